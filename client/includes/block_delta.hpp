@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+// rsync-style block delta (FILES_SIGNATURE / FILES_PATCH / FILES_DELTA in protocol.hpp).
+// Shared by client and server: keep client/includes/block_delta.hpp and
+// client/src/block_delta.cpp identical to the server copies.
+//
+// The receiver cuts its copy of the file (the base) into fixed-size blocks and publishes a
+// signature: a weak rolling checksum (rsync's Adler-style a + b << 16) and a strong hash
+// (SHA-256 truncated to STRONG_HASH_BYTES) per block. The sender slides a window over the new
+// file one byte at a time, rolling the weak checksum; a weak hit is confirmed with the strong
+// hash, then becomes a "copy blocks" op, everything else becomes literal data. The receiver
+// rebuilds the file from its base plus the delta into a temp file and renames it over the base.
+//
+// Wire formats (integers little-endian):
+//   signature: "FSIG" u32 block_size u64 file_size, then per block: u32 weak, 16 bytes strong
+//   delta:     "FDLT" u32 block_size, then ops:
+//                'C' u64 first_block u32 block_count   copy from the base
+//                'D' u32 length, length bytes           literal data
+//                'E' u64 result_size                    end of delta
+namespace BlockDelta {
+    constexpr std::uint32_t MIN_BLOCK_SIZE = 2048;
+    constexpr std::uint32_t MAX_BLOCK_SIZE = 1u << 20;
+    constexpr std::size_t STRONG_HASH_BYTES = 16;
+    constexpr std::uint64_t MAX_SIGNATURE_BLOCKS = 1u << 24; // Chặn signature giả mạo quá lớn
+    // Mặc định cho ngưỡng dùng delta (server: transfer.delta_* trong config.properties)
+    constexpr std::uint64_t DEFAULT_MIN_FILE_SIZE = 1u << 20; // File nhỏ hơn: gửi nguyên file
+    constexpr int DEFAULT_MAX_DELTA_PERCENT = 70;             // Delta lớn hơn % này của file: gửi nguyên file
+
+    struct BlockSignature {
+        std::uint32_t weak = 0;
+        std::array<unsigned char, STRONG_HASH_BYTES> strong{};
+    };
+
+    struct Signature {
+        std::uint32_t block_size = 0;
+        std::uint64_t file_size = 0;
+        std::vector<BlockSignature> blocks; // ceil(file_size / block_size), block cuối có thể ngắn hơn
+    };
+
+    struct DeltaStats {
+        std::uint64_t copied_bytes = 0;  // Lấy lại từ base
+        std::uint64_t literal_bytes = 0; // Gửi kèm trong delta
+        std::uint64_t delta_bytes = 0;   // Kích thước delta đã ghi
+    };
+
+    // ~sqrt(file_size) như rsync, trong [MIN_BLOCK_SIZE, MAX_BLOCK_SIZE]
+    std::uint32_t block_size_for(std::uint64_t file_size);
+
+    std::uint32_t weak_checksum(const unsigned char* data, std::size_t length);
+
+    // Đọc base tới EOF. false nếu lỗi đọc.
+    bool compute_signature(std::istream& base, std::uint32_t block_size, Signature& out);
+    bool write_signature(const Signature& signature, std::ostream& out);
+    // false nếu sai định dạng (magic, block_size ngoài khoảng, số block không khớp file_size)
+    bool read_signature(std::istream& in, Signature& out);
+
+    // Delta biến base (mô tả bởi signature) thành nội dung đọc từ target.
+    bool write_delta(const Signature& base_signature, std::istream& target, std::ostream& out, DeltaStats* stats = nullptr);
+    // base phải seek được. false nếu delta sai định dạng hoặc tham chiếu ngoài base.
+    bool apply_delta(std::istream& base, std::istream& delta, std::ostream& out, std::uint64_t* result_size = nullptr);
+
+    // Delta có đáng gửi thay cho nguyên file không
+    inline bool delta_worthwhile(std::uint64_t delta_size, std::uint64_t file_size, int max_delta_percent) {
+        return delta_size * 100 <= file_size * static_cast<std::uint64_t>(max_delta_percent < 0 ? 0 : max_delta_percent);
+    }
+} // namespace BlockDelta
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+
+// Content-defined chunking (FastCDC) for the deduplicated chunk store (FILES_CHUNKS_* in protocol.hpp).
+// Shared by client and server: keep client/includes/fastcdc.hpp and client/src/fastcdc.cpp
+// identical to the server copies, both sides must cut the same file at the same offsets.
+//
+// A gear hash (fp = (fp << 1) + GEAR[byte]) rolls over the data; a cut falls where the masked
+// bits of fp are all zero. No cut before MIN_SIZE, a stricter mask until AVG_SIZE and a looser
+// one after it ("normalized chunking", keeps chunk sizes close to AVG_SIZE), a forced cut at
+// MAX_SIZE. Cuts depend only on nearby content, so an insert or delete moves the boundaries of
+// one or two chunks and every other chunk keeps its hash.
+//
+// A chunk is named by the SHA-256 (hex) of its content.
+//
+// Chunk upload frame (FILES_CHUNKS body, repeated until EOF; integers little-endian):
+//   32 bytes raw SHA-256, u32 length, length bytes
+namespace FastCdc {
+    constexpr std::uint32_t MIN_SIZE = 16 * 1024;
+    constexpr std::uint32_t AVG_SIZE = 64 * 1024;
+    constexpr std::uint32_t MAX_SIZE = 256 * 1024;
+    constexpr std::size_t HASH_BYTES = 32;
+
+    // Độ dài chunk đầu tiên của data[0, length) (= length nếu length <= MIN_SIZE)
+    std::size_t cut_point(const unsigned char* data, std::size_t length);
+
+    // Đọc in tới EOF, gọi on_chunk cho từng chunk theo thứ tự. false nếu lỗi đọc hoặc on_chunk trả về false.
+    using ChunkCallback = std::function<bool(const unsigned char* data, std::size_t length)>;
+    bool split(std::istream& in, const ChunkCallback& on_chunk);
+
+    std::string chunk_hash(const unsigned char* data, std::size_t length); // SHA-256 hex
+    bool is_chunk_hash(const std::string& hash);                            // 64 ký tự hex thường
+
+    bool write_frame(std::ostream& out, const std::string& hash, const unsigned char* data, std::size_t length);
+    // false khi hết dữ liệu (eof = true) hoặc frame sai định dạng / dài hơn MAX_SIZE (eof = false)
+    bool read_frame(std::istream& in, std::string& hash, std::string& data, bool& eof);
+} // namespace FastCdc
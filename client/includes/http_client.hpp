@@ -12,6 +12,8 @@
 #include "protocol.hpp"     // File protocol.hpp của bạn
 #include <Poco/Net/HTMLForm.h>
 #include <Poco/File.h> // Cho Poco::File
+#include <functional>
+#include "http_session_pool.hpp"
 
 // Forward declaration cho các struct/enum nếu chúng được định nghĩa ở nơi khác
 // và bạn chỉ muốn dùng con trỏ/tham chiếu ở đây.
@@ -32,6 +34,7 @@ enum class ClientSyncErrorCode {
     ERROR_BAD_REQUEST,          // 400
     ERROR_SERVER_ERROR,         // 5xx
     ERROR_CONFLICT,             // 409
+    ERROR_RATE_LIMITED,         // 429, chờ ApiResponse::retry_after_seconds rồi gửi lại
     ERROR_JSON_PARSE,           // Lỗi parse JSON response
     ERROR_LOCAL_FILE_IO,        // Lỗi đọc/ghi file cục bộ khi upload/download
     ERROR_MULTIPART_FORM,       // Lỗi tạo hoặc gửi multipart form
@@ -40,12 +43,20 @@ enum class ClientSyncErrorCode {
 
 const char* clientSyncErrorCodeToString(ClientSyncErrorCode code);
 
+// Định dạng manifest gửi lên / nhận về (CBOR, MessagePack: dạng compact, xem CompactManifest trong protocol.hpp)
+enum class ManifestFormat { JSON, CBOR, MSGPACK };
+
+const char* manifestFormatToString(ManifestFormat format);
+// "json" / "cbor" / "msgpack" (không phân biệt hoa thường); giá trị lạ trả về std::nullopt
+std::optional<ManifestFormat> manifestFormatFromString(const std::string& name);
+
 struct ApiResponse {
     long statusCode = 0; // Mặc định là 0 nếu request không đến được server
     json body;           // Sẽ là object rỗng nếu không có body hoặc parse lỗi
     std::string raw_body_if_not_json; // Lưu body nếu không phải JSON và có lỗi
     std::string error_message;
     ClientSyncErrorCode error_code = ClientSyncErrorCode::SUCCESS;
+    int retry_after_seconds = 0; // Header Retry-After (429 / 503), 0 = không có
 
     bool isSuccess() const {
         return statusCode >= 200 && statusCode < 300 && error_code == ClientSyncErrorCode::SUCCESS;
@@ -54,7 +65,8 @@ struct ApiResponse {
 
 class HttpClient {
 public:
-    HttpClient(const std::string& base_url, Poco::Timespan timeout = Poco::Timespan(30, 0)); // Timeout 30 giây
+    HttpClient(const std::string& base_url, Poco::Timespan timeout = Poco::Timespan(30, 0), // Timeout 30 giây
+               HttpSessionPool::Options pool_options = HttpSessionPool::Options());
 
     // Auth
     ApiResponse login(const std::string& username, const std::string& password);
@@ -65,20 +77,67 @@ public:
     ApiResponse uploadFile(const std::string& token, const std::string& localFilePath, const std::string& serverRelativePath);
     // downloadFile sẽ stream trực tiếp vào file, trả về error code để đơn giản hơn
     ClientSyncErrorCode downloadFile(const std::string& token, const std::string& serverRelativePath, const std::string& localSavePath);
+    // Block delta (BlockDelta trong protocol.hpp): signature của bản trên server; gửi delta lên
+    // (body stream từ file); gửi signature của bản cục bộ và nhận delta hoặc nguyên file
+    // (isDelta = false) vào localSavePath.
+    ClientSyncErrorCode getFileSignature(const std::string& token, const std::string& serverRelativePath,
+                                         std::string& signature, std::string& serverChecksum);
+    ApiResponse uploadDelta(const std::string& token, const std::string& localDeltaPath, const std::string& serverRelativePath,
+                            const std::string& baseChecksum, const std::string& newChecksum);
+    ClientSyncErrorCode downloadDelta(const std::string& token, const std::string& serverRelativePath, const std::string& localSignature,
+                                      const std::string& localSavePath, bool& isDelta, std::string& serverChecksum);
+    // Upload theo chunk (ChunkedUpload trong protocol.hpp): hỏi chunk nào server còn thiếu
+    // (body["missing"]), gửi các frame chunk (FastCdc::write_frame), rồi commit danh sách chunk thành file.
+    // Tạo file từ nội dung server đã có (FILES_CLAIM); 404 = chưa có, phải upload.
+    ApiResponse claimFile(const std::string& token, const std::string& serverRelativePath, const std::string& checksum);
+    ApiResponse queryMissingChunks(const std::string& token, const std::vector<std::string>& chunkHashes);
+    ApiResponse uploadChunks(const std::string& token, const std::string& frames);
+    ApiResponse commitChunks(const std::string& token, const std::string& serverRelativePath, const std::string& checksum,
+                             const std::vector<std::string>& chunkHashes);
     ApiResponse listDirectory(const std::string& token, const std::string& serverRelativePath = "."); // Mặc định là thư mục gốc
     ApiResponse createDirectory(const std::string& token, const std::string& serverRelativePath);
     ApiResponse deletePath(const std::string& token, const std::string& serverRelativePath);
     ApiResponse renamePath(const std::string& token, const std::string& oldServerRelativePath, const std::string& newServerRelativePath);
+    // Nhiều mkdir / delete / rename trong một request (MetadataBatch trong protocol.hpp); body["results"] theo thứ tự
+    ApiResponse batchMetadata(const std::string& token, const json& operations, bool atomic);
 
     // Sync
-    ApiResponse postSyncManifest(const std::string& token, const json& clientManifest);
+    // clientManifest phải đúng dạng của format (object JSON hoặc mảng compact); response cũng được
+    // yêu cầu theo format đó và được giải mã vào ApiResponse::body.
+    ApiResponse postSyncManifest(const std::string& token, const json& clientManifest, ManifestFormat format = ManifestFormat::JSON);
+    // Như trên nhưng xin plan dạng stream (PlanStream): onOperation được gọi với từng operation ngay khi
+    // nhận được, body chỉ là dòng cuối {"status", "count"}. Server cũ trả cả plan vào body như postSyncManifest.
+    ApiResponse streamSyncManifest(const std::string& token, const json& clientManifest, ManifestFormat format,
+                                   const std::function<void(const json&)>& onOperation);
+    // {"directories": [{"path", "hash"}]} -> hash của server và các con của thư mục khác hash (MerkleTree)
+    ApiResponse postSyncTree(const std::string& token, const json& directories, ManifestFormat format = ManifestFormat::JSON);
+    // Long-poll SYNC_WATCH: trả về khi tree hash của server khác lastHash hoặc hết timeoutSeconds.
+    // timeoutSeconds bị giới hạn dưới timeout của session để request không bị cắt giữa chừng.
+    ApiResponse watchChanges(const std::string& token, const std::string& lastHash, int timeoutSeconds);
+
+    // Thống kê kết nối keep-alive (tạo mới / dùng lại / bỏ vì hỏng)
+    HttpSessionPool::Stats connectionStats() const { return session_pool_.stats(); }
 
 private:
     Poco::URI server_uri_base_; // Lưu URI gốc của server
     Poco::Timespan default_timeout_;
+    HttpSessionPool session_pool_; // Kết nối keep-alive tới server_uri_base_, dùng chung giữa các thread
 
+    // Gửi request trên một session của pool và nhận header response; lease giữ session đến khi
+    // caller đọc hết body rồi gọi lease.release(). Nếu session lấy từ pool hoá ra đã bị server đóng
+    // và retryable = true, request được gửi lại một lần trên kết nối mới.
+    std::istream& exchange(HttpSessionPool::Lease& lease, Poco::Net::HTTPRequest& request, Poco::Net::HTTPResponse& response,
+                           const std::function<void(std::ostream&)>& writeBody, bool retryable);
     // Hàm helper chung để gửi request và nhận response
-    ApiResponse performRequest(Poco::Net::HTTPRequest& request, const std::string& requestBody = "", Poco::Net::HTTPClientSession* existingSession = nullptr);
+    // onNdjsonLine: response 2xx kiểu application/x-ndjson được đọc từng dòng thay vì giữ cả body
+    ApiResponse performRequest(Poco::Net::HTTPRequest& request, const std::string& requestBody = "",
+                               const std::function<void(const json&)>& onNdjsonLine = nullptr);
+    // Như trên nhưng body được ghi bởi writeBody (caller tự đặt Content-Length / Content-Type)
+    ApiResponse performRequest(Poco::Net::HTTPRequest& request, const std::function<void(std::ostream&)>& writeBody,
+                               const std::function<void(const json&)>& onNdjsonLine = nullptr);
+    // POST body manifest / tree sync theo format (JSON hoặc CBOR / MessagePack compact)
+    ApiResponse postManifestBody(const std::string& path, const std::string& token, const json& payload, ManifestFormat format,
+                                 const std::function<void(const json&)>& onNdjsonLine = nullptr);
     // Hàm helper cho multipart (upload)
-    ApiResponse performMultipartUpload(Poco::Net::HTTPRequest& request, Poco::Net::HTMLForm& form, Poco::Net::HTTPClientSession* existingSession = nullptr);
+    ApiResponse performMultipartUpload(Poco::Net::HTTPRequest& request, Poco::Net::HTMLForm& form);
 };
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <Poco/Net/HTTPClientSession.h>
+#include <Poco/Timespan.h>
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Pool các HTTPClientSession keep-alive tới một server (host:port).
+// Mỗi request mượn một session (Lease) và trả lại sau khi đã đọc hết response,
+// nên các request tiếp theo dùng lại kết nối TCP thay vì bắt tay lại từ đầu.
+// Thread-safe: nhiều thread có thể acquire() cùng lúc, mỗi Lease chỉ dùng bởi một thread.
+class HttpSessionPool {
+public:
+    struct Options {
+        std::size_t max_idle = 4;                  // Session rảnh giữ lại tối đa
+        std::chrono::seconds idle_timeout{8};      // Nên nhỏ hơn keep-alive timeout của server (Poco: 10s)
+        Poco::Timespan timeout{30, 0};             // Send/receive timeout của từng session
+    };
+
+    struct Stats {
+        std::uint64_t created = 0;
+        std::uint64_t reused = 0;
+        std::uint64_t discarded_stale = 0;   // Server đã đóng kết nối khi session đang nằm trong pool
+        std::uint64_t discarded_idle = 0;    // Rảnh quá idle_timeout
+        std::size_t idle = 0;
+    };
+
+    class Lease {
+    public:
+        Lease() = default;
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&& other) noexcept;
+        ~Lease();
+
+        Poco::Net::HTTPClientSession& session() { return *session_; }
+        // true nếu kết nối được lấy lại từ pool (có thể đã bị server đóng giữa chừng)
+        bool reused() const { return reused_; }
+
+        // Trả session về pool. Chỉ gọi khi response đã được đọc hết; reusable = false
+        // (ví dụ server trả "Connection: close") thì session bị đóng.
+        // Lease bị huỷ mà chưa release (exception giữa chừng) cũng đóng session.
+        void release(bool reusable);
+
+    private:
+        friend class HttpSessionPool;
+        Lease(HttpSessionPool* pool, std::unique_ptr<Poco::Net::HTTPClientSession> session, bool reused)
+            : pool_(pool), session_(std::move(session)), reused_(reused) {}
+
+        HttpSessionPool* pool_ = nullptr;
+        std::unique_ptr<Poco::Net::HTTPClientSession> session_;
+        bool reused_ = false;
+    };
+
+    HttpSessionPool(const std::string& host, unsigned short port);
+    HttpSessionPool(const std::string& host, unsigned short port, Options options);
+
+    HttpSessionPool(const HttpSessionPool&) = delete;
+    HttpSessionPool& operator=(const HttpSessionPool&) = delete;
+
+    // Session rảnh gần nhất còn sống, nếu không có thì tạo mới (kết nối khi gửi request đầu tiên).
+    Lease acquire();
+    // Luôn tạo session mới, dùng khi gửi lại request sau khi kết nối cũ hỏng.
+    Lease acquire_fresh();
+
+    // Đóng mọi session đang rảnh.
+    void clear();
+
+    Stats stats() const;
+    const std::string& host() const { return host_; }
+    unsigned short port() const { return port_; }
+
+private:
+    struct IdleSession {
+        std::unique_ptr<Poco::Net::HTTPClientSession> session;
+        std::chrono::steady_clock::time_point idle_since;
+    };
+
+    std::unique_ptr<Poco::Net::HTTPClientSession> create_session();
+    void give_back(std::unique_ptr<Poco::Net::HTTPClientSession> session);
+    // Kết nối rảnh mà đọc được (EOF/RST hoặc dữ liệu lạ) nghĩa là không dùng lại được nữa.
+    static bool is_healthy(Poco::Net::HTTPClientSession& session);
+
+    const std::string host_;
+    const unsigned short port_;
+    const Options options_;
+
+    mutable std::mutex mutex_;
+    std::deque<IdleSession> idle_;   // Cuối deque = vừa trả về gần nhất
+    Stats stats_;
+};
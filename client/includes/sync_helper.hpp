@@ -5,6 +5,8 @@
 #include "auth_manager.hpp"     // Để quản lý đăng nhập và token
 #include "local_file_system.hpp"// Để thao tác file cục bộ
 #include "file_watcher_helper.hpp"// Để có thể bỏ qua sự kiện inotify
+#include "tree_hash.hpp"        // Tree hash thư mục cục bộ cho SYNC_TREE
+#include "sync_plan_executor.hpp" // Chạy sync plan song song theo DAG
 #include "utils.hpp"            // Cho các hàm tiện ích như trim
 #include "json.hpp"             // nlohmann/json
 
@@ -16,6 +18,7 @@
 #include <sstream>   // Cho std::stringstream
 #include <algorithm> // Cho std::find, std::remove
 #include <stdexcept> // Cho std::runtime_error
+#include <mutex>     // Cho watch_mutex_
 
 // Forward declaration nếu FileWatcherHelper chỉ cần con trỏ/tham chiếu ở đây
 // class FileWatcherHelper; // Nếu không include đầy đủ file_watcher_helper.hpp
@@ -65,6 +68,13 @@ public:
     // Hàm chính để kích hoạt quá trình đồng bộ dựa trên manifest
     void triggerManifestSync();
 
+    enum class WatchResult { CHANGED, UNCHANGED, BUSY, UNSUPPORTED, FAILED };
+    // Chờ server báo thay đổi (SYNC_WATCH long-poll), gọi từ thread riêng song song với các hàm trên.
+    // Chỉ dùng token mà triggerManifestSync đã có (AuthManager không thread-safe): trước lần sync
+    // đầu tiên trả về FAILED; 401 trả về CHANGED để lần sync kế tiếp đăng nhập lại. BUSY: server
+    // trả lời ngay kèm Retry-After (không giữ được thêm watcher), caller chờ trước khi watch lại.
+    WatchResult watchServerChanges(int timeoutSeconds);
+
     // (Tùy chọn) Lấy danh sách file từ server (có thể dùng để so sánh hoặc cho UI)
     // std::optional<std::vector<std::string>> get_files_list_from_server(const std::string& serverRelativePath);
 
@@ -78,14 +88,73 @@ private:
     std::string watcher_root_path_; // Đường dẫn tuyệt đối đến thư mục gốc đang theo dõi cục bộ
     app::AppData app_data_;         // Trạng thái file đã biết (từ app_data.json)
     std::string app_data_file_path_; // Đường dẫn đến file app_data.json
+    ManifestFormat manifest_format_ = ManifestFormat::MSGPACK; // manifest_format trong config; về JSON nếu server cũ từ chối
+    bool tree_sync_supported_ = true; // false khi server cũ không có SYNC_TREE: luôn gửi manifest đầy đủ
+    bool batch_supported_ = true;     // false khi server cũ không có FILES_BATCH: mỗi thao tác một request
+    SyncPlanExecutor::Options sync_options_; // sync_workers, sync_max_connections, ... trong config
+
+    // AuthManager không thread-safe: khi chạy sync plan song song, mọi truy cập đi qua hai hàm này
+    std::mutex auth_mutex_;
+    // Token đang có, không gọi mạng (mỗi operation của plan đều gọi); chưa có thì đăng nhập.
+    // Throw nếu thất bại. Token hết hạn được phát hiện qua 401 của chính request và renewToken.
+    std::string currentToken();
+    // Sau 401 với token rejected: đăng nhập lại, trừ khi thread khác đã lấy token mới
+    std::string renewToken(const std::string& rejected);
+    // Gửi request với currentToken(); 401 thì renewToken và gửi lại một lần
+    ApiResponse withToken(const std::function<ApiResponse(const std::string&)>& request);
+
+    // Dùng chung với thread watch
+    std::mutex watch_mutex_;
+    std::string watch_token_;  // Token mới nhất của triggerManifestSync
+    std::string watch_hash_;   // Root tree hash server trả về lần watch trước ("" = chưa có)
+    void publishWatchToken(const std::string& token);
 
     // Hàm private để quản lý app_data.json
+    // Khi đang chạy sync plan, add/remove chỉ đánh dấu dirty và processServerOperations ghi file một lần ở cuối
+    std::mutex app_data_mutex_;
+    bool app_data_deferred_ = false;
+    bool app_data_dirty_ = false;
     void loadAppData();
     void saveAppData();
     void addPathToAppData(const std::string& relativePath);
     void removePathFromAppData(const std::string& relativePath);
 
     // Hàm private để thực hiện các bước trong triggerManifestSync
-    json buildClientManifest();
+    // Theo manifest_format_: object JSON hoặc entry compact. Có scope: chỉ các con trực tiếp của
+    // những thư mục đó (kèm tombstone) và key "scope" để server chỉ so các thư mục này.
+    json buildClientManifest(const std::vector<LocalFileInfo>& local_files, const std::vector<std::string>* scope = nullptr);
+    // Đi cây từ gốc qua SYNC_TREE, trả về các thư mục có hash khác server (rỗng: không có gì thay đổi).
+    // nullopt nếu server không hỗ trợ SYNC_TREE.
+    std::optional<std::vector<std::string>> findChangedDirectories(std::string& token, const LocalTreeHashes& tree);
     void processServerOperations(const json& operationsArray);
+    // Plan stream (PlanStream trong protocol.hpp): mỗi operation chạy ngay khi tới. Các mkdir /
+    // MOVE_ON_SERVER liên tiếp được giữ lại trong batchable và gửi chung qua FILES_BATCH trước khi
+    // operation khác vào stream (operation sau có thể nằm trong thư mục vừa tạo).
+    struct PlanRun {
+        explicit PlanRun(const SyncPlanExecutor::Options& options, SyncPlanExecutor::Runner runner);
+        SyncPlanExecutor executor;
+        SyncPlanExecutor::Stream stream;
+        std::vector<SyncPlanExecutor::Task> batchable;
+    };
+    void addPlanOperation(PlanRun& run, const json& operation);
+    void flushPlanBatch(PlanRun& run);
+    // Operation của server -> task cho executor; nullopt nếu thiếu relative_path
+    std::optional<SyncPlanExecutor::Task> taskFromOperation(const json& operation) const;
+    // Giữ app_data trong bộ nhớ khi plan chạy; end ghi file một lần và in tổng kết
+    void beginPlanExecution();
+    void endPlanExecution(const SyncPlanExecutor::Progress& progress);
+    // Gửi các mkdir và MOVE_ON_SERVER của plan qua FILES_BATCH (vài request thay vì mỗi thao tác một
+    // request) và bỏ những thao tác đã xong khỏi tasks; phần còn lại chạy từng request như trước.
+    void flushMetadataBatch(std::vector<SyncPlanExecutor::Task>& tasks);
+    // Một operation của plan, gọi từ worker của SyncPlanExecutor. Throw nếu lỗi để executor thử lại
+    void executeServerOperation(const SyncPlanExecutor::Task& task);
+
+    // Block delta cho file lớn đã có ở cả hai phía (BlockDelta trong protocol.hpp). Server cũ,
+    // file mới, delta không đáng hoặc bị từ chối: truyền nguyên file như trước.
+    ApiResponse uploadWithDelta(const std::string& token, const fs::path& localFullPath, const std::string& serverRelativePath);
+    ClientSyncErrorCode downloadWithDelta(const std::string& token, const std::string& serverRelativePath, const fs::path& localFullPath);
+    // File mới: cắt bằng FastCDC và chỉ gửi các chunk server còn thiếu (ChunkedUpload trong protocol.hpp).
+    // Lỗi (kể cả server cũ không có endpoint) được trả về để caller upload nguyên file.
+    ApiResponse uploadWithChunks(const std::string& token, const fs::path& localFullPath, const std::string& serverRelativePath,
+                                 const std::string& checksum);
 };
\ No newline at end of file
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Thực thi sync plan (SYNC_OPERATIONS của server) bằng một pool worker thay vì từng operation một:
+// plan 10k file nhỏ bị giới hạn bởi round-trip chứ không phải băng thông.
+//
+// Thứ tự cần giữ được biểu diễn bằng một DAG:
+//   - operation tạo thư mục (creates_directory) chạy trước mọi operation nằm dưới thư mục đó,
+//   - DELETE_ON_CLIENT / DELETE_ON_SERVER chạy sau mọi MOVE_* (move có thể lấy file ra khỏi
+//     thư mục sắp bị xoá),
+//   - còn lại chạy song song, ưu tiên theo thứ tự trong plan.
+// Operation bị lỗi được thử lại tối đa max_attempts lần; hết lượt thì các operation phụ thuộc vào
+// nó bị bỏ qua (skipped). Giới hạn số operation dùng mạng chạy cùng lúc (max_connections) và tổng
+// byte đang truyền (max_inflight_bytes, một operation lớn hơn giới hạn vẫn chạy được khi nó chạy một mình).
+// Runner throw RetryLater khi server bảo chờ (429 / 503 + Retry-After): operation được chạy lại sau
+// delay mà không tốn lượt thử, và trong lúc đó không worker nào bắt đầu operation mới.
+// workers <= 1 chạy tuần tự trên thread gọi run(), cùng thứ tự như trước khi có executor.
+//
+// Stream nhận task dần dần (plan stream NDJSON, PlanStream trong protocol.hpp) và chạy ngay khi
+// task vào. Dependency chỉ nối về task đã add trước đó, nên thứ tự add phải là thứ tự server gửi:
+// thư mục trước nội dung của nó, DELETE_* sau các MOVE_* (server đảm bảo cả hai).
+class SyncPlanExecutor {
+public:
+    struct Task {
+        std::string action;             // Tên action (SYNC_ACTION_NAMES trong protocol.hpp)
+        std::string path;               // relative_path
+        std::string old_path;           // MOVE_ON_SERVER / MOVE_ON_CLIENT
+        std::uint64_t bytes = 0;        // Ước lượng số byte truyền (0 = không biết / không truyền)
+        bool creates_directory = false;
+        bool uses_network = true;
+    };
+
+    struct RetryLater : std::runtime_error {
+        RetryLater(const std::string& what, std::chrono::milliseconds delay) : std::runtime_error(what), delay(delay) {}
+        std::chrono::milliseconds delay;
+    };
+
+    struct Options {
+        unsigned workers = 4;                           // <= 1: tuần tự
+        unsigned max_connections = 4;                   // Operation dùng mạng chạy cùng lúc
+        std::uint64_t max_inflight_bytes = 64u << 20;   // Tổng Task::bytes đang chạy
+        unsigned max_attempts = 3;
+        std::chrono::milliseconds retry_backoff{500};   // Lần thử thứ n chờ n * retry_backoff
+        unsigned max_retry_later = 30;                  // RetryLater tối đa cho một operation, quá thì tính là lỗi
+    };
+
+    struct Progress {
+        std::size_t total = 0;
+        std::size_t succeeded = 0;
+        std::size_t failed = 0;
+        std::size_t skipped = 0;        // Phụ thuộc vào operation bị lỗi
+        std::size_t retries = 0;
+        std::size_t throttled = 0;      // Lần chờ theo RetryLater
+        std::uint64_t bytes_total = 0;
+        std::uint64_t bytes_done = 0;
+        std::size_t finished() const { return succeeded + failed + skipped; }
+    };
+
+    // Thực hiện một operation, throw nếu lỗi (sẽ được thử lại). Được gọi từ nhiều thread cùng lúc.
+    using Runner = std::function<void(const Task&)>;
+    // Gọi sau mỗi operation kết thúc, tuần tự (không bao giờ hai lần cùng lúc).
+    using ProgressCallback = std::function<void(const Task&, const Progress&)>;
+
+    class Stream;
+
+    explicit SyncPlanExecutor(Options options);
+
+    Progress run(const std::vector<Task>& tasks, const Runner& runner, const ProgressCallback& on_progress = nullptr) const;
+
+    // Cạnh của DAG: dependencies[i] là các task phải xong trước task i. Dùng bởi run(), public để kiểm tra.
+    static std::vector<std::vector<std::size_t>> build_dependencies(const std::vector<Task>& tasks);
+
+    const Options& options() const { return options_; }
+
+private:
+    struct State;
+
+    Options options_;
+};
+
+// Worker chạy nền trong suốt đời Stream; finish() chờ mọi task đã add xong.
+class SyncPlanExecutor::Stream {
+public:
+    Stream(const SyncPlanExecutor& executor, Runner runner, ProgressCallback on_progress = nullptr);
+    ~Stream();
+
+    Stream(const Stream&) = delete;
+    Stream& operator=(const Stream&) = delete;
+
+    void add(Task task);
+    // Không add thêm được nữa. Gọi lần hai trả lại cùng kết quả.
+    Progress finish();
+
+private:
+    std::unique_ptr<State> state_;
+    std::vector<std::thread> threads_;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "local_file_system.hpp" // LocalFileInfo
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Tree hash của các thư mục cục bộ, tính bottom-up từ một lần scan theo cùng quy tắc với server
+// (MerkleTree trong protocol.hpp). Path tương đối so với sync root, "" là chính sync root.
+class LocalTreeHashes {
+public:
+    struct Child {
+        std::string name;
+        bool isDirectory = false;
+        std::string value; // file: checksum hex; thư mục: tree hash của nó
+    };
+
+    explicit LocalTreeHashes(const std::vector<LocalFileInfo>& files);
+
+    bool hasDirectory(const std::string& dirPath) const { return dirs_.count(dirPath) > 0; }
+    // "" nếu thư mục không có ở client (giống server báo thư mục không tồn tại)
+    std::string hashOf(const std::string& dirPath) const;
+    // Các con trực tiếp, đã sắp theo tên
+    const std::vector<Child>& childrenOf(const std::string& dirPath) const;
+    // dirPath và mọi thư mục con của nó (thư mục chỉ có ở client: không cần hỏi server)
+    void collectSubtree(const std::string& dirPath, std::vector<std::string>& out) const;
+
+    static std::string joinPath(const std::string& dirPath, const std::string& name) {
+        return dirPath.empty() ? name : dirPath + "/" + name;
+    }
+
+private:
+    struct Dir {
+        std::vector<Child> children;
+        std::string hash;
+    };
+    std::map<std::string, Dir> dirs_;
+};
+
+// Tree hash (hex) từ các con trực tiếp; children được sắp lại theo tên.
+std::string computeTreeHash(std::vector<LocalTreeHashes::Child>& children);
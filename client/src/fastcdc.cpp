@@ -0,0 +1,136 @@
+#include "fastcdc.hpp"
+
+#include <openssl/evp.h>
+#include <array>
+#include <cstring>
+#include <vector>
+
+namespace FastCdc {
+
+namespace {
+    // Mask kiểm tra các bit cao của fp: bit cao chịu ảnh hưởng của ~64 byte gần nhất
+    constexpr std::uint64_t MASK_S = ~0ull << (64 - 18); // Khó hơn log2(AVG_SIZE) 2 bit: trước AVG_SIZE
+    constexpr std::uint64_t MASK_L = ~0ull << (64 - 14); // Dễ hơn 2 bit: sau AVG_SIZE
+
+    // Bảng gear cố định (splitmix64 từ một seed hằng): client và server phải có cùng bảng
+    const std::array<std::uint64_t, 256>& gear() {
+        static const std::array<std::uint64_t, 256> table = [] {
+            std::array<std::uint64_t, 256> t{};
+            std::uint64_t state = 0x46617374434443ull; // "FastCDC"
+            for (auto& value : t) {
+                std::uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+                value = z ^ (z >> 31);
+            }
+            return t;
+        }();
+        return table;
+    }
+
+    const char HEX[] = "0123456789abcdef";
+
+    int hex_value(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    }
+}
+
+std::size_t cut_point(const unsigned char* data, std::size_t length) {
+    if (length <= MIN_SIZE) return length;
+    const std::size_t end = length < MAX_SIZE ? length : MAX_SIZE;
+    const std::size_t normal = end < AVG_SIZE ? end : AVG_SIZE;
+    const auto& table = gear();
+
+    std::uint64_t fp = 0;
+    std::size_t i = MIN_SIZE;
+    for (; i < normal; ++i) {
+        fp = (fp << 1) + table[data[i]];
+        if (!(fp & MASK_S)) return i + 1;
+    }
+    for (; i < end; ++i) {
+        fp = (fp << 1) + table[data[i]];
+        if (!(fp & MASK_L)) return i + 1;
+    }
+    return end;
+}
+
+bool split(std::istream& in, const ChunkCallback& on_chunk) {
+    std::vector<unsigned char> buffer(2 * static_cast<std::size_t>(MAX_SIZE));
+    std::size_t begin = 0, end = 0;
+    bool eof = false;
+    while (true) {
+        // Giữ ít nhất MAX_SIZE byte trong buffer để cut_point thấy đủ một chunk dài nhất
+        if (!eof && end - begin < MAX_SIZE) {
+            if (begin > 0) {
+                std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+                end -= begin;
+                begin = 0;
+            }
+            in.read(reinterpret_cast<char*>(buffer.data() + end), static_cast<std::streamsize>(buffer.size() - end));
+            end += static_cast<std::size_t>(in.gcount());
+            if (!in) {
+                if (in.bad()) return false;
+                eof = true;
+            }
+            continue;
+        }
+        if (begin == end) return true;
+        const std::size_t length = cut_point(buffer.data() + begin, end - begin);
+        if (!on_chunk(buffer.data() + begin, length)) return false;
+        begin += length;
+    }
+}
+
+std::string chunk_hash(const unsigned char* data, std::size_t length) {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_length = 0;
+    EVP_Digest(data, length, digest, &digest_length, EVP_sha256(), nullptr);
+    std::string hex(2 * digest_length, '0');
+    for (unsigned int i = 0; i < digest_length; ++i) {
+        hex[2 * i] = HEX[digest[i] >> 4];
+        hex[2 * i + 1] = HEX[digest[i] & 0x0f];
+    }
+    return hex;
+}
+
+bool is_chunk_hash(const std::string& hash) {
+    if (hash.size() != 2 * HASH_BYTES) return false;
+    for (char c : hash) {
+        if (hex_value(c) < 0) return false;
+    }
+    return true;
+}
+
+bool write_frame(std::ostream& out, const std::string& hash, const unsigned char* data, std::size_t length) {
+    if (!is_chunk_hash(hash) || length > MAX_SIZE) return false;
+    unsigned char header[HASH_BYTES + 4];
+    for (std::size_t i = 0; i < HASH_BYTES; ++i) {
+        header[i] = static_cast<unsigned char>(hex_value(hash[2 * i]) << 4 | hex_value(hash[2 * i + 1]));
+    }
+    for (int i = 0; i < 4; ++i) header[HASH_BYTES + i] = static_cast<unsigned char>(length >> (8 * i));
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(length));
+    return static_cast<bool>(out);
+}
+
+bool read_frame(std::istream& in, std::string& hash, std::string& data, bool& eof) {
+    unsigned char header[HASH_BYTES + 4];
+    in.read(reinterpret_cast<char*>(header), sizeof(header));
+    eof = in.gcount() == 0 && in.eof();
+    if (in.gcount() != static_cast<std::streamsize>(sizeof(header))) return false;
+
+    hash.assign(2 * HASH_BYTES, '0');
+    for (std::size_t i = 0; i < HASH_BYTES; ++i) {
+        hash[2 * i] = HEX[header[i] >> 4];
+        hash[2 * i + 1] = HEX[header[i] & 0x0f];
+    }
+    std::uint32_t length = 0;
+    for (int i = 0; i < 4; ++i) length |= static_cast<std::uint32_t>(header[HASH_BYTES + i]) << (8 * i);
+    if (length > MAX_SIZE) return false;
+    data.resize(length);
+    return length == 0 || static_cast<bool>(in.read(&data[0], length));
+}
+
+} // namespace FastCdc
@@ -17,9 +17,43 @@
 #include <Poco/Net/NetException.h>
 #include <Poco/UUIDGenerator.h> // Thêm include này để tạo boundary duy nhất
 #include <Poco/String.h>
+#include <Poco/InflatingStream.h> // Giải nén response gzip
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <vector>
+
+// zstd chỉ được quảng bá trong Accept-Encoding khi build có libzstd.
+#ifndef SYNC_CLIENT_HAVE_ZSTD
+#if __has_include(<zstd.h>)
+#define SYNC_CLIENT_HAVE_ZSTD 1
+#else
+#define SYNC_CLIENT_HAVE_ZSTD 0
+#endif
+#endif
+#if SYNC_CLIENT_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+
+
+
+const char* manifestFormatToString(ManifestFormat format) {
+    switch (format) {
+        case ManifestFormat::CBOR: return "cbor";
+        case ManifestFormat::MSGPACK: return "msgpack";
+        case ManifestFormat::JSON: break;
+    }
+    return "json";
+}
 
-
-
+std::optional<ManifestFormat> manifestFormatFromString(const std::string& name) {
+    const std::string lower = Poco::toLower(name);
+    if (lower == "json") return ManifestFormat::JSON;
+    if (lower == "cbor") return ManifestFormat::CBOR;
+    if (lower == "msgpack" || lower == "messagepack") return ManifestFormat::MSGPACK;
+    return std::nullopt;
+}
 
 const char* clientSyncErrorCodeToString(ClientSyncErrorCode code) {
     switch (code) {
@@ -33,6 +67,7 @@ const char* clientSyncErrorCodeToString(ClientSyncErrorCode code) {
         case ClientSyncErrorCode::ERROR_BAD_REQUEST: return "Bad request (400)";
         case ClientSyncErrorCode::ERROR_SERVER_ERROR: return "Server error (5xx)";
         case ClientSyncErrorCode::ERROR_CONFLICT: return "Conflict (409)";
+        case ClientSyncErrorCode::ERROR_RATE_LIMITED: return "Rate limited (429)";
         case ClientSyncErrorCode::ERROR_JSON_PARSE: return "JSON parse error in response";
         case ClientSyncErrorCode::ERROR_LOCAL_FILE_IO: return "Local file I/O error";
         case ClientSyncErrorCode::ERROR_MULTIPART_FORM: return "Multipart form error";
@@ -41,64 +76,221 @@ const char* clientSyncErrorCodeToString(ClientSyncErrorCode code) {
     }
 }
 
-HttpClient::HttpClient(const std::string& base_url, Poco::Timespan timeout)
-    : server_uri_base_(base_url), default_timeout_(timeout) {
-    if (server_uri_base_.getPath().empty()) {
-        server_uri_base_.setPath("/"); // Đảm bảo URI có path, ít nhất là "/"
+namespace {
+    // Gửi lại được khi không biết server đã nhận request trước khi kết nối đứt hay chưa.
+    bool isIdempotentMethod(const std::string& method) {
+        return method == Poco::Net::HTTPRequest::HTTP_GET || method == Poco::Net::HTTPRequest::HTTP_HEAD ||
+               method == Poco::Net::HTTPRequest::HTTP_PUT || method == Poco::Net::HTTPRequest::HTTP_DELETE ||
+               method == Poco::Net::HTTPRequest::HTTP_OPTIONS;
     }
-}
 
+#if SYNC_CLIENT_HAVE_ZSTD
+    const std::string kAcceptEncoding = ContentCodings::ZSTD + ", " + ContentCodings::GZIP;
+
+    void copyZstdStream(std::istream& in, std::ostream& out) {
+        std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> dctx(ZSTD_createDCtx(), &ZSTD_freeDCtx);
+        if (!dctx) throw Poco::RuntimeException("ZSTD_createDCtx failed");
+        std::vector<char> inBuf(ZSTD_DStreamInSize()), outBuf(ZSTD_DStreamOutSize());
+        std::size_t pending = 0; // != 0: frame chưa kết thúc
+        for (;;) {
+            in.read(inBuf.data(), static_cast<std::streamsize>(inBuf.size()));
+            std::streamsize n = in.gcount();
+            if (n <= 0) break;
+            ZSTD_inBuffer ib{inBuf.data(), static_cast<std::size_t>(n), 0};
+            ZSTD_outBuffer ob{outBuf.data(), outBuf.size(), outBuf.size()};
+            while (ib.pos < ib.size || ob.pos == ob.size) {
+                ob = ZSTD_outBuffer{outBuf.data(), outBuf.size(), 0};
+                pending = ZSTD_decompressStream(dctx.get(), &ob, &ib);
+                if (ZSTD_isError(pending)) throw Poco::DataFormatException(std::string("zstd: ") + ZSTD_getErrorName(pending));
+                out.write(outBuf.data(), static_cast<std::streamsize>(ob.pos));
+            }
+        }
+        if (pending != 0) throw Poco::DataFormatException("zstd: truncated response body");
+    }
+#else
+    const std::string kAcceptEncoding = ContentCodings::GZIP;
+#endif
+
+    // Đọc hết body theo Content-Encoding của response. Sau khi giải nén vẫn đọc bỏ phần còn lại
+    // của stream (chunk cuối) để kết nối keep-alive dùng lại được.
+    ClientSyncErrorCode errorCodeForStatus(int status) {
+        switch (status) {
+            case Poco::Net::HTTPResponse::HTTP_UNAUTHORIZED: return ClientSyncErrorCode::ERROR_AUTH_FAILED;
+            case Poco::Net::HTTPResponse::HTTP_FORBIDDEN:    return ClientSyncErrorCode::ERROR_FORBIDDEN;
+            case Poco::Net::HTTPResponse::HTTP_NOT_FOUND:    return ClientSyncErrorCode::ERROR_NOT_FOUND;
+            case Poco::Net::HTTPResponse::HTTP_CONFLICT:     return ClientSyncErrorCode::ERROR_CONFLICT;
+            case Poco::Net::HTTPResponse::HTTP_TOO_MANY_REQUESTS: return ClientSyncErrorCode::ERROR_RATE_LIMITED;
+            default:
+                if (status >= 400 && status < 500) return ClientSyncErrorCode::ERROR_BAD_REQUEST;
+                if (status >= 500) return ClientSyncErrorCode::ERROR_SERVER_ERROR;
+                return ClientSyncErrorCode::ERROR_UNKNOWN;
+        }
+    }
 
+    // Retry-After dạng số giây (server không gửi dạng ngày giờ); không có / không hợp lệ -> 0
+    int retryAfterSeconds(const Poco::Net::HTTPResponse& response) {
+        const std::string value = response.get("Retry-After", "");
+        if (value.empty() || !std::all_of(value.begin(), value.end(), [](char c) { return c >= '0' && c <= '9'; })) return 0;
+        try {
+            return std::stoi(value);
+        } catch (const std::exception&) {
+            return 0;
+        }
+    }
 
+    void copyDecodedBody(std::istream& rs, const std::string& contentEncoding, std::ostream& out) {
+        if (contentEncoding.empty() || Poco::icompare(contentEncoding, ContentCodings::IDENTITY) == 0) {
+            Poco::StreamCopier::copyStream(rs, out);
+            return;
+        }
+        if (Poco::icompare(contentEncoding, ContentCodings::GZIP) == 0) {
+            Poco::InflatingInputStream inflater(rs, Poco::InflatingStreamBuf::STREAM_GZIP);
+            Poco::StreamCopier::copyStream(inflater, out);
+        }
+#if SYNC_CLIENT_HAVE_ZSTD
+        else if (Poco::icompare(contentEncoding, ContentCodings::ZSTD) == 0) {
+            copyZstdStream(rs, out);
+        }
+#endif
+        else {
+            throw Poco::DataFormatException("Unsupported Content-Encoding: " + contentEncoding);
+        }
+        rs.ignore(std::numeric_limits<std::streamsize>::max());
+    }
 
-ApiResponse HttpClient::performRequest(Poco::Net::HTTPRequest& request, const std::string& requestBody, Poco::Net::HTTPClientSession* existingSession) {
-    ApiResponse api_res;
-    Poco::Net::HTTPClientSession localSession; // Tạo session cục bộ nếu không có session được truyền vào
-    Poco::Net::HTTPClientSession* session_ptr;
+    // PlanStream: mỗi dòng một operation, dòng có "status" là dòng cuối và thành ApiResponse::body.
+    // Server không nén stream; nếu bị nén (proxy) thì phải giải nén cả body trước, chỉ mất phần chạy sớm.
+    void readNdjsonBody(std::istream& rs, const std::string& contentEncoding, const std::function<void(const json&)>& onLine,
+                        ApiResponse& api_res) {
+        std::istringstream decoded;
+        std::istream* in = &rs;
+        if (!contentEncoding.empty() && Poco::icompare(contentEncoding, ContentCodings::IDENTITY) != 0) {
+            std::ostringstream body;
+            copyDecodedBody(rs, contentEncoding, body);
+            decoded.str(body.str());
+            in = &decoded;
+        }
 
-    if (existingSession) {
-        session_ptr = existingSession;
-    } else {
-        localSession.setHost(server_uri_base_.getHost());
-        localSession.setPort(server_uri_base_.getPort());
-        localSession.setTimeout(default_timeout_);
-        session_ptr = &localSession;
+        bool trailer = false;
+        std::string line;
+        try {
+            while (std::getline(*in, line, PlanStream::LINE_SEPARATOR)) {
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (line.empty()) continue;
+                json value = json::parse(line);
+                if (value.is_object() && value.contains(JsonKeys::STATUS)) {
+                    api_res.body = std::move(value);
+                    trailer = true;
+                } else if (!trailer) {
+                    onLine(value);
+                }
+            }
+        } catch (const json::parse_error& e) {
+            api_res.error_message = "Server sent a malformed plan line: " + std::string(e.what());
+            api_res.error_code = ClientSyncErrorCode::ERROR_JSON_PARSE;
+            rs.ignore(std::numeric_limits<std::streamsize>::max());
+            return;
+        }
+        if (!trailer) {
+            api_res.error_message = "Sync plan stream ended before its final line.";
+            api_res.error_code = ClientSyncErrorCode::ERROR_SERVER_ERROR;
+        } else if (api_res.body.value(JsonKeys::STATUS, std::string()) != "success") {
+            api_res.error_message = api_res.body.value(JsonKeys::MESSAGE, std::string("Sync planning failed on the server."));
+            api_res.error_code = ClientSyncErrorCode::ERROR_SERVER_ERROR;
+        }
+    }
+
+    HttpSessionPool::Options withTimeout(HttpSessionPool::Options options, Poco::Timespan timeout) {
+        options.timeout = timeout;
+        return options;
     }
+}
 
+HttpClient::HttpClient(const std::string& base_url, Poco::Timespan timeout, HttpSessionPool::Options pool_options)
+    : server_uri_base_(base_url), default_timeout_(timeout),
+      session_pool_(server_uri_base_.getHost(), server_uri_base_.getPort(), withTimeout(pool_options, timeout)) {
+    if (server_uri_base_.getPath().empty()) {
+        server_uri_base_.setPath("/"); // Đảm bảo URI có path, ít nhất là "/"
+    }
+}
+
+std::istream& HttpClient::exchange(HttpSessionPool::Lease& lease, Poco::Net::HTTPRequest& request, Poco::Net::HTTPResponse& response,
+                                   const std::function<void(std::ostream&)>& writeBody, bool retryable) {
+    lease = session_pool_.acquire();
     try {
-        if (!requestBody.empty()) {
-            request.setContentLength(requestBody.length());
-            if (request.getContentType().empty()) { // Đặt default nếu client chưa set
-                request.setContentType(ContentTypes::APPLICATION_JSON);
-            }
+        std::ostream& ostr = lease.session().sendRequest(request);
+        if (writeBody) writeBody(ostr);
+        return lease.session().receiveResponse(response);
+    } catch (const Poco::IOException& e) {
+        // Server đóng kết nối keep-alive đúng lúc ta gửi (reset / không có response).
+        // TimeoutException không thuộc IOException nên không bị gửi lại.
+        if (!lease.reused() || !retryable) throw;
+        std::cerr << "HttpClient: stale keep-alive connection for " << request.getURI() << " (" << e.displayText() << "), retrying." << std::endl;
+    }
+    lease = session_pool_.acquire_fresh();
+    std::ostream& ostr = lease.session().sendRequest(request);
+    if (writeBody) writeBody(ostr);
+    return lease.session().receiveResponse(response);
+}
+
+
+ApiResponse HttpClient::performRequest(Poco::Net::HTTPRequest& request, const std::string& requestBody,
+                                       const std::function<void(const json&)>& onNdjsonLine) {
+    if (!requestBody.empty()) {
+        request.setContentLength(requestBody.length());
+        if (request.getContentType().empty()) { // Đặt default nếu client chưa set
+            request.setContentType(ContentTypes::APPLICATION_JSON);
         }
-        // Gửi request
-        std::ostream& ostr = session_ptr->sendRequest(request);
+    }
+    return performRequest(request, [&requestBody](std::ostream& ostr) {
         if (!requestBody.empty()) {
             ostr << requestBody;
             ostr.flush();
         }
+    }, onNdjsonLine);
+}
+
+ApiResponse HttpClient::performRequest(Poco::Net::HTTPRequest& request, const std::function<void(std::ostream&)>& writeBody,
+                                       const std::function<void(const json&)>& onNdjsonLine) {
+    ApiResponse api_res;
+    HttpSessionPool::Lease lease;
 
-        // Nhận response
+    try {
+        request.set(HttpHeaders::ACCEPT_ENCODING, kAcceptEncoding); // JSON lớn (list, manifest) được nén
+
+        // Gửi request, nhận response
         Poco::Net::HTTPResponse http_res;
-        std::istream& rs = session_ptr->receiveResponse(http_res);
+        std::istream& rs = exchange(lease, request, http_res, writeBody, isIdempotentMethod(request.getMethod()));
         api_res.statusCode = http_res.getStatus();
+        api_res.retry_after_seconds = retryAfterSeconds(http_res);
 
-        std::ostringstream data_oss;
-        Poco::StreamCopier::copyStream(rs, data_oss);
-        std::string response_body_str = data_oss.str();
-        api_res.raw_body_if_not_json = response_body_str; // Lưu lại raw body
-
-        // Parse JSON nếu content type là JSON
         std::string contentType = http_res.getContentType();
         std::string::size_type pos = contentType.find(';');
         if (pos != std::string::npos) {
             contentType = contentType.substr(0, pos); // Bỏ phần charset nếu có
         }
 
-        if (contentType == "application/json" && !response_body_str.empty()) {
+        if (onNdjsonLine && api_res.statusCode >= 200 && api_res.statusCode < 300 && contentType == ContentTypes::APPLICATION_NDJSON) {
+            readNdjsonBody(rs, http_res.get(HttpHeaders::CONTENT_ENCODING, ""), onNdjsonLine, api_res);
+            lease.release(http_res.getKeepAlive());
+            return api_res;
+        }
+
+        std::ostringstream data_oss;
+        copyDecodedBody(rs, http_res.get(HttpHeaders::CONTENT_ENCODING, ""), data_oss);
+        lease.release(http_res.getKeepAlive()); // Đã đọc hết body: kết nối dùng lại được
+        std::string response_body_str = data_oss.str();
+        api_res.raw_body_if_not_json = response_body_str; // Lưu lại raw body
+
+        // Parse JSON nếu content type là JSON
+
+        // Manifest / listing có thể về dưới dạng CBOR hoặc MessagePack nếu request đã xin
+        if (!response_body_str.empty() && (contentType == "application/json" || contentType == ContentTypes::APPLICATION_CBOR ||
+                                           contentType == ContentTypes::APPLICATION_MSGPACK)) {
             try {
-                api_res.body = json::parse(response_body_str);
+                if (contentType == ContentTypes::APPLICATION_CBOR) api_res.body = json::from_cbor(response_body_str);
+                else if (contentType == ContentTypes::APPLICATION_MSGPACK) api_res.body = json::from_msgpack(response_body_str);
+                else api_res.body = json::parse(response_body_str);
             } catch (const json::parse_error& e) {
                 std::cerr << "HttpClient: Failed to parse JSON response for " << request.getURI() << ": " << e.what()
                           << ". Body: " << response_body_str.substr(0, 200) << std::endl;
@@ -124,6 +316,7 @@ ApiResponse HttpClient::performRequest(Poco::Net::HTTPRequest& request, const st
                     case Poco::Net::HTTPResponse::HTTP_FORBIDDEN:       api_res.error_code = ClientSyncErrorCode::ERROR_FORBIDDEN; break;
                     case Poco::Net::HTTPResponse::HTTP_NOT_FOUND:       api_res.error_code = ClientSyncErrorCode::ERROR_NOT_FOUND; break;
                     case Poco::Net::HTTPResponse::HTTP_CONFLICT:        api_res.error_code = ClientSyncErrorCode::ERROR_CONFLICT; break;
+                    case Poco::Net::HTTPResponse::HTTP_TOO_MANY_REQUESTS: api_res.error_code = ClientSyncErrorCode::ERROR_RATE_LIMITED; break;
                     default:
                         if (api_res.statusCode >= 400 && api_res.statusCode < 500) api_res.error_code = ClientSyncErrorCode::ERROR_BAD_REQUEST;
                         else if (api_res.statusCode >= 500) api_res.error_code = ClientSyncErrorCode::ERROR_SERVER_ERROR;
@@ -150,20 +343,10 @@ ApiResponse HttpClient::performRequest(Poco::Net::HTTPRequest& request, const st
 }
 
 
-ApiResponse HttpClient::performMultipartUpload(Poco::Net::HTTPRequest& request, Poco::Net::HTMLForm& form, Poco::Net::HTTPClientSession* existingSession) {
+ApiResponse HttpClient::performMultipartUpload(Poco::Net::HTTPRequest& request, Poco::Net::HTMLForm& form) {
     ApiResponse api_res;
-    Poco::Net::HTTPClientSession localSession;
-    Poco::Net::HTTPClientSession* session_ptr;
+    HttpSessionPool::Lease lease;
 
-    if (existingSession) {
-        session_ptr = existingSession;
-    } else {
-        localSession.setHost(server_uri_base_.getHost());
-        localSession.setPort(server_uri_base_.getPort());
-        localSession.setTimeout(default_timeout_);
-        session_ptr = &localSession;
-    }
-    
 try {
     // 1. Để Poco::Net::HTMLForm tự động chuẩn bị request.
     //    Hàm này sẽ tạo boundary, set header "Content-Type" với boundary đó,
@@ -184,21 +367,21 @@ try {
     }
     std::cout << "[Client Upload Debug] -----------------------------------------" << std::endl;
 
-    // 3. Gửi request (chỉ chứa headers) đến server.
-    std::ostream& ostr = session_ptr->sendRequest(request);
-
-    // 4. Ghi nội dung của form (đã được định dạng với các boundary) vào stream.
-    //    Đây chính là bước gửi HTTP body.
-    form.write(ostr);
-    ostr.flush();
-
+    // 3. Gửi request (headers) đến server, rồi 4. ghi nội dung của form (đã được định dạng
+    //    với các boundary) vào stream - đây chính là bước gửi HTTP body.
+    //    Form chỉ ghi được một lần nên upload không được gửi lại khi kết nối cũ hỏng.
     // 5. Nhận và xử lý phản hồi từ server (phần này giữ nguyên như cũ).
     Poco::Net::HTTPResponse http_res;
-    std::istream& rs = session_ptr->receiveResponse(http_res);
+    std::istream& rs = exchange(lease, request, http_res, [&form](std::ostream& ostr) {
+        form.write(ostr);
+        ostr.flush();
+    }, false);
     api_res.statusCode = http_res.getStatus();
+    api_res.retry_after_seconds = retryAfterSeconds(http_res);
 
     std::ostringstream data_oss;
-    Poco::StreamCopier::copyStream(rs, data_oss);
+    copyDecodedBody(rs, http_res.get(HttpHeaders::CONTENT_ENCODING, ""), data_oss);
+    lease.release(http_res.getKeepAlive());
     std::string response_body_str = data_oss.str();
     api_res.raw_body_if_not_json = response_body_str;
 
@@ -228,6 +411,7 @@ try {
             case Poco::Net::HTTPResponse::HTTP_UNAUTHORIZED:   api_res.error_code = ClientSyncErrorCode::ERROR_AUTH_FAILED; break;
             case Poco::Net::HTTPResponse::HTTP_FORBIDDEN:      api_res.error_code = ClientSyncErrorCode::ERROR_FORBIDDEN; break;
             case Poco::Net::HTTPResponse::HTTP_NOT_FOUND:      api_res.error_code = ClientSyncErrorCode::ERROR_NOT_FOUND; break;
+            case Poco::Net::HTTPResponse::HTTP_TOO_MANY_REQUESTS: api_res.error_code = ClientSyncErrorCode::ERROR_RATE_LIMITED; break;
             default:                                           api_res.error_code = ClientSyncErrorCode::ERROR_SERVER_ERROR; break;
         }
     }
@@ -350,9 +534,6 @@ ApiResponse HttpClient::uploadFile(const std::string& token, const std::string&
 }
 //////downloadfile
 ClientSyncErrorCode HttpClient::downloadFile(const std::string& token, const std::string& serverRelativePath, const std::string& localSavePath) {
-    Poco::Net::HTTPClientSession session(server_uri_base_.getHost(), server_uri_base_.getPort());
-    session.setTimeout(default_timeout_); // Có thể cần timeout dài hơn cho download file lớn
-
     Poco::URI endpoint_uri(server_uri_base_);
     endpoint_uri.setPath( Endpoints::FILES_DOWNLOAD);
     endpoint_uri.addQueryParameter(JsonKeys::PATH, serverRelativePath);
@@ -360,10 +541,10 @@ ClientSyncErrorCode HttpClient::downloadFile(const std::string& token, const std
     Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_GET, endpoint_uri.getPathAndQuery(), Poco::Net::HTTPMessage::HTTP_1_1);
     request.set(HttpHeaders::AUTH_TOKEN, token);
 
+    HttpSessionPool::Lease lease;
     try {
-        session.sendRequest(request);
         Poco::Net::HTTPResponse http_res;
-        std::istream& rs = session.receiveResponse(http_res);
+        std::istream& rs = exchange(lease, request, http_res, nullptr, true);
 
         if (http_res.getStatus() == Poco::Net::HTTPResponse::HTTP_OK) {
             Poco::Path p_local(localSavePath);
@@ -382,6 +563,7 @@ ClientSyncErrorCode HttpClient::downloadFile(const std::string& token, const std
                 return ClientSyncErrorCode::ERROR_LOCAL_FILE_IO;
             }
             Poco::StreamCopier::copyStream(rs, outfile);
+            lease.release(http_res.getKeepAlive());
             outfile.close();
             if (!outfile.good()) {
                  std::cerr << "HttpClient: Error writing to local file: " << localSavePath << std::endl;
@@ -391,11 +573,13 @@ ClientSyncErrorCode HttpClient::downloadFile(const std::string& token, const std
         } else {
             std::cerr << "HttpClient: Download failed for " << serverRelativePath << ". Status: " << http_res.getStatus() << " " << http_res.getReason() << std::endl;
             std::ostringstream err_oss; Poco::StreamCopier::copyStream(rs, err_oss); // Đọc body lỗi
+            lease.release(http_res.getKeepAlive());
             std::cerr << "Server error body: " << err_oss.str().substr(0, 200) << std::endl;
 
             if (http_res.getStatus() == Poco::Net::HTTPResponse::HTTP_NOT_FOUND) return ClientSyncErrorCode::ERROR_NOT_FOUND;
             if (http_res.getStatus() == Poco::Net::HTTPResponse::HTTP_FORBIDDEN) return ClientSyncErrorCode::ERROR_FORBIDDEN;
             if (http_res.getStatus() == Poco::Net::HTTPResponse::HTTP_UNAUTHORIZED) return ClientSyncErrorCode::ERROR_AUTH_FAILED;
+            if (http_res.getStatus() == Poco::Net::HTTPResponse::HTTP_TOO_MANY_REQUESTS) return ClientSyncErrorCode::ERROR_RATE_LIMITED;
             return ClientSyncErrorCode::ERROR_SERVER_ERROR;
         }
     } catch (const Poco::TimeoutException& e) {
@@ -413,6 +597,168 @@ ClientSyncErrorCode HttpClient::downloadFile(const std::string& token, const std
     }
 }
 
+// --- Block delta (BlockDelta trong protocol.hpp) ---
+
+ClientSyncErrorCode HttpClient::getFileSignature(const std::string& token, const std::string& serverRelativePath,
+                                                 std::string& signature, std::string& serverChecksum) {
+    Poco::URI endpoint_uri(server_uri_base_);
+    endpoint_uri.setPath(Endpoints::FILES_SIGNATURE);
+    endpoint_uri.addQueryParameter(JsonKeys::PATH, serverRelativePath);
+
+    Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_GET, endpoint_uri.getPathAndQuery(), Poco::Net::HTTPMessage::HTTP_1_1);
+    request.set(HttpHeaders::AUTH_TOKEN, token);
+
+    HttpSessionPool::Lease lease;
+    try {
+        Poco::Net::HTTPResponse http_res;
+        std::istream& rs = exchange(lease, request, http_res, nullptr, true);
+        std::ostringstream body;
+        Poco::StreamCopier::copyStream(rs, body);
+        lease.release(http_res.getKeepAlive());
+        if (http_res.getStatus() != Poco::Net::HTTPResponse::HTTP_OK) return errorCodeForStatus(http_res.getStatus());
+        signature = body.str();
+        serverChecksum = http_res.get(HttpHeaders::FILE_CHECKSUM, "");
+        return ClientSyncErrorCode::SUCCESS;
+    } catch (const Poco::TimeoutException& e) {
+        std::cerr << "HttpClient Signature Timeout for " << serverRelativePath << ": " << e.displayText() << std::endl;
+        return ClientSyncErrorCode::ERROR_TIMEOUT;
+    } catch (const Poco::Net::NetException& e) {
+        std::cerr << "HttpClient Signature Network Exception for " << serverRelativePath << ": " << e.displayText() << std::endl;
+        return ClientSyncErrorCode::ERROR_CONNECTION_FAILED;
+    } catch (const Poco::Exception& e) {
+        std::cerr << "HttpClient Signature Poco Exception for " << serverRelativePath << ": " << e.displayText() << std::endl;
+        return ClientSyncErrorCode::ERROR_UNKNOWN;
+    }
+}
+
+ApiResponse HttpClient::uploadDelta(const std::string& token, const std::string& localDeltaPath, const std::string& serverRelativePath,
+                                    const std::string& baseChecksum, const std::string& newChecksum) {
+    Poco::URI endpoint_uri(server_uri_base_);
+    endpoint_uri.setPath(Endpoints::FILES_PATCH);
+    endpoint_uri.addQueryParameter(JsonKeys::PATH, serverRelativePath);
+
+    Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST, endpoint_uri.getPathAndQuery(), Poco::Net::HTTPMessage::HTTP_1_1);
+    request.set(HttpHeaders::AUTH_TOKEN, token);
+    request.set(HttpHeaders::BASE_CHECKSUM, baseChecksum);
+    request.set(HttpHeaders::FILE_CHECKSUM, newChecksum);
+    request.setContentType(ContentTypes::APPLICATION_OCTET_STREAM);
+
+    std::ifstream delta(localDeltaPath, std::ios::binary | std::ios::ate);
+    if (!delta) {
+        ApiResponse res;
+        res.error_message = "Could not open delta file: " + localDeltaPath;
+        res.error_code = ClientSyncErrorCode::ERROR_LOCAL_FILE_IO;
+        return res;
+    }
+    request.setContentLength64(static_cast<Poco::Int64>(delta.tellg()));
+    delta.seekg(0);
+    // Stream delta từ file, không giữ cả delta trong bộ nhớ
+    return performRequest(request, [&delta](std::ostream& ostr) {
+        delta.clear();
+        delta.seekg(0);
+        Poco::StreamCopier::copyStream(delta, ostr);
+        ostr.flush();
+    });
+}
+
+ClientSyncErrorCode HttpClient::downloadDelta(const std::string& token, const std::string& serverRelativePath, const std::string& localSignature,
+                                              const std::string& localSavePath, bool& isDelta, std::string& serverChecksum) {
+    Poco::URI endpoint_uri(server_uri_base_);
+    endpoint_uri.setPath(Endpoints::FILES_DELTA);
+    endpoint_uri.addQueryParameter(JsonKeys::PATH, serverRelativePath);
+
+    Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST, endpoint_uri.getPathAndQuery(), Poco::Net::HTTPMessage::HTTP_1_1);
+    request.set(HttpHeaders::AUTH_TOKEN, token);
+    request.setContentType(ContentTypes::APPLICATION_OCTET_STREAM);
+    request.setContentLength(localSignature.size());
+
+    HttpSessionPool::Lease lease;
+    try {
+        Poco::Net::HTTPResponse http_res;
+        std::istream& rs = exchange(lease, request, http_res, [&localSignature](std::ostream& ostr) {
+            ostr.write(localSignature.data(), static_cast<std::streamsize>(localSignature.size()));
+            ostr.flush();
+        }, false);
+
+        if (http_res.getStatus() != Poco::Net::HTTPResponse::HTTP_OK) {
+            std::ostringstream err_oss; Poco::StreamCopier::copyStream(rs, err_oss);
+            lease.release(http_res.getKeepAlive());
+            return errorCodeForStatus(http_res.getStatus());
+        }
+        std::ofstream outfile(localSavePath, std::ios::binary | std::ios::trunc);
+        if (!outfile) {
+            std::cerr << "HttpClient: Cannot open local file for writing: " << localSavePath << std::endl;
+            return ClientSyncErrorCode::ERROR_LOCAL_FILE_IO;
+        }
+        Poco::StreamCopier::copyStream(rs, outfile);
+        lease.release(http_res.getKeepAlive());
+        outfile.close();
+        if (!outfile.good()) return ClientSyncErrorCode::ERROR_LOCAL_FILE_IO;
+        isDelta = http_res.get(HttpHeaders::TRANSFER_MODE, "") == "delta";
+        serverChecksum = http_res.get(HttpHeaders::FILE_CHECKSUM, "");
+        return ClientSyncErrorCode::SUCCESS;
+    } catch (const Poco::TimeoutException& e) {
+        std::cerr << "HttpClient Delta Download Timeout for " << serverRelativePath << ": " << e.displayText() << std::endl;
+        return ClientSyncErrorCode::ERROR_TIMEOUT;
+    } catch (const Poco::Net::NetException& e) {
+        std::cerr << "HttpClient Delta Download Network Exception for " << serverRelativePath << ": " << e.displayText() << std::endl;
+        return ClientSyncErrorCode::ERROR_CONNECTION_FAILED;
+    } catch (const Poco::Exception& e) {
+        std::cerr << "HttpClient Delta Download Poco Exception for " << serverRelativePath << ": " << e.displayText() << std::endl;
+        return ClientSyncErrorCode::ERROR_UNKNOWN;
+    }
+}
+
+ApiResponse HttpClient::queryMissingChunks(const std::string& token, const std::vector<std::string>& chunkHashes) {
+    Poco::URI endpoint_uri(server_uri_base_);
+    endpoint_uri.setPath(Endpoints::FILES_CHUNKS_MISSING);
+
+    Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST, endpoint_uri.getPathAndQuery(), Poco::Net::HTTPMessage::HTTP_1_1);
+    request.set(HttpHeaders::AUTH_TOKEN, token);
+
+    json payload;
+    payload[JsonKeys::CHUNKS] = chunkHashes;
+    return performRequest(request, payload.dump());
+}
+
+ApiResponse HttpClient::uploadChunks(const std::string& token, const std::string& frames) {
+    Poco::URI endpoint_uri(server_uri_base_);
+    endpoint_uri.setPath(Endpoints::FILES_CHUNKS);
+
+    Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST, endpoint_uri.getPathAndQuery(), Poco::Net::HTTPMessage::HTTP_1_1);
+    request.set(HttpHeaders::AUTH_TOKEN, token);
+    request.setContentType(ContentTypes::APPLICATION_OCTET_STREAM);
+    return performRequest(request, frames);
+}
+
+ApiResponse HttpClient::commitChunks(const std::string& token, const std::string& serverRelativePath, const std::string& checksum,
+                                     const std::vector<std::string>& chunkHashes) {
+    Poco::URI endpoint_uri(server_uri_base_);
+    endpoint_uri.setPath(Endpoints::FILES_COMMIT);
+
+    Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST, endpoint_uri.getPathAndQuery(), Poco::Net::HTTPMessage::HTTP_1_1);
+    request.set(HttpHeaders::AUTH_TOKEN, token);
+
+    json payload;
+    payload[JsonKeys::PATH] = serverRelativePath;
+    payload[JsonKeys::CHECKSUM] = checksum;
+    payload[JsonKeys::CHUNKS] = chunkHashes;
+    return performRequest(request, payload.dump());
+}
+
+ApiResponse HttpClient::claimFile(const std::string& token, const std::string& serverRelativePath, const std::string& checksum) {
+    Poco::URI endpoint_uri(server_uri_base_);
+    endpoint_uri.setPath(Endpoints::FILES_CLAIM);
+
+    Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST, endpoint_uri.getPathAndQuery(), Poco::Net::HTTPMessage::HTTP_1_1);
+    request.set(HttpHeaders::AUTH_TOKEN, token);
+
+    json payload;
+    payload[JsonKeys::PATH] = serverRelativePath;
+    payload[JsonKeys::CHECKSUM] = checksum;
+    return performRequest(request, payload.dump());
+}
+
 ApiResponse HttpClient::listDirectory(const std::string& token, const std::string& serverRelativePath) {
     Poco::URI endpoint_uri(server_uri_base_);
     endpoint_uri.setPath( Endpoints::FILES_LIST);
@@ -460,14 +806,70 @@ ApiResponse HttpClient::renamePath(const std::string& token, const std::string&
     return performRequest(request, payload.dump());
 }
 
+ApiResponse HttpClient::batchMetadata(const std::string& token, const json& operations, bool atomic) {
+    Poco::URI endpoint_uri(server_uri_base_);
+    endpoint_uri.setPath(Endpoints::FILES_BATCH);
+
+    Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST, endpoint_uri.getPathAndQuery(), Poco::Net::HTTPMessage::HTTP_1_1);
+    request.set(HttpHeaders::AUTH_TOKEN, token);
+
+    json payload;
+    payload[JsonKeys::OPERATIONS] = operations;
+    payload[JsonKeys::ATOMIC] = atomic;
+    return performRequest(request, payload.dump());
+}
+
 // --- Sync ---
-ApiResponse HttpClient::postSyncManifest(const std::string& token, const json& clientManifest) {
+ApiResponse HttpClient::postSyncManifest(const std::string& token, const json& clientManifest, ManifestFormat format) {
+    return postManifestBody(Endpoints::SYNC_MANIFEST, token, clientManifest, format);
+}
+
+ApiResponse HttpClient::streamSyncManifest(const std::string& token, const json& clientManifest, ManifestFormat format,
+                                           const std::function<void(const json&)>& onOperation) {
+    return postManifestBody(Endpoints::SYNC_MANIFEST, token, clientManifest, format, onOperation);
+}
+
+ApiResponse HttpClient::postSyncTree(const std::string& token, const json& directories, ManifestFormat format) {
+    return postManifestBody(Endpoints::SYNC_TREE, token, directories, format);
+}
+
+ApiResponse HttpClient::watchChanges(const std::string& token, const std::string& lastHash, int timeoutSeconds) {
+    // Chừa 5 giây cho server trả lời sau khi hết thời gian chờ
+    const int maxSeconds = std::max(1, static_cast<int>(default_timeout_.totalSeconds()) - 5);
+    Poco::URI endpoint_uri(server_uri_base_);
+    endpoint_uri.setPath(Endpoints::SYNC_WATCH);
+    endpoint_uri.addQueryParameter(JsonKeys::HASH, lastHash);
+    endpoint_uri.addQueryParameter("timeout", std::to_string(std::clamp(timeoutSeconds, 0, maxSeconds)));
+
+    Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_GET, endpoint_uri.getPathAndQuery(), Poco::Net::HTTPMessage::HTTP_1_1);
+    request.set(HttpHeaders::AUTH_TOKEN, token);
+    return performRequest(request);
+}
+
+ApiResponse HttpClient::postManifestBody(const std::string& path, const std::string& token, const json& payload, ManifestFormat format,
+                                         const std::function<void(const json&)>& onNdjsonLine) {
     Poco::URI endpoint_uri(server_uri_base_);
-    endpoint_uri.setPath( Endpoints::SYNC_MANIFEST);
+    endpoint_uri.setPath(path);
 
     Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST, endpoint_uri.getPathAndQuery(), Poco::Net::HTTPMessage::HTTP_1_1);
     request.set(HttpHeaders::AUTH_TOKEN, token);
-    // ContentType sẽ được set trong performRequest
+    // Server không biết PlanStream bỏ qua application/x-ndjson và trả response thường
+    const std::string streamAccept = onNdjsonLine ? ContentTypes::APPLICATION_NDJSON + ", " : std::string();
+    if (format == ManifestFormat::JSON) {
+        // ContentType sẽ được set trong performRequest
+        if (onNdjsonLine) request.set(HttpHeaders::ACCEPT, streamAccept + "application/json;q=0.5");
+        return performRequest(request, payload.dump(), onNdjsonLine);
+    }
 
-    return performRequest(request, clientManifest.dump());
-}
\ No newline at end of file
+    std::string body;
+    if (format == ManifestFormat::CBOR) {
+        json::to_cbor(payload, body);
+        request.setContentType(ContentTypes::APPLICATION_CBOR);
+        request.set(HttpHeaders::ACCEPT, streamAccept + ContentTypes::APPLICATION_CBOR + ", application/json;q=0.5");
+    } else {
+        json::to_msgpack(payload, body);
+        request.setContentType(ContentTypes::APPLICATION_MSGPACK);
+        request.set(HttpHeaders::ACCEPT, streamAccept + ContentTypes::APPLICATION_MSGPACK + ", application/json;q=0.5");
+    }
+    return performRequest(request, body, onNdjsonLine);
+}
@@ -0,0 +1,117 @@
+#include "http_session_pool.hpp"
+
+#include <Poco/Exception.h>
+#include <Poco/Net/Socket.h>
+
+HttpSessionPool::Lease::Lease(Lease&& other) noexcept
+    : pool_(other.pool_), session_(std::move(other.session_)), reused_(other.reused_) {
+    other.pool_ = nullptr;
+}
+
+HttpSessionPool::Lease& HttpSessionPool::Lease::operator=(Lease&& other) noexcept {
+    if (this != &other) {
+        session_.reset(); // session đang giữ (nếu có) bị bỏ, không trả về pool
+        pool_ = other.pool_;
+        session_ = std::move(other.session_);
+        reused_ = other.reused_;
+        other.pool_ = nullptr;
+    }
+    return *this;
+}
+
+HttpSessionPool::Lease::~Lease() = default;
+
+void HttpSessionPool::Lease::release(bool reusable) {
+    if (!session_) return;
+    if (reusable && pool_) {
+        pool_->give_back(std::move(session_));
+    }
+    session_.reset();
+}
+
+HttpSessionPool::HttpSessionPool(const std::string& host, unsigned short port)
+    : HttpSessionPool(host, port, Options()) {}
+
+HttpSessionPool::HttpSessionPool(const std::string& host, unsigned short port, Options options)
+    : host_(host), port_(port), options_(options) {}
+
+std::unique_ptr<Poco::Net::HTTPClientSession> HttpSessionPool::create_session() {
+    auto session = std::make_unique<Poco::Net::HTTPClientSession>(host_, port_);
+    session->setTimeout(options_.timeout);
+    session->setKeepAlive(true);
+    session->setKeepAliveTimeout(Poco::Timespan(static_cast<long>(options_.idle_timeout.count()), 0));
+    return session;
+}
+
+bool HttpSessionPool::is_healthy(Poco::Net::HTTPClientSession& session) {
+    try {
+        if (!session.connected()) return false;
+        return !session.socket().poll(Poco::Timespan(0), Poco::Net::Socket::SELECT_READ | Poco::Net::Socket::SELECT_ERROR);
+    } catch (const Poco::Exception&) {
+        return false;
+    }
+}
+
+HttpSessionPool::Lease HttpSessionPool::acquire() {
+    for (;;) {
+        std::unique_ptr<Poco::Net::HTTPClientSession> candidate;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const auto now = std::chrono::steady_clock::now();
+            // Session cũ nhất nằm đầu deque: bỏ những cái đã rảnh quá lâu.
+            while (!idle_.empty() && now - idle_.front().idle_since >= options_.idle_timeout) {
+                idle_.pop_front();
+                ++stats_.discarded_idle;
+            }
+            if (idle_.empty()) {
+                ++stats_.created;
+                break;
+            }
+            candidate = std::move(idle_.back().session);
+            idle_.pop_back();
+        }
+        // poll() không block (timeout 0) nhưng vẫn là syscall, làm ngoài lock.
+        if (is_healthy(*candidate)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++stats_.reused;
+            return Lease(this, std::move(candidate), true);
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.discarded_stale;
+    }
+    return Lease(this, create_session(), false);
+}
+
+HttpSessionPool::Lease HttpSessionPool::acquire_fresh() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.created;
+    }
+    return Lease(this, create_session(), false);
+}
+
+void HttpSessionPool::give_back(std::unique_ptr<Poco::Net::HTTPClientSession> session) {
+    if (options_.max_idle == 0 || !session->connected()) return; // server đã đóng (Connection: close)
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (idle_.size() >= options_.max_idle) {
+        idle_.pop_front();
+        ++stats_.discarded_idle;
+    }
+    idle_.push_back({std::move(session), std::chrono::steady_clock::now()});
+}
+
+void HttpSessionPool::clear() {
+    std::deque<IdleSession> closing;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing.swap(idle_);
+    }
+    // Đóng socket ngoài lock.
+}
+
+HttpSessionPool::Stats HttpSessionPool::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats s = stats_;
+    s.idle = idle_.size();
+    return s;
+}
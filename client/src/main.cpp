@@ -75,9 +75,45 @@ int main() {
         event_queue.push(event);
     });
 
+    // Server báo thay đổi qua long-poll (SYNC_WATCH) thay vì đồng bộ theo chu kỳ.
+    // Server cũ không có SYNC_WATCH: quay về đồng bộ mỗi sync_interval như trước.
+    std::atomic<bool> server_changed(false);
+    std::atomic<bool> watch_supported(true);
+    std::atomic<bool> watch_done(false);
+    std::thread watch_thread([&]() {
+        const int watch_timeout_seconds = 25; // HttpClient giới hạn dưới timeout 30s của session
+        while (keep_running.load()) {
+            switch (sync_helper_ptr->watchServerChanges(watch_timeout_seconds)) {
+                case SyncHelper::WatchResult::CHANGED:
+                    server_changed.store(true);
+                    break;
+                case SyncHelper::WatchResult::UNCHANGED:
+                    break;
+                case SyncHelper::WatchResult::BUSY:
+                    // Server không giữ được thêm long-poll: hỏi lại sau một chu kỳ watch
+                    for (int i = 0; i < 2 * watch_timeout_seconds && keep_running.load(); ++i) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+                    }
+                    break;
+                case SyncHelper::WatchResult::UNSUPPORTED:
+                    watch_supported.store(false);
+                    watch_done.store(true);
+                    return;
+                case SyncHelper::WatchResult::FAILED:
+                    // Server không trả lời / chưa có token: thử lại sau 5 giây
+                    for (int i = 0; i < 10 && keep_running.load(); ++i) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+                    }
+                    break;
+            }
+        }
+        watch_done.store(true);
+    });
+
     std::thread event_processor_thread([&]() {
         auto last_sync_time = std::chrono::steady_clock::now();
-        const auto sync_interval = std::chrono::seconds(10); // Đồng bộ manifest mỗi 10 giây nếu có thay đổi
+        const auto sync_interval = std::chrono::seconds(10); // Chỉ dùng khi server không hỗ trợ SYNC_WATCH
+        bool local_changes = false;
 
         while (keep_running.load()) {
             std::this_thread::sleep_for(std::chrono::milliseconds(500)); // Kiểm tra hàng đợi thường xuyên hơn
@@ -100,22 +136,26 @@ int main() {
                         // Logic xử lý sự kiện chi tiết sẽ nằm trong triggerManifestSync
                         std::cout << "Sự kiện cục bộ: " << static_cast<int>(current_event.inotify_event)
                                   << " cho " << current_event.path_from_watcher_root << std::endl;
-                        // Đánh dấu cần đồng bộ manifest
-                        last_sync_time = std::chrono::steady_clock::now() - sync_interval - std::chrono::seconds(1); // Buộc đồng bộ ở lần check tiếp theo
+                        // Đánh dấu cần đồng bộ manifest ở lần check tiếp theo
+                        local_changes = true;
                     } catch (const std::exception& e) {
                         std::cerr << "Lỗi khi xử lý sự kiện cho '" << current_event.path_from_watcher_root << "': " << e.what() << std::endl;
                     }
                 }
             }
 
-            // Đồng bộ manifest định kỳ nếu có thay đổi hoặc theo lịch
-            if (std::chrono::steady_clock::now() - last_sync_time > sync_interval) {
+            // Đồng bộ khi có thay đổi cục bộ, khi server báo thay đổi, hoặc theo lịch nếu server không hỗ trợ watch
+            const bool remote_changes = server_changed.exchange(false);
+            const bool periodic = !watch_supported.load() && std::chrono::steady_clock::now() - last_sync_time > sync_interval;
+            if (local_changes || remote_changes || periodic) {
+                local_changes = false;
                 try {
-                    std::cout << "Kích hoạt đồng bộ manifest định kỳ..." << std::endl;
+                    std::cout << "Kích hoạt đồng bộ manifest ("
+                              << (remote_changes ? "server báo thay đổi" : periodic ? "định kỳ" : "thay đổi cục bộ") << ")..." << std::endl;
                     sync_helper_ptr->triggerManifestSync();
                     last_sync_time = std::chrono::steady_clock::now();
                 } catch (const std::exception& e) {
-                     std::cerr << "Lỗi trong quá trình đồng bộ manifest định kỳ: " << e.what() << std::endl;
+                     std::cerr << "Lỗi trong quá trình đồng bộ manifest: " << e.what() << std::endl;
                      // Có thể thử lại sau một khoảng thời gian dài hơn
                      last_sync_time = std::chrono::steady_clock::now(); // Reset để tránh lặp lỗi ngay
                 }
@@ -133,6 +173,16 @@ int main() {
     if (event_processor_thread.joinable()) {
         event_processor_thread.join();
     }
+    // Watch có thể đang chờ server tới 25 giây: chờ ngắn, còn lại thì để process thoát cùng nó
+    for (int i = 0; i < 20 && !watch_done.load(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    if (watch_done.load()) {
+        watch_thread.join();
+    } else {
+        watch_thread.detach();
+        (void)sync_helper_ptr.release(); // Thread watch vẫn dùng SyncHelper cho tới khi process kết thúc
+    }
     // watcher_ptr và sync_helper_ptr sẽ tự hủy
 
     std::cout << "Client đã dừng." << std::endl;
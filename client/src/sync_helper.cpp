@@ -3,11 +3,97 @@
 #include <Poco/Path.h>   // Cho Poco::Path để chuẩn hóa
 #include <iostream>      // Cho std::cout, std::cerr
 #include "http_client.hpp" 
+#include "block_delta.hpp"
+#include "fastcdc.hpp"
+#include <Poco/TemporaryFile.h>
 #include <filesystem>
 #include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <set>
 #include <format> 
 namespace fs = std::filesystem;
 
+namespace {
+    constexpr std::size_t kMaxBatchOperations = 500; // Dưới storage.batch_max_operations mặc định của server
+
+    int hexDigit(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // SHA-256 hex -> 32 byte thô cho manifest compact; checksum rỗng hoặc không hợp lệ -> nil
+    json checksumToWire(const std::string& hex) {
+        if (hex.size() != 2 * CompactManifest::CHECKSUM_BYTES) return nullptr;
+        json::binary_t raw;
+        raw.reserve(CompactManifest::CHECKSUM_BYTES);
+        for (std::size_t i = 0; i < hex.size(); i += 2) {
+            int hi = hexDigit(hex[i]), lo = hexDigit(hex[i + 1]);
+            if (hi < 0 || lo < 0) return nullptr;
+            raw.push_back(static_cast<std::uint8_t>(hi << 4 | lo));
+        }
+        return json::binary(std::move(raw));
+    }
+
+    // Giá trị con trong response SYNC_TREE: hex ở JSON, 32 byte thô / nil ở CBOR / MessagePack
+    std::string treeValueToHex(const json& value) {
+        if (value.is_string()) return value.get<std::string>();
+        if (!value.is_binary()) return std::string();
+        static const char digits[] = "0123456789abcdef";
+        std::string hex;
+        for (std::uint8_t byte : value.get_binary()) {
+            hex += digits[byte >> 4];
+            hex += digits[byte & 0x0f];
+        }
+        return hex;
+    }
+
+    // total = 0: plan stream, chưa biết tổng
+    SyncPlanExecutor::ProgressCallback progressReporter(std::size_t total) {
+        const std::size_t reportEvery = total > 0 ? std::max<std::size_t>(1, total / 20) : 100;
+        return [reportEvery, total](const SyncPlanExecutor::Task&, const SyncPlanExecutor::Progress& p) {
+            if (p.finished() % reportEvery != 0 && (total == 0 || p.finished() != p.total)) return;
+            std::cout << "[SyncHelper] Progress: " << p.finished() << "/" << p.total << " operations, "
+                      << p.bytes_done << "/" << p.bytes_total << " bytes" << std::endl;
+        };
+    }
+
+    // 429, hoặc 503 có Retry-After (pool của server đầy): executor chờ rồi chạy lại operation
+    void throwIfRetryLater(const ApiResponse& res) {
+        const bool busy = res.statusCode == Poco::Net::HTTPResponse::HTTP_SERVICE_UNAVAILABLE && res.retry_after_seconds > 0;
+        if (res.error_code != ClientSyncErrorCode::ERROR_RATE_LIMITED && !busy) return;
+        throw SyncPlanExecutor::RetryLater("server asked to retry later (" + std::to_string(res.statusCode) + ")",
+                                           std::chrono::seconds(std::max(1, res.retry_after_seconds)));
+    }
+
+    std::string parentPathOf(const std::string& path) {
+        std::size_t slash = path.find_last_of('/');
+        return slash == std::string::npos ? std::string() : path.substr(0, slash);
+    }
+
+    // sync_operations compact ([action_code, relative_path(, old_path)]) -> dạng object như JSON
+    json expandCompactOperations(const json& operations) {
+        json expanded = json::array();
+        for (const auto& op : operations) {
+            if (!op.is_array()) {
+                expanded.push_back(op);
+                continue;
+            }
+            if (op.size() < 2 || !op[0].is_number_integer() || !op[1].is_string()) continue;
+            const int code = op[0].get<int>();
+            const char* name = code >= 0 && code < CompactManifest::SYNC_ACTION_COUNT
+                                   ? CompactManifest::SYNC_ACTION_NAMES[code] : "UNKNOWN_SYNC_ACTION";
+            json item = {{JsonKeys::SYNC_ACTION_TYPE, name}, {JsonKeys::RELATIVE_PATH, op[1]}};
+            if (op.size() > 2 && op[2].is_string()) item[JsonKeys::OLD_PATH] = op[2];
+            expanded.push_back(std::move(item));
+        }
+        return expanded;
+    }
+}
+
 
 SyncHelper::SyncHelper(FileWatcherHelper& watcher, const std::string& config_file_path)
     : watcher_(watcher), app_data_file_path_("app_data.json") { // Khởi tạo watcher_
@@ -29,9 +115,36 @@ SyncHelper::SyncHelper(FileWatcherHelper& watcher, const std::string& config_fil
     std::string username_str = username_c;
     std::string password_str = password_c;
     watcher_root_path_ = watcher_root_c; // Lưu đường dẫn gốc cục bộ
+
+    // Tuỳ chọn: số kết nối keep-alive giữ lại và thời gian giữ (giây).
+    HttpSessionPool::Options pool_options;
+    if (const char* max_idle_c = config_get(config, "http_max_idle_connections")) {
+        pool_options.max_idle = static_cast<std::size_t>(std::max(0, std::atoi(max_idle_c)));
+    }
+    if (const char* idle_timeout_c = config_get(config, "http_idle_timeout_seconds")) {
+        pool_options.idle_timeout = std::chrono::seconds(std::max(1, std::atoi(idle_timeout_c)));
+    }
+    // Tuỳ chọn: json | cbor | msgpack (mặc định msgpack)
+    if (const char* manifest_format_c = config_get(config, "manifest_format")) {
+        if (auto format = manifestFormatFromString(manifest_format_c)) {
+            manifest_format_ = *format;
+        } else {
+            std::cerr << "SyncHelper: manifest_format '" << manifest_format_c << "' không hợp lệ, dùng "
+                      << manifestFormatToString(manifest_format_) << "." << std::endl;
+        }
+    }
+    // Sync plan song song: sync_workers = 1 chạy tuần tự như trước
+    auto readPositive = [&](const char* key, unsigned fallback) {
+        const char* value = config_get(config, key);
+        return value ? static_cast<unsigned>(std::max(1, std::atoi(value))) : fallback;
+    };
+    sync_options_.workers = readPositive("sync_workers", sync_options_.workers);
+    sync_options_.max_connections = readPositive("sync_max_connections", sync_options_.workers);
+    sync_options_.max_inflight_bytes = static_cast<std::uint64_t>(readPositive("sync_max_inflight_mb", 64)) << 20;
+    sync_options_.max_attempts = readPositive("sync_max_attempts", sync_options_.max_attempts);
     config_free(config);
 
-    http_client_ = std::make_unique<HttpClient>(server_url_str);
+    http_client_ = std::make_unique<HttpClient>(server_url_str, Poco::Timespan(30, 0), pool_options);
     auth_manager_ = std::make_unique<AuthManager>(*http_client_, username_str, password_str);
     local_fs_ = std::make_unique<LocalFileSystem>();
 
@@ -60,15 +173,48 @@ SyncHelper::~SyncHelper() {
 
 
 
-void SyncHelper::performUpload(const std::string& pathFromWatcherRoot) {
+std::string SyncHelper::currentToken() {
+    std::lock_guard<std::mutex> lock(auth_mutex_);
+    if (auto token_opt = auth_manager_->getToken()) return *token_opt;
+    if (!auth_manager_->ensureAuthenticated()) {
+        throw std::runtime_error("SyncHelper: Cần đăng nhập.");
+    }
+    auto token_opt = auth_manager_->getToken();
+    if (!token_opt) {
+        throw std::runtime_error("SyncHelper: Không lấy được token.");
+    }
+    return *token_opt;
+}
+
+std::string SyncHelper::renewToken(const std::string& rejected) {
+    std::lock_guard<std::mutex> lock(auth_mutex_);
+    auto token_opt = auth_manager_->getToken();
+    if (token_opt && *token_opt != rejected) return *token_opt; // Thread khác đã đăng nhập lại
+    auth_manager_->invalidateToken();
     if (!auth_manager_->ensureAuthenticated()) {
-        throw std::runtime_error("SyncHelper: Cần đăng nhập để upload.");
+        throw std::runtime_error("SyncHelper: Đăng nhập lại thất bại sau lỗi 401.");
     }
-    std::string token = *(auth_manager_->getToken()); // Nên kiểm tra optional trước khi dereference
+    token_opt = auth_manager_->getToken();
+    if (!token_opt) throw std::runtime_error("SyncHelper: Không lấy được token mới sau khi đăng nhập lại.");
+    return *token_opt;
+}
+
+ApiResponse SyncHelper::withToken(const std::function<ApiResponse(const std::string&)>& request) {
+    const std::string token = currentToken();
+    ApiResponse res = request(token);
+    if (res.statusCode == Poco::Net::HTTPResponse::HTTP_UNAUTHORIZED) {
+        std::cerr << "[SyncHelper] Request nhận lỗi 401. Thử đăng nhập lại." << std::endl;
+        res = request(renewToken(token));
+    }
+    throwIfRetryLater(res);
+    return res;
+}
+
+void SyncHelper::performUpload(const std::string& pathFromWatcherRoot) {
     fs::path local_full_path = fs::path(watcher_root_path_) / pathFromWatcherRoot;
 
     std::cout << "[SyncHelper] Uploading: " << pathFromWatcherRoot << " (Local: " << local_full_path.string() << ")" << std::endl;
-    ApiResponse res = http_client_->uploadFile(token, local_full_path.string(), pathFromWatcherRoot);
+    ApiResponse res = withToken([&](const std::string& token) { return uploadWithDelta(token, local_full_path, pathFromWatcherRoot); });
 
     if (res.statusCode == Poco::Net::HTTPResponse::HTTP_CREATED || res.statusCode == Poco::Net::HTTPResponse::HTTP_OK) {
         std::cout << "Upload thành công: " << pathFromWatcherRoot << std::endl;
@@ -87,15 +233,7 @@ void SyncHelper::performUpload(const std::string& pathFromWatcherRoot) {
 
 
 void SyncHelper::performDownload(const std::string& serverRelativePath, const std::string& localSaveRelativePath) {
-    std::cout << "[SyncHelper] Attempting to ensure authentication for download..." << std::endl;
-    if (!auth_manager_->ensureAuthenticated()) {
-        throw std::runtime_error("SyncHelper: Cần đăng nhập để download (lần 1).");
-    }
-    auto token_opt = auth_manager_->getToken();
-    if (!token_opt) {
-        throw std::runtime_error("SyncHelper: Không lấy được token để download (lần 1).");
-    }
-    std::string token = *token_opt;
+    std::string token = currentToken();
 
     fs::path local_full_save_path = fs::path(watcher_root_path_) / localSaveRelativePath;
     std::cout << "[SyncHelper] Downloading: '" << serverRelativePath << "' to '" << local_full_save_path.string() << "'" << std::endl;
@@ -103,22 +241,20 @@ void SyncHelper::performDownload(const std::string& serverRelativePath, const st
     // Thông báo cho watcher bỏ qua sự kiện tạo/ghi file này
     // watcher_.ignoreEventOnce(localSaveRelativePath); // Đã gọi ở processServerOperations
 
-    ClientSyncErrorCode dl_res = http_client_->downloadFile(token, serverRelativePath, local_full_save_path.string());
+    ClientSyncErrorCode dl_res = downloadWithDelta(token, serverRelativePath, local_full_save_path);
 
     if (dl_res == ClientSyncErrorCode::ERROR_AUTH_FAILED) {
         std::cerr << "[SyncHelper] Download '" << serverRelativePath << "' nhận lỗi 401. Thử đăng nhập lại." << std::endl;
-        auth_manager_->invalidateToken();
-        if (!auth_manager_->ensureAuthenticated()) {
-            throw std::runtime_error("SyncHelper: Đăng nhập lại thất bại sau lỗi 401 khi download " + serverRelativePath);
-        }
-        token_opt = auth_manager_->getToken();
-        if (!token_opt) throw std::runtime_error("SyncHelper: Không lấy được token mới sau khi đăng nhập lại cho download.");
-        token = *token_opt;
+        token = renewToken(token);
         std::cout << "[SyncHelper] Thử download lại '" << serverRelativePath << "' với token mới." << std::endl;
         // watcher_.ignoreEventOnce(localSaveRelativePath); // Gọi lại ignore vì request trước thất bại và đây là lần thử mới
-        dl_res = http_client_->downloadFile(token, serverRelativePath, local_full_save_path.string());
+        dl_res = downloadWithDelta(token, serverRelativePath, local_full_save_path);
     }
 
+    if (dl_res == ClientSyncErrorCode::ERROR_RATE_LIMITED) {
+        // Download không trả về header: chờ mức tối thiểu của Retry-After
+        throw SyncPlanExecutor::RetryLater("download '" + serverRelativePath + "' rate limited", std::chrono::seconds(1));
+    }
     if (dl_res == ClientSyncErrorCode::SUCCESS) {
         std::cout << "Download thành công: " << serverRelativePath << std::endl;
         addPathToAppData(serverRelativePath); // File này giờ đã có cục bộ và (hy vọng) khớp server
@@ -132,6 +268,197 @@ void SyncHelper::performDownload(const std::string& serverRelativePath, const st
     }
 }
 
+ApiResponse SyncHelper::uploadWithDelta(const std::string& token, const fs::path& localFullPath, const std::string& serverRelativePath) {
+    std::error_code ec;
+    const std::uintmax_t size = fs::file_size(localFullPath, ec);
+    if (ec || size < FastCdc::AVG_SIZE) {
+        return http_client_->uploadFile(token, localFullPath.string(), serverRelativePath);
+    }
+    // File mới: server có sẵn nội dung thì không gửi gì (FILES_CLAIM), không thì upload theo chunk.
+    // Lỗi xác thực trả về để caller đăng nhập lại
+    auto uploadNew = [&]() {
+        const std::string checksum = local_fs_->calculateChecksum(localFullPath);
+        if (checksum.empty()) return http_client_->uploadFile(token, localFullPath.string(), serverRelativePath);
+        ApiResponse res = http_client_->claimFile(token, serverRelativePath, checksum);
+        if (res.isSuccess()) {
+            std::cout << "[SyncHelper] Server already has " << serverRelativePath << " (" << size << " bytes not sent)" << std::endl;
+            return res;
+        }
+        // Lỗi xác thực / hết hạn mức: trả về cho caller, gửi thêm request chỉ tốn thêm hạn mức
+        auto mustReturn = [](const ApiResponse& r) {
+            return r.error_code == ClientSyncErrorCode::ERROR_AUTH_FAILED || r.error_code == ClientSyncErrorCode::ERROR_RATE_LIMITED;
+        };
+        if (mustReturn(res)) return res;
+        res = uploadWithChunks(token, localFullPath, serverRelativePath, checksum);
+        if (res.isSuccess() || mustReturn(res)) return res;
+        std::cerr << "[SyncHelper] Chunked upload '" << serverRelativePath << "' thất bại (" << res.statusCode
+                  << "), upload nguyên file." << std::endl;
+        return http_client_->uploadFile(token, localFullPath.string(), serverRelativePath);
+    };
+    if (size < BlockDelta::DEFAULT_MIN_FILE_SIZE) {
+        return uploadNew();
+    }
+
+    // 404: file chưa có trên server (hoặc server cũ) -> upload nguyên file
+    std::string signatureBytes, serverChecksum;
+    BlockDelta::Signature serverSignature;
+    if (http_client_->getFileSignature(token, serverRelativePath, signatureBytes, serverChecksum) == ClientSyncErrorCode::SUCCESS
+        && !serverChecksum.empty()) {
+        std::istringstream signatureIn(signatureBytes);
+        if (!BlockDelta::read_signature(signatureIn, serverSignature)) serverChecksum.clear();
+    } else {
+        serverChecksum.clear();
+    }
+    if (serverChecksum.empty()) {
+        return uploadNew();
+    }
+
+    // Delta ghi ra file tạm ngoài thư mục đang theo dõi
+    const std::string newChecksum = local_fs_->calculateChecksum(localFullPath);
+    const std::string deltaPath = Poco::TemporaryFile::tempName();
+    BlockDelta::DeltaStats stats;
+    bool ok = false;
+    {
+        std::ifstream target(localFullPath, std::ios::binary);
+        std::ofstream deltaOut(deltaPath, std::ios::binary | std::ios::trunc);
+        ok = target && deltaOut && BlockDelta::write_delta(serverSignature, target, deltaOut, &stats);
+    }
+
+    ApiResponse res;
+    if (ok && !newChecksum.empty() && BlockDelta::delta_worthwhile(stats.delta_bytes, size, BlockDelta::DEFAULT_MAX_DELTA_PERCENT)) {
+        std::cout << "[SyncHelper] Delta upload: " << serverRelativePath << " (" << stats.delta_bytes << " / " << size << " bytes)" << std::endl;
+        res = http_client_->uploadDelta(token, deltaPath, serverRelativePath, serverChecksum, newChecksum);
+    }
+    fs::remove(deltaPath, ec);
+    if (res.isSuccess() || res.error_code == ClientSyncErrorCode::ERROR_RATE_LIMITED) return res;
+    if (res.statusCode != 0) {
+        // 412: file trên server đã đổi; 422: delta không khớp (file cục bộ đổi giữa chừng)
+        std::cerr << "[SyncHelper] Delta upload '" << serverRelativePath << "' bị từ chối (" << res.statusCode
+                  << "), upload nguyên file." << std::endl;
+    }
+    return http_client_->uploadFile(token, localFullPath.string(), serverRelativePath);
+}
+
+ApiResponse SyncHelper::uploadWithChunks(const std::string& token, const fs::path& localFullPath, const std::string& serverRelativePath,
+                                         const std::string& checksum) {
+    constexpr std::size_t kFrameBatchBytes = 8u << 20; // Gom frame thành request ~8 MiB
+
+    ApiResponse failed;
+    failed.error_code = ClientSyncErrorCode::ERROR_LOCAL_FILE_IO;
+    failed.error_message = "Could not read " + localFullPath.string();
+
+    // Cắt file, chỉ giữ hash và vị trí từng chunk
+    std::vector<std::string> hashes;
+    std::vector<std::pair<std::uint64_t, std::uint32_t>> spans; // offset, length
+    {
+        std::ifstream in(localFullPath, std::ios::binary);
+        std::uint64_t offset = 0;
+        const bool ok = in && FastCdc::split(in, [&](const unsigned char* data, std::size_t length) {
+            hashes.push_back(FastCdc::chunk_hash(data, length));
+            spans.emplace_back(offset, static_cast<std::uint32_t>(length));
+            offset += length;
+            return true;
+        });
+        if (!ok) return failed;
+    }
+    ApiResponse res = http_client_->queryMissingChunks(token, hashes);
+    if (!res.isSuccess()) return res;
+    std::set<std::string> missing;
+    if (res.body.contains(JsonKeys::MISSING) && res.body[JsonKeys::MISSING].is_array()) {
+        for (const auto& hash : res.body[JsonKeys::MISSING]) {
+            if (hash.is_string()) missing.insert(hash.get<std::string>());
+        }
+    }
+
+    std::ifstream in(localFullPath, std::ios::binary);
+    if (!in) return failed;
+    std::ostringstream frames;
+    std::size_t sent = 0;
+    std::string buffer;
+    for (std::size_t i = 0; i < hashes.size(); ++i) {
+        if (missing.erase(hashes[i]) == 0) continue; // Server đã có, hoặc đã gửi ở trên (chunk lặp lại trong file)
+        buffer.resize(spans[i].second);
+        in.seekg(static_cast<std::streamoff>(spans[i].first));
+        if (!in.read(&buffer[0], static_cast<std::streamsize>(buffer.size()))) return failed;
+        FastCdc::write_frame(frames, hashes[i], reinterpret_cast<const unsigned char*>(buffer.data()), buffer.size());
+        ++sent;
+        if (frames.tellp() >= static_cast<std::streamoff>(kFrameBatchBytes)) {
+            res = http_client_->uploadChunks(token, frames.str());
+            if (!res.isSuccess()) return res;
+            frames.str("");
+        }
+    }
+    if (frames.tellp() > 0) {
+        res = http_client_->uploadChunks(token, frames.str());
+        if (!res.isSuccess()) return res;
+    }
+
+    std::cout << "[SyncHelper] Chunked upload: " << serverRelativePath << " (" << sent << " / " << hashes.size()
+              << " chunks sent)" << std::endl;
+    return http_client_->commitChunks(token, serverRelativePath, checksum, hashes);
+}
+
+ClientSyncErrorCode SyncHelper::downloadWithDelta(const std::string& token, const std::string& serverRelativePath, const fs::path& localFullPath) {
+    std::error_code ec;
+    const std::uintmax_t size = fs::is_regular_file(localFullPath, ec) ? fs::file_size(localFullPath, ec) : 0;
+    if (ec || size < BlockDelta::DEFAULT_MIN_FILE_SIZE) {
+        return http_client_->downloadFile(token, serverRelativePath, localFullPath.string());
+    }
+
+    std::string signatureBytes;
+    {
+        std::ifstream base(localFullPath, std::ios::binary);
+        BlockDelta::Signature signature;
+        std::ostringstream out;
+        if (!base || !BlockDelta::compute_signature(base, BlockDelta::block_size_for(size), signature)
+            || !BlockDelta::write_signature(signature, out)) {
+            return http_client_->downloadFile(token, serverRelativePath, localFullPath.string());
+        }
+        signatureBytes = out.str();
+    }
+
+    // File tạm cạnh file đích để rename là atomic
+    const fs::path dir = localFullPath.parent_path();
+    const std::string name = localFullPath.filename().string();
+    const fs::path bodyPath = dir / ("." + name + ".delta-download");
+    const fs::path resultPath = dir / ("." + name + ".delta-result");
+    auto cleanup = [&]() {
+        fs::remove(bodyPath, ec);
+        fs::remove(resultPath, ec);
+    };
+
+    bool isDelta = false;
+    std::string serverChecksum;
+    ClientSyncErrorCode rc = http_client_->downloadDelta(token, serverRelativePath, signatureBytes, bodyPath.string(), isDelta, serverChecksum);
+    if (rc == ClientSyncErrorCode::ERROR_AUTH_FAILED) {
+        cleanup();
+        return rc; // performDownload đăng nhập lại rồi thử lại
+    }
+    if (rc == ClientSyncErrorCode::SUCCESS) {
+        fs::path received = bodyPath;
+        if (isDelta) {
+            std::ifstream base(localFullPath, std::ios::binary);
+            std::ifstream delta(bodyPath, std::ios::binary);
+            std::ofstream out(resultPath, std::ios::binary | std::ios::trunc);
+            const bool applied = base && delta && out && BlockDelta::apply_delta(base, delta, out);
+            out.close();
+            received = applied && out ? resultPath : fs::path();
+        }
+        if (!received.empty() && (serverChecksum.empty() || local_fs_->calculateChecksum(received) == serverChecksum)) {
+            fs::rename(received, localFullPath, ec);
+            if (!ec) {
+                if (isDelta) std::cout << "[SyncHelper] Delta download: " << serverRelativePath << std::endl;
+                cleanup();
+                return ClientSyncErrorCode::SUCCESS;
+            }
+        }
+        std::cerr << "[SyncHelper] Delta download '" << serverRelativePath << "' không dựng lại được file, tải nguyên file." << std::endl;
+    }
+    // Server cũ (404 / 405) hoặc lỗi khác: tải nguyên file như trước
+    cleanup();
+    return http_client_->downloadFile(token, serverRelativePath, localFullPath.string());
+}
+
 void SyncHelper::performDeleteOnServer(const std::string& serverRelativePath) {
     if (!auth_manager_->ensureAuthenticated()) {
         throw std::runtime_error("SyncHelper: Cần đăng nhập để xóa trên server.");
@@ -171,164 +498,400 @@ void SyncHelper::performRenameOnServer(const std::string& oldServerRelativePath,
     }
 }
 
-json SyncHelper::buildClientManifest() {
-    std::cout << "[SyncHelper] Building client manifest..." << std::endl;
-    std::vector<LocalFileInfo> local_files = local_fs_->scanDirectoryRecursive(watcher_root_path_, watcher_root_path_);
-    
-    json client_manifest_payload = { {JsonKeys::CLIENT_FILES, json::array()} };
+json SyncHelper::buildClientManifest(const std::vector<LocalFileInfo>& local_files, const std::vector<std::string>* scope) {
+    std::cout << "[SyncHelper] Building client manifest (" << manifestFormatToString(manifest_format_)
+              << (scope ? ", " + std::to_string(scope->size()) + " changed directories" : std::string()) << ")..." << std::endl;
+    std::set<std::string> scope_set;
+    if (scope) scope_set.insert(scope->begin(), scope->end());
+    auto inScope = [&](const std::string& path) { return !scope || scope_set.count(parentPathOf(path)) > 0; };
+
+    // CBOR / MessagePack: mỗi entry là [relative_path, last_modified, checksum 32 byte, flags(, size)]
+    const bool compact = manifest_format_ != ManifestFormat::JSON;
+    json client_files = json::array();
     std::set<std::string> local_paths_set;
 
     for (const auto& local_file : local_files) {
         local_paths_set.insert(local_file.relativePath);
-        client_manifest_payload[JsonKeys::CLIENT_FILES].push_back({
+        if (!inScope(local_file.relativePath)) continue;
+        // Kích thước file giúp server xếp file nhỏ lên trước trong plan stream
+        if (compact) {
+            json entry = json::array({local_file.relativePath,
+                                      static_cast<std::int64_t>(local_file.lastModifiedPoco.epochTime()),
+                                      checksumToWire(local_file.checksum),
+                                      local_file.isDirectory ? CompactManifest::FLAG_DIRECTORY : 0u});
+            if (!local_file.isDirectory) entry.push_back(static_cast<std::uint64_t>(local_file.size));
+            client_files.push_back(std::move(entry));
+            continue;
+        }
+        json entry = {
             {JsonKeys::RELATIVE_PATH, local_file.relativePath},
             {JsonKeys::LAST_MODIFIED, local_file.lastModifiedPoco.epochTime()},
             {JsonKeys::CHECKSUM, local_file.checksum},
             {JsonKeys::IS_DIRECTORY, local_file.isDirectory}, // Thêm thông tin thư mục
-            {"is_deleted", false} // Thêm cờ is_deleted
-        });
+            {JsonKeys::IS_DELETED, false} // Thêm cờ is_deleted
+        };
+        if (!local_file.isDirectory) entry[JsonKeys::SIZE] = static_cast<std::uint64_t>(local_file.size);
+        client_files.push_back(std::move(entry));
     }
 
     // --- THÊM LOGIC PHÁT HIỆN XÓA Ở ĐÂY ---
     for (const std::string& path_in_app_data : app_data_.paths_on_server) {
-        if (local_paths_set.find(path_in_app_data) == local_paths_set.end()) {
+        if (local_paths_set.find(path_in_app_data) == local_paths_set.end() && inScope(path_in_app_data)) {
             // File này có trong app_data nhưng không có trên đĩa -> đã bị xóa
             std::cout << "[Manifest] Detected deleted local file: " << path_in_app_data << std::endl;
-            client_manifest_payload[JsonKeys::CLIENT_FILES].push_back({
+            if (compact) {
+                client_files.push_back(json::array({path_in_app_data, 0, nullptr, CompactManifest::FLAG_DELETED}));
+                continue;
+            }
+            client_files.push_back({
                 {JsonKeys::RELATIVE_PATH, path_in_app_data},
-                {"is_deleted", true} // Báo cho server biết file này đã bị xóa
+                {JsonKeys::IS_DELETED, true} // Báo cho server biết file này đã bị xóa
             });
         }
     }
     // --- KẾT THÚC THÊM LOGIC ---
 
-    std::cout << "[SyncHelper] Client manifest built with " << client_manifest_payload[JsonKeys::CLIENT_FILES].size() << " items." << std::endl;
-    return client_manifest_payload;
+    std::cout << "[SyncHelper] Client manifest built with " << client_files.size() << " items." << std::endl;
+    json manifest = { {JsonKeys::CLIENT_FILES, std::move(client_files)} };
+    if (scope) manifest[JsonKeys::SCOPE] = *scope;
+    return manifest;
+}
+
+std::optional<std::vector<std::string>> SyncHelper::findChangedDirectories(std::string& token, const LocalTreeHashes& tree) {
+    const std::set<std::string> known_on_server(app_data_.paths_on_server.begin(), app_data_.paths_on_server.end());
+    std::vector<std::string> changed;
+    std::vector<std::string> frontier{""}; // Mỗi vòng là một request cho cả một mức của cây
+    std::size_t requests = 0;
+
+    while (!frontier.empty()) {
+        json directories = json::array();
+        for (const auto& dir : frontier) {
+            directories.push_back({{JsonKeys::PATH, dir}, {JsonKeys::HASH, tree.hashOf(dir)}});
+        }
+        const json payload = {{JsonKeys::DIRECTORIES, std::move(directories)}};
+        ApiResponse res = http_client_->postSyncTree(token, payload, manifest_format_);
+        if (res.statusCode == Poco::Net::HTTPResponse::HTTP_UNAUTHORIZED) {
+            auth_manager_->invalidateToken();
+            auto token_opt = auth_manager_->ensureAuthenticated() ? auth_manager_->getToken() : std::nullopt;
+            if (!token_opt) throw std::runtime_error("SyncHelper: Đăng nhập lại thất bại sau lỗi 401 khi gửi tree hash.");
+            token = *token_opt;
+            res = http_client_->postSyncTree(token, payload, manifest_format_);
+        }
+        if (res.statusCode == Poco::Net::HTTPResponse::HTTP_NOT_FOUND ||
+            res.statusCode == Poco::Net::HTTPResponse::HTTP_METHOD_NOT_ALLOWED) {
+            std::cerr << "[SyncHelper] Server does not support tree sync. Using full manifests." << std::endl;
+            tree_sync_supported_ = false;
+            return std::nullopt;
+        }
+        if (!res.isSuccess() || !res.body.contains(JsonKeys::DIRECTORIES) || !res.body[JsonKeys::DIRECTORIES].is_array()) {
+            throw std::runtime_error("SyncHelper: Tree sync thất bại: " + res.error_message + " (Code: " + std::to_string(res.statusCode) + ")");
+        }
+        ++requests;
+
+        frontier.clear();
+        for (const auto& dir : res.body[JsonKeys::DIRECTORIES]) {
+            const std::string path = dir.value(JsonKeys::PATH, std::string());
+            const std::string server_hash = dir.value(JsonKeys::HASH, std::string());
+            if (tree.hasDirectory(path) && server_hash == tree.hashOf(path)) continue; // Cả cây con giống nhau
+            changed.push_back(path);
+
+            std::map<std::string, std::pair<bool, std::string>> server_children; // name -> (is_directory, value hex)
+            if (dir.contains(JsonKeys::CHILDREN) && dir[JsonKeys::CHILDREN].is_array()) {
+                for (const auto& child : dir[JsonKeys::CHILDREN]) {
+                    if (!child.is_array() || child.size() < 3 || !child[0].is_string() || !child[1].is_boolean()) continue;
+                    server_children[child[0].get<std::string>()] = {child[1].get<bool>(), treeValueToHex(child[2])};
+                }
+            }
+
+            for (const auto& child : tree.childrenOf(path)) {
+                if (!child.isDirectory) continue;
+                const std::string child_path = LocalTreeHashes::joinPath(path, child.name);
+                auto it = server_children.find(child.name);
+                if (it == server_children.end() || !it->second.first) {
+                    tree.collectSubtree(child_path, changed); // Chỉ có ở client: gửi cả cây con, không cần hỏi
+                } else if (it->second.second != child.value) {
+                    frontier.push_back(child_path);
+                }
+                if (it != server_children.end()) server_children.erase(it);
+            }
+            for (const auto& [name, info] : server_children) {
+                if (!info.first) continue;
+                const std::string child_path = LocalTreeHashes::joinPath(path, name);
+                // Thư mục client đã xoá: tombstone nằm trong manifest của thư mục cha, không cần đi xuống
+                if (known_on_server.count(child_path) > 0) continue;
+                frontier.push_back(child_path); // Chỉ có trên server: lấy các con để tải về
+            }
+        }
+    }
+
+    std::cout << "[SyncHelper] Tree sync: " << changed.size() << " changed directories after " << requests << " requests." << std::endl;
+    return changed;
 }
 
 /// @brief ////////////////////////////////////////////////////////////////////////
 /// @param operationsArray 
 void SyncHelper::processServerOperations(const json& operationsArray) {
     std::cout << "[SyncHelper] Processing " << operationsArray.size() << " server operations..." << std::endl;
-    if (!auth_manager_->ensureAuthenticated()) { // Đảm bảo xác thực trước khi bắt đầu một loạt operations
+    try {
+        currentToken(); // Đảm bảo xác thực trước khi bắt đầu một loạt operations
+    } catch (const std::exception&) {
         std::cerr << "[SyncHelper] Authentication failed before processing server operations. Aborting." << std::endl;
         return;
     }
-    std::vector<json> createDirOps;
-    std::vector<json> otherOps;
 
+    std::vector<SyncPlanExecutor::Task> tasks;
+    tasks.reserve(operationsArray.size());
     for (const auto& op_json : operationsArray) {
-       std::string action_str = op_json.value(JsonKeys::SYNC_ACTION_TYPE, "");
-    std::string rel_path = op_json.value(JsonKeys::RELATIVE_PATH, "");
-    if (rel_path.empty()) continue;
+        if (auto task = taskFromOperation(op_json)) tasks.push_back(std::move(*task));
+    }
 
-    // QUAN TRỌNG: Luôn dùng đường dẫn đầy đủ để kiểm tra
-    fs::path local_full_path = fs::path(watcher_root_path_) / rel_path;
+    beginPlanExecution();
+    flushMetadataBatch(tasks);
+
+    const SyncPlanExecutor executor(sync_options_);
+    std::cout << "[SyncHelper] Executing " << tasks.size() << " operations with " << executor.options().workers
+              << " worker(s)..." << std::endl;
+    const SyncPlanExecutor::Progress progress = executor.run(
+        tasks, [this](const SyncPlanExecutor::Task& task) { executeServerOperation(task); }, progressReporter(tasks.size()));
+    endPlanExecution(progress);
+}
 
-    if (action_str == "UPLOAD_TO_SERVER") {
-        // Kiểm tra lại điều kiện fs::exists() để tránh lỗi
-        if (fs::exists(local_full_path) && fs::is_directory(local_full_path)) {
-            createDirOps.push_back(op_json);
+std::optional<SyncPlanExecutor::Task> SyncHelper::taskFromOperation(const json& op_json) const {
+    SyncPlanExecutor::Task task;
+    task.action = op_json.value(JsonKeys::SYNC_ACTION_TYPE, "");
+    task.path = op_json.value(JsonKeys::RELATIVE_PATH, "");
+    task.old_path = op_json.value(JsonKeys::OLD_PATH, "");
+    if (task.path.empty()) {
+        std::cerr << "[SyncHelper] Operation missing relative_path, skipping." << std::endl;
+        return std::nullopt;
+    }
+
+    // QUAN TRỌNG: Luôn dùng đường dẫn đầy đủ để kiểm tra
+    const fs::path local_full_path = fs::path(watcher_root_path_) / task.path;
+    std::error_code ec;
+    if (task.action == "UPLOAD_TO_SERVER") {
+        if (fs::is_directory(local_full_path, ec)) {
+            task.creates_directory = true; // Chạy trước các operation bên trong thư mục
         } else {
-            otherOps.push_back(op_json);
+            task.bytes = fs::file_size(local_full_path, ec);
+            if (ec) task.bytes = 0;
         }
-    } else {
-        otherOps.push_back(op_json);
+    } else if (task.action == "DOWNLOAD_TO_CLIENT" || task.action == "CONFLICT_SERVER_WINS") {
+        if (op_json.contains(JsonKeys::SIZE) && op_json[JsonKeys::SIZE].is_number_unsigned()) {
+            task.bytes = op_json[JsonKeys::SIZE].get<std::uint64_t>();
+        } else {
+            // Server cũ không gửi kích thước: lấy bản cục bộ (nếu có) làm ước lượng cho giới hạn byte
+            task.bytes = fs::file_size(local_full_path, ec);
+            if (ec) task.bytes = 0;
+        }
+    } else if (task.action == "DELETE_ON_CLIENT" || task.action == "DELETE_ON_SERVER" || task.action == "NO_ACTION") {
+        task.uses_network = false;
     }
+    return task;
 }
 
-    std::sort(createDirOps.begin(), createDirOps.end(), [](const json& a, const json& b) {
-        std::string path_a = a.value(JsonKeys::RELATIVE_PATH, "");
-        std::string path_b = b.value(JsonKeys::RELATIVE_PATH, "");
-        return std::count(path_a.begin(), path_a.end(), '/') < std::count(path_b.begin(), path_b.end(), '/');
+void SyncHelper::beginPlanExecution() {
+    std::lock_guard<std::mutex> lock(app_data_mutex_);
+    app_data_deferred_ = true;
+}
+
+void SyncHelper::endPlanExecution(const SyncPlanExecutor::Progress& progress) {
+    {
+        std::lock_guard<std::mutex> lock(app_data_mutex_);
+        app_data_deferred_ = false;
+        if (app_data_dirty_) saveAppData();
+        app_data_dirty_ = false;
+    }
+    std::cout << "[SyncHelper] Server operations done: " << progress.succeeded << " succeeded, " << progress.failed
+              << " failed, " << progress.skipped << " skipped, " << progress.retries << " retries, " << progress.throttled
+              << " rate-limit waits." << std::endl;
+}
+
+SyncHelper::PlanRun::PlanRun(const SyncPlanExecutor::Options& options, SyncPlanExecutor::Runner runner)
+    : executor(options), stream(executor, std::move(runner), progressReporter(0)) {}
+
+void SyncHelper::addPlanOperation(PlanRun& run, const json& operation) {
+    std::optional<SyncPlanExecutor::Task> task = taskFromOperation(operation);
+    if (!task) return;
+    const bool batchable = batch_supported_ && (task->creates_directory || (task->action == "MOVE_ON_SERVER" && !task->old_path.empty()));
+    if (batchable) {
+        run.batchable.push_back(std::move(*task));
+        if (run.batchable.size() >= kMaxBatchOperations) flushPlanBatch(run);
+        return;
+    }
+    flushPlanBatch(run);
+    run.stream.add(std::move(*task));
+}
+
+void SyncHelper::flushPlanBatch(PlanRun& run) {
+    if (run.batchable.empty()) return;
+    flushMetadataBatch(run.batchable);
+    for (auto& task : run.batchable) run.stream.add(std::move(task)); // Phần batch chưa làm được
+    run.batchable.clear();
+}
+
+void SyncHelper::flushMetadataBatch(std::vector<SyncPlanExecutor::Task>& tasks) {
+    if (!batch_supported_) return;
+
+    std::vector<std::size_t> queued;
+    for (std::size_t i = 0; i < tasks.size(); ++i) {
+        if (tasks[i].creates_directory || (tasks[i].action == "MOVE_ON_SERVER" && !tasks[i].old_path.empty())) queued.push_back(i);
+    }
+    if (queued.size() < 2) return; // Một thao tác: request riêng như trước
+    // Thư mục cha trước thư mục con, rename sau cùng (đích có thể nằm trong thư mục vừa tạo)
+    auto depth = [](const std::string& path) { return std::count(path.begin(), path.end(), '/'); };
+    std::stable_sort(queued.begin(), queued.end(), [&](std::size_t a, std::size_t b) {
+        if (tasks[a].creates_directory != tasks[b].creates_directory) return tasks[a].creates_directory;
+        return tasks[a].creates_directory && depth(tasks[a].path) < depth(tasks[b].path);
     });
-    
 
-    std::cout << "[SyncHelper] Executing " << createDirOps.size() << " CREATE_DIRECTORY operations first..." << std::endl;
-    for (const auto& op_json : createDirOps) {
-        std::string rel_path = op_json.value(JsonKeys::RELATIVE_PATH, "");
-        try {
-            std::cout << "[SyncHelper] Creating directory on server: " << rel_path << std::endl;
-            ApiResponse res = http_client_->createDirectory(*(auth_manager_->getToken()), rel_path);
-            if (!res.isSuccess() && res.error_code != ClientSyncErrorCode::ERROR_CONFLICT) { // Bỏ qua lỗi "đã tồn tại"
-                std::cerr << "Failed to create directory '" << rel_path << "': " << res.error_message << std::endl;
+    std::string token;
+    try {
+        token = currentToken();
+    } catch (const std::exception&) {
+        return; // Để từng thao tác tự đăng nhập lại
+    }
+    std::vector<bool> done(tasks.size(), false);
+    std::size_t applied = 0;
+    for (std::size_t begin = 0; begin < queued.size(); begin += kMaxBatchOperations) {
+        const std::size_t end = std::min(queued.size(), begin + kMaxBatchOperations);
+        json operations = json::array();
+        for (std::size_t k = begin; k < end; ++k) {
+            const auto& task = tasks[queued[k]];
+            if (task.creates_directory) {
+                operations.push_back({{JsonKeys::OP, MetadataBatch::MKDIR}, {JsonKeys::PATH, task.path}});
+            } else {
+                operations.push_back({{JsonKeys::OP, MetadataBatch::RENAME}, {JsonKeys::OLD_PATH, task.old_path}, {JsonKeys::NEW_PATH, task.path}});
+            }
+        }
+        ApiResponse res = http_client_->batchMetadata(token, operations, false);
+        if (res.statusCode == Poco::Net::HTTPResponse::HTTP_NOT_FOUND || res.statusCode == Poco::Net::HTTPResponse::HTTP_METHOD_NOT_ALLOWED) {
+            std::cout << "[SyncHelper] Server không hỗ trợ FILES_BATCH, gửi từng thao tác." << std::endl;
+            batch_supported_ = false;
+            break;
+        }
+        const bool wellFormed = res.isSuccess() && res.body.contains(JsonKeys::RESULTS) && res.body[JsonKeys::RESULTS].is_array()
+                                && res.body[JsonKeys::RESULTS].size() == end - begin;
+        if (!wellFormed) {
+            std::cerr << "[SyncHelper] Metadata batch thất bại (" << res.statusCode << "), gửi từng thao tác." << std::endl;
+            break;
+        }
+        const json& results = res.body[JsonKeys::RESULTS];
+        for (std::size_t k = begin; k < end; ++k) {
+            const int code = results[k - begin].is_object() ? results[k - begin].value(JsonKeys::CODE, 0) : 0;
+            if (code < 200 || code >= 300) continue; // Chạy lại riêng (rename lỗi thì upload)
+            const auto& task = tasks[queued[k]];
+            if (!task.creates_directory) {
+                removePathFromAppData(task.old_path);
+                addPathToAppData(task.path);
             }
-        } catch (const std::exception& e) {
-            std::cerr << "Exception while creating directory '" << rel_path << "': " << e.what() << std::endl;
+            done[queued[k]] = true;
+            ++applied;
         }
     }
-    std::cout << "[SyncHelper] Executing " << otherOps.size() << " other operations..." << std::endl;
-    for (const auto& op_json : operationsArray) {
-        std::string action_str = op_json.value(JsonKeys::SYNC_ACTION_TYPE, "");
-        std::string rel_path = op_json.value(JsonKeys::RELATIVE_PATH, "");
 
-        if (rel_path.empty()) {
-            std::cerr << "[SyncHelper] Operation missing relative_path, skipping." << std::endl;
-            continue;
-        }
+    std::size_t out = 0;
+    for (std::size_t i = 0; i < tasks.size(); ++i) {
+        if (!done[i]) tasks[out++] = std::move(tasks[i]);
+    }
+    tasks.erase(tasks.begin() + static_cast<std::ptrdiff_t>(out), tasks.end());
+    std::cout << "[SyncHelper] Metadata batch: " << applied << "/" << queued.size() << " operations applied." << std::endl;
+}
 
-        fs::path local_full_path_for_op = fs::path(watcher_root_path_) / rel_path;
+void SyncHelper::executeServerOperation(const SyncPlanExecutor::Task& task) {
+    const std::string& action_str = task.action;
+    const std::string& rel_path = task.path;
+    fs::path local_full_path_for_op = fs::path(watcher_root_path_) / rel_path;
 
-        std::cout << "[SyncHelper] Server operation: " << action_str << " for '" << rel_path << "'" << std::endl;
-        
-        try {
-            if (action_str == "UPLOAD_TO_SERVER") {
-                // Logic này giờ chỉ chạy cho file, vì thư mục đã được lọc ra
-                fs::path local_full_path_for_op = fs::path(watcher_root_path_) / rel_path;
-                if (fs::exists(local_full_path_for_op)) {
-                    performUpload(rel_path);
-                } else {
-                    std::cerr << "[SyncHelper] Server requested UPLOAD for non-existent local file: " << rel_path << std::endl;
-                }
-            } else if (action_str == "DOWNLOAD_TO_CLIENT") {
-                std::cout << "[SyncHelper] Preparing to download: " << rel_path << std::endl;
-                watcher_.ignoreEventOnce(rel_path); // BÁO CHO WATCHER BỎ QUA sự kiện tạo/ghi file này
-                performDownload(rel_path, rel_path); // serverRelativePath và localSaveRelativePath là như nhau
-            } else if (action_str == "DELETE_ON_CLIENT") {
-                std::cout << "[SyncHelper] Preparing to delete local: " << rel_path << std::endl;
-                watcher_.ignoreEventOnce(rel_path); // BÁO CHO WATCHER BỎ QUA sự kiện xóa file này
-                if (local_fs_->deletePathRecursive(local_full_path_for_op)) {
-                    std::cout << "Đã xóa cục bộ theo yêu cầu server: " << rel_path << std::endl;
-                    removePathFromAppData(rel_path); // Cập nhật app_data sau khi xóa cục bộ
-                } else {
-                     std::cerr << "Lỗi xóa cục bộ theo yêu cầu server: " << rel_path << std::endl;
-                }
-            } else if (action_str == "CONFLICT_SERVER_WINS") {
-                std::cout << "[SyncHelper] Conflict: Server wins for '" << rel_path << "'. Preparing to download." << std::endl;
-                // TODO: Xử lý conflict tốt hơn (ví dụ đổi tên file cục bộ trước khi download)
-                // Hiện tại, chỉ ghi đè.
-                fs::path conflict_local_path = local_full_path_for_op; // Đường dẫn file cục bộ hiện tại
-                if (fs::exists(conflict_local_path)) {
-                    // Tạo tên file conflict
-                    std::string stem = conflict_local_path.stem().string();
-                    std::string ext = conflict_local_path.extension().string();
-                    Poco::Timestamp now;
-                    std::string conflict_suffix = "_conflict_local_" + Poco::format("{:%Y%m%d%H%M%S}", now);
-                    fs::path renamed_conflict_path = conflict_local_path.parent_path() / (stem + conflict_suffix + ext);
-                    
-                    std::cout << "[SyncHelper] Renaming local conflicting file to: " << renamed_conflict_path.string() << std::endl;
-                    watcher_.ignoreEventOnce(fs::relative(renamed_conflict_path, watcher_root_path_).string()); // Bỏ qua sự kiện tạo file conflict
-                    watcher_.ignoreEventOnce(rel_path); // Bỏ qua sự kiện xóa (do rename) và sự kiện tạo (do download)
-                    try {
-                        local_fs_->renamePath(conflict_local_path, renamed_conflict_path);
-                    } catch (const std::exception& e_rename) {
-                        std::cerr << "[SyncHelper] Could not rename conflicting local file '" << rel_path << "': " << e_rename.what() << ". Proceeding with overwrite." << std::endl;
-                    }
-                }
-                performDownload(rel_path, rel_path);
-            } else if (action_str == "DELETE_ON_SERVER") {
-                // Server thông báo file này đã bị xóa trên server, client không cần làm gì với file cục bộ
-                // nhưng cần cập nhật app_data_
-                std::cout << "[SyncHelper] Server confirms '" << rel_path << "' is deleted on server. Updating local state." << std::endl;
-                removePathFromAppData(rel_path);
-            } else if (action_str == "NO_ACTION") {
-                std::cout << "[SyncHelper] No action needed for: " << rel_path << std::endl;
-            } else {
-                std::cerr << "[SyncHelper] Unknown server operation: " << action_str << " for " << rel_path << std::endl;
+    std::cout << "[SyncHelper] Server operation: " << action_str << " for '" << rel_path << "'" << std::endl;
+
+    if (task.creates_directory) {
+        std::cout << "[SyncHelper] Creating directory on server: " << rel_path << std::endl;
+        ApiResponse res = withToken([&](const std::string& token) { return http_client_->createDirectory(token, rel_path); });
+        if (!res.isSuccess() && res.error_code != ClientSyncErrorCode::ERROR_CONFLICT) { // Bỏ qua lỗi "đã tồn tại"
+            throw std::runtime_error("Failed to create directory '" + rel_path + "': " + res.error_message);
+        }
+    } else if (action_str == "UPLOAD_TO_SERVER") {
+        if (fs::exists(local_full_path_for_op)) {
+            performUpload(rel_path);
+        } else {
+            std::cerr << "[SyncHelper] Server requested UPLOAD for non-existent local file: " << rel_path << std::endl;
+        }
+    } else if (action_str == "DOWNLOAD_TO_CLIENT") {
+        std::cout << "[SyncHelper] Preparing to download: " << rel_path << std::endl;
+        watcher_.ignoreEventOnce(rel_path); // BÁO CHO WATCHER BỎ QUA sự kiện tạo/ghi file này
+        performDownload(rel_path, rel_path); // serverRelativePath và localSaveRelativePath là như nhau
+    } else if (action_str == "DELETE_ON_CLIENT") {
+        std::cout << "[SyncHelper] Preparing to delete local: " << rel_path << std::endl;
+        watcher_.ignoreEventOnce(rel_path); // BÁO CHO WATCHER BỎ QUA sự kiện xóa file này
+        if (!local_fs_->deletePathRecursive(local_full_path_for_op)) {
+            throw std::runtime_error("Lỗi xóa cục bộ theo yêu cầu server: " + rel_path);
+        }
+        std::cout << "Đã xóa cục bộ theo yêu cầu server: " << rel_path << std::endl;
+        removePathFromAppData(rel_path); // Cập nhật app_data sau khi xóa cục bộ
+    } else if (action_str == "CONFLICT_SERVER_WINS") {
+        std::cout << "[SyncHelper] Conflict: Server wins for '" << rel_path << "'. Preparing to download." << std::endl;
+        fs::path conflict_local_path = local_full_path_for_op; // Đường dẫn file cục bộ hiện tại
+        if (fs::exists(conflict_local_path)) {
+            // Tạo tên file conflict
+            std::string stem = conflict_local_path.stem().string();
+            std::string ext = conflict_local_path.extension().string();
+            Poco::Timestamp now;
+            std::string conflict_suffix = "_conflict_local_" + Poco::format("{:%Y%m%d%H%M%S}", now);
+            fs::path renamed_conflict_path = conflict_local_path.parent_path() / (stem + conflict_suffix + ext);
+
+            std::cout << "[SyncHelper] Renaming local conflicting file to: " << renamed_conflict_path.string() << std::endl;
+            watcher_.ignoreEventOnce(fs::relative(renamed_conflict_path, watcher_root_path_).string()); // Bỏ qua sự kiện tạo file conflict
+            watcher_.ignoreEventOnce(rel_path); // Bỏ qua sự kiện xóa (do rename) và sự kiện tạo (do download)
+            try {
+                local_fs_->renamePath(conflict_local_path, renamed_conflict_path);
+            } catch (const std::exception& e_rename) {
+                std::cerr << "[SyncHelper] Could not rename conflicting local file '" << rel_path << "': " << e_rename.what() << ". Proceeding with overwrite." << std::endl;
             }
-        } catch (const std::exception& e) {
-            std::cerr << "[SyncHelper] Lỗi khi thực thi operation '" << action_str << "' cho '" << rel_path << "': " << e.what() << std::endl;
         }
+        performDownload(rel_path, rel_path);
+    } else if (action_str == "DELETE_ON_SERVER") {
+        // Server thông báo file này đã bị xóa trên server, client không cần làm gì với file cục bộ
+        // nhưng cần cập nhật app_data_
+        std::cout << "[SyncHelper] Server confirms '" << rel_path << "' is deleted on server. Updating local state." << std::endl;
+        removePathFromAppData(rel_path);
+    } else if (action_str == "MOVE_ON_SERVER") {
+        // Client đã đổi tên old_path -> rel_path mà server chưa biết: đổi tên trên server, không upload
+        const std::string& old_path = task.old_path;
+        ApiResponse res = old_path.empty() ? ApiResponse()
+            : withToken([&](const std::string& token) { return http_client_->renamePath(token, old_path, rel_path); });
+        if (res.isSuccess()) {
+            std::cout << "[SyncHelper] Renamed on server: " << old_path << " -> " << rel_path << std::endl;
+            removePathFromAppData(old_path);
+            addPathToAppData(rel_path);
+        } else {
+            std::cerr << "[SyncHelper] Rename '" << old_path << "' on server failed (" << res.statusCode << "), uploading instead." << std::endl;
+            performUpload(rel_path);
+        }
+    } else if (action_str == "MOVE_ON_CLIENT") {
+        // File đã được đổi tên trên server: đổi tên bản cục bộ thay vì tải lại
+        const std::string& old_path = task.old_path;
+        const fs::path old_full_path = fs::path(watcher_root_path_) / old_path;
+        std::error_code ec;
+        bool moved = false;
+        if (!old_path.empty() && fs::is_regular_file(old_full_path, ec) && !fs::exists(local_full_path_for_op, ec)) {
+            fs::create_directories(local_full_path_for_op.parent_path(), ec);
+            watcher_.ignoreEventOnce(old_path);
+            watcher_.ignoreEventOnce(rel_path);
+            moved = local_fs_->renamePath(old_full_path, local_full_path_for_op);
+        }
+        if (moved) {
+            std::cout << "[SyncHelper] Renamed locally: " << old_path << " -> " << rel_path << std::endl;
+            removePathFromAppData(old_path);
+            addPathToAppData(rel_path);
+        } else {
+            watcher_.ignoreEventOnce(rel_path);
+            performDownload(rel_path, rel_path);
+        }
+    } else if (action_str == "NO_ACTION") {
+        std::cout << "[SyncHelper] No action needed for: " << rel_path << std::endl;
+    } else {
+        std::cerr << "[SyncHelper] Unknown server operation: " << action_str << " for " << rel_path << std::endl;
     }
 }
 
@@ -365,6 +928,7 @@ void SyncHelper::triggerManifestSync() {
         return; // Hoặc throw
     }
     std::string token = *token_opt;
+    publishWatchToken(token);
     std::cout << "[SyncHelper] Authentication successful. Proceeding with manifest sync with token: "
               << token.substr(0, std::min((size_t)15, token.length())) << "..." << std::endl;
 
@@ -372,14 +936,41 @@ void SyncHelper::triggerManifestSync() {
     //std::string token = *(auth_manager_->getToken());
     
     try {
-        json client_manifest = buildClientManifest();
+        std::vector<LocalFileInfo> local_files = local_fs_->scanDirectoryRecursive(watcher_root_path_, watcher_root_path_);
+
+        // So tree hash trước: chỉ những thư mục khác server mới có trong manifest
+        std::optional<std::vector<std::string>> scope;
+        if (tree_sync_supported_) {
+            scope = findChangedDirectories(token, LocalTreeHashes(local_files));
+            if (scope && scope->empty()) {
+                std::cout << "[SyncHelper] Tree hash khớp server, không cần gửi manifest." << std::endl;
+                return;
+            }
+        }
+
+        json client_manifest = buildClientManifest(local_files, scope ? &*scope : nullptr);
         if (client_manifest[JsonKeys::CLIENT_FILES].empty()) {
             std::cout << "[SyncHelper] Manifest rỗng, không có gì để gửi (hoặc chưa xử lý xóa)." << std::endl;
             // Có thể vẫn cần gửi manifest rỗng để server biết client không có file nào (nếu đó là logic)
             // Hoặc nếu đây là lần đầu, server sẽ gửi lại toàn bộ file.
         }
 
-        ApiResponse res = http_client_->postSyncManifest(token, client_manifest);
+        // Plan về dạng stream: operation chạy ngay khi tới, trong lúc server còn đang tính phần sau.
+        // Chỉ response 2xx mới có operation, nên các lần gửi lại bên dưới không bao giờ chạy plan hai lần.
+        std::optional<PlanRun> plan;
+        std::size_t streamed = 0;
+        auto onOperation = [this, &plan, &streamed](const json& operation) {
+            if (!plan) {
+                beginPlanExecution();
+                plan.emplace(sync_options_, [this](const SyncPlanExecutor::Task& task) { executeServerOperation(task); });
+                std::cout << "[SyncHelper] Executing streamed plan with " << plan->executor.options().workers << " worker(s)..." << std::endl;
+            }
+            addPlanOperation(*plan, operation);
+            ++streamed;
+        };
+        auto sendManifest = [&]() { return http_client_->streamSyncManifest(token, client_manifest, manifest_format_, onOperation); };
+
+        ApiResponse res = sendManifest();
         if (res.statusCode == Poco::Net::HTTPResponse::HTTP_UNAUTHORIZED) {
             std::cerr << "[SyncHelper] Manifest sync received 401. Token might have expired during operation. Invalidating and retrying login." << std::endl;
             auth_manager_->invalidateToken(); // Vô hiệu hóa token cũ
@@ -392,9 +983,25 @@ void SyncHelper::triggerManifestSync() {
             }
             token = *token_opt;
             std::cout << "[SyncHelper] Retrying manifest sync with new token." << std::endl;
-            res = http_client_->postSyncManifest(token, client_manifest); // Thử lại request
+            res = sendManifest(); // Thử lại request
         }
 
+        if ((res.statusCode == Poco::Net::HTTPResponse::HTTP_BAD_REQUEST ||
+             res.statusCode == Poco::Net::HTTPResponse::HTTP_UNSUPPORTED_MEDIA_TYPE) && manifest_format_ != ManifestFormat::JSON) {
+            // Server cũ chỉ hiểu JSON: chuyển hẳn sang JSON cho các lần sync sau
+            std::cerr << "[SyncHelper] Server rejected " << manifestFormatToString(manifest_format_)
+                      << " manifest (" << res.error_message << "). Falling back to JSON." << std::endl;
+            manifest_format_ = ManifestFormat::JSON;
+            client_manifest = buildClientManifest(local_files, scope ? &*scope : nullptr);
+            res = sendManifest();
+        }
+
+        publishWatchToken(token); // Có thể đã đăng nhập lại ở trên
+        if (plan) {
+            // Stream bị cắt giữa chừng vẫn chạy hết phần đã nhận; lần sync sau làm nốt
+            flushPlanBatch(*plan);
+            endPlanExecution(plan->stream.finish());
+        }
         if (!res.isSuccess()) {
             std::cerr << "[SyncHelper] Lỗi gửi manifest (sau khi có thể đã thử lại): " << res.error_message << " (Code: " << res.statusCode << ")" << std::endl;
             return;
@@ -408,7 +1015,11 @@ void SyncHelper::triggerManifestSync() {
 
 
         if (res.body.contains(JsonKeys::SYNC_OPERATIONS) && res.body[JsonKeys::SYNC_OPERATIONS].is_array()) {
-            processServerOperations(res.body[JsonKeys::SYNC_OPERATIONS]);
+            // Server không có plan stream: cả plan nằm trong body
+            processServerOperations(expandCompactOperations(res.body[JsonKeys::SYNC_OPERATIONS]));
+        } else if (res.body.contains(JsonKeys::COUNT)) {
+            std::cout << "[SyncHelper] Streamed plan: " << streamed << "/" << res.body.value(JsonKeys::COUNT, std::size_t{0})
+                      << " operations received." << std::endl;
         } else {
             std::cerr << "[SyncHelper] Phản hồi manifest từ server không hợp lệ hoặc không có operations." << std::endl;
         }
@@ -419,6 +1030,46 @@ void SyncHelper::triggerManifestSync() {
     }
 }
 
+void SyncHelper::publishWatchToken(const std::string& token) {
+    std::lock_guard<std::mutex> lock(watch_mutex_);
+    watch_token_ = token;
+}
+
+SyncHelper::WatchResult SyncHelper::watchServerChanges(int timeoutSeconds) {
+    std::string token, lastHash;
+    {
+        std::lock_guard<std::mutex> lock(watch_mutex_);
+        token = watch_token_;
+        lastHash = watch_hash_;
+    }
+    if (token.empty()) return WatchResult::FAILED;
+
+    ApiResponse res = http_client_->watchChanges(token, lastHash, timeoutSeconds);
+    if (res.statusCode == Poco::Net::HTTPResponse::HTTP_NOT_FOUND ||
+        res.statusCode == Poco::Net::HTTPResponse::HTTP_METHOD_NOT_ALLOWED) {
+        std::cerr << "[SyncHelper] Server does not support change watch. Falling back to periodic sync." << std::endl;
+        return WatchResult::UNSUPPORTED;
+    }
+    if (res.statusCode == Poco::Net::HTTPResponse::HTTP_UNAUTHORIZED) {
+        // Token hết hạn: lần sync kế tiếp đăng nhập lại và cập nhật token cho watch
+        std::lock_guard<std::mutex> lock(watch_mutex_);
+        if (watch_token_ == token) watch_token_.clear();
+        return WatchResult::CHANGED;
+    }
+    if (!res.isSuccess() || !res.body.is_object() || !res.body.contains(JsonKeys::CHANGED)) {
+        std::cerr << "[SyncHelper] Watch thất bại: " << res.error_message << " (Code: " << res.statusCode << ")" << std::endl;
+        return WatchResult::FAILED;
+    }
+
+    // Thay đổi do chính client này upload cũng đánh thức watch; lần sync đó chỉ tốn một request SYNC_TREE.
+    {
+        std::lock_guard<std::mutex> lock(watch_mutex_);
+        watch_hash_ = res.body.value(JsonKeys::HASH, std::string());
+    }
+    if (res.body.value(JsonKeys::CHANGED, false)) return WatchResult::CHANGED;
+    return res.retry_after_seconds > 0 ? WatchResult::BUSY : WatchResult::UNCHANGED;
+}
+
 
 // --- Private methods for app_data.json management ---
 void SyncHelper::loadAppData() {
@@ -461,21 +1112,23 @@ void SyncHelper::saveAppData() {
 }
 
 void SyncHelper::addPathToAppData(const std::string& relativePath) {
+    std::lock_guard<std::mutex> lock(app_data_mutex_);
     Poco::Path p(relativePath);
     std::string normalized_path = p.toString(Poco::Path::PATH_UNIX);
     auto it = std::find(app_data_.paths_on_server.begin(), app_data_.paths_on_server.end(), normalized_path);
     if (it == app_data_.paths_on_server.end()) {
         app_data_.paths_on_server.push_back(normalized_path);
-        saveAppData();
+        if (app_data_deferred_) app_data_dirty_ = true; else saveAppData();
     }
 }
 
 void SyncHelper::removePathFromAppData(const std::string& relativePath) {
+    std::lock_guard<std::mutex> lock(app_data_mutex_);
     Poco::Path p(relativePath);
     std::string normalized_path = p.toString(Poco::Path::PATH_UNIX);
     auto new_end = std::remove(app_data_.paths_on_server.begin(), app_data_.paths_on_server.end(), normalized_path);
     if (new_end != app_data_.paths_on_server.end()) {
         app_data_.paths_on_server.erase(new_end, app_data_.paths_on_server.end());
-        saveAppData();
+        if (app_data_deferred_) app_data_dirty_ = true; else saveAppData();
     }
 }
\ No newline at end of file
@@ -0,0 +1,333 @@
+#include "sync_plan_executor.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+    bool is_move(const SyncPlanExecutor::Task& task) {
+        return task.action == "MOVE_ON_SERVER" || task.action == "MOVE_ON_CLIENT";
+    }
+
+    bool is_delete(const SyncPlanExecutor::Task& task) {
+        return task.action == "DELETE_ON_CLIENT" || task.action == "DELETE_ON_SERVER";
+    }
+
+    // path == dir hoặc nằm dưới dir
+    bool is_same_or_under(const std::string& path, const std::string& dir) {
+        if (path.size() < dir.size() || path.compare(0, dir.size(), dir) != 0) return false;
+        return path.size() == dir.size() || path[dir.size()] == '/';
+    }
+
+    bool paths_overlap(const std::string& a, const std::string& b) {
+        return !a.empty() && !b.empty() && (is_same_or_under(a, b) || is_same_or_under(b, a));
+    }
+}
+
+SyncPlanExecutor::SyncPlanExecutor(Options options) : options_(options) {
+    if (options_.max_attempts == 0) options_.max_attempts = 1;
+    if (options_.max_connections == 0) options_.max_connections = std::max(1u, options_.workers);
+}
+
+std::vector<std::vector<std::size_t>> SyncPlanExecutor::build_dependencies(const std::vector<Task>& tasks) {
+    std::vector<std::vector<std::size_t>> dependencies(tasks.size());
+
+    // Thư mục được tạo trong plan -> task tạo nó
+    std::map<std::string, std::size_t> directory_tasks;
+    for (std::size_t i = 0; i < tasks.size(); ++i) {
+        if (tasks[i].creates_directory) directory_tasks[tasks[i].path] = i;
+    }
+    if (!directory_tasks.empty()) {
+        for (std::size_t i = 0; i < tasks.size(); ++i) {
+            // Chỉ cần thư mục cha gần nhất có trong plan: nó lại phụ thuộc vào các thư mục phía trên
+            std::string parent = tasks[i].path;
+            for (auto slash = parent.rfind('/'); slash != std::string::npos && slash > 0; slash = parent.rfind('/')) {
+                parent.resize(slash);
+                auto it = directory_tasks.find(parent);
+                if (it != directory_tasks.end()) {
+                    dependencies[i].push_back(it->second);
+                    break;
+                }
+            }
+        }
+    }
+
+    // Delete chạy sau move liên quan (nguồn hoặc đích nằm trong / chứa path bị xoá)
+    std::vector<std::size_t> moves;
+    for (std::size_t i = 0; i < tasks.size(); ++i) {
+        if (is_move(tasks[i])) moves.push_back(i);
+    }
+    if (!moves.empty()) {
+        for (std::size_t i = 0; i < tasks.size(); ++i) {
+            if (!is_delete(tasks[i])) continue;
+            for (std::size_t move : moves) {
+                if (paths_overlap(tasks[i].path, tasks[move].old_path) || paths_overlap(tasks[i].path, tasks[move].path)) {
+                    dependencies[i].push_back(move);
+                }
+            }
+        }
+    }
+    return dependencies;
+}
+
+// Lịch chạy dùng chung cho run() và Stream. Task chỉ được thêm vào cuối (deque: tham chiếu không đổi).
+struct SyncPlanExecutor::State {
+    enum class Outcome { PENDING, SUCCEEDED, FAILED, SKIPPED };
+
+    const Options& options;
+    Runner runner;
+    ProgressCallback on_progress;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Task> tasks;
+    std::vector<std::vector<std::size_t>> dependents;
+    std::vector<std::size_t> pending;    // Dependency chưa xong
+    std::vector<bool> poisoned;          // Có dependency bị lỗi hoặc bị bỏ qua
+    std::vector<Outcome> outcomes;
+    std::set<std::size_t> ready;         // Theo thứ tự trong plan
+    bool closed = false;                 // Không còn task mới
+    unsigned connections = 0;
+    std::uint64_t inflight_bytes = 0;
+    std::chrono::steady_clock::time_point paused_until{}; // RetryLater: chưa bắt đầu task mới trước lúc này
+    Progress progress;
+
+    // Chỉ Stream dùng: dependency nối về task đã add
+    std::map<std::string, std::size_t> directory_tasks;
+    std::vector<std::size_t> moves;
+
+    State(const Options& options, Runner runner, ProgressCallback on_progress)
+        : options(options), runner(std::move(runner)), on_progress(std::move(on_progress)) {}
+
+    // Các hàm *_locked gọi khi giữ mutex
+    std::size_t push_locked(Task task) {
+        const std::size_t i = tasks.size();
+        ++progress.total;
+        progress.bytes_total += task.bytes;
+        tasks.push_back(std::move(task));
+        dependents.emplace_back();
+        pending.push_back(0);
+        poisoned.push_back(false);
+        outcomes.push_back(Outcome::PENDING);
+        return i;
+    }
+
+    void depend_locked(std::size_t i, std::size_t dependency) {
+        if (outcomes[dependency] == Outcome::PENDING) {
+            dependents[dependency].push_back(i);
+            ++pending[i];
+        } else if (outcomes[dependency] != Outcome::SUCCEEDED) {
+            poisoned[i] = true;
+        }
+    }
+
+    // Task i đã nối xong dependency
+    void release_locked(std::size_t i) {
+        if (pending[i] > 0) return;
+        if (poisoned[i]) {
+            finish_locked(i, Outcome::SKIPPED);
+        } else {
+            ready.insert(i);
+        }
+    }
+
+    void finish_locked(std::size_t first, Outcome outcome) {
+        std::vector<std::pair<std::size_t, Outcome>> stack{{first, outcome}};
+        while (!stack.empty()) {
+            const auto [i, result] = stack.back();
+            stack.pop_back();
+            outcomes[i] = result;
+            if (result == Outcome::SUCCEEDED) {
+                ++progress.succeeded;
+                progress.bytes_done += tasks[i].bytes;
+            } else if (result == Outcome::FAILED) {
+                ++progress.failed;
+            } else {
+                ++progress.skipped;
+                std::cerr << "[SyncPlanExecutor] Skipping " << tasks[i].action << " '" << tasks[i].path
+                          << "': a dependency failed." << std::endl;
+            }
+            if (on_progress) on_progress(tasks[i], progress);
+            for (std::size_t dependent : dependents[i]) {
+                if (result != Outcome::SUCCEEDED) poisoned[dependent] = true;
+                if (--pending[dependent] > 0) continue;
+                if (poisoned[dependent]) {
+                    stack.emplace_back(dependent, Outcome::SKIPPED);
+                } else {
+                    ready.insert(dependent);
+                }
+            }
+        }
+    }
+
+    // Task sẵn sàng đầu tiên còn vừa giới hạn kết nối / byte
+    std::optional<std::size_t> pick_locked() const {
+        for (std::size_t i : ready) {
+            const Task& task = tasks[i];
+            if (task.uses_network && connections >= options.max_connections) continue;
+            if (task.bytes > 0 && inflight_bytes > 0 && inflight_bytes + task.bytes > options.max_inflight_bytes) continue;
+            return i;
+        }
+        return std::nullopt;
+    }
+
+    bool execute(const Task& task, std::size_t& retries, std::size_t& throttled) {
+        unsigned waits = 0;
+        for (unsigned attempt = 1;;) {
+            std::string error;
+            try {
+                runner(task);
+                return true;
+            } catch (const RetryLater& e) {
+                if (waits < options.max_retry_later) {
+                    // Server quá tải / hết hạn mức: chờ rồi chạy lại, không tính là một lần thử
+                    ++waits;
+                    ++throttled;
+                    const auto until = std::chrono::steady_clock::now() + e.delay;
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        paused_until = std::max(paused_until, until);
+                    }
+                    std::cerr << "[SyncPlanExecutor] " << task.action << " '" << task.path << "': " << e.what() << ", retrying in "
+                              << e.delay.count() << " ms." << std::endl;
+                    std::this_thread::sleep_until(until);
+                    continue;
+                }
+                error = e.what();
+            } catch (const std::exception& e) {
+                error = e.what();
+            } catch (...) {
+                error = "unknown error";
+            }
+            std::cerr << "[SyncPlanExecutor] " << task.action << " '" << task.path << "' failed (attempt " << attempt << "/"
+                      << options.max_attempts << "): " << error << std::endl;
+            if (attempt >= options.max_attempts) return false;
+            ++retries;
+            std::this_thread::sleep_for(options.retry_backoff * attempt);
+            ++attempt;
+        }
+    }
+
+    // Vòng lặp của một worker, trả về khi đã đóng và mọi task đã xong
+    void work() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            const auto now = std::chrono::steady_clock::now();
+            const std::optional<std::size_t> next = now >= paused_until ? pick_locked() : std::nullopt;
+            if (!next) {
+                if (closed && progress.finished() == tasks.size()) return;
+                if (now < paused_until) cv.wait_until(lock, paused_until);
+                else cv.wait(lock);
+                continue;
+            }
+            const std::size_t i = *next;
+            const Task& task = tasks[i];
+            ready.erase(i);
+            if (task.uses_network) ++connections;
+            inflight_bytes += task.bytes;
+            lock.unlock();
+
+            std::size_t retries = 0, throttled = 0;
+            const bool ok = execute(task, retries, throttled);
+
+            lock.lock();
+            if (task.uses_network) --connections;
+            inflight_bytes -= task.bytes;
+            progress.retries += retries;
+            progress.throttled += throttled;
+            finish_locked(i, ok ? Outcome::SUCCEEDED : Outcome::FAILED);
+            cv.notify_all();
+        }
+    }
+};
+
+SyncPlanExecutor::Progress SyncPlanExecutor::run(const std::vector<Task>& tasks, const Runner& runner,
+                                                 const ProgressCallback& on_progress) const {
+    State state(options_, runner, on_progress);
+    const std::size_t n = tasks.size();
+    if (n == 0) return state.progress;
+
+    // Cả plan đã có: nối đủ DAG trước khi worker nào chạy
+    for (const auto& task : tasks) state.push_locked(task);
+    const auto dependencies = build_dependencies(tasks);
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t dependency : dependencies[i]) state.depend_locked(i, dependency);
+    }
+    for (std::size_t i = 0; i < n; ++i) state.release_locked(i);
+    state.closed = true;
+
+    const unsigned workers = static_cast<unsigned>(std::min<std::size_t>(std::max(1u, options_.workers), n));
+    if (workers == 1) {
+        state.work(); // Tuần tự trên thread gọi run()
+        return state.progress;
+    }
+    std::vector<std::thread> threads;
+    threads.reserve(workers);
+    for (unsigned w = 0; w < workers; ++w) threads.emplace_back([&state] { state.work(); });
+    for (auto& thread : threads) thread.join();
+    return state.progress;
+}
+
+SyncPlanExecutor::Stream::Stream(const SyncPlanExecutor& executor, Runner runner, ProgressCallback on_progress)
+    : state_(std::make_unique<State>(executor.options(), std::move(runner), std::move(on_progress))) {
+    const unsigned workers = std::max(1u, executor.options().workers);
+    threads_.reserve(workers);
+    for (unsigned w = 0; w < workers; ++w) threads_.emplace_back([state = state_.get()] { state->work(); });
+}
+
+SyncPlanExecutor::Stream::~Stream() {
+    finish();
+}
+
+void SyncPlanExecutor::Stream::add(Task task) {
+    State& state = *state_;
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.closed) throw std::logic_error("SyncPlanExecutor::Stream::add after finish()");
+    const std::size_t i = state.push_locked(std::move(task));
+    const Task& added = state.tasks[i];
+
+    // Như build_dependencies, nhưng chỉ nhìn về các task đã có
+    if (!state.directory_tasks.empty()) {
+        std::string parent = added.path;
+        for (auto slash = parent.rfind('/'); slash != std::string::npos && slash > 0; slash = parent.rfind('/')) {
+            parent.resize(slash);
+            auto it = state.directory_tasks.find(parent);
+            if (it != state.directory_tasks.end()) {
+                state.depend_locked(i, it->second);
+                break;
+            }
+        }
+    }
+    if (is_delete(added)) {
+        for (std::size_t move : state.moves) {
+            const Task& moved = state.tasks[move];
+            if (paths_overlap(added.path, moved.old_path) || paths_overlap(added.path, moved.path)) state.depend_locked(i, move);
+        }
+    }
+    if (added.creates_directory) state.directory_tasks[added.path] = i;
+    if (is_move(added)) state.moves.push_back(i);
+
+    state.release_locked(i);
+    state.cv.notify_all();
+}
+
+SyncPlanExecutor::Progress SyncPlanExecutor::Stream::finish() {
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->closed = true;
+    }
+    state_->cv.notify_all();
+    for (auto& thread : threads_) {
+        if (thread.joinable()) thread.join();
+    }
+    return state_->progress;
+}
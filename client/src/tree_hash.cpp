@@ -0,0 +1,94 @@
+#include "tree_hash.hpp"
+#include "protocol.hpp" // MerkleTree
+
+#include <openssl/evp.h>
+#include <algorithm>
+#include <memory>
+
+namespace {
+    std::string parentOf(const std::string& path) {
+        std::size_t slash = path.find_last_of('/');
+        return slash == std::string::npos ? std::string() : path.substr(0, slash);
+    }
+
+    std::string nameOf(const std::string& path) {
+        std::size_t slash = path.find_last_of('/');
+        return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+
+    std::size_t depthOf(const std::string& path) {
+        return path.empty() ? 0 : 1 + static_cast<std::size_t>(std::count(path.begin(), path.end(), '/'));
+    }
+}
+
+std::string computeTreeHash(std::vector<LocalTreeHashes::Child>& children) {
+    std::sort(children.begin(), children.end(),
+              [](const LocalTreeHashes::Child& a, const LocalTreeHashes::Child& b) { return a.name < b.name; });
+
+    std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx(EVP_MD_CTX_new(), EVP_MD_CTX_free);
+    EVP_DigestInit_ex(ctx.get(), EVP_sha256(), nullptr);
+    static const char zero = '\0';
+    for (const auto& child : children) {
+        const char kind = child.isDirectory ? MerkleTree::KIND_DIRECTORY : MerkleTree::KIND_FILE;
+        EVP_DigestUpdate(ctx.get(), &kind, 1);
+        EVP_DigestUpdate(ctx.get(), child.name.data(), child.name.size());
+        EVP_DigestUpdate(ctx.get(), &zero, 1);
+        EVP_DigestUpdate(ctx.get(), child.value.data(), child.value.size());
+        EVP_DigestUpdate(ctx.get(), &zero, 1);
+    }
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    EVP_DigestFinal_ex(ctx.get(), digest, &length);
+
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(2 * length, '0');
+    for (unsigned int i = 0; i < length; ++i) {
+        hex[2 * i] = digits[digest[i] >> 4];
+        hex[2 * i + 1] = digits[digest[i] & 0x0f];
+    }
+    return hex;
+}
+
+LocalTreeHashes::LocalTreeHashes(const std::vector<LocalFileInfo>& files) {
+    dirs_[""]; // Sync root luôn có, kể cả khi rỗng
+
+    // Mọi thư mục (kể cả thư mục rỗng và các thư mục cha) có một Dir; file vào children luôn
+    for (const auto& file : files) {
+        const std::string& path = file.relativePath;
+        if (path.empty() || path == ".") continue;
+        if (file.isDirectory) dirs_[path];
+        else dirs_[parentOf(path)].children.push_back({nameOf(path), false, file.checksum});
+        for (std::string dir = parentOf(path); !dir.empty(); dir = parentOf(dir)) dirs_[dir];
+    }
+
+    // Bottom-up: thư mục sâu hơn được tính trước rồi gắn hash vào thư mục cha
+    std::vector<std::string> order;
+    order.reserve(dirs_.size());
+    for (const auto& entry : dirs_) order.push_back(entry.first);
+    std::stable_sort(order.begin(), order.end(),
+                     [](const std::string& a, const std::string& b) { return depthOf(a) > depthOf(b); });
+    for (const std::string& path : order) {
+        Dir& dir = dirs_[path];
+        dir.hash = computeTreeHash(dir.children);
+        if (!path.empty()) dirs_[parentOf(path)].children.push_back({nameOf(path), true, dir.hash});
+    }
+}
+
+std::string LocalTreeHashes::hashOf(const std::string& dirPath) const {
+    auto it = dirs_.find(dirPath);
+    return it == dirs_.end() ? std::string() : it->second.hash;
+}
+
+const std::vector<LocalTreeHashes::Child>& LocalTreeHashes::childrenOf(const std::string& dirPath) const {
+    static const std::vector<Child> none;
+    auto it = dirs_.find(dirPath);
+    return it == dirs_.end() ? none : it->second.children;
+}
+
+void LocalTreeHashes::collectSubtree(const std::string& dirPath, std::vector<std::string>& out) const {
+    if (!hasDirectory(dirPath)) return;
+    out.push_back(dirPath);
+    for (const auto& child : childrenOf(dirPath)) {
+        if (child.isDirectory) collectSubtree(joinPath(dirPath, child.name), out);
+    }
+}
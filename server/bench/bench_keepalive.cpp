@@ -0,0 +1,297 @@
+// Keep-alive load test for the HTTP engines.
+//
+// Opens N keep-alive connections and keeps them all open for the whole run;
+// each connection sends a request, waits for the response, optionally sleeps
+// --interval-ms, and repeats. Reports throughput, latency percentiles and the
+// server's thread count / RSS, so the two engines can be compared at 10k
+// mostly-idle sync clients.
+//
+//   In-process epoll engine (no Poco needed), run from server/:
+//     g++ -std=c++17 -O2 -Iinclude bench/bench_keepalive.cpp src/epoll_http_server.cpp
+//         src/http_request_parser.cpp src/bounded_executor.cpp src/async_logger.cpp -lpthread -o bench_keepalive
+//     ./bench_keepalive --connections 10000 --duration 10 --interval-ms 1000
+//
+//   Against a running file_server (server.engine = poco or epoll):
+//     ./bench_keepalive --port 8080 --server-pid $(pidof file_server) --path /api/v1/server/stats
+//         --header "X-Auth-Token: <token>" --connections 10000 --interval-ms 1000
+//
+// Needs about 2 x connections file descriptors in-process (ulimit -n).
+
+#include "epoll_http_server.hpp"
+#include "async_logger.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct Args {
+        std::size_t connections = 10000;
+        int duration_s = 10;
+        int interval_ms = 0;             // think time between requests on one connection
+        std::string host = "127.0.0.1";
+        int port = 0;                    // 0 = start the epoll engine in this process
+        std::string path = "/bench";
+        std::vector<std::string> headers;
+        int server_pid = 0;
+        std::size_t io_threads = 2;
+        std::size_t handler_threads = 16;
+    };
+
+    struct Conn {
+        int fd = -1;
+        bool connected = false;
+        bool waiting = false;            // request sent, response not complete
+        Clock::time_point sent_at;
+        std::string in;
+    };
+
+    void usage() {
+        std::cerr << "usage: bench_keepalive [--connections N] [--duration S] [--interval-ms MS]\n"
+                     "                       [--host H --port P] [--path /p] [--header 'K: V']...\n"
+                     "                       [--server-pid PID] [--io-threads N] [--handler-threads N]\n";
+    }
+
+    bool parse_args(int argc, char** argv, Args& a) {
+        for (int i = 1; i < argc; ++i) {
+            std::string k = argv[i];
+            auto next = [&]() -> const char* { return i + 1 < argc ? argv[++i] : nullptr; };
+            const char* v = (k == "--help") ? nullptr : next();
+            if (!v) return false;
+            if (k == "--connections") a.connections = std::strtoul(v, nullptr, 10);
+            else if (k == "--duration") a.duration_s = std::atoi(v);
+            else if (k == "--interval-ms") a.interval_ms = std::atoi(v);
+            else if (k == "--host") a.host = v;
+            else if (k == "--port") a.port = std::atoi(v);
+            else if (k == "--path") a.path = v;
+            else if (k == "--header") a.headers.push_back(v);
+            else if (k == "--server-pid") a.server_pid = std::atoi(v);
+            else if (k == "--io-threads") a.io_threads = std::strtoul(v, nullptr, 10);
+            else if (k == "--handler-threads") a.handler_threads = std::strtoul(v, nullptr, 10);
+            else return false;
+        }
+        return a.connections > 0 && a.duration_s > 0;
+    }
+
+    // "Threads:" and "VmRSS:" from /proc/<pid>/status.
+    std::string process_usage(int pid) {
+        std::ifstream in(pid > 0 ? "/proc/" + std::to_string(pid) + "/status" : "/proc/self/status");
+        std::string line, threads = "?", rss = "?";
+        while (std::getline(in, line)) {
+            if (line.rfind("Threads:", 0) == 0) threads = line.substr(line.find_first_not_of(" \t", 8));
+            if (line.rfind("VmRSS:", 0) == 0) rss = line.substr(line.find_first_not_of(" \t", 6));
+        }
+        return "threads=" + threads + " rss=" + rss;
+    }
+
+    // Length of the first complete response in buf, or 0.
+    std::size_t complete_response(const std::string& buf) {
+        std::size_t end = buf.find("\r\n\r\n");
+        if (end == std::string::npos) return 0;
+        std::size_t length = 0;
+        for (std::size_t pos = buf.find("\r\n") + 2; pos < end;) {
+            std::size_t eol = buf.find("\r\n", pos);
+            if (strncasecmp(buf.data() + pos, "Content-Length:", 15) == 0) {
+                length = std::strtoull(buf.data() + pos + 15, nullptr, 10);
+            }
+            pos = eol + 2;
+        }
+        return buf.size() >= end + 4 + length ? end + 4 + length : 0;
+    }
+
+    double percentile(const std::vector<std::uint32_t>& sorted, double p) {
+        if (sorted.empty()) return 0;
+        std::size_t i = static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1));
+        return sorted[i] / 1000.0;
+    }
+}
+
+int main(int argc, char** argv) {
+    Args args;
+    if (!parse_args(argc, argv, args)) { usage(); return 2; }
+
+    rlimit lim{};
+    getrlimit(RLIMIT_NOFILE, &lim);
+    lim.rlim_cur = lim.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &lim);
+    std::size_t needed = args.connections * (args.port == 0 ? 2 : 1) + 64;
+    if (lim.rlim_cur < needed) {
+        std::cerr << "warning: RLIMIT_NOFILE is " << lim.rlim_cur << ", " << needed << " descriptors needed\n";
+    }
+
+    std::unique_ptr<EpollHttpServer> server;
+    int port = args.port;
+    int server_pid = args.server_pid;
+    if (port == 0) {
+        EpollHttpServer::Options options;
+        options.bind_address = "127.0.0.1";
+        options.port = 0;
+        options.io_threads = args.io_threads;
+        options.handler_threads = args.handler_threads;
+        options.handler_queue_limit = args.connections;
+        options.max_connections = args.connections + 16;
+        server = std::make_unique<EpollHttpServer>(options, [](EpollHttpServer::Request&, EpollHttpServer::Response& res) {
+            res.headers.emplace_back("Content-Type", "application/json");
+            res.body = "{\"status\":\"success\"}";
+        });
+        server->start();
+        port = server->port();
+        AsyncLogger::instance().set_level(LogLevel::WARN);
+    }
+
+    std::string request = "GET " + args.path + " HTTP/1.1\r\nHost: " + args.host + "\r\n";
+    for (const auto& h : args.headers) request += h + "\r\n";
+    request += "\r\n";
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<std::uint16_t>(port));
+    if (inet_pton(AF_INET, args.host.c_str(), &addr.sin_addr) != 1) { std::cerr << "bad --host\n"; return 2; }
+
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    std::vector<Conn> conns(args.connections);
+    std::vector<epoll_event> events(1024);
+    std::size_t connected = 0, connect_failed = 0, errors = 0;
+
+    // 1. Mở kết nối theo từng đợt để không tràn backlog của listen socket.
+    const std::size_t kBatch = 512;
+    Clock::time_point connect_start = Clock::now();
+    for (std::size_t begin = 0; begin < conns.size(); begin += kBatch) {
+        std::size_t end = std::min(conns.size(), begin + kBatch);
+        std::size_t pending = 0;
+        for (std::size_t i = begin; i < end; ++i) {
+            int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd < 0) { ++connect_failed; continue; }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 && errno != EINPROGRESS) {
+                ::close(fd);
+                ++connect_failed;
+                continue;
+            }
+            conns[i].fd = fd;
+            epoll_event ev{};
+            ev.events = EPOLLOUT;
+            ev.data.u64 = i;
+            epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+            ++pending;
+        }
+        while (pending > 0) {
+            int n = epoll_wait(ep, events.data(), static_cast<int>(events.size()), 5000);
+            if (n <= 0) break;
+            for (int k = 0; k < n; ++k) {
+                Conn& c = conns[events[k].data.u64];
+                int err = 0;
+                socklen_t len = sizeof(err);
+                getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                epoll_event ev{};
+                ev.events = EPOLLIN;
+                ev.data.u64 = events[k].data.u64;
+                epoll_ctl(ep, EPOLL_CTL_MOD, c.fd, &ev);
+                if (err == 0) { c.connected = true; ++connected; } else { ++connect_failed; }
+                --pending;
+            }
+        }
+    }
+    double connect_s = std::chrono::duration<double>(Clock::now() - connect_start).count();
+    std::cout << "connected " << connected << "/" << args.connections << " in " << connect_s << " s ("
+              << connect_failed << " failed); server " << (server ? process_usage(0) : process_usage(server_pid)) << "\n";
+
+    // 2. Mỗi kết nối: gửi request, chờ response, (nghỉ interval), lặp lại.
+    auto send_request = [&](std::size_t i) {
+        Conn& c = conns[i];
+        ssize_t n = ::send(c.fd, request.data(), request.size(), MSG_NOSIGNAL);
+        if (n != static_cast<ssize_t>(request.size())) { ++errors; ::close(c.fd); c.connected = false; return; }
+        c.waiting = true;
+        c.sent_at = Clock::now();
+    };
+    using Due = std::pair<Clock::time_point, std::size_t>;
+    std::priority_queue<Due, std::vector<Due>, std::greater<Due>> timers;
+
+    std::vector<std::uint32_t> latencies_us;
+    latencies_us.reserve(1 << 20);
+    Clock::time_point start = Clock::now();
+    Clock::time_point stop_at = start + std::chrono::seconds(args.duration_s);
+    for (std::size_t i = 0; i < conns.size(); ++i) {
+        if (!conns[i].connected) continue;
+        // Rải đều lần gửi đầu trong một interval để không dồn cả 10k request vào cùng lúc.
+        if (args.interval_ms > 0) timers.push({start + std::chrono::microseconds(args.interval_ms * 1000LL * i / conns.size()), i});
+        else send_request(i);
+    }
+
+    char buf[16384];
+    std::string peak_usage;
+    Clock::time_point next_sample = start + std::chrono::seconds(1);
+    while (Clock::now() < stop_at) {
+        Clock::time_point now = Clock::now();
+        while (!timers.empty() && timers.top().first <= now) {
+            std::size_t i = timers.top().second;
+            timers.pop();
+            if (conns[i].connected) send_request(i);
+        }
+        int timeout_ms = 10;
+        int n = epoll_wait(ep, events.data(), static_cast<int>(events.size()), timeout_ms);
+        for (int k = 0; k < n; ++k) {
+            std::size_t i = events[k].data.u64;
+            Conn& c = conns[i];
+            if (!c.connected) continue;
+            ssize_t r = ::recv(c.fd, buf, sizeof(buf), 0);
+            if (r <= 0) {
+                if (r < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+                ++errors; // server đóng kết nối keep-alive
+                ::close(c.fd);
+                c.connected = false;
+                continue;
+            }
+            c.in.append(buf, static_cast<std::size_t>(r));
+            std::size_t len = complete_response(c.in);
+            if (len == 0 || !c.waiting) continue;
+            if (c.in.compare(0, 12, "HTTP/1.1 200") != 0) ++errors;
+            c.in.erase(0, len);
+            c.waiting = false;
+            Clock::time_point done = Clock::now();
+            latencies_us.push_back(static_cast<std::uint32_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(done - c.sent_at).count()));
+            if (args.interval_ms > 0) timers.push({c.sent_at + std::chrono::milliseconds(args.interval_ms), i});
+            else send_request(i);
+        }
+        if (now >= next_sample) {
+            peak_usage = server ? process_usage(0) : process_usage(server_pid);
+            next_sample = now + std::chrono::seconds(1);
+        }
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::size_t still_open = 0;
+    for (const Conn& c : conns) still_open += c.connected ? 1 : 0;
+    std::sort(latencies_us.begin(), latencies_us.end());
+    std::printf("requests %zu in %.1f s = %.0f req/s, errors %zu, connections still open %zu\n",
+                latencies_us.size(), elapsed, static_cast<double>(latencies_us.size()) / elapsed, errors, still_open);
+    std::printf("latency ms: p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  max %.2f\n",
+                percentile(latencies_us, 0.50), percentile(latencies_us, 0.90), percentile(latencies_us, 0.99),
+                percentile(latencies_us, 0.999), latencies_us.empty() ? 0.0 : latencies_us.back() / 1000.0);
+    std::printf("server during run: %s%s\n", peak_usage.c_str(), server ? " (in-process: includes this 1-thread client)" : "");
+
+    for (Conn& c : conns) if (c.connected) ::close(c.fd);
+    ::close(ep);
+    if (server) server->stop();
+    return 0;
+}
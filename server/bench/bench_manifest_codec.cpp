@@ -0,0 +1,270 @@
+// Sync manifest size / encode / parse time: text JSON vs compact CBOR and MessagePack.
+//
+// Builds N client_files entries (nested paths, SHA-256 checksums, a few directories and
+// deletions), then for each format measures the body size (also gzip -6, as sent when the
+// client accepts it) and the time to serialize it. The body is then read back into a
+// vector of ManifestEntry two ways: through a DOM (json::parse + per-entry lookups, the old
+// handleSyncManifest) and through read_manifest_stream (SAX). For each reader the bench
+// reports time and peak RSS growth; "output only" is the RSS of the resulting vector alone.
+//
+// Last, a sync_operations response with N operations is written to a socket-like sink
+// (64 KiB buffer) through a DOM + dump(2) (the old sendJsonResponse) and through
+// ManifestResponseWriter, reporting time to first byte, total time and peak RSS growth.
+//
+//   Run from server/ (Poco headers only, nothing is linked from Poco):
+//     g++ -std=c++17 -O2 -Iinclude bench/bench_manifest_codec.cpp src/manifest_codec.cpp
+//         src/content_coding.cpp -lz -o bench_manifest_codec
+//     ./bench_manifest_codec --entries 1000000
+
+#include "manifest_codec.hpp"
+#include "content_coding.hpp"
+#include "protocol.hpp"
+
+#include <malloc.h>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    double ms_since(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    std::vector<ManifestEntry> make_entries(std::size_t count) {
+        std::mt19937_64 rng(42);
+        static const char digits[] = "0123456789abcdef";
+        std::vector<ManifestEntry> entries;
+        entries.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            ManifestEntry e;
+            e.relative_path = "projects/team_" + std::to_string(i % 97) + "/module_" + std::to_string(i % 1009) +
+                              "/file_" + std::to_string(i) + ".dat";
+            e.last_modified = 1700000000 + static_cast<std::int64_t>(rng() % 10000000);
+            e.is_directory = i % 50 == 0;
+            e.is_deleted = i % 200 == 7;
+            if (!e.is_directory && !e.is_deleted) {
+                e.checksum.resize(64);
+                for (auto& c : e.checksum) c = digits[rng() & 0x0f];
+            }
+            entries.push_back(std::move(e));
+        }
+        return entries;
+    }
+
+    const char* format_name(ManifestFormat format) {
+        switch (format) {
+            case ManifestFormat::CBOR: return "cbor (compact)";
+            case ManifestFormat::MSGPACK: return "msgpack (compact)";
+            case ManifestFormat::JSON: break;
+        }
+        return "json";
+    }
+
+    std::size_t gzip_size(const std::string& body) {
+        std::size_t out = 0;
+        StreamCompressor gz(ContentCoding::GZIP, 6, [&out](const char*, std::size_t n) { out += n; });
+        gz.write(body.data(), body.size());
+        gz.finish();
+        return out;
+    }
+
+    // istream đọc thẳng từ body có sẵn (istringstream sẽ chép cả body và làm sai số đo RSS).
+    class BodyBuf : public std::streambuf {
+    public:
+        explicit BodyBuf(const std::string& body) {
+            char* p = const_cast<char*>(body.data());
+            setg(p, p, p + body.size());
+        }
+    };
+
+    std::size_t proc_status_kb(const char* field) {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.rfind(field, 0) == 0) return std::strtoul(line.c_str() + std::strlen(field), nullptr, 10);
+        }
+        return 0;
+    }
+
+    // Trả bộ nhớ đã free về OS và đặt lại VmHWM để đo đỉnh RSS của bước kế tiếp.
+    std::size_t reset_peak_rss() {
+        malloc_trim(0);
+        std::ofstream("/proc/self/clear_refs") << "5";
+        return proc_status_kb("VmRSS:");
+    }
+
+    double peak_growth_mb(std::size_t baseline_kb) {
+        return (static_cast<double>(proc_status_kb("VmHWM:")) - static_cast<double>(baseline_kb)) / 1024.0;
+    }
+
+    // Cách cũ: dựng DOM rồi chép từng phần tử ra.
+    void dom_decode(const std::string& body, ManifestFormat format, std::vector<ManifestEntry>& out) {
+        nlohmann::json doc = format == ManifestFormat::CBOR ? nlohmann::json::from_cbor(body)
+                           : format == ManifestFormat::MSGPACK ? nlohmann::json::from_msgpack(body)
+                           : nlohmann::json::parse(body);
+        for (const auto& item : doc[JsonKeys::CLIENT_FILES]) {
+            ManifestEntry e;
+            if (item.is_object()) {
+                e.relative_path = item.value(JsonKeys::RELATIVE_PATH, "");
+                e.last_modified = item.value(JsonKeys::LAST_MODIFIED, static_cast<std::int64_t>(0));
+                e.checksum = item.value(JsonKeys::CHECKSUM, "");
+                e.is_directory = item.value(JsonKeys::IS_DIRECTORY, false);
+                e.is_deleted = item.value(JsonKeys::IS_DELETED, false);
+            } else {
+                e.relative_path = item[0].get<std::string>();
+                e.last_modified = item[1].get<std::int64_t>();
+                if (item[2].is_binary()) {
+                    static const char digits[] = "0123456789abcdef";
+                    for (std::uint8_t b : item[2].get_binary()) { e.checksum += digits[b >> 4]; e.checksum += digits[b & 0x0f]; }
+                }
+                const auto flags = item[3].get<unsigned>();
+                e.is_directory = flags & CompactManifest::FLAG_DIRECTORY;
+                e.is_deleted = flags & CompactManifest::FLAG_DELETED;
+            }
+            if (!e.relative_path.empty()) out.push_back(std::move(e));
+        }
+    }
+
+    void check(const std::vector<ManifestEntry>& decoded, const std::vector<ManifestEntry>& entries, ManifestFormat format) {
+        if (decoded.size() != entries.size() || decoded.back().checksum != entries.back().checksum) {
+            std::cerr << "round trip mismatch for " << format_name(format) << "\n";
+            std::exit(1);
+        }
+    }
+
+    void run(const std::vector<ManifestEntry>& entries, ManifestFormat format) {
+        auto start = Clock::now();
+        std::string body;
+        {
+            nlohmann::json files = nlohmann::json::array();
+            for (const auto& e : entries) files.push_back(encode_manifest_entry(e, format));
+            nlohmann::json payload = {{JsonKeys::CLIENT_FILES, std::move(files)}};
+            body = serialize_manifest_body(payload, format);
+        }
+        const double encode_ms = ms_since(start);
+        std::printf("%-18s %9.1f MB %9.1f MB %8.0f ms\n", format_name(format), body.size() / 1e6, gzip_size(body) / 1e6, encode_ms);
+
+        {
+            std::vector<ManifestEntry> decoded;
+            const std::size_t baseline = reset_peak_rss();
+            start = Clock::now();
+            dom_decode(body, format, decoded);
+            const double ms = ms_since(start);
+            const double peak = peak_growth_mb(baseline);
+            check(decoded, entries, format);
+            std::printf("%-18s %44s %8.0f ms %8.0f MB\n", "", "read: DOM", ms, peak);
+        }
+        {
+            std::vector<ManifestEntry> decoded;
+            const std::size_t baseline = reset_peak_rss();
+            start = Clock::now();
+            BodyBuf buf(body);
+            std::istream in(&buf);
+            read_manifest_stream(in, format, {}, [&decoded](ManifestEntry&& e) { decoded.push_back(std::move(e)); },
+                                 [&decoded](std::size_t n) { decoded.reserve(n); });
+            const double ms = ms_since(start);
+            const double peak = peak_growth_mb(baseline);
+            check(decoded, entries, format);
+            std::printf("%-18s %44s %8.0f ms %8.0f MB\n", "", "read: SAX stream", ms, peak);
+        }
+    }
+}
+
+namespace {
+    // Giống socket stream: gom 64 KiB rồi "gửi"; ghi lại thời điểm lần gửi đầu tiên.
+    class SinkBuf : public std::streambuf {
+    public:
+        SinkBuf() { setp(buffer_, buffer_ + sizeof(buffer_)); }
+        std::uint64_t bytes() const { return bytes_; }
+        Clock::time_point first_send() const { return first_send_; }
+
+    protected:
+        int_type overflow(int_type ch) override {
+            flush_buffer();
+            if (!traits_type::eq_int_type(ch, traits_type::eof())) sputc(traits_type::to_char_type(ch));
+            return traits_type::not_eof(ch);
+        }
+        int sync() override { flush_buffer(); return 0; }
+
+    private:
+        void flush_buffer() {
+            if (pptr() == pbase()) return;
+            if (bytes_ == 0) first_send_ = Clock::now();
+            bytes_ += static_cast<std::uint64_t>(pptr() - pbase());
+            setp(buffer_, buffer_ + sizeof(buffer_));
+        }
+
+        char buffer_[64 * 1024];
+        std::uint64_t bytes_ = 0;
+        Clock::time_point first_send_;
+    };
+
+    void run_response(const std::vector<ManifestEntry>& entries, ManifestFormat format, bool streaming) {
+        const std::size_t baseline = reset_peak_rss();
+        const auto start = Clock::now();
+        SinkBuf sink;
+        std::ostream out(&sink);
+        if (streaming) {
+            ManifestResponseWriter writer(out, format, 2);
+            writer.field(JsonKeys::STATUS, "success");
+            writer.begin_array(JsonKeys::SYNC_OPERATIONS, entries.size());
+            for (std::size_t i = 0; i < entries.size(); ++i) {
+                writer.element(encode_sync_operation(static_cast<int>(i % 3), entries[i].relative_path, format));
+            }
+            writer.end_array();
+            writer.finish();
+        } else {
+            nlohmann::json ops = nlohmann::json::array();
+            for (std::size_t i = 0; i < entries.size(); ++i) {
+                ops.push_back(encode_sync_operation(static_cast<int>(i % 3), entries[i].relative_path, format));
+            }
+            nlohmann::json payload = {{JsonKeys::STATUS, "success"}, {JsonKeys::SYNC_OPERATIONS, std::move(ops)}};
+            const std::string body = format == ManifestFormat::JSON ? payload.dump(2) : serialize_manifest_body(payload, format);
+            out.write(body.data(), static_cast<std::streamsize>(body.size()));
+            out.flush();
+        }
+        const double total_ms = ms_since(start);
+        const double ttfb_ms = std::chrono::duration<double, std::milli>(sink.first_send() - start).count();
+        std::printf("%-18s %-18s %9.1f MB %9.0f ms %9.0f ms %9.0f MB\n", format_name(format),
+                    streaming ? "streaming writer" : "DOM + dump", sink.bytes() / 1e6, ttfb_ms, total_ms, peak_growth_mb(baseline));
+    }
+}
+
+int main(int argc, char** argv) {
+    std::size_t count = 1000000;
+    for (int i = 1; i < argc; ++i) {
+        std::string k = argv[i];
+        if (k == "--entries" && i + 1 < argc) count = std::strtoul(argv[++i], nullptr, 10);
+        else { std::cerr << "usage: bench_manifest_codec [--entries N]\n"; return 2; }
+    }
+
+    const auto entries = make_entries(count);
+    std::printf("%zu entries\n", count);
+    {
+        const std::size_t baseline = reset_peak_rss();
+        std::vector<ManifestEntry> copy(entries);
+        std::printf("output only (vector of %zu entries): %.0f MB\n", copy.size(), peak_growth_mb(baseline));
+    }
+    std::printf("%-18s %12s %12s %11s %8s %11s %11s\n", "format", "size", "gzip -6", "encode", "", "time", "peak RSS");
+    for (ManifestFormat format : {ManifestFormat::JSON, ManifestFormat::CBOR, ManifestFormat::MSGPACK}) {
+        run(entries, format);
+    }
+
+    std::printf("\nsync_operations response, %zu operations\n", count);
+    std::printf("%-18s %-18s %12s %12s %12s %12s\n", "format", "writer", "size", "first byte", "total", "peak RSS");
+    for (ManifestFormat format : {ManifestFormat::JSON, ManifestFormat::MSGPACK}) {
+        run_response(entries, format, false);
+        run_response(entries, format, true);
+    }
+    return 0;
+}
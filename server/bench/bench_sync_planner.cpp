@@ -0,0 +1,270 @@
+// Sync planning time / memory: the old map-based planner vs the sorted merge-join.
+//
+// Generates N paths; ~70% are in the client manifest (in shuffled order, as a client walk
+// does not produce byte order) and ~70% on the server (in path order, as the DB query now
+// returns them), so ~40% match, with a mix of equal / newer / conflicting / deleted entries.
+// Rows are produced on the fly from the index so the input itself takes no memory.
+//
+//   map baseline   the previous determine_sync_actions: std::map<string, ServerSyncFileInfo>
+//                  (full path, relative path, checksum per entry) + std::map<string, bool> of
+//                  processed client paths. Poco::Path normalisation is replaced by a plain
+//                  string copy, so the baseline is slightly flattered.
+//   merge-join     SyncPlanManifest for both sides (build + sort client) + plan_sync_operations,
+//                  once on one thread and once split into path ranges on --threads threads.
+//
+// Each run reports wall time and peak RSS growth, including the ops. "build" is the server side
+// (map / flat array from the DB rows) plus, for the merge-join, sorting the client manifest;
+// reading the client manifest itself is the same streaming parse for both and not timed.
+//
+//   Run from server/ (Poco headers only, nothing is linked from Poco):
+//     g++ -std=c++17 -O2 -Iinclude bench/bench_sync_planner.cpp src/sync_planner.cpp
+//         -lpthread -o bench_sync_planner
+//     ./bench_sync_planner --entries 1000000
+//     ./bench_sync_planner --entries 10000000 --no-baseline   # the map baseline needs ~5 GB there
+
+#include "sync_planner.hpp"
+
+#include <malloc.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    double ms_since(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    std::size_t proc_status_kb(const char* field) {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.rfind(field, 0) == 0) return std::strtoul(line.c_str() + std::strlen(field), nullptr, 10);
+        }
+        return 0;
+    }
+
+    // Trả bộ nhớ đã free về OS và đặt lại VmHWM để đo đỉnh RSS của bước kế tiếp.
+    std::size_t reset_peak_rss() {
+        malloc_trim(0);
+        std::ofstream("/proc/self/clear_refs") << "5";
+        return proc_status_kb("VmRSS:");
+    }
+
+    double peak_growth_mb(std::size_t baseline_kb) {
+        return (static_cast<double>(proc_status_kb("VmHWM:")) - static_cast<double>(baseline_kb)) / 1024.0;
+    }
+
+    const std::string kRoot = "/srv/fileserver/data/users/alice/";
+
+    std::uint64_t mix(std::uint64_t x) {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    // Một dòng của manifest / file_metadata, sinh lại từ chỉ số; path tăng dần theo i.
+    struct Row {
+        std::string path;
+        std::string checksum;
+        std::int64_t last_modified = 0;
+        bool is_deleted = false;
+        unsigned category = 0; // <3 chỉ client, >=7 chỉ server, còn lại cả hai
+    };
+
+    void make_row(std::size_t i, bool server_side, Row& row) {
+        static const char digits[] = "0123456789abcdef";
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "projects/m%05zu/file_%09zu.dat", i / 1000, i);
+        row.path = buf;
+        const std::uint64_t h = mix(i);
+        row.category = static_cast<unsigned>(h % 10);
+        // Cả hai phía: 0..1 giống nhau, 2 client mới hơn, 3 server mới hơn, 4 conflict, 5 client đã xoá
+        const unsigned variant = static_cast<unsigned>((h >> 8) % 6);
+        const bool differs = server_side && variant >= 2 && variant <= 4;
+        row.checksum.resize(64);
+        std::uint64_t s = mix(h + (differs ? 1 : 0));
+        for (std::size_t k = 0; k < 64; ++k) {
+            if (k % 16 == 0) s = mix(s);
+            row.checksum[k] = digits[(s >> ((k % 16) * 4)) & 0x0f];
+        }
+        row.last_modified = 1700000000 + static_cast<std::int64_t>(h % 1000000);
+        if (server_side && variant == 2) row.last_modified -= 10;
+        if (server_side && variant == 3) row.last_modified += 10;
+        row.is_deleted = !server_side && variant == 5 && row.category >= 3;
+    }
+
+    struct Input {
+        std::size_t count;
+        std::vector<std::uint32_t> client_order; // thứ tự các path trong manifest của client
+    };
+
+    Input make_input(std::size_t count) {
+        Input input{count, {}};
+        for (std::size_t i = 0; i < count; ++i) {
+            if (mix(i) % 10 < 7) input.client_order.push_back(static_cast<std::uint32_t>(i));
+        }
+        std::shuffle(input.client_order.begin(), input.client_order.end(), std::mt19937_64(42));
+        return input;
+    }
+
+    template <class F>
+    void for_each_server_row(const Input& input, F&& f) {
+        Row row;
+        for (std::size_t i = 0; i < input.count; ++i) {
+            if (mix(i) % 10 < 3) continue;
+            make_row(i, true, row);
+            f(row);
+        }
+    }
+
+    template <class F>
+    void for_each_client_row(const Input& input, F&& f) {
+        Row row;
+        for (std::uint32_t i : input.client_order) {
+            make_row(i, false, row);
+            f(row);
+        }
+    }
+
+    std::size_t g_sink = 0; // để compiler không bỏ kết quả
+
+    // --- Cách cũ ---
+    struct OldClientInfo {
+        std::string relative_path;
+        std::int64_t last_modified;
+        std::string checksum;
+        bool is_directory = false;
+        bool is_deleted = false;
+    };
+    struct OldServerInfo {
+        std::string full_path_on_server;
+        std::string relative_path;
+        std::int64_t last_modified;
+        std::string checksum;
+        int owner_user_id;
+        bool is_directory;
+        int version;
+    };
+
+    void run_map_baseline(const Input& input) {
+        const std::size_t baseline = reset_peak_rss();
+        std::vector<OldClientInfo> client; // handleSyncManifest cũ dựng vector này trước
+        client.reserve(input.client_order.size());
+        for_each_client_row(input, [&](const Row& r) {
+            client.push_back({r.path, r.last_modified, r.checksum, false, r.is_deleted});
+        });
+
+        const auto start = Clock::now();
+        std::map<std::string, OldServerInfo> server_states;
+        for_each_server_row(input, [&](const Row& r) {
+            OldServerInfo sfi;
+            sfi.full_path_on_server = kRoot + r.path;
+            sfi.relative_path = sfi.full_path_on_server.substr(kRoot.size());
+            sfi.checksum = r.checksum;
+            sfi.last_modified = r.last_modified;
+            sfi.version = 1;
+            sfi.owner_user_id = 1;
+            sfi.is_directory = false;
+            server_states[sfi.relative_path] = sfi;
+        });
+        const double build_ms = ms_since(start);
+
+        const auto plan_start = Clock::now();
+        std::vector<SyncOperation> operations;
+        std::map<std::string, bool> client_files_processed;
+        for (const auto& c : client) {
+            std::string path = c.relative_path; // thay cho Poco::Path(...).toString(PATH_UNIX)
+            client_files_processed[path] = true;
+            auto it = server_states.find(path);
+            if (c.is_deleted) {
+                operations.emplace_back(it != server_states.end() ? SyncActionType::DELETE_ON_SERVER : SyncActionType::NO_ACTION, path);
+                continue;
+            }
+            if (it == server_states.end()) { operations.emplace_back(SyncActionType::UPLOAD_TO_SERVER, path); continue; }
+            const OldServerInfo& s = it->second;
+            if (c.checksum == s.checksum) operations.emplace_back(SyncActionType::NO_ACTION, path);
+            else if (c.last_modified == s.last_modified) operations.emplace_back(SyncActionType::CONFLICT_SERVER_WINS, path);
+            else if (c.last_modified > s.last_modified) operations.emplace_back(SyncActionType::UPLOAD_TO_SERVER, path);
+            else operations.emplace_back(SyncActionType::DOWNLOAD_TO_CLIENT, path);
+        }
+        for (const auto& pair : server_states) {
+            if (client_files_processed.find(pair.first) == client_files_processed.end()) {
+                operations.emplace_back(SyncActionType::DOWNLOAD_TO_CLIENT, pair.first);
+            }
+        }
+        const double plan_ms = ms_since(plan_start);
+        g_sink += operations.size();
+        std::printf("%-26s %10.0f ms %10.0f ms %10.0f ms %10.0f MB %10zu\n", "map baseline", build_ms, plan_ms,
+                    build_ms + plan_ms, peak_growth_mb(baseline), operations.size());
+    }
+
+    // --- Merge-join ---
+    void run_merge_join(const Input& input, unsigned threads) {
+        const std::size_t baseline = reset_peak_rss();
+        SyncPlanManifest client; // handleSyncManifest giờ add thẳng vào đây khi đọc manifest
+        client.reserve(input.client_order.size());
+        for_each_client_row(input, [&](const Row& r) {
+            client.add(r.path, r.last_modified, r.checksum, false, r.is_deleted);
+        });
+
+        const auto start = Clock::now();
+        SyncPlanManifest server;
+        server.reserve(input.count * 7 / 10 + 1);
+        std::string full_path = kRoot;
+        for_each_server_row(input, [&](const Row& r) {
+            full_path.resize(kRoot.size());
+            full_path += r.path; // như sqlite3_column_text: path đầy đủ, cắt root khi add
+            server.add(std::string_view(full_path).substr(kRoot.size()), r.last_modified, r.checksum, false, false);
+        });
+        server.sort_by_path();
+        client.sort_by_path();
+        const double build_ms = ms_since(start);
+
+        const auto plan_start = Clock::now();
+        SyncPlanOptions options;
+        options.threads = threads;
+        auto operations = plan_sync_operations(client, server, options);
+        const double plan_ms = ms_since(plan_start);
+        g_sink += operations.size();
+        char label[64];
+        std::snprintf(label, sizeof(label), "merge-join, %u thread%s", threads, threads == 1 ? "" : "s");
+        std::printf("%-26s %10.0f ms %10.0f ms %10.0f ms %10.0f MB %10zu\n", label, build_ms, plan_ms,
+                    build_ms + plan_ms, peak_growth_mb(baseline), operations.size());
+    }
+}
+
+int main(int argc, char** argv) {
+    std::size_t count = 1000000;
+    unsigned threads = std::max(2u, std::thread::hardware_concurrency());
+    bool baseline = true;
+    for (int i = 1; i < argc; ++i) {
+        std::string k = argv[i];
+        if (k == "--entries" && i + 1 < argc) count = std::strtoul(argv[++i], nullptr, 10);
+        else if (k == "--threads" && i + 1 < argc) threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (k == "--no-baseline") baseline = false;
+        else { std::cerr << "usage: bench_sync_planner [--entries N] [--threads T] [--no-baseline]\n"; return 2; }
+    }
+
+    const Input input = make_input(count);
+    std::printf("%zu paths: %zu in client manifest, server has the rest of ~70%%; %u hardware threads\n",
+                count, input.client_order.size(), std::thread::hardware_concurrency());
+    std::printf("%-26s %13s %13s %13s %13s %10s\n", "planner", "build", "plan", "total", "peak RSS", "ops");
+    if (baseline) run_map_baseline(input);
+    run_merge_join(input, 1);
+    run_merge_join(input, threads);
+    return g_sink == 0;
+}
@@ -30,5 +30,6 @@ public:
 private:
     Database& db_;
     UserManager& user_manager_;
+    PermissionLevel resolve_permission(int user_id, const fs::path& absolute_server_resource_path);
     std::string permission_level_to_string(PermissionLevel perm);
 };
\ No newline at end of file
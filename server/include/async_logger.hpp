@@ -0,0 +1,153 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+// DBG/ERR rather than DEBUG/ERROR: those are commonly defined as macros.
+enum class LogLevel : std::uint8_t { DBG = 0, INFO = 1, WARN = 2, ERR = 3, OFF = 4 };
+
+// Statements below this level are compiled out entirely (-DFILESERVER_LOG_MIN_LEVEL=0 keeps debug).
+#ifndef FILESERVER_LOG_MIN_LEVEL
+#define FILESERVER_LOG_MIN_LEVEL 1
+#endif
+
+// Fixed-size line buffer behind the LOG_* macros; text past the end is dropped.
+class LogLine {
+public:
+    static constexpr std::size_t kCapacity = 240;
+
+    LogLine() : os_(&buf_) {}
+    std::ostream& begin() {
+        buf_.reset();
+        os_.clear();
+        os_.flags(std::ios_base::dec | std::ios_base::skipws);
+        os_.width(0);
+        os_.precision(6);
+        os_.fill(' ');
+        return os_;
+    }
+    const char* data() const { return buf_.data(); }
+    std::size_t size() const { return buf_.size(); }
+
+private:
+    class Buffer : public std::streambuf {
+    public:
+        void reset() { setp(data_, data_ + kCapacity); }
+        const char* data() const { return pbase(); }
+        std::size_t size() const { return static_cast<std::size_t>(pptr() - pbase()); }
+    protected:
+        int_type overflow(int_type ch) override { return traits_type::not_eof(ch); }
+    private:
+        char data_[kCapacity];
+    };
+    Buffer buf_;
+    std::ostream os_;
+};
+
+// Request-path logger: the calling thread formats its message into its own
+// single-producer ring buffer (no lock, no syscall); a background thread
+// drains all rings, adds the timestamp and writes in batches.
+// Before start() (tests, early startup) messages are written synchronously.
+class AsyncLogger {
+public:
+    static AsyncLogger& instance();
+
+    // out: file to append to, or nullptr for stdout.
+    void start(LogLevel level, const std::string& file_path = "");
+    void stop(); // Drains every ring, then joins the writer
+
+    void set_level(LogLevel level) { level_.store(static_cast<std::uint8_t>(level), std::memory_order_relaxed); }
+    bool enabled(LogLevel level) const {
+        return static_cast<std::uint8_t>(level) >= level_.load(std::memory_order_relaxed);
+    }
+
+    void log(LogLevel level, const char* file, int line, const char* text, std::size_t length);
+
+    std::uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    static bool parse_level(const std::string& name, LogLevel& out);
+
+    // Thread-local line reused by the LOG_* macros.
+    static LogLine& scratch();
+
+private:
+    AsyncLogger() = default;
+    ~AsyncLogger();
+
+    static constexpr std::size_t kRingSlots = 512;   // per thread, power of 2
+    static constexpr std::size_t kMaxMessage = LogLine::kCapacity;
+
+    struct Record {
+        std::int64_t unix_us;
+        LogLevel level;
+        std::uint16_t line;
+        std::uint16_t length;
+        const char* file;
+        char text[kMaxMessage];
+    };
+
+    struct Ring {
+        std::array<Record, kRingSlots> slots;
+        alignas(64) std::atomic<std::uint64_t> head{0}; // next write (producer)
+        alignas(64) std::atomic<std::uint64_t> tail{0}; // next read (writer thread)
+        std::atomic<bool> owner_alive{true};
+        std::uint64_t thread_tag = 0;
+    };
+
+    struct RingHandle; // thread_local owner, marks the ring dead on thread exit
+
+    Ring& local_ring();
+    void writer_loop();
+    std::size_t drain(std::string& batch);
+    void write_line(std::string& out, const Record& r, std::uint64_t thread_tag) const;
+    void write_direct(const Record& r);
+
+    std::atomic<std::uint8_t> level_{static_cast<std::uint8_t>(LogLevel::INFO)};
+    std::atomic<bool> running_{false};
+    std::atomic<std::uint64_t> dropped_{0};
+    std::atomic<std::uint64_t> next_thread_tag_{1};
+
+    std::mutex registry_mutex_; // only taken when a thread logs for the first time, and by the writer
+    std::vector<std::shared_ptr<Ring>> rings_;
+
+    std::mutex direct_mutex_;   // synchronous path / final writes
+    std::FILE* out_ = nullptr;
+    bool owns_out_ = false;
+    std::thread writer_;
+};
+
+#define FILESERVER_LOG_AT(lvl, expr)                                                        \
+    do {                                                                                    \
+        if (AsyncLogger::instance().enabled(lvl)) {                                         \
+            LogLine& log_line_ = AsyncLogger::scratch();                                    \
+            log_line_.begin() << expr;                                                      \
+            AsyncLogger::instance().log(lvl, __FILE__, __LINE__,                            \
+                                        log_line_.data(), log_line_.size());                \
+        }                                                                                   \
+    } while (0)
+
+#if FILESERVER_LOG_MIN_LEVEL <= 0
+#define LOG_DEBUG(expr) FILESERVER_LOG_AT(LogLevel::DBG, expr)
+#else
+#define LOG_DEBUG(expr) do {} while (0)
+#endif
+#if FILESERVER_LOG_MIN_LEVEL <= 1
+#define LOG_INFO(expr) FILESERVER_LOG_AT(LogLevel::INFO, expr)
+#else
+#define LOG_INFO(expr) do {} while (0)
+#endif
+#if FILESERVER_LOG_MIN_LEVEL <= 2
+#define LOG_WARN(expr) FILESERVER_LOG_AT(LogLevel::WARN, expr)
+#else
+#define LOG_WARN(expr) do {} while (0)
+#endif
+#define LOG_ERROR(expr) FILESERVER_LOG_AT(LogLevel::ERR, expr)
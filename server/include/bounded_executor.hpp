@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Thrown by BoundedExecutor::submit when the queue is full. Handlers turn it into 503 + Retry-After.
+class ExecutorSaturated : public std::runtime_error {
+public:
+    explicit ExecutorSaturated(const std::string& executor_name)
+        : std::runtime_error("Executor '" + executor_name + "' is saturated") {}
+};
+
+// Fixed-size worker pool with a bounded FIFO queue.
+// Used to keep expensive work (password hashing, ...) off the HTTP handler
+// threads' CPU budget and to shed load early instead of queueing without limit.
+// queue_limit counts jobs waiting for a busy pool; idle workers are extra
+// capacity, so queue_limit = 0 means "run now or reject".
+class BoundedExecutor {
+public:
+    struct Stats {
+        std::size_t workers;
+        std::size_t queue_limit;
+        std::size_t queue_depth;
+        std::size_t active;
+        std::uint64_t submitted;
+        std::uint64_t completed;
+        std::uint64_t rejected;
+        double avg_wait_ms;   // time spent queued
+        double avg_run_ms;    // time spent executing
+        double max_wait_ms;
+    };
+
+    BoundedExecutor(std::string name, std::size_t workers, std::size_t queue_limit);
+    ~BoundedExecutor();
+
+    BoundedExecutor(const BoundedExecutor&) = delete;
+    BoundedExecutor& operator=(const BoundedExecutor&) = delete;
+
+    // Queues f and returns its future. Throws ExecutorSaturated if no worker is idle and the queue is full.
+    template <class F>
+    auto submit(F&& f) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+        using R = std::invoke_result_t<std::decay_t<F>>;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+        std::future<R> result = task->get_future();
+        if (!enqueue([task]() { (*task)(); })) {
+            throw ExecutorSaturated(name_);
+        }
+        return result;
+    }
+
+    // Runs f on the pool and waits for the result (exceptions propagate).
+    template <class F>
+    auto run(F&& f) -> std::invoke_result_t<std::decay_t<F>> {
+        return submit(std::forward<F>(f)).get();
+    }
+
+    void shutdown(); // Finishes queued work, then joins the workers
+    Stats stats() const;
+    const std::string& name() const { return name_; }
+
+private:
+    struct Item {
+        std::function<void()> fn;
+        std::chrono::steady_clock::time_point enqueued_at;
+    };
+
+    bool enqueue(std::function<void()> fn);
+    void worker_loop();
+
+    const std::string name_;
+    const std::size_t queue_limit_;
+    std::vector<std::thread> workers_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Item> queue_;
+    std::size_t idle_ = 0; // Workers not running a job
+    bool stopping_ = false;
+
+    std::atomic<std::size_t> active_{0};
+    std::atomic<std::uint64_t> submitted_{0};
+    std::atomic<std::uint64_t> completed_{0};
+    std::atomic<std::uint64_t> rejected_{0};
+    std::atomic<std::uint64_t> total_wait_us_{0};
+    std::atomic<std::uint64_t> total_run_us_{0};
+    std::atomic<std::uint64_t> max_wait_us_{0};
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "timing_wheel.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Registry of one-shot change subscriptions for long-poll watchers (GET /sync/watch).
+// A subscription watches one root directory (absolute, canonical, no trailing '/',
+// same form as TreeHashIndex paths). FileManager calls notify() with the directory
+// whose content changed; every subscription on that directory or one of its
+// ancestors fires once with changed = true and is removed.
+//
+// Subscriptions that see no change fire with changed = false once their timeout
+// passes. Timeouts ride a timing wheel advanced once per second by a background
+// sweeper (like SessionStore); stop_sweeper() fires whatever is still waiting.
+// Callbacks run on the notifying / sweeper thread with no lock held and must not block.
+class ChangeNotifier {
+public:
+    using Callback = std::function<void(bool changed)>;
+    using Id = std::uint64_t;
+
+    ChangeNotifier();
+    ~ChangeNotifier();
+
+    ChangeNotifier(const ChangeNotifier&) = delete;
+    ChangeNotifier& operator=(const ChangeNotifier&) = delete;
+
+    Id subscribe(const std::string& root, std::chrono::seconds timeout, Callback callback);
+    // false if the callback has already fired (or is firing).
+    bool unsubscribe(Id id);
+    void notify(const std::string& changed_dir);
+
+    std::size_t waiting() const;
+
+    void start_sweeper();
+    void stop_sweeper();
+    // Fires subscriptions whose timeout has passed. Called by the sweeper; public for tests.
+    std::size_t sweep();
+
+private:
+    struct Subscription {
+        std::string root;
+        Callback callback;
+    };
+
+    TimingWheel::Tick now_tick() const;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<Id, Subscription> subscriptions_;
+    std::unordered_multimap<std::string, Id> by_root_;
+    TimingWheel wheel_;   // key = id; đã fire/huỷ thì bỏ qua khi tới hạn
+    Id next_id_ = 1;
+    const std::chrono::steady_clock::time_point epoch_;
+
+    std::thread sweeper_;
+    std::mutex sweeper_mutex_;
+    std::condition_variable sweeper_cv_;
+    bool stop_requested_ = false;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "db.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct ChunkRef {
+    std::string hash; // SHA-256 hex của nội dung chunk
+    std::uint32_t size = 0;
+};
+
+// Một file được lưu dưới dạng chunk: danh sách chunk theo thứ tự.
+struct ChunkRecipe {
+    std::string checksum; // SHA-256 hex của cả file (giống FileManager::calculate_checksum)
+    std::uint64_t size = 0;
+    std::vector<ChunkRef> chunks;
+};
+
+struct ChunkStoreStats {
+    std::uint64_t chunks = 0;           // Chunk đang lưu
+    std::uint64_t stored_bytes = 0;     // Mỗi chunk tính một lần
+    std::uint64_t logical_bytes = 0;    // Tổng kích thước các file có recipe
+    std::uint64_t collected_chunks = 0; // Đã bị GC xoá từ lúc khởi động
+    std::uint64_t collected_bytes = 0;
+};
+
+// Content-addressed chunk store (chunks cắt bằng FastCDC, xem fastcdc.hpp). Mỗi chunk là một file
+// <root>/ab/cd/<hash>, được ghi một lần rồi không đổi; bảng chunks giữ kích thước, refcount (số lần
+// chunk xuất hiện trong file_recipes) và last_used. file_recipes giữ danh sách chunk của từng file,
+// khoá theo path tuyệt đối đã canonical như file_metadata.
+//
+// Chunk mới upload có refcount 0 cho tới khi một recipe dùng nó. GC xoá các chunk refcount 0 không
+// được dùng (ghi, hỏi FILES_CHUNKS_MISSING, bỏ khỏi recipe) trong khoảng grace, nên client có
+// thời gian upload hết chunk rồi mới commit.
+//
+// chunk_owners ghi user nào đã upload (chứng minh có nội dung) từng chunk: missing_chunks và
+// complete_recipe chỉ coi chunk là có sẵn với user đó, để hash không trở thành cách dò xem server
+// có giữ một nội dung nào đó hay không, hay đọc file của người khác.
+class ChunkStore {
+public:
+    ChunkStore(Database& db, const fs::path& root);
+    ~ChunkStore();
+
+    ChunkStore(const ChunkStore&) = delete;
+    ChunkStore& operator=(const ChunkStore&) = delete;
+
+    fs::path chunk_path(const std::string& hash) const;
+
+    // false nếu hash không khớp nội dung hoặc lỗi ghi. user_id != -1 được ghi là owner.
+    bool put_chunk(const std::string& hash, const unsigned char* data, std::size_t length, int user_id);
+    // Các hash chưa lưu, hoặc user chưa upload (user_id == -1: không xét owner).
+    // Chunk có sẵn được làm mới last_used để GC không xoá trước khi client commit.
+    std::vector<std::string> missing_chunks(const std::vector<std::string>& hashes, int user_id);
+    // Cắt in bằng FastCDC, lưu mọi chunk và điền recipe (kể cả checksum cả file).
+    bool ingest(std::istream& in, ChunkRecipe& recipe, int user_id);
+    // Điền size từng chunk và cả file từ store. false nếu có chunk thiếu hoặc user chưa upload.
+    bool complete_recipe(ChunkRecipe& recipe, int user_id);
+
+    std::optional<ChunkRecipe> recipe(const std::string& file_path);
+    // Thay recipe của file_path, cập nhật refcount trong một transaction. false nếu thiếu chunk.
+    bool put_recipe(const std::string& file_path, const ChunkRecipe& recipe);
+    // file_path và mọi path nằm dưới nó
+    void remove_recipes(const std::string& path);
+    void move_recipes(const std::string& old_path, const std::string& new_path);
+
+    // Nội dung theo recipe, seek được. Chunk mất / ngắn làm stream chuyển sang bad().
+    std::unique_ptr<std::istream> open(const ChunkRecipe& recipe) const;
+
+    // Xoá chunk refcount 0 không dùng trong grace. Trả về số chunk đã xoá.
+    std::size_t collect_garbage(std::chrono::seconds grace);
+    void start_gc(std::chrono::seconds interval, std::chrono::seconds grace);
+    void stop_gc();
+
+    ChunkStoreStats stats() const;
+
+private:
+    bool store_chunk(const std::string& hash, const unsigned char* data, std::size_t length, int user_id); // Hash đã kiểm tra
+    // Ghi dòng chunks / chunk_owners; temp_path (nếu có) được rename vào chỗ. false nếu chunk chưa có mà không có temp_path.
+    bool insert_locked(const std::string& hash, std::size_t length, const fs::path& temp_path, int user_id);
+    bool write_temp(const unsigned char* data, std::size_t length, fs::path& temp_path);
+    std::optional<ChunkRecipe> recipe_locked(const std::string& file_path);
+    bool adjust_refcounts_locked(const std::vector<ChunkRef>& chunks, int delta, std::int64_t now);
+    bool has_recipes_locked(const std::string& path);
+    bool remove_recipes_locked(const std::string& path, std::int64_t now, std::uint64_t& removed_bytes);
+
+    Database& db_;
+    const fs::path root_;
+    mutable std::mutex mutex_; // Mọi truy cập bảng chunks / chunk_owners / file_recipes; luôn lấy sau db_.write_mutex()
+    ChunkStoreStats stats_;
+
+    std::thread gc_;
+    std::mutex gc_mutex_;
+    std::condition_variable gc_cv_;
+    bool gc_stop_requested_ = false;
+};
@@ -9,15 +9,86 @@ struct Config {
     // Server
     static unsigned short HTTP_SERVER_PORT;
     static std::string SERVER_BASE_URL;
+    static int HTTP_MAX_THREADS;         // Poco connection threads (mostly waiting on the pools below)
+    static int HTTP_MAX_QUEUED;          // Accepted connections waiting for a thread
+    static int HTTP_TIMEOUT_SECONDS;     // Socket send/receive timeout
+    static std::string HTTP_ENGINE;      // "poco" (thread per connection) | "epoll" (EpollHttpServer)
+
+    // Epoll engine (server.engine = epoll)
+    static int REACTOR_IO_THREADS;
+    static int REACTOR_HANDLER_THREADS;
+    static int REACTOR_HANDLER_QUEUE_LIMIT;
+    static int REACTOR_MAX_CONNECTIONS;
+    static int REACTOR_IDLE_TIMEOUT_SECONDS;
+    static int REACTOR_BODY_SPOOL_BYTES; // Larger request bodies are buffered in a temp file
+
+    // Worker pools that run API handlers (see RouteClass in route_table.hpp)
+    static int METADATA_WORKERS;
+    static int METADATA_QUEUE_LIMIT;
+    static int TRANSFER_WORKERS;
+    static int TRANSFER_QUEUE_LIMIT;
+    static int POOL_RETRY_AFTER_SECONDS; // Retry-After sent when a pool is full
 
     // Paths
     static std::string DATABASE_PATH;
     static std::string USER_DATA_ROOT;
     static std::string SHARED_DATA_ROOT;
+    static std::string STORAGE_MODE;                // "plain" | "chunked" (FastCDC chunk store, see chunk_store.hpp)
+    static std::string STORAGE_CHUNKS_ROOT;
+    static int STORAGE_CHUNK_GC_INTERVAL_SECONDS;   // 0 = no background GC
+    static int STORAGE_CHUNK_GC_GRACE_SECONDS;      // Unreferenced chunks younger than this are kept
+    static int STORAGE_BATCH_MAX_OPERATIONS;        // Operations accepted in one FILES_BATCH request
+    static std::string STORAGE_BATCH_TRASH_DIR;     // Server-private staging for FILES_BATCH deletes
 
     // Security
     static int PASSWORD_SALT_LENGTH;
     static int HASH_ITERATIONS;
+    static std::string TOKEN_KEYS;        // "kid:secret,kid2:secret2" (HMAC keys for session tokens)
+    static std::string TOKEN_ACTIVE_KEY;  // kid used to sign new tokens
+    static int TOKEN_TTL_SECONDS;         // Hard lifetime of a session token
+    static int HASH_WORKERS;              // Threads dedicated to password hashing
+    static int HASH_QUEUE_LIMIT;          // Waiting hash jobs before login/register return 503
+    static int HASH_RETRY_AFTER_SECONDS;  // Retry-After sent with that 503
+
+    // Sessions
+    static int SESSION_IDLE_TTL_SECONDS;
+    static int SESSION_FLUSH_INTERVAL_SECONDS; // Write-behind interval for persisted sessions
+
+    // Metrics
+    static std::string METRICS_TOKEN; // Bearer token for /metrics from non-loopback clients (empty = loopback only)
+
+    // Response compression (Accept-Encoding: zstd, gzip) for JSON responses
+    static bool COMPRESSION_ENABLED;
+    static int COMPRESSION_MIN_BYTES;   // Smaller bodies are sent uncompressed
+    static int COMPRESSION_GZIP_LEVEL;  // 1..9
+    static int COMPRESSION_ZSTD_LEVEL;  // 1..19
+
+    // Sync manifests (read as a stream, see read_manifest_stream)
+    static int SYNC_MANIFEST_MAX_ENTRIES; // client_files entries per manifest (0 = unlimited)
+    static int SYNC_MANIFEST_MAX_BYTES;   // Request body bytes, also for chunked bodies (0 = unlimited)
+    static int SYNC_PLANNER_THREADS;      // Path-range partitions planned in parallel per manifest
+    static int SYNC_PLANNER_MIN_PARTITION;// Client + server entries per partition before splitting
+    static bool SYNC_DETECT_MOVES;        // Plan renames as MOVE_ON_SERVER / MOVE_ON_CLIENT instead of delete + transfer
+    static int SYNC_STREAM_SLICE_ENTRIES; // Streamed plans (NDJSON): manifest entries merge-joined per slice before sending
+    static int SYNC_STREAM_LARGE_FILE_BYTES; // Streamed plans: files this large go last, smallest first (0 = no split)
+    static int SYNC_WATCH_TIMEOUT_SECONDS;// Longest /sync/watch long-poll before answering "changed": false
+    static int SYNC_WATCH_MAX_WAITERS;    // Parked watchers before answering 503 (0 = unlimited)
+
+    // Block delta transfer (FILES_SIGNATURE / FILES_PATCH / FILES_DELTA)
+    static int TRANSFER_DELTA_MIN_FILE_SIZE; // Smaller files are sent whole by FILES_DELTA
+    static int TRANSFER_DELTA_MAX_PERCENT;   // FILES_DELTA sends the whole file when the delta is larger than this % of it
+
+    // Logging
+    static std::string LOG_LEVEL;  // debug | info | warn | error | off
+    static std::string LOG_FILE;   // empty = stdout
+
+    // Rate limiting (0 = unlimited)
+    static double RATE_LIMIT_USER_REQUESTS_PER_SECOND;
+    static double RATE_LIMIT_USER_REQUEST_BURST;
+    static double RATE_LIMIT_USER_BYTES_PER_SECOND;
+    static double RATE_LIMIT_USER_BYTES_BURST;
+    static double RATE_LIMIT_IP_REQUESTS_PER_SECOND;
+    static double RATE_LIMIT_IP_REQUEST_BURST;
 };
 
 // Thêm dòng sau vào cuối struct hoặc ngoài struct:
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+// Nén response JSON theo Accept-Encoding. gzip dùng zlib (luôn có, Poco cũng cần);
+// zstd chỉ bật khi build có <zstd.h> / libzstd.
+enum class ContentCoding { IDENTITY, GZIP, ZSTD };
+
+const char* content_coding_name(ContentCoding coding);
+bool content_coding_supported(ContentCoding coding);
+
+// Chọn coding cho response từ header Accept-Encoding (q-values, "*", "identity;q=0").
+// Ưu tiên zstd rồi gzip khi client chấp nhận cả hai với cùng q; thiếu header = IDENTITY.
+ContentCoding negotiate_content_coding(std::string_view accept_encoding);
+
+// Nén streaming: mỗi write() nén phần dữ liệu mới và đẩy output (nếu có) ra sink.
+// Throws std::runtime_error nếu coding không được hỗ trợ hoặc thư viện nén báo lỗi.
+class StreamCompressor {
+public:
+    using Sink = std::function<void(const char* data, std::size_t length)>;
+
+    StreamCompressor(ContentCoding coding, int level, Sink sink);
+    ~StreamCompressor();
+
+    StreamCompressor(const StreamCompressor&) = delete;
+    StreamCompressor& operator=(const StreamCompressor&) = delete;
+
+    void write(const char* data, std::size_t length);
+    void finish(); // Ghi phần cuối (gzip trailer / zstd epilogue); sau đó không write được nữa
+
+    std::uint64_t bytes_in() const { return bytes_in_; }
+    std::uint64_t bytes_out() const { return bytes_out_; }
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+    Sink sink_;
+    std::uint64_t bytes_in_ = 0;
+    std::uint64_t bytes_out_ = 0;
+};
+
+// ostream cho body response. Giữ tối đa threshold byte đầu trong bộ nhớ:
+// - body kết thúc trước ngưỡng: open(IDENTITY, độ dài) rồi ghi nguyên văn (có Content-Length);
+// - vượt ngưỡng: open(coding, -1) rồi nén dần phần còn lại ra stream đích (chunked),
+//   không giữ cả body chưa nén hay đã nén trong bộ nhớ.
+// open được gọi đúng một lần và trả về stream đích (ví dụ HTTPServerResponse::send()).
+class CompressingBodyStream : public std::ostream {
+public:
+    using Open = std::function<std::ostream&(ContentCoding coding, std::int64_t length)>;
+
+    CompressingBodyStream(ContentCoding coding, int level, std::size_t threshold, Open open);
+    ~CompressingBodyStream() override;
+
+    // Bắt buộc gọi sau khi ghi xong body.
+    void finish();
+
+    // Sau finish(): coding thực sự đã dùng và số byte trước/sau khi nén.
+    ContentCoding coding_used() const;
+    std::uint64_t bytes_in() const;
+    std::uint64_t bytes_out() const;
+
+private:
+    class Buffer;
+    std::unique_ptr<Buffer> buffer_;
+};
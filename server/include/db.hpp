@@ -5,6 +5,7 @@
 #include <vector>
 #include <optional>
 #include <functional>
+#include <mutex>
 
 class Database {
 public:
@@ -19,11 +20,26 @@ public:
                        std::function<void(sqlite3_stmt*)> row_callback);
     // For SELECT statements that expect a single value or row
     std::optional<std::string> execute_scalar(const std::string& sql);
+
+    // Transaction lồng được (SAVEPOINT name): mở bên trong một transaction khác (FILES_BATCH) thì chỉ
+    // là một savepoint, được ghi khi transaction ngoài cùng commit; rollback chỉ huỷ phần của nó.
+    bool savepoint(const std::string& name);
+    bool release(const std::string& name);
+    void rollback_to(const std::string& name);
+
+    // Mọi thread dùng chung một connection nên transaction là của connection, không của thread.
+    // FILES_BATCH giữ khoá này suốt BEGIN..COMMIT/ROLLBACK; các writer khác (và các span SAVEPOINT)
+    // cũng lấy nó để ghi của họ không lọt vào, rồi bị ROLLBACK cùng, transaction của batch.
+    // Đệ quy: batch gọi lại ChunkStore / TreeHashIndex trên cùng thread.
+    std::recursive_mutex& write_mutex() { return write_mutex_; }
     
     sqlite3* get_db_handle(); // Be careful with direct access
     bool initialize_schema();
 
 private:
+    bool migrate_file_metadata_parent_path();
+
     sqlite3* db_ = nullptr;
     std::string db_path_;
+    std::recursive_mutex write_mutex_;
 };
\ No newline at end of file
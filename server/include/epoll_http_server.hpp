@@ -0,0 +1,152 @@
+#pragma once
+
+#include "bounded_executor.hpp"
+#include "http_request_parser.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Event-driven HTTP/1.1 engine (server.engine = epoll). A few I/O threads own
+// every connection through epoll; an idle keep-alive connection costs a file
+// descriptor and a small buffer, not a thread. Complete requests are handed to
+// a separate handler pool; responses go back to the owning I/O thread, which
+// writes them without blocking.
+//
+// Request bodies are buffered before the handler runs (in memory, or in a temp
+// file above body_spool_threshold), so handlers can read them synchronously.
+//
+// A handler that cannot answer yet (long-poll) calls Request::defer() and
+// returns: the connection stays parked on its I/O thread, holding no handler
+// thread, until the returned Responder is completed from any thread.
+class EpollHttpServer {
+    struct Connection;
+    struct Mailbox;
+
+public:
+    class Responder;
+
+    struct Options {
+        std::string bind_address;                 // empty = all interfaces
+        std::uint16_t port = 8080;                // 0 = pick a free port (see port())
+        std::size_t io_threads = 2;
+        std::size_t handler_threads = 32;
+        std::size_t handler_queue_limit = 1024;   // queued requests before answering 503
+        std::size_t max_connections = 20000;
+        std::chrono::seconds idle_timeout{300};   // keep-alive idle / slow request limit
+        HttpRequestParser::Limits limits;
+        std::size_t body_spool_threshold = 1 << 20;
+        std::string spool_dir;                    // empty = system temp dir
+    };
+
+    struct Request {
+        HttpRequestHead head;
+        std::string body;        // when the body was kept in memory
+        std::string body_file;   // spooled body, removed after the handler returns
+        std::uint64_t body_size = 0;
+        std::string peer_host;
+        std::uint16_t peer_port = 0;
+        std::string local_host;
+        std::uint16_t local_port = 0;
+        // Set by the engine while the handler runs; callable once. The body
+        // (body_file) is gone after the handler returns, so read it first.
+        std::function<std::shared_ptr<Responder>()> defer;
+    };
+
+    struct Response {
+        int status = 200;
+        std::string reason;                                       // empty = standard reason phrase
+        std::vector<std::pair<std::string, std::string>> headers; // Content-Length / Connection are added by the server
+        std::string body;
+        std::string file_path;   // sent with sendfile(2) after body, if set
+        bool close = false;      // close the connection after this response
+    };
+
+    // Completes a deferred request. complete() is thread-safe and takes effect
+    // once; a Responder dropped without completing answers 500. After stop()
+    // completions are discarded (the connection is already closed).
+    class Responder {
+    public:
+        ~Responder();
+        Responder(const Responder&) = delete;
+        Responder& operator=(const Responder&) = delete;
+
+        void complete(Response response);
+
+    private:
+        friend class EpollHttpServer;
+        Responder(std::shared_ptr<Mailbox> mailbox, Connection* connection, bool keep_alive)
+            : mailbox_(std::move(mailbox)), connection_(connection), keep_alive_(keep_alive) {}
+
+        std::shared_ptr<Mailbox> mailbox_;
+        Connection* connection_;
+        bool keep_alive_;
+        std::atomic<bool> done_{false};
+    };
+
+    // Runs on the handler pool. Exceptions become 500.
+    using Handler = std::function<void(Request&, Response&)>;
+
+    struct Stats {
+        std::size_t connections;      // open right now
+        std::uint64_t accepted;
+        std::uint64_t refused;        // over max_connections
+        std::uint64_t requests;
+        std::uint64_t rejected;       // handler queue full (503)
+        std::uint64_t idle_closed;
+        std::uint64_t parse_errors;
+    };
+
+    EpollHttpServer(Options options, Handler handler);
+    ~EpollHttpServer();
+
+    EpollHttpServer(const EpollHttpServer&) = delete;
+    EpollHttpServer& operator=(const EpollHttpServer&) = delete;
+
+    void start();  // Throws std::system_error if the socket cannot be bound
+    void stop();   // Stops accepting, drains the handler pool, closes every connection
+    std::uint16_t port() const { return bound_port_; }
+
+    Stats stats() const;
+    const BoundedExecutor& handler_pool() const { return handler_pool_; }
+
+    static const char* reason_phrase(int status);
+
+private:
+    struct IoThread;
+
+    void io_loop(IoThread& io);
+    void accept_connections(IoThread& io);
+    void on_readable(IoThread& io, Connection& c);
+    void process_input(IoThread& io, Connection& c);
+    void dispatch(IoThread& io, Connection& c);
+    void complete(IoThread& io, Connection& c, Response& response, bool keep_alive);
+    void send_error(IoThread& io, Connection& c, int status, const std::string& message);
+    void flush(IoThread& io, Connection& c);
+    void set_interest(IoThread& io, Connection& c, std::uint32_t events);
+    void close_connection(IoThread& io, Connection& c);
+    void sweep_idle(IoThread& io);
+
+    const Options options_;
+    const Handler handler_;
+    BoundedExecutor handler_pool_;
+
+    int listen_fd_ = -1;
+    std::uint16_t bound_port_ = 0;
+    std::vector<std::unique_ptr<IoThread>> io_threads_;
+    std::atomic<bool> running_{false};
+
+    std::atomic<std::size_t> connections_{0};
+    std::atomic<std::uint64_t> accepted_{0};
+    std::atomic<std::uint64_t> refused_{0};
+    std::atomic<std::uint64_t> requests_{0};
+    std::atomic<std::uint64_t> rejected_{0};
+    std::atomic<std::uint64_t> idle_closed_{0};
+    std::atomic<std::uint64_t> parse_errors_{0};
+};
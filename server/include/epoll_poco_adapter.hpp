@@ -0,0 +1,33 @@
+#pragma once
+
+#include "epoll_http_server.hpp"
+
+#include <Poco/Net/HTTPRequestHandlerFactory.h>
+#include <Poco/Net/HTTPServerParams.h>
+#include <Poco/Net/HTTPServerResponse.h>
+
+#include <functional>
+
+// Runs the regular Poco request handlers (FileServerRequestHandlerFactory)
+// on the epoll engine: each request is wrapped in HTTPServerRequest /
+// HTTPServerResponse implementations backed by the engine's buffers, so the
+// route handlers are the same for both engines.
+// The factory must outlive the returned handler.
+//
+// Responses created by the adapter also implement DeferrableResponse, so a
+// route handler can park a long-poll request (dynamic_cast the response; the
+// Poco engine's responses do not implement it).
+EpollHttpServer::Handler make_poco_handler(Poco::Net::HTTPRequestHandlerFactory& factory,
+                                           Poco::Net::HTTPServerParams::Ptr params);
+
+// defer() detaches the request from the handler thread; the handler returns
+// right away. Calling the returned function (once, from any thread) runs the
+// writer on a fresh response, which starts with the headers already set on this
+// one (CORS, Server, ...), and sends the result.
+class DeferrableResponse {
+public:
+    using Writer = std::function<void(Poco::Net::HTTPServerResponse&)>;
+
+    virtual ~DeferrableResponse() = default;
+    virtual std::function<void(const Writer&)> defer() = 0;
+};
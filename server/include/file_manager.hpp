@@ -1,9 +1,15 @@
 #pragma once
 
+#include "change_notifier.hpp"
+#include "chunk_store.hpp"
 #include "db.hpp"
+#include "tree_hash.hpp"
 #include <string>
 #include <vector>
 #include <filesystem>
+#include <functional>
+#include <istream>
+#include <memory>
 #include <optional> // Thêm nếu chưa có, vì download_file trả về optional
 
 namespace fs = std::filesystem;
@@ -18,27 +24,129 @@ struct FileInfo {
 };
 
 
+// Kết quả của FileManager::apply_delta
+enum class DeltaApplyResult {
+    OK,
+    NOT_FOUND,          // Không có file base
+    BASE_CHANGED,       // Base trên server không còn là bản delta được tính từ
+    INVALID_DELTA,      // Delta sai định dạng / tham chiếu ngoài base
+    CHECKSUM_MISMATCH,  // File dựng lại không khớp checksum mong đợi
+    IO_ERROR
+};
+
+// Kết quả của FileManager::commit_chunks
+enum class ChunkCommitResult {
+    OK,
+    INVALID_PATH,       // Path không an toàn hoặc là thư mục
+    MISSING_CHUNKS,     // Có chunk chưa upload (hoặc user chưa upload nó)
+    CHECKSUM_MISMATCH,  // Nội dung ghép lại không khớp checksum mong đợi
+    IO_ERROR
+};
+
+// Kết quả của FileManager::claim_by_checksum
+enum class ClaimResult {
+    OK,
+    INVALID_PATH,       // Path không an toàn hoặc là thư mục
+    NOT_FOUND,          // Không có file nào user đọc được với checksum đó (hoặc các file đó đã đổi)
+    IO_ERROR
+};
+
+// Một thao tác của FileManager::apply_metadata_batch (FILES_BATCH)
+enum class MetadataOpType { MKDIR, DELETE, RENAME };
+
+struct MetadataOp {
+    MetadataOpType type;
+    std::string path;     // RENAME: path cũ
+    std::string new_path; // Chỉ dùng cho RENAME
+};
+
+// Kết quả từng thao tác của FileManager::apply_metadata_batch
+enum class MetadataOpResult {
+    OK,
+    INVALID_PATH,       // Path không an toàn, là gốc, hoặc đổi tên vào chính nó
+    FORBIDDEN,          // can_write từ chối
+    NOT_FOUND,
+    CONFLICT,           // Đích đã tồn tại (hoặc là file khi tạo thư mục)
+    IO_ERROR,
+    NOT_APPLIED         // atomic: thao tác khác lỗi nên cả batch bị huỷ
+};
+
+// storage.mode = chunked: nội dung file nằm trong ChunkStore, file trên đĩa chỉ là placeholder
+// thưa (sparse) cùng kích thước để listing / stat vẫn đúng. Mọi lần đọc nội dung phải đi qua
+// open_file / download_file / calculate_checksum. File cũ (chưa có recipe) vẫn được đọc như
+// thường và được chuyển sang chunk ở lần ghi sau; ngược lại khi đổi về plain.
 class FileManager {
 public:
     FileManager(Database& db);
 
     bool upload_file(const fs::path& server_base_path, const std::string& relative_path, const std::vector<char>& data, int user_id = -1);
+    // Dựng bản mới của một file có sẵn từ base + delta (BlockDelta) vào file tạm cùng thư mục,
+    // kiểm tra checksum rồi rename đè lên base. Checksum rỗng = không kiểm tra.
+    DeltaApplyResult apply_delta(const fs::path& server_base_path, const std::string& relative_path, std::istream& delta,
+                                 const std::string& expected_base_checksum, const std::string& expected_checksum, int user_id = -1);
+    // Ghi file từ các chunk đã upload (FILES_COMMIT); size của recipe được điền từ store.
+    ChunkCommitResult commit_chunks(const fs::path& server_base_path, const std::string& relative_path, ChunkRecipe recipe,
+                                    const std::string& expected_checksum, int user_id = -1);
+    // Tạo file từ một file có sẵn trên server cùng checksum (FILES_CLAIM): dùng chung recipe ở chế
+    // độ chunked, reflink nếu filesystem hỗ trợ, không thì copy. can_read lọc các file nguồn theo quyền.
+    ClaimResult claim_by_checksum(const fs::path& server_base_path, const std::string& relative_path, const std::string& checksum,
+                                  const std::function<bool(const fs::path&)>& can_read, int user_id = -1,
+                                  std::uint64_t* claimed_bytes = nullptr);
     std::optional<std::vector<char>> download_file(const fs::path& server_base_path, const std::string& relative_path, int user_id = -1);
     bool delete_file_or_directory(const fs::path& server_base_path, const std::string& relative_path, int user_id = -1);
     bool create_directory(const fs::path& server_base_path, const std::string& relative_path, int user_id = -1);
+    // Các thao tác theo thứ tự trong một transaction metadata: tree hash của mỗi thư mục bị đổi chỉ
+    // được tính lại một lần ở cuối, watcher được báo sau commit. can_write(path) kiểm tra quyền ghi
+    // (thư mục cha khi tạo / đổi tên, chính path khi xoá).
+    // atomic: thao tác lỗi đầu tiên huỷ cả batch. Transaction bị rollback, thư mục đã tạo bị xoá, file
+    // đã đổi tên được trả về chỗ cũ; path bị xoá chỉ được chuyển ra chỗ tạm cho tới khi commit.
+    // Không atomic: thao tác lỗi được bỏ qua, các thao tác sau vẫn chạy.
+    std::vector<MetadataOpResult> apply_metadata_batch(const fs::path& server_base_path, const std::vector<MetadataOp>& ops, bool atomic,
+                                                       const std::function<bool(const fs::path&)>& can_write, int user_id = -1);
     std::vector<FileInfo> list_directory(const fs::path& server_base_path, const std::string& relative_path, int user_id = -1);
     
     // Path validation and resolution
     fs::path resolve_safe_path(const fs::path& base_path, const std::string& relative_user_path); // Đảm bảo khai báo này có và đúng
 
     std::string calculate_checksum(const fs::path& file_path);
+    // Nội dung của file (ghép từ chunk nếu cần), seek được. nullptr nếu không mở được.
+    std::unique_ptr<std::istream> open_file(const fs::path& full_server_path, std::uint64_t* size = nullptr);
+    // File trên đĩa chỉ là placeholder: không gửi thẳng bằng sendFile được
+    bool is_stored_as_chunks(const fs::path& full_server_path);
 
     // --- THÊM KHAI BÁO NÀY VÀO ---
     bool update_metadata_after_rename(const fs::path& old_abs_path_obj, const fs::path& new_abs_path_obj, int user_id);
     // -------------------------------
     void update_file_metadata(const fs::path& full_server_path, int user_id = -1); 
+
+    // Tree hash của các thư mục, được cập nhật sau mỗi thao tác ở trên (xem TreeHashIndex).
+    TreeHashIndex& tree_hashes() { return tree_hashes_; }
+    // Watcher của /sync/watch, được báo sau mỗi thay đổi (cùng lúc với tree hash).
+    ChangeNotifier& changes() { return changes_; }
+    ChunkStore& chunks() { return chunks_; }
 private:
     Database& db_;
+    TreeHashIndex tree_hashes_;
+    ChangeNotifier changes_;
+    ChunkStore chunks_;
+    bool chunked_storage() const;
+    void create_parent_directories(const fs::path& full_server_path, int user_id); // Kèm dòng metadata
+    // Lưu nội dung in thành chunk + recipe rồi thay file bằng placeholder
+    bool store_as_chunks(std::istream& in, const fs::path& full_server_path, int user_id);
+    bool write_placeholder(const fs::path& full_server_path, std::uint64_t size);
+    // File tạm (cùng thư mục) thành nội dung mới của full_server_path: rename, hoặc chunk ở chế độ chunked
+    bool commit_temp_file(const fs::path& temp_path, const fs::path& full_server_path, int user_id);
+    // Các file (chưa xoá) có checksum trong file_metadata, tối đa limit
+    std::vector<fs::path> files_with_checksum(const std::string& checksum, std::size_t limit);
+    // Bản sao của source ở temp_path (reflink nếu được); true nếu nội dung khớp checksum
+    bool materialize_copy(const fs::path& source, const fs::path& temp_path, const std::string& checksum);
+    void directory_changed(const std::string& dir_path); // refresh tree hash rồi notify
+    // Metadata, recipe, tree hash của path (và mọi thứ bên dưới) rồi xoá trên đĩa, hoặc chuyển tới
+    // staging nếu có (apply_metadata_batch xoá hẳn sau commit)
+    void remove_path(const fs::path& full_server_path, const fs::path& staging = {});
+    struct BatchUndo;
+    MetadataOpResult apply_metadata_op(const fs::path& server_base_path, const MetadataOp& op,
+                                       const std::function<bool(const fs::path&)>& can_write, int user_id, BatchUndo* undo);
     //void update_file_metadata(const fs::path& full_server_path, int user_id = -1); // Giữ nguyên user_id tùy chọn
     void remove_file_metadata(const fs::path& full_server_path);
     // calculate_checksum đã được public rồi, không cần private nữa nếu muốn gọi từ ngoài
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Request line + headers of one HTTP/1.x request.
+struct HttpRequestHead {
+    std::string method;
+    std::string uri;
+    std::string version;                                        // "HTTP/1.0" | "HTTP/1.1"
+    std::vector<std::pair<std::string, std::string>> headers;   // in arrival order
+    std::int64_t content_length = -1;                           // -1 = none
+    bool chunked = false;
+    bool keep_alive = true;
+    bool expect_continue = false;
+
+    // Case-insensitive lookup; nullptr if absent.
+    const std::string* find(std::string_view name) const;
+};
+
+// Incremental HTTP/1.1 request parser for the epoll engine. Bytes can arrive
+// in any split; parse() stops at the end of one message so pipelined requests
+// stay in the caller's buffer. Body bytes (fixed-length or chunked) are handed
+// to a sink as they arrive instead of being accumulated here.
+class HttpRequestParser {
+public:
+    enum class Status { NEED_MORE, COMPLETE, ERROR };
+
+    struct Limits {
+        std::size_t max_header_bytes = 64 * 1024;  // request line + headers
+        std::uint64_t max_body_bytes = 0;          // 0 = unlimited
+    };
+
+    // Return false to abort parsing (the request then fails with 500).
+    using BodySink = std::function<bool(const char* data, std::size_t length)>;
+
+    HttpRequestParser() = default;
+    explicit HttpRequestParser(Limits limits) : limits_(limits) {}
+
+    // Consumes bytes from data; consumed is set to how many were used.
+    Status parse(const char* data, std::size_t length, std::size_t& consumed, const BodySink& sink);
+
+    // Ready for the next request on the same connection.
+    void reset();
+
+    bool headers_complete() const { return state_ > State::HEADERS; }
+    bool in_progress() const { return state_ != State::HEADERS || !header_buf_.empty(); }
+    const HttpRequestHead& head() const { return head_; }
+    HttpRequestHead& head() { return head_; }
+    std::uint64_t body_bytes() const { return body_bytes_; }
+
+    // Status code to answer with after ERROR (400, 413, 431, 501, 505, 500).
+    int error_status() const { return error_status_; }
+    const std::string& error_message() const { return error_message_; }
+
+private:
+    enum class State { HEADERS, BODY_FIXED, CHUNK_SIZE, CHUNK_DATA, CHUNK_DATA_END, TRAILERS, COMPLETE, FAILED };
+
+    Status fail(int status, std::string message);
+    bool parse_head(std::string_view block);
+    bool deliver(const char* data, std::size_t length, const BodySink& sink);
+    // Collects one CRLF-terminated line into line_buf_; true once the line is complete.
+    bool take_line(const char* data, std::size_t length, std::size_t& pos);
+
+    Limits limits_;
+    State state_ = State::HEADERS;
+    HttpRequestHead head_;
+    std::string header_buf_;
+    std::string line_buf_;
+    std::uint64_t remaining_ = 0;  // of the current fixed body or chunk
+    std::uint64_t body_bytes_ = 0;
+    int error_status_ = 0;
+    std::string error_message_;
+};
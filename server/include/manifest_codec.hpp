@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <nlohmann/json.hpp>
+
+// Mã hoá body của SYNC_MANIFEST / FILES_LIST: JSON như cũ, hoặc CBOR / MessagePack dạng
+// compact (mảng theo vị trí, checksum 32 byte thô, action là số) — xem CompactManifest trong protocol.hpp.
+enum class ManifestFormat { JSON, CBOR, MSGPACK };
+
+const std::string& manifest_format_content_type(ManifestFormat format);
+
+// Format của body request theo Content-Type; không nhận ra = JSON.
+ManifestFormat manifest_format_from_content_type(std::string_view content_type);
+
+// Format của response theo header Accept. Chỉ chọn binary khi client nêu rõ
+// application/cbor hoặc application/msgpack (q > 0); thiếu header hay "*/*" = JSON.
+ManifestFormat negotiate_manifest_format(std::string_view accept);
+
+// Header Accept có nêu application/x-ndjson (q > 0): trả plan dạng stream (PlanStream trong protocol.hpp).
+bool accepts_plan_stream(std::string_view accept);
+
+std::string serialize_manifest_body(const nlohmann::json& payload, ManifestFormat format);
+
+// SHA-256 hex -> 32 byte (chuỗi rỗng -> null). Hex sai độ dài / ký tự throws std::invalid_argument.
+nlohmann::json checksum_to_wire(std::string_view hex);
+
+struct ManifestEntry {
+    std::string relative_path;
+    std::int64_t last_modified = 0; // Unix timestamp
+    std::string checksum;           // hex, rỗng nếu không có
+    bool is_directory = false;
+    bool is_deleted = false;
+    std::uint64_t size = 0;         // Byte, 0 nếu client không gửi
+};
+
+nlohmann::json encode_manifest_entry(const ManifestEntry& entry, ManifestFormat format);
+
+// Body manifest sai cú pháp hoặc sai schema (-> 400).
+class ManifestMalformed : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Manifest vượt max_entries / max_bytes (-> 413).
+class ManifestTooLarge : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+struct ManifestLimits {
+    std::uint64_t max_entries = 0; // Số phần tử client_files; 0 = không giới hạn
+    std::uint64_t max_bytes = 0;   // Byte body đọc từ stream; 0 = không giới hạn
+};
+
+// Đọc client_files thẳng từ stream bằng SAX (nlohmann::json_sax), không dựng DOM: mỗi entry có
+// relative_path được chuyển cho visit ngay khi đọc xong, các key khác được bỏ qua. Với CBOR /
+// MessagePack số phần tử biết trước nên reserve (nếu có) được gọi một lần trước entry đầu tiên.
+// Nhận cả entry dạng object lẫn dạng compact ở mọi format. Nếu có scope, từng path trong mảng
+// "scope" (manifest sau tree sync, xem Endpoints::SYNC_TREE) được chuyển cho nó; không có thì
+// key này bị bỏ qua như các key lạ. Trả về số entry đã đọc.
+// Throws ManifestMalformed, ManifestTooLarge; lỗi của stream / visit được ném tiếp.
+std::uint64_t read_manifest_stream(std::istream& in, ManifestFormat format, const ManifestLimits& limits,
+                                   const std::function<void(ManifestEntry&&)>& visit,
+                                   const std::function<void(std::size_t)>& reserve = nullptr,
+                                   const std::function<void(std::string&&)>& scope = nullptr);
+
+// Một phần tử của sync_operations; action_code theo CompactManifest::SYNC_ACTION_NAMES.
+// old_path (khác rỗng với MOVE_*) được thêm làm "old_path" / phần tử thứ ba; size (khác 0) chỉ có ở JSON.
+nlohmann::json encode_sync_operation(int action_code, const std::string& relative_path, ManifestFormat format,
+                                     const std::string& old_path = std::string(), std::uint64_t size = 0);
+
+// Một phần tử của listing.
+nlohmann::json encode_listing_entry(const std::string& name, const std::string& path, bool is_directory,
+                                    std::uint64_t size, std::int64_t last_modified, ManifestFormat format);
+
+// Ghi response {key: value, ..., array_key: [phần tử...]} thẳng ra stream theo format, từng phần tử
+// một, không dựng DOM cho cả body. Thứ tự gọi: field()/begin_array() ... end_array() ... finish().
+// MessagePack ghi độ dài trước nên số field và số phần tử phải biết trước; sai số lượng
+// throws std::logic_error.
+class ManifestResponseWriter {
+public:
+    ManifestResponseWriter(std::ostream& out, ManifestFormat format, std::size_t fields);
+
+    void field(const std::string& key, const nlohmann::json& value);
+    void begin_array(const std::string& key, std::size_t count);
+    void element(const nlohmann::json& value);
+    void end_array();
+    void finish();
+
+private:
+    void write_key(const std::string& key);
+    void write_head(unsigned major, std::uint64_t length); // map / mảng (CBOR: major type 5 / 4)
+
+    std::ostream& out_;
+    ManifestFormat format_;
+    std::size_t fields_left_;
+    std::size_t elements_left_ = 0;
+    bool in_array_ = false;
+    bool first_ = true; // JSON: chưa cần dấu phẩy
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Monotonic counter. inc() is a single relaxed atomic add.
+class Counter {
+public:
+    void inc(std::uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+    std::uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+private:
+    std::atomic<std::uint64_t> value_{0};
+};
+
+// Value that goes up and down.
+class Gauge {
+public:
+    void set(std::int64_t v) { value_.store(v, std::memory_order_relaxed); }
+    void add(std::int64_t n) { value_.fetch_add(n, std::memory_order_relaxed); }
+    std::int64_t value() const { return value_.load(std::memory_order_relaxed); }
+private:
+    std::atomic<std::int64_t> value_{0};
+};
+
+// Log-bucketed histogram over integer microseconds (or bytes, etc.): each
+// power of two is split into two buckets, so a bucket spans at most 50% of
+// its lower bound. record() = bit scan + three relaxed atomic adds.
+class Histogram {
+public:
+    static constexpr int kMaxExponent = 40;                 // values >= 2^40 go into the last bucket
+    static constexpr std::size_t kBucketCount = 2 * kMaxExponent + 2;
+
+    void record(std::uint64_t value) {
+        buckets_[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    static std::size_t bucket_index(std::uint64_t value) {
+        if (value < 2) return static_cast<std::size_t>(value);
+        int msb = 63 - __builtin_clzll(value);
+        if (msb >= kMaxExponent) return kBucketCount - 1;
+        std::size_t sub = static_cast<std::size_t>((value >> (msb - 1)) & 1);
+        return static_cast<std::size_t>(2 * msb) + sub;
+    }
+    // Largest value that falls into bucket i (inclusive).
+    static std::uint64_t bucket_upper_bound(std::size_t i);
+
+    std::uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    std::uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+    std::uint64_t bucket(std::size_t i) const { return buckets_[i].load(std::memory_order_relaxed); }
+
+private:
+    std::array<std::atomic<std::uint64_t>, kBucketCount> buckets_{};
+    std::atomic<std::uint64_t> count_{0};
+    std::atomic<std::uint64_t> sum_{0};
+};
+
+// Records the elapsed time into a microsecond histogram when it goes out of scope.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram& h) : histogram_(h), started_(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        histogram_.record(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - started_).count()));
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+private:
+    Histogram& histogram_;
+    std::chrono::steady_clock::time_point started_;
+};
+
+// Process-wide metric registry. Metrics are registered once (startup, or a
+// function-local static at the call site) and the returned references stay
+// valid for the life of the process; recording never touches the registry.
+class MetricsRegistry {
+public:
+    using Labels = std::vector<std::pair<std::string, std::string>>;
+
+    static MetricsRegistry& global();
+
+    // Same (name, labels) returns the same metric.
+    Counter& counter(const std::string& name, const std::string& help, const Labels& labels = {});
+    Gauge& gauge(const std::string& name, const std::string& help, const Labels& labels = {});
+    // unit_scale converts recorded units to the exported unit (1e-6: microseconds -> seconds).
+    Histogram& histogram(const std::string& name, const std::string& help, const Labels& labels = {},
+                         double unit_scale = 1e-6);
+    // Evaluated at scrape time (session counts, thread-pool usage, ...). Replaces an existing callback.
+    void gauge_callback(const std::string& name, const std::string& help, const Labels& labels,
+                        std::function<double()> fn);
+    // Same, for values that only grow (exported as TYPE counter).
+    void counter_callback(const std::string& name, const std::string& help, const Labels& labels,
+                          std::function<double()> fn);
+    void remove_callbacks(const std::string& name);
+
+    // Prometheus text exposition format 0.0.4.
+    std::string render_prometheus() const;
+
+private:
+    enum class Kind { COUNTER, GAUGE, HISTOGRAM, GAUGE_CALLBACK, COUNTER_CALLBACK };
+
+    struct Entry {
+        std::string name;
+        std::string help;
+        Kind kind;
+        Labels labels;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+        double unit_scale = 1.0;
+        std::function<double()> callback;
+    };
+
+    Entry* find(const std::string& name, const Labels& labels);
+    Entry& add(const std::string& name, const std::string& help, Kind kind, const Labels& labels);
+    void set_callback(const std::string& name, const std::string& help, Kind kind, const Labels& labels,
+                      std::function<double()> fn);
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<Entry>> entries_;
+};
@@ -15,6 +15,11 @@ namespace HttpHeaders {
     const std::string FILE_CHECKSUM = "X-File-Checksum";   // SHA256 checksum for uploads/downloads
     const std::string FILE_LAST_MODIFIED = "X-File-Last-Modified"; // Unix timestamp for file
     const std::string FILE_RELATIVE_PATH = "X-File-Relative-Path"; // Often used with multipart/form-data uploads
+    const std::string ACCEPT_ENCODING = "Accept-Encoding";   // Client: codings it can decode, e.g. "zstd, gzip"
+    const std::string CONTENT_ENCODING = "Content-Encoding"; // Server: coding of a compressed JSON response
+    const std::string ACCEPT = "Accept";                     // Client: media types it can parse (binary manifests)
+    const std::string BASE_CHECKSUM = "X-Base-Checksum";     // FILES_PATCH: checksum of the base the delta was computed from
+    const std::string TRANSFER_MODE = "X-Transfer-Mode";     // FILES_DELTA response: "delta" or "full" (see BlockDelta)
 } // namespace HttpHeaders
 
 
@@ -43,11 +48,23 @@ namespace Endpoints {
     const std::string FILES_DELETE    = API_BASE_PATH + "/files/delete";       // DELETE (path as query param or JSON body)
     const std::string FILES_RENAME    = API_BASE_PATH + "/files/rename";       // POST (JSON body with "old_path", "new_path")
     const std::string FILES_MOVE      = API_BASE_PATH + "/files/move";         // POST (JSON body with "source_path", "dest_path")
+    // Block delta transfer (see BlockDelta below)
+    const std::string FILES_SIGNATURE = API_BASE_PATH + "/files/signature";    // GET (?path=), block signature of the server's copy
+    const std::string FILES_PATCH     = API_BASE_PATH + "/files/patch";        // POST (?path=, body = delta against the server's copy)
+    const std::string FILES_DELTA     = API_BASE_PATH + "/files/delta";        // POST (?path=, body = client signature, response = delta)
+    // Chunked upload (see ChunkedUpload below)
+    const std::string FILES_CHUNKS_MISSING = API_BASE_PATH + "/files/chunks/missing"; // POST (JSON {"chunks": [hash, ...]})
+    const std::string FILES_CHUNKS    = API_BASE_PATH + "/files/chunks";       // POST (body = chunk frames, see fastcdc.hpp)
+    const std::string FILES_COMMIT    = API_BASE_PATH + "/files/commit";       // POST (JSON {"path", "checksum", "chunks"})
+    const std::string FILES_CLAIM     = API_BASE_PATH + "/files/claim";        // POST (JSON {"path", "checksum"}), see ClaimByChecksum below
+    const std::string FILES_BATCH     = API_BASE_PATH + "/files/batch";        // POST (JSON {"operations": [...], "atomic"}), see MetadataBatch below
 
     // Synchronization
     // Client sends its manifest, server responds with actions needed.
     const std::string SYNC_MANIFEST   = API_BASE_PATH + "/sync/manifest";      // POST (JSON body with client file states)
                                                                             // Response: JSON body with sync operations
+    const std::string SYNC_TREE       = API_BASE_PATH + "/sync/tree";          // POST (directory hashes, see MerkleTree)
+    const std::string SYNC_WATCH      = API_BASE_PATH + "/sync/watch";         // GET long-poll (?hash=<root tree hash>&timeout=<s>, see MerkleTree)
 
     // Sharing & Permissions (Example - design can vary greatly)
     const std::string SHARED_CREATE_STORAGE = API_BASE_PATH + "/shared/storage"; // POST (JSON body: {"name": "project_alpha"})
@@ -55,6 +72,10 @@ namespace Endpoints {
     const std::string SHARED_GRANT_ACCESS = API_BASE_PATH + "/shared/access";    // POST (JSON body: {"storage_name", "username", "permission"})
     const std::string SHARED_REVOKE_ACCESS = API_BASE_PATH + "/shared/access";   // DELETE (JSON body or query params)
     // const std::string FILES_SHARE      = API_BASE_PATH + "/files/share";      // POST (JSON: {"path", "target_user", "permission"})
+
+    // Server introspection
+    const std::string SERVER_STATS    = API_BASE_PATH + "/server/stats";       // GET (requires token, session counters etc.)
+    const std::string METRICS         = "/metrics";                            // GET, Prometheus text format (loopback or metrics.token)
 } // namespace Endpoints
 
 
@@ -88,14 +109,53 @@ namespace JsonKeys {
 
     // Sync
     const std::string CLIENT_FILES = "client_files"; // Array for sync manifest
+    const std::string IS_DELETED = "is_deleted";     // Client-side deletion in the manifest
     const std::string SYNC_OPERATIONS = "sync_operations";
     const std::string SYNC_ACTION_TYPE = "sync_action_type";
     const std::string RELATIVE_PATH = "relative_path"; // Used within sync structures
+    const std::string SCOPE = "scope";               // Directories a scoped manifest covers (see MerkleTree)
+    const std::string DIRECTORIES = "directories";   // SYNC_TREE request / response
+    const std::string HASH = "hash";                 // Directory tree hash (see MerkleTree)
+    const std::string CHILDREN = "children";
+    const std::string CHANGED = "changed";           // SYNC_WATCH response
+    const std::string CHUNKS = "chunks";             // Chunk hashes in file order (FILES_CHUNKS_MISSING / FILES_COMMIT)
+    const std::string MISSING = "missing";           // FILES_CHUNKS_MISSING response
+    const std::string STORED = "stored";             // FILES_CHUNKS response: number of chunks accepted
+    const std::string OPERATIONS = "operations";     // FILES_BATCH request
+    const std::string OP = "op";                     // FILES_BATCH operation: "mkdir", "delete", "rename"
+    const std::string ATOMIC = "atomic";             // FILES_BATCH: all-or-nothing
+    const std::string RESULTS = "results";           // FILES_BATCH response, one per operation
+    const std::string CODE = "code";                 // HTTP status of one batch operation
+    const std::string COUNT = "count";               // Streamed sync plan trailer: operations sent
 
     // Sharing
     const std::string STORAGE_NAME = "storage_name";
     const std::string TARGET_USER = "target_user";
     const std::string PERMISSION = "permission";     // "r", "rw"
+
+    // Server stats
+    const std::string SESSIONS = "sessions";
+    const std::string ACTIVE = "active";
+    const std::string CREATED = "created";
+    const std::string EXPIRED = "expired";
+    const std::string REMOVED = "removed";
+    const std::string IDLE_TTL_SECONDS = "idle_ttl_seconds";
+    const std::string REVOKED_TOKENS = "revoked_tokens";
+    const std::string PASSWORD_HASHING = "password_hashing";
+    const std::string WORKERS = "workers";
+    const std::string QUEUE_LIMIT = "queue_limit";
+    const std::string QUEUE_DEPTH = "queue_depth";
+    const std::string COMPLETED = "completed";
+    const std::string REJECTED = "rejected";
+    const std::string AVG_WAIT_MS = "avg_wait_ms";
+    const std::string AVG_RUN_MS = "avg_run_ms";
+    const std::string MAX_WAIT_MS = "max_wait_ms";
+    const std::string WORKER_POOLS = "worker_pools"; // {"metadata": {...}, "transfer": {...}}
+    const std::string RATE_LIMIT = "rate_limit";
+    const std::string REJECTED_USER_REQUESTS = "rejected_user_requests";
+    const std::string REJECTED_USER_BYTES = "rejected_user_bytes";
+    const std::string REJECTED_IP_REQUESTS = "rejected_ip_requests";
+    const std::string TRACKED_KEYS = "tracked_keys";
 } // namespace JsonKeys
 
 
@@ -137,8 +197,183 @@ namespace ContentTypes {
     const std::string MULTIPART_FORM_DATA = "multipart/form-data";
     const std::string APPLICATION_OCTET_STREAM = "application/octet-stream"; // For binary file downloads
     const std::string TEXT_PLAIN = "text/plain; charset=utf-8";
+    const std::string APPLICATION_CBOR = "application/cbor";       // Compact manifest (see CompactManifest)
+    const std::string APPLICATION_MSGPACK = "application/msgpack"; // Compact manifest (see CompactManifest)
+    const std::string APPLICATION_NDJSON = "application/x-ndjson"; // Streamed sync plan (see PlanStream)
 } // namespace ContentTypes
 
+// --- Compact (binary) manifests ---
+/*
+   SYNC_MANIFEST and FILES_LIST also speak CBOR and MessagePack:
+   - request body: Content-Type application/cbor or application/msgpack;
+   - response: the server answers in CBOR / MessagePack when the Accept header names one of them,
+     JSON otherwise. Error responses are always JSON.
+
+   Top-level keys stay the same as in JSON ("status", "client_files", "sync_operations", "listing"),
+   but every entry is a positional array instead of an object, checksums are the raw 32 SHA-256
+   bytes (CBOR byte string / MessagePack bin, nil when unknown) and actions are integer codes:
+     client_files[i]    = [relative_path, last_modified, checksum, flags] or [..., flags, size]
+     sync_operations[i] = [action_code, relative_path] or, for MOVE_*, [action_code, relative_path, old_path]
+     listing[i]         = [name, path, is_directory, size, last_modified]
+*/
+/*
+   Renames: a file deleted on one side and present under a new path with the same checksum is
+   planned as one rename instead of a delete plus a transfer. The operation carries "old_path"
+   (JSON) next to "relative_path", the new path:
+     MOVE_ON_SERVER  the client renamed old_path (tombstone in its manifest): it calls FILES_RENAME
+     MOVE_ON_CLIENT  old_path was renamed or deleted on the server: the client renames its copy
+   If the rename fails, the client falls back to uploading / downloading relative_path.
+*/
+/*
+   client_files entries may carry the file "size" (bytes; the optional fifth compact element). The
+   server uses it to order a streamed plan and echoes it as "size" on the JSON operations that
+   transfer the file; it also sends "size" for files it sends (download / conflict). 0, absent or
+   not a number = unknown.
+*/
+namespace CompactManifest {
+    const unsigned FLAG_DIRECTORY = 1;
+    const unsigned FLAG_DELETED = 2;
+    const std::size_t CHECKSUM_BYTES = 32;
+
+    // action_code = index in this table (same order as the server's SyncActionType).
+    const char* const SYNC_ACTION_NAMES[] = {
+        "NO_ACTION", "UPLOAD_TO_SERVER", "DOWNLOAD_TO_CLIENT", "CONFLICT_SERVER_WINS",
+        "CONFLICT_CLIENT_WINS", "CREATE_CONFLICT_COPY_ON_SERVER", "DELETE_ON_CLIENT", "DELETE_ON_SERVER",
+        "MOVE_ON_SERVER", "MOVE_ON_CLIENT"
+    };
+    const int SYNC_ACTION_COUNT = sizeof(SYNC_ACTION_NAMES) / sizeof(SYNC_ACTION_NAMES[0]);
+} // namespace CompactManifest
+
+// --- Directory tree hashes (subtree-skipping sync) ---
+/*
+   Every directory has a tree hash, computed the same way by client and server:
+     hash(dir) = hex(SHA-256( for each direct child, sorted by name (byte order):
+                                kind name '\0' value '\0' ))
+   kind is 'f' (file, value = its SHA-256 checksum hex, "" if unknown) or 'd' (directory,
+   value = hash(child)). Timestamps and tombstones are not part of the hash; an empty
+   directory hashes the empty string. Paths are relative to the sync root ("" = the root).
+
+   SYNC_TREE walks the tree top-down, one level per request, in the manifest formats above:
+     request:  {"directories": [{"path": p, "hash": client_hash}, ...]}
+     response: {"status": "success", "directories": [{"path": p, "hash": server_hash,
+                                                      "children": [[name, is_directory, value], ...]}, ...]}
+   "children" is only sent when the hashes differ. "hash" is always hex; a child's value is hex in
+   JSON, raw 32 bytes (nil when empty) in CBOR / MessagePack. A directory missing on the server
+   has hash "" and no children.
+   The client descends into the subdirectories whose hashes differ, then sends SYNC_MANIFEST with
+   "scope": [every differing directory] and only the direct children of those directories
+   (tombstones included). The server then plans those directories only. An unchanged tree costs
+   one request carrying only the root hash, and no manifest at all.
+
+   SYNC_WATCH replaces periodic polling: GET ?hash=<root hash the client last saw>&timeout=<seconds>
+   returns {"status": "success", "changed": bool, "hash": current root hash} as soon as the home
+   tree hash differs from "hash" (at once if it already does), or with "changed": false after
+   the timeout (capped by the server). The client syncs when "changed" is true and watches again
+   with the returned hash. 503 + Retry-After when too many watchers are parked. A server that
+   cannot park more watchers without tying up threads answers "changed": false at once with a
+   Retry-After header; the client waits that long before watching again.
+*/
+namespace MerkleTree {
+    const char KIND_FILE = 'f';
+    const char KIND_DIRECTORY = 'd';
+} // namespace MerkleTree
+
+// --- Block delta transfer (modified large files) ---
+/*
+   Formats and algorithm: block_delta.hpp (BlockDelta). All bodies are application/octet-stream.
+
+   Upload (client has the new version):
+     GET  FILES_SIGNATURE?path=p      -> signature of the server's file, X-File-Checksum = its checksum
+     POST FILES_PATCH?path=p          body = delta, X-Base-Checksum = that checksum,
+                                      X-File-Checksum = checksum of the new version
+     -> 201 like FILES_UPLOAD; 412 when the server's file is no longer the base (upload the whole
+        file instead); 422 when the delta is malformed or the result does not match X-File-Checksum.
+   Download (server has the new version):
+     POST FILES_DELTA?path=p          body = signature of the client's copy
+     -> 200, X-File-Checksum = checksum of the server's file and X-Transfer-Mode = "delta" (body is a
+        delta against the client's copy) or "full" (body is the whole file: the delta would not
+        have been smaller than transfer.delta_max_percent of it).
+   The sender uploads the whole file when the delta exceeds BlockDelta::DEFAULT_MAX_DELTA_PERCENT
+   of it, and files below BlockDelta::DEFAULT_MIN_FILE_SIZE are always sent whole.
+*/
+
+// --- Chunked upload (new files, deduplicated by content) ---
+/*
+   Chunking and frame format: fastcdc.hpp (FastCdc). A chunk is named by the SHA-256 of its content.
+
+     POST FILES_CHUNKS_MISSING  {"chunks": [h1, h2, ...]}  -> {"missing": [...]}: chunks the server
+                                does not have, or that this user has never uploaded itself
+     POST FILES_CHUNKS          body = frames of the missing chunks (batched, several requests are fine)
+                                -> {"stored": n}; 422 if a frame does not match its hash
+     POST FILES_COMMIT          {"path": p, "checksum": file checksum, "chunks": [h1, h2, ...]}
+                                -> 201 like FILES_UPLOAD; 409 when a chunk is missing again (ask
+                                FILES_CHUNKS_MISSING again); 422 when the chunks do not add up to "checksum".
+   Missing chunks must be committed within storage.chunk_gc_grace_seconds of being uploaded or
+   reported present. With storage.mode = chunked the server keeps the file as that chunk list;
+   otherwise it assembles the file. Downloads are unchanged.
+*/
+
+// --- Claim by checksum (content the server already has) ---
+/*
+     POST FILES_CLAIM  {"path": p, "checksum": SHA-256 of the whole file}
+                       -> 201 like FILES_UPLOAD when a file with that checksum exists that this user
+                       may read: the server creates p from it (shares its chunks, reflink or copy)
+                       and the body is never sent; 404 when there is none, upload as usual.
+   Checked before uploading a new file. The server verifies the content, not just the
+   recorded checksum, so a stale file_metadata row only turns into a 404.
+*/
+
+// --- Streamed sync plan ---
+/*
+   A client that lists application/x-ndjson in the Accept header of SYNC_MANIFEST (request body in
+   any manifest format) gets the plan as newline-delimited JSON while the server is still computing
+   it, instead of one "sync_operations" array at the end:
+     {"sync_action_type": "UPLOAD_TO_SERVER", "relative_path": "a/b.txt", "size": 1234}
+     {"sync_action_type": "MOVE_ON_SERVER", "relative_path": "c.txt", "old_path": "b.txt"}
+     ...
+     {"status": "success", "count": n}       <- trailer: the plan is complete
+   Operations come in priority order rather than path order: for each slice of the manifest,
+   directory creates (a directory always before its contents) then the other operations; after the
+   last slice renames, files of sync.stream_large_file_bytes or more (smallest first), then deletes
+   when rename detection is on. The client can start each operation as soon as its line arrives.
+   A failure after the 200 is reported as a {"status": "error", "message": ...} trailer; a stream
+   without trailer was cut short. The body is never compressed, so lines are not held back by the
+   compressor. Servers without streaming answer with the usual array response.
+*/
+namespace PlanStream {
+    const char LINE_SEPARATOR = '\n';
+} // namespace PlanStream
+
+// --- Metadata batch ---
+/*
+     POST FILES_BATCH  {"atomic": false, "operations": [
+                          {"op": "mkdir",  "path": p},
+                          {"op": "delete", "path": p},
+                          {"op": "rename", "old_path": p, "new_path": q}, ...]}
+                       -> 200 {"results": [{"code": 201}, {"code": 404, "message": ...}, ...]}
+   Operations run in order, with the same permissions as FILES_MKDIR / FILES_DELETE /
+   FILES_RENAME, in one metadata transaction. "code" is what the single request would have
+   returned (mkdir 201, delete / rename 200); each failed operation leaves nothing behind.
+   atomic = false: failed operations are skipped, the rest still run.
+   atomic = true: the first failure undoes the whole batch; the failed operation has its own
+   code and every other one 424 (Failed Dependency).
+   400 when the body is malformed or carries more than storage.batch_max_operations operations.
+   Servers without FILES_BATCH answer 404: fall back to one request per operation.
+*/
+namespace MetadataBatch {
+    const std::string MKDIR = "mkdir";
+    const std::string DELETE = "delete";
+    const std::string RENAME = "rename";
+} // namespace MetadataBatch
+
+// --- Content Codings (Accept-Encoding / Content-Encoding) ---
+// JSON responses above compression.min_bytes are compressed when the client accepts it.
+namespace ContentCodings {
+    const std::string ZSTD = "zstd";
+    const std::string GZIP = "gzip";
+    const std::string IDENTITY = "identity";
+} // namespace ContentCodings
+
 
 // --- File Upload (using multipart/form-data) ---
 /*
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+// Token bucket per key, implemented as GCRA: each key stores only its
+// "theoretical arrival time" (TAT). A known key costs one shared lock plus a
+// CAS loop on an atomic; the exclusive lock is only taken to add a new key.
+class RateLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Decision {
+        bool allowed;
+        std::chrono::nanoseconds retry_after; // 0 when allowed
+    };
+
+    // rate_per_second <= 0 disables the limiter (every call is allowed).
+    // burst = bucket size, in the same unit as cost.
+    RateLimiter(double rate_per_second, double burst);
+
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    bool enabled() const { return enabled_; }
+
+    // Takes `cost` tokens if available.
+    Decision acquire(const std::string& key, double cost = 1.0) { return acquire(key, cost, Clock::now()); }
+    Decision acquire(const std::string& key, double cost, Clock::time_point now);
+
+    // For costs only known after the fact (bytes sent): admit while the bucket
+    // is not in debt, then charge() the real amount, which may push it into debt.
+    Decision check(const std::string& key) { return check(key, Clock::now()); }
+    Decision check(const std::string& key, Clock::time_point now);
+    void charge(const std::string& key, double cost) { charge(key, cost, Clock::now()); }
+    void charge(const std::string& key, double cost, Clock::time_point now);
+
+    std::size_t tracked_keys() const;
+
+private:
+    static constexpr std::size_t kShardCount = 32;
+    static constexpr std::size_t kMaxKeysPerShard = 4096; // full buckets are dropped beyond this
+
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<std::atomic<std::int64_t>>> tat_ns;
+    };
+
+    // shared_ptr: an entry may be dropped from the map while a caller still uses it.
+    std::shared_ptr<std::atomic<std::int64_t>> slot(const std::string& key, std::int64_t now_ns);
+    std::int64_t to_ns(Clock::time_point t) const;
+
+    const bool enabled_;
+    const double interval_ns_;          // time needed to refill one unit
+    const std::int64_t tolerance_ns_;   // burst expressed as time
+    std::array<Shard, kShardCount> shards_;
+};
+
+// The buckets checked by APIRouterHandler::handleRequest before routing.
+class AdmissionControl {
+public:
+    struct Limits {
+        double user_requests_per_second;
+        double user_request_burst;
+        double user_bytes_per_second;
+        double user_bytes_burst;
+        double ip_requests_per_second;
+        double ip_request_burst;
+    };
+
+    struct Stats {
+        std::uint64_t rejected_user_requests;
+        std::uint64_t rejected_user_bytes;
+        std::uint64_t rejected_ip_requests;
+        std::size_t tracked_keys;
+    };
+
+    explicit AdmissionControl(const Limits& limits);
+
+    // Metadata calls (list, mkdir, manifest, ...): one token per request.
+    RateLimiter::Decision admit_user_request(int user_id);
+    // Transfers: admitted unless the user's byte bucket is in debt.
+    RateLimiter::Decision admit_user_transfer(int user_id);
+    void charge_user_bytes(int user_id, std::uint64_t bytes);
+    // Public (unauthenticated) routes, keyed by client IP.
+    RateLimiter::Decision admit_ip_request(const std::string& ip);
+
+    Stats stats() const;
+
+private:
+    RateLimiter user_requests_;
+    RateLimiter user_bytes_;
+    RateLimiter ip_requests_;
+    std::atomic<std::uint64_t> rejected_user_requests_{0};
+    std::atomic<std::uint64_t> rejected_user_bytes_{0};
+    std::atomic<std::uint64_t> rejected_ip_requests_{0};
+};
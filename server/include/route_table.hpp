@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class HttpMethod : std::uint8_t { GET, POST, PUT, DELETE, HEAD, OPTIONS, PATCH, UNKNOWN };
+
+HttpMethod parse_http_method(std::string_view method);
+const char* http_method_name(HttpMethod method);
+
+// Which admission-control budget a route draws from (see rate_limiter.hpp).
+enum class RouteCost : std::uint8_t {
+    REQUEST,        // one token from the per-user (or per-IP) request bucket
+    UPLOAD_BYTES,   // request body bytes actually read, from the per-user byte bucket
+    DOWNLOAD_BYTES  // response body bytes actually sent, from the per-user byte bucket
+};
+
+// Which worker pool runs the handler. Transfers and metadata calls are sized
+// independently so a few large downloads cannot delay logins and listings.
+enum class RouteClass : std::uint8_t {
+    METADATA,  // short JSON calls
+    TRANSFER,  // file bodies streamed to/from disk
+    INLINE     // runs on the connection thread (handler already offloads its own work)
+};
+
+struct RouteSpec {
+    HttpMethod method;
+    std::string path;              // exact match, without query string
+    std::uint16_t id;              // handler / metric index, dense from 0
+    std::string name;              // stable label for logs and metrics
+    bool requires_auth;
+    RouteCost cost;
+    std::uint64_t max_body_bytes;  // 0 = no limit
+    RouteClass work_class = RouteClass::METADATA;
+};
+
+// Immutable (method, path) -> RouteSpec table, built once at startup.
+// Lookup uses a perfect hash found at construction time: one hash over the
+// path, one slot probe and one string compare; no allocation.
+class RouteTable {
+public:
+    // Throws std::invalid_argument on duplicate (method, path) or non-dense ids.
+    explicit RouteTable(std::vector<RouteSpec> routes);
+
+    const RouteSpec* find(HttpMethod method, std::string_view path) const;
+    const std::vector<RouteSpec>& routes() const { return routes_; }
+    std::size_t size() const { return routes_.size(); }
+
+    // Path part of a request URI ("/a/b?x=1" -> "/a/b").
+    static std::string_view path_of(std::string_view uri);
+
+private:
+    static std::uint64_t hash(HttpMethod method, std::string_view path, std::uint64_t seed);
+
+    static constexpr std::uint16_t kEmptySlot = 0xFFFF;
+
+    std::vector<RouteSpec> routes_;
+    std::vector<std::uint16_t> slots_; // index into routes_, or kEmptySlot
+    std::uint64_t seed_ = 0;
+    std::uint64_t mask_ = 0;
+};
@@ -5,6 +5,15 @@
 #include "file_manager.hpp"
 #include "sync_manager.hpp"
 #include "access_control.hpp"
+#include "session_store.hpp"
+#include "token_codec.hpp"
+#include "token_revocation.hpp"
+#include "rate_limiter.hpp"
+#include "bounded_executor.hpp"
+#include "route_table.hpp"
+#include "metrics.hpp"
+#include "content_coding.hpp"
+#include "manifest_codec.hpp"
 #include "protocol.hpp" // Our HTTP protocol definitions
 
 #include <Poco/Net/HTTPServer.h>
@@ -43,10 +52,39 @@ using json = nlohmann::json;   // Alias for nlohmann::json
 // Forward declaration
 class APIRouterHandler;
 
+// Metrics recorded by APIRouterHandler; per-route entries are indexed by RouteSpec::id.
+struct ApiMetrics {
+    struct Route {
+        Counter* requests;
+        Counter* errors;      // responses with status >= 400
+        Histogram* latency;   // microseconds
+    };
+    std::vector<Route> routes;
+    Counter* unmatched;
+    Counter* upload_bytes;
+    Counter* download_bytes;
+    Counter* json_bytes_uncompressed; // JSON bodies that were sent compressed: size before...
+    Counter* json_bytes_compressed;   // ...and after compression
+    Counter* claim_hits;              // FILES_CLAIM served from an existing file...
+    Counter* claim_misses;            // ...or answered 404
+    Counter* claim_bytes_avoided;     // Size of the files created by FILES_CLAIM
+
+    static ApiMetrics create(const RouteTable& table, MetricsRegistry& registry);
+};
+
+// Executors that run API handlers, chosen by RouteSpec::work_class (owned by FileServerApp).
+struct WorkerPools {
+    BoundedExecutor& metadata;
+    BoundedExecutor& transfer;
+    int retry_after_seconds; // Retry-After sent when the chosen pool is full
+};
+
 // Request Handler Factory: Creates instances of our APIRouterHandler
 class FileServerRequestHandlerFactory : public HTTPRequestHandlerFactory {
 public:
-    FileServerRequestHandlerFactory(Database& db, UserManager& um, FileManager& fm, SyncManager& sm, AccessControlManager& acm);
+    FileServerRequestHandlerFactory(Database& db, UserManager& um, FileManager& fm, SyncManager& sm, AccessControlManager& acm,
+                                    SessionStore& sessions, const TokenCodec& tokens, TokenRevocationList& revocations,
+                                    AdmissionControl& admission, const WorkerPools& pools);
     HTTPRequestHandler* createRequestHandler(const HTTPServerRequest& request) override;
 
 private:
@@ -64,6 +102,13 @@ private:
     FileManager& file_manager_;
     SyncManager& sync_manager_;
     AccessControlManager& access_control_manager_;
+    SessionStore& session_store_;
+    const TokenCodec& token_codec_;
+    TokenRevocationList& revocations_;
+    AdmissionControl& admission_;
+    const WorkerPools pools_;
+    const RouteTable routes_; // Built once, shared read-only by every handler
+    const ApiMetrics metrics_;
     // Định nghĩa kiểu cho các hàm handler
     //using PublicHandler = std::function<void(HTTPServerRequest&, HTTPServerResponse&)>;
     //using AuthHandler = std::function<void(HTTPServerRequest&, HTTPServerResponse&, const ActiveSession&)>;
@@ -79,20 +124,27 @@ private:
 // Main HTTP Request Handler: Routes and processes API requests
 class APIRouterHandler : public HTTPRequestHandler {
 public:
-    APIRouterHandler(Database& db, UserManager& um, FileManager& fm, SyncManager& sm, AccessControlManager& acm);
+    // RouteSpec::id values; also used as metric ids.
+    enum class RouteId : std::uint16_t {
+        REGISTER, LOGIN, LOGOUT, USER_ME,
+        FILES_UPLOAD, FILES_DOWNLOAD, FILES_LIST, FILES_MKDIR, FILES_DELETE, FILES_RENAME,
+        FILES_SIGNATURE, FILES_PATCH, FILES_DELTA, FILES_CHUNKS_MISSING, FILES_CHUNKS, FILES_COMMIT, FILES_CLAIM,
+        FILES_BATCH,
+        SYNC_MANIFEST, SYNC_TREE, SYNC_WATCH, SHARED_CREATE_STORAGE, SHARED_GRANT_ACCESS, SERVER_STATS,
+        COUNT
+    };
+
+    APIRouterHandler(Database& db, UserManager& um, FileManager& fm, SyncManager& sm, AccessControlManager& acm,
+                     SessionStore& sessions, const TokenCodec& tokens, TokenRevocationList& revocations,
+                     AdmissionControl& admission, const WorkerPools& pools, const RouteTable& routes,
+                     const ApiMetrics& metrics);
     void handleRequest(HTTPServerRequest& request, HTTPServerResponse& response) override;
 
-private:
-    struct ActiveSession {
-        int user_id;
-        std::string username;
-        std::string home_dir;       // Absolute path to user's home directory
-        Poco::Timestamp last_activity;
-        // Potentially other session data: Poco::UUID session_id_uuid;
-    };
+    // All API routes with their metadata (auth, rate-limit budget, body limit).
+    static RouteTable buildRouteTable();
 
-    using PublicHandler = std::function<void(HTTPServerRequest&, HTTPServerResponse&)>;
-    using AuthHandler = std::function<void(HTTPServerRequest&, HTTPServerResponse&, const ActiveSession&)>;
+private:
+    using ActiveSession = SessionInfo; // Defined in session_store.hpp
 
 
 
@@ -104,17 +156,20 @@ private:
     FileManager& file_manager_;
     SyncManager& sync_manager_;
     AccessControlManager& access_control_manager_;
-
-    // --- Active Session Structure (Simplified for local server) ---
-    std::map<std::string, PublicHandler> public_routes_;
-    std::map<std::string, AuthHandler> authenticated_routes_;
-
-    // Static map for active sessions.
-    // WARNING: For a local, single-process server. NOT suitable for production/multi-process.
-    // Needs protection for concurrent access from multiple handler threads.
-    static std::map<std::string, ActiveSession> active_sessions_;
-    static Poco::Mutex session_mutex_; // Mutex to protect active_sessions_
-    void setupRoutes();
+    SessionStore& session_store_;       // Idle tracking per token id (owned by FileServerApp)
+    const TokenCodec& token_codec_;     // Signs/verifies stateless session tokens
+    TokenRevocationList& revocations_;  // Logged-out token ids
+    AdmissionControl& admission_;       // Per-user / per-IP rate limits
+    const WorkerPools& pools_;          // Owned by the factory
+    const RouteTable& routes_;          // Owned by the factory
+    const ApiMetrics& metrics_;         // Owned by the factory
+    ContentCoding response_coding_ = ContentCoding::IDENTITY; // From Accept-Encoding, for JSON responses
+
+    // Calls the handler for route.id; session is null for public routes.
+    void dispatch(const RouteSpec& route, HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession* session);
+    // Runs work on the pool for route.work_class and waits for it. Returns false
+    // (after sending 503) if that pool's queue is full.
+    bool runOnWorkerPool(const RouteSpec& route, HTTPServerResponse& response, const std::function<void()>& work);
     // --- Request Handling Helper Methods ---
     // User Management
     void handleUserRegister(HTTPServerRequest& request, HTTPServerResponse& response);
@@ -129,10 +184,23 @@ private:
     void handleFileMkdir(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session);
     void handleFileDelete(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session);
     void handleFileRename(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session);
+    // Block delta transfer (BlockDelta in block_delta.hpp)
+    void handleFileSignature(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session);
+    void handleFilePatch(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session);
+    void handleFileDelta(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session);
+    // Chunked upload (ChunkStore in chunk_store.hpp)
+    void handleChunksMissing(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session);
+    void handleChunksUpload(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session);
+    void handleFileCommit(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session);
+    void handleFileClaim(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session);
+    void handleFileBatch(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session);
     // void handleFileMetadata(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session); // TODO
 
     // Synchronization
     void handleSyncManifest(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session);
+    void handleSyncTree(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session);
+    // Long-poll; on the epoll engine the request is parked without a thread (DeferrableResponse).
+    void handleSyncWatch(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session);
 
     // Sharing & Permissions
     void handleCreateSharedStorage(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session);
@@ -140,15 +208,29 @@ private:
     // void handleRevokeSharedAccess(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session); // TODO
     // void handleListSharedStorages(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session); // TODO
 
+    // Server introspection
+    void handleServerStats(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session);
+
     // --- Utility Methods ---
     void sendJsonResponse(HTTPServerResponse& response, HTTPResponse::HTTPStatus status, const json& payload);
+    // 200 {"status": "success", array_key: [count phần tử]} theo format đã negotiate (listing / manifest).
+    // write_elements gọi writer.element() đúng count lần; body đi thẳng ra socket (chunked), không dựng DOM.
+    void streamManifestResponse(HTTPServerResponse& response, ManifestFormat format, const std::string& array_key,
+                                std::size_t count, const std::function<void(ManifestResponseWriter&)>& write_elements);
+    // Gửi body (Content-Type đã đặt), nén theo response_coding_ nếu đủ lớn.
+    // streaming = false: body không nén được gom lại để có Content-Length (response JSON nhỏ).
+    void sendResponseBody(HTTPServerResponse& response, const std::function<void(std::ostream&)>& write_body, bool streaming = false);
     void sendErrorResponse(HTTPServerResponse& response, HTTPResponse::HTTPStatus status, const std::string& message);
     void sendSuccessResponse(HTTPServerResponse& response, const std::string& message, HTTPResponse::HTTPStatus status = HTTPResponse::HTTP_OK);
+    // 503 + Retry-After, used when a bounded worker pool rejects work
+    void sendRetryLaterResponse(HTTPServerResponse& response, int retry_after_seconds, const std::string& message);
+    // 429 + Retry-After when a rate-limit bucket is empty
+    void sendRateLimitedResponse(HTTPServerResponse& response, std::chrono::nanoseconds retry_after, const std::string& message);
 
 
     std::optional<ActiveSession> getAuthenticatedSession(HTTPServerRequest& request);
-    std::string generateToken(int user_id, const std::string& username); // Generate a unique session token
-    // void clearExpiredSessions(); // Optional: For periodic cleanup of old sessions
+    // Issues a signed session token; home_root is the home dir relative to Config::USER_DATA_ROOT.
+    std::string generateToken(int user_id, const std::string& username, const std::string& home_root, TokenClaims& claims);
 };
 
 // The FileServerApp class (using Poco::Util::ServerApplication)
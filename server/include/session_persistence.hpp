@@ -0,0 +1,57 @@
+#pragma once
+
+#include "db.hpp"
+#include "session_store.hpp"
+#include "token_revocation.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Keeps session state in SQLite so a restart is invisible to sync clients:
+// - the auto-generated token signing key (when security.token_keys is empty),
+// - active sessions, with last_activity written behind in batches,
+// - the token revocation list.
+// Uses its own SQLite connection so batch transactions don't mix with
+// statements issued by request handlers on the shared connection.
+class SessionPersistence {
+public:
+    SessionPersistence(const std::string& db_path, SessionStore& store, TokenRevocationList& revocations,
+                       std::chrono::seconds flush_interval);
+    ~SessionPersistence();
+
+    SessionPersistence(const SessionPersistence&) = delete;
+    SessionPersistence& operator=(const SessionPersistence&) = delete;
+
+    bool is_open() { return db_.get_db_handle() != nullptr; }
+
+    // Returns the stored secret for key_id, creating and storing a random one if absent.
+    std::optional<std::string> load_or_create_signing_key(const std::string& key_id);
+
+    // Restores unexpired sessions and revocations into the store / list.
+    // Returns the number of sessions restored.
+    std::size_t load();
+
+    void start();
+    void stop();   // Stops the flusher and writes the last batch
+    bool flush();  // Writes pending changes in one transaction
+
+private:
+    Database db_;
+    SessionStore& store_;
+    TokenRevocationList& revocations_;
+    const std::chrono::seconds flush_interval_;
+
+    std::mutex flush_mutex_; // serialises flush() between the flusher and stop()
+    std::vector<PersistedSession> retry_upserts_; // from a failed batch, guarded by flush_mutex_
+    std::vector<std::string> retry_deletes_;
+
+    std::thread flusher_;
+    std::mutex flusher_mutex_;
+    std::condition_variable flusher_cv_;
+    bool stop_requested_ = false;
+};
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "timing_wheel.hpp"
+
+#include <Poco/Timestamp.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Snapshot of a logged-in session handed to request handlers.
+struct SessionInfo {
+    int user_id;
+    std::string username;
+    std::string home_dir;       // Absolute path to user's home directory
+    Poco::Timestamp last_activity;
+};
+
+// Row shape used to persist / restore sessions (see session_persistence.hpp).
+struct PersistedSession {
+    std::string token_id;
+    int user_id;
+    std::string username;
+    std::string home_dir;
+    std::int64_t token_expires_at;   // Unix seconds
+    std::int64_t last_activity;      // Unix seconds
+};
+
+// Lock-striped token id -> session activity map.
+// Tokens are self-verifying (see token_codec.hpp); this store only tracks idle
+// time per token id so that unused logins can be expired and counted.
+// - Lookups take a shared lock on one shard only; last_activity is an atomic, so
+//   the hot path (authenticated request) never takes an exclusive lock.
+// - Idle expiry is driven by a hierarchical timing wheel advanced once per second
+//   by a background sweeper. Entries are re-armed lazily: when a slot fires we
+//   compare against the real last_activity and reschedule if the session was used.
+class SessionStore {
+public:
+    // Called from the sweeper thread (no store lock held) for each idle-expired token id.
+    using ExpiryListener = std::function<void(const std::string& token_id, std::int64_t token_expires_at)>;
+
+    struct Stats {
+        std::uint64_t active;
+        std::uint64_t created;
+        std::uint64_t expired;
+        std::uint64_t removed;  // explicit logout
+    };
+
+    explicit SessionStore(std::chrono::seconds idle_ttl);
+    ~SessionStore();
+
+    SessionStore(const SessionStore&) = delete;
+    SessionStore& operator=(const SessionStore&) = delete;
+
+    void start_sweeper();
+    void stop_sweeper();
+
+    void set_expiry_listener(ExpiryListener listener) { expiry_listener_ = std::move(listener); }
+
+    void insert(const std::string& token_id, int user_id, const std::string& username, const std::string& home_dir,
+                std::int64_t token_expires_at = 0);
+    // Looks up the token id and refreshes its last_activity. Returns nullopt if unknown or idle-expired.
+    std::optional<SessionInfo> touch(const std::string& token_id);
+    // Like touch(), but starts tracking token ids this process has not seen yet
+    // (issued by another server process or before a restart). Returns false only
+    // when the token is known and has been idle longer than the TTL.
+    bool touch_or_adopt(const std::string& token_id, int user_id, const std::string& username, const std::string& home_dir,
+                        std::int64_t token_expires_at);
+    bool erase(const std::string& token_id);
+
+    // Re-inserts a session loaded from disk. Sessions already idle past the TTL are ignored.
+    bool restore(const PersistedSession& session);
+    // Write-behind support: returns sessions created/touched since the last call
+    // and token ids removed since the last call (logout or idle expiry).
+    void drain_changes(std::vector<PersistedSession>& upserts, std::vector<std::string>& deletes);
+
+    // Advances the wheel to "now" and drops idle sessions. Called by the sweeper;
+    // public so tests and shutdown code can force a pass.
+    std::size_t sweep();
+
+    Stats stats() const;
+    std::chrono::seconds idle_ttl() const { return idle_ttl_; }
+
+private:
+    struct Entry {
+        int user_id;
+        std::string username;
+        std::string home_dir;
+        std::int64_t token_expires_at;              // Unix seconds, 0 if unknown
+        std::atomic<std::int64_t> last_activity_ms; // steady clock, ms since store epoch
+        std::atomic<bool> dirty{true};              // not yet written to disk
+    };
+
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<Entry>> map;
+    };
+
+    static constexpr std::size_t SHARD_COUNT = 32;
+
+    Shard& shard_for(const std::string& token);
+    std::int64_t now_ms() const;
+    std::int64_t to_unix_seconds(std::int64_t store_ms) const;
+    void note_removed(const std::string& token_id);
+    TimingWheel::Tick tick_for_ms(std::int64_t ms) const;
+    void on_wheel_expire(const std::string& token_id, std::vector<std::pair<std::string, std::int64_t>>& expired);
+
+    std::array<Shard, SHARD_COUNT> shards_;
+    const std::chrono::seconds idle_ttl_;
+    const std::chrono::steady_clock::time_point epoch_;
+    const std::int64_t epoch_unix_ms_; // wall clock at epoch_, to convert for persistence
+
+    std::mutex wheel_mutex_;
+    TimingWheel wheel_;
+    ExpiryListener expiry_listener_;
+
+    std::mutex removed_mutex_;
+    std::vector<std::string> removed_since_drain_;
+
+    std::atomic<std::uint64_t> active_{0};
+    std::atomic<std::uint64_t> created_{0};
+    std::atomic<std::uint64_t> expired_{0};
+    std::atomic<std::uint64_t> removed_{0};
+
+    std::thread sweeper_;
+    std::mutex sweeper_mutex_;
+    std::condition_variable sweeper_cv_;
+    bool stop_requested_ = false;
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class SyncActionType {
+    NO_ACTION,
+    UPLOAD_TO_SERVER,    // Client sends file to server
+    DOWNLOAD_TO_CLIENT,  // Client receives file from server
+    CONFLICT_SERVER_WINS,// Client should download server's version to resolve
+    CONFLICT_CLIENT_WINS,// Client should upload its version to resolve (server overwrites)
+    CREATE_CONFLICT_COPY_ON_SERVER, // Server renames its, client uploads. Or server renames client's upload.
+    DELETE_ON_CLIENT,    // Client should delete its local copy
+    DELETE_ON_SERVER,    // Server should delete its copy (client initiated)
+    MOVE_ON_SERVER,      // Client renamed source_path -> relative_path: rename on the server, no upload
+    MOVE_ON_CLIENT       // Server renamed source_path -> relative_path: rename locally, no download
+};
+
+struct SyncOperation {
+    SyncActionType action;
+    std::string relative_path;
+    std::string source_path; // Chỉ với MOVE_*: path cũ
+    std::uint64_t size = 0;  // Byte phải truyền nếu biết (kích thước bản ở phía gửi), 0 = không biết
+    bool is_directory = false;
+
+    SyncOperation(SyncActionType act, std::string path, std::string source = std::string())
+        : action(act), relative_path(std::move(path)), source_path(std::move(source)) {}
+};
+
+// Path tương đối dạng chuẩn như SyncPlanManifest::add lưu: bỏ '/' thừa (đầu, cuối, lặp) và segment ".".
+std::string normalize_sync_path(std::string_view relative_path);
+
+// Một phía của manifest (client hoặc server) dạng mảng phẳng: mỗi entry 40 byte, path và
+// checksum nằm liền nhau trong một buffer chung nên không có cấp phát riêng cho từng entry.
+// Path được chuẩn hoá khi add(): bỏ '/' thừa (đầu, cuối, lặp) và segment ".".
+class SyncPlanManifest {
+public:
+    void reserve(std::size_t entries, std::size_t text_bytes = 0);
+    void add(std::string_view relative_path, std::int64_t last_modified, std::string_view checksum,
+             bool is_directory, bool is_deleted, std::uint64_t file_size = 0);
+
+    // Sắp theo path (so sánh byte, giống collation BINARY của SQLite). Không làm gì nếu các entry
+    // đã được add theo thứ tự tăng dần, như khi đọc từ DB với ORDER BY. Path trùng: giữ entry add sau cùng.
+    void sort_by_path();
+    bool sorted() const { return sorted_; }
+
+    std::size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+    std::string_view path(std::size_t i) const {
+        return {text_.data() + entries_[i].path_offset, entries_[i].path_size};
+    }
+    std::string_view checksum(std::size_t i) const {
+        return {text_.data() + entries_[i].path_offset + entries_[i].path_size, entries_[i].checksum_size};
+    }
+    std::int64_t last_modified(std::size_t i) const { return entries_[i].last_modified; }
+    std::uint64_t file_size(std::size_t i) const { return entries_[i].file_size; } // 0 = không biết
+    bool is_directory(std::size_t i) const { return entries_[i].flags & FLAG_DIRECTORY; }
+    bool is_deleted(std::size_t i) const { return entries_[i].flags & FLAG_DELETED; }
+
+private:
+    static constexpr std::uint8_t FLAG_DIRECTORY = 1;
+    static constexpr std::uint8_t FLAG_DELETED = 2;
+
+    struct Entry {
+        std::uint64_t path_offset;   // checksum nằm ngay sau path trong text_
+        std::uint32_t path_size;
+        std::uint32_t checksum_size;
+        std::int64_t last_modified;  // Unix timestamp (giây)
+        std::uint64_t file_size;
+        std::uint8_t flags;
+    };
+
+    std::string text_;
+    std::vector<Entry> entries_;
+    bool sorted_ = true; // Tăng dần chặt, không trùng
+};
+
+struct SyncPlanOptions {
+    unsigned threads = 1;                        // Số partition tối đa (thread gọi chạy partition đầu)
+    std::size_t min_partition_entries = 65536;   // Dưới ngưỡng này không tách thêm partition
+
+    // Ghép cặp xoá + tạo cùng checksum thành một lần đổi tên (xem pair_moves bên dưới).
+    bool detect_moves = false;
+    // Path (tương đối) từng có trên server rồi bị xoá / đổi tên ở đó. Null = không tạo MOVE_ON_CLIENT.
+    std::function<bool(std::string_view relative_path)> deleted_on_server;
+
+    // SyncOperation::size của operation tải từ server (manifest server không có kích thước).
+    // Gọi từ các thread partition. Null = 0.
+    std::function<std::uint64_t(std::string_view relative_path)> server_file_size;
+
+    // Chỉ dùng bởi stream_sync_operations
+    std::size_t stream_slice_entries = 4096;     // Mỗi đoạn merge-join trước khi chuyển operations đi
+    std::uint64_t large_file_bytes = 4u << 20;   // File từ ngưỡng này trở lên được gửi sau cùng; 0 = không tách
+};
+
+// Merge-join hai manifest đã sort_by_path(), trả về operations theo thứ tự path. Với manifest lớn,
+// khoảng path được chia thành các partition không chồng nhau (cắt tại cùng một path ở cả hai phía)
+// và mỗi partition chạy trên một thread riêng; kết quả giống hệt khi chạy một thread.
+// Throws std::invalid_argument nếu một phía chưa được sắp.
+//
+// Với detect_moves, sau merge-join các cặp cùng checksum (file, checksum khác rỗng) được gộp:
+//   MOVE_ON_SERVER  client có tombstone A (server còn A), B chỉ có ở client          -> đổi tên A -> B trên server
+//   MOVE_ON_CLIENT  A chỉ có ở client và deleted_on_server(A), B chỉ có trên server -> đổi tên A -> B ở client
+// Op MOVE nằm ở vị trí của B, op của A bị bỏ. Mỗi path chỉ thuộc một cặp; thiếu bằng chứng thì giữ
+// upload / download như cũ.
+std::vector<SyncOperation> plan_sync_operations(const SyncPlanManifest& client, const SyncPlanManifest& server,
+                                                const SyncPlanOptions& options = {});
+
+// Cùng tập operations như plan_sync_operations, nhưng chuyển cho emit theo thứ tự ưu tiên ngay khi
+// tính xong, để client bắt đầu truyền trong lúc phần còn lại của plan đang được tính. Manifest được
+// merge-join từng đoạn khoảng stream_slice_entries entry (trên thread gọi); mỗi đoạn emit:
+//   1. tạo thư mục (UPLOAD / DOWNLOAD của thư mục), theo path nên thư mục cha luôn đi trước con,
+//   2. các operation còn lại theo path,
+// trừ những operation phải chờ hết manifest, được emit sau đoạn cuối:
+//   3. với detect_moves: cặp MOVE và các ứng viên (upload / download / delete có checksum trùng một
+//      ứng viên phía bên kia) không ghép được,
+//   4. file từ large_file_bytes trở lên, nhỏ trước,
+//   5. với detect_moves: delete (sau move có thể lấy file ra khỏi thư mục bị xoá).
+// Throws std::invalid_argument nếu một phía chưa được sắp; lỗi của emit được ném tiếp.
+void stream_sync_operations(const SyncPlanManifest& client, const SyncPlanManifest& server, const SyncPlanOptions& options,
+                            const std::function<void(SyncOperation&&)>& emit);
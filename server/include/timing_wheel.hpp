@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Hierarchical timing wheel (Varghese & Lauck) with 1-tick resolution.
+// Level 0 has 64 slots of 1 tick, level 1 has 64 slots of 64 ticks, ...
+// Scheduling and expiry are O(1) amortised; an entry is moved down one level
+// each time its enclosing slot is reached (cascade).
+// Not thread-safe: the owner serialises access (SessionStore uses one mutex).
+class TimingWheel {
+public:
+    using Tick = std::uint64_t;
+
+    explicit TimingWheel(Tick start_tick = 0);
+
+    // Schedule `key` to fire at `deadline` (absolute tick). Deadlines in the past
+    // fire on the next advance().
+    void schedule(const std::string& key, Tick deadline);
+
+    // Advance the wheel up to `now` and call `on_expire` for every key whose
+    // deadline is <= now. Returns the number of fired keys.
+    std::size_t advance(Tick now, const std::function<void(const std::string&)>& on_expire);
+
+    Tick current_tick() const { return current_; }
+    std::size_t size() const { return size_; }
+
+private:
+    static constexpr int SLOT_BITS = 6;
+    static constexpr std::size_t SLOTS = std::size_t(1) << SLOT_BITS;
+    static constexpr int LEVELS = 4; // 64^4 ticks ~ 194 days at 1s/tick
+
+    struct Entry {
+        std::string key;
+        Tick deadline;
+    };
+    using Slot = std::vector<Entry>;
+
+    void place(Entry&& entry, Tick earliest);
+    void cascade(int level);
+
+    std::array<std::array<Slot, SLOTS>, LEVELS> wheels_;
+    std::vector<Entry> overflow_; // deadlines beyond the last level
+    Tick current_;
+    std::size_t size_ = 0;
+};
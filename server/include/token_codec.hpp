@@ -0,0 +1,53 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+
+// Claims carried inside a signed session token.
+struct TokenClaims {
+    int user_id = 0;
+    std::string username;
+    std::string home_root;      // Home directory relative to Config::USER_DATA_ROOT
+    std::int64_t issued_at = 0; // Unix seconds
+    std::int64_t expires_at = 0;
+    std::string key_id;
+    std::string token_id;       // Random id, used for revocation (logout)
+};
+
+// Stateless HMAC-SHA256 session tokens:
+//   v1.<key_id>.<base64url(json claims)>.<base64url(hmac)>
+// The MAC covers everything before the last '.', so any process that holds the
+// same key ring can verify a token without consulting shared state.
+//
+// Keys are configured once at startup (add_key/set_active_key) and are read-only
+// afterwards, so issue()/verify() are safe to call from any handler thread.
+// Rotation: add the new key, make it active, keep the old key until its tokens expire.
+class TokenCodec {
+public:
+    bool add_key(const std::string& key_id, const std::string& secret);
+    bool set_active_key(const std::string& key_id);
+    bool has_active_key() const { return !active_key_id_.empty(); }
+    const std::string& active_key_id() const { return active_key_id_; }
+
+    // Signs a new token with the active key. If out_claims is given it receives the issued claims.
+    std::string issue(int user_id, const std::string& username, const std::string& home_root, std::chrono::seconds ttl,
+                      TokenClaims* out_claims = nullptr) const;
+    // Returns claims if the signature is valid for a known key and the token is not expired.
+    std::optional<TokenClaims> verify(const std::string& token) const;
+
+    // Parses "kid:secret,kid2:secret2" (the security.token_keys config format).
+    bool load_key_list(const std::string& key_list);
+
+    static std::string generate_secret(std::size_t bytes = 32);
+
+private:
+    std::map<std::string, std::string> keys_; // key_id -> secret
+    std::string active_key_id_;
+};
+
+// Base64url without padding (RFC 4648 §5). Exposed for tests.
+std::string base64url_encode(const std::string& data);
+std::optional<std::string> base64url_decode(const std::string& text);
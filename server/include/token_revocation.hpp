@@ -0,0 +1,29 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Small deny-list of token ids (jti) that were logged out before they expired.
+// Entries are dropped once the token itself would have expired (checked on each
+// revoke), so the list only ever holds "logged out in the last token lifetime" ids.
+// is_revoked() is a single relaxed atomic load while the list is empty (the common case).
+class TokenRevocationList {
+public:
+    void revoke(const std::string& token_id, std::int64_t expires_at);
+    bool is_revoked(const std::string& token_id) const;
+    // Removes entries whose expires_at <= now (unix seconds). Returns removed count.
+    std::size_t purge_expired(std::int64_t now);
+    std::size_t size() const { return count_.load(std::memory_order_relaxed); }
+    // Copy of (token_id, expires_at) pairs, for persistence.
+    std::vector<std::pair<std::string, std::int64_t>> snapshot() const;
+
+private:
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string, std::int64_t> revoked_; // jti -> expires_at
+    std::atomic<std::size_t> count_{0};
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "db.hpp"
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Một con trực tiếp của thư mục khi tính tree hash (xem MerkleTree trong protocol.hpp).
+struct TreeHashChild {
+    std::string name;
+    bool is_directory = false;
+    std::string value; // file: checksum hex; thư mục: tree hash của nó
+};
+
+// Tree hash (hex) của một thư mục từ các con trực tiếp; children được sắp lại theo tên.
+std::string compute_tree_hash(std::vector<TreeHashChild>& children);
+
+// Tree hash của các thư mục trên server, lưu trong bảng directory_hashes và tính từ các dòng
+// file_metadata chưa xoá (theo parent_path). Mọi path là path tuyệt đối đã canonical, không có
+// '/' ở cuối, giống file_path trong file_metadata.
+//
+// FileManager gọi refresh() sau mỗi thay đổi: thư mục chứa thay đổi và các thư mục cha được tính
+// lại tới gốc của storage (home của user hoặc shared storage, con trực tiếp của USER_DATA_ROOT /
+// SHARED_DATA_ROOT), mỗi mức chỉ đọc các con trực tiếp. Thư mục chưa có hash (dữ liệu cũ) được
+// tính khi cần rồi lưu lại.
+class TreeHashIndex {
+public:
+    explicit TreeHashIndex(Database& db);
+
+    std::string directory_hash(const std::string& dir_path);
+    std::vector<TreeHashChild> children(const std::string& dir_path);
+
+    // Một con của dir_path đã thay đổi.
+    void refresh(const std::string& dir_path);
+    // Thư mục đã bị xoá / đổi tên: bỏ hoặc chuyển hash của nó và mọi thư mục con.
+    void drop_subtree(const std::string& dir_path);
+    void move_subtree(const std::string& old_dir_path, const std::string& new_dir_path);
+
+private:
+    std::string hash_locked(const std::string& dir_path);      // Đọc bảng, tính nếu chưa có
+    std::string recompute_locked(const std::string& dir_path); // Tính lại từ các con rồi lưu
+    std::vector<TreeHashChild> children_locked(const std::string& dir_path);
+    bool is_storage_top(const std::string& dir_path) const;
+
+    Database& db_;
+    std::vector<std::string> storage_roots_; // USER_DATA_ROOT, SHARED_DATA_ROOT (canonical)
+    std::mutex mutex_;                       // Một lần tính lại chuỗi cha tại một thời điểm; lấy sau db_.write_mutex()
+};
@@ -4,9 +4,13 @@
 #include <string>
 #include <optional>
 
+class BoundedExecutor;
+
 class UserManager {
 public:
-    UserManager(Database& db);
+    // If hash_executor is given, password hashing runs on that pool (and may throw
+    // ExecutorSaturated when it is full); otherwise it runs on the calling thread.
+    UserManager(Database& db, BoundedExecutor* hash_executor = nullptr);
 
     // Returns user_id on success
     std::optional<int> register_user(const std::string& username, const std::string& password);
@@ -16,10 +20,20 @@ public:
     std::optional<std::string> get_user_home_dir(int user_id);
     std::optional<int> get_user_id_by_username(const std::string& username);
 
+    // Stored format: pbkdf2_sha256$<iterations>$<salt hex>$<hash hex>
+    static std::string hash_password(const std::string& password, int iterations, int salt_length);
+    // Also accepts legacy unsalted SHA-256 hex hashes.
+    static bool verify_password(const std::string& password, const std::string& stored_hash);
+    // True for legacy hashes or PBKDF2 hashes with fewer iterations than configured.
+    static bool needs_rehash(const std::string& stored_hash, int iterations);
+
+    const BoundedExecutor* hash_executor() const { return hash_executor_; }
+
 private:
     Database& db_;
-    
-    std::string hash_password(const std::string& password);
-    bool verify_password(const std::string& password, const std::string& hash);
+    BoundedExecutor* hash_executor_;
+
+    template <class F> auto run_hashing(F&& f);
+    bool update_password_hash(int user_id, const std::string& new_hash);
     bool create_user_directory(const std::string& username);
 };
\ No newline at end of file
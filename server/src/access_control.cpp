@@ -1,4 +1,6 @@
 #include "access_control.hpp"
+#include "metrics.hpp"
+#include "async_logger.hpp"
 #include "config.hpp"
 #include <iostream>
 #include <sqlite3.h>
@@ -21,11 +23,25 @@ PermissionLevel AccessControlManager::string_to_permission_level(const std::stri
 }
 
 PermissionLevel AccessControlManager::get_permission(int user_id, const fs::path& absolute_server_resource_path_obj) {
+    static Histogram& check_time = MetricsRegistry::global().histogram(
+        "fileserver_acl_check_duration_seconds", "Time spent resolving a permission check");
+    static Counter& denied = MetricsRegistry::global().counter(
+        "fileserver_acl_denied_total", "Permission checks that resolved to no access");
+    PermissionLevel level;
+    {
+        ScopedTimer timer(check_time);
+        level = resolve_permission(user_id, absolute_server_resource_path_obj);
+    }
+    if (level == PermissionLevel::NONE) denied.inc();
+    return level;
+}
+
+PermissionLevel AccessControlManager::resolve_permission(int user_id, const fs::path& absolute_server_resource_path_obj) {
     fs::path canonical_resource_path;
     try {
         canonical_resource_path = fs::weakly_canonical(absolute_server_resource_path_obj);
     } catch (const fs::filesystem_error& e) {
-        std::cerr << "ACM: Filesystem error canonicalizing path " << absolute_server_resource_path_obj << ": " << e.what() << std::endl;
+        LOG_ERROR("ACM: Filesystem error canonicalizing path " << absolute_server_resource_path_obj << ": " << e.what());
         return PermissionLevel::NONE;
     }
     std::string resource_path_str = canonical_resource_path.string();
@@ -43,7 +59,7 @@ PermissionLevel AccessControlManager::get_permission(int user_id, const fs::path
                 highest_perm = PermissionLevel::READ_WRITE;
             }
         } catch (const fs::filesystem_error& e) {
-            std::cerr << "ACM: Filesystem error canonicalizing user home path " << *user_home_dir_str_opt << ": " << e.what() << std::endl;
+            LOG_ERROR("ACM: Filesystem error canonicalizing user home path " << *user_home_dir_str_opt << ": " << e.what());
             // user_home_path_for_check sẽ vẫn rỗng
         }
     }
@@ -85,7 +101,7 @@ PermissionLevel AccessControlManager::get_permission(int user_id, const fs::path
         try {
              shared_root_resolved = fs::weakly_canonical(shared_root_path_obj);
         } catch(const fs::filesystem_error& e){
-             std::cerr << "ACM: Filesystem error canonicalizing SHARED_DATA_ROOT " << shared_root_path_obj << ": " << e.what() << std::endl;
+             LOG_ERROR("ACM: Filesystem error canonicalizing SHARED_DATA_ROOT " << shared_root_path_obj << ": " << e.what());
              return highest_perm; // Không thể xác định quyền shared
         }
 
@@ -121,7 +137,7 @@ PermissionLevel AccessControlManager::get_permission(int user_id, const fs::path
 bool AccessControlManager::grant_explicit_permission(int user_id, const fs::path& absolute_server_resource_path_obj, PermissionLevel perm) {
     std::string perm_s = permission_level_to_string(perm);
     if (perm_s.empty() && perm != PermissionLevel::NONE) { // Allow granting "NONE" to explicitly revoke
-         std::cerr << "ACM: Invalid permission level for grant_explicit_permission." << std::endl;
+         LOG_WARN("ACM: Invalid permission level for grant_explicit_permission.");
          return false;
     }
     if (perm == PermissionLevel::NONE) perm_s = "none"; // Store 'none' explicitly
@@ -130,7 +146,7 @@ bool AccessControlManager::grant_explicit_permission(int user_id, const fs::path
     try {
         canonical_path = fs::weakly_canonical(absolute_server_resource_path_obj);
     } catch (const fs::filesystem_error& e) {
-        std::cerr << "ACM: Invalid path for grant_explicit_permission: " << e.what() << std::endl;
+        LOG_WARN("ACM: Invalid path for grant_explicit_permission: " << e.what());
         return false;
     }
 
@@ -141,6 +157,7 @@ bool AccessControlManager::grant_explicit_permission(int user_id, const fs::path
     );
     if (!sql) return false;
 
+    std::lock_guard<std::recursive_mutex> db_lock(db_.write_mutex());
     bool success = db_.execute(sql);
     sqlite3_free(sql);
     return success;
@@ -151,7 +168,7 @@ bool AccessControlManager::revoke_explicit_permission(int user_id, const fs::pat
     try {
         canonical_path = fs::weakly_canonical(absolute_server_resource_path_obj);
     } catch (const fs::filesystem_error& e) {
-        std::cerr << "ACM: Invalid path for revoke_explicit_permission: " << e.what() << std::endl;
+        LOG_WARN("ACM: Invalid path for revoke_explicit_permission: " << e.what());
         return false;
     }
     char* sql = sqlite3_mprintf(
@@ -159,6 +176,7 @@ bool AccessControlManager::revoke_explicit_permission(int user_id, const fs::pat
         user_id, canonical_path.string().c_str()
     );
     if (!sql) return false;
+    std::lock_guard<std::recursive_mutex> db_lock(db_.write_mutex());
     bool success = db_.execute(sql);
     sqlite3_free(sql);
     return success;
@@ -174,13 +192,13 @@ bool AccessControlManager::create_shared_storage(const std::string& storage_name
         }
         if (!fs::exists(storage_dir)) {
             if (!fs::create_directories(storage_dir)) {
-                std::cerr << "Failed to create physical directory for shared storage: " << storage_dir << std::endl;
+                LOG_ERROR("Failed to create physical directory for shared storage: " << storage_dir);
                 return false;
             }
         }
         canonical_storage_path = fs::weakly_canonical(storage_dir);
     } catch (const fs::filesystem_error& e) {
-        std::cerr << "Filesystem error creating shared storage directory " << storage_dir << ": " << e.what() << std::endl;
+        LOG_ERROR("Filesystem error creating shared storage directory " << storage_dir << ": " << e.what());
         return false;
     }
 
@@ -188,13 +206,14 @@ bool AccessControlManager::create_shared_storage(const std::string& storage_name
         "INSERT OR IGNORE INTO shared_storage (storage_name, storage_path) VALUES (%Q, %Q);",
         storage_name.c_str(), canonical_storage_path.string().c_str()
     );
-     if (!sql) { std::cerr << "ACM: Mprintf failed for create_shared_storage." << std::endl; return false;}
+     if (!sql) { LOG_ERROR("ACM: Mprintf failed for create_shared_storage."); return false;}
 
+    std::lock_guard<std::recursive_mutex> db_lock(db_.write_mutex()); // Cả grant cho người tạo bên dưới
     bool success = db_.execute(sql);
     sqlite3_free(sql);
 
     if (!success) {
-        std::cerr << "Failed to create shared storage DB entry for: " << storage_name << std::endl;
+        LOG_ERROR("Failed to create shared storage DB entry for: " << storage_name);
         return false;
     }
     // Grant creator RW access
@@ -215,7 +234,7 @@ std::optional<fs::path> AccessControlManager::get_shared_storage_path(const std:
         try {
             return fs::weakly_canonical(*path_str_opt);
         } catch (const fs::filesystem_error& e) {
-            std::cerr << "ACM: Invalid shared storage path in DB for " << storage_name << ": " << *path_str_opt << std::endl;
+            LOG_WARN("ACM: Invalid shared storage path in DB for " << storage_name << ": " << *path_str_opt);
             return std::nullopt;
         }
     }
@@ -225,19 +244,20 @@ std::optional<fs::path> AccessControlManager::get_shared_storage_path(const std:
 bool AccessControlManager::grant_shared_storage_access(int user_id, const std::string& storage_name, PermissionLevel perm) {
     std::string perm_s = permission_level_to_string(perm);
     if (perm_s.empty() && perm != PermissionLevel::NONE) {
-        std::cerr << "ACM: Invalid permission level for grant_shared_storage_access." << std::endl;
+        LOG_WARN("ACM: Invalid permission level for grant_shared_storage_access.");
         return false;
     }
      if (perm == PermissionLevel::NONE) perm_s = "none";
 
 
     char* sql_get_id = sqlite3_mprintf("SELECT id FROM shared_storage WHERE storage_name = %Q;", storage_name.c_str());
-    if(!sql_get_id) { std::cerr << "ACM: Mprintf failed for get_id." << std::endl; return false;}
+    if(!sql_get_id) { LOG_ERROR("ACM: Mprintf failed for get_id."); return false;}
+    std::lock_guard<std::recursive_mutex> db_lock(db_.write_mutex());
     auto storage_id_str_opt = db_.execute_scalar(sql_get_id);
     sqlite3_free(sql_get_id);
 
     if (!storage_id_str_opt) {
-        std::cerr << "Shared storage '" << storage_name << "' not found." << std::endl;
+        LOG_WARN("Shared storage '" << storage_name << "' not found.");
         return false;
     }
     int storage_id = std::stoi(*storage_id_str_opt);
@@ -247,7 +267,7 @@ bool AccessControlManager::grant_shared_storage_access(int user_id, const std::s
         "ON CONFLICT(shared_storage_id, user_id) DO UPDATE SET access = excluded.access;",
         storage_id, user_id, perm_s.c_str()
     );
-    if (!sql_grant) { std::cerr << "ACM: Mprintf failed for grant." << std::endl; return false;}
+    if (!sql_grant) { LOG_ERROR("ACM: Mprintf failed for grant."); return false;}
 
     bool success = db_.execute(sql_grant);
     sqlite3_free(sql_grant);
@@ -256,7 +276,8 @@ bool AccessControlManager::grant_shared_storage_access(int user_id, const std::s
 
 bool AccessControlManager::revoke_shared_storage_access(int user_id, const std::string& storage_name) {
     char* sql_get_id = sqlite3_mprintf("SELECT id FROM shared_storage WHERE storage_name = %Q;", storage_name.c_str());
-    if(!sql_get_id) { std::cerr << "ACM: Mprintf failed for get_id on revoke." << std::endl; return false;}
+    if(!sql_get_id) { LOG_ERROR("ACM: Mprintf failed for get_id on revoke."); return false;}
+    std::lock_guard<std::recursive_mutex> db_lock(db_.write_mutex());
     auto storage_id_str_opt = db_.execute_scalar(sql_get_id);
     sqlite3_free(sql_get_id);
     
@@ -269,7 +290,7 @@ bool AccessControlManager::revoke_shared_storage_access(int user_id, const std::
         "DELETE FROM shared_access WHERE shared_storage_id = %d AND user_id = %d;",
         storage_id, user_id
     );
-    if (!sql_revoke) { std::cerr << "ACM: Mprintf failed for revoke." << std::endl; return false;}
+    if (!sql_revoke) { LOG_ERROR("ACM: Mprintf failed for revoke."); return false;}
 
     bool success = db_.execute(sql_revoke);
     sqlite3_free(sql_revoke);
@@ -0,0 +1,193 @@
+#include "async_logger.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+namespace {
+    std::int64_t unix_now_us() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    const char* level_name(LogLevel level) {
+        switch (level) {
+            case LogLevel::DBG: return "DEBUG";
+            case LogLevel::INFO: return "INFO ";
+            case LogLevel::WARN: return "WARN ";
+            case LogLevel::ERR: return "ERROR";
+            case LogLevel::OFF: break;
+        }
+        return "?    ";
+    }
+
+    const char* base_name(const char* path) {
+        const char* slash = std::strrchr(path, '/');
+        return slash ? slash + 1 : path;
+    }
+}
+
+struct AsyncLogger::RingHandle {
+    std::shared_ptr<Ring> ring;
+    ~RingHandle() {
+        if (ring) ring->owner_alive.store(false, std::memory_order_release);
+    }
+};
+
+AsyncLogger& AsyncLogger::instance() {
+    static AsyncLogger logger;
+    return logger;
+}
+
+AsyncLogger::~AsyncLogger() {
+    stop();
+}
+
+LogLine& AsyncLogger::scratch() {
+    thread_local LogLine line;
+    return line;
+}
+
+bool AsyncLogger::parse_level(const std::string& name, LogLevel& out) {
+    std::string n = name;
+    std::transform(n.begin(), n.end(), n.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (n == "debug") out = LogLevel::DBG;
+    else if (n == "info") out = LogLevel::INFO;
+    else if (n == "warn" || n == "warning") out = LogLevel::WARN;
+    else if (n == "error") out = LogLevel::ERR;
+    else if (n == "off") out = LogLevel::OFF;
+    else return false;
+    return true;
+}
+
+void AsyncLogger::start(LogLevel level, const std::string& file_path) {
+    std::lock_guard<std::mutex> lock(direct_mutex_);
+    if (running_.load()) return;
+    set_level(level);
+    if (!file_path.empty()) {
+        out_ = std::fopen(file_path.c_str(), "a");
+        owns_out_ = out_ != nullptr;
+        if (!out_) std::fprintf(stderr, "[AsyncLogger] Cannot open %s, logging to stdout.\n", file_path.c_str());
+    }
+    if (!out_) out_ = stdout;
+    running_.store(true, std::memory_order_release);
+    writer_ = std::thread([this]() { writer_loop(); });
+}
+
+void AsyncLogger::stop() {
+    if (!running_.exchange(false)) return;
+    if (writer_.joinable()) writer_.join();
+    // Ghi nốt những gì còn trong các ring.
+    std::string batch;
+    drain(batch);
+    std::lock_guard<std::mutex> lock(direct_mutex_);
+    if (!batch.empty()) std::fwrite(batch.data(), 1, batch.size(), out_);
+    std::fflush(out_);
+    if (owns_out_) std::fclose(out_);
+    out_ = nullptr;
+    owns_out_ = false;
+}
+
+AsyncLogger::Ring& AsyncLogger::local_ring() {
+    thread_local RingHandle handle;
+    if (!handle.ring) {
+        handle.ring = std::make_shared<Ring>();
+        handle.ring->thread_tag = next_thread_tag_.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(registry_mutex_);
+        rings_.push_back(handle.ring);
+    }
+    return *handle.ring;
+}
+
+void AsyncLogger::log(LogLevel level, const char* file, int line, const char* text, std::size_t length) {
+    length = std::min(length, kMaxMessage);
+    if (!running_.load(std::memory_order_acquire)) {
+        Record r{unix_now_us(), level, static_cast<std::uint16_t>(line), static_cast<std::uint16_t>(length), file, {}};
+        std::memcpy(r.text, text, length);
+        write_direct(r);
+        return;
+    }
+
+    Ring& ring = local_ring();
+    std::uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) >= kRingSlots) {
+        dropped_.fetch_add(1, std::memory_order_relaxed); // writer không theo kịp: bỏ, không chặn request
+        return;
+    }
+    Record& r = ring.slots[head & (kRingSlots - 1)];
+    r.unix_us = unix_now_us();
+    r.level = level;
+    r.line = static_cast<std::uint16_t>(line);
+    r.length = static_cast<std::uint16_t>(length);
+    r.file = file;
+    std::memcpy(r.text, text, length);
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void AsyncLogger::write_line(std::string& out, const Record& r, std::uint64_t thread_tag) const {
+    std::time_t secs = static_cast<std::time_t>(r.unix_us / 1000000);
+    std::tm tm{};
+    gmtime_r(&secs, &tm);
+    char prefix[96];
+    std::size_t n = std::strftime(prefix, sizeof(prefix), "%Y-%m-%dT%H:%M:%S", &tm);
+    n += static_cast<std::size_t>(std::snprintf(prefix + n, sizeof(prefix) - n, ".%06lldZ %s t%llu ",
+                                                static_cast<long long>(r.unix_us % 1000000), level_name(r.level),
+                                                static_cast<unsigned long long>(thread_tag)));
+    out.append(prefix, std::min(n, sizeof(prefix) - 1));
+    out.append(base_name(r.file));
+    out.push_back(':');
+    out.append(std::to_string(r.line));
+    out.append(" | ");
+    out.append(r.text, r.length);
+    out.push_back('\n');
+}
+
+void AsyncLogger::write_direct(const Record& r) {
+    std::string line;
+    write_line(line, r, 0);
+    std::lock_guard<std::mutex> lock(direct_mutex_);
+    std::FILE* f = out_ ? out_ : (r.level >= LogLevel::WARN ? stderr : stdout);
+    std::fwrite(line.data(), 1, line.size(), f);
+    std::fflush(f);
+}
+
+std::size_t AsyncLogger::drain(std::string& batch) {
+    std::size_t count = 0;
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+    for (auto it = rings_.begin(); it != rings_.end();) {
+        Ring& ring = **it;
+        bool alive = ring.owner_alive.load(std::memory_order_acquire);
+        std::uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+        std::uint64_t head = ring.head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail, ++count) {
+            write_line(batch, ring.slots[tail & (kRingSlots - 1)], ring.thread_tag);
+        }
+        ring.tail.store(tail, std::memory_order_release);
+        // Thread đã kết thúc và ring đã rỗng: bỏ khỏi registry.
+        if (!alive && ring.head.load(std::memory_order_acquire) == tail) it = rings_.erase(it);
+        else ++it;
+    }
+    return count;
+}
+
+void AsyncLogger::writer_loop() {
+    std::string batch;
+    std::uint64_t reported_drops = 0;
+    while (running_.load(std::memory_order_acquire)) {
+        batch.clear();
+        std::size_t n = drain(batch);
+        std::uint64_t drops = dropped_.load(std::memory_order_relaxed);
+        if (drops != reported_drops) {
+            batch += "[AsyncLogger] dropped " + std::to_string(drops - reported_drops) + " message(s): ring buffer full\n";
+            reported_drops = drops;
+        }
+        if (!batch.empty()) {
+            std::lock_guard<std::mutex> lock(direct_mutex_);
+            std::fwrite(batch.data(), 1, batch.size(), out_);
+            std::fflush(out_); // một lần flush cho cả batch
+        }
+        if (n == 0) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+}
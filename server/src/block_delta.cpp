@@ -0,0 +1,372 @@
+#include "block_delta.hpp"
+
+#include <openssl/evp.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace BlockDelta {
+
+namespace {
+    const char SIGNATURE_MAGIC[4] = {'F', 'S', 'I', 'G'};
+    const char DELTA_MAGIC[4] = {'F', 'D', 'L', 'T'};
+    const char OP_COPY = 'C';
+    const char OP_DATA = 'D';
+    const char OP_END = 'E';
+
+    constexpr std::size_t READ_CHUNK = 256 * 1024;
+    constexpr std::size_t LITERAL_FLUSH_BYTES = 64 * 1024; // Literal dài hơn được cắt thành nhiều op 'D'
+    constexpr std::size_t COPY_BUFFER = 64 * 1024;
+
+    void put_u32(std::ostream& out, std::uint32_t value) {
+        unsigned char bytes[4];
+        for (int i = 0; i < 4; ++i) bytes[i] = static_cast<unsigned char>(value >> (8 * i));
+        out.write(reinterpret_cast<const char*>(bytes), 4);
+    }
+
+    void put_u64(std::ostream& out, std::uint64_t value) {
+        unsigned char bytes[8];
+        for (int i = 0; i < 8; ++i) bytes[i] = static_cast<unsigned char>(value >> (8 * i));
+        out.write(reinterpret_cast<const char*>(bytes), 8);
+    }
+
+    bool get_u32(std::istream& in, std::uint32_t& value) {
+        unsigned char bytes[4];
+        if (!in.read(reinterpret_cast<char*>(bytes), 4)) return false;
+        value = 0;
+        for (int i = 0; i < 4; ++i) value |= static_cast<std::uint32_t>(bytes[i]) << (8 * i);
+        return true;
+    }
+
+    bool get_u64(std::istream& in, std::uint64_t& value) {
+        unsigned char bytes[8];
+        if (!in.read(reinterpret_cast<char*>(bytes), 8)) return false;
+        value = 0;
+        for (int i = 0; i < 8; ++i) value |= static_cast<std::uint64_t>(bytes[i]) << (8 * i);
+        return true;
+    }
+
+    bool expect_magic(std::istream& in, const char (&magic)[4]) {
+        char bytes[4];
+        return in.read(bytes, 4) && std::memcmp(bytes, magic, 4) == 0;
+    }
+
+    std::array<unsigned char, STRONG_HASH_BYTES> strong_hash(const unsigned char* data, std::size_t length) {
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        unsigned int digest_length = 0;
+        EVP_Digest(data, length, digest, &digest_length, EVP_sha256(), nullptr);
+        std::array<unsigned char, STRONG_HASH_BYTES> out{};
+        std::memcpy(out.data(), digest, STRONG_HASH_BYTES);
+        return out;
+    }
+
+    // a = sum(x_i), b = sum((L - i) * x_i), mod 2^16 (số học uint32 tràn vẫn đúng ở 16 bit thấp)
+    class RollingChecksum {
+    public:
+        void reset(const unsigned char* data, std::size_t length) {
+            a_ = b_ = 0;
+            length_ = static_cast<std::uint32_t>(length);
+            for (std::size_t i = 0; i < length; ++i) {
+                a_ += data[i];
+                b_ += static_cast<std::uint32_t>(length - i) * data[i];
+            }
+        }
+        // Trượt cửa sổ đi một byte: bỏ out ở đầu, thêm in ở cuối
+        void roll(unsigned char out, unsigned char in) {
+            a_ += static_cast<std::uint32_t>(in) - out;
+            b_ += a_ - length_ * out;
+        }
+        std::uint32_t value() const { return (a_ & 0xffff) | ((b_ & 0xffff) << 16); }
+
+    private:
+        std::uint32_t a_ = 0;
+        std::uint32_t b_ = 0;
+        std::uint32_t length_ = 0;
+    };
+
+    // Ghi op ra delta; các block copy liền nhau được gộp thành một op 'C'.
+    class DeltaWriter {
+    public:
+        DeltaWriter(std::ostream& out, DeltaStats& stats) : out_(out), stats_(stats) {}
+
+        void header(std::uint32_t block_size) {
+            write(DELTA_MAGIC, 4);
+            u32(block_size);
+        }
+
+        void literal(const unsigned char* data, std::size_t length) {
+            flush_copy();
+            stats_.literal_bytes += length;
+            while (length > 0) {
+                const std::size_t n = std::min(length, LITERAL_FLUSH_BYTES);
+                write(&OP_DATA, 1);
+                u32(static_cast<std::uint32_t>(n));
+                write(reinterpret_cast<const char*>(data), n);
+                data += n;
+                length -= n;
+            }
+        }
+
+        void copy(std::uint64_t block, std::size_t bytes) {
+            stats_.copied_bytes += bytes;
+            if (copy_count_ > 0 && copy_first_ + copy_count_ == block && copy_count_ < UINT32_MAX) {
+                ++copy_count_;
+                return;
+            }
+            flush_copy();
+            copy_first_ = block;
+            copy_count_ = 1;
+        }
+
+        // Block base mà một copy tiếp theo sẽ nối dài op 'C' đang chờ (UINT64_MAX nếu không có)
+        std::uint64_t next_block() const { return copy_count_ > 0 ? copy_first_ + copy_count_ : UINT64_MAX; }
+
+        void finish(std::uint64_t result_size) {
+            flush_copy();
+            write(&OP_END, 1);
+            u64(result_size);
+        }
+
+    private:
+        void flush_copy() {
+            if (copy_count_ == 0) return;
+            write(&OP_COPY, 1);
+            u64(copy_first_);
+            u32(copy_count_);
+            copy_count_ = 0;
+        }
+        void write(const char* data, std::size_t length) {
+            out_.write(data, static_cast<std::streamsize>(length));
+            stats_.delta_bytes += length;
+        }
+        void u32(std::uint32_t value) { put_u32(out_, value); stats_.delta_bytes += 4; }
+        void u64(std::uint64_t value) { put_u64(out_, value); stats_.delta_bytes += 8; }
+
+        std::ostream& out_;
+        DeltaStats& stats_;
+        std::uint64_t copy_first_ = 0;
+        std::uint32_t copy_count_ = 0;
+    };
+} // namespace
+
+std::uint32_t block_size_for(std::uint64_t file_size) {
+    const double root = std::sqrt(static_cast<double>(file_size));
+    std::uint64_t size = static_cast<std::uint64_t>(root);
+    size = (size + 1023) & ~static_cast<std::uint64_t>(1023); // Làm tròn lên bội 1 KiB
+    return static_cast<std::uint32_t>(std::clamp<std::uint64_t>(size, MIN_BLOCK_SIZE, MAX_BLOCK_SIZE));
+}
+
+std::uint32_t weak_checksum(const unsigned char* data, std::size_t length) {
+    RollingChecksum checksum;
+    checksum.reset(data, length);
+    return checksum.value();
+}
+
+bool compute_signature(std::istream& base, std::uint32_t block_size, Signature& out) {
+    out = Signature{};
+    out.block_size = block_size;
+    if (block_size == 0) return false;
+
+    std::vector<unsigned char> block(block_size);
+    for (;;) {
+        base.read(reinterpret_cast<char*>(block.data()), block_size);
+        const std::size_t got = static_cast<std::size_t>(base.gcount());
+        if (got > 0) {
+            BlockSignature entry;
+            entry.weak = weak_checksum(block.data(), got);
+            entry.strong = strong_hash(block.data(), got);
+            out.blocks.push_back(entry);
+            out.file_size += got;
+        }
+        if (got < block_size) break;
+    }
+    return !base.bad();
+}
+
+bool write_signature(const Signature& signature, std::ostream& out) {
+    out.write(SIGNATURE_MAGIC, 4);
+    put_u32(out, signature.block_size);
+    put_u64(out, signature.file_size);
+    for (const auto& block : signature.blocks) {
+        put_u32(out, block.weak);
+        out.write(reinterpret_cast<const char*>(block.strong.data()), STRONG_HASH_BYTES);
+    }
+    return out.good();
+}
+
+bool read_signature(std::istream& in, Signature& out) {
+    out = Signature{};
+    if (!expect_magic(in, SIGNATURE_MAGIC)) return false;
+    if (!get_u32(in, out.block_size) || !get_u64(in, out.file_size)) return false;
+    if (out.block_size == 0 || out.block_size > MAX_BLOCK_SIZE) return false;
+
+    const std::uint64_t count = out.file_size / out.block_size + (out.file_size % out.block_size != 0 ? 1 : 0);
+    if (count > MAX_SIGNATURE_BLOCKS) return false;
+    out.blocks.resize(static_cast<std::size_t>(count));
+    for (auto& block : out.blocks) {
+        if (!get_u32(in, block.weak)) return false;
+        if (!in.read(reinterpret_cast<char*>(block.strong.data()), STRONG_HASH_BYTES)) return false;
+    }
+    return true;
+}
+
+bool write_delta(const Signature& base_signature, std::istream& target, std::ostream& out, DeltaStats* stats) {
+    DeltaStats local_stats;
+    DeltaStats& st = stats ? *stats : local_stats;
+    st = DeltaStats{};
+    const std::size_t block_size = base_signature.block_size;
+    if (block_size == 0) return false;
+
+    // Chỉ block đầy đủ mới khớp giữa file; block cuối ngắn chỉ khớp ở cuối target
+    const std::uint64_t full_blocks = std::min<std::uint64_t>(base_signature.file_size / block_size, base_signature.blocks.size());
+    const std::size_t tail_size = static_cast<std::size_t>(base_signature.file_size % block_size);
+    std::unordered_multimap<std::uint32_t, std::uint64_t> by_weak;
+    by_weak.reserve(static_cast<std::size_t>(full_blocks));
+    for (std::uint64_t i = 0; i < full_blocks; ++i) by_weak.emplace(base_signature.blocks[i].weak, i);
+
+    DeltaWriter writer(out, st);
+    writer.header(base_signature.block_size);
+
+    // buf giữ [literal_start, cuối dữ liệu đã đọc); pos là đầu cửa sổ hiện tại
+    std::vector<unsigned char> buf;
+    std::size_t pos = 0;
+    std::size_t literal_start = 0;
+    std::uint64_t total = 0;
+    bool eof = false;
+    auto fill = [&](std::size_t need) {
+        while (!eof && buf.size() - pos < need) {
+            if (literal_start > READ_CHUNK) { // Bỏ phần đã ghi ra delta
+                buf.erase(buf.begin(), buf.begin() + static_cast<std::ptrdiff_t>(literal_start));
+                pos -= literal_start;
+                literal_start = 0;
+            }
+            const std::size_t old_size = buf.size();
+            buf.resize(old_size + READ_CHUNK);
+            target.read(reinterpret_cast<char*>(buf.data() + old_size), READ_CHUNK);
+            const std::size_t got = static_cast<std::size_t>(target.gcount());
+            buf.resize(old_size + got);
+            total += got;
+            if (got < READ_CHUNK) {
+                if (target.bad()) return false;
+                eof = true;
+            }
+        }
+        return true;
+    };
+    auto strong_matches = [&](std::uint64_t block, const std::array<unsigned char, STRONG_HASH_BYTES>& strong) {
+        return base_signature.blocks[static_cast<std::size_t>(block)].strong == strong;
+    };
+
+    RollingChecksum rolling;
+    bool have_weak = false;
+    for (;;) {
+        if (!fill(block_size)) return false;
+        if (buf.size() - pos < block_size) break;
+        if (!have_weak) {
+            rolling.reset(&buf[pos], block_size);
+            have_weak = true;
+        }
+
+        const std::uint32_t weak = rolling.value();
+        std::uint64_t match = UINT64_MAX;
+        auto range = by_weak.equal_range(weak);
+        if (range.first != range.second) {
+            const auto strong = strong_hash(&buf[pos], block_size);
+            // Ưu tiên block nối tiếp op copy đang chờ (vùng lặp lại như block toàn số 0)
+            const std::uint64_t next = writer.next_block();
+            if (next < full_blocks && base_signature.blocks[static_cast<std::size_t>(next)].weak == weak && strong_matches(next, strong)) {
+                match = next;
+            } else {
+                for (auto it = range.first; it != range.second; ++it) {
+                    if (strong_matches(it->second, strong)) { match = it->second; break; }
+                }
+            }
+        }
+
+        if (match != UINT64_MAX) {
+            if (pos > literal_start) writer.literal(&buf[literal_start], pos - literal_start);
+            writer.copy(match, block_size);
+            pos += block_size;
+            literal_start = pos;
+            have_weak = false;
+            continue;
+        }
+
+        // Không khớp: byte đầu cửa sổ thành literal, trượt đi một byte
+        if (!fill(block_size + 1)) return false;
+        if (buf.size() - pos > block_size) rolling.roll(buf[pos], buf[pos + block_size]);
+        else have_weak = false;
+        ++pos;
+        if (pos - literal_start >= LITERAL_FLUSH_BYTES) {
+            writer.literal(&buf[literal_start], pos - literal_start);
+            literal_start = pos;
+        }
+    }
+
+    const std::size_t rest = buf.size() - pos;
+    if (rest > 0 && rest == tail_size && base_signature.blocks.size() > full_blocks
+        && base_signature.blocks[static_cast<std::size_t>(full_blocks)].weak == weak_checksum(&buf[pos], rest)
+        && strong_matches(full_blocks, strong_hash(&buf[pos], rest))) {
+        if (pos > literal_start) writer.literal(&buf[literal_start], pos - literal_start);
+        writer.copy(full_blocks, rest);
+        pos += rest;
+        literal_start = pos;
+    }
+    if (buf.size() > literal_start) writer.literal(&buf[literal_start], buf.size() - literal_start);
+    writer.finish(total);
+    return out.good();
+}
+
+bool apply_delta(std::istream& base, std::istream& delta, std::ostream& out, std::uint64_t* result_size) {
+    std::uint32_t block_size = 0;
+    if (!expect_magic(delta, DELTA_MAGIC) || !get_u32(delta, block_size) || block_size == 0) return false;
+
+    base.clear();
+    base.seekg(0, std::ios::end);
+    const std::streamoff end = base.tellg();
+    if (end < 0) return false;
+    const std::uint64_t base_size = static_cast<std::uint64_t>(end);
+
+    std::vector<char> buffer(COPY_BUFFER);
+    auto copy_bytes = [&](std::istream& from, std::uint64_t length) {
+        while (length > 0) {
+            const std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(length, buffer.size()));
+            if (!from.read(buffer.data(), static_cast<std::streamsize>(n))) return false;
+            out.write(buffer.data(), static_cast<std::streamsize>(n));
+            length -= n;
+        }
+        return out.good();
+    };
+
+    std::uint64_t written = 0;
+    for (;;) {
+        char op = 0;
+        if (!delta.get(op)) return false;
+        if (op == OP_COPY) {
+            std::uint64_t first = 0;
+            std::uint32_t count = 0;
+            if (!get_u64(delta, first) || !get_u32(delta, count) || count == 0) return false;
+            if (first >= (base_size + block_size - 1) / block_size) return false; // Ngoài base
+            const std::uint64_t start = first * block_size;
+            const std::uint64_t stop = std::min(base_size, start + static_cast<std::uint64_t>(count) * block_size);
+            base.clear();
+            base.seekg(static_cast<std::streamoff>(start));
+            if (!copy_bytes(base, stop - start)) return false;
+            written += stop - start;
+        } else if (op == OP_DATA) {
+            std::uint32_t length = 0;
+            if (!get_u32(delta, length) || !copy_bytes(delta, length)) return false;
+            written += length;
+        } else if (op == OP_END) {
+            std::uint64_t expected = 0;
+            if (!get_u64(delta, expected) || expected != written) return false;
+            if (result_size) *result_size = written;
+            return out.good();
+        } else {
+            return false;
+        }
+    }
+}
+
+} // namespace BlockDelta
@@ -0,0 +1,96 @@
+#include "bounded_executor.hpp"
+
+BoundedExecutor::BoundedExecutor(std::string name, std::size_t workers, std::size_t queue_limit)
+    : name_(std::move(name)), queue_limit_(queue_limit) {
+    if (workers == 0) workers = 1;
+    idle_ = workers; // Trước khi thread nào chạy: job gửi ngay sau constructor không bị từ chối
+    workers_.reserve(workers);
+    for (std::size_t i = 0; i < workers; ++i) {
+        workers_.emplace_back([this]() { worker_loop(); });
+    }
+}
+
+BoundedExecutor::~BoundedExecutor() {
+    shutdown();
+}
+
+bool BoundedExecutor::enqueue(std::function<void()> fn) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Job chưa được worker nào nhận vẫn nằm trong queue_, nên mỗi worker rảnh chỉ bù được một chỗ
+        if (stopping_ || queue_.size() >= queue_limit_ + idle_) {
+            rejected_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        queue_.push_back(Item{std::move(fn), std::chrono::steady_clock::now()});
+    }
+    submitted_.fetch_add(1, std::memory_order_relaxed);
+    cv_.notify_one();
+    return true;
+}
+
+void BoundedExecutor::worker_loop() {
+    bool busy = false;
+    for (;;) {
+        Item item;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (busy) ++idle_; // Xong job trước: lại rảnh
+            busy = false;
+            cv_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) return; // stopping_ và đã hết việc
+            item = std::move(queue_.front());
+            queue_.pop_front();
+            --idle_;
+            busy = true;
+        }
+        active_.fetch_add(1, std::memory_order_relaxed);
+        auto started = std::chrono::steady_clock::now();
+        std::uint64_t wait_us = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(started - item.enqueued_at).count());
+
+        item.fn(); // packaged_task giữ exception trong future, không ném ra đây
+
+        std::uint64_t run_us = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count());
+        total_wait_us_.fetch_add(wait_us, std::memory_order_relaxed);
+        total_run_us_.fetch_add(run_us, std::memory_order_relaxed);
+        std::uint64_t prev_max = max_wait_us_.load(std::memory_order_relaxed);
+        while (wait_us > prev_max && !max_wait_us_.compare_exchange_weak(prev_max, wait_us, std::memory_order_relaxed)) {}
+        active_.fetch_sub(1, std::memory_order_relaxed);
+        completed_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void BoundedExecutor::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_ && workers_.empty()) return;
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : workers_) {
+        if (t.joinable()) t.join();
+    }
+    workers_.clear();
+}
+
+BoundedExecutor::Stats BoundedExecutor::stats() const {
+    Stats s{};
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        s.queue_depth = queue_.size();
+        s.workers = workers_.size();
+    }
+    s.queue_limit = queue_limit_;
+    s.active = active_.load(std::memory_order_relaxed);
+    s.submitted = submitted_.load(std::memory_order_relaxed);
+    s.completed = completed_.load(std::memory_order_relaxed);
+    s.rejected = rejected_.load(std::memory_order_relaxed);
+    if (s.completed > 0) {
+        s.avg_wait_ms = total_wait_us_.load(std::memory_order_relaxed) / 1000.0 / s.completed;
+        s.avg_run_ms = total_run_us_.load(std::memory_order_relaxed) / 1000.0 / s.completed;
+    }
+    s.max_wait_ms = max_wait_us_.load(std::memory_order_relaxed) / 1000.0;
+    return s;
+}
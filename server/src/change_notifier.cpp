@@ -0,0 +1,125 @@
+#include "change_notifier.hpp"
+#include "async_logger.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+ChangeNotifier::ChangeNotifier() : wheel_(0), epoch_(std::chrono::steady_clock::now()) {}
+
+ChangeNotifier::~ChangeNotifier() {
+    stop_sweeper();
+}
+
+TimingWheel::Tick ChangeNotifier::now_tick() const {
+    return static_cast<TimingWheel::Tick>(
+        std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - epoch_).count());
+}
+
+ChangeNotifier::Id ChangeNotifier::subscribe(const std::string& root, std::chrono::seconds timeout, Callback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const Id id = next_id_++;
+    subscriptions_.emplace(id, Subscription{root, std::move(callback)});
+    by_root_.emplace(root, id);
+    // Tick hiện tại có thể đã trôi gần hết: +1 để không fire sớm hơn timeout
+    const auto seconds = static_cast<TimingWheel::Tick>(std::max<std::chrono::seconds::rep>(timeout.count(), 0));
+    wheel_.schedule(std::to_string(id), now_tick() + seconds + 1);
+    return id;
+}
+
+bool ChangeNotifier::unsubscribe(Id id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = subscriptions_.find(id);
+    if (it == subscriptions_.end()) return false;
+    auto range = by_root_.equal_range(it->second.root);
+    for (auto r = range.first; r != range.second; ++r) {
+        if (r->second == id) { by_root_.erase(r); break; }
+    }
+    subscriptions_.erase(it);
+    return true; // Entry trong wheel_ được bỏ qua khi tới hạn
+}
+
+void ChangeNotifier::notify(const std::string& changed_dir) {
+    std::vector<Callback> fired;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (by_root_.empty()) return;
+        // changed_dir và mọi thư mục cha của nó
+        std::string dir = changed_dir;
+        while (!dir.empty()) {
+            auto range = by_root_.equal_range(dir);
+            for (auto r = range.first; r != range.second; ++r) {
+                auto it = subscriptions_.find(r->second);
+                if (it == subscriptions_.end()) continue;
+                fired.push_back(std::move(it->second.callback));
+                subscriptions_.erase(it);
+            }
+            by_root_.erase(range.first, range.second);
+
+            const std::size_t slash = dir.find_last_of('/');
+            if (slash == std::string::npos || dir == "/") break;
+            dir.erase(slash == 0 ? 1 : slash);
+        }
+    }
+    for (auto& callback : fired) callback(true);
+}
+
+std::size_t ChangeNotifier::waiting() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return subscriptions_.size();
+}
+
+std::size_t ChangeNotifier::sweep() {
+    std::vector<Callback> expired;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wheel_.advance(now_tick(), [this, &expired](const std::string& key) {
+            auto it = subscriptions_.find(std::stoull(key));
+            if (it == subscriptions_.end()) return; // Đã fire hoặc đã huỷ
+            auto range = by_root_.equal_range(it->second.root);
+            for (auto r = range.first; r != range.second; ++r) {
+                if (r->second == it->first) { by_root_.erase(r); break; }
+            }
+            expired.push_back(std::move(it->second.callback));
+            subscriptions_.erase(it);
+        });
+    }
+    for (auto& callback : expired) callback(false);
+    return expired.size();
+}
+
+void ChangeNotifier::start_sweeper() {
+    std::lock_guard<std::mutex> lock(sweeper_mutex_);
+    if (sweeper_.joinable()) return;
+    stop_requested_ = false;
+    sweeper_ = std::thread([this]() {
+        std::unique_lock<std::mutex> lk(sweeper_mutex_);
+        while (!stop_requested_) {
+            sweeper_cv_.wait_for(lk, std::chrono::seconds(1), [this]() { return stop_requested_; });
+            if (stop_requested_) break;
+            lk.unlock();
+            sweep();
+            lk.lock();
+        }
+    });
+}
+
+void ChangeNotifier::stop_sweeper() {
+    {
+        std::lock_guard<std::mutex> lock(sweeper_mutex_);
+        stop_requested_ = true;
+    }
+    sweeper_cv_.notify_all();
+    if (sweeper_.joinable()) sweeper_.join();
+
+    // Không còn ai fire theo timeout: trả lời ngay các watcher còn chờ
+    std::vector<Callback> remaining;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& kv : subscriptions_) remaining.push_back(std::move(kv.second.callback));
+        subscriptions_.clear();
+        by_root_.clear();
+    }
+    if (!remaining.empty()) LOG_INFO("[ChangeNotifier] Releasing " << remaining.size() << " waiting watcher(s).");
+    for (auto& callback : remaining) callback(false);
+}
@@ -0,0 +1,557 @@
+#include "chunk_store.hpp"
+#include "async_logger.hpp"
+#include "fastcdc.hpp"
+
+#include <openssl/evp.h>
+#include <sqlite3.h>
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_set>
+
+namespace {
+    using Statement = std::unique_ptr<sqlite3_stmt, decltype(&sqlite3_finalize)>;
+
+    Statement prepare(Database& db, const char* sql) {
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(db.get_db_handle(), sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            LOG_ERROR("[ChunkStore] Failed to prepare statement: " << sqlite3_errmsg(db.get_db_handle()));
+            sqlite3_finalize(stmt);
+            stmt = nullptr;
+        }
+        return Statement(stmt, sqlite3_finalize);
+    }
+
+    std::int64_t unix_now() {
+        return static_cast<std::int64_t>(std::time(nullptr));
+    }
+
+    // [prefix/, prefix0): mọi path nằm dưới prefix ('0' là ký tự ngay sau '/'), như trong tree_hash.cpp
+    std::string subtree_condition(const char* column, const std::string& path) {
+        std::string lower = path + "/";
+        std::string upper = path + "0";
+        char* sql = sqlite3_mprintf("(%s = %Q OR (%s >= %Q AND %s < %Q))", column, path.c_str(),
+                                    column, lower.c_str(), column, upper.c_str());
+        std::string condition = sql ? sql : "0";
+        sqlite3_free(sql);
+        return condition;
+    }
+
+    // Cột chunks của file_recipes: mỗi chunk là 32 byte hash + u32 size (little-endian)
+    constexpr std::size_t RECIPE_ENTRY_BYTES = FastCdc::HASH_BYTES + 4;
+
+    int hex_value(char c) {
+        return c <= '9' ? c - '0' : c - 'a' + 10;
+    }
+
+    std::string encode_chunks(const std::vector<ChunkRef>& chunks) {
+        std::string blob;
+        blob.reserve(chunks.size() * RECIPE_ENTRY_BYTES);
+        for (const auto& chunk : chunks) {
+            for (std::size_t i = 0; i < FastCdc::HASH_BYTES; ++i) {
+                blob.push_back(static_cast<char>(hex_value(chunk.hash[2 * i]) << 4 | hex_value(chunk.hash[2 * i + 1])));
+            }
+            for (int i = 0; i < 4; ++i) blob.push_back(static_cast<char>(chunk.size >> (8 * i)));
+        }
+        return blob;
+    }
+
+    bool decode_chunks(const unsigned char* blob, std::size_t length, std::vector<ChunkRef>& chunks) {
+        static const char digits[] = "0123456789abcdef";
+        if (length % RECIPE_ENTRY_BYTES != 0) return false;
+        chunks.resize(length / RECIPE_ENTRY_BYTES);
+        for (auto& chunk : chunks) {
+            chunk.hash.assign(2 * FastCdc::HASH_BYTES, '0');
+            for (std::size_t i = 0; i < FastCdc::HASH_BYTES; ++i) {
+                chunk.hash[2 * i] = digits[blob[i] >> 4];
+                chunk.hash[2 * i + 1] = digits[blob[i] & 0x0f];
+            }
+            chunk.size = 0;
+            for (int i = 0; i < 4; ++i) chunk.size |= static_cast<std::uint32_t>(blob[FastCdc::HASH_BYTES + i]) << (8 * i);
+            blob += RECIPE_ENTRY_BYTES;
+        }
+        return true;
+    }
+
+    // Đọc nối tiếp các file chunk; giữ một chunk trong bộ nhớ. Seek tìm chunk theo offset tích luỹ.
+    class ChunkStreamBuf : public std::streambuf {
+    public:
+        ChunkStreamBuf(std::vector<fs::path> paths, std::vector<std::uint64_t> offsets)
+            : paths_(std::move(paths)), offsets_(std::move(offsets)) {}
+
+    protected:
+        int_type underflow() override {
+            if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+            const std::size_t next = loaded_ ? index_ + 1 : 0;
+            if (next >= paths_.size()) return traits_type::eof();
+            load(next);
+            setg(buffer_.data(), buffer_.data(), buffer_.data() + buffer_.size());
+            return traits_type::to_int_type(*gptr());
+        }
+
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+            const std::int64_t current = loaded_ ? static_cast<std::int64_t>(offsets_[index_]) + (gptr() - eback()) : 0;
+            std::int64_t target = off;
+            if (dir == std::ios_base::cur) target += current;
+            else if (dir == std::ios_base::end) target += static_cast<std::int64_t>(offsets_.back());
+            return seekpos(pos_type(static_cast<off_type>(target)), which);
+        }
+
+        pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+            const std::int64_t target = static_cast<std::int64_t>(pos);
+            if (!(which & std::ios_base::in) || target < 0 || static_cast<std::uint64_t>(target) > offsets_.back()) {
+                return pos_type(off_type(-1));
+            }
+            if (paths_.empty()) return pos; // File rỗng
+            std::size_t index = static_cast<std::size_t>(
+                std::upper_bound(offsets_.begin(), offsets_.end(), static_cast<std::uint64_t>(target)) - offsets_.begin()) - 1;
+            index = std::min(index, paths_.size() - 1); // target == cuối file: cuối chunk cuối
+            if (!loaded_ || index != index_) load(index);
+            setg(buffer_.data(), buffer_.data() + (target - static_cast<std::int64_t>(offsets_[index])),
+                 buffer_.data() + buffer_.size());
+            return pos;
+        }
+
+    private:
+        // Ném lỗi: istream bắt và đặt badbit
+        void load(std::size_t index) {
+            const std::size_t size = static_cast<std::size_t>(offsets_[index + 1] - offsets_[index]);
+            buffer_.resize(size);
+            std::ifstream in(paths_[index], std::ios::binary);
+            if (!in.read(buffer_.data(), static_cast<std::streamsize>(size))) {
+                throw std::runtime_error("chunk missing or truncated: " + paths_[index].string());
+            }
+            index_ = index;
+            loaded_ = true;
+        }
+
+        std::vector<fs::path> paths_;
+        std::vector<std::uint64_t> offsets_; // offsets_[i] = vị trí đầu chunk i; phần tử cuối = kích thước file
+        std::vector<char> buffer_;
+        std::size_t index_ = 0;
+        bool loaded_ = false;
+    };
+
+    class ChunkInputStream : public std::istream {
+    public:
+        ChunkInputStream(std::vector<fs::path> paths, std::vector<std::uint64_t> offsets)
+            : std::istream(nullptr), buf_(std::move(paths), std::move(offsets)) {
+            rdbuf(&buf_);
+        }
+
+    private:
+        ChunkStreamBuf buf_;
+    };
+}
+
+ChunkStore::ChunkStore(Database& db, const fs::path& root) : db_(db), root_(root) {
+    db_.execute_query("SELECT COUNT(*), COALESCE(SUM(size), 0) FROM chunks;", [this](sqlite3_stmt* stmt) {
+        stats_.chunks = static_cast<std::uint64_t>(sqlite3_column_int64(stmt, 0));
+        stats_.stored_bytes = static_cast<std::uint64_t>(sqlite3_column_int64(stmt, 1));
+    });
+    db_.execute_query("SELECT COALESCE(SUM(size), 0) FROM file_recipes;", [this](sqlite3_stmt* stmt) {
+        stats_.logical_bytes = static_cast<std::uint64_t>(sqlite3_column_int64(stmt, 0));
+    });
+}
+
+ChunkStore::~ChunkStore() {
+    stop_gc();
+}
+
+fs::path ChunkStore::chunk_path(const std::string& hash) const {
+    return root_ / hash.substr(0, 2) / hash.substr(2, 2) / hash;
+}
+
+bool ChunkStore::put_chunk(const std::string& hash, const unsigned char* data, std::size_t length, int user_id) {
+    if (!FastCdc::is_chunk_hash(hash) || length > FastCdc::MAX_SIZE || FastCdc::chunk_hash(data, length) != hash) {
+        return false;
+    }
+    return store_chunk(hash, data, length, user_id);
+}
+
+bool ChunkStore::store_chunk(const std::string& hash, const unsigned char* data, std::size_t length, int user_id) {
+    {
+        std::scoped_lock lock(db_.write_mutex(), mutex_);
+        if (insert_locked(hash, length, fs::path(), user_id)) return true; // Đã có
+    }
+    // Ghi file tạm ngoài lock; chỉ rename vào chỗ khi giữ lock (chunk chưa có dòng thì GC không đụng tới)
+    fs::path temp_path;
+    if (!write_temp(data, length, temp_path)) return false;
+    std::scoped_lock lock(db_.write_mutex(), mutex_);
+    return insert_locked(hash, length, temp_path, user_id);
+}
+
+bool ChunkStore::write_temp(const unsigned char* data, std::size_t length, fs::path& temp_path) {
+    static std::atomic<unsigned long> temp_counter{0};
+    const fs::path temp_dir = root_ / "tmp";
+    std::error_code ec;
+    fs::create_directories(temp_dir, ec);
+    temp_path = temp_dir / ("chunk-" + std::to_string(++temp_counter) + ".tmp");
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(length));
+    out.close();
+    if (!out) {
+        LOG_ERROR("[ChunkStore] Failed to write " << temp_path);
+        fs::remove(temp_path, ec);
+        return false;
+    }
+    return true;
+}
+
+bool ChunkStore::insert_locked(const std::string& hash, std::size_t length, const fs::path& temp_path, int user_id) {
+    const std::int64_t now = unix_now();
+    std::error_code ec;
+    Statement touch = prepare(db_, "UPDATE chunks SET last_used = ? WHERE hash = ?;");
+    if (!touch) return false;
+    sqlite3_bind_int64(touch.get(), 1, now);
+    sqlite3_bind_text(touch.get(), 2, hash.c_str(), -1, SQLITE_STATIC);
+    if (sqlite3_step(touch.get()) != SQLITE_DONE) return false;
+
+    if (sqlite3_changes(db_.get_db_handle()) > 0) {
+        if (!temp_path.empty()) fs::remove(temp_path, ec); // Trùng: chunk đã có
+    } else {
+        if (temp_path.empty()) return false;
+        const fs::path target = chunk_path(hash);
+        fs::create_directories(target.parent_path(), ec);
+        fs::rename(temp_path, target, ec);
+        if (ec) {
+            LOG_ERROR("[ChunkStore] Failed to store chunk " << hash << ": " << ec.message());
+            fs::remove(temp_path, ec);
+            return false;
+        }
+        Statement insert = prepare(db_, "INSERT INTO chunks (hash, size, refcount, last_used) VALUES (?, ?, 0, ?);");
+        if (!insert) return false;
+        sqlite3_bind_text(insert.get(), 1, hash.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(insert.get(), 2, static_cast<sqlite3_int64>(length));
+        sqlite3_bind_int64(insert.get(), 3, now);
+        if (sqlite3_step(insert.get()) != SQLITE_DONE) {
+            LOG_ERROR("[ChunkStore] Failed to record chunk " << hash << ": " << sqlite3_errmsg(db_.get_db_handle()));
+            fs::remove(target, ec);
+            return false;
+        }
+        ++stats_.chunks;
+        stats_.stored_bytes += length;
+    }
+
+    if (user_id != -1) {
+        Statement owner = prepare(db_, "INSERT OR IGNORE INTO chunk_owners (hash, user_id) VALUES (?, ?);");
+        if (!owner) return false;
+        sqlite3_bind_text(owner.get(), 1, hash.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(owner.get(), 2, user_id);
+        if (sqlite3_step(owner.get()) != SQLITE_DONE) return false;
+    }
+    return true;
+}
+
+std::vector<std::string> ChunkStore::missing_chunks(const std::vector<std::string>& hashes, int user_id) {
+    std::vector<std::string> missing;
+    std::unordered_set<std::string> seen;
+    std::scoped_lock lock(db_.write_mutex(), mutex_);
+    const std::int64_t now = unix_now();
+    Statement lookup = prepare(db_,
+        "SELECT EXISTS(SELECT 1 FROM chunk_owners o WHERE o.hash = c.hash AND o.user_id = ?) FROM chunks c WHERE c.hash = ?;");
+    Statement touch = prepare(db_, "UPDATE chunks SET last_used = ? WHERE hash = ?;");
+    if (!lookup || !touch) return hashes;
+
+    db_.savepoint("chunk_store"); // Gom các UPDATE last_used
+    for (const auto& hash : hashes) {
+        if (!seen.insert(hash).second) continue;
+        bool present = false;
+        if (FastCdc::is_chunk_hash(hash)) {
+            sqlite3_bind_int(lookup.get(), 1, user_id);
+            sqlite3_bind_text(lookup.get(), 2, hash.c_str(), -1, SQLITE_TRANSIENT);
+            if (sqlite3_step(lookup.get()) == SQLITE_ROW) {
+                present = user_id == -1 || sqlite3_column_int(lookup.get(), 0) != 0;
+            }
+            sqlite3_reset(lookup.get());
+        }
+        if (!present) {
+            missing.push_back(hash);
+            continue;
+        }
+        sqlite3_bind_int64(touch.get(), 1, now);
+        sqlite3_bind_text(touch.get(), 2, hash.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_step(touch.get());
+        sqlite3_reset(touch.get());
+    }
+    if (!db_.release("chunk_store")) db_.rollback_to("chunk_store");
+    return missing;
+}
+
+bool ChunkStore::ingest(std::istream& in, ChunkRecipe& recipe, int user_id) {
+    std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx(EVP_MD_CTX_new(), EVP_MD_CTX_free);
+    EVP_DigestInit_ex(ctx.get(), EVP_sha256(), nullptr);
+    recipe = ChunkRecipe{};
+    const bool ok = FastCdc::split(in, [&](const unsigned char* data, std::size_t length) {
+        EVP_DigestUpdate(ctx.get(), data, length);
+        std::string hash = FastCdc::chunk_hash(data, length);
+        if (!store_chunk(hash, data, length, user_id)) return false;
+        recipe.chunks.push_back(ChunkRef{std::move(hash), static_cast<std::uint32_t>(length)});
+        recipe.size += length;
+        return true;
+    });
+    if (!ok) return false;
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    EVP_DigestFinal_ex(ctx.get(), digest, &length);
+    static const char digits[] = "0123456789abcdef";
+    recipe.checksum.assign(2 * length, '0');
+    for (unsigned int i = 0; i < length; ++i) {
+        recipe.checksum[2 * i] = digits[digest[i] >> 4];
+        recipe.checksum[2 * i + 1] = digits[digest[i] & 0x0f];
+    }
+    return true;
+}
+
+bool ChunkStore::complete_recipe(ChunkRecipe& recipe, int user_id) {
+    std::scoped_lock lock(db_.write_mutex(), mutex_);
+    Statement lookup = prepare(db_,
+        "SELECT c.size, EXISTS(SELECT 1 FROM chunk_owners o WHERE o.hash = c.hash AND o.user_id = ?) FROM chunks c WHERE c.hash = ?;");
+    if (!lookup) return false;
+    recipe.size = 0;
+    for (auto& chunk : recipe.chunks) {
+        if (!FastCdc::is_chunk_hash(chunk.hash)) return false;
+        sqlite3_bind_int(lookup.get(), 1, user_id);
+        sqlite3_bind_text(lookup.get(), 2, chunk.hash.c_str(), -1, SQLITE_TRANSIENT);
+        const bool found = sqlite3_step(lookup.get()) == SQLITE_ROW &&
+                           (user_id == -1 || sqlite3_column_int(lookup.get(), 1) != 0);
+        if (found) chunk.size = static_cast<std::uint32_t>(sqlite3_column_int64(lookup.get(), 0));
+        sqlite3_reset(lookup.get());
+        if (!found) return false;
+        recipe.size += chunk.size;
+    }
+    return true;
+}
+
+std::optional<ChunkRecipe> ChunkStore::recipe(const std::string& file_path) {
+    std::scoped_lock lock(db_.write_mutex(), mutex_);
+    return recipe_locked(file_path);
+}
+
+std::optional<ChunkRecipe> ChunkStore::recipe_locked(const std::string& file_path) {
+    Statement select = prepare(db_, "SELECT checksum, size, chunks FROM file_recipes WHERE file_path = ?;");
+    if (!select) return std::nullopt;
+    sqlite3_bind_text(select.get(), 1, file_path.c_str(), -1, SQLITE_STATIC);
+    if (sqlite3_step(select.get()) != SQLITE_ROW) return std::nullopt;
+
+    ChunkRecipe recipe;
+    const unsigned char* checksum = sqlite3_column_text(select.get(), 0);
+    recipe.checksum = checksum ? reinterpret_cast<const char*>(checksum) : "";
+    recipe.size = static_cast<std::uint64_t>(sqlite3_column_int64(select.get(), 1));
+    const auto* blob = static_cast<const unsigned char*>(sqlite3_column_blob(select.get(), 2));
+    const int blob_size = sqlite3_column_bytes(select.get(), 2);
+    if (blob_size > 0 && !decode_chunks(blob, static_cast<std::size_t>(blob_size), recipe.chunks)) {
+        LOG_ERROR("[ChunkStore] Corrupt recipe for " << file_path);
+        return std::nullopt;
+    }
+    return recipe;
+}
+
+bool ChunkStore::adjust_refcounts_locked(const std::vector<ChunkRef>& chunks, int delta, std::int64_t now) {
+    if (chunks.empty()) return true;
+    Statement update = prepare(db_, "UPDATE chunks SET refcount = refcount + ?, last_used = ? WHERE hash = ?;");
+    if (!update) return false;
+    for (const auto& chunk : chunks) {
+        sqlite3_bind_int(update.get(), 1, delta);
+        sqlite3_bind_int64(update.get(), 2, now);
+        sqlite3_bind_text(update.get(), 3, chunk.hash.c_str(), -1, SQLITE_TRANSIENT);
+        const bool ok = sqlite3_step(update.get()) == SQLITE_DONE;
+        sqlite3_reset(update.get());
+        if (!ok) return false;
+    }
+    return true;
+}
+
+bool ChunkStore::put_recipe(const std::string& file_path, const ChunkRecipe& recipe) {
+    std::scoped_lock lock(db_.write_mutex(), mutex_);
+    const std::int64_t now = unix_now();
+
+    // Kiểm tra trước khi đổi gì; GC cũng giữ mutex_ nên chunk không biến mất giữa chừng
+    Statement exists = prepare(db_, "SELECT 1 FROM chunks WHERE hash = ?;");
+    if (!exists) return false;
+    std::unordered_set<std::string> checked;
+    for (const auto& chunk : recipe.chunks) {
+        if (!checked.insert(chunk.hash).second) continue;
+        sqlite3_bind_text(exists.get(), 1, chunk.hash.c_str(), -1, SQLITE_TRANSIENT);
+        const bool found = sqlite3_step(exists.get()) == SQLITE_ROW;
+        sqlite3_reset(exists.get());
+        if (!found) {
+            LOG_WARN("[ChunkStore] Recipe for " << file_path << " references missing chunk " << chunk.hash);
+            return false;
+        }
+    }
+
+    if (!db_.savepoint("chunk_store")) return false;
+    const std::optional<ChunkRecipe> old = recipe_locked(file_path);
+    bool ok = (!old || adjust_refcounts_locked(old->chunks, -1, now)) && adjust_refcounts_locked(recipe.chunks, 1, now);
+    if (ok) {
+        Statement upsert = prepare(db_, "INSERT OR REPLACE INTO file_recipes (file_path, checksum, size, chunks) VALUES (?, ?, ?, ?);");
+        const std::string blob = encode_chunks(recipe.chunks);
+        ok = static_cast<bool>(upsert);
+        if (ok) {
+            sqlite3_bind_text(upsert.get(), 1, file_path.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(upsert.get(), 2, recipe.checksum.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_int64(upsert.get(), 3, static_cast<sqlite3_int64>(recipe.size));
+            sqlite3_bind_blob(upsert.get(), 4, blob.data(), static_cast<int>(blob.size()), SQLITE_STATIC);
+            ok = sqlite3_step(upsert.get()) == SQLITE_DONE;
+        }
+    }
+    if (!ok || !db_.release("chunk_store")) {
+        LOG_ERROR("[ChunkStore] Failed to store recipe for " << file_path << ": " << sqlite3_errmsg(db_.get_db_handle()));
+        db_.rollback_to("chunk_store");
+        return false;
+    }
+    stats_.logical_bytes += recipe.size;
+    if (old) stats_.logical_bytes -= std::min(stats_.logical_bytes, old->size);
+    return true;
+}
+
+bool ChunkStore::remove_recipes_locked(const std::string& path, std::int64_t now, std::uint64_t& removed_bytes) {
+    const std::string condition = subtree_condition("file_path", path);
+    std::vector<std::pair<std::uint64_t, std::vector<ChunkRef>>> removed;
+    bool decoded = true;
+    db_.execute_query("SELECT size, chunks FROM file_recipes WHERE " + condition + ";", [&](sqlite3_stmt* stmt) {
+        std::vector<ChunkRef> chunks;
+        const auto* blob = static_cast<const unsigned char*>(sqlite3_column_blob(stmt, 1));
+        const int blob_size = sqlite3_column_bytes(stmt, 1);
+        if (blob_size > 0) decoded &= decode_chunks(blob, static_cast<std::size_t>(blob_size), chunks);
+        removed.emplace_back(static_cast<std::uint64_t>(sqlite3_column_int64(stmt, 0)), std::move(chunks));
+    });
+    removed_bytes = 0;
+    if (removed.empty()) return true;
+    if (!decoded) LOG_ERROR("[ChunkStore] Corrupt recipe under " << path << "; its chunks keep their references.");
+
+    for (const auto& entry : removed) {
+        if (!adjust_refcounts_locked(entry.second, -1, now)) return false;
+        removed_bytes += entry.first;
+    }
+    return db_.execute("DELETE FROM file_recipes WHERE " + condition + ";");
+}
+
+bool ChunkStore::has_recipes_locked(const std::string& path) {
+    return db_.execute_scalar("SELECT 1 FROM file_recipes WHERE " + subtree_condition("file_path", path) + " LIMIT 1;").has_value();
+}
+
+void ChunkStore::remove_recipes(const std::string& path) {
+    std::scoped_lock lock(db_.write_mutex(), mutex_);
+    if (!has_recipes_locked(path)) return; // Plain mode: không mở transaction cho mỗi lần ghi / xoá
+    if (!db_.savepoint("chunk_store")) return;
+    std::uint64_t removed_bytes = 0;
+    if (!remove_recipes_locked(path, unix_now(), removed_bytes) || !db_.release("chunk_store")) {
+        LOG_ERROR("[ChunkStore] Failed to remove recipes under " << path);
+        db_.rollback_to("chunk_store");
+        return;
+    }
+    stats_.logical_bytes -= std::min(stats_.logical_bytes, removed_bytes);
+}
+
+void ChunkStore::move_recipes(const std::string& old_path, const std::string& new_path) {
+    std::scoped_lock lock(db_.write_mutex(), mutex_);
+    if (!has_recipes_locked(old_path) && !has_recipes_locked(new_path)) return;
+    if (!db_.savepoint("chunk_store")) return;
+    // Đích bị ghi đè: recipe cũ ở đó (nếu có) không còn đúng
+    std::uint64_t removed_bytes = 0;
+    bool ok = remove_recipes_locked(new_path, unix_now(), removed_bytes);
+    if (ok) {
+        char* sql = sqlite3_mprintf("UPDATE file_recipes SET file_path = %Q || substr(file_path, %d) WHERE %s;",
+                                    new_path.c_str(), static_cast<int>(old_path.size()) + 1,
+                                    subtree_condition("file_path", old_path).c_str());
+        ok = sql && db_.execute(sql);
+        sqlite3_free(sql);
+    }
+    if (!ok || !db_.release("chunk_store")) {
+        LOG_ERROR("[ChunkStore] Failed to move recipes from " << old_path << " to " << new_path);
+        db_.rollback_to("chunk_store");
+        return;
+    }
+    stats_.logical_bytes -= std::min(stats_.logical_bytes, removed_bytes);
+}
+
+std::unique_ptr<std::istream> ChunkStore::open(const ChunkRecipe& recipe) const {
+    std::vector<fs::path> paths;
+    std::vector<std::uint64_t> offsets{0};
+    paths.reserve(recipe.chunks.size());
+    offsets.reserve(recipe.chunks.size() + 1);
+    for (const auto& chunk : recipe.chunks) {
+        paths.push_back(chunk_path(chunk.hash));
+        offsets.push_back(offsets.back() + chunk.size);
+    }
+    return std::make_unique<ChunkInputStream>(std::move(paths), std::move(offsets));
+}
+
+std::size_t ChunkStore::collect_garbage(std::chrono::seconds grace) {
+    std::scoped_lock lock(db_.write_mutex(), mutex_);
+    const std::int64_t cutoff = unix_now() - static_cast<std::int64_t>(grace.count());
+    std::vector<std::pair<std::string, std::uint64_t>> garbage;
+    db_.execute_query("SELECT hash, size FROM chunks WHERE refcount <= 0 AND last_used <= " + std::to_string(cutoff) + ";",
+                      [&garbage](sqlite3_stmt* stmt) {
+        const unsigned char* hash = sqlite3_column_text(stmt, 0);
+        if (hash) garbage.emplace_back(reinterpret_cast<const char*>(hash), static_cast<std::uint64_t>(sqlite3_column_int64(stmt, 1)));
+    });
+    if (garbage.empty()) return 0;
+
+    // Xoá dòng trước, file sau: crash giữa chừng chỉ để lại file mồ côi, không để recipe trỏ vào chunk đã mất
+    if (!db_.savepoint("chunk_store")) return 0;
+    Statement delete_owners = prepare(db_, "DELETE FROM chunk_owners WHERE hash = ?;");
+    Statement delete_chunk = prepare(db_, "DELETE FROM chunks WHERE hash = ? AND refcount <= 0;");
+    bool ok = delete_owners && delete_chunk;
+    for (std::size_t i = 0; ok && i < garbage.size(); ++i) {
+        for (sqlite3_stmt* stmt : {delete_owners.get(), delete_chunk.get()}) {
+            sqlite3_bind_text(stmt, 1, garbage[i].first.c_str(), -1, SQLITE_STATIC);
+            ok = ok && sqlite3_step(stmt) == SQLITE_DONE;
+            sqlite3_reset(stmt);
+        }
+    }
+    if (!ok || !db_.release("chunk_store")) {
+        LOG_ERROR("[ChunkStore] Garbage collection failed: " << sqlite3_errmsg(db_.get_db_handle()));
+        db_.rollback_to("chunk_store");
+        return 0;
+    }
+
+    std::uint64_t bytes = 0;
+    for (const auto& [hash, size] : garbage) {
+        std::error_code ec;
+        fs::remove(chunk_path(hash), ec);
+        bytes += size;
+    }
+    stats_.chunks -= std::min<std::uint64_t>(stats_.chunks, garbage.size());
+    stats_.stored_bytes -= std::min(stats_.stored_bytes, bytes);
+    stats_.collected_chunks += garbage.size();
+    stats_.collected_bytes += bytes;
+    LOG_INFO("[ChunkStore] Collected " << garbage.size() << " unreferenced chunk(s), " << bytes << " bytes.");
+    return garbage.size();
+}
+
+void ChunkStore::start_gc(std::chrono::seconds interval, std::chrono::seconds grace) {
+    std::lock_guard<std::mutex> lock(gc_mutex_);
+    if (gc_.joinable() || interval.count() <= 0) return;
+    gc_stop_requested_ = false;
+    gc_ = std::thread([this, interval, grace]() {
+        std::unique_lock<std::mutex> lk(gc_mutex_);
+        while (!gc_stop_requested_) {
+            gc_cv_.wait_for(lk, interval, [this]() { return gc_stop_requested_; });
+            if (gc_stop_requested_) break;
+            lk.unlock();
+            collect_garbage(grace);
+            lk.lock();
+        }
+    });
+}
+
+void ChunkStore::stop_gc() {
+    {
+        std::lock_guard<std::mutex> lock(gc_mutex_);
+        gc_stop_requested_ = true;
+    }
+    gc_cv_.notify_all();
+    if (gc_.joinable()) gc_.join();
+}
+
+ChunkStoreStats ChunkStore::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
@@ -1,4 +1,5 @@
 #include "config.hpp"
+#include "async_logger.hpp"
 #include <Poco/Util/PropertyFileConfiguration.h>
 #include <Poco/AutoPtr.h>
 #include <Poco/Logger.h>
@@ -10,22 +11,128 @@ using Poco::AutoPtr;
 // Định nghĩa biến static
 unsigned short Config::HTTP_SERVER_PORT = 8080;
 std::string Config::SERVER_BASE_URL = "";
+int Config::HTTP_MAX_THREADS = 128;
+int Config::HTTP_MAX_QUEUED = 100;
+int Config::HTTP_TIMEOUT_SECONDS = 60;
+std::string Config::HTTP_ENGINE = "poco";
+int Config::REACTOR_IO_THREADS = 2;
+int Config::REACTOR_HANDLER_THREADS = 64;
+int Config::REACTOR_HANDLER_QUEUE_LIMIT = 1024;
+int Config::REACTOR_MAX_CONNECTIONS = 20000;
+int Config::REACTOR_IDLE_TIMEOUT_SECONDS = 300;
+int Config::REACTOR_BODY_SPOOL_BYTES = 1048576;
+int Config::METADATA_WORKERS = 8;
+int Config::METADATA_QUEUE_LIMIT = 64;
+int Config::TRANSFER_WORKERS = 4;
+int Config::TRANSFER_QUEUE_LIMIT = 16;
+int Config::POOL_RETRY_AFTER_SECONDS = 1;
 std::string Config::DATABASE_PATH = "db/file_server.db";
 std::string Config::USER_DATA_ROOT = "data/users";
 std::string Config::SHARED_DATA_ROOT = "data/shared";
+std::string Config::STORAGE_MODE = "plain";
+std::string Config::STORAGE_CHUNKS_ROOT = "data/chunks";
+int Config::STORAGE_CHUNK_GC_INTERVAL_SECONDS = 600;
+int Config::STORAGE_CHUNK_GC_GRACE_SECONDS = 3600;
+int Config::STORAGE_BATCH_MAX_OPERATIONS = 1000;
+std::string Config::STORAGE_BATCH_TRASH_DIR = "data/batch-trash";
 int Config::PASSWORD_SALT_LENGTH = 16;
 int Config::HASH_ITERATIONS = 10000;
+std::string Config::TOKEN_KEYS = "";
+std::string Config::TOKEN_ACTIVE_KEY = "";
+int Config::TOKEN_TTL_SECONDS = 604800;
+int Config::HASH_WORKERS = 2;
+int Config::HASH_QUEUE_LIMIT = 8;
+int Config::HASH_RETRY_AFTER_SECONDS = 2;
+int Config::SESSION_IDLE_TTL_SECONDS = 1800;
+int Config::SESSION_FLUSH_INTERVAL_SECONDS = 5;
+std::string Config::METRICS_TOKEN = "";
+bool Config::COMPRESSION_ENABLED = true;
+int Config::COMPRESSION_MIN_BYTES = 1024;
+int Config::COMPRESSION_GZIP_LEVEL = 6;
+int Config::COMPRESSION_ZSTD_LEVEL = 3;
+int Config::SYNC_MANIFEST_MAX_ENTRIES = 2000000;
+int Config::SYNC_MANIFEST_MAX_BYTES = 268435456;
+int Config::SYNC_PLANNER_THREADS = 4;
+int Config::SYNC_PLANNER_MIN_PARTITION = 65536;
+bool Config::SYNC_DETECT_MOVES = true;
+int Config::SYNC_STREAM_SLICE_ENTRIES = 4096;
+int Config::SYNC_STREAM_LARGE_FILE_BYTES = 4194304;
+int Config::SYNC_WATCH_TIMEOUT_SECONDS = 55;
+int Config::SYNC_WATCH_MAX_WAITERS = 10000;
+int Config::TRANSFER_DELTA_MIN_FILE_SIZE = 1048576;
+int Config::TRANSFER_DELTA_MAX_PERCENT = 70;
+std::string Config::LOG_LEVEL = "info";
+std::string Config::LOG_FILE = "";
+double Config::RATE_LIMIT_USER_REQUESTS_PER_SECOND = 20;
+double Config::RATE_LIMIT_USER_REQUEST_BURST = 40;
+double Config::RATE_LIMIT_USER_BYTES_PER_SECOND = 20971520;
+double Config::RATE_LIMIT_USER_BYTES_BURST = 104857600;
+double Config::RATE_LIMIT_IP_REQUESTS_PER_SECOND = 2;
+double Config::RATE_LIMIT_IP_REQUEST_BURST = 10;
 
 void loadConfigFromFile(const std::string& filePath) {
     try {
         AutoPtr<PropertyFileConfiguration> config = new PropertyFileConfiguration(filePath);
 
         Config::HTTP_SERVER_PORT = static_cast<unsigned short>(config->getUInt("server.port", 8080));
+        Config::HTTP_MAX_THREADS = config->getInt("server.max_threads", 128);
+        Config::HTTP_MAX_QUEUED = config->getInt("server.max_queued", 100);
+        Config::HTTP_TIMEOUT_SECONDS = config->getInt("server.timeout_seconds", 60);
+        Config::HTTP_ENGINE = config->getString("server.engine", "poco");
+        Config::REACTOR_IO_THREADS = config->getInt("reactor.io_threads", 2);
+        Config::REACTOR_HANDLER_THREADS = config->getInt("reactor.handler_threads", 64);
+        Config::REACTOR_HANDLER_QUEUE_LIMIT = config->getInt("reactor.handler_queue_limit", 1024);
+        Config::REACTOR_MAX_CONNECTIONS = config->getInt("reactor.max_connections", 20000);
+        Config::REACTOR_IDLE_TIMEOUT_SECONDS = config->getInt("reactor.idle_timeout_seconds", 300);
+        Config::REACTOR_BODY_SPOOL_BYTES = config->getInt("reactor.body_spool_bytes", 1048576);
+        Config::METADATA_WORKERS = config->getInt("pool.metadata_workers", 8);
+        Config::METADATA_QUEUE_LIMIT = config->getInt("pool.metadata_queue_limit", 64);
+        Config::TRANSFER_WORKERS = config->getInt("pool.transfer_workers", 4);
+        Config::TRANSFER_QUEUE_LIMIT = config->getInt("pool.transfer_queue_limit", 16);
+        Config::POOL_RETRY_AFTER_SECONDS = config->getInt("pool.retry_after_seconds", 1);
         Config::DATABASE_PATH = config->getString("database.path", "db/file_server.db");
         Config::USER_DATA_ROOT = config->getString("storage.users_root", "data/users");
         Config::SHARED_DATA_ROOT = config->getString("storage.shared_root", "data/shared");
+        Config::STORAGE_MODE = config->getString("storage.mode", "plain");
+        Config::STORAGE_CHUNKS_ROOT = config->getString("storage.chunks_root", "data/chunks");
+        Config::STORAGE_CHUNK_GC_INTERVAL_SECONDS = config->getInt("storage.chunk_gc_interval_seconds", 600);
+        Config::STORAGE_CHUNK_GC_GRACE_SECONDS = config->getInt("storage.chunk_gc_grace_seconds", 3600);
+        Config::STORAGE_BATCH_MAX_OPERATIONS = config->getInt("storage.batch_max_operations", 1000);
+        Config::STORAGE_BATCH_TRASH_DIR = config->getString("storage.batch_trash_dir", "data/batch-trash");
         Config::PASSWORD_SALT_LENGTH = config->getInt("security.salt_length", 16);
         Config::HASH_ITERATIONS = config->getInt("security.hash_iterations", 10000);
+        Config::TOKEN_KEYS = config->getString("security.token_keys", "");
+        Config::TOKEN_ACTIVE_KEY = config->getString("security.token_active_key", "");
+        Config::TOKEN_TTL_SECONDS = config->getInt("security.token_ttl_seconds", 604800);
+        Config::HASH_WORKERS = config->getInt("security.hash_workers", 2);
+        Config::HASH_QUEUE_LIMIT = config->getInt("security.hash_queue_limit", 8);
+        Config::HASH_RETRY_AFTER_SECONDS = config->getInt("security.hash_retry_after_seconds", 2);
+        Config::SESSION_IDLE_TTL_SECONDS = config->getInt("session.ttl_seconds", 1800);
+        Config::SESSION_FLUSH_INTERVAL_SECONDS = config->getInt("session.flush_interval_seconds", 5);
+        Config::METRICS_TOKEN = config->getString("metrics.token", "");
+        Config::COMPRESSION_ENABLED = config->getBool("compression.enabled", true);
+        Config::COMPRESSION_MIN_BYTES = config->getInt("compression.min_bytes", 1024);
+        Config::COMPRESSION_GZIP_LEVEL = config->getInt("compression.gzip_level", 6);
+        Config::COMPRESSION_ZSTD_LEVEL = config->getInt("compression.zstd_level", 3);
+        Config::SYNC_MANIFEST_MAX_ENTRIES = config->getInt("sync.manifest_max_entries", 2000000);
+        Config::SYNC_MANIFEST_MAX_BYTES = config->getInt("sync.manifest_max_bytes", 268435456);
+        Config::SYNC_PLANNER_THREADS = config->getInt("sync.planner_threads", 4);
+        Config::SYNC_PLANNER_MIN_PARTITION = config->getInt("sync.planner_min_partition", 65536);
+        Config::SYNC_DETECT_MOVES = config->getBool("sync.detect_moves", true);
+        Config::SYNC_STREAM_SLICE_ENTRIES = config->getInt("sync.stream_slice_entries", 4096);
+        Config::SYNC_STREAM_LARGE_FILE_BYTES = config->getInt("sync.stream_large_file_bytes", 4194304);
+        Config::SYNC_WATCH_TIMEOUT_SECONDS = config->getInt("sync.watch_timeout_seconds", 55);
+        Config::SYNC_WATCH_MAX_WAITERS = config->getInt("sync.watch_max_waiters", 10000);
+        Config::TRANSFER_DELTA_MIN_FILE_SIZE = config->getInt("transfer.delta_min_file_size", 1048576);
+        Config::TRANSFER_DELTA_MAX_PERCENT = config->getInt("transfer.delta_max_percent", 70);
+        Config::LOG_LEVEL = config->getString("log.level", "info");
+        Config::LOG_FILE = config->getString("log.file", "");
+        Config::RATE_LIMIT_USER_REQUESTS_PER_SECOND = config->getDouble("ratelimit.user_requests_per_second", 20);
+        Config::RATE_LIMIT_USER_REQUEST_BURST = config->getDouble("ratelimit.user_request_burst", 40);
+        Config::RATE_LIMIT_USER_BYTES_PER_SECOND = config->getDouble("ratelimit.user_bytes_per_second", 20971520);
+        Config::RATE_LIMIT_USER_BYTES_BURST = config->getDouble("ratelimit.user_bytes_burst", 104857600);
+        Config::RATE_LIMIT_IP_REQUESTS_PER_SECOND = config->getDouble("ratelimit.ip_requests_per_second", 2);
+        Config::RATE_LIMIT_IP_REQUEST_BURST = config->getDouble("ratelimit.ip_request_burst", 10);
 
         Config::SERVER_BASE_URL = "http://localhost:" + std::to_string(Config::HTTP_SERVER_PORT);
 
@@ -33,7 +140,7 @@ void loadConfigFromFile(const std::string& filePath) {
         Poco::Logger::get("Config").information("Port: " + std::to_string(Config::HTTP_SERVER_PORT));
     }
     catch (const Poco::Exception& ex) {
-        std::cerr << "Error loading config file: " << ex.displayText() << std::endl;
+        LOG_ERROR("Error loading config file: " << ex.displayText());
         throw;
     }
 }
@@ -0,0 +1,308 @@
+#include "content_coding.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+
+#include <zlib.h>
+
+// Build với -DFILESERVER_HAVE_ZSTD=0 để tắt zstd dù có header.
+#ifndef FILESERVER_HAVE_ZSTD
+#if __has_include(<zstd.h>)
+#define FILESERVER_HAVE_ZSTD 1
+#else
+#define FILESERVER_HAVE_ZSTD 0
+#endif
+#endif
+
+#if FILESERVER_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+    constexpr std::size_t kOutChunk = 64 * 1024;
+
+    std::string_view trim(std::string_view s) {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+        return s;
+    }
+
+    bool iequals(std::string_view a, std::string_view b) {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+            return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+        });
+    }
+
+    // "q=0.5" trong phần tham số; thiếu hoặc sai cú pháp = 1.
+    double parse_qvalue(std::string_view params) {
+        while (!params.empty()) {
+            std::size_t semi = params.find(';');
+            std::string_view param = trim(params.substr(0, semi));
+            params = semi == std::string_view::npos ? std::string_view() : params.substr(semi + 1);
+            if (param.size() >= 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+                std::string value(param.substr(2));
+                char* end = nullptr;
+                double q = std::strtod(value.c_str(), &end);
+                if (end == value.c_str()) return 1.0;
+                return std::clamp(q, 0.0, 1.0);
+            }
+        }
+        return 1.0;
+    }
+}
+
+const char* content_coding_name(ContentCoding coding) {
+    switch (coding) {
+        case ContentCoding::GZIP: return "gzip";
+        case ContentCoding::ZSTD: return "zstd";
+        case ContentCoding::IDENTITY: break;
+    }
+    return "identity";
+}
+
+bool content_coding_supported(ContentCoding coding) {
+    return coding != ContentCoding::ZSTD || FILESERVER_HAVE_ZSTD;
+}
+
+ContentCoding negotiate_content_coding(std::string_view accept_encoding) {
+    double q_gzip = -1, q_zstd = -1, q_any = -1; // -1 = không được nhắc tới
+    while (!accept_encoding.empty()) {
+        std::size_t comma = accept_encoding.find(',');
+        std::string_view item = accept_encoding.substr(0, comma);
+        accept_encoding = comma == std::string_view::npos ? std::string_view() : accept_encoding.substr(comma + 1);
+
+        std::size_t semi = item.find(';');
+        std::string_view name = trim(item.substr(0, semi));
+        double q = semi == std::string_view::npos ? 1.0 : parse_qvalue(item.substr(semi + 1));
+        if (iequals(name, "gzip") || iequals(name, "x-gzip")) q_gzip = std::max(q_gzip, q);
+        else if (iequals(name, "zstd")) q_zstd = std::max(q_zstd, q);
+        else if (name == "*") q_any = std::max(q_any, q);
+    }
+    if (q_gzip < 0) q_gzip = q_any;
+    if (q_zstd < 0) q_zstd = q_any;
+    if (!content_coding_supported(ContentCoding::ZSTD)) q_zstd = -1;
+
+    if (q_zstd > 0 && q_zstd >= q_gzip) return ContentCoding::ZSTD;
+    if (q_gzip > 0) return ContentCoding::GZIP;
+    return ContentCoding::IDENTITY;
+}
+
+
+// --- StreamCompressor ---
+
+struct StreamCompressor::Impl {
+    ContentCoding coding;
+    std::vector<char> out = std::vector<char>(kOutChunk);
+    z_stream zs{};
+    bool zs_ready = false;
+    bool finished = false;
+#if FILESERVER_HAVE_ZSTD
+    ZSTD_CCtx* zstd = nullptr;
+#endif
+
+    ~Impl() {
+        if (zs_ready) deflateEnd(&zs);
+#if FILESERVER_HAVE_ZSTD
+        if (zstd) ZSTD_freeCCtx(zstd);
+#endif
+    }
+};
+
+StreamCompressor::StreamCompressor(ContentCoding coding, int level, Sink sink)
+    : impl_(std::make_unique<Impl>()), sink_(std::move(sink)) {
+    impl_->coding = coding;
+    if (coding == ContentCoding::GZIP) {
+        // windowBits 15 + 16 = gzip header/trailer thay vì zlib
+        if (deflateInit2(&impl_->zs, std::clamp(level, 1, 9), Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("deflateInit2 failed");
+        }
+        impl_->zs_ready = true;
+        return;
+    }
+#if FILESERVER_HAVE_ZSTD
+    if (coding == ContentCoding::ZSTD) {
+        impl_->zstd = ZSTD_createCCtx();
+        if (!impl_->zstd || ZSTD_isError(ZSTD_CCtx_setParameter(impl_->zstd, ZSTD_c_compressionLevel, level))) {
+            throw std::runtime_error("ZSTD_createCCtx failed");
+        }
+        return;
+    }
+#endif
+    throw std::runtime_error(std::string("Unsupported content coding: ") + content_coding_name(coding));
+}
+
+StreamCompressor::~StreamCompressor() = default;
+
+void StreamCompressor::write(const char* data, std::size_t length) {
+    if (impl_->finished) throw std::logic_error("StreamCompressor::write after finish");
+    bytes_in_ += length;
+    Impl& d = *impl_;
+    if (d.coding == ContentCoding::GZIP) {
+        while (length > 0) {
+            // avail_in là uInt: chia nhỏ các đoạn rất lớn
+            const uInt piece = static_cast<uInt>(std::min<std::size_t>(length, 1u << 30));
+            d.zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+            d.zs.avail_in = piece;
+            do {
+                d.zs.next_out = reinterpret_cast<Bytef*>(d.out.data());
+                d.zs.avail_out = static_cast<uInt>(d.out.size());
+                if (deflate(&d.zs, Z_NO_FLUSH) == Z_STREAM_ERROR) throw std::runtime_error("deflate failed");
+                std::size_t produced = d.out.size() - d.zs.avail_out;
+                if (produced > 0) { bytes_out_ += produced; sink_(d.out.data(), produced); }
+            } while (d.zs.avail_out == 0);
+            data += piece;
+            length -= piece;
+        }
+        return;
+    }
+#if FILESERVER_HAVE_ZSTD
+    ZSTD_inBuffer in{data, length, 0};
+    while (in.pos < in.size) {
+        ZSTD_outBuffer o{d.out.data(), d.out.size(), 0};
+        std::size_t rc = ZSTD_compressStream2(d.zstd, &o, &in, ZSTD_e_continue);
+        if (ZSTD_isError(rc)) throw std::runtime_error(std::string("zstd: ") + ZSTD_getErrorName(rc));
+        if (o.pos > 0) { bytes_out_ += o.pos; sink_(d.out.data(), o.pos); }
+    }
+#endif
+}
+
+void StreamCompressor::finish() {
+    Impl& d = *impl_;
+    if (d.finished) return;
+    d.finished = true;
+    if (d.coding == ContentCoding::GZIP) {
+        d.zs.next_in = nullptr;
+        d.zs.avail_in = 0;
+        int rc;
+        do {
+            d.zs.next_out = reinterpret_cast<Bytef*>(d.out.data());
+            d.zs.avail_out = static_cast<uInt>(d.out.size());
+            rc = deflate(&d.zs, Z_FINISH);
+            if (rc == Z_STREAM_ERROR) throw std::runtime_error("deflate failed");
+            std::size_t produced = d.out.size() - d.zs.avail_out;
+            if (produced > 0) { bytes_out_ += produced; sink_(d.out.data(), produced); }
+        } while (rc != Z_STREAM_END);
+        return;
+    }
+#if FILESERVER_HAVE_ZSTD
+    for (;;) {
+        ZSTD_inBuffer in{nullptr, 0, 0};
+        ZSTD_outBuffer o{d.out.data(), d.out.size(), 0};
+        std::size_t remaining = ZSTD_compressStream2(d.zstd, &o, &in, ZSTD_e_end);
+        if (ZSTD_isError(remaining)) throw std::runtime_error(std::string("zstd: ") + ZSTD_getErrorName(remaining));
+        if (o.pos > 0) { bytes_out_ += o.pos; sink_(d.out.data(), o.pos); }
+        if (remaining == 0) break;
+    }
+#endif
+}
+
+
+// --- CompressingBodyStream ---
+
+class CompressingBodyStream::Buffer : public std::streambuf {
+public:
+    Buffer(ContentCoding coding, int level, std::size_t threshold, Open open)
+        : coding_(coding), level_(level), threshold_(threshold), open_(std::move(open)), put_(16 * 1024) {
+        setp(put_.data(), put_.data() + put_.size());
+    }
+
+    void finish() {
+        if (state_ == State::DONE) return;
+        flush_put_area();
+        if (state_ == State::BUFFERING) {
+            target_ = &open_(ContentCoding::IDENTITY, static_cast<std::int64_t>(pending_.size()));
+            target_->write(pending_.data(), static_cast<std::streamsize>(pending_.size()));
+            bytes_in_ = bytes_out_ = pending_.size();
+            used_ = ContentCoding::IDENTITY;
+        } else {
+            compressor_->finish();
+            bytes_in_ = compressor_->bytes_in();
+            bytes_out_ = compressor_->bytes_out();
+        }
+        target_->flush();
+        state_ = State::DONE;
+    }
+
+    ContentCoding used() const { return used_; }
+    std::uint64_t bytes_in() const { return bytes_in_; }
+    std::uint64_t bytes_out() const { return bytes_out_; }
+
+protected:
+    int_type overflow(int_type ch) override {
+        flush_put_area();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        if (n <= epptr() - pptr()) {
+            std::copy(s, s + n, pptr());
+            pbump(static_cast<int>(n));
+            return n;
+        }
+        flush_put_area();
+        consume(s, static_cast<std::size_t>(n));
+        return n;
+    }
+
+private:
+    enum class State { BUFFERING, COMPRESSING, DONE };
+
+    void flush_put_area() {
+        std::size_t n = static_cast<std::size_t>(pptr() - pbase());
+        if (n > 0) consume(pbase(), n);
+        setp(put_.data(), put_.data() + put_.size());
+    }
+
+    void consume(const char* data, std::size_t length) {
+        if (state_ == State::DONE) throw std::logic_error("CompressingBodyStream: write after finish");
+        if (state_ == State::COMPRESSING) {
+            compressor_->write(data, length);
+            return;
+        }
+        pending_.append(data, length);
+        if (coding_ == ContentCoding::IDENTITY || pending_.size() < threshold_) return;
+
+        // Vượt ngưỡng: gửi header (chunked + Content-Encoding) rồi nén phần đã giữ lại.
+        target_ = &open_(coding_, -1);
+        std::ostream* target = target_;
+        compressor_ = std::make_unique<StreamCompressor>(coding_, level_, [target](const char* d, std::size_t n) {
+            target->write(d, static_cast<std::streamsize>(n));
+        });
+        used_ = coding_;
+        state_ = State::COMPRESSING;
+        compressor_->write(pending_.data(), pending_.size());
+        std::string().swap(pending_);
+    }
+
+    const ContentCoding coding_;
+    const int level_;
+    const std::size_t threshold_;
+    const Open open_;
+    std::vector<char> put_;
+    std::string pending_;
+    std::unique_ptr<StreamCompressor> compressor_;
+    std::ostream* target_ = nullptr;
+    State state_ = State::BUFFERING;
+    ContentCoding used_ = ContentCoding::IDENTITY;
+    std::uint64_t bytes_in_ = 0;
+    std::uint64_t bytes_out_ = 0;
+};
+
+CompressingBodyStream::CompressingBodyStream(ContentCoding coding, int level, std::size_t threshold, Open open)
+    : std::ostream(nullptr), buffer_(std::make_unique<Buffer>(coding, level, threshold, std::move(open))) {
+    rdbuf(buffer_.get());
+}
+
+CompressingBodyStream::~CompressingBodyStream() = default;
+
+void CompressingBodyStream::finish() { buffer_->finish(); }
+ContentCoding CompressingBodyStream::coding_used() const { return buffer_->used(); }
+std::uint64_t CompressingBodyStream::bytes_in() const { return buffer_->bytes_in(); }
+std::uint64_t CompressingBodyStream::bytes_out() const { return buffer_->bytes_out(); }
@@ -1,4 +1,6 @@
 #include "db.hpp"
+#include "async_logger.hpp"
+#include "metrics.hpp"
 #include "config.hpp" // For DATABASE_PATH
 #include <iostream>
 #include <stdexcept> // For std::runtime_error
@@ -7,10 +9,23 @@ namespace fs = std::filesystem;
 
 
 
+namespace {
+    // SQLITE_TRACE_PROFILE fires once per finished statement with its run time in
+    // nanoseconds, so statements prepared directly on get_db_handle() are timed too.
+    int profile_statement(unsigned type, void*, void*, void* x) {
+        static Histogram& statement_time = MetricsRegistry::global().histogram(
+            "fileserver_db_statement_duration_seconds", "SQLite statement execution time");
+        if (type == SQLITE_TRACE_PROFILE) {
+            statement_time.record(*static_cast<sqlite3_int64*>(x) / 1000);
+        }
+        return 0;
+    }
+}
+
 Database::Database(const std::string& db_path) : db_path_(db_path) {
     if (!open(db_path_)) {
         // Consider throwing an exception or setting an error state
-        std::cerr << "Failed to open database: " << db_path_ << std::endl;
+        LOG_ERROR("Failed to open database: " << db_path_);
     }
 }
 
@@ -26,12 +41,15 @@ bool Database::open(const std::string& db_path) {
     }
 
     if (sqlite3_open(db_path.c_str(), &db_) != SQLITE_OK) {
-        std::cerr << "Cannot open database: " << sqlite3_errmsg(db_) << std::endl;
+        LOG_ERROR("Cannot open database: " << sqlite3_errmsg(db_));
         db_ = nullptr;
         return false;
     }
     // Enable foreign key constraints
     execute("PRAGMA foreign_keys = ON;");
+    // Several connections share the file (e.g. SessionPersistence): wait on locks instead of failing with SQLITE_BUSY.
+    sqlite3_busy_timeout(db_, 5000);
+    sqlite3_trace_v2(db_, SQLITE_TRACE_PROFILE, profile_statement, nullptr);
     return true;
 }
 
@@ -47,19 +65,31 @@ bool Database::execute(const std::string& sql) {
     char* err_msg = nullptr;
     int rc = sqlite3_exec(db_, sql.c_str(), nullptr, nullptr, &err_msg);
     if (rc != SQLITE_OK) {
-        std::cerr << "SQL error: " << err_msg << std::endl;
+        LOG_ERROR("SQL error: " << err_msg);
         sqlite3_free(err_msg);
         return false;
     }
     return true;
 }
 
+bool Database::savepoint(const std::string& name) {
+    return execute("SAVEPOINT " + name + ";");
+}
+
+bool Database::release(const std::string& name) {
+    return execute("RELEASE " + name + ";");
+}
+
+void Database::rollback_to(const std::string& name) {
+    execute("ROLLBACK TO " + name + "; RELEASE " + name + ";");
+}
+
 bool Database::execute_query(const std::string& sql, 
                            std::function<void(sqlite3_stmt*)> row_callback) {
     if (!db_) return false;
     sqlite3_stmt* stmt;
     if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db_) << std::endl;
+        LOG_ERROR("Failed to prepare statement: " << sqlite3_errmsg(db_));
         return false;
     }
 
@@ -75,7 +105,7 @@ std::optional<std::string> Database::execute_scalar(const std::string& sql) {
     if (!db_) return std::nullopt;
     sqlite3_stmt* stmt;
     if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement for scalar: " << sqlite3_errmsg(db_) << std::endl;
+        LOG_ERROR("Failed to prepare statement for scalar: " << sqlite3_errmsg(db_));
         return std::nullopt;
     }
 
@@ -151,6 +181,7 @@ bool Database::initialize_schema() {
             is_directory INTEGER NOT NULL DEFAULT 0, 
             is_deleted INTEGER NOT NULL DEFAULT 0,   
             deleted_timestamp INTEGER,   
+            parent_path TEXT,            -- Thư mục chứa (file_path tới '/' cuối), cho tree hash
             FOREIGN KEY (owner_user_id) REFERENCES users(id) ON DELETE SET NULL
         );
     )";
@@ -159,15 +190,130 @@ bool Database::initialize_schema() {
     ON file_metadata (file_path, is_deleted);
 )";
 
+    // Tree hash của từng thư mục (xem TreeHashIndex / MerkleTree trong protocol.hpp)
+    std::string directory_hashes_table_sql = R"(
+        CREATE TABLE IF NOT EXISTS directory_hashes (
+            dir_path TEXT PRIMARY KEY,
+            tree_hash TEXT NOT NULL
+        );
+    )";
+    std::string metadata_parent_index_sql = R"(
+        CREATE INDEX IF NOT EXISTS idx_file_metadata_parent
+        ON file_metadata (parent_path, is_deleted);
+    )";
+    // Tìm file theo nội dung (FILES_CLAIM)
+    std::string metadata_checksum_index_sql = R"(
+        CREATE INDEX IF NOT EXISTS idx_file_metadata_checksum
+        ON file_metadata (checksum, is_deleted);
+    )";
+
+    // Session state that must survive a restart (see session_persistence.hpp).
+    std::string token_signing_keys_table_sql = R"(
+        CREATE TABLE IF NOT EXISTS token_signing_keys (
+            key_id TEXT PRIMARY KEY,
+            secret TEXT NOT NULL,
+            created_at INTEGER NOT NULL
+        );
+    )";
+    std::string sessions_table_sql = R"(
+        CREATE TABLE IF NOT EXISTS sessions (
+            token_id TEXT PRIMARY KEY,
+            user_id INTEGER NOT NULL,
+            username TEXT NOT NULL,
+            home_dir TEXT NOT NULL,
+            expires_at INTEGER NOT NULL,     -- token hard expiry (unix seconds)
+            last_activity INTEGER NOT NULL,  -- unix seconds, written behind
+            FOREIGN KEY (user_id) REFERENCES users(id) ON DELETE CASCADE
+        );
+    )";
+    std::string revoked_tokens_table_sql = R"(
+        CREATE TABLE IF NOT EXISTS revoked_tokens (
+            token_id TEXT PRIMARY KEY,
+            expires_at INTEGER NOT NULL
+        );
+    )";
+
+    // Chunk store (storage.mode = chunked, xem chunk_store.hpp)
+    std::string chunks_table_sql = R"(
+        CREATE TABLE IF NOT EXISTS chunks (
+            hash TEXT PRIMARY KEY,               -- SHA-256 hex, file <storage.chunks_root>/ab/cd/<hash>
+            size INTEGER NOT NULL,
+            refcount INTEGER NOT NULL DEFAULT 0, -- Số lần xuất hiện trong file_recipes
+            last_used INTEGER NOT NULL           -- unix seconds; GC bỏ qua chunk dùng gần đây
+        );
+    )";
+    std::string chunks_unreferenced_index_sql = R"(
+        CREATE INDEX IF NOT EXISTS idx_chunks_refcount ON chunks (refcount, last_used);
+    )";
+    std::string chunk_owners_table_sql = R"(
+        CREATE TABLE IF NOT EXISTS chunk_owners (
+            hash TEXT NOT NULL,
+            user_id INTEGER NOT NULL,            -- User đã upload chunk (có nội dung của nó)
+            PRIMARY KEY (hash, user_id)
+        ) WITHOUT ROWID;
+    )";
+    std::string file_recipes_table_sql = R"(
+        CREATE TABLE IF NOT EXISTS file_recipes (
+            file_path TEXT PRIMARY KEY,          -- Như file_metadata.file_path
+            checksum TEXT NOT NULL,
+            size INTEGER NOT NULL,
+            chunks BLOB NOT NULL                 -- Mỗi chunk: 32 byte hash + u32 size
+        );
+    )";
+
     bool success = true;
     success &= execute(users_table_sql);
     success &= execute(permissions_table_sql);
     success &= execute(shared_storage_table_sql);
     success &= execute(shared_access_table_sql);
     success &= execute(file_metadata_table_sql);
+    success &= migrate_file_metadata_parent_path();
+    success &= execute(metadata_parent_index_sql);
+    success &= execute(metadata_checksum_index_sql);
+    success &= execute(directory_hashes_table_sql);
+    success &= execute(token_signing_keys_table_sql);
+    success &= execute(sessions_table_sql);
+    success &= execute(revoked_tokens_table_sql);
+    success &= execute(chunks_table_sql);
+    success &= execute(chunks_unreferenced_index_sql);
+    success &= execute(chunk_owners_table_sql);
+    success &= execute(file_recipes_table_sql);
 
     if (!success) {
-        std::cerr << "Failed to initialize database schema." << std::endl;
+        LOG_ERROR("Failed to initialize database schema.");
     }
     return success;
-}
\ No newline at end of file
+}
+
+// DB tạo trước khi có cột parent_path: thêm cột rồi điền cho các dòng cũ.
+bool Database::migrate_file_metadata_parent_path() {
+    bool has_column = false;
+    execute_query("PRAGMA table_info(file_metadata);", [&has_column](sqlite3_stmt* stmt) {
+        const unsigned char* name = sqlite3_column_text(stmt, 1);
+        if (name && std::string(reinterpret_cast<const char*>(name)) == "parent_path") has_column = true;
+    });
+    if (!has_column && !execute("ALTER TABLE file_metadata ADD COLUMN parent_path TEXT;")) return false;
+
+    std::vector<std::pair<sqlite3_int64, std::string>> rows;
+    execute_query("SELECT id, file_path FROM file_metadata WHERE parent_path IS NULL;", [&rows](sqlite3_stmt* stmt) {
+        rows.emplace_back(sqlite3_column_int64(stmt, 0), reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)));
+    });
+    if (rows.empty()) return true;
+
+    LOG_INFO("Filling parent_path for " << rows.size() << " file_metadata rows.");
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, "UPDATE file_metadata SET parent_path = ? WHERE id = ?;", -1, &stmt, nullptr) != SQLITE_OK) {
+        LOG_ERROR("Failed to prepare parent_path backfill: " << sqlite3_errmsg(db_));
+        return false;
+    }
+    execute("BEGIN;");
+    for (const auto& [id, file_path] : rows) {
+        const std::string parent = fs::path(file_path).parent_path().string();
+        sqlite3_bind_text(stmt, 1, parent.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt, 2, id);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    return execute("COMMIT;");
+}
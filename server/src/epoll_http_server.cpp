@@ -0,0 +1,660 @@
+#include "epoll_http_server.hpp"
+#include "async_logger.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_map>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr std::size_t kReadBufferBytes = 64 * 1024;
+    constexpr int kMaxEvents = 256;
+    constexpr int kMaxAcceptsPerWake = 64;   // để các I/O thread khác cũng nhận kết nối
+    constexpr int kMaxReadsPerWake = 16;     // một upload lớn không giữ I/O thread quá lâu
+
+    bool iequals(const std::string& a, const char* b) {
+        std::size_t n = std::strlen(b);
+        if (a.size() != n) return false;
+        for (std::size_t i = 0; i < n; ++i) {
+            if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) return false;
+        }
+        return true;
+    }
+
+    // "::ffff:1.2.3.4" -> "1.2.3.4" so per-IP limits and logs see one form.
+    void describe(const sockaddr_storage& addr, std::string& host, std::uint16_t& port) {
+        char buf[INET6_ADDRSTRLEN] = {0};
+        if (addr.ss_family == AF_INET) {
+            const auto& a = reinterpret_cast<const sockaddr_in&>(addr);
+            inet_ntop(AF_INET, &a.sin_addr, buf, sizeof(buf));
+            port = ntohs(a.sin_port);
+        } else if (addr.ss_family == AF_INET6) {
+            const auto& a = reinterpret_cast<const sockaddr_in6&>(addr);
+            if (IN6_IS_ADDR_V4MAPPED(&a.sin6_addr)) inet_ntop(AF_INET, &a.sin6_addr.s6_addr[12], buf, sizeof(buf));
+            else inet_ntop(AF_INET6, &a.sin6_addr, buf, sizeof(buf));
+            port = ntohs(a.sin6_port);
+        }
+        host = buf;
+    }
+
+    [[noreturn]] void throw_errno(const std::string& what) {
+        throw std::system_error(errno, std::generic_category(), "EpollHttpServer: " + what);
+    }
+}
+
+struct EpollHttpServer::Connection {
+    enum class State { READING, HANDLING, WRITING };
+
+    int fd = -1;
+    State state = State::READING;
+    HttpRequestParser parser;
+    std::string input;                   // read but not yet parsed (pipelined requests)
+    std::unique_ptr<Request> request;    // being received
+    std::FILE* spool = nullptr;          // open while request->body_file is being written
+    bool continue_sent = false;
+    bool head_only = false;
+
+    std::string out;
+    std::size_t out_offset = 0;
+    int file_fd = -1;
+    off_t file_offset = 0;
+    std::uint64_t file_remaining = 0;
+    bool close_after_write = false;
+
+    bool peer_closed = false;            // hung up while its handler was running
+    std::uint32_t events = 0;            // current epoll interest
+    Clock::time_point last_activity;
+
+    std::string peer_host;
+    std::uint16_t peer_port = 0;
+    std::string local_host;
+    std::uint16_t local_port = 0;
+
+    void discard_body() {
+        if (spool) { std::fclose(spool); spool = nullptr; }
+        if (request && !request->body_file.empty()) std::remove(request->body_file.c_str());
+        request.reset();
+    }
+};
+
+// Handler threads / Responders -> one I/O thread. Shared with Responders, which
+// may outlive the I/O thread: after stop() closes it, posts are dropped.
+struct EpollHttpServer::Mailbox {
+    struct Completion {
+        Connection* connection;
+        Response response;
+        bool keep_alive;
+    };
+
+    std::mutex mutex;
+    std::vector<Completion> completions;
+    int wake_fd = -1;
+    bool open = true;
+
+    void post(Connection* connection, Response&& response, bool keep_alive) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!open) return;
+        completions.push_back(Completion{connection, std::move(response), keep_alive});
+        std::uint64_t one = 1;
+        (void)!::write(wake_fd, &one, sizeof(one));
+    }
+};
+
+struct EpollHttpServer::IoThread {
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    std::thread thread;
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+    std::vector<std::unique_ptr<Connection>> closed; // freed after the current batch of events
+    std::vector<char> read_buffer = std::vector<char>(kReadBufferBytes);
+    std::shared_ptr<Mailbox> mailbox = std::make_shared<Mailbox>();
+};
+
+EpollHttpServer::Responder::~Responder() {
+    if (!done_.exchange(true)) {
+        Response response;
+        response.status = 500;
+        response.body = "Internal server error\n";
+        mailbox_->post(connection_, std::move(response), keep_alive_);
+    }
+}
+
+void EpollHttpServer::Responder::complete(Response response) {
+    if (done_.exchange(true)) return;
+    mailbox_->post(connection_, std::move(response), keep_alive_);
+}
+
+EpollHttpServer::EpollHttpServer(Options options, Handler handler)
+    : options_(std::move(options)), handler_(std::move(handler)),
+      handler_pool_("http_handlers", std::max<std::size_t>(1, options_.handler_threads), options_.handler_queue_limit) {}
+
+EpollHttpServer::~EpollHttpServer() {
+    stop();
+}
+
+const char* EpollHttpServer::reason_phrase(int status) {
+    switch (status) {
+        case 100: return "Continue";
+        case 200: return "OK";
+        case 201: return "Created";
+        case 204: return "No Content";
+        case 206: return "Partial Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 408: return "Request Timeout";
+        case 409: return "Conflict";
+        case 411: return "Length Required";
+        case 412: return "Precondition Failed";
+        case 413: return "Payload Too Large";
+        case 415: return "Unsupported Media Type";
+        case 429: return "Too Many Requests";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        case 505: return "HTTP Version Not Supported";
+        default: return "Unknown";
+    }
+}
+
+void EpollHttpServer::start() {
+    if (running_.load()) return;
+
+    // Dual-stack IPv6 socket when no address is given, IPv4 otherwise / as fallback.
+    sockaddr_storage addr{};
+    socklen_t addr_len = 0;
+    int family = AF_INET6;
+    if (!options_.bind_address.empty()) {
+        auto& v4 = reinterpret_cast<sockaddr_in&>(addr);
+        auto& v6 = reinterpret_cast<sockaddr_in6&>(addr);
+        if (inet_pton(AF_INET, options_.bind_address.c_str(), &v4.sin_addr) == 1) family = AF_INET;
+        else if (inet_pton(AF_INET6, options_.bind_address.c_str(), &v6.sin6_addr) == 1) family = AF_INET6;
+        else throw std::system_error(EINVAL, std::generic_category(), "EpollHttpServer: bad bind address " + options_.bind_address);
+    }
+    listen_fd_ = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0 && family == AF_INET6 && options_.bind_address.empty()) {
+        family = AF_INET;
+        listen_fd_ = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    }
+    if (listen_fd_ < 0) throw_errno("socket");
+
+    int one = 1, zero = 0;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (family == AF_INET6) {
+        setsockopt(listen_fd_, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+        auto& v6 = reinterpret_cast<sockaddr_in6&>(addr);
+        v6.sin6_family = AF_INET6;
+        v6.sin6_port = htons(options_.port);
+        if (options_.bind_address.empty()) v6.sin6_addr = in6addr_any;
+        addr_len = sizeof(sockaddr_in6);
+    } else {
+        auto& v4 = reinterpret_cast<sockaddr_in&>(addr);
+        v4.sin_family = AF_INET;
+        v4.sin_port = htons(options_.port);
+        if (options_.bind_address.empty()) v4.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr_len = sizeof(sockaddr_in);
+    }
+    if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), addr_len) < 0) {
+        int err = errno;
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+        errno = err;
+        throw_errno("bind port " + std::to_string(options_.port));
+    }
+    if (::listen(listen_fd_, SOMAXCONN) < 0) throw_errno("listen");
+    sockaddr_storage bound{};
+    socklen_t bound_len = sizeof(bound);
+    getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&bound), &bound_len);
+    std::string ignored_host;
+    describe(bound, ignored_host, bound_port_);
+
+    // sendfile(2) không có MSG_NOSIGNAL: client đóng giữa chừng không được giết process.
+    std::signal(SIGPIPE, SIG_IGN);
+
+    running_.store(true);
+    for (std::size_t i = 0; i < std::max<std::size_t>(1, options_.io_threads); ++i) {
+        auto io = std::make_unique<IoThread>();
+        io->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        io->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (io->epoll_fd < 0 || io->wake_fd < 0) throw_errno("epoll/eventfd");
+        io->mailbox->wake_fd = io->wake_fd;
+
+        epoll_event wake{};
+        wake.events = EPOLLIN;
+        wake.data.ptr = &io->wake_fd;
+        epoll_ctl(io->epoll_fd, EPOLL_CTL_ADD, io->wake_fd, &wake);
+        // EPOLLEXCLUSIVE: mỗi kết nối mới chỉ đánh thức một I/O thread.
+        epoll_event listen{};
+        listen.events = EPOLLIN | EPOLLEXCLUSIVE;
+        listen.data.ptr = nullptr;
+        if (epoll_ctl(io->epoll_fd, EPOLL_CTL_ADD, listen_fd_, &listen) < 0) throw_errno("epoll_ctl(listen)");
+
+        IoThread* raw = io.get();
+        io->thread = std::thread([this, raw]() { io_loop(*raw); });
+        io_threads_.push_back(std::move(io));
+    }
+    LOG_INFO("Epoll HTTP engine listening on port " << bound_port_ << " (" << io_threads_.size() << " I/O threads, "
+             << handler_pool_.stats().workers << " handler threads)");
+}
+
+void EpollHttpServer::stop() {
+    if (!running_.exchange(false)) return;
+    for (auto& io : io_threads_) epoll_ctl(io->epoll_fd, EPOLL_CTL_DEL, listen_fd_, nullptr);
+    handler_pool_.shutdown(); // handlers đang chạy xong hết trước khi đóng kết nối
+    for (auto& io : io_threads_) {
+        std::uint64_t one = 1;
+        (void)!::write(io->wake_fd, &one, sizeof(one));
+        if (io->thread.joinable()) io->thread.join();
+    }
+    for (auto& io : io_threads_) {
+        {
+            // Responder còn giữ (long-poll) không được ghi vào wake_fd / kết nối đã đóng
+            std::lock_guard<std::mutex> lock(io->mailbox->mutex);
+            io->mailbox->open = false;
+            io->mailbox->completions.clear();
+        }
+        std::vector<Connection*> open;
+        for (auto& kv : io->connections) open.push_back(kv.second.get());
+        for (Connection* c : open) close_connection(*io, *c);
+        io->closed.clear();
+        ::close(io->epoll_fd);
+        ::close(io->wake_fd);
+    }
+    io_threads_.clear();
+    if (listen_fd_ >= 0) ::close(listen_fd_);
+    listen_fd_ = -1;
+}
+
+EpollHttpServer::Stats EpollHttpServer::stats() const {
+    return Stats{connections_.load(), accepted_.load(), refused_.load(), requests_.load(),
+                 rejected_.load(), idle_closed_.load(), parse_errors_.load()};
+}
+
+void EpollHttpServer::io_loop(IoThread& io) {
+    epoll_event events[kMaxEvents];
+    Clock::time_point next_sweep = Clock::now() + std::chrono::seconds(1);
+
+    while (running_.load(std::memory_order_acquire)) {
+        int n = epoll_wait(io.epoll_fd, events, kMaxEvents, 1000);
+        if (n < 0 && errno != EINTR) {
+            LOG_ERROR("epoll_wait failed: " << std::strerror(errno));
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            const epoll_event& ev = events[i];
+            if (ev.data.ptr == nullptr) {
+                accept_connections(io);
+                continue;
+            }
+            if (ev.data.ptr == &io.wake_fd) {
+                std::uint64_t ignored;
+                (void)!::read(io.wake_fd, &ignored, sizeof(ignored));
+                std::vector<Mailbox::Completion> done;
+                {
+                    std::lock_guard<std::mutex> lock(io.mailbox->mutex);
+                    done.swap(io.mailbox->completions);
+                }
+                for (auto& d : done) complete(io, *d.connection, d.response, d.keep_alive);
+                continue;
+            }
+
+            Connection& c = *static_cast<Connection*>(ev.data.ptr);
+            if (c.fd < 0) continue; // đã đóng trước đó trong cùng batch
+            if (c.state == Connection::State::HANDLING) {
+                // Chỉ có thể là HUP/ERR: giữ object đến khi handler trả kết quả.
+                c.peer_closed = true;
+                epoll_ctl(io.epoll_fd, EPOLL_CTL_DEL, c.fd, nullptr);
+                continue;
+            }
+            if (ev.events & EPOLLIN) on_readable(io, c);
+            if (c.fd >= 0 && (ev.events & EPOLLOUT)) flush(io, c);
+            if (c.fd >= 0 && (ev.events & (EPOLLERR | EPOLLHUP)) && c.state != Connection::State::HANDLING) {
+                close_connection(io, c);
+            }
+        }
+        io.closed.clear();
+
+        Clock::time_point now = Clock::now();
+        if (now >= next_sweep) {
+            sweep_idle(io);
+            io.closed.clear();
+            next_sweep = now + std::chrono::seconds(1);
+        }
+    }
+}
+
+void EpollHttpServer::accept_connections(IoThread& io) {
+    for (int i = 0; i < kMaxAcceptsPerWake; ++i) {
+        sockaddr_storage peer{};
+        socklen_t peer_len = sizeof(peer);
+        int fd = ::accept4(listen_fd_, reinterpret_cast<sockaddr*>(&peer), &peer_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EMFILE || errno == ENFILE) LOG_WARN("accept: out of file descriptors");
+            return; // EAGAIN: hết kết nối chờ
+        }
+        if (connections_.load(std::memory_order_relaxed) >= options_.max_connections) {
+            refused_.fetch_add(1, std::memory_order_relaxed);
+            ::close(fd);
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        auto c = std::make_unique<Connection>();
+        c->fd = fd;
+        c->parser = HttpRequestParser(options_.limits);
+        c->last_activity = Clock::now();
+        describe(peer, c->peer_host, c->peer_port);
+        sockaddr_storage local{};
+        socklen_t local_len = sizeof(local);
+        if (getsockname(fd, reinterpret_cast<sockaddr*>(&local), &local_len) == 0) describe(local, c->local_host, c->local_port);
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = c.get();
+        if (epoll_ctl(io.epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            ::close(fd);
+            continue;
+        }
+        c->events = EPOLLIN;
+        io.connections.emplace(fd, std::move(c));
+        connections_.fetch_add(1, std::memory_order_relaxed);
+        accepted_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void EpollHttpServer::on_readable(IoThread& io, Connection& c) {
+    for (int i = 0; i < kMaxReadsPerWake; ++i) {
+        ssize_t n = ::recv(c.fd, io.read_buffer.data(), io.read_buffer.size(), 0);
+        if (n > 0) {
+            c.last_activity = Clock::now();
+            c.input.append(io.read_buffer.data(), static_cast<std::size_t>(n));
+            process_input(io, c);
+            if (c.fd < 0 || c.state != Connection::State::READING) return;
+            continue;
+        }
+        if (n == 0) { // client đóng kết nối
+            close_connection(io, c);
+            return;
+        }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) close_connection(io, c);
+        return;
+    }
+}
+
+void EpollHttpServer::process_input(IoThread& io, Connection& c) {
+    const std::size_t threshold = options_.body_spool_threshold;
+    auto sink = [this, &c, threshold](const char* data, std::size_t length) {
+        Request& r = *c.request;
+        if (!c.spool && r.body.size() + length > threshold) {
+            // Body lớn: chuyển sang file tạm để không giữ hàng GB trong RAM.
+            std::filesystem::path dir = options_.spool_dir.empty() ? std::filesystem::temp_directory_path()
+                                                                   : std::filesystem::path(options_.spool_dir);
+            std::string path = (dir / "fileserver-body-XXXXXX").string();
+            int fd = ::mkstemp(path.data());
+            if (fd < 0) return false;
+            c.spool = ::fdopen(fd, "wb");
+            if (!c.spool) { ::close(fd); std::remove(path.c_str()); return false; }
+            r.body_file = path;
+            if (!r.body.empty() && std::fwrite(r.body.data(), 1, r.body.size(), c.spool) != r.body.size()) return false;
+            std::string().swap(r.body);
+        }
+        if (c.spool) return std::fwrite(data, 1, length, c.spool) == length;
+        r.body.append(data, length);
+        return true;
+    };
+
+    while (c.state == Connection::State::READING && !c.input.empty()) {
+        if (!c.request) c.request = std::make_unique<Request>();
+        std::size_t consumed = 0;
+        HttpRequestParser::Status status = c.parser.parse(c.input.data(), c.input.size(), consumed, sink);
+        c.input.erase(0, consumed);
+
+        if (status == HttpRequestParser::Status::ERROR) {
+            parse_errors_.fetch_add(1, std::memory_order_relaxed);
+            send_error(io, c, c.parser.error_status(), c.parser.error_message());
+            return;
+        }
+        if (status == HttpRequestParser::Status::COMPLETE) {
+            dispatch(io, c);
+            return;
+        }
+        if (c.parser.head().expect_continue && c.parser.headers_complete() && !c.continue_sent) {
+            c.continue_sent = true;
+            c.out += "HTTP/1.1 100 Continue\r\n\r\n";
+            flush(io, c);
+            if (c.fd < 0) return;
+        }
+        return; // NEED_MORE: đã dùng hết input
+    }
+}
+
+void EpollHttpServer::dispatch(IoThread& io, Connection& c) {
+    requests_.fetch_add(1, std::memory_order_relaxed);
+    if (c.spool) {
+        bool ok = std::fflush(c.spool) == 0;
+        std::fclose(c.spool);
+        c.spool = nullptr;
+        if (!ok) { send_error(io, c, 500, "Could not store request body"); return; }
+    }
+    std::shared_ptr<Request> request(std::move(c.request));
+    request->head = std::move(c.parser.head());
+    request->body_size = c.parser.body_bytes();
+    request->peer_host = c.peer_host;
+    request->peer_port = c.peer_port;
+    request->local_host = c.local_host;
+    request->local_port = c.local_port;
+
+    const bool keep_alive = request->head.keep_alive;
+    c.head_only = request->head.method == "HEAD";
+    c.state = Connection::State::HANDLING;
+    set_interest(io, c, 0); // không đọc request kế tiếp (pipelining) cho tới khi trả lời xong
+
+    Connection* connection = &c;
+    std::shared_ptr<Mailbox> mailbox = io.mailbox;
+    try {
+        handler_pool_.submit([this, request, connection, mailbox, keep_alive]() {
+            bool deferred = false;
+            request->defer = [&deferred, &mailbox, connection, keep_alive]() {
+                if (deferred) throw std::logic_error("EpollHttpServer: request deferred twice");
+                deferred = true;
+                return std::shared_ptr<Responder>(new Responder(mailbox, connection, keep_alive));
+            };
+            Response response;
+            try {
+                handler_(*request, response);
+            } catch (const std::exception& e) {
+                LOG_ERROR("Unhandled exception in HTTP handler: " << e.what());
+                response = Response();
+                response.status = 500;
+                response.body = "Internal server error\n";
+            }
+            request->defer = nullptr;
+            if (!request->body_file.empty()) std::remove(request->body_file.c_str());
+            // Deferred: chỉ Responder được trả lời, kể cả khi handler ném sau khi defer
+            if (!deferred) mailbox->post(connection, std::move(response), keep_alive);
+        });
+    } catch (const ExecutorSaturated&) {
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        if (!request->body_file.empty()) std::remove(request->body_file.c_str());
+        Response busy;
+        busy.status = 503;
+        busy.headers.emplace_back("Retry-After", "1");
+        busy.headers.emplace_back("Content-Type", "text/plain");
+        busy.body = "Server busy, retry later.\n";
+        complete(io, c, busy, keep_alive);
+    }
+}
+
+void EpollHttpServer::complete(IoThread& io, Connection& c, Response& response, bool keep_alive) {
+    if (c.peer_closed) {
+        close_connection(io, c);
+        return;
+    }
+    if (!response.file_path.empty()) {
+        int fd = ::open(response.file_path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st{};
+        if (fd < 0 || ::fstat(fd, &st) < 0) {
+            if (fd >= 0) ::close(fd);
+            response = Response();
+            response.status = 404;
+            response.body = "File not found\n";
+        } else {
+            c.file_fd = fd;
+            c.file_offset = 0;
+            c.file_remaining = static_cast<std::uint64_t>(st.st_size);
+        }
+    }
+
+    const bool close = !keep_alive || response.close || !running_.load(std::memory_order_relaxed);
+    std::string& out = c.out;
+    out += "HTTP/1.1 ";
+    out += std::to_string(response.status);
+    out += ' ';
+    out += response.reason.empty() ? reason_phrase(response.status) : response.reason;
+    out += "\r\n";
+    for (const auto& h : response.headers) {
+        if (iequals(h.first, "Content-Length") || iequals(h.first, "Connection") || iequals(h.first, "Transfer-Encoding")) continue;
+        out += h.first;
+        out += ": ";
+        out += h.second;
+        out += "\r\n";
+    }
+    out += "Content-Length: ";
+    out += std::to_string(response.body.size() + c.file_remaining);
+    out += close ? "\r\nConnection: close\r\n\r\n" : "\r\nConnection: keep-alive\r\n\r\n";
+    if (c.head_only) {
+        if (c.file_fd >= 0) { ::close(c.file_fd); c.file_fd = -1; c.file_remaining = 0; }
+    } else {
+        out += response.body;
+    }
+
+    c.close_after_write = close;
+    c.state = Connection::State::WRITING;
+    flush(io, c);
+}
+
+void EpollHttpServer::send_error(IoThread& io, Connection& c, int status, const std::string& message) {
+    c.discard_body();
+    c.head_only = false;
+    Response r;
+    r.status = status;
+    r.headers.emplace_back("Content-Type", "text/plain");
+    r.body = message + "\n";
+    complete(io, c, r, false);
+}
+
+void EpollHttpServer::flush(IoThread& io, Connection& c) {
+    while (c.out_offset < c.out.size()) {
+        ssize_t n = ::send(c.fd, c.out.data() + c.out_offset, c.out.size() - c.out_offset, MSG_NOSIGNAL);
+        if (n > 0) { c.out_offset += static_cast<std::size_t>(n); continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            set_interest(io, c, (c.state == Connection::State::READING ? std::uint32_t(EPOLLIN) : 0u) | EPOLLOUT);
+            return;
+        }
+        close_connection(io, c);
+        return;
+    }
+    c.out.clear();
+    c.out_offset = 0;
+    if (c.out.capacity() > 256 * 1024) std::string().swap(c.out); // không giữ buffer lớn cho kết nối idle
+
+    while (c.file_fd >= 0 && c.file_remaining > 0) {
+        std::size_t chunk = static_cast<std::size_t>(std::min<std::uint64_t>(c.file_remaining, 1u << 30));
+        ssize_t n = ::sendfile(c.fd, c.file_fd, &c.file_offset, chunk);
+        if (n > 0) { c.file_remaining -= static_cast<std::uint64_t>(n); continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            set_interest(io, c, EPOLLOUT);
+            return;
+        }
+        close_connection(io, c); // lỗi, hoặc file bị cắt ngắn sau khi đã gửi Content-Length
+        return;
+    }
+    if (c.file_fd >= 0) { ::close(c.file_fd); c.file_fd = -1; }
+    c.last_activity = Clock::now();
+
+    if (c.state != Connection::State::WRITING) { // 100 Continue đã gửi xong, tiếp tục đọc body
+        set_interest(io, c, EPOLLIN);
+        return;
+    }
+    if (c.close_after_write) {
+        close_connection(io, c);
+        return;
+    }
+    c.state = Connection::State::READING;
+    c.parser.reset();
+    c.request.reset();
+    c.continue_sent = false;
+    set_interest(io, c, EPOLLIN);
+    process_input(io, c); // request pipelined đã nằm sẵn trong input
+}
+
+void EpollHttpServer::set_interest(IoThread& io, Connection& c, std::uint32_t events) {
+    if (c.events == events || c.peer_closed) return;
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.ptr = &c;
+    epoll_ctl(io.epoll_fd, EPOLL_CTL_MOD, c.fd, &ev);
+    c.events = events;
+}
+
+void EpollHttpServer::close_connection(IoThread& io, Connection& c) {
+    if (c.fd < 0) return;
+    if (!c.peer_closed) epoll_ctl(io.epoll_fd, EPOLL_CTL_DEL, c.fd, nullptr);
+    int fd = c.fd;
+    ::close(fd);
+    c.fd = -1;
+    if (c.file_fd >= 0) { ::close(c.file_fd); c.file_fd = -1; }
+    c.discard_body();
+    connections_.fetch_sub(1, std::memory_order_relaxed);
+
+    auto it = io.connections.find(fd);
+    if (it != io.connections.end()) {
+        io.closed.push_back(std::move(it->second)); // event khác trong batch có thể còn trỏ tới
+        io.connections.erase(it);
+    }
+}
+
+void EpollHttpServer::sweep_idle(IoThread& io) {
+    const Clock::time_point cutoff = Clock::now() - options_.idle_timeout;
+    std::vector<Connection*> expired;
+    for (auto& kv : io.connections) {
+        Connection& c = *kv.second;
+        if (c.state != Connection::State::HANDLING && c.last_activity < cutoff) expired.push_back(&c);
+    }
+    for (Connection* c : expired) {
+        idle_closed_.fetch_add(1, std::memory_order_relaxed);
+        close_connection(io, *c);
+    }
+}
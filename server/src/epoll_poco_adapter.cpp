@@ -0,0 +1,161 @@
+#include "epoll_poco_adapter.hpp"
+
+#include <Poco/Net/HTTPRequestHandler.h>
+#include <Poco/Net/HTTPServerRequest.h>
+#include <Poco/Net/HTTPServerResponse.h>
+#include <Poco/Net/SocketAddress.h>
+#include <Poco/String.h>
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <utility>
+#include <vector>
+
+namespace {
+    using Poco::Net::HTTPResponse;
+
+    // Read-only view of the in-memory body, no copy.
+    class BodyBuffer : public std::streambuf {
+    public:
+        explicit BodyBuffer(std::string& body) {
+            char* begin = body.data();
+            setg(begin, begin, begin + body.size());
+        }
+    };
+
+    class EpollServerResponse : public Poco::Net::HTTPServerResponse, public DeferrableResponse {
+    public:
+        explicit EpollServerResponse(EpollHttpServer::Request* request = nullptr) : request_(request) {}
+
+        // The engine already answered "Expect: 100-continue" before buffering the body.
+        void sendContinue() override {}
+
+        std::ostream& send() override {
+            sent_ = true;
+            return body_;
+        }
+
+        void sendFile(const std::string& path, const std::string& mediaType) override {
+            setContentLength64(static_cast<Poco::Int64>(std::filesystem::file_size(path)));
+            setContentType(mediaType);
+            file_path_ = path; // gửi bằng sendfile(2) từ I/O thread
+            sent_ = true;
+        }
+
+        void sendBuffer(const void* buffer, std::size_t length) override {
+            body_.write(static_cast<const char*>(buffer), static_cast<std::streamsize>(length));
+            sent_ = true;
+        }
+
+        void redirect(const std::string& uri, HTTPStatus status) override {
+            setStatusAndReason(status);
+            set("Location", uri);
+            sent_ = true;
+        }
+
+        void requireAuthentication(const std::string& realm) override {
+            setStatusAndReason(HTTPResponse::HTTP_UNAUTHORIZED);
+            set("WWW-Authenticate", "Basic realm=\"" + realm + "\"");
+            sent_ = true;
+        }
+
+        bool sent() const override { return sent_; }
+
+        std::function<void(const Writer&)> defer() override {
+            if (!request_ || !request_->defer) throw std::logic_error("Response cannot be deferred");
+            std::shared_ptr<EpollHttpServer::Responder> responder = request_->defer();
+            deferred_ = true;
+            std::vector<std::pair<std::string, std::string>> headers(begin(), end());
+            std::string version = getVersion();
+            return [responder, headers, version](const Writer& write) {
+                EpollServerResponse later;
+                later.setVersion(version);
+                for (const auto& h : headers) later.set(h.first, h.second);
+                EpollHttpServer::Response out;
+                try {
+                    write(later);
+                    later.moveTo(out);
+                } catch (const std::exception&) {
+                    out = EpollHttpServer::Response();
+                    out.status = 500;
+                    out.body = "Internal server error\n";
+                }
+                responder->complete(std::move(out));
+            };
+        }
+
+        bool deferred() const { return deferred_; }
+
+        void moveTo(EpollHttpServer::Response& out) {
+            out.status = static_cast<int>(getStatus());
+            for (auto it = begin(); it != end(); ++it) out.headers.emplace_back(it->first, it->second);
+            out.body = body_.str();
+            out.file_path = std::move(file_path_);
+            out.close = Poco::icompare(get("Connection", ""), "close") == 0;
+        }
+
+    private:
+        std::ostringstream body_;
+        std::string file_path_;
+        bool sent_ = false;
+        EpollHttpServer::Request* request_;
+        bool deferred_ = false;
+    };
+
+    class EpollServerRequest : public Poco::Net::HTTPServerRequest {
+    public:
+        EpollServerRequest(EpollHttpServer::Request& r, EpollServerResponse& response, const Poco::Net::HTTPServerParams& params)
+            : response_(response), params_(params),
+              client_(r.peer_host, r.peer_port), server_(r.local_host, r.local_port), memory_(nullptr) {
+            setMethod(r.head.method);
+            setURI(r.head.uri);
+            setVersion(r.head.version);
+            for (const auto& h : r.head.headers) add(h.first, h.second);
+            if (!r.body_file.empty()) {
+                file_.open(r.body_file, std::ios::binary);
+                stream_ = &file_;
+            } else {
+                buffer_ = std::make_unique<BodyBuffer>(r.body);
+                memory_.rdbuf(buffer_.get());
+                stream_ = &memory_;
+            }
+        }
+
+        std::istream& stream() override { return *stream_; }
+        const Poco::Net::SocketAddress& clientAddress() const override { return client_; }
+        const Poco::Net::SocketAddress& serverAddress() const override { return server_; }
+        const Poco::Net::HTTPServerParams& serverParams() const override { return params_; }
+        Poco::Net::HTTPServerResponse& response() const override { return response_; }
+        bool secure() const override { return false; }
+
+    private:
+        EpollServerResponse& response_;
+        const Poco::Net::HTTPServerParams& params_;
+        Poco::Net::SocketAddress client_;
+        Poco::Net::SocketAddress server_;
+        std::unique_ptr<BodyBuffer> buffer_;
+        std::istream memory_;
+        std::ifstream file_;
+        std::istream* stream_ = nullptr;
+    };
+}
+
+EpollHttpServer::Handler make_poco_handler(Poco::Net::HTTPRequestHandlerFactory& factory,
+                                           Poco::Net::HTTPServerParams::Ptr params) {
+    return [&factory, params](EpollHttpServer::Request& r, EpollHttpServer::Response& out) {
+        EpollServerResponse response(&r);
+        response.setVersion(r.head.version);
+        EpollServerRequest request(r, response, *params);
+        std::unique_ptr<Poco::Net::HTTPRequestHandler> handler(factory.createRequestHandler(request));
+        if (handler) {
+            handler->handleRequest(request, response);
+        } else {
+            response.setStatusAndReason(HTTPResponse::HTTP_NOT_IMPLEMENTED);
+        }
+        if (!response.deferred()) response.moveTo(out); // Deferred: trả lời qua Responder
+    };
+}
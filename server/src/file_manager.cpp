@@ -1,17 +1,121 @@
 #include "file_manager.hpp"
+#include "async_logger.hpp"
+#include "block_delta.hpp"
 #include "config.hpp"
+#include <algorithm>
+#include <atomic>
 #include <fstream>
 #include <iostream>
 #include <openssl/sha.h> // For checksums later
 #include <iomanip>
+#include <set>
 #include <sstream>
 #include <filesystem> // Đảm bảo include
 #include <chrono>  
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
 namespace fs = std::filesystem;
 
 
 
-FileManager::FileManager(Database& db) : db_(db) {}
+namespace {
+    // File tạm cùng thư mục với target để rename là atomic; tên riêng cho mỗi lần gọi
+    fs::path temp_path_for(const fs::path& target, const char* tag) {
+        static std::atomic<unsigned long> temp_counter{0};
+        return target.parent_path() /
+            ("." + target.filename().string() + "." + tag + "-" + std::to_string(++temp_counter) + ".tmp");
+    }
+
+    // Khác nullptr khi thread đang chạy apply_metadata_batch: directory_changed chỉ ghi lại thư mục
+    thread_local std::set<std::string>* batch_changed_dirs = nullptr;
+
+    // Các thư mục tổ tiên (kể cả dir) chưa có trên đĩa, nông nhất trước
+    std::vector<fs::path> missing_directories(const fs::path& dir) {
+        std::vector<fs::path> missing;
+        for (fs::path p = dir; !p.empty() && !fs::exists(p); p = p.parent_path()) missing.push_back(p);
+        std::reverse(missing.begin(), missing.end());
+        return missing;
+    }
+
+    // Khoá của file_recipes: path canonical như file_metadata.file_path
+    std::string recipe_key(const fs::path& path) {
+        std::error_code ec;
+        fs::path canonical = fs::weakly_canonical(path, ec);
+        return (ec ? path : canonical).string();
+    }
+
+    std::string sha256_hex(std::istream& in) {
+        unsigned char hash_digest[SHA256_DIGEST_LENGTH];
+        SHA256_CTX sha256_ctx;
+        SHA256_Init(&sha256_ctx);
+        char buffer[8192];
+        while (in.good()) {
+            in.read(buffer, sizeof(buffer));
+            std::streamsize bytes_read = in.gcount();
+            if (bytes_read > 0) {
+                SHA256_Update(&sha256_ctx, buffer, static_cast<size_t>(bytes_read));
+            }
+        }
+        if (in.bad()) return "";
+        SHA256_Final(hash_digest, &sha256_ctx);
+        std::ostringstream ss;
+        ss << std::hex << std::setfill('0');
+        for (int i = 0; i < SHA256_DIGEST_LENGTH; ++i) {
+            ss << std::setw(2) << static_cast<unsigned int>(hash_digest[i]);
+        }
+        return ss.str();
+    }
+
+    // Reflink (FICLONE, btrfs / XFS): dest dùng chung block với source cho tới khi một bên bị ghi.
+    // false nếu filesystem hoặc nền tảng không hỗ trợ; dest khi đó không tồn tại.
+    bool reflink_file(const fs::path& source, const fs::path& dest) {
+#if defined(__linux__) && defined(FICLONE)
+        const int in = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in < 0) return false;
+        const int out = ::open(dest.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        const bool cloned = out >= 0 && ::ioctl(out, FICLONE, in) == 0;
+        if (out >= 0) ::close(out);
+        ::close(in);
+        if (!cloned) {
+            std::error_code ec;
+            fs::remove(dest, ec);
+        }
+        return cloned;
+#else
+        (void)source;
+        (void)dest;
+        return false;
+#endif
+    }
+
+    // istream đọc thẳng từ bộ nhớ (không copy dữ liệu upload)
+    class MemoryStreamBuf : public std::streambuf {
+    public:
+        MemoryStreamBuf(const char* data, std::size_t size) {
+            char* begin = const_cast<char*>(data);
+            setg(begin, begin, begin + size);
+        }
+    };
+}
+
+FileManager::FileManager(Database& db) : db_(db), tree_hashes_(db), chunks_(db, Config::STORAGE_CHUNKS_ROOT) {}
+
+bool FileManager::chunked_storage() const {
+    return Config::STORAGE_MODE == "chunked";
+}
+
+void FileManager::directory_changed(const std::string& dir_path) {
+    if (batch_changed_dirs) { // apply_metadata_batch tính lại và notify một lần sau cùng
+        batch_changed_dirs->insert(dir_path);
+        return;
+    }
+    tree_hashes_.refresh(dir_path);
+    changes_.notify(dir_path); // Sau refresh: watcher được đánh thức sẽ đọc thấy hash mới
+}
 
 // Helper to ensure user_path is within base_path and doesn't use ".." to escape.
 // Returns the canonical absolute path if safe, otherwise an empty path.
@@ -19,7 +123,7 @@ fs::path FileManager::resolve_safe_path(const fs::path& base_path, const std::st
     fs::path relative_user_path(relative_user_path_str);
     for (const auto& part : relative_user_path) {
         if (part == "..") {
-            std::cerr << "Path traversal attempt detected: " << relative_user_path_str << std::endl;
+            LOG_WARN("Path traversal attempt detected: " << relative_user_path_str);
             return {};
         }
     }
@@ -30,7 +134,7 @@ fs::path FileManager::resolve_safe_path(const fs::path& base_path, const std::st
         canonical_base_path = fs::weakly_canonical(base_path);
         canonical_full_path = fs::weakly_canonical(full_path);
     } catch (const fs::filesystem_error& e) {
-        std::cerr << "Path canonicalization error (" << full_path << "): " << e.what() << std::endl;
+        LOG_ERROR("Path canonicalization error (" << full_path << "): " << e.what());
         return {};
     }
     std::string full_str = canonical_full_path.string();
@@ -40,7 +144,7 @@ fs::path FileManager::resolve_safe_path(const fs::path& base_path, const std::st
             return canonical_full_path;
         }
     }
-    std::cerr << "Path " << full_path << " is outside base " << base_path << std::endl;
+    LOG_WARN("Path " << full_path << " is outside base " << base_path);
     return {};
 }
 
@@ -52,30 +156,319 @@ bool FileManager::upload_file(const fs::path& server_base_path, const std::strin
     fs::path full_server_path = resolve_safe_path(server_base_path, relative_path);
 
     if (full_server_path.empty()) {
-        std::cerr << "Upload: unsafe or invalid path: " << relative_path_str << " relative to " << server_base_path << std::endl;
+        LOG_WARN("Upload: unsafe or invalid path: " << relative_path_str << " relative to " << server_base_path);
         return false;
     }
     
     try {
-        // Create parent directories if they don't exist
-        if (full_server_path.has_parent_path()) {
-            fs::create_directories(full_server_path.parent_path());
-        }
-
-        std::ofstream outfile(full_server_path, std::ios::binary | std::ios::trunc);
-        if (!outfile) {
-            std::cerr << "Failed to open file for writing: " << full_server_path << std::endl;
-            return false;
+        create_parent_directories(full_server_path, user_id);
+
+        if (chunked_storage()) {
+            MemoryStreamBuf buffer(data.data(), data.size());
+            std::istream in(&buffer);
+            if (!store_as_chunks(in, full_server_path, user_id)) {
+                LOG_ERROR("Failed to store file as chunks: " << full_server_path);
+                return false;
+            }
+        } else {
+            std::ofstream outfile(full_server_path, std::ios::binary | std::ios::trunc);
+            if (!outfile) {
+                LOG_ERROR("Failed to open file for writing: " << full_server_path);
+                return false;
+            }
+            outfile.write(data.data(), data.size());
+            outfile.close();
+            chunks_.remove_recipes(recipe_key(full_server_path)); // File thật thay cho placeholder cũ (nếu có)
         }
-        outfile.write(data.data(), data.size());
-        outfile.close();
-        std::cout << "Uploaded file: " << full_server_path << std::endl;
+        LOG_INFO("Uploaded file: " << full_server_path);
         update_file_metadata(full_server_path, user_id);
+        directory_changed(full_server_path.parent_path().string());
         return true;
     } catch (const fs::filesystem_error& e) {
-        std::cerr << "Filesystem error uploading file " << full_server_path << ": " << e.what() << std::endl;
+        LOG_ERROR("Filesystem error uploading file " << full_server_path << ": " << e.what());
+        return false;
+    }
+}
+
+void FileManager::create_parent_directories(const fs::path& full_server_path, int user_id) {
+    // Create parent directories if they don't exist; they get metadata rows too so that
+    // the directory tree hashes see them.
+    std::vector<fs::path> created_dirs;
+    for (fs::path dir = full_server_path.parent_path(); !dir.empty() && !fs::exists(dir); dir = dir.parent_path()) {
+        created_dirs.push_back(dir);
+    }
+    if (full_server_path.has_parent_path()) {
+        fs::create_directories(full_server_path.parent_path());
+    }
+    for (auto it = created_dirs.rbegin(); it != created_dirs.rend(); ++it) {
+        update_file_metadata(*it, user_id);
+    }
+}
+
+bool FileManager::store_as_chunks(std::istream& in, const fs::path& full_server_path, int user_id) {
+    ChunkRecipe recipe;
+    if (!chunks_.ingest(in, recipe, user_id)) return false;
+    const std::string key = recipe_key(full_server_path);
+    if (!chunks_.put_recipe(key, recipe)) return false;
+    if (!write_placeholder(full_server_path, recipe.size)) {
+        chunks_.remove_recipes(key); // Giữ nguyên file trên đĩa còn hơn recipe không khớp với nó
+        return false;
+    }
+    return true;
+}
+
+bool FileManager::write_placeholder(const fs::path& full_server_path, std::uint64_t size) {
+    const fs::path temp_path = temp_path_for(full_server_path, "chunked");
+    std::error_code ec;
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            LOG_ERROR("Failed to create placeholder " << temp_path);
+            return false;
+        }
+    }
+    fs::resize_file(temp_path, size, ec); // Không ghi byte nào: file thưa
+    if (!ec) fs::rename(temp_path, full_server_path, ec);
+    if (ec) {
+        LOG_ERROR("Failed to write placeholder for " << full_server_path << ": " << ec.message());
+        fs::remove(temp_path, ec);
+        return false;
+    }
+    return true;
+}
+
+bool FileManager::commit_temp_file(const fs::path& temp_path, const fs::path& full_server_path, int user_id) {
+    std::error_code ec;
+    if (chunked_storage()) {
+        bool stored = false;
+        {
+            std::ifstream in(temp_path, std::ios::binary);
+            stored = in && store_as_chunks(in, full_server_path, user_id);
+        }
+        fs::remove(temp_path, ec);
+        return stored;
+    }
+    fs::rename(temp_path, full_server_path, ec);
+    if (ec) {
+        LOG_ERROR("Failed to move " << temp_path << " to " << full_server_path << ": " << ec.message());
+        fs::remove(temp_path, ec);
         return false;
     }
+    chunks_.remove_recipes(recipe_key(full_server_path));
+    return true;
+}
+
+DeltaApplyResult FileManager::apply_delta(const fs::path& server_base_path, const std::string& relative_path_str, std::istream& delta,
+                                          const std::string& expected_base_checksum, const std::string& expected_checksum, int user_id) {
+    fs::path full_server_path = resolve_safe_path(server_base_path, relative_path_str);
+    if (full_server_path.empty() || !fs::is_regular_file(full_server_path)) {
+        LOG_WARN("Apply delta: base file not found: " << relative_path_str << " relative to " << server_base_path);
+        return DeltaApplyResult::NOT_FOUND;
+    }
+    if (!expected_base_checksum.empty() && calculate_checksum(full_server_path) != expected_base_checksum) {
+        return DeltaApplyResult::BASE_CHANGED;
+    }
+
+    const fs::path temp_path = temp_path_for(full_server_path, "delta");
+    auto discard = [&temp_path](DeltaApplyResult result) {
+        std::error_code ec;
+        fs::remove(temp_path, ec);
+        return result;
+    };
+
+    try {
+        {
+            auto base = open_file(full_server_path);
+            std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+            if (!base || !out) {
+                LOG_ERROR("Apply delta: cannot open " << full_server_path << " or " << temp_path);
+                return discard(DeltaApplyResult::IO_ERROR);
+            }
+            if (!BlockDelta::apply_delta(*base, delta, out)) {
+                LOG_WARN("Apply delta: invalid delta for " << full_server_path);
+                return discard(DeltaApplyResult::INVALID_DELTA);
+            }
+            out.close();
+            if (!out) return discard(DeltaApplyResult::IO_ERROR);
+        }
+        if (!expected_checksum.empty() && calculate_checksum(temp_path) != expected_checksum) {
+            LOG_WARN("Apply delta: checksum mismatch for " << full_server_path);
+            return discard(DeltaApplyResult::CHECKSUM_MISMATCH);
+        }
+        if (!commit_temp_file(temp_path, full_server_path, user_id)) return DeltaApplyResult::IO_ERROR;
+    } catch (const fs::filesystem_error& e) {
+        LOG_ERROR("Filesystem error applying delta to " << full_server_path << ": " << e.what());
+        return discard(DeltaApplyResult::IO_ERROR);
+    }
+
+    LOG_INFO("Patched file: " << full_server_path);
+    update_file_metadata(full_server_path, user_id);
+    directory_changed(full_server_path.parent_path().string());
+    return DeltaApplyResult::OK;
+}
+
+ChunkCommitResult FileManager::commit_chunks(const fs::path& server_base_path, const std::string& relative_path_str, ChunkRecipe recipe,
+                                             const std::string& expected_checksum, int user_id) {
+    fs::path full_server_path = resolve_safe_path(server_base_path, relative_path_str);
+    std::error_code ec;
+    if (full_server_path.empty() || fs::is_directory(full_server_path, ec)) {
+        LOG_WARN("Commit chunks: unsafe or invalid path: " << relative_path_str << " relative to " << server_base_path);
+        return ChunkCommitResult::INVALID_PATH;
+    }
+    if (!chunks_.complete_recipe(recipe, user_id)) return ChunkCommitResult::MISSING_CHUNKS;
+
+    // Hash từng chunk đã được kiểm lúc upload; checksum cả file kiểm thứ tự và đủ chunk
+    {
+        auto content = chunks_.open(recipe);
+        recipe.checksum = sha256_hex(*content);
+    }
+    if (recipe.checksum.empty()) {
+        LOG_ERROR("Commit chunks: cannot read chunks for " << full_server_path);
+        return ChunkCommitResult::IO_ERROR;
+    }
+    if (!expected_checksum.empty() && recipe.checksum != expected_checksum) {
+        LOG_WARN("Commit chunks: checksum mismatch for " << full_server_path);
+        return ChunkCommitResult::CHECKSUM_MISMATCH;
+    }
+
+    try {
+        create_parent_directories(full_server_path, user_id);
+        if (chunked_storage()) {
+            const std::string key = recipe_key(full_server_path);
+            if (!chunks_.put_recipe(key, recipe)) return ChunkCommitResult::MISSING_CHUNKS;
+            if (!write_placeholder(full_server_path, recipe.size)) {
+                chunks_.remove_recipes(key);
+                return ChunkCommitResult::IO_ERROR;
+            }
+        } else {
+            // Plain: ghép ra file thật; các chunk hết được dùng và sẽ bị GC dọn
+            const fs::path temp_path = temp_path_for(full_server_path, "commit");
+            {
+                auto content = chunks_.open(recipe);
+                std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+                if (recipe.size > 0) out << content->rdbuf();
+                out.close();
+                if (!out || fs::file_size(temp_path, ec) != recipe.size) {
+                    LOG_ERROR("Commit chunks: failed to assemble " << temp_path);
+                    fs::remove(temp_path, ec);
+                    return ChunkCommitResult::IO_ERROR;
+                }
+            }
+            if (!commit_temp_file(temp_path, full_server_path, user_id)) return ChunkCommitResult::IO_ERROR;
+        }
+    } catch (const fs::filesystem_error& e) {
+        LOG_ERROR("Filesystem error committing chunks to " << full_server_path << ": " << e.what());
+        return ChunkCommitResult::IO_ERROR;
+    }
+
+    LOG_INFO("Committed file from " << recipe.chunks.size() << " chunk(s): " << full_server_path);
+    update_file_metadata(full_server_path, user_id);
+    directory_changed(full_server_path.parent_path().string());
+    return ChunkCommitResult::OK;
+}
+
+ClaimResult FileManager::claim_by_checksum(const fs::path& server_base_path, const std::string& relative_path_str, const std::string& checksum,
+                                           const std::function<bool(const fs::path&)>& can_read, int user_id, std::uint64_t* claimed_bytes) {
+    constexpr std::size_t kMaxCandidates = 8; // Các bản trùng nhau: thử vài bản là đủ
+    fs::path full_server_path = resolve_safe_path(server_base_path, relative_path_str);
+    std::error_code ec;
+    if (full_server_path.empty() || checksum.empty() || fs::is_directory(full_server_path, ec)) {
+        LOG_WARN("Claim: unsafe or invalid path: " << relative_path_str << " relative to " << server_base_path);
+        return ClaimResult::INVALID_PATH;
+    }
+    const std::string target_key = recipe_key(full_server_path);
+
+    try {
+        for (const fs::path& source : files_with_checksum(checksum, kMaxCandidates)) {
+            if (!fs::is_regular_file(source, ec) || !can_read(source)) continue;
+            create_parent_directories(full_server_path, user_id);
+
+            bool claimed = false;
+            std::uint64_t size = 0;
+            auto recipe = chunks_.recipe(source.string());
+            if (chunked_storage() && recipe && recipe->checksum == checksum) {
+                // Chỉ thêm một recipe: không đọc, không ghi byte nội dung nào
+                claimed = chunks_.put_recipe(target_key, *recipe) && write_placeholder(full_server_path, recipe->size);
+                if (!claimed) chunks_.remove_recipes(target_key);
+                size = recipe->size;
+            } else {
+                const fs::path temp_path = temp_path_for(full_server_path, "claim");
+                if (!materialize_copy(source, temp_path, checksum)) {
+                    fs::remove(temp_path, ec);
+                    LOG_WARN("Claim: " << source << " no longer matches checksum " << checksum);
+                    continue;
+                }
+                size = fs::file_size(temp_path, ec);
+                claimed = commit_temp_file(temp_path, full_server_path, user_id);
+            }
+            if (!claimed) return ClaimResult::IO_ERROR;
+
+            LOG_INFO("Claimed " << full_server_path << " from " << source << " (" << size << " bytes)");
+            if (claimed_bytes) *claimed_bytes = size;
+            update_file_metadata(full_server_path, user_id);
+            directory_changed(full_server_path.parent_path().string());
+            return ClaimResult::OK;
+        }
+    } catch (const fs::filesystem_error& e) {
+        LOG_ERROR("Filesystem error claiming " << full_server_path << ": " << e.what());
+        return ClaimResult::IO_ERROR;
+    }
+    return ClaimResult::NOT_FOUND;
+}
+
+std::vector<fs::path> FileManager::files_with_checksum(const std::string& checksum, std::size_t limit) {
+    std::vector<fs::path> files;
+    char* sql = sqlite3_mprintf(
+        "SELECT file_path FROM file_metadata WHERE checksum = %Q AND is_deleted = 0 AND is_directory = 0 LIMIT %d;",
+        checksum.c_str(), static_cast<int>(limit));
+    if (!sql) return files;
+    std::lock_guard<std::recursive_mutex> db_lock(db_.write_mutex()); // Không đọc dòng của một batch chưa commit
+    db_.execute_query(sql, [&files](sqlite3_stmt* stmt) {
+        const unsigned char* path = sqlite3_column_text(stmt, 0);
+        if (path) files.emplace_back(reinterpret_cast<const char*>(path));
+    });
+    sqlite3_free(sql);
+    return files;
+}
+
+bool FileManager::materialize_copy(const fs::path& source, const fs::path& temp_path, const std::string& checksum) {
+    std::error_code ec;
+    bool copied = false;
+    if (!is_stored_as_chunks(source)) {
+        copied = reflink_file(source, temp_path) ||
+                 fs::copy_file(source, temp_path, fs::copy_options::overwrite_existing, ec);
+    } else {
+        // Placeholder: ghép nội dung từ chunk
+        std::uint64_t size = 0;
+        auto in = open_file(source, &size);
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (in && out) {
+            if (size > 0) out << in->rdbuf();
+            out.close();
+            copied = out && fs::file_size(temp_path, ec) == size;
+        }
+    }
+    // file_metadata có thể cũ (file bị sửa ngoài server): kiểm lại nội dung thật
+    return copied && calculate_checksum(temp_path) == checksum;
+}
+
+std::unique_ptr<std::istream> FileManager::open_file(const fs::path& full_server_path, std::uint64_t* size) {
+    if (auto recipe = chunks_.recipe(recipe_key(full_server_path))) {
+        if (size) *size = recipe->size;
+        return chunks_.open(*recipe);
+    }
+    auto in = std::make_unique<std::ifstream>(full_server_path, std::ios::binary);
+    if (!*in) return nullptr;
+    if (size) {
+        std::error_code ec;
+        *size = fs::file_size(full_server_path, ec);
+        if (ec) return nullptr;
+    }
+    return in;
+}
+
+bool FileManager::is_stored_as_chunks(const fs::path& full_server_path) {
+    return chunks_.recipe(recipe_key(full_server_path)).has_value();
 }
 
 std::optional<std::vector<char>> FileManager::download_file(const fs::path& server_base_path, const std::string& relative_path_str, int user_id) {
@@ -83,29 +476,28 @@ std::optional<std::vector<char>> FileManager::download_file(const fs::path& serv
     fs::path full_server_path = resolve_safe_path(server_base_path, relative_path);
 
     if (full_server_path.empty() || !fs::exists(full_server_path) || fs::is_directory(full_server_path)) {
-        std::cerr << "Download: File not found or is a directory: " << full_server_path << std::endl;
+        LOG_WARN("Download: File not found or is a directory: " << full_server_path);
         return std::nullopt;
     }
 
     try {
-        std::ifstream infile(full_server_path, std::ios::binary | std::ios::ate);
+        std::uint64_t size = 0;
+        auto infile = open_file(full_server_path, &size);
         if (!infile) {
-            std::cerr << "Failed to open file for reading: " << full_server_path << std::endl;
+            LOG_ERROR("Failed to open file for reading: " << full_server_path);
             return std::nullopt;
         }
-        std::streamsize size = infile.tellg();
-        infile.seekg(0, std::ios::beg);
 
         std::vector<char> buffer(size);
-        if (infile.read(buffer.data(), size)) {
-            std::cout << "Downloaded file: " << full_server_path << std::endl;
+        if (size == 0 || infile->read(buffer.data(), static_cast<std::streamsize>(size))) {
+            LOG_INFO("Downloaded file: " << full_server_path);
             return buffer;
         } else {
-            std::cerr << "Failed to read file: " << full_server_path << std::endl;
+            LOG_ERROR("Failed to read file: " << full_server_path);
             return std::nullopt;
         }
     } catch (const fs::filesystem_error& e) {
-        std::cerr << "Filesystem error downloading file " << full_server_path << ": " << e.what() << std::endl;
+        LOG_ERROR("Filesystem error downloading file " << full_server_path << ": " << e.what());
         return std::nullopt;
     }
 }
@@ -115,78 +507,222 @@ bool FileManager::delete_file_or_directory(const fs::path& server_base_path, con
     fs::path full_server_path = resolve_safe_path(server_base_path, relative_path);
 
     if (full_server_path.empty() || !fs::exists(full_server_path)) {
-        std::cerr << "Delete: Path not found or unsafe: " << full_server_path << std::endl;
+        LOG_WARN("Delete: Path not found or unsafe: " << full_server_path);
         return false;
     }
     // Prevent deleting the base path itself
     if (full_server_path == fs::weakly_canonical(server_base_path)) {
-        std::cerr << "Delete: Attempt to delete base path denied: " << full_server_path << std::endl;
+        LOG_WARN("Delete: Attempt to delete base path denied: " << full_server_path);
         return false;
     }
 
     try {
-        if (fs::is_directory(full_server_path)) {
-           
-            for (const auto& entry : fs::recursive_directory_iterator(full_server_path)) {
-                remove_file_metadata(entry.path());
-            }
-            
-            remove_file_metadata(full_server_path);
-
-            
-            fs::remove_all(full_server_path);
-        } else {
-            
-            remove_file_metadata(full_server_path);
-            fs::remove(full_server_path);
-        }
-        // --- KẾT THÚC SỬA ĐỔI ---
-
-        std::cout << "Deleted: " << full_server_path << std::endl;
+        remove_path(full_server_path);
+        LOG_INFO("Deleted: " << full_server_path);
         return true;
     } catch (const fs::filesystem_error& e) {
-        std::cerr << "Filesystem error deleting " << full_server_path << ": " << e.what() << std::endl;
+        LOG_ERROR("Filesystem error deleting " << full_server_path << ": " << e.what());
         return false;
     }
 }
 
+void FileManager::remove_path(const fs::path& full_server_path, const fs::path& staging) {
+    if (fs::is_directory(full_server_path)) {
+        for (const auto& entry : fs::recursive_directory_iterator(full_server_path)) {
+            remove_file_metadata(entry.path());
+        }
+        remove_file_metadata(full_server_path);
+        if (staging.empty()) fs::remove_all(full_server_path); else fs::rename(full_server_path, staging);
+        tree_hashes_.drop_subtree(full_server_path.string());
+    } else {
+        remove_file_metadata(full_server_path);
+        if (staging.empty()) fs::remove(full_server_path); else fs::rename(full_server_path, staging);
+    }
+    chunks_.remove_recipes(full_server_path.string());
+    directory_changed(full_server_path.parent_path().string());
+}
+
 bool FileManager::create_directory(const fs::path& server_base_path, const std::string& relative_path_str, int user_id) {
     fs::path relative_path(relative_path_str);
     fs::path full_server_path = resolve_safe_path(server_base_path, relative_path);
 
     if (full_server_path.empty()) {
-        std::cerr << "Create Directory: Unsafe or invalid path: " << relative_path_str << std::endl;
+        LOG_WARN("Create Directory: Unsafe or invalid path: " << relative_path_str);
         return false;
     }
 
     try {
         if (fs::create_directories(full_server_path)) {
-            std::cout << "Created directory: " << full_server_path << std::endl;
+            LOG_INFO("Created directory: " << full_server_path);
             // Optionally, add metadata for directories if needed, e.g., for empty dir sync
             // update_file_metadata(full_server_path, user_id); // Or a specific dir metadata function
             update_file_metadata(full_server_path, user_id);
+            directory_changed(full_server_path.parent_path().string());
             return true;
         } else {
              // It might already exist, which is not an error for create_directories
             if (fs::exists(full_server_path) && fs::is_directory(full_server_path)) {
-                 std::cout << "Directory already exists: " << full_server_path << std::endl;
+                 LOG_DEBUG("Directory already exists: " << full_server_path);
+                 // Thư mục có thể đã được tạo ngầm (chưa có dòng metadata): ghi lại để tree hash thấy nó
+                 update_file_metadata(full_server_path, user_id);
+                 directory_changed(full_server_path.parent_path().string());
                  return true;
             }
-            std::cerr << "Failed to create directory: " << full_server_path << std::endl;
+            LOG_ERROR("Failed to create directory: " << full_server_path);
             return false;
         }
     } catch (const fs::filesystem_error& e) {
-        std::cerr << "Filesystem error creating directory " << full_server_path << ": " << e.what() << std::endl;
+        LOG_ERROR("Filesystem error creating directory " << full_server_path << ": " << e.what());
         return false;
     }
 }
 
+// Những gì batch đã làm trên đĩa, để huỷ được theo thứ tự ngược lại
+struct FileManager::BatchUndo {
+    enum class Kind { CREATED_DIRECTORY, RENAMED, STAGED };
+    struct Action {
+        Kind kind;
+        fs::path from;
+        fs::path to; // RENAMED: path mới; STAGED: chỗ tạm
+    };
+    std::vector<Action> actions;
+
+    void created(const std::vector<fs::path>& dirs) {
+        for (const auto& dir : dirs) actions.push_back({Kind::CREATED_DIRECTORY, dir, {}});
+    }
+
+    void revert(std::size_t mark) {
+        while (actions.size() > mark) {
+            const Action& action = actions.back();
+            std::error_code ec;
+            if (action.kind == Kind::CREATED_DIRECTORY) {
+                fs::remove(action.from, ec); // Chưa tạo được thì không có gì để xoá
+            } else {
+                fs::rename(action.to, action.from, ec);
+            }
+            if (ec) LOG_ERROR("Batch: could not undo change of " << action.from << ": " << ec.message());
+            actions.pop_back();
+        }
+    }
+};
+
+namespace {
+    struct BatchScope {
+        explicit BatchScope(std::set<std::string>* dirs) { batch_changed_dirs = dirs; }
+        ~BatchScope() { batch_changed_dirs = nullptr; }
+    };
+}
+
+MetadataOpResult FileManager::apply_metadata_op(const fs::path& server_base_path, const MetadataOp& op,
+                                                const std::function<bool(const fs::path&)>& can_write, int user_id, BatchUndo* undo) {
+    const fs::path base = fs::weakly_canonical(server_base_path);
+    const fs::path full_server_path = resolve_safe_path(server_base_path, op.path);
+    if (full_server_path.empty() || full_server_path == base) return MetadataOpResult::INVALID_PATH;
+
+    try {
+        switch (op.type) {
+            case MetadataOpType::MKDIR: {
+                if (!can_write(full_server_path.parent_path())) return MetadataOpResult::FORBIDDEN;
+                if (fs::exists(full_server_path) && !fs::is_directory(full_server_path)) return MetadataOpResult::CONFLICT;
+                undo->created(missing_directories(full_server_path));
+                create_parent_directories(full_server_path, user_id);
+                return create_directory(server_base_path, op.path, user_id) ? MetadataOpResult::OK : MetadataOpResult::IO_ERROR;
+            }
+            case MetadataOpType::DELETE: {
+                if (!can_write(full_server_path)) return MetadataOpResult::FORBIDDEN;
+                if (!fs::exists(full_server_path)) return MetadataOpResult::NOT_FOUND;
+                // Thư mục riêng của server, ngoài users_root / shared_root: không user nào chạm tới được
+                const fs::path trash = Config::STORAGE_BATCH_TRASH_DIR;
+                fs::create_directories(trash);
+                const fs::path staging = temp_path_for(trash / full_server_path.filename(), "deleted");
+                remove_path(full_server_path, staging);
+                undo->actions.push_back({BatchUndo::Kind::STAGED, full_server_path, staging});
+                return MetadataOpResult::OK;
+            }
+            case MetadataOpType::RENAME: {
+                const fs::path new_full_path = resolve_safe_path(server_base_path, op.new_path);
+                if (new_full_path.empty() || new_full_path == base || new_full_path == full_server_path) return MetadataOpResult::INVALID_PATH;
+                const std::string old_prefix = full_server_path.string() + "/";
+                if (new_full_path.string().compare(0, old_prefix.size(), old_prefix) == 0) return MetadataOpResult::INVALID_PATH; // Vào chính nó
+                if (!can_write(full_server_path.parent_path()) || !can_write(new_full_path.parent_path())) return MetadataOpResult::FORBIDDEN;
+                if (!fs::exists(full_server_path)) return MetadataOpResult::NOT_FOUND;
+                if (fs::exists(new_full_path)) return MetadataOpResult::CONFLICT;
+                undo->created(missing_directories(new_full_path.parent_path()));
+                create_parent_directories(new_full_path, user_id);
+                fs::rename(full_server_path, new_full_path);
+                undo->actions.push_back({BatchUndo::Kind::RENAMED, full_server_path, new_full_path});
+                return update_metadata_after_rename(full_server_path, new_full_path, user_id) ? MetadataOpResult::OK : MetadataOpResult::IO_ERROR;
+            }
+        }
+    } catch (const fs::filesystem_error& e) {
+        LOG_ERROR("Batch: filesystem error on " << op.path << ": " << e.what());
+    }
+    return MetadataOpResult::IO_ERROR;
+}
+
+std::vector<MetadataOpResult> FileManager::apply_metadata_batch(const fs::path& server_base_path, const std::vector<MetadataOp>& ops, bool atomic,
+                                                                const std::function<bool(const fs::path&)>& can_write, int user_id) {
+    std::vector<MetadataOpResult> results(ops.size(), MetadataOpResult::NOT_APPLIED);
+    if (ops.empty()) return results;
+    // Giữ đến COMMIT/ROLLBACK: writer của thread khác trên cùng connection phải chờ (xem Database::write_mutex)
+    std::lock_guard<std::recursive_mutex> db_lock(db_.write_mutex());
+    if (!db_.execute("BEGIN IMMEDIATE;")) {
+        std::fill(results.begin(), results.end(), MetadataOpResult::IO_ERROR);
+        return results;
+    }
+
+    std::set<std::string> changed_dirs;
+    BatchUndo undo;
+    bool aborted = false;
+    {
+        BatchScope scope(&changed_dirs);
+        for (std::size_t i = 0; i < ops.size() && !aborted; ++i) {
+            // Mỗi thao tác là một savepoint: lỗi giữa chừng không để lại nửa thao tác kể cả khi không atomic
+            const std::size_t mark = undo.actions.size();
+            if (!db_.savepoint("metadata_op")) {
+                results[i] = MetadataOpResult::IO_ERROR;
+            } else {
+                results[i] = apply_metadata_op(server_base_path, ops[i], can_write, user_id, &undo);
+                if (results[i] == MetadataOpResult::OK) {
+                    db_.release("metadata_op");
+                } else {
+                    db_.rollback_to("metadata_op");
+                    undo.revert(mark);
+                }
+            }
+            aborted = atomic && results[i] != MetadataOpResult::OK;
+        }
+        if (!aborted) {
+            for (const auto& dir : changed_dirs) {
+                if (fs::is_directory(dir)) tree_hashes_.refresh(dir); // Thư mục đã bị xoá / đổi tên thì không
+            }
+        }
+    }
+
+    if (!aborted && db_.execute("COMMIT;")) {
+        std::error_code ec;
+        for (const auto& action : undo.actions) {
+            if (action.kind == BatchUndo::Kind::STAGED) fs::remove_all(action.to, ec);
+        }
+        for (const auto& dir : changed_dirs) changes_.notify(dir);
+        return results;
+    }
+
+    db_.execute("ROLLBACK;");
+    undo.revert(0);
+    for (auto& result : results) {
+        if (result == MetadataOpResult::OK) result = aborted ? MetadataOpResult::NOT_APPLIED : MetadataOpResult::IO_ERROR;
+    }
+    LOG_WARN("Metadata batch of " << ops.size() << " operations rolled back.");
+    return results;
+}
+
 std::vector<FileInfo> FileManager::list_directory(const fs::path& server_base_path, const std::string& relative_path_str, int user_id) {
     std::vector<FileInfo> result;
     fs::path full_server_path = resolve_safe_path(server_base_path, relative_path_str);
 
     if (full_server_path.empty() || !fs::exists(full_server_path) || !fs::is_directory(full_server_path)) {
-        std::cerr << "List Directory: Path not found, not a directory, or unsafe: " << full_server_path << std::endl;
+        LOG_WARN("List Directory: Path not found, not a directory, or unsafe: " << full_server_path);
         return result;
     }
 
@@ -215,7 +751,7 @@ std::vector<FileInfo> FileManager::list_directory(const fs::path& server_base_pa
             result.push_back(info);
         }
     } catch (const fs::filesystem_error& e) {
-        std::cerr << "Filesystem error listing directory " << full_server_path << ": " << e.what() << std::endl;
+        LOG_ERROR("Filesystem error listing directory " << full_server_path << ": " << e.what());
     }
     return result;
 }
@@ -225,27 +761,11 @@ std::vector<FileInfo> FileManager::list_directory(const fs::path& server_base_pa
 std::string FileManager::calculate_checksum(const fs::path& file_path_obj) {
     // Giữ nguyên code SHA256 cũ (sẽ có warning) hoặc thay bằng EVP
     fs::path file_path = fs::weakly_canonical(file_path_obj);
+    // File lưu dạng chunk: checksum đã tính lúc ghi, không đọc placeholder
+    if (auto recipe = chunks_.recipe(file_path.string())) return recipe->checksum;
     std::ifstream file(file_path, std::ios::binary);
     if (!file.is_open()) { return ""; }
-    unsigned char hash_digest[SHA256_DIGEST_LENGTH];
-    SHA256_CTX sha256_ctx;
-    SHA256_Init(&sha256_ctx);
-    char buffer[8192];
-    while (file.good()) {
-        file.read(buffer, sizeof(buffer));
-        std::streamsize bytes_read = file.gcount();
-        if (bytes_read > 0) {
-            SHA256_Update(&sha256_ctx, buffer, static_cast<size_t>(bytes_read));
-        }
-    }
-    file.close();
-    SHA256_Final(hash_digest, &sha256_ctx);
-    std::ostringstream ss;
-    ss << std::hex << std::setfill('0');
-    for (int i = 0; i < SHA256_DIGEST_LENGTH; ++i) {
-        ss << std::setw(2) << static_cast<unsigned int>(hash_digest[i]);
-    }
-    return ss.str();
+    return sha256_hex(file);
 }
 
 
@@ -254,8 +774,10 @@ void FileManager::update_file_metadata(const fs::path& full_server_path_obj, int
     //     if (fs::is_directory(full_server_path_obj)) return;
     // }
     if (!fs::exists(full_server_path_obj)) return;
+    std::lock_guard<std::recursive_mutex> db_lock(db_.write_mutex());
     bool is_dir = fs::is_directory(full_server_path_obj);
     std::string full_server_path_str = fs::weakly_canonical(full_server_path_obj).string();
+    std::string parent_path_str = fs::path(full_server_path_str).parent_path().string();
     std::string checksum = is_dir ? "" : calculate_checksum(full_server_path_obj);
 
     //////////////////////////////
@@ -277,9 +799,10 @@ void FileManager::update_file_metadata(const fs::path& full_server_path_obj, int
     // #endif
     sqlite3_stmt* stmt;
     std::string sql = R"(
-        INSERT INTO file_metadata (file_path, checksum, last_modified, owner_user_id, version, is_directory, is_deleted)
-        VALUES (?, ?, ?, ?, 1, ?, 0)
+        INSERT INTO file_metadata (file_path, checksum, last_modified, owner_user_id, version, is_directory, is_deleted, parent_path)
+        VALUES (?, ?, ?, ?, 1, ?, 0, ?)
         ON CONFLICT(file_path) DO UPDATE SET
+        parent_path = excluded.parent_path,
         checksum = excluded.checksum,
         last_modified = excluded.last_modified,
         owner_user_id = COALESCE(excluded.owner_user_id, owner_user_id),
@@ -296,6 +819,7 @@ void FileManager::update_file_metadata(const fs::path& full_server_path_obj, int
         if (user_id != -1) { sqlite3_bind_int(stmt, 4, user_id); } else { sqlite3_bind_null(stmt, 4); }
         /////////////////
         sqlite3_bind_int(stmt, 5, is_dir ? 1 : 0);
+        sqlite3_bind_text(stmt, 6, parent_path_str.c_str(), -1, SQLITE_STATIC);
         /////////////////
         // Execute the statement
          // Note: This will insert a new row or update an existing one
@@ -303,15 +827,15 @@ void FileManager::update_file_metadata(const fs::path& full_server_path_obj, int
          // If it doesn't exist, it will insert a new row
 
         if (sqlite3_step(stmt) != SQLITE_DONE) {
-            std::cerr << "Failed to update metadata for " << full_server_path_str << ": " << sqlite3_errmsg(db_.get_db_handle()) << std::endl;
+            LOG_ERROR("Failed to update metadata for " << full_server_path_str << ": " << sqlite3_errmsg(db_.get_db_handle()));
         } else {
-            std::cout << "Updated metadata for " << full_server_path_str << std::endl;
+            LOG_INFO("Updated metadata for " << full_server_path_str);
         }
          // Finalize the statement to release resources
          // Note: This is important to avoid memory leaks
         sqlite3_finalize(stmt);
     } else {
-        std::cerr << "Failed to prepare metadata statement for " << full_server_path_str << ": " << sqlite3_errmsg(db_.get_db_handle()) << std::endl;
+        LOG_ERROR("Failed to prepare metadata statement for " << full_server_path_str << ": " << sqlite3_errmsg(db_.get_db_handle()));
     }
 }
 
@@ -322,6 +846,7 @@ void FileManager::remove_file_metadata(const fs::path& full_server_path_obj) {
         SET is_deleted = 1, deleted_timestamp = ? 
         WHERE file_path = ? AND is_deleted = 0;
     )";
+    std::lock_guard<std::recursive_mutex> db_lock(db_.write_mutex());
     sqlite3_stmt* stmt;
     if (sqlite3_prepare_v2(db_.get_db_handle(), sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
         //sqlite3_bind_text(stmt, 1, full_server_path.c_str(), -1, SQLITE_STATIC);
@@ -329,11 +854,11 @@ void FileManager::remove_file_metadata(const fs::path& full_server_path_obj) {
         sqlite3_bind_text(stmt, 2, full_server_path.c_str(), -1, SQLITE_STATIC);
 
         if (sqlite3_step(stmt) != SQLITE_DONE) {
-            std::cerr << "Failed to mark metadata as deleted for " << full_server_path << ": " << sqlite3_errmsg(db_.get_db_handle()) << std::endl;
+            LOG_ERROR("Failed to mark metadata as deleted for " << full_server_path << ": " << sqlite3_errmsg(db_.get_db_handle()));
         }
         sqlite3_finalize(stmt);
     } else {
-         std::cerr << "Failed to prepare metadata delete (tombstone) statement for " << full_server_path << ": " << sqlite3_errmsg(db_.get_db_handle()) << std::endl;
+         LOG_ERROR("Failed to prepare metadata delete (tombstone) statement for " << full_server_path << ": " << sqlite3_errmsg(db_.get_db_handle()));
     }
 }
 
@@ -342,26 +867,41 @@ bool FileManager::update_metadata_after_rename(const fs::path& old_abs_path_obj,
     if (!fs::exists(new_abs_path_obj)) {
         return false;
     }
+    std::lock_guard<std::recursive_mutex> db_lock(db_.write_mutex());
+
+    const fs::path old_parent = fs::weakly_canonical(old_abs_path_obj).parent_path();
+    const fs::path new_parent = fs::weakly_canonical(new_abs_path_obj).parent_path();
+    auto refresh_parents = [&]() {
+        directory_changed(old_parent.string());
+        if (new_parent != old_parent) directory_changed(new_parent.string());
+    };
 
     if (fs::is_regular_file(new_abs_path_obj)) {
+        chunks_.move_recipes(recipe_key(old_abs_path_obj), recipe_key(new_abs_path_obj)); // Trước update: checksum lấy từ recipe
         remove_file_metadata(old_abs_path_obj);
         update_file_metadata(new_abs_path_obj, user_id);
+        refresh_parents();
         return true;
     }
 
     
     if (fs::is_directory(new_abs_path_obj)) {
-        std::string old_path_prefix = fs::weakly_canonical(old_abs_path_obj).string();
-        std::string new_path_prefix = fs::weakly_canonical(new_abs_path_obj).string();
-        if (old_path_prefix.back() != fs::path::preferred_separator) old_path_prefix += fs::path::preferred_separator;
-        if (new_path_prefix.back() != fs::path::preferred_separator) new_path_prefix += fs::path::preferred_separator;
+        std::string old_dir = fs::weakly_canonical(old_abs_path_obj).string();
+        std::string new_dir = fs::weakly_canonical(new_abs_path_obj).string();
+        std::string old_path_prefix = old_dir + fs::path::preferred_separator;
+        std::string new_path_prefix = new_dir + fs::path::preferred_separator;
+        std::string old_path_end = old_dir + static_cast<char>(fs::path::preferred_separator + 1); // Cận trên của mọi path dưới old_dir
         char* sql_update_children = sqlite3_mprintf(
-        "UPDATE file_metadata "
-        "SET file_path = %Q || substr(file_path, %d) " // Nối prefix mới với phần còn lại của path cũ
-        "WHERE file_path LIKE %Q || '/%%';",
+        "UPDATE OR REPLACE file_metadata "
+        "SET file_path = %Q || substr(file_path, %d), " // Nối prefix mới với phần còn lại của path cũ
+        "parent_path = %Q || substr(parent_path, %d) "
+        "WHERE file_path >= %Q AND file_path < %Q;",
         new_path_prefix.c_str(),
         static_cast<int>(old_path_prefix.length()) + 1, // Vị trí bắt đầu của chuỗi con
-        old_path_prefix.c_str()
+        new_dir.c_str(),
+        static_cast<int>(old_dir.length()) + 1,
+        old_path_prefix.c_str(),
+        old_path_end.c_str()
         );
 
         if (sql_update_children) {
@@ -369,7 +909,11 @@ bool FileManager::update_metadata_after_rename(const fs::path& old_abs_path_obj,
             sqlite3_free(sql_update_children);
         }
 
+        chunks_.move_recipes(old_dir, new_dir);
         remove_file_metadata(old_abs_path_obj);
+        update_file_metadata(new_abs_path_obj, user_id);
+        tree_hashes_.move_subtree(old_dir, new_dir);
+        refresh_parents();
         return true;
     }
 
@@ -0,0 +1,265 @@
+#include "http_request_parser.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace {
+    constexpr std::size_t kMaxLineBytes = 4096; // chunk-size and trailer lines
+
+    bool iequals(std::string_view a, std::string_view b) {
+        if (a.size() != b.size()) return false;
+        for (std::size_t i = 0; i < a.size(); ++i) {
+            if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) return false;
+        }
+        return true;
+    }
+
+    std::string_view trim(std::string_view s) {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+        return s;
+    }
+
+    // Calls fn for each comma-separated, trimmed, non-empty token.
+    template <class F>
+    void for_each_token(std::string_view list, F fn) {
+        while (!list.empty()) {
+            std::size_t comma = list.find(',');
+            std::string_view token = trim(list.substr(0, comma));
+            if (!token.empty()) fn(token);
+            if (comma == std::string_view::npos) break;
+            list.remove_prefix(comma + 1);
+        }
+    }
+}
+
+const std::string* HttpRequestHead::find(std::string_view name) const {
+    for (const auto& h : headers) {
+        if (iequals(h.first, name)) return &h.second;
+    }
+    return nullptr;
+}
+
+void HttpRequestParser::reset() {
+    state_ = State::HEADERS;
+    head_ = HttpRequestHead();
+    header_buf_.clear();
+    line_buf_.clear();
+    remaining_ = 0;
+    body_bytes_ = 0;
+    error_status_ = 0;
+    error_message_.clear();
+}
+
+HttpRequestParser::Status HttpRequestParser::fail(int status, std::string message) {
+    state_ = State::FAILED;
+    error_status_ = status;
+    error_message_ = std::move(message);
+    return Status::ERROR;
+}
+
+bool HttpRequestParser::parse_head(std::string_view block) {
+    std::size_t eol = block.find("\r\n");
+    std::string_view request_line = block.substr(0, eol);
+    block = eol == std::string_view::npos ? std::string_view() : block.substr(eol + 2);
+
+    std::size_t sp1 = request_line.find(' ');
+    std::size_t sp2 = sp1 == std::string_view::npos ? sp1 : request_line.find(' ', sp1 + 1);
+    if (sp1 == 0 || sp2 == std::string_view::npos || sp2 == sp1 + 1 ||
+        request_line.find(' ', sp2 + 1) != std::string_view::npos) {
+        fail(400, "Malformed request line");
+        return false;
+    }
+    head_.method.assign(request_line.substr(0, sp1));
+    head_.uri.assign(request_line.substr(sp1 + 1, sp2 - sp1 - 1));
+    head_.version.assign(request_line.substr(sp2 + 1));
+    if (head_.version != "HTTP/1.1" && head_.version != "HTTP/1.0") {
+        fail(head_.version.rfind("HTTP/", 0) == 0 ? 505 : 400, "Unsupported HTTP version");
+        return false;
+    }
+    const bool http11 = head_.version == "HTTP/1.1";
+    head_.keep_alive = http11;
+
+    bool has_transfer_encoding = false;
+    while (!block.empty()) {
+        eol = block.find("\r\n");
+        std::string_view line = block.substr(0, eol);
+        block = eol == std::string_view::npos ? std::string_view() : block.substr(eol + 2);
+
+        if (line.front() == ' ' || line.front() == '\t') { fail(400, "Obsolete header folding"); return false; }
+        std::size_t colon = line.find(':');
+        if (colon == 0 || colon == std::string_view::npos) { fail(400, "Malformed header line"); return false; }
+        std::string_view name = line.substr(0, colon);
+        if (name.find_first_of(" \t") != std::string_view::npos) { fail(400, "Whitespace in header name"); return false; }
+        std::string_view value = trim(line.substr(colon + 1));
+        head_.headers.emplace_back(std::string(name), std::string(value));
+
+        if (iequals(name, "Content-Length")) {
+            if (value.empty() || value.size() > 18 ||
+                !std::all_of(value.begin(), value.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+                fail(400, "Invalid Content-Length");
+                return false;
+            }
+            std::int64_t n = std::stoll(std::string(value));
+            if (head_.content_length >= 0 && head_.content_length != n) { fail(400, "Conflicting Content-Length"); return false; }
+            head_.content_length = n;
+        } else if (iequals(name, "Transfer-Encoding")) {
+            has_transfer_encoding = true;
+            bool ok = true;
+            for_each_token(value, [&](std::string_view coding) {
+                if (!iequals(coding, "chunked") || head_.chunked) ok = false;
+                head_.chunked = true;
+            });
+            if (!ok || !head_.chunked) { fail(501, "Only chunked transfer coding is supported"); return false; }
+        } else if (iequals(name, "Connection")) {
+            for_each_token(value, [&](std::string_view option) {
+                if (iequals(option, "close")) head_.keep_alive = false;
+                else if (iequals(option, "keep-alive")) head_.keep_alive = true;
+            });
+        } else if (iequals(name, "Expect")) {
+            if (http11 && iequals(value, "100-continue")) head_.expect_continue = true;
+        }
+    }
+    // Cả hai cùng có mặt là dấu hiệu request smuggling: từ chối luôn.
+    if (has_transfer_encoding && head_.content_length >= 0) {
+        fail(400, "Both Content-Length and Transfer-Encoding present");
+        return false;
+    }
+
+    if (head_.chunked) {
+        state_ = State::CHUNK_SIZE;
+    } else if (head_.content_length > 0) {
+        if (limits_.max_body_bytes > 0 && static_cast<std::uint64_t>(head_.content_length) > limits_.max_body_bytes) {
+            fail(413, "Request body too large");
+            return false;
+        }
+        remaining_ = static_cast<std::uint64_t>(head_.content_length);
+        state_ = State::BODY_FIXED;
+    } else {
+        state_ = State::COMPLETE;
+    }
+    return true;
+}
+
+bool HttpRequestParser::deliver(const char* data, std::size_t length, const BodySink& sink) {
+    body_bytes_ += length;
+    if (sink && !sink(data, length)) {
+        fail(500, "Could not store request body");
+        return false;
+    }
+    return true;
+}
+
+bool HttpRequestParser::take_line(const char* data, std::size_t length, std::size_t& pos) {
+    const char* start = data + pos;
+    const char* nl = static_cast<const char*>(std::memchr(start, '\n', length - pos));
+    if (!nl) {
+        line_buf_.append(start, length - pos);
+        pos = length;
+        return false;
+    }
+    line_buf_.append(start, static_cast<std::size_t>(nl - start));
+    pos += static_cast<std::size_t>(nl - start) + 1;
+    if (!line_buf_.empty() && line_buf_.back() == '\r') line_buf_.pop_back();
+    return true;
+}
+
+HttpRequestParser::Status HttpRequestParser::parse(const char* data, std::size_t length, std::size_t& consumed, const BodySink& sink) {
+    consumed = 0;
+    if (state_ == State::FAILED) return Status::ERROR;
+    if (state_ == State::COMPLETE) return Status::COMPLETE;
+
+    std::size_t pos = 0;
+    if (state_ == State::HEADERS) {
+        // Bỏ qua các dòng trống trước request line (RFC 9112 §2.2).
+        if (header_buf_.empty()) {
+            while (pos < length && (data[pos] == '\r' || data[pos] == '\n')) ++pos;
+        }
+        std::size_t previous = header_buf_.size();
+        header_buf_.append(data + pos, length - pos);
+        std::size_t end = header_buf_.find("\r\n\r\n", previous >= 3 ? previous - 3 : 0);
+        if (end == std::string::npos) {
+            if (header_buf_.size() > limits_.max_header_bytes) return fail(431, "Request header too large");
+            consumed = length;
+            return Status::NEED_MORE;
+        }
+        if (end > limits_.max_header_bytes) return fail(431, "Request header too large");
+        pos = length - (header_buf_.size() - (end + 4));
+        header_buf_.resize(end);
+        if (!parse_head(header_buf_)) return Status::ERROR;
+        header_buf_.clear();
+    }
+
+    while (state_ != State::COMPLETE && pos < length) {
+        switch (state_) {
+            case State::BODY_FIXED: {
+                std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(remaining_, length - pos));
+                if (!deliver(data + pos, n, sink)) return Status::ERROR;
+                pos += n;
+                remaining_ -= n;
+                if (remaining_ == 0) state_ = State::COMPLETE;
+                break;
+            }
+            case State::CHUNK_SIZE: {
+                if (!take_line(data, length, pos)) {
+                    if (line_buf_.size() > kMaxLineBytes) return fail(400, "Chunk size line too long");
+                    break;
+                }
+                std::string_view line(line_buf_);
+                line = line.substr(0, line.find(';'));
+                line = trim(line);
+                if (line.empty() || line.size() > 15) return fail(400, "Invalid chunk size");
+                std::uint64_t size = 0;
+                for (char c : line) {
+                    int digit = std::isxdigit(static_cast<unsigned char>(c))
+                                    ? (std::isdigit(static_cast<unsigned char>(c)) ? c - '0' : (std::tolower(c) - 'a' + 10))
+                                    : -1;
+                    if (digit < 0) return fail(400, "Invalid chunk size");
+                    size = size * 16 + static_cast<std::uint64_t>(digit);
+                }
+                line_buf_.clear();
+                if (size == 0) {
+                    state_ = State::TRAILERS;
+                } else {
+                    if (limits_.max_body_bytes > 0 && body_bytes_ + size > limits_.max_body_bytes) {
+                        return fail(413, "Request body too large");
+                    }
+                    remaining_ = size;
+                    state_ = State::CHUNK_DATA;
+                }
+                break;
+            }
+            case State::CHUNK_DATA: {
+                std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(remaining_, length - pos));
+                if (!deliver(data + pos, n, sink)) return Status::ERROR;
+                pos += n;
+                remaining_ -= n;
+                if (remaining_ == 0) state_ = State::CHUNK_DATA_END;
+                break;
+            }
+            case State::CHUNK_DATA_END:
+                if (!take_line(data, length, pos)) {
+                    if (line_buf_.size() > 2) return fail(400, "Missing CRLF after chunk data");
+                    break;
+                }
+                if (!line_buf_.empty()) return fail(400, "Missing CRLF after chunk data");
+                state_ = State::CHUNK_SIZE;
+                break;
+            case State::TRAILERS:
+                if (!take_line(data, length, pos)) {
+                    if (line_buf_.size() > kMaxLineBytes) return fail(400, "Trailer line too long");
+                    break;
+                }
+                if (line_buf_.empty()) state_ = State::COMPLETE; // trailer fields are ignored
+                line_buf_.clear();
+                break;
+            case State::HEADERS:
+            case State::COMPLETE:
+            case State::FAILED:
+                break;
+        }
+    }
+    consumed = pos;
+    return state_ == State::COMPLETE ? Status::COMPLETE : Status::NEED_MORE;
+}
@@ -1,14 +1,26 @@
 #include "db.hpp"
+#include "async_logger.hpp"
 #include "config.hpp" // Bao gồm file config mới
 #include "user_manager.hpp"
 #include "file_manager.hpp"
 #include "sync_manager.hpp"
 #include "access_control.hpp"
 #include "server.hpp"
+#include "session_store.hpp"
+#include "token_codec.hpp"
+#include "token_revocation.hpp"
+#include "session_persistence.hpp"
+#include "bounded_executor.hpp"
+#include "rate_limiter.hpp"
+#include "metrics.hpp"
+#include "epoll_http_server.hpp"
+#include "epoll_poco_adapter.hpp"
 #include <filesystem>
 #include <Poco/Net/ServerSocket.h>
 #include <Poco/Net/HTTPServer.h>
 #include <Poco/Net/HTTPServerParams.h>
+#include <Poco/ThreadPool.h>
+#include <Poco/Timespan.h>
 #include <Poco/Util/ServerApplication.h>
 #include <Poco/Util/Option.h>
 #include <Poco/Util/OptionSet.h>
@@ -16,6 +28,7 @@
 #include <iostream>
 #include <csignal>
 #include <memory>
+#include <algorithm>
 
 namespace fs = std::filesystem;
 
@@ -50,6 +63,12 @@ protected:
         // Config::HASH_ITERATIONS = config().getInt("security.hash_iterations", 10000);
         // Config::SERVER_BASE_URL = "http://localhost:" + std::to_string(Config::HTTP_SERVER_PORT);
         logger().information("Configuration loaded. Port: " + std::to_string(Config::HTTP_SERVER_PORT));
+
+        LogLevel logLevel = LogLevel::INFO;
+        if (!AsyncLogger::parse_level(Config::LOG_LEVEL, logLevel)) {
+            logger().warning("Unknown log.level '" + Config::LOG_LEVEL + "', using info.");
+        }
+        AsyncLogger::instance().start(logLevel, Config::LOG_FILE);
         // *** KẾT THÚC LOAD CẤU HÌNH ***
 
         // Sử dụng các biến từ Config struct
@@ -58,16 +77,146 @@ protected:
         if (!db_->initialize_schema()) { logger().fatal("DB schema init failed."); terminate(); return; }
         logger().information("Database initialized.");
 
-        userManager_ = std::make_unique<UserManager>(*db_);
+        // Pool riêng cho PBKDF2 để login dồn dập không làm nghẽn các thread HTTP.
+        hashExecutor_ = std::make_unique<BoundedExecutor>(
+            "password_hashing", static_cast<std::size_t>(std::max(1, Config::HASH_WORKERS)),
+            static_cast<std::size_t>(std::max(0, Config::HASH_QUEUE_LIMIT)));
+        // Handler pools: transfer và metadata tách riêng, mỗi pool có giới hạn hàng đợi riêng.
+        metadataExecutor_ = std::make_unique<BoundedExecutor>(
+            "metadata", static_cast<std::size_t>(std::max(1, Config::METADATA_WORKERS)),
+            static_cast<std::size_t>(std::max(0, Config::METADATA_QUEUE_LIMIT)));
+        transferExecutor_ = std::make_unique<BoundedExecutor>(
+            "transfer", static_cast<std::size_t>(std::max(1, Config::TRANSFER_WORKERS)),
+            static_cast<std::size_t>(std::max(0, Config::TRANSFER_QUEUE_LIMIT)));
+        userManager_ = std::make_unique<UserManager>(*db_, hashExecutor_.get());
         fileManager_ = std::make_unique<FileManager>(*db_);
         syncManager_ = std::make_unique<SyncManager>(*db_, *fileManager_);
         access_controlManager_ = std::make_unique<AccessControlManager>(*db_, *userManager_);
+        revocations_ = std::make_unique<TokenRevocationList>();
+        sessionStore_ = std::make_unique<SessionStore>(std::chrono::seconds(Config::SESSION_IDLE_TTL_SECONDS));
+        sessionPersistence_ = std::make_unique<SessionPersistence>(
+            Config::DATABASE_PATH, *sessionStore_, *revocations_, std::chrono::seconds(Config::SESSION_FLUSH_INTERVAL_SECONDS));
+        if (!sessionPersistence_->is_open()) { logger().fatal("Session store DB connection failed."); terminate(); return; }
+
+        tokenCodec_ = std::make_unique<TokenCodec>();
+        if (!Config::TOKEN_KEYS.empty()) {
+            if (!tokenCodec_->load_key_list(Config::TOKEN_KEYS) || !tokenCodec_->set_active_key(Config::TOKEN_ACTIVE_KEY)) {
+                logger().fatal("Invalid security.token_keys / security.token_active_key."); terminate(); return;
+            }
+        } else {
+            // Không cấu hình key: dùng key ngẫu nhiên lưu trong DB để token vẫn hợp lệ sau khi restart.
+            auto secret = sessionPersistence_->load_or_create_signing_key("local");
+            if (!secret) { logger().fatal("Could not load or create the token signing key."); terminate(); return; }
+            tokenCodec_->add_key("local", *secret);
+            tokenCodec_->set_active_key("local");
+        }
+
+        std::size_t restored = sessionPersistence_->load();
+        logger().information("Restored " + std::to_string(restored) + " session(s) from the database.");
+        sessionStore_->set_expiry_listener([this](const std::string& token_id, std::int64_t expires_at) {
+            revocations_->revoke(token_id, expires_at);
+        });
+        sessionStore_->start_sweeper();
+        fileManager_->changes().start_sweeper(); // Timeout của /sync/watch
+        fileManager_->chunks().start_gc(std::chrono::seconds(Config::STORAGE_CHUNK_GC_INTERVAL_SECONDS),
+                                        std::chrono::seconds(std::max(0, Config::STORAGE_CHUNK_GC_GRACE_SECONDS)));
+
+        admissionControl_ = std::make_unique<AdmissionControl>(AdmissionControl::Limits{
+            Config::RATE_LIMIT_USER_REQUESTS_PER_SECOND, Config::RATE_LIMIT_USER_REQUEST_BURST,
+            Config::RATE_LIMIT_USER_BYTES_PER_SECOND, Config::RATE_LIMIT_USER_BYTES_BURST,
+            Config::RATE_LIMIT_IP_REQUESTS_PER_SECOND, Config::RATE_LIMIT_IP_REQUEST_BURST});
+        sessionPersistence_->start();
 
         logger().information("Managers initialized.");
     }
 
+    // Giá trị đọc lúc scrape /metrics, không tốn gì trên đường request.
+    void registerMetrics() {
+        MetricsRegistry& m = MetricsRegistry::global();
+        m.gauge_callback("fileserver_sessions_active", "Sessions currently tracked", {},
+                         [this]() { return static_cast<double>(sessionStore_->stats().active); });
+        m.counter_callback("fileserver_sessions_expired_total", "Sessions expired for inactivity", {},
+                         [this]() { return static_cast<double>(sessionStore_->stats().expired); });
+        m.gauge_callback("fileserver_revoked_tokens", "Token ids on the revocation list", {},
+                         [this]() { return static_cast<double>(revocations_->size()); });
+        m.gauge_callback("fileserver_sync_watchers", "Long-poll /sync/watch requests waiting for a change", {},
+                         [this]() { return static_cast<double>(fileManager_->changes().waiting()); });
+
+        ChunkStore* chunks = &fileManager_->chunks();
+        m.gauge_callback("fileserver_chunk_store_chunks", "Chunks in the deduplicated chunk store", {},
+                         [chunks]() { return static_cast<double>(chunks->stats().chunks); });
+        m.gauge_callback("fileserver_chunk_store_stored_bytes", "Bytes of chunk data on disk (each chunk once)", {},
+                         [chunks]() { return static_cast<double>(chunks->stats().stored_bytes); });
+        m.gauge_callback("fileserver_chunk_store_logical_bytes", "Total size of the files stored as chunks", {},
+                         [chunks]() { return static_cast<double>(chunks->stats().logical_bytes); });
+        m.gauge_callback("fileserver_chunk_store_saved_bytes", "Bytes saved by deduplication (logical - stored)", {},
+                         [chunks]() {
+                             const ChunkStoreStats s = chunks->stats();
+                             return s.logical_bytes > s.stored_bytes ? static_cast<double>(s.logical_bytes - s.stored_bytes) : 0.0;
+                         });
+        m.counter_callback("fileserver_chunk_store_collected_total", "Unreferenced chunks deleted by the chunk GC", {},
+                         [chunks]() { return static_cast<double>(chunks->stats().collected_chunks); });
+
+        if (reactorServer_) {
+            EpollHttpServer* reactor = reactorServer_.get();
+            m.gauge_callback("fileserver_http_connections_current", "Open connections", {},
+                             [reactor]() { return static_cast<double>(reactor->stats().connections); });
+            m.counter_callback("fileserver_http_connections_accepted_total", "Connections accepted", {},
+                             [reactor]() { return static_cast<double>(reactor->stats().accepted); });
+            m.counter_callback("fileserver_http_connections_refused_total", "Connections refused over reactor.max_connections", {},
+                             [reactor]() { return static_cast<double>(reactor->stats().refused); });
+            m.counter_callback("fileserver_http_connections_idle_closed_total", "Keep-alive connections closed for inactivity", {},
+                             [reactor]() { return static_cast<double>(reactor->stats().idle_closed); });
+            m.counter_callback("fileserver_http_parse_errors_total", "Requests rejected by the HTTP parser", {},
+                             [reactor]() { return static_cast<double>(reactor->stats().parse_errors); });
+        } else {
+            Poco::Net::HTTPServer* http = httpServer_.get();
+            m.gauge_callback("fileserver_http_threads_busy", "Poco HTTPServer threads currently serving connections", {},
+                             [http]() { return static_cast<double>(http->currentThreads()); });
+            m.gauge_callback("fileserver_http_threads_max", "Poco HTTPServer thread limit", {},
+                             [http]() { return static_cast<double>(http->maxThreads()); });
+            m.gauge_callback("fileserver_http_connections_queued", "Accepted connections waiting for a thread", {},
+                             [http]() { return static_cast<double>(http->queuedConnections()); });
+            m.gauge_callback("fileserver_http_connections_current", "Connections being served", {},
+                             [http]() { return static_cast<double>(http->currentConnections()); });
+            m.counter_callback("fileserver_http_connections_refused_total", "Connections refused because the queue was full", {},
+                             [http]() { return static_cast<double>(http->refusedConnections()); });
+        }
+
+        std::vector<const BoundedExecutor*> executors{hashExecutor_.get(), metadataExecutor_.get(), transferExecutor_.get()};
+        if (reactorServer_) executors.push_back(&reactorServer_->handler_pool());
+        for (const BoundedExecutor* executor : executors) {
+            MetricsRegistry::Labels pool{{"pool", executor->name()}};
+            m.gauge_callback("fileserver_executor_queue_depth", "Jobs waiting in a bounded executor", pool,
+                             [executor]() { return static_cast<double>(executor->stats().queue_depth); });
+            m.gauge_callback("fileserver_executor_active", "Jobs running in a bounded executor", pool,
+                             [executor]() { return static_cast<double>(executor->stats().active); });
+            m.counter_callback("fileserver_executor_rejected_total", "Jobs rejected by a full bounded executor", pool,
+                             [executor]() { return static_cast<double>(executor->stats().rejected); });
+            m.gauge_callback("fileserver_executor_wait_seconds_avg", "Average queue wait in a bounded executor", pool,
+                             [executor]() { return executor->stats().avg_wait_ms / 1000.0; });
+        }
+
+        AdmissionControl* admission = admissionControl_.get();
+        m.counter_callback("fileserver_rate_limited_total", "Requests refused with 429", {{"bucket", "user_requests"}},
+                         [admission]() { return static_cast<double>(admission->stats().rejected_user_requests); });
+        m.counter_callback("fileserver_rate_limited_total", "Requests refused with 429", {{"bucket", "user_bytes"}},
+                         [admission]() { return static_cast<double>(admission->stats().rejected_user_bytes); });
+        m.counter_callback("fileserver_rate_limited_total", "Requests refused with 429", {{"bucket", "ip_requests"}},
+                         [admission]() { return static_cast<double>(admission->stats().rejected_ip_requests); });
+
+        m.counter_callback("fileserver_log_dropped_total", "Log lines dropped because a ring buffer was full", {},
+                         []() { return static_cast<double>(AsyncLogger::instance().dropped()); });
+    }
+
     void uninitialize() override {
         logger().information("FileServerApp uninitializing...");
+        if (sessionStore_) sessionStore_->stop_sweeper();
+        if (sessionPersistence_) sessionPersistence_->stop(); // final write-behind flush
+        if (metadataExecutor_) metadataExecutor_->shutdown();
+        if (transferExecutor_) transferExecutor_->shutdown();
+        if (hashExecutor_) hashExecutor_->shutdown();
+        AsyncLogger::instance().stop(); // flush những log còn trong ring
         ServerApplication::uninitialize();
     }
 
@@ -90,43 +239,94 @@ protected:
 
     int main(const std::vector<std::string>& args) override {
         if (_helpRequested) return Application::EXIT_OK;
-        if (!db_ || !userManager_ || !fileManager_ || !syncManager_ || !access_controlManager_) {
+        if (!db_ || !userManager_ || !fileManager_ || !syncManager_ || !access_controlManager_ || !sessionStore_) {
             logger().fatal("Core components not initialized."); return Application::EXIT_CONFIG;
         }
 
-        Poco::Net::ServerSocket svs(Config::HTTP_SERVER_PORT); // Sử dụng config
+        const bool useReactor = Config::HTTP_ENGINE == "epoll";
+        if (!useReactor && Config::HTTP_ENGINE != "poco") {
+            logger().warning("Unknown server.engine '" + Config::HTTP_ENGINE + "', using poco.");
+        }
+        const int maxThreads = std::max(1, useReactor ? Config::REACTOR_HANDLER_THREADS : Config::HTTP_MAX_THREADS);
+        const int pooledJobs = Config::TRANSFER_WORKERS + Config::TRANSFER_QUEUE_LIMIT + Config::METADATA_WORKERS + Config::METADATA_QUEUE_LIMIT;
+        if (maxThreads <= pooledJobs) {
+            logger().warning(std::string(useReactor ? "reactor.handler_threads" : "server.max_threads") + " (" + std::to_string(maxThreads) +
+                             ") should exceed the worker pools' workers + queue limits (" + std::to_string(pooledJobs) +
+                             "); queued transfers can otherwise hold every connection thread.");
+        }
         Poco::Net::HTTPServerParams::Ptr pParams = new Poco::Net::HTTPServerParams;
-        pParams->setMaxQueued(100); pParams->setMaxThreads(16);
+        pParams->setMaxQueued(std::max(1, Config::HTTP_MAX_QUEUED));
+        pParams->setMaxThreads(maxThreads);
+        pParams->setTimeout(Poco::Timespan(Config::HTTP_TIMEOUT_SECONDS, 0));
+        pParams->setKeepAlive(true); // client giữ kết nối trong pool, xem HttpSessionPool
+        WorkerPools pools{*metadataExecutor_, *transferExecutor_, Config::POOL_RETRY_AFTER_SECONDS};
 
-        httpServer_ = std::make_unique<Poco::Net::HTTPServer>(
-            new FileServerRequestHandlerFactory(*db_, *userManager_, *fileManager_, *syncManager_, *access_controlManager_),
-            svs, pParams
-        );
+        if (useReactor) {
+            // Cùng factory/handler với Poco, chỉ khác phần quản lý kết nối.
+            reactorFactory_ = std::make_unique<FileServerRequestHandlerFactory>(
+                *db_, *userManager_, *fileManager_, *syncManager_, *access_controlManager_, *sessionStore_, *tokenCodec_,
+                *revocations_, *admissionControl_, pools);
+            EpollHttpServer::Options options;
+            options.port = Config::HTTP_SERVER_PORT;
+            options.io_threads = static_cast<std::size_t>(std::max(1, Config::REACTOR_IO_THREADS));
+            options.handler_threads = static_cast<std::size_t>(maxThreads);
+            options.handler_queue_limit = static_cast<std::size_t>(std::max(0, Config::REACTOR_HANDLER_QUEUE_LIMIT));
+            options.max_connections = static_cast<std::size_t>(std::max(1, Config::REACTOR_MAX_CONNECTIONS));
+            options.idle_timeout = std::chrono::seconds(std::max(1, Config::REACTOR_IDLE_TIMEOUT_SECONDS));
+            options.body_spool_threshold = static_cast<std::size_t>(std::max(0, Config::REACTOR_BODY_SPOOL_BYTES));
+            reactorServer_ = std::make_unique<EpollHttpServer>(options, make_poco_handler(*reactorFactory_, pParams));
+        } else {
+            Poco::Net::ServerSocket svs(Config::HTTP_SERVER_PORT); // Sử dụng config
+            // ThreadPool mặc định của Poco chỉ có 16 thread, setMaxThreads không vượt được giới hạn đó.
+            httpThreads_ = std::make_unique<Poco::ThreadPool>(2, maxThreads);
+            httpServer_ = std::make_unique<Poco::Net::HTTPServer>(
+                new FileServerRequestHandlerFactory(*db_, *userManager_, *fileManager_, *syncManager_, *access_controlManager_,
+                                                    *sessionStore_, *tokenCodec_, *revocations_, *admissionControl_, pools),
+                *httpThreads_, svs, pParams
+            );
+        }
 
-        httpServer_->start();
-        logger().information("HTTP Server started on port " + std::to_string(Config::HTTP_SERVER_PORT));
+        registerMetrics();
+        if (reactorServer_) reactorServer_->start();
+        else httpServer_->start();
+        logger().information("HTTP Server (" + std::string(useReactor ? "epoll" : "poco") + " engine) started on port " +
+                             std::to_string(Config::HTTP_SERVER_PORT));
         waitForTerminationRequest();
         logger().information("Stopping HTTP server...");
-        httpServer_->stop();
+        fileManager_->changes().stop_sweeper(); // Trả lời các watcher đang chờ trước khi đóng kết nối
+        fileManager_->chunks().stop_gc();
+        if (reactorServer_) reactorServer_->stop();
+        else httpServer_->stop();
         logger().information("HTTP Server stopped.");
         return Application::EXIT_OK;
     }
 
 private:
     bool _helpRequested;
+    std::unique_ptr<Poco::ThreadPool> httpThreads_; // must outlive httpServer_
     std::unique_ptr<Poco::Net::HTTPServer> httpServer_;
+    std::unique_ptr<FileServerRequestHandlerFactory> reactorFactory_; // must outlive reactorServer_
+    std::unique_ptr<EpollHttpServer> reactorServer_;
     std::unique_ptr<Database> db_;
+    std::unique_ptr<BoundedExecutor> hashExecutor_; // must outlive userManager_
+    std::unique_ptr<BoundedExecutor> metadataExecutor_;
+    std::unique_ptr<BoundedExecutor> transferExecutor_;
     std::unique_ptr<UserManager> userManager_;
     std::unique_ptr<FileManager> fileManager_;
     std::unique_ptr<SyncManager> syncManager_;
     std::unique_ptr<AccessControlManager> access_controlManager_;
+    std::unique_ptr<TokenCodec> tokenCodec_;
+    std::unique_ptr<TokenRevocationList> revocations_;
+    std::unique_ptr<SessionStore> sessionStore_;
+    std::unique_ptr<SessionPersistence> sessionPersistence_;
+    std::unique_ptr<AdmissionControl> admissionControl_;
 };
 
 int main(int argc, char** argv) {
     try {
-        std::cout << "Server Current Working Directory: " << fs::current_path().string() << std::endl;
+        LOG_INFO("Server Current Working Directory: " << fs::current_path().string());
     } catch (const fs::filesystem_error& e) {
-        std::cerr << "Error getting current working directory: " << e.what() << std::endl;
+        LOG_ERROR("Error getting current working directory: " << e.what());
     }
     FileServerApp app;
     return app.run(argc, argv);
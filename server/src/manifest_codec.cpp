@@ -0,0 +1,588 @@
+#include "manifest_codec.hpp"
+#include "protocol.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <stdexcept>
+#include <streambuf>
+
+using json = nlohmann::json;
+
+namespace {
+    std::string_view trim(std::string_view s) {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+        return s;
+    }
+
+    bool iequals(std::string_view a, std::string_view b) {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+            return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+        });
+    }
+
+    // "application/cbor; charset=..." -> "application/cbor"
+    std::string_view media_type(std::string_view value) {
+        return trim(value.substr(0, value.find(';')));
+    }
+
+    double parse_qvalue(std::string_view params) {
+        while (!params.empty()) {
+            std::size_t semi = params.find(';');
+            std::string_view param = trim(params.substr(0, semi));
+            params = semi == std::string_view::npos ? std::string_view() : params.substr(semi + 1);
+            if (param.size() >= 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+                std::string value(param.substr(2));
+                char* end = nullptr;
+                double q = std::strtod(value.c_str(), &end);
+                if (end == value.c_str()) return 1.0;
+                return std::clamp(q, 0.0, 1.0);
+            }
+        }
+        return 1.0;
+    }
+
+    int hex_value(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // Đọc stream gốc theo khối 64 KiB, throws ManifestTooLarge khi vượt max_bytes (0 = không giới hạn).
+    // Giới hạn cả body chunked, thứ mà kiểm tra Content-Length của RouteTable không thấy.
+    class BudgetedStreamBuf : public std::streambuf {
+    public:
+        BudgetedStreamBuf(std::istream& source, std::uint64_t max_bytes) : source_(source.rdbuf()), max_bytes_(max_bytes) {}
+
+    protected:
+        int_type underflow() override {
+            if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+            const std::streamsize n = source_ ? source_->sgetn(buffer_, sizeof(buffer_)) : 0;
+            if (n <= 0) return traits_type::eof();
+            consumed_ += static_cast<std::uint64_t>(n);
+            if (max_bytes_ > 0 && consumed_ > max_bytes_) {
+                throw ManifestTooLarge("Manifest body exceeds " + std::to_string(max_bytes_) + " bytes.");
+            }
+            setg(buffer_, buffer_, buffer_ + n);
+            return traits_type::to_int_type(*gptr());
+        }
+
+    private:
+        std::streambuf* source_;
+        std::uint64_t max_bytes_;
+        std::uint64_t consumed_ = 0;
+        char buffer_[64 * 1024];
+    };
+
+    // SAX handler: chỉ giữ entry đang đọc. Các string (path, checksum) được move thẳng từ parser
+    // vào ManifestEntry rồi sang visit, nên không có DOM hay bản sao trung gian.
+    class ManifestSaxReader : public nlohmann::json_sax<json> {
+    public:
+        ManifestSaxReader(std::uint64_t max_entries, const std::function<void(ManifestEntry&&)>& visit,
+                          const std::function<void(std::size_t)>& reserve,
+                          const std::function<void(std::string&&)>& scope)
+            : max_entries_(max_entries), visit_(visit), reserve_(reserve), scope_(scope) {}
+
+        // Gọi sau sax_parse; trả về số entry đã chuyển cho visit.
+        std::uint64_t finish() const {
+            if (!seen_files_) throw ManifestMalformed("Missing or invalid '" + JsonKeys::CLIENT_FILES + "' array.");
+            return visited_;
+        }
+
+        bool null() override {
+            if (skip_depth_ > 0) return true;
+            switch (target()) {
+                case Field::CHECKSUM: entry_.checksum.clear(); break;
+                case Field::SIZE:  // Chỉ là gợi ý cho thứ tự plan: kiểu khác bị bỏ qua
+                case Field::NONE: break;
+                default: wrong_type();
+            }
+            return next();
+        }
+
+        bool boolean(bool val) override {
+            if (skip_depth_ > 0) return true;
+            switch (target()) {
+                case Field::IS_DIRECTORY: entry_.is_directory = val; break;
+                case Field::IS_DELETED: entry_.is_deleted = val; break;
+                case Field::SIZE:
+                case Field::NONE: break;
+                default: wrong_type();
+            }
+            return next();
+        }
+
+        bool number_integer(number_integer_t val) override {
+            if (skip_depth_ > 0) return true;
+            switch (target()) {
+                case Field::LAST_MODIFIED: entry_.last_modified = val; break;
+                case Field::SIZE: entry_.size = val > 0 ? static_cast<std::uint64_t>(val) : 0; break;
+                case Field::NONE: break;
+                default: wrong_type();
+            }
+            return next();
+        }
+
+        bool number_unsigned(number_unsigned_t val) override {
+            if (skip_depth_ > 0) return true;
+            switch (target()) {
+                case Field::LAST_MODIFIED:
+                    if (val > static_cast<number_unsigned_t>(INT64_MAX)) wrong_type();
+                    entry_.last_modified = static_cast<std::int64_t>(val);
+                    break;
+                case Field::FLAGS:
+                    entry_.is_directory = val & CompactManifest::FLAG_DIRECTORY;
+                    entry_.is_deleted = val & CompactManifest::FLAG_DELETED;
+                    break;
+                case Field::SIZE: entry_.size = val; break;
+                case Field::NONE: break;
+                default: wrong_type();
+            }
+            return next();
+        }
+
+        bool number_float(number_float_t val, const string_t&) override {
+            if (skip_depth_ > 0) return true;
+            switch (target()) {
+                case Field::LAST_MODIFIED: entry_.last_modified = static_cast<std::int64_t>(val); break;
+                case Field::SIZE: entry_.size = val > 0 && val < 1.8e19 ? static_cast<std::uint64_t>(val) : 0; break;
+                case Field::NONE: break;
+                default: wrong_type();
+            }
+            return next();
+        }
+
+        bool string(string_t& val) override {
+            if (skip_depth_ > 0) return true;
+            switch (target()) {
+                case Field::RELATIVE_PATH: entry_.relative_path = std::move(val); break;
+                case Field::CHECKSUM: entry_.checksum = std::move(val); break; // JSON: hex như client gửi
+                case Field::SCOPE_PATH:
+                    check_scope_count(++scope_entries_);
+                    scope_(std::move(val));
+                    break;
+                case Field::SIZE:
+                case Field::NONE: break;
+                default: wrong_type();
+            }
+            return next();
+        }
+
+        bool binary(binary_t& val) override {
+            if (skip_depth_ > 0) return true;
+            switch (target()) {
+                case Field::CHECKSUM: {
+                    if (val.size() != CompactManifest::CHECKSUM_BYTES) throw ManifestMalformed("Checksum must be 32 raw bytes.");
+                    static const char digits[] = "0123456789abcdef";
+                    entry_.checksum.resize(2 * CompactManifest::CHECKSUM_BYTES);
+                    for (std::size_t i = 0; i < val.size(); ++i) {
+                        entry_.checksum[2 * i] = digits[val[i] >> 4];
+                        entry_.checksum[2 * i + 1] = digits[val[i] & 0x0f];
+                    }
+                    break;
+                }
+                case Field::SIZE:
+                case Field::NONE: break;
+                default: wrong_type();
+            }
+            return next();
+        }
+
+        bool start_object(std::size_t) override {
+            if (skip_depth_ > 0) { ++skip_depth_; return true; }
+            switch (where_) {
+                case Where::TOP: where_ = Where::ROOT; field_ = Field::NONE; return true;
+                case Where::FILES: begin_entry(Where::ENTRY_OBJECT); return true;
+                case Where::SCOPE: wrong_type();
+                default: return skip_container();
+            }
+        }
+
+        bool key(string_t& val) override {
+            if (skip_depth_ > 0) return true;
+            if (where_ == Where::ROOT) {
+                if (val == JsonKeys::CLIENT_FILES) field_ = Field::FILES;
+                else if (val == JsonKeys::SCOPE && scope_) field_ = Field::SCOPE;
+                else field_ = Field::NONE;
+            } else if (where_ == Where::ENTRY_OBJECT) {
+                if (val == JsonKeys::RELATIVE_PATH) field_ = Field::RELATIVE_PATH;
+                else if (val == JsonKeys::LAST_MODIFIED) field_ = Field::LAST_MODIFIED;
+                else if (val == JsonKeys::CHECKSUM) field_ = Field::CHECKSUM;
+                else if (val == JsonKeys::IS_DIRECTORY) field_ = Field::IS_DIRECTORY;
+                else if (val == JsonKeys::IS_DELETED) field_ = Field::IS_DELETED;
+                else if (val == JsonKeys::SIZE) field_ = Field::SIZE;
+                else field_ = Field::NONE;
+            }
+            return true;
+        }
+
+        bool end_object() override {
+            if (skip_depth_ > 0) return end_skipped();
+            if (where_ == Where::ENTRY_OBJECT) {
+                end_entry();
+            } else {
+                where_ = Where::DONE;
+            }
+            return true;
+        }
+
+        bool start_array(std::size_t elements) override {
+            if (skip_depth_ > 0) { ++skip_depth_; return true; }
+            switch (where_) {
+                case Where::TOP: throw ManifestMalformed("Manifest body must be an object.");
+                case Where::ROOT:
+                    if (field_ == Field::SCOPE) {
+                        where_ = Where::SCOPE;
+                        if (elements != static_cast<std::size_t>(-1)) check_scope_count(elements);
+                        return true;
+                    }
+                    if (field_ != Field::FILES) return skip_container();
+                    where_ = Where::FILES;
+                    seen_files_ = true;
+                    // CBOR / MessagePack ghi trước số phần tử; JSON báo (size_t)-1
+                    if (elements != static_cast<std::size_t>(-1)) {
+                        check_entry_count(elements);
+                        if (reserve_) reserve_(elements);
+                    }
+                    return true;
+                case Where::FILES: begin_entry(Where::ENTRY_ARRAY); return true;
+                case Where::SCOPE: wrong_type();
+                default: return skip_container();
+            }
+        }
+
+        bool end_array() override {
+            if (skip_depth_ > 0) return end_skipped();
+            if (where_ == Where::ENTRY_ARRAY) {
+                if (index_ < 4) throw ManifestMalformed("Each compact '" + JsonKeys::CLIENT_FILES + "' entry must be [path, mtime, checksum, flags].");
+                end_entry();
+            } else { // hết client_files / scope
+                where_ = Where::ROOT;
+                field_ = Field::NONE;
+            }
+            return true;
+        }
+
+        bool parse_error(std::size_t position, const std::string&, const nlohmann::detail::exception& ex) override {
+            throw ManifestMalformed("Invalid manifest body at byte " + std::to_string(position) + ": " + ex.what());
+        }
+
+    private:
+        enum class Where { TOP, ROOT, FILES, ENTRY_OBJECT, ENTRY_ARRAY, SCOPE, DONE };
+        enum class Field { NONE, FILES, SCOPE, RELATIVE_PATH, LAST_MODIFIED, CHECKSUM, IS_DIRECTORY, IS_DELETED, FLAGS, SIZE, SCOPE_PATH };
+
+        // Giá trị scalar sắp tới thuộc field nào; scalar ở chỗ cần object / mảng là lỗi schema.
+        Field target() const {
+            switch (where_) {
+                case Where::ENTRY_OBJECT:
+                case Where::ENTRY_ARRAY: return field_;
+                case Where::SCOPE: return Field::SCOPE_PATH;
+                case Where::ROOT:
+                    if (field_ == Field::SCOPE) throw ManifestMalformed("'" + JsonKeys::SCOPE + "' must be an array of paths.");
+                    if (field_ != Field::FILES) return Field::NONE;
+                    break;
+                case Where::FILES: throw ManifestMalformed("Each '" + JsonKeys::CLIENT_FILES + "' entry must be an object or an array.");
+                default: throw ManifestMalformed("Manifest body must be an object.");
+            }
+            throw ManifestMalformed("Missing or invalid '" + JsonKeys::CLIENT_FILES + "' array.");
+        }
+
+        [[noreturn]] void wrong_type() const {
+            if (where_ == Where::SCOPE) throw ManifestMalformed("'" + JsonKeys::SCOPE + "' must be an array of paths.");
+            throw ManifestMalformed("Invalid value type in '" + JsonKeys::CLIENT_FILES + "' entry " + std::to_string(entries_) + ".");
+        }
+
+        // Một giá trị của entry / root đã đọc xong: mảng compact chuyển sang vị trí kế tiếp.
+        bool next() {
+            if (where_ == Where::ENTRY_ARRAY) {
+                ++index_;
+                field_ = index_ == 1 ? Field::LAST_MODIFIED : index_ == 2 ? Field::CHECKSUM : index_ == 3 ? Field::FLAGS
+                       : index_ == 4 ? Field::SIZE : Field::NONE;
+            } else {
+                field_ = Field::NONE;
+            }
+            return true;
+        }
+
+        bool skip_container() {
+            if (where_ == Where::ROOT && field_ == Field::FILES) throw ManifestMalformed("Missing or invalid '" + JsonKeys::CLIENT_FILES + "' array.");
+            if (where_ == Where::ENTRY_OBJECT || where_ == Where::ENTRY_ARRAY) {
+                if (field_ != Field::NONE) wrong_type();
+            }
+            skip_depth_ = 1;
+            return true;
+        }
+
+        bool end_skipped() {
+            if (--skip_depth_ == 0) return next();
+            return true;
+        }
+
+        void check_entry_count(std::uint64_t count) const {
+            if (max_entries_ > 0 && count > max_entries_) {
+                throw ManifestTooLarge("Manifest has more than " + std::to_string(max_entries_) + " entries.");
+            }
+        }
+
+        void check_scope_count(std::uint64_t count) const {
+            if (max_entries_ > 0 && count > max_entries_) {
+                throw ManifestTooLarge("Manifest scope has more than " + std::to_string(max_entries_) + " directories.");
+            }
+        }
+
+        void begin_entry(Where where) {
+            check_entry_count(++entries_);
+            entry_ = ManifestEntry();
+            where_ = where;
+            index_ = 0;
+            field_ = where == Where::ENTRY_ARRAY ? Field::RELATIVE_PATH : Field::NONE;
+        }
+
+        void end_entry() {
+            where_ = Where::FILES;
+            field_ = Field::NONE;
+            if (entry_.relative_path.empty()) return;
+            visit_(std::move(entry_));
+            ++visited_;
+        }
+
+        std::uint64_t max_entries_;
+        const std::function<void(ManifestEntry&&)>& visit_;
+        const std::function<void(std::size_t)>& reserve_;
+        const std::function<void(std::string&&)>& scope_;
+
+        Where where_ = Where::TOP;
+        Field field_ = Field::NONE;
+        std::size_t skip_depth_ = 0; // > 0: đang bỏ qua một object / mảng không cần
+        std::size_t index_ = 0;      // vị trí trong entry compact
+        ManifestEntry entry_;
+        std::uint64_t entries_ = 0;  // phần tử client_files đã gặp (kể cả bị bỏ qua)
+        std::uint64_t visited_ = 0;
+        std::uint64_t scope_entries_ = 0;
+        bool seen_files_ = false;
+    };
+}
+
+const std::string& manifest_format_content_type(ManifestFormat format) {
+    switch (format) {
+        case ManifestFormat::CBOR: return ContentTypes::APPLICATION_CBOR;
+        case ManifestFormat::MSGPACK: return ContentTypes::APPLICATION_MSGPACK;
+        case ManifestFormat::JSON: break;
+    }
+    return ContentTypes::APPLICATION_JSON;
+}
+
+ManifestFormat manifest_format_from_content_type(std::string_view content_type) {
+    std::string_view type = media_type(content_type);
+    if (iequals(type, ContentTypes::APPLICATION_CBOR)) return ManifestFormat::CBOR;
+    if (iequals(type, ContentTypes::APPLICATION_MSGPACK) || iequals(type, "application/x-msgpack")) return ManifestFormat::MSGPACK;
+    return ManifestFormat::JSON;
+}
+
+ManifestFormat negotiate_manifest_format(std::string_view accept) {
+    ManifestFormat best = ManifestFormat::JSON;
+    double q_best = 0, q_json = -1; // q_json = -1: client không nhắc tới JSON
+    while (!accept.empty()) {
+        std::size_t comma = accept.find(',');
+        std::string_view item = accept.substr(0, comma);
+        accept = comma == std::string_view::npos ? std::string_view() : accept.substr(comma + 1);
+
+        std::size_t semi = item.find(';');
+        std::string_view type = media_type(item);
+        double q = semi == std::string_view::npos ? 1.0 : parse_qvalue(item.substr(semi + 1));
+        if (iequals(type, "application/json")) {
+            q_json = std::max(q_json, q);
+            continue;
+        }
+        ManifestFormat format = manifest_format_from_content_type(type);
+        if (format != ManifestFormat::JSON && q > q_best) { // Cùng q: kiểu liệt kê trước thắng
+            best = format;
+            q_best = q;
+        }
+    }
+    return q_best > 0 && q_best >= q_json ? best : ManifestFormat::JSON;
+}
+
+bool accepts_plan_stream(std::string_view accept) {
+    while (!accept.empty()) {
+        std::size_t comma = accept.find(',');
+        std::string_view item = accept.substr(0, comma);
+        accept = comma == std::string_view::npos ? std::string_view() : accept.substr(comma + 1);
+
+        std::size_t semi = item.find(';');
+        double q = semi == std::string_view::npos ? 1.0 : parse_qvalue(item.substr(semi + 1));
+        if (iequals(media_type(item), ContentTypes::APPLICATION_NDJSON) && q > 0) return true;
+    }
+    return false;
+}
+
+std::string serialize_manifest_body(const json& payload, ManifestFormat format) {
+    std::string out;
+    switch (format) {
+        case ManifestFormat::CBOR: json::to_cbor(payload, out); break;
+        case ManifestFormat::MSGPACK: json::to_msgpack(payload, out); break;
+        case ManifestFormat::JSON: out = payload.dump(); break;
+    }
+    return out;
+}
+
+json checksum_to_wire(std::string_view hex) {
+    if (hex.empty()) return nullptr;
+    if (hex.size() != 2 * CompactManifest::CHECKSUM_BYTES) throw std::invalid_argument("Checksum must be 64 hex characters.");
+    json::binary_t raw;
+    raw.reserve(CompactManifest::CHECKSUM_BYTES);
+    for (std::size_t i = 0; i < hex.size(); i += 2) {
+        int hi = hex_value(hex[i]), lo = hex_value(hex[i + 1]);
+        if (hi < 0 || lo < 0) throw std::invalid_argument("Checksum is not valid hex.");
+        raw.push_back(static_cast<std::uint8_t>(hi << 4 | lo));
+    }
+    return json::binary(std::move(raw));
+}
+
+json encode_manifest_entry(const ManifestEntry& entry, ManifestFormat format) {
+    if (format == ManifestFormat::JSON) {
+        json object = {{JsonKeys::RELATIVE_PATH, entry.relative_path},
+                       {JsonKeys::LAST_MODIFIED, entry.last_modified},
+                       {JsonKeys::CHECKSUM, entry.checksum},
+                       {JsonKeys::IS_DIRECTORY, entry.is_directory},
+                       {JsonKeys::IS_DELETED, entry.is_deleted}};
+        if (entry.size > 0) object[JsonKeys::SIZE] = entry.size;
+        return object;
+    }
+    unsigned flags = (entry.is_directory ? CompactManifest::FLAG_DIRECTORY : 0) | (entry.is_deleted ? CompactManifest::FLAG_DELETED : 0);
+    json compact = json::array({entry.relative_path, entry.last_modified, checksum_to_wire(entry.checksum), flags});
+    if (entry.size > 0) compact.push_back(entry.size);
+    return compact;
+}
+
+std::uint64_t read_manifest_stream(std::istream& in, ManifestFormat format, const ManifestLimits& limits,
+                                   const std::function<void(ManifestEntry&&)>& visit,
+                                   const std::function<void(std::size_t)>& reserve,
+                                   const std::function<void(std::string&&)>& scope) {
+    BudgetedStreamBuf budgeted(in, limits.max_bytes);
+    std::istream body(&budgeted);
+    ManifestSaxReader reader(limits.max_entries, visit, reserve, scope);
+    json::input_format_t input_format = json::input_format_t::json;
+    if (format == ManifestFormat::CBOR) input_format = json::input_format_t::cbor;
+    else if (format == ManifestFormat::MSGPACK) input_format = json::input_format_t::msgpack;
+    json::sax_parse(body, &reader, input_format);
+    return reader.finish();
+}
+
+json encode_sync_operation(int action_code, const std::string& relative_path, ManifestFormat format,
+                           const std::string& old_path, std::uint64_t size) {
+    if (format != ManifestFormat::JSON) {
+        return old_path.empty() ? json::array({action_code, relative_path}) : json::array({action_code, relative_path, old_path});
+    }
+    const char* name = action_code >= 0 && action_code < CompactManifest::SYNC_ACTION_COUNT
+                           ? CompactManifest::SYNC_ACTION_NAMES[action_code] : "UNKNOWN_SYNC_ACTION";
+    json op = {{JsonKeys::SYNC_ACTION_TYPE, name}, {JsonKeys::RELATIVE_PATH, relative_path}};
+    if (!old_path.empty()) op[JsonKeys::OLD_PATH] = old_path;
+    if (size > 0) op[JsonKeys::SIZE] = size;
+    return op;
+}
+
+json encode_listing_entry(const std::string& name, const std::string& path, bool is_directory,
+                          std::uint64_t size, std::int64_t last_modified, ManifestFormat format) {
+    if (format != ManifestFormat::JSON) return json::array({name, path, is_directory, size, last_modified});
+    return {{JsonKeys::NAME, name},
+            {JsonKeys::PATH, path}, // Path relative to the sync root/home dir
+            {JsonKeys::IS_DIRECTORY, is_directory},
+            {JsonKeys::SIZE, size},
+            {JsonKeys::LAST_MODIFIED, last_modified}}; // Unix timestamp
+}
+
+// --- ManifestResponseWriter ---
+namespace {
+    constexpr unsigned kMajorArray = 4; // CBOR major types; MessagePack dùng mã riêng
+    constexpr unsigned kMajorMap = 5;
+
+    void put_big_endian(std::ostream& out, std::uint64_t value, int bytes) {
+        for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8) out.put(static_cast<char>((value >> shift) & 0xff));
+    }
+}
+
+ManifestResponseWriter::ManifestResponseWriter(std::ostream& out, ManifestFormat format, std::size_t fields)
+    : out_(out), format_(format), fields_left_(fields) {
+    if (format_ == ManifestFormat::JSON) out_.put('{');
+    else write_head(kMajorMap, fields);
+}
+
+void ManifestResponseWriter::field(const std::string& key, const json& value) {
+    write_key(key);
+    switch (format_) {
+        case ManifestFormat::CBOR: json::to_cbor(value, out_); break;
+        case ManifestFormat::MSGPACK: json::to_msgpack(value, out_); break;
+        case ManifestFormat::JSON: out_ << value.dump(); break;
+    }
+}
+
+void ManifestResponseWriter::begin_array(const std::string& key, std::size_t count) {
+    write_key(key);
+    in_array_ = true;
+    elements_left_ = count;
+    first_ = true;
+    if (format_ == ManifestFormat::JSON) out_.put('[');
+    else write_head(kMajorArray, count);
+}
+
+void ManifestResponseWriter::element(const json& value) {
+    if (!in_array_ || elements_left_ == 0) throw std::logic_error("ManifestResponseWriter: more elements than announced");
+    --elements_left_;
+    switch (format_) {
+        case ManifestFormat::CBOR: json::to_cbor(value, out_); break;
+        case ManifestFormat::MSGPACK: json::to_msgpack(value, out_); break;
+        case ManifestFormat::JSON:
+            if (!first_) out_.put(',');
+            first_ = false;
+            out_ << value.dump();
+            break;
+    }
+}
+
+void ManifestResponseWriter::end_array() {
+    if (!in_array_ || elements_left_ != 0) throw std::logic_error("ManifestResponseWriter: fewer elements than announced");
+    in_array_ = false;
+    first_ = false;
+    if (format_ == ManifestFormat::JSON) out_.put(']');
+}
+
+void ManifestResponseWriter::finish() {
+    if (in_array_ || fields_left_ != 0) throw std::logic_error("ManifestResponseWriter: object not complete");
+    if (format_ == ManifestFormat::JSON) out_.put('}');
+    out_.flush();
+}
+
+void ManifestResponseWriter::write_key(const std::string& key) {
+    if (in_array_ || fields_left_ == 0) throw std::logic_error("ManifestResponseWriter: more fields than announced");
+    --fields_left_;
+    switch (format_) {
+        case ManifestFormat::CBOR: json::to_cbor(json(key), out_); break;
+        case ManifestFormat::MSGPACK: json::to_msgpack(json(key), out_); break;
+        case ManifestFormat::JSON:
+            if (!first_) out_.put(',');
+            first_ = false;
+            out_ << json(key).dump() << ':';
+            break;
+    }
+}
+
+void ManifestResponseWriter::write_head(unsigned major, std::uint64_t length) {
+    if (format_ == ManifestFormat::CBOR) {
+        const auto type = static_cast<std::uint8_t>(major << 5);
+        if (length < 24) out_.put(static_cast<char>(type | length));
+        else if (length <= 0xff) { out_.put(static_cast<char>(type | 24)); put_big_endian(out_, length, 1); }
+        else if (length <= 0xffff) { out_.put(static_cast<char>(type | 25)); put_big_endian(out_, length, 2); }
+        else if (length <= 0xffffffffu) { out_.put(static_cast<char>(type | 26)); put_big_endian(out_, length, 4); }
+        else { out_.put(static_cast<char>(type | 27)); put_big_endian(out_, length, 8); }
+        return;
+    }
+    // MessagePack: fixmap / map16 / map32, fixarray / array16 / array32
+    const bool map = major == kMajorMap;
+    if (length < 16) out_.put(static_cast<char>((map ? 0x80 : 0x90) | length));
+    else if (length <= 0xffff) { out_.put(static_cast<char>(map ? 0xde : 0xdc)); put_big_endian(out_, length, 2); }
+    else if (length <= 0xffffffffu) { out_.put(static_cast<char>(map ? 0xdf : 0xdd)); put_big_endian(out_, length, 4); }
+    else throw std::length_error("MessagePack containers are limited to 2^32-1 elements");
+}
@@ -0,0 +1,182 @@
+#include "metrics.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <stdexcept>
+
+namespace {
+    std::string escape_label(const std::string& v) {
+        std::string out;
+        out.reserve(v.size());
+        for (char c : v) {
+            if (c == '\\' || c == '"') { out.push_back('\\'); out.push_back(c); }
+            else if (c == '\n') out += "\\n";
+            else out.push_back(c);
+        }
+        return out;
+    }
+
+    std::string format_labels(const MetricsRegistry::Labels& labels, const std::string& extra_key = "",
+                              const std::string& extra_value = "") {
+        if (labels.empty() && extra_key.empty()) return "";
+        std::string out = "{";
+        bool first = true;
+        for (const auto& kv : labels) {
+            if (!first) out += ",";
+            out += kv.first + "=\"" + escape_label(kv.second) + "\"";
+            first = false;
+        }
+        if (!extra_key.empty()) {
+            if (!first) out += ",";
+            out += extra_key + "=\"" + extra_value + "\"";
+        }
+        return out + "}";
+    }
+
+    std::string format_number(double v) {
+        if (std::isnan(v)) return "NaN";
+        if (std::isinf(v)) return v > 0 ? "+Inf" : "-Inf";
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "%.9g", v);
+        return buf;
+    }
+}
+
+std::uint64_t Histogram::bucket_upper_bound(std::size_t i) {
+    if (i < 2) return i;
+    if (i >= kBucketCount - 1) return UINT64_MAX;
+    std::size_t msb = i / 2;
+    std::uint64_t sub = i % 2;
+    std::uint64_t half = std::uint64_t(1) << (msb - 1);
+    std::uint64_t lower = (std::uint64_t(2) + sub) * half;
+    return lower + half - 1;
+}
+
+MetricsRegistry& MetricsRegistry::global() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+MetricsRegistry::Entry* MetricsRegistry::find(const std::string& name, const Labels& labels) {
+    for (auto& e : entries_) {
+        if (e->name == name && e->labels == labels) return e.get();
+    }
+    return nullptr;
+}
+
+MetricsRegistry::Entry& MetricsRegistry::add(const std::string& name, const std::string& help, Kind kind, const Labels& labels) {
+    for (auto& e : entries_) {
+        if (e->name == name && e->kind != kind) {
+            throw std::invalid_argument("Metric '" + name + "' already registered with a different type");
+        }
+    }
+    auto entry = std::make_unique<Entry>();
+    entry->name = name;
+    entry->help = help;
+    entry->kind = kind;
+    entry->labels = labels;
+    entries_.push_back(std::move(entry));
+    return *entries_.back();
+}
+
+Counter& MetricsRegistry::counter(const std::string& name, const std::string& help, const Labels& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (Entry* e = find(name, labels); e && e->counter) return *e->counter;
+    Entry& e = add(name, help, Kind::COUNTER, labels);
+    e.counter = std::make_unique<Counter>();
+    return *e.counter;
+}
+
+Gauge& MetricsRegistry::gauge(const std::string& name, const std::string& help, const Labels& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (Entry* e = find(name, labels); e && e->gauge) return *e->gauge;
+    Entry& e = add(name, help, Kind::GAUGE, labels);
+    e.gauge = std::make_unique<Gauge>();
+    return *e.gauge;
+}
+
+Histogram& MetricsRegistry::histogram(const std::string& name, const std::string& help, const Labels& labels, double unit_scale) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (Entry* e = find(name, labels); e && e->histogram) return *e->histogram;
+    Entry& e = add(name, help, Kind::HISTOGRAM, labels);
+    e.histogram = std::make_unique<Histogram>();
+    e.unit_scale = unit_scale;
+    return *e.histogram;
+}
+
+void MetricsRegistry::set_callback(const std::string& name, const std::string& help, Kind kind, const Labels& labels,
+                                   std::function<double()> fn) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (Entry* e = find(name, labels); e && e->kind == kind) {
+        e->callback = std::move(fn);
+        return;
+    }
+    add(name, help, kind, labels).callback = std::move(fn);
+}
+
+void MetricsRegistry::gauge_callback(const std::string& name, const std::string& help, const Labels& labels,
+                                     std::function<double()> fn) {
+    set_callback(name, help, Kind::GAUGE_CALLBACK, labels, std::move(fn));
+}
+
+void MetricsRegistry::counter_callback(const std::string& name, const std::string& help, const Labels& labels,
+                                       std::function<double()> fn) {
+    set_callback(name, help, Kind::COUNTER_CALLBACK, labels, std::move(fn));
+}
+
+void MetricsRegistry::remove_callbacks(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        bool callback = (*it)->kind == Kind::GAUGE_CALLBACK || (*it)->kind == Kind::COUNTER_CALLBACK;
+        if ((*it)->name == name && callback) it = entries_.erase(it);
+        else ++it;
+    }
+}
+
+std::string MetricsRegistry::render_prometheus() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Nhóm theo tên để mỗi family chỉ có một dòng HELP/TYPE.
+    std::map<std::string, std::vector<const Entry*>> families;
+    for (const auto& e : entries_) families[e->name].push_back(e.get());
+
+    std::string out;
+    for (const auto& [name, entries] : families) {
+        const Entry& first = *entries.front();
+        const char* type = (first.kind == Kind::COUNTER || first.kind == Kind::COUNTER_CALLBACK) ? "counter"
+                         : first.kind == Kind::HISTOGRAM ? "histogram" : "gauge";
+        out += "# HELP " + name + " " + first.help + "\n";
+        out += "# TYPE " + name + " " + type + "\n";
+        for (const Entry* e : entries) {
+            switch (e->kind) {
+                case Kind::COUNTER:
+                    out += name + format_labels(e->labels) + " " + std::to_string(e->counter->value()) + "\n";
+                    break;
+                case Kind::GAUGE:
+                    out += name + format_labels(e->labels) + " " + std::to_string(e->gauge->value()) + "\n";
+                    break;
+                case Kind::GAUGE_CALLBACK:
+                case Kind::COUNTER_CALLBACK:
+                    out += name + format_labels(e->labels) + " " + format_number(e->callback ? e->callback() : 0.0) + "\n";
+                    break;
+                case Kind::HISTOGRAM: {
+                    const Histogram& h = *e->histogram;
+                    std::uint64_t cumulative = 0;
+                    for (std::size_t i = 0; i + 1 < Histogram::kBucketCount; ++i) {
+                        cumulative += h.bucket(i);
+                        // Bỏ các bucket trống ở đầu để output gọn; bucket là cumulative nên vẫn đúng.
+                        if (cumulative == 0 && i + 2 < Histogram::kBucketCount) continue;
+                        double le = static_cast<double>(Histogram::bucket_upper_bound(i)) * e->unit_scale;
+                        out += name + "_bucket" + format_labels(e->labels, "le", format_number(le)) + " " + std::to_string(cumulative) + "\n";
+                        if (cumulative == h.count()) break;
+                    }
+                    out += name + "_bucket" + format_labels(e->labels, "le", "+Inf") + " " + std::to_string(h.count()) + "\n";
+                    out += name + "_sum" + format_labels(e->labels) + " " + format_number(static_cast<double>(h.sum()) * e->unit_scale) + "\n";
+                    out += name + "_count" + format_labels(e->labels) + " " + std::to_string(h.count()) + "\n";
+                    break;
+                }
+            }
+        }
+    }
+    return out;
+}
@@ -0,0 +1,114 @@
+#include "rate_limiter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <mutex>
+
+RateLimiter::RateLimiter(double rate_per_second, double burst)
+    : enabled_(rate_per_second > 0),
+      interval_ns_(rate_per_second > 0 ? 1e9 / rate_per_second : 0.0),
+      tolerance_ns_(rate_per_second > 0 ? static_cast<std::int64_t>(1e9 / rate_per_second * std::max(1.0, burst)) : 0) {}
+
+std::int64_t RateLimiter::to_ns(Clock::time_point t) const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+std::shared_ptr<std::atomic<std::int64_t>> RateLimiter::slot(const std::string& key, std::int64_t now_ns) {
+    Shard& shard = shards_[std::hash<std::string>{}(key) % kShardCount];
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.tat_ns.find(key);
+        if (it != shard.tat_ns.end()) return it->second;
+    }
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    if (shard.tat_ns.size() >= kMaxKeysPerShard) {
+        // Bucket đã đầy lại (TAT <= now) thì không khác gì key mới: bỏ đi.
+        for (auto it = shard.tat_ns.begin(); it != shard.tat_ns.end();) {
+            if (it->second->load(std::memory_order_relaxed) <= now_ns) it = shard.tat_ns.erase(it);
+            else ++it;
+        }
+    }
+    auto& entry = shard.tat_ns[key];
+    if (!entry) entry = std::make_shared<std::atomic<std::int64_t>>(now_ns);
+    return entry;
+}
+
+RateLimiter::Decision RateLimiter::acquire(const std::string& key, double cost, Clock::time_point now) {
+    if (!enabled_) return {true, std::chrono::nanoseconds(0)};
+    const std::int64_t now_ns = to_ns(now);
+    const std::int64_t increment = static_cast<std::int64_t>(std::llround(interval_ns_ * cost));
+    auto slot_ptr = slot(key, now_ns);
+    std::atomic<std::int64_t>& tat = *slot_ptr;
+
+    std::int64_t current = tat.load(std::memory_order_relaxed);
+    for (;;) {
+        std::int64_t next = std::max(current, now_ns) + increment;
+        std::int64_t over = next - now_ns - tolerance_ns_;
+        if (over > 0) return {false, std::chrono::nanoseconds(over)};
+        if (tat.compare_exchange_weak(current, next, std::memory_order_relaxed)) return {true, std::chrono::nanoseconds(0)};
+    }
+}
+
+RateLimiter::Decision RateLimiter::check(const std::string& key, Clock::time_point now) {
+    if (!enabled_) return {true, std::chrono::nanoseconds(0)};
+    const std::int64_t now_ns = to_ns(now);
+    std::int64_t over = slot(key, now_ns)->load(std::memory_order_relaxed) - now_ns - tolerance_ns_;
+    if (over > 0) return {false, std::chrono::nanoseconds(over)};
+    return {true, std::chrono::nanoseconds(0)};
+}
+
+void RateLimiter::charge(const std::string& key, double cost, Clock::time_point now) {
+    if (!enabled_ || cost <= 0) return;
+    const std::int64_t now_ns = to_ns(now);
+    const std::int64_t increment = static_cast<std::int64_t>(std::llround(interval_ns_ * cost));
+    auto slot_ptr = slot(key, now_ns);
+    std::atomic<std::int64_t>& tat = *slot_ptr;
+    std::int64_t current = tat.load(std::memory_order_relaxed);
+    while (!tat.compare_exchange_weak(current, std::max(current, now_ns) + increment, std::memory_order_relaxed)) {}
+}
+
+std::size_t RateLimiter::tracked_keys() const {
+    std::size_t total = 0;
+    for (const auto& shard : shards_) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        total += shard.tat_ns.size();
+    }
+    return total;
+}
+
+// --- AdmissionControl ---
+
+AdmissionControl::AdmissionControl(const Limits& limits)
+    : user_requests_(limits.user_requests_per_second, limits.user_request_burst),
+      user_bytes_(limits.user_bytes_per_second, limits.user_bytes_burst),
+      ip_requests_(limits.ip_requests_per_second, limits.ip_request_burst) {}
+
+RateLimiter::Decision AdmissionControl::admit_user_request(int user_id) {
+    auto d = user_requests_.acquire(std::to_string(user_id));
+    if (!d.allowed) rejected_user_requests_.fetch_add(1, std::memory_order_relaxed);
+    return d;
+}
+
+RateLimiter::Decision AdmissionControl::admit_user_transfer(int user_id) {
+    auto d = user_bytes_.check(std::to_string(user_id));
+    if (!d.allowed) rejected_user_bytes_.fetch_add(1, std::memory_order_relaxed);
+    return d;
+}
+
+void AdmissionControl::charge_user_bytes(int user_id, std::uint64_t bytes) {
+    user_bytes_.charge(std::to_string(user_id), static_cast<double>(bytes));
+}
+
+RateLimiter::Decision AdmissionControl::admit_ip_request(const std::string& ip) {
+    auto d = ip_requests_.acquire(ip);
+    if (!d.allowed) rejected_ip_requests_.fetch_add(1, std::memory_order_relaxed);
+    return d;
+}
+
+AdmissionControl::Stats AdmissionControl::stats() const {
+    return Stats{rejected_user_requests_.load(std::memory_order_relaxed),
+                 rejected_user_bytes_.load(std::memory_order_relaxed),
+                 rejected_ip_requests_.load(std::memory_order_relaxed),
+                 user_requests_.tracked_keys() + user_bytes_.tracked_keys() + ip_requests_.tracked_keys()};
+}
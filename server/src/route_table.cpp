@@ -0,0 +1,105 @@
+#include "route_table.hpp"
+
+#include <stdexcept>
+
+HttpMethod parse_http_method(std::string_view method) {
+    switch (method.size()) {
+        case 3:
+            if (method == "GET") return HttpMethod::GET;
+            if (method == "PUT") return HttpMethod::PUT;
+            break;
+        case 4:
+            if (method == "POST") return HttpMethod::POST;
+            if (method == "HEAD") return HttpMethod::HEAD;
+            break;
+        case 5:
+            if (method == "PATCH") return HttpMethod::PATCH;
+            break;
+        case 6:
+            if (method == "DELETE") return HttpMethod::DELETE;
+            break;
+        case 7:
+            if (method == "OPTIONS") return HttpMethod::OPTIONS;
+            break;
+    }
+    return HttpMethod::UNKNOWN;
+}
+
+const char* http_method_name(HttpMethod method) {
+    switch (method) {
+        case HttpMethod::GET: return "GET";
+        case HttpMethod::POST: return "POST";
+        case HttpMethod::PUT: return "PUT";
+        case HttpMethod::DELETE: return "DELETE";
+        case HttpMethod::HEAD: return "HEAD";
+        case HttpMethod::OPTIONS: return "OPTIONS";
+        case HttpMethod::PATCH: return "PATCH";
+        case HttpMethod::UNKNOWN: break;
+    }
+    return "UNKNOWN";
+}
+
+std::uint64_t RouteTable::hash(HttpMethod method, std::string_view path, std::uint64_t seed) {
+    // FNV-1a, seeded; method folded in first.
+    std::uint64_t h = 1469598103934665603ULL ^ seed;
+    h = (h ^ static_cast<std::uint8_t>(method)) * 1099511628211ULL;
+    for (char c : path) {
+        h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+    }
+    return h ^ (h >> 29);
+}
+
+RouteTable::RouteTable(std::vector<RouteSpec> routes) : routes_(std::move(routes)) {
+    if (routes_.size() >= kEmptySlot) throw std::invalid_argument("RouteTable: too many routes");
+
+    std::vector<bool> seen_ids(routes_.size(), false);
+    for (const auto& r : routes_) {
+        if (r.id >= routes_.size() || seen_ids[r.id]) {
+            throw std::invalid_argument("RouteTable: route ids must be unique and dense (" + r.name + ")");
+        }
+        seen_ids[r.id] = true;
+    }
+    for (std::size_t i = 0; i < routes_.size(); ++i) {
+        for (std::size_t j = i + 1; j < routes_.size(); ++j) {
+            if (routes_[i].method == routes_[j].method && routes_[i].path == routes_[j].path) {
+                throw std::invalid_argument("RouteTable: duplicate route " + std::string(http_method_name(routes_[i].method)) + " " + routes_[i].path);
+            }
+        }
+    }
+
+    // Tìm seed sao cho không có 2 route nào rơi vào cùng slot; nới bảng nếu thử mãi không được.
+    std::size_t size = 8;
+    while (size < routes_.size() * 2) size <<= 1;
+    for (;;) {
+        for (std::uint64_t seed = 1; seed <= 4096; ++seed) {
+            std::vector<std::uint16_t> slots(size, kEmptySlot);
+            bool collision = false;
+            for (std::size_t i = 0; i < routes_.size() && !collision; ++i) {
+                std::uint64_t slot = hash(routes_[i].method, routes_[i].path, seed) & (size - 1);
+                if (slots[slot] != kEmptySlot) collision = true;
+                else slots[slot] = static_cast<std::uint16_t>(i);
+            }
+            if (!collision) {
+                slots_ = std::move(slots);
+                seed_ = seed;
+                mask_ = size - 1;
+                return;
+            }
+        }
+        size <<= 1;
+    }
+}
+
+const RouteSpec* RouteTable::find(HttpMethod method, std::string_view path) const {
+    if (slots_.empty()) return nullptr;
+    std::uint16_t idx = slots_[hash(method, path, seed_) & mask_];
+    if (idx == kEmptySlot) return nullptr;
+    const RouteSpec& r = routes_[idx];
+    if (r.method != method || r.path != path) return nullptr;
+    return &r;
+}
+
+std::string_view RouteTable::path_of(std::string_view uri) {
+    std::size_t end = uri.find_first_of("?#");
+    return end == std::string_view::npos ? uri : uri.substr(0, end);
+}
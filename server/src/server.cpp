@@ -1,7 +1,12 @@
 #include "server.hpp"
+#include "async_logger.hpp"
 #include "config.hpp"
 #include "protocol.hpp"
+#include "block_delta.hpp"
+#include "fastcdc.hpp"
 #include "sync_manager.hpp" // Để có SyncActionType enum
+#include "bounded_executor.hpp"
+#include "epoll_poco_adapter.hpp" // DeferrableResponse
 
 #include <Poco/StreamCopier.h>
 #include <Poco/Path.h>
@@ -23,16 +28,24 @@
 #include <sstream>
 #include <iostream>
 #include <memory>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <functional>
+#include <iomanip>
+#include <streambuf>
 // Thêm vào đầu file server.cpp
 #include <Poco/TemporaryFile.h>
 #include <Poco/File.h>
 namespace fs = std::filesystem;
 
 
-std::map<std::string, APIRouterHandler::ActiveSession> APIRouterHandler::active_sessions_;
-Poco::Mutex APIRouterHandler::session_mutex_;
-
 namespace {
+    // Watcher đang giữ thread kết nối của engine Poco (xem handleSyncWatch)
+    std::atomic<int> poco_parked_watchers{0};
+
     class NotFoundHandler : public Poco::Net::HTTPRequestHandler {
     public:
         void handleRequest(Poco::Net::HTTPServerRequest& req, Poco::Net::HTTPServerResponse& resp) override {
@@ -42,6 +55,298 @@ namespace {
             resp.sendBuffer(msg, strlen(msg));
         }
     };
+
+    // GET /metrics (Prometheus text format). Loopback only, unless metrics.token
+    // is set, in which case "Authorization: Bearer <token>" is accepted from anywhere.
+    class MetricsHandler : public Poco::Net::HTTPRequestHandler {
+    public:
+        void handleRequest(Poco::Net::HTTPServerRequest& req, Poco::Net::HTTPServerResponse& resp) override {
+            bool allowed = req.clientAddress().host().isLoopback();
+            if (!Config::METRICS_TOKEN.empty() && req.has("Authorization")) {
+                allowed = req.get("Authorization") == "Bearer " + Config::METRICS_TOKEN;
+            }
+            if (!allowed || req.getMethod() != Poco::Net::HTTPRequest::HTTP_GET) {
+                resp.setStatus(allowed ? HTTPResponse::HTTP_METHOD_NOT_ALLOWED : HTTPResponse::HTTP_FORBIDDEN);
+                resp.setContentLength(0);
+                resp.send();
+                return;
+            }
+            std::string body = MetricsRegistry::global().render_prometheus();
+            resp.setStatus(HTTPResponse::HTTP_OK);
+            resp.setContentType("text/plain; version=0.0.4; charset=utf-8");
+            resp.sendBuffer(body.data(), body.size());
+        }
+    };
+
+    // Keep-alive: phần body mà handler không đọc (request bị từ chối trước khi đọc body)
+    // phải được đọc bỏ, nếu không request kế tiếp trên cùng kết nối sẽ bị parse lẫn vào đó.
+    // Body lớn hơn kMaxDrainBytes (hoặc chunked) thì đóng kết nối thay vì đọc bỏ.
+    class RequestBodyDrain {
+    public:
+        static constexpr Poco::Int64 kMaxDrainBytes = 1 << 20;
+
+        RequestBodyDrain(Poco::Net::HTTPServerRequest& request, Poco::Net::HTTPServerResponse& response) : request_(request) {
+            const bool has_body = request.hasContentLength() ? request.getContentLength64() > 0 : request.getChunkedTransferEncoding();
+            drain_ = has_body && request.hasContentLength() && request.getContentLength64() <= kMaxDrainBytes;
+            if (has_body && !drain_) response.setKeepAlive(false);
+        }
+        ~RequestBodyDrain() {
+            if (!drain_) return;
+            try {
+                request_.stream().ignore(static_cast<std::streamsize>(kMaxDrainBytes));
+            } catch (...) {
+                // Kết nối hỏng: Poco sẽ tự đóng.
+            }
+        }
+
+    private:
+        Poco::Net::HTTPServerRequest& request_;
+        bool drain_ = false;
+    };
+
+    // Path trong directory_hashes / file_metadata là canonical, không có '/' ở cuối
+    std::string canonicalHome(const std::string& home_dir) {
+        std::error_code ec;
+        std::string home = fs::weakly_canonical(fs::path(home_dir), ec).string();
+        if (ec) home = home_dir;
+        while (home.size() > 1 && home.back() == '/') home.pop_back();
+        return home;
+    }
+
+    // ?path= của các endpoint file; "" nếu thiếu hoặc không an toàn
+    std::string safeQueryPath(Poco::Net::HTTPServerRequest& request) {
+        Poco::URI uri(request.getURI());
+        for (const auto& p : uri.getQueryParameters()) {
+            if (p.first != JsonKeys::PATH) continue;
+            if (Poco::Path(p.second).isAbsolute() || p.second.find("..") != std::string::npos) return "";
+            return p.second;
+        }
+        return "";
+    }
+
+    // {"chunks": [hash, ...]} của FILES_CHUNKS_MISSING / FILES_COMMIT; false nếu không đúng dạng
+    bool readChunkHashes(const json& payload, std::vector<std::string>& hashes) {
+        auto it = payload.find(JsonKeys::CHUNKS);
+        if (it == payload.end() || !it->is_array()) return false;
+        hashes.reserve(it->size());
+        for (const auto& hash : *it) {
+            if (!hash.is_string() || !FastCdc::is_chunk_hash(hash.get_ref<const std::string&>())) return false;
+            hashes.push_back(hash.get<std::string>());
+        }
+        return true;
+    }
+
+    // Response của SYNC_WATCH. Không dùng response_coding_ của APIRouterHandler: với epoll,
+    // response được ghi sau khi handler (và APIRouterHandler) đã xong.
+    void sendWatchResponse(Poco::Net::HTTPServerResponse& response, bool changed, const std::string& hash) {
+        json payload;
+        payload[JsonKeys::STATUS] = "success";
+        payload[JsonKeys::CHANGED] = changed;
+        payload[JsonKeys::HASH] = hash;
+        const std::string body = payload.dump();
+        response.setStatus(HTTPResponse::HTTP_OK);
+        response.setContentType(ContentTypes::APPLICATION_JSON);
+        response.set("Cache-Control", "no-store");
+        response.sendBuffer(body.data(), body.size());
+    }
+
+    json executorStatsJson(const BoundedExecutor& executor) {
+        BoundedExecutor::Stats h = executor.stats();
+        json pool;
+        pool[JsonKeys::WORKERS] = h.workers;
+        pool[JsonKeys::QUEUE_LIMIT] = h.queue_limit;
+        pool[JsonKeys::QUEUE_DEPTH] = h.queue_depth;
+        pool[JsonKeys::ACTIVE] = h.active;
+        pool[JsonKeys::COMPLETED] = h.completed;
+        pool[JsonKeys::REJECTED] = h.rejected;
+        pool[JsonKeys::AVG_WAIT_MS] = h.avg_wait_ms;
+        pool[JsonKeys::AVG_RUN_MS] = h.avg_run_ms;
+        pool[JsonKeys::MAX_WAIT_MS] = h.max_wait_ms;
+        return pool;
+    }
+
+    // Đo thời gian và status của một request khi ra khỏi scope (kể cả các nhánh return sớm).
+    class RouteObservation {
+    public:
+        RouteObservation(const ApiMetrics::Route& m, const HTTPServerResponse& resp)
+            : metrics_(m), response_(resp), started_(std::chrono::steady_clock::now()) {}
+        ~RouteObservation() {
+            metrics_.latency->record(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - started_).count()));
+            metrics_.requests->inc();
+            if (response_.getStatus() >= HTTPResponse::HTTP_BAD_REQUEST) metrics_.errors->inc();
+        }
+    private:
+        const ApiMetrics::Route& metrics_;
+        const HTTPServerResponse& response_;
+        std::chrono::steady_clock::time_point started_;
+    };
+
+    // Đếm byte thật sự đọc từ body request (kể cả chunked, không có Content-Length).
+    class CountingInBuffer : public std::streambuf {
+    public:
+        explicit CountingInBuffer(std::streambuf* inner) : inner_(inner) {}
+        std::uint64_t count() const { return count_; }
+
+    protected:
+        int_type underflow() override {
+            if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+            std::streamsize n = inner_ ? inner_->sgetn(buffer_, sizeof(buffer_)) : 0;
+            if (n <= 0) return traits_type::eof();
+            count_ += static_cast<std::uint64_t>(n);
+            setg(buffer_, buffer_, buffer_ + n);
+            return traits_type::to_int_type(*gptr());
+        }
+
+    private:
+        std::streambuf* inner_;
+        char buffer_[8192];
+        std::uint64_t count_ = 0;
+    };
+
+    // Đếm byte ghi vào stream của response.send(), không buffer thêm.
+    class CountingOutBuffer : public std::streambuf {
+    public:
+        explicit CountingOutBuffer(std::streambuf* inner) : inner_(inner) {}
+        std::uint64_t count() const { return count_; }
+
+    protected:
+        int_type overflow(int_type c) override {
+            if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+            if (traits_type::eq_int_type(inner_->sputc(traits_type::to_char_type(c)), traits_type::eof())) return traits_type::eof();
+            ++count_;
+            return c;
+        }
+        std::streamsize xsputn(const char* s, std::streamsize n) override {
+            std::streamsize written = inner_->sputn(s, n);
+            if (written > 0) count_ += static_cast<std::uint64_t>(written);
+            return written;
+        }
+        int sync() override { return inner_->pubsync(); }
+
+    private:
+        std::streambuf* inner_;
+        std::uint64_t count_ = 0;
+    };
+
+    // Bọc response của engine cho route transfer: status/header được chép sang
+    // response thật ngay trước khi gửi, số byte body được đếm theo cách gửi.
+    class CountingServerResponse : public HTTPServerResponse {
+    public:
+        explicit CountingServerResponse(HTTPServerResponse& inner) : inner_(inner), out_(nullptr) {
+            setVersion(inner.getVersion());
+            setStatus(inner.getStatus());
+            setReason(inner.getReason());
+            for (auto it = inner.begin(); it != inner.end(); ++it) add(it->first, it->second);
+        }
+
+        void sendContinue() override { inner_.sendContinue(); }
+
+        std::ostream& send() override {
+            commit();
+            buffer_ = std::make_unique<CountingOutBuffer>(inner_.send().rdbuf());
+            out_.rdbuf(buffer_.get());
+            return out_;
+        }
+
+        void sendFile(const std::string& path, const std::string& mediaType) override {
+            commit();
+            inner_.sendFile(path, mediaType);
+            std::error_code ec;
+            auto size = fs::file_size(path, ec);
+            if (!ec) bytes_ += size;
+        }
+
+        void sendBuffer(const void* buffer, std::size_t length) override {
+            commit();
+            inner_.sendBuffer(buffer, length);
+            bytes_ += length;
+        }
+
+        void redirect(const std::string& uri, HTTPStatus status) override {
+            commit();
+            inner_.redirect(uri, status);
+        }
+
+        void requireAuthentication(const std::string& realm) override {
+            commit();
+            inner_.requireAuthentication(realm);
+        }
+
+        bool sent() const override { return inner_.sent(); }
+
+        std::uint64_t bytes_sent() const { return bytes_ + (buffer_ ? buffer_->count() : 0); }
+
+    private:
+        void commit() {
+            inner_.clear();
+            inner_.setVersion(getVersion());
+            inner_.setStatus(getStatus());
+            inner_.setReason(getReason());
+            for (auto it = begin(); it != end(); ++it) inner_.add(it->first, it->second);
+        }
+
+        HTTPServerResponse& inner_;
+        std::unique_ptr<CountingOutBuffer> buffer_;
+        std::ostream out_;
+        std::uint64_t bytes_ = 0;
+    };
+
+    class CountingServerRequest : public HTTPServerRequest {
+    public:
+        CountingServerRequest(HTTPServerRequest& inner, HTTPServerResponse& response)
+            : inner_(inner), response_(response), buffer_(inner.stream().rdbuf()), stream_(&buffer_) {
+            setMethod(inner.getMethod());
+            setURI(inner.getURI());
+            setVersion(inner.getVersion());
+            for (auto it = inner.begin(); it != inner.end(); ++it) add(it->first, it->second);
+        }
+
+        std::istream& stream() override { return stream_; }
+        const Poco::Net::SocketAddress& clientAddress() const override { return inner_.clientAddress(); }
+        const Poco::Net::SocketAddress& serverAddress() const override { return inner_.serverAddress(); }
+        const Poco::Net::HTTPServerParams& serverParams() const override { return inner_.serverParams(); }
+        HTTPServerResponse& response() const override { return response_; }
+        bool secure() const override { return inner_.secure(); }
+
+        std::uint64_t bytes_read() const { return buffer_.count(); }
+
+    private:
+        HTTPServerRequest& inner_;
+        HTTPServerResponse& response_;
+        CountingInBuffer buffer_;
+        std::istream stream_;
+    };
+
+    // Trừ byte vào bucket khi rời scope, kể cả khi handler ném exception giữa chừng.
+    class TransferCharge {
+    public:
+        explicit TransferCharge(std::function<void()> charge) : charge_(std::move(charge)) {}
+        ~TransferCharge() { charge_(); }
+    private:
+        std::function<void()> charge_;
+    };
+}
+
+ApiMetrics ApiMetrics::create(const RouteTable& table, MetricsRegistry& registry) {
+    ApiMetrics m;
+    m.routes.resize(table.size());
+    for (const auto& r : table.routes()) {
+        MetricsRegistry::Labels labels{{"route", r.name}};
+        m.routes[r.id] = Route{
+            &registry.counter("fileserver_http_requests_total", "API requests by route", labels),
+            &registry.counter("fileserver_http_errors_total", "API responses with status >= 400 by route", labels),
+            &registry.histogram("fileserver_http_request_duration_seconds", "API request latency by route", labels)};
+    }
+    m.unmatched = &registry.counter("fileserver_http_unmatched_total", "API requests that matched no route");
+    m.upload_bytes = &registry.counter("fileserver_upload_bytes_total", "Bytes received by file uploads");
+    m.download_bytes = &registry.counter("fileserver_download_bytes_total", "Bytes sent by file downloads");
+    m.json_bytes_uncompressed = &registry.counter("fileserver_json_compressed_input_bytes_total", "JSON response bytes before compression");
+    m.json_bytes_compressed = &registry.counter("fileserver_json_compressed_output_bytes_total", "JSON response bytes after compression");
+    m.claim_hits = &registry.counter("fileserver_claim_total", "FILES_CLAIM requests by result", {{"result", "hit"}});
+    m.claim_misses = &registry.counter("fileserver_claim_total", "FILES_CLAIM requests by result", {{"result", "miss"}});
+    m.claim_bytes_avoided = &registry.counter("fileserver_claim_bytes_avoided_total", "Upload bytes not sent because FILES_CLAIM found the content on the server");
+    return m;
 }
 
 
@@ -55,12 +360,20 @@ namespace {
 
 
 
-FileServerRequestHandlerFactory::FileServerRequestHandlerFactory(Database& db, UserManager& um, FileManager& fm, SyncManager& sm, AccessControlManager& acm)
-    : db_(db), user_manager_(um), file_manager_(fm), sync_manager_(sm), access_control_manager_(acm) {}
+FileServerRequestHandlerFactory::FileServerRequestHandlerFactory(Database& db, UserManager& um, FileManager& fm, SyncManager& sm, AccessControlManager& acm,
+                                                                 SessionStore& sessions, const TokenCodec& tokens, TokenRevocationList& revocations,
+                                                                 AdmissionControl& admission, const WorkerPools& pools)
+    : db_(db), user_manager_(um), file_manager_(fm), sync_manager_(sm), access_control_manager_(acm),
+      session_store_(sessions), token_codec_(tokens), revocations_(revocations), admission_(admission), pools_(pools),
+      routes_(APIRouterHandler::buildRouteTable()), metrics_(ApiMetrics::create(routes_, MetricsRegistry::global())) {}
 
 HTTPRequestHandler* FileServerRequestHandlerFactory::createRequestHandler(const HTTPServerRequest& request) {
+    if (RouteTable::path_of(request.getURI()) == Endpoints::METRICS) {
+        return new MetricsHandler();
+    }
     if (request.getURI().rfind(API_BASE_PATH, 0) == 0) {
-        return new APIRouterHandler(db_, user_manager_, file_manager_, sync_manager_, access_control_manager_);
+        return new APIRouterHandler(db_, user_manager_, file_manager_, sync_manager_, access_control_manager_,
+                                    session_store_, token_codec_, revocations_, admission_, pools_, routes_, metrics_);
     }
     return new NotFoundHandler();
 }
@@ -71,31 +384,87 @@ HTTPRequestHandler* FileServerRequestHandlerFactory::createRequestHandler(const
 
 
 // --- APIRouterHandler Implementation ---
-APIRouterHandler::APIRouterHandler(Database& db, UserManager& um, FileManager& fm, SyncManager& sm, AccessControlManager& acm)
-    : db_(db), user_manager_(um), file_manager_(fm), sync_manager_(sm), access_control_manager_(acm) {
-    setupRoutes(); // Gọi hàm đăng ký route
+APIRouterHandler::APIRouterHandler(Database& db, UserManager& um, FileManager& fm, SyncManager& sm, AccessControlManager& acm,
+                                   SessionStore& sessions, const TokenCodec& tokens, TokenRevocationList& revocations,
+                                   AdmissionControl& admission, const WorkerPools& pools, const RouteTable& routes,
+                                   const ApiMetrics& metrics)
+    : db_(db), user_manager_(um), file_manager_(fm), sync_manager_(sm), access_control_manager_(acm),
+      session_store_(sessions), token_codec_(tokens), revocations_(revocations), admission_(admission), pools_(pools),
+      routes_(routes), metrics_(metrics) {}
+
+
+
+RouteTable APIRouterHandler::buildRouteTable() {
+    constexpr std::uint64_t kJsonBodyLimit = 1 << 20;       // 1 MiB cho các request JSON nhỏ
+    // Manifest có thể lớn; handler còn tự đếm byte khi body là chunked (xem read_manifest_stream)
+    const std::uint64_t kManifestBodyLimit = static_cast<std::uint64_t>(std::max(0, Config::SYNC_MANIFEST_MAX_BYTES));
+    constexpr std::uint64_t kNoLimit = 0;
+    auto id = [](RouteId r) { return static_cast<std::uint16_t>(r); };
+
+    return RouteTable({
+        // --- Public Routes ---
+        {HttpMethod::POST,   Endpoints::REGISTER,              id(RouteId::REGISTER),              "users_register",  false, RouteCost::REQUEST,        kJsonBodyLimit,     RouteClass::INLINE},
+        {HttpMethod::POST,   Endpoints::LOGIN,                 id(RouteId::LOGIN),                 "users_login",     false, RouteCost::REQUEST,        kJsonBodyLimit,     RouteClass::INLINE},
+        // --- Authenticated Routes ---
+        {HttpMethod::POST,   Endpoints::LOGOUT,                id(RouteId::LOGOUT),                "users_logout",    true,  RouteCost::REQUEST,        kJsonBodyLimit,     RouteClass::METADATA},
+        {HttpMethod::GET,    Endpoints::USER_ME,               id(RouteId::USER_ME),               "users_me",        true,  RouteCost::REQUEST,        kJsonBodyLimit,     RouteClass::METADATA},
+        {HttpMethod::POST,   Endpoints::FILES_UPLOAD,          id(RouteId::FILES_UPLOAD),          "files_upload",    true,  RouteCost::UPLOAD_BYTES,   kNoLimit,           RouteClass::TRANSFER},
+        {HttpMethod::GET,    Endpoints::FILES_DOWNLOAD,        id(RouteId::FILES_DOWNLOAD),        "files_download",  true,  RouteCost::DOWNLOAD_BYTES, kJsonBodyLimit,     RouteClass::TRANSFER},
+        {HttpMethod::GET,    Endpoints::FILES_LIST,            id(RouteId::FILES_LIST),            "files_list",      true,  RouteCost::REQUEST,        kJsonBodyLimit,     RouteClass::METADATA},
+        {HttpMethod::POST,   Endpoints::FILES_MKDIR,           id(RouteId::FILES_MKDIR),           "files_mkdir",     true,  RouteCost::REQUEST,        kJsonBodyLimit,     RouteClass::METADATA},
+        {HttpMethod::DELETE, Endpoints::FILES_DELETE,          id(RouteId::FILES_DELETE),          "files_delete",    true,  RouteCost::REQUEST,        kJsonBodyLimit,     RouteClass::METADATA},
+        {HttpMethod::POST,   Endpoints::FILES_RENAME,          id(RouteId::FILES_RENAME),          "files_rename",    true,  RouteCost::REQUEST,        kJsonBodyLimit,     RouteClass::METADATA},
+        {HttpMethod::GET,    Endpoints::FILES_SIGNATURE,       id(RouteId::FILES_SIGNATURE),       "files_signature", true,  RouteCost::DOWNLOAD_BYTES, kJsonBodyLimit,     RouteClass::TRANSFER},
+        {HttpMethod::POST,   Endpoints::FILES_PATCH,           id(RouteId::FILES_PATCH),           "files_patch",     true,  RouteCost::UPLOAD_BYTES,   kNoLimit,           RouteClass::TRANSFER},
+        // Body là signature (read_signature tự chặn kích thước), response là delta
+        {HttpMethod::POST,   Endpoints::FILES_DELTA,           id(RouteId::FILES_DELTA),           "files_delta",     true,  RouteCost::DOWNLOAD_BYTES, kNoLimit,           RouteClass::TRANSFER},
+        // Danh sách hash của một file lớn có thể dài như manifest
+        {HttpMethod::POST,   Endpoints::FILES_CHUNKS_MISSING,  id(RouteId::FILES_CHUNKS_MISSING),  "files_chunks_missing", true, RouteCost::REQUEST,   kManifestBodyLimit, RouteClass::METADATA},
+        {HttpMethod::POST,   Endpoints::FILES_CHUNKS,          id(RouteId::FILES_CHUNKS),          "files_chunks",    true,  RouteCost::UPLOAD_BYTES,   kNoLimit,           RouteClass::TRANSFER},
+        // Đọc lại mọi chunk để kiểm checksum (và ghép file ở chế độ plain)
+        {HttpMethod::POST,   Endpoints::FILES_COMMIT,          id(RouteId::FILES_COMMIT),          "files_commit",    true,  RouteCost::REQUEST,        kManifestBodyLimit, RouteClass::TRANSFER},
+        // Có thể phải copy và đọc lại cả file nguồn
+        {HttpMethod::POST,   Endpoints::FILES_CLAIM,           id(RouteId::FILES_CLAIM),           "files_claim",     true,  RouteCost::REQUEST,        kJsonBodyLimit,     RouteClass::TRANSFER},
+        // Nhiều mkdir / delete / rename trong một transaction; body tỉ lệ với storage.batch_max_operations
+        {HttpMethod::POST,   Endpoints::FILES_BATCH,           id(RouteId::FILES_BATCH),           "files_batch",     true,  RouteCost::REQUEST,        kManifestBodyLimit, RouteClass::METADATA},
+        {HttpMethod::POST,   Endpoints::SYNC_MANIFEST,         id(RouteId::SYNC_MANIFEST),         "sync_manifest",   true,  RouteCost::REQUEST,        kManifestBodyLimit, RouteClass::METADATA},
+        {HttpMethod::POST,   Endpoints::SYNC_TREE,             id(RouteId::SYNC_TREE),             "sync_tree",       true,  RouteCost::REQUEST,        kManifestBodyLimit, RouteClass::METADATA},
+        {HttpMethod::GET,    Endpoints::SYNC_WATCH,            id(RouteId::SYNC_WATCH),            "sync_watch",      true,  RouteCost::REQUEST,        kJsonBodyLimit,     RouteClass::INLINE},
+        {HttpMethod::POST,   Endpoints::SHARED_CREATE_STORAGE, id(RouteId::SHARED_CREATE_STORAGE), "shared_create",   true,  RouteCost::REQUEST,        kJsonBodyLimit,     RouteClass::METADATA},
+        {HttpMethod::POST,   Endpoints::SHARED_GRANT_ACCESS,   id(RouteId::SHARED_GRANT_ACCESS),   "shared_grant",    true,  RouteCost::REQUEST,        kJsonBodyLimit,     RouteClass::METADATA},
+        {HttpMethod::GET,    Endpoints::SERVER_STATS,          id(RouteId::SERVER_STATS),          "server_stats",    true,  RouteCost::REQUEST,        kJsonBodyLimit,     RouteClass::METADATA},
+    });
 }
 
-
-
-void APIRouterHandler::setupRoutes() {
-    // --- Public Routes ---
-    // Key của map là "METHOD /path"
-    public_routes_["POST " + Endpoints::REGISTER] = [this](auto& req, auto& resp){ this->handleUserRegister(req, resp); };
-    public_routes_["POST " + Endpoints::LOGIN]    = [this](auto& req, auto& resp){ this->handleUserLogin(req, resp); };
-
-    // --- Authenticated Routes ---
-    authenticated_routes_["POST " + Endpoints::LOGOUT]          = [this](auto& req, auto& resp, const auto& sess){ this->handleUserLogout(req, resp, sess); };
-    authenticated_routes_["GET " + Endpoints::USER_ME]           = [this](auto& req, auto& resp, const auto& sess){ this->handleUserMe(req, resp, sess); };
-    authenticated_routes_["POST " + Endpoints::FILES_UPLOAD]     = [this](auto& req, auto& resp, const auto& sess){ this->handleFileUpload(req, resp, sess); };
-    authenticated_routes_["GET " + Endpoints::FILES_DOWNLOAD]    = [this](auto& req, auto& resp, const auto& sess){ this->handleFileDownload(req, resp, sess); };
-    authenticated_routes_["GET " + Endpoints::FILES_LIST]        = [this](auto& req, auto& resp, const auto& sess){ this->handleFileList(req, resp, sess); };
-    authenticated_routes_["POST " + Endpoints::FILES_MKDIR]      = [this](auto& req, auto& resp, const auto& sess){ this->handleFileMkdir(req, resp, sess); };
-    authenticated_routes_["DELETE " + Endpoints::FILES_DELETE]   = [this](auto& req, auto& resp, const auto& sess){ this->handleFileDelete(req, resp, sess); };
-    authenticated_routes_["POST " + Endpoints::FILES_RENAME]     = [this](auto& req, auto& resp, const auto& sess){ this->handleFileRename(req, resp, sess); };
-    authenticated_routes_["POST " + Endpoints::SYNC_MANIFEST]    = [this](auto& req, auto& resp, const auto& sess){ this->handleSyncManifest(req, resp, sess); };
-    authenticated_routes_["POST " + Endpoints::SHARED_CREATE_STORAGE] = [this](auto& req, auto& resp, const auto& sess){ this->handleCreateSharedStorage(req, resp, sess); };
-    authenticated_routes_["POST " + Endpoints::SHARED_GRANT_ACCESS]   = [this](auto& req, auto& resp, const auto& sess){ this->handleGrantSharedAccess(req, resp, sess); };
+void APIRouterHandler::dispatch(const RouteSpec& route, HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession* session) {
+    switch (static_cast<RouteId>(route.id)) {
+        case RouteId::REGISTER:              handleUserRegister(request, response); return;
+        case RouteId::LOGIN:                 handleUserLogin(request, response); return;
+        case RouteId::LOGOUT:                handleUserLogout(request, response, *session); return;
+        case RouteId::USER_ME:               handleUserMe(request, response, *session); return;
+        case RouteId::FILES_UPLOAD:          handleFileUpload(request, response, *session); return;
+        case RouteId::FILES_DOWNLOAD:        handleFileDownload(request, response, *session); return;
+        case RouteId::FILES_LIST:            handleFileList(request, response, *session); return;
+        case RouteId::FILES_MKDIR:           handleFileMkdir(request, response, *session); return;
+        case RouteId::FILES_DELETE:          handleFileDelete(request, response, *session); return;
+        case RouteId::FILES_RENAME:          handleFileRename(request, response, *session); return;
+        case RouteId::FILES_SIGNATURE:       handleFileSignature(request, response, *session); return;
+        case RouteId::FILES_PATCH:           handleFilePatch(request, response, *session); return;
+        case RouteId::FILES_DELTA:           handleFileDelta(request, response, *session); return;
+        case RouteId::FILES_CHUNKS_MISSING:  handleChunksMissing(request, response, *session); return;
+        case RouteId::FILES_CHUNKS:          handleChunksUpload(request, response, *session); return;
+        case RouteId::FILES_COMMIT:          handleFileCommit(request, response, *session); return;
+        case RouteId::FILES_CLAIM:           handleFileClaim(request, response, *session); return;
+        case RouteId::FILES_BATCH:           handleFileBatch(request, response, *session); return;
+        case RouteId::SYNC_MANIFEST:         handleSyncManifest(request, response, *session); return;
+        case RouteId::SYNC_TREE:             handleSyncTree(request, response, *session); return;
+        case RouteId::SYNC_WATCH:            handleSyncWatch(request, response, *session); return;
+        case RouteId::SHARED_CREATE_STORAGE: handleCreateSharedStorage(request, response, *session); return;
+        case RouteId::SHARED_GRANT_ACCESS:   handleGrantSharedAccess(request, response, *session); return;
+        case RouteId::SERVER_STATS:          handleServerStats(request, response, *session); return;
+        case RouteId::COUNT: break;
+    }
+    sendErrorResponse(response, HTTPResponse::HTTP_NOT_FOUND, "API endpoint not found.");
 }
 
 
@@ -105,13 +474,87 @@ void APIRouterHandler::setupRoutes() {
 
 
 
+// Thread kết nối của Poco chỉ chờ; việc thật chạy trên pool tương ứng nên
+// download lớn không chiếm chỗ của login / list / manifest.
+bool APIRouterHandler::runOnWorkerPool(const RouteSpec& route, HTTPServerResponse& response, const std::function<void()>& work) {
+    if (route.work_class == RouteClass::INLINE) {
+        work();
+        return true;
+    }
+    BoundedExecutor& pool = route.work_class == RouteClass::TRANSFER ? pools_.transfer : pools_.metadata;
+    try {
+        pool.run([&work]() { work(); });
+    } catch (const ExecutorSaturated&) {
+        LOG_WARN("Worker pool '" << pool.name() << "' full, rejecting " << route.name);
+        sendRetryLaterResponse(response, pools_.retry_after_seconds, "Server busy, retry later.");
+        return false;
+    }
+    return true;
+}
+
 // Utility: Send JSON response
 void APIRouterHandler::sendJsonResponse(HTTPServerResponse& response, HTTPResponse::HTTPStatus status, const json& payload) {
     response.setStatus(status);
     response.setContentType(ContentTypes::APPLICATION_JSON);
-    std::ostream& ostr = response.send();
-    ostr << payload.dump(2); // Pretty print JSON with indent 2
-    ostr.flush();
+    sendResponseBody(response, [&payload](std::ostream& out) {
+        out << std::setw(2) << payload; // Pretty print JSON with indent 2
+    });
+}
+
+// Utility: Stream a listing / sync-operation array in the negotiated encoding
+void APIRouterHandler::streamManifestResponse(HTTPServerResponse& response, ManifestFormat format, const std::string& array_key,
+                                              std::size_t count, const std::function<void(ManifestResponseWriter&)>& write_elements) {
+    response.setStatus(HTTPResponse::HTTP_OK);
+    response.setContentType(manifest_format_content_type(format));
+    response.set("Vary", HttpHeaders::ACCEPT + ", " + HttpHeaders::ACCEPT_ENCODING);
+    sendResponseBody(response, [&](std::ostream& out) {
+        ManifestResponseWriter writer(out, format, 2);
+        writer.field(JsonKeys::STATUS, "success");
+        writer.begin_array(array_key, count);
+        write_elements(writer);
+        writer.end_array();
+        writer.finish();
+    }, true);
+}
+
+void APIRouterHandler::sendResponseBody(HTTPServerResponse& response, const std::function<void(std::ostream&)>& write_body, bool streaming) {
+    if (response_coding_ == ContentCoding::IDENTITY && streaming) {
+        // Body lớn: chunked thẳng ra socket, byte đầu đi ngay và không giữ cả body trong bộ nhớ.
+        response.setChunkedTransferEncoding(true);
+        std::ostream& out = response.send();
+        write_body(out);
+        out.flush();
+        return;
+    }
+    if (response_coding_ == ContentCoding::IDENTITY) {
+        // sendBuffer đặt Content-Length; send() không có Content-Length thì Poco phải đóng kết nối (mất keep-alive).
+        std::ostringstream out;
+        write_body(out);
+        const std::string body = out.str();
+        response.sendBuffer(body.data(), body.size());
+        return;
+    }
+
+    // Client nhận nén: body được ghi thẳng vào bộ nén rồi gửi chunked, không giữ cả
+    // body trong bộ nhớ. Body nhỏ hơn compression.min_bytes vẫn gửi nguyên văn.
+    if (!response.has("Vary")) response.set("Vary", HttpHeaders::ACCEPT_ENCODING);
+    const int level = response_coding_ == ContentCoding::ZSTD ? Config::COMPRESSION_ZSTD_LEVEL : Config::COMPRESSION_GZIP_LEVEL;
+    CompressingBodyStream body(response_coding_, level, static_cast<std::size_t>(std::max(0, Config::COMPRESSION_MIN_BYTES)),
+        [&response](ContentCoding coding, std::int64_t length) -> std::ostream& {
+            if (coding == ContentCoding::IDENTITY) {
+                response.setContentLength64(length);
+            } else {
+                response.set(HttpHeaders::CONTENT_ENCODING, content_coding_name(coding));
+                response.setChunkedTransferEncoding(true);
+            }
+            return response.send();
+        });
+    write_body(body);
+    body.finish();
+    if (body.coding_used() != ContentCoding::IDENTITY) {
+        metrics_.json_bytes_uncompressed->inc(body.bytes_in());
+        metrics_.json_bytes_compressed->inc(body.bytes_out());
+    }
 }
 
 
@@ -134,14 +577,24 @@ void APIRouterHandler::sendSuccessResponse(HTTPServerResponse& response, const s
     sendJsonResponse(response, status, success_payload);
 }
 
+// Utility: Ask the client to come back later (overloaded worker pool)
+void APIRouterHandler::sendRetryLaterResponse(HTTPServerResponse& response, int retry_after_seconds, const std::string& message) {
+    response.set("Retry-After", std::to_string(retry_after_seconds));
+    sendErrorResponse(response, HTTPResponse::HTTP_SERVICE_UNAVAILABLE, message);
+}
+
+
+// Utility: Rate limit hit (Retry-After rounded up to whole seconds)
+void APIRouterHandler::sendRateLimitedResponse(HTTPServerResponse& response, std::chrono::nanoseconds retry_after, const std::string& message) {
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(retry_after + std::chrono::nanoseconds(999999999)).count();
+    response.set("Retry-After", std::to_string(std::max<long long>(1, seconds)));
+    sendErrorResponse(response, HTTPResponse::HTTP_TOO_MANY_REQUESTS, message);
+}
+
 
-// Authentication: Generate a simple session token
-std::string APIRouterHandler::generateToken(int user_id, const std::string& username) {
-    Poco::UUIDGenerator& generator = Poco::UUIDGenerator::defaultGenerator();
-    Poco::UUID uuid = generator.createRandom(); // Using random UUID for more uniqueness
-    // Token format: "token_UID<user_id>_USER<username>_UUID<uuid_string>"
-    // This is just for local demo, not cryptographically secure for production.
-    return "token_UID" + std::to_string(user_id) + "_USER" + username + "_UUID" + uuid.toString();
+// Authentication: Generate a signed session token (see token_codec.hpp for the format)
+std::string APIRouterHandler::generateToken(int user_id, const std::string& username, const std::string& home_root, TokenClaims& claims) {
+    return token_codec_.issue(user_id, username, home_root, std::chrono::seconds(Config::TOKEN_TTL_SECONDS), &claims);
 }
 
 // Authentication: Get active session based on token from request header
@@ -149,22 +602,22 @@ std::optional<APIRouterHandler::ActiveSession> APIRouterHandler::getAuthenticate
     if (!request.has(HttpHeaders::AUTH_TOKEN)) {
         return std::nullopt;
     }
-    std::string token = request.get(HttpHeaders::AUTH_TOKEN);
+    const std::string& token = request.get(HttpHeaders::AUTH_TOKEN);
+
+    // Signature + expiry check needs no shared state; the revocation list is
+    // a single atomic load unless someone has logged out recently.
+    auto claims = token_codec_.verify(token);
+    if (!claims || revocations_.is_revoked(claims->token_id)) {
+        return std::nullopt;
+    }
+    std::string home_dir = (fs::path(Config::USER_DATA_ROOT) / claims->home_root).string();
 
-    Poco::Mutex::ScopedLock lock(session_mutex_); // Protect access to active_sessions_
-    auto it = active_sessions_.find(token);
-    if (it != active_sessions_.end()) {
-        // Optional: Implement session expiry check
-        // Poco::Timespan session_duration = Poco::Timestamp() - it->second.last_activity;
-        // if (session_duration.totalMinutes() > 30) { // Example: 30 minute expiry
-        //     active_sessions_.erase(it);
-        //     std::cout << "Session expired for token: " << token << std::endl;
-        //     return std::nullopt;
-        // }
-        it->second.last_activity = Poco::Timestamp(); // Update last activity time
-        return it->second; // Return copy of the session data
+    // Idle bookkeeping (process-local). Tokens idle for longer than the TTL are revoked.
+    if (!session_store_.touch_or_adopt(claims->token_id, claims->user_id, claims->username, home_dir, claims->expires_at)) {
+        revocations_.revoke(claims->token_id, claims->expires_at);
+        return std::nullopt;
     }
-    return std::nullopt; // Token not found
+    return ActiveSession{claims->user_id, claims->username, home_dir, Poco::Timestamp()};
 }
 
 // Main request router
@@ -173,8 +626,13 @@ void APIRouterHandler::handleRequest(HTTPServerRequest& request, HTTPServerRespo
     response.set("Server", "FileServer/1.0 (Poco)");
     response.set("Access-Control-Allow-Origin", "*");
     response.set("Access-Control-Allow-Methods", "GET, POST, PUT, DELETE, OPTIONS");
-    response.set("Access-Control-Allow-Headers", "Content-Type, " + HttpHeaders::AUTH_TOKEN + ", " + HttpHeaders::FILE_CHECKSUM + ", " + HttpHeaders::FILE_RELATIVE_PATH + ", " + HttpHeaders::FILE_LAST_MODIFIED);
+    static const std::string kAllowHeaders = "Content-Type, " + HttpHeaders::AUTH_TOKEN + ", " + HttpHeaders::FILE_CHECKSUM + ", " + HttpHeaders::FILE_RELATIVE_PATH + ", " + HttpHeaders::FILE_LAST_MODIFIED;
+    response.set("Access-Control-Allow-Headers", kAllowHeaders);
     response.set("Access-Control-Max-Age", "86400"); // Cache preflight for 1 day
+    RequestBodyDrain drain(request, response);
+    if (Config::COMPRESSION_ENABLED && request.has(HttpHeaders::ACCEPT_ENCODING)) {
+        response_coding_ = negotiate_content_coding(request.get(HttpHeaders::ACCEPT_ENCODING));
+    }
 
     // Handle OPTIONS (preflight) requests for CORS
     if (request.getMethod() == Poco::Net::HTTPRequest::HTTP_OPTIONS) {
@@ -185,44 +643,40 @@ void APIRouterHandler::handleRequest(HTTPServerRequest& request, HTTPServerRespo
     }
     //////////////////////////////////////////////////////////////////////////
 
-    Poco::URI uri(request.getURI());
-    std::string endpointPath = uri.getPath();
-    std::string method = request.getMethod();
-    std::string route_key = method + " " + endpointPath;
-    std::cout << Poco::DateTimeFormatter::format(Poco::Timestamp(), Poco::DateTimeFormat::ISO8601_FORMAT)
-              << " Request: " << method << " " << endpointPath << " from " << request.clientAddress().toString() << std::endl;
-    
-
-    
-    
-//     std::optional<ActiveSession> current_session_opt;
-//     bool needs_authentication = !(
-//     (endpointPath == Endpoints::REGISTER && method == Poco::Net::HTTPRequest::HTTP_POST) || // SỬA Ở ĐÂY
-//     (endpointPath == Endpoints::LOGIN && method == Poco::Net::HTTPRequest::HTTP_POST)    // SỬA Ở ĐÂY
-// );
-
-    // if (needs_authentication) {
-    //     current_session_opt = getAuthenticatedSession(request);
-    //     if (!current_session_opt) {
-    //         sendErrorResponse(response, HTTPResponse::HTTP_UNAUTHORIZED, "Auth required.");
-    //         return;
-    //     }
-    // }
-
-    
-
+    // Tra bảng route dùng chung: không tạo string hay map nào cho mỗi request.
+    const HttpMethod method = parse_http_method(request.getMethod());
+    const std::string_view endpointPath = RouteTable::path_of(request.getURI());
+    // Timestamp do writer của AsyncLogger thêm vào, thread request chỉ ghi vào ring của nó.
+    LOG_INFO("Request: " << request.getMethod() << " " << endpointPath << " from " << request.clientAddress().toString());
 
+    const RouteSpec* route = routes_.find(method, endpointPath);
+    if (!route) {
+        metrics_.unmatched->inc();
+        sendErrorResponse(response, HTTPResponse::HTTP_NOT_FOUND, "API endpoint not found.");
+        return;
+    }
+    // Khai báo ngoài try: sống qua các catch bên dưới nên status 4xx/5xx do exception cũng được ghi nhận
+    RouteObservation observation(metrics_.routes[route->id], response);
 
-    
     try {
-        // 1. Thử tìm trong các route public trước
-        auto public_it = public_routes_.find(route_key);
-        if (public_it != public_routes_.end()) {
-            public_it->second(request, response); // Gọi handler public
+        if (route->max_body_bytes > 0 && request.hasContentLength() &&
+            request.getContentLength64() > static_cast<Poco::Int64>(route->max_body_bytes)) {
+            sendErrorResponse(response, HTTPResponse::HTTP_REQUEST_ENTITY_TOO_LARGE, "Request body too large for this endpoint.");
+            return;
+        }
+
+        // 1. Route public: chỉ giới hạn theo IP
+        if (!route->requires_auth) {
+            auto admitted = admission_.admit_ip_request(request.clientAddress().host().toString());
+            if (!admitted.allowed) {
+                sendRateLimitedResponse(response, admitted.retry_after, "Too many requests from this address.");
+                return;
+            }
+            runOnWorkerPool(*route, response, [&]() { dispatch(*route, request, response, nullptr); }); // Gọi handler public
             return;
         }
 
-        // 2. Nếu không phải public, yêu cầu xác thực
+        // 2. Route cần xác thực
         auto current_session_opt = getAuthenticatedSession(request);
         if (!current_session_opt) {
             sendErrorResponse(response, HTTPResponse::HTTP_UNAUTHORIZED, "Authentication required.");
@@ -230,27 +684,47 @@ void APIRouterHandler::handleRequest(HTTPServerRequest& request, HTTPServerRespo
         }
         const ActiveSession& session = *current_session_opt;
 
-        // 3. Tìm trong các route đã xác thực
-        auto auth_it = authenticated_routes_.find(route_key);
-        if (auth_it != authenticated_routes_.end()) {
-            auth_it->second(request, response, session); // Gọi handler đã xác thực
+        // 3. Kiểm tra hạn mức trước khi chiếm thread worker cho request này.
+        const bool is_transfer = route->cost != RouteCost::REQUEST;
+        auto admitted = is_transfer ? admission_.admit_user_transfer(session.user_id)
+                                    : admission_.admit_user_request(session.user_id);
+        if (!admitted.allowed) {
+            sendRateLimitedResponse(response, admitted.retry_after,
+                                    is_transfer ? "Transfer budget exhausted, retry later." : "Too many requests, retry later.");
             return;
         }
 
-        // 4. Nếu không tìm thấy ở đâu cả
-        sendErrorResponse(response, HTTPResponse::HTTP_NOT_FOUND, "API endpoint not found.");
-
-    
+        // Gọi handler đã xác thực trên pool của route (transfer / metadata)
+        if (!is_transfer) {
+            runOnWorkerPool(*route, response, [&]() { dispatch(*route, request, response, &session); });
+            return;
+        }
 
+        // Số byte chỉ biết sau khi xử lý: đếm byte thật sự đọc/ghi qua stream (upload chunked,
+        // response stream không có Content-Length) rồi trừ vào bucket (có thể âm, chặn các transfer kế tiếp).
+        CountingServerResponse counted_response(response);
+        CountingServerRequest counted_request(request, counted_response);
+        TransferCharge charge([&]() {
+            if (route->cost == RouteCost::UPLOAD_BYTES) {
+                std::uint64_t bytes = counted_request.bytes_read();
+                admission_.charge_user_bytes(session.user_id, bytes);
+                metrics_.upload_bytes->inc(bytes);
+            } else {
+                std::uint64_t bytes = counted_response.bytes_sent();
+                admission_.charge_user_bytes(session.user_id, bytes);
+                metrics_.download_bytes->inc(bytes);
+            }
+        });
+        runOnWorkerPool(*route, response, [&]() { dispatch(*route, counted_request, counted_response, &session); });
 
     } catch (const Poco::Exception& e) {
-        std::cerr << "Poco Exception in handler: " << e.displayText() << std::endl;
+        LOG_ERROR("Poco Exception in handler: " << e.displayText());
         sendErrorResponse(response, HTTPResponse::HTTP_INTERNAL_SERVER_ERROR, "Server error (Poco): " + e.displayText());
     } catch (const json::exception& e) {
-        std::cerr << "JSON Exception in handler: " << e.what() << std::endl;
+        LOG_ERROR("JSON Exception in handler: " << e.what());
         sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "JSON processing error: " + std::string(e.what()));
     } catch (const std::exception& e) {
-        std::cerr << "Standard Exception in handler: " << e.what() << std::endl;
+        LOG_ERROR("Standard Exception in handler: " << e.what());
         sendErrorResponse(response, HTTPResponse::HTTP_INTERNAL_SERVER_ERROR, "Server error: " + std::string(e.what()));
     }
 }
@@ -277,7 +751,14 @@ void APIRouterHandler::handleUserRegister(HTTPServerRequest& request, HTTPServer
     }
     // Add more validation for username/password complexity if needed
 
-    auto user_id_opt = user_manager_.register_user(username, password);
+    std::optional<int> user_id_opt;
+    try {
+        user_id_opt = user_manager_.register_user(username, password);
+    } catch (const ExecutorSaturated& e) {
+        LOG_WARN(e.what() << ", rejecting register for " << username);
+        sendRetryLaterResponse(response, Config::HASH_RETRY_AFTER_SECONDS, "Server is busy, please retry later.");
+        return;
+    }
     if (user_id_opt) {
         json res_data;
         res_data[JsonKeys::USER_ID] = *user_id_opt;
@@ -309,7 +790,14 @@ void APIRouterHandler::handleUserLogin(HTTPServerRequest& request, HTTPServerRes
         return;
     }
 
-    auto user_id_opt = user_manager_.login_user(username, password);
+    std::optional<int> user_id_opt;
+    try {
+        user_id_opt = user_manager_.login_user(username, password);
+    } catch (const ExecutorSaturated& e) {
+        LOG_WARN(e.what() << ", rejecting login for " << username);
+        sendRetryLaterResponse(response, Config::HASH_RETRY_AFTER_SECONDS, "Server is busy, please retry later.");
+        return;
+    }
     if (user_id_opt) {
         auto home_dir_opt = user_manager_.get_user_home_dir(*user_id_opt);
         if (!home_dir_opt) {
@@ -317,14 +805,17 @@ void APIRouterHandler::handleUserLogin(HTTPServerRequest& request, HTTPServerRes
             return;
         }
 
-        std::string token = generateToken(*user_id_opt, username);
-        ActiveSession new_session = {*user_id_opt, username, *home_dir_opt, Poco::Timestamp()};
-
-        { // Scoped lock for session map
-            Poco::Mutex::ScopedLock lock(session_mutex_);
-            active_sessions_[token] = new_session;
+        std::string home_root = fs::path(*home_dir_opt).lexically_relative(Config::USER_DATA_ROOT).generic_string();
+        if (home_root.empty() || home_root == "." || home_root.rfind("..", 0) == 0) {
+            sendErrorResponse(response, HTTPResponse::HTTP_INTERNAL_SERVER_ERROR, "User home directory is outside the configured users root.");
+            return;
         }
-        
+
+        TokenClaims claims;
+        std::string token = generateToken(*user_id_opt, username, home_root, claims);
+        session_store_.insert(claims.token_id, *user_id_opt, username, *home_dir_opt, claims.expires_at);
+
+
         json data;
         data[JsonKeys::USER_ID] = *user_id_opt;
         data[JsonKeys::USERNAME] = username;
@@ -343,10 +834,12 @@ void APIRouterHandler::handleUserLogin(HTTPServerRequest& request, HTTPServerRes
 
 void APIRouterHandler::handleUserLogout(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session) {
     if (request.has(HttpHeaders::AUTH_TOKEN)) {
-        std::string token = request.get(HttpHeaders::AUTH_TOKEN);
-        Poco::Mutex::ScopedLock lock(session_mutex_);
-        if (active_sessions_.erase(token)) {
-            std::cout << "User logged out, token erased: " << token.substr(0, 20) << "..." << std::endl;
+        auto claims = token_codec_.verify(request.get(HttpHeaders::AUTH_TOKEN));
+        if (claims) {
+            // Token tự xác thực nên phải đưa jti vào danh sách thu hồi tới khi nó hết hạn.
+            revocations_.revoke(claims->token_id, claims->expires_at);
+            session_store_.erase(claims->token_id);
+            LOG_INFO("User logged out, token revoked: " << claims->token_id);
         }
     }
     sendSuccessResponse(response, "Logged out successfully.");
@@ -365,6 +858,41 @@ void APIRouterHandler::handleUserMe(HTTPServerRequest& request, HTTPServerRespon
     sendJsonResponse(response, HTTPResponse::HTTP_OK, res_payload);
 }
 
+void APIRouterHandler::handleServerStats(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session) {
+    SessionStore::Stats s = session_store_.stats();
+    json sessions;
+    sessions[JsonKeys::ACTIVE] = s.active;
+    sessions[JsonKeys::CREATED] = s.created;
+    sessions[JsonKeys::EXPIRED] = s.expired;
+    sessions[JsonKeys::REMOVED] = s.removed;
+    sessions[JsonKeys::IDLE_TTL_SECONDS] = session_store_.idle_ttl().count();
+    sessions[JsonKeys::REVOKED_TOKENS] = revocations_.size();
+
+    json data;
+    data[JsonKeys::SESSIONS] = sessions;
+
+    AdmissionControl::Stats rl = admission_.stats();
+    json rate_limit;
+    rate_limit[JsonKeys::REJECTED_USER_REQUESTS] = rl.rejected_user_requests;
+    rate_limit[JsonKeys::REJECTED_USER_BYTES] = rl.rejected_user_bytes;
+    rate_limit[JsonKeys::REJECTED_IP_REQUESTS] = rl.rejected_ip_requests;
+    rate_limit[JsonKeys::TRACKED_KEYS] = rl.tracked_keys;
+    data[JsonKeys::RATE_LIMIT] = rate_limit;
+
+    if (const BoundedExecutor* hashing = user_manager_.hash_executor()) {
+        data[JsonKeys::PASSWORD_HASHING] = executorStatsJson(*hashing);
+    }
+    json pools;
+    pools[pools_.metadata.name()] = executorStatsJson(pools_.metadata);
+    pools[pools_.transfer.name()] = executorStatsJson(pools_.transfer);
+    data[JsonKeys::WORKER_POOLS] = pools;
+
+    json res_payload;
+    res_payload[JsonKeys::STATUS] = "success";
+    res_payload[JsonKeys::DATA] = data;
+    sendJsonResponse(response, HTTPResponse::HTTP_OK, res_payload);
+}
+
 
 
 
@@ -483,8 +1011,8 @@ void APIRouterHandler::handleUserMe(HTTPServerRequest& request, HTTPServerRespon
 //     }
 // }
 void APIRouterHandler::handleFileUpload(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session) {
-    std::cout << "[Server Upload] Received upload request from user: " << session.username << std::endl;
-    std::cout << "[Server Upload Debug] Request Content-Type: " << request.getContentType() << std::endl;
+    LOG_INFO("[Server Upload] Received upload request from user: " << session.username);
+    LOG_DEBUG("[Server Upload Debug] Request Content-Type: " << request.getContentType());
 
     if (request.getContentType().rfind("multipart/form-data", 0) != 0) {
         sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Content-Type must be multipart/form-data.");
@@ -534,8 +1062,8 @@ void APIRouterHandler::handleFileUpload(HTTPServerRequest& request, HTTPServerRe
             final_relative_path = partHandler.relativePathFromField;
         }
 
-        std::cout << "[Server Upload Debug] Final target relative path: '" << final_relative_path << "'" << std::endl;
-        std::cout << "[Server Upload Debug] Original filename from part: '" << partHandler.originalFileName << "'" << std::endl;
+        LOG_DEBUG("[Server Upload Debug] Final target relative path: '" << final_relative_path << "'");
+        LOG_DEBUG("[Server Upload Debug] Original filename from part: '" << partHandler.originalFileName << "'");
         
         if (final_relative_path.empty() || Poco::Path(final_relative_path).isAbsolute() || final_relative_path.find("..") != std::string::npos) {
             sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Invalid or missing 'relativePath'.");
@@ -549,7 +1077,7 @@ void APIRouterHandler::handleFileUpload(HTTPServerRequest& request, HTTPServerRe
 
         std::string file_content_str = partHandler.pFileStream->str();
         if (file_content_str.empty()) {
-            std::cout << "[Server Upload] Warning: Received a 0-byte file upload for " << final_relative_path << std::endl;
+            LOG_WARN("[Server Upload] Warning: Received a 0-byte file upload for " << final_relative_path);
         }
         std::vector<char> file_data_vec(file_content_str.begin(), file_content_str.end());
 
@@ -567,10 +1095,10 @@ void APIRouterHandler::handleFileUpload(HTTPServerRequest& request, HTTPServerRe
         }
 
     } catch (const Poco::Exception& e) {
-        std::cerr << "[Server Upload] Poco::Exception caught: " << e.displayText() << std::endl;
+        LOG_ERROR("[Server Upload] Poco::Exception caught: " << e.displayText());
         sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Bad Request: Could not parse multipart form. " + e.displayText());
     } catch (const std::exception& e) {
-        std::cerr << "[Server Upload] std::exception caught: " << e.what() << std::endl;
+        LOG_ERROR("[Server Upload] std::exception caught: " << e.what());
         sendErrorResponse(response, HTTPResponse::HTTP_INTERNAL_SERVER_ERROR, "An unexpected server error occurred during upload.");
     }
 }
@@ -617,8 +1145,365 @@ void APIRouterHandler::handleFileDownload(HTTPServerRequest& request, HTTPServer
 
 
 
+// --- Block delta transfer (xem BlockDelta trong protocol.hpp / block_delta.hpp) ---
+
+void APIRouterHandler::handleFileSignature(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session) {
+    const std::string relative_path = safeQueryPath(request);
+    if (relative_path.empty()) {
+        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Invalid or missing 'path' query parameter.");
+        return;
+    }
+    if (access_control_manager_.get_permission(session.user_id, fs::path(session.home_dir) / relative_path) < PermissionLevel::READ) {
+        sendErrorResponse(response, HTTPResponse::HTTP_FORBIDDEN, "Permission denied to read this file.");
+        return;
+    }
+    fs::path full_path = file_manager_.resolve_safe_path(session.home_dir, relative_path);
+    std::error_code ec;
+    if (full_path.empty() || !fs::is_regular_file(full_path, ec)) {
+        sendErrorResponse(response, HTTPResponse::HTTP_NOT_FOUND, "File not found.");
+        return;
+    }
+
+    // Checksum trước signature: nếu file đổi giữa hai bước, FILES_PATCH sẽ không khớp X-File-Checksum
+    const std::string checksum = file_manager_.calculate_checksum(full_path);
+    std::uint64_t file_size = 0;
+    auto base = file_manager_.open_file(full_path, &file_size); // File lưu dạng chunk: ghép từ chunk store
+    BlockDelta::Signature signature;
+    if (!base || !BlockDelta::compute_signature(*base, BlockDelta::block_size_for(file_size), signature)) {
+        sendErrorResponse(response, HTTPResponse::HTTP_INTERNAL_SERVER_ERROR, "Could not read the file.");
+        return;
+    }
+    std::ostringstream body;
+    BlockDelta::write_signature(signature, body);
+    const std::string payload = body.str();
+
+    LOG_DEBUG("[Server Delta] Signature of " << full_path << ": " << signature.blocks.size() << " blocks of " << signature.block_size);
+    response.set(HttpHeaders::FILE_CHECKSUM, checksum);
+    response.setContentType(ContentTypes::APPLICATION_OCTET_STREAM);
+    response.setContentLength(payload.size());
+    response.sendBuffer(payload.data(), payload.size());
+}
+
+void APIRouterHandler::handleFilePatch(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session) {
+    const std::string relative_path = safeQueryPath(request);
+    if (relative_path.empty()) {
+        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Invalid or missing 'path' query parameter.");
+        return;
+    }
+    const std::string base_checksum = request.get(HttpHeaders::BASE_CHECKSUM, "");
+    const std::string checksum = request.get(HttpHeaders::FILE_CHECKSUM, "");
+    if (base_checksum.empty() || checksum.empty()) {
+        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST,
+                          HttpHeaders::BASE_CHECKSUM + " and " + HttpHeaders::FILE_CHECKSUM + " headers are required.");
+        return;
+    }
+    fs::path target_abs_fs_path = fs::path(session.home_dir) / relative_path;
+    if (access_control_manager_.get_permission(session.user_id, target_abs_fs_path.parent_path()) < PermissionLevel::READ_WRITE) {
+        sendErrorResponse(response, HTTPResponse::HTTP_FORBIDDEN, "Permission denied to write to the target location.");
+        return;
+    }
+
+    switch (file_manager_.apply_delta(session.home_dir, relative_path, request.stream(), base_checksum, checksum, session.user_id)) {
+        case DeltaApplyResult::OK:
+            sendSuccessResponse(response, "File '" + relative_path + "' patched successfully.", HTTPResponse::HTTP_CREATED);
+            return;
+        case DeltaApplyResult::NOT_FOUND:
+            sendErrorResponse(response, HTTPResponse::HTTP_NOT_FOUND, "Base file not found.");
+            return;
+        case DeltaApplyResult::BASE_CHANGED:
+            sendErrorResponse(response, HTTPResponse::HTTP_PRECONDITION_FAILED, "The file changed since its signature was fetched.");
+            return;
+        case DeltaApplyResult::INVALID_DELTA:
+            sendErrorResponse(response, HTTPResponse::HTTP_UNPROCESSABLE_ENTITY, "Malformed delta.");
+            return;
+        case DeltaApplyResult::CHECKSUM_MISMATCH:
+            sendErrorResponse(response, HTTPResponse::HTTP_UNPROCESSABLE_ENTITY, "Patched file does not match " + HttpHeaders::FILE_CHECKSUM + ".");
+            return;
+        case DeltaApplyResult::IO_ERROR:
+            break;
+    }
+    sendErrorResponse(response, HTTPResponse::HTTP_INTERNAL_SERVER_ERROR, "File patch failed on the server.");
+}
+
+void APIRouterHandler::handleFileDelta(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session) {
+    const std::string relative_path = safeQueryPath(request);
+    if (relative_path.empty()) {
+        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Invalid or missing 'path' query parameter.");
+        return;
+    }
+    if (access_control_manager_.get_permission(session.user_id, fs::path(session.home_dir) / relative_path) < PermissionLevel::READ) {
+        sendErrorResponse(response, HTTPResponse::HTTP_FORBIDDEN, "Permission denied to read this file.");
+        return;
+    }
+    fs::path full_path = file_manager_.resolve_safe_path(session.home_dir, relative_path);
+    std::error_code ec;
+    if (full_path.empty() || !fs::is_regular_file(full_path, ec)) {
+        sendErrorResponse(response, HTTPResponse::HTTP_NOT_FOUND, "File not found.");
+        return;
+    }
+    BlockDelta::Signature client_signature;
+    if (!BlockDelta::read_signature(request.stream(), client_signature)) {
+        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Malformed block signature.");
+        return;
+    }
+
+    std::uint64_t file_size = 0;
+    auto target = file_manager_.open_file(full_path, &file_size);
+    if (!target) {
+        sendErrorResponse(response, HTTPResponse::HTTP_INTERNAL_SERVER_ERROR, "Could not read the file.");
+        return;
+    }
+    response.set(HttpHeaders::FILE_CHECKSUM, file_manager_.calculate_checksum(full_path));
+    if (file_size >= static_cast<std::uint64_t>(std::max(0, Config::TRANSFER_DELTA_MIN_FILE_SIZE))) {
+        // Delta nằm trong bộ nhớ (như FILES_DOWNLOAD), chỉ được gửi khi nhỏ hơn nhiều so với file
+        std::ostringstream delta;
+        BlockDelta::DeltaStats stats;
+        if (!BlockDelta::write_delta(client_signature, *target, delta, &stats)) {
+            sendErrorResponse(response, HTTPResponse::HTTP_INTERNAL_SERVER_ERROR, "Could not read the file.");
+            return;
+        }
+        if (BlockDelta::delta_worthwhile(stats.delta_bytes, file_size, Config::TRANSFER_DELTA_MAX_PERCENT)) {
+            LOG_DEBUG("[Server Delta] " << full_path << ": " << stats.delta_bytes << " delta bytes for " << file_size
+                      << " (" << stats.copied_bytes << " reused)");
+            const std::string payload = delta.str();
+            response.set(HttpHeaders::TRANSFER_MODE, "delta");
+            response.setContentType(ContentTypes::APPLICATION_OCTET_STREAM);
+            response.setContentLength(payload.size());
+            response.sendBuffer(payload.data(), payload.size());
+            return;
+        }
+    }
+    // Delta không đáng: gửi nguyên file (epoll engine dùng sendfile(2))
+    response.set(HttpHeaders::TRANSFER_MODE, "full");
+    if (!file_manager_.is_stored_as_chunks(full_path)) {
+        response.sendFile(full_path.string(), ContentTypes::APPLICATION_OCTET_STREAM);
+        return;
+    }
+    // Trên đĩa chỉ là placeholder: stream nội dung ghép từ chunk
+    target->clear();
+    target->seekg(0);
+    response.setContentType(ContentTypes::APPLICATION_OCTET_STREAM);
+    response.setContentLength64(static_cast<std::int64_t>(file_size));
+    std::ostream& out = response.send();
+    if (file_size > 0) out << target->rdbuf();
+    out.flush();
+}
+
+// --- Chunked upload (xem ChunkedUpload trong protocol.hpp / chunk_store.hpp) ---
+
+void APIRouterHandler::handleChunksMissing(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session) {
+    json req_payload;
+    try {
+        req_payload = json::parse(request.stream());
+    } catch (const json::exception& e) {
+        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Invalid JSON: " + std::string(e.what()));
+        return;
+    }
+    std::vector<std::string> hashes;
+    if (!readChunkHashes(req_payload, hashes)) {
+        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "'chunks' must be an array of SHA-256 hex strings.");
+        return;
+    }
+    const std::vector<std::string> missing = file_manager_.chunks().missing_chunks(hashes, session.user_id);
+    LOG_DEBUG("[Server Chunks] " << missing.size() << " of " << hashes.size() << " chunk(s) missing for user " << session.user_id);
+    sendJsonResponse(response, HTTPResponse::HTTP_OK, {{JsonKeys::STATUS, "success"}, {JsonKeys::MISSING, missing}});
+}
+
+void APIRouterHandler::handleChunksUpload(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session) {
+    // Chunk chưa thuộc file nào nên không cần quyền trên path; chỉ cần đăng nhập (như FILES_CHUNKS_MISSING)
+    std::size_t stored = 0;
+    std::string hash, data;
+    bool eof = false;
+    while (FastCdc::read_frame(request.stream(), hash, data, eof)) {
+        if (!file_manager_.chunks().put_chunk(hash, reinterpret_cast<const unsigned char*>(data.data()), data.size(), session.user_id)) {
+            sendErrorResponse(response, HTTPResponse::HTTP_UNPROCESSABLE_ENTITY, "Chunk " + hash + " does not match its hash.");
+            return;
+        }
+        ++stored;
+    }
+    if (!eof) {
+        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Malformed chunk frame after " + std::to_string(stored) + " chunk(s).");
+        return;
+    }
+    sendJsonResponse(response, HTTPResponse::HTTP_OK, {{JsonKeys::STATUS, "success"}, {JsonKeys::STORED, stored}});
+}
 
+void APIRouterHandler::handleFileCommit(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session) {
+    json req_payload;
+    try {
+        req_payload = json::parse(request.stream());
+    } catch (const json::exception& e) {
+        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Invalid JSON: " + std::string(e.what()));
+        return;
+    }
+    const std::string relative_path = req_payload.value(JsonKeys::PATH, "");
+    const std::string checksum = req_payload.value(JsonKeys::CHECKSUM, "");
+    std::vector<std::string> hashes;
+    if (relative_path.empty() || Poco::Path(relative_path).isAbsolute() || relative_path.find("..") != std::string::npos) {
+        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Invalid or missing 'path' in JSON body.");
+        return;
+    }
+    if (checksum.empty() || !readChunkHashes(req_payload, hashes)) {
+        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "'checksum' and 'chunks' are required.");
+        return;
+    }
+    fs::path target_abs_fs_path = fs::path(session.home_dir) / relative_path;
+    if (access_control_manager_.get_permission(session.user_id, target_abs_fs_path.parent_path()) < PermissionLevel::READ_WRITE) {
+        sendErrorResponse(response, HTTPResponse::HTTP_FORBIDDEN, "Permission denied to write to the target location.");
+        return;
+    }
 
+    ChunkRecipe recipe;
+    recipe.chunks.reserve(hashes.size());
+    for (auto& hash : hashes) recipe.chunks.push_back(ChunkRef{std::move(hash), 0});
+    switch (file_manager_.commit_chunks(session.home_dir, relative_path, std::move(recipe), checksum, session.user_id)) {
+        case ChunkCommitResult::OK:
+            sendSuccessResponse(response, "File '" + relative_path + "' uploaded successfully.", HTTPResponse::HTTP_CREATED);
+            return;
+        case ChunkCommitResult::INVALID_PATH:
+            sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Invalid target path.");
+            return;
+        case ChunkCommitResult::MISSING_CHUNKS:
+            sendErrorResponse(response, HTTPResponse::HTTP_CONFLICT, "Some chunks are missing; query " + Endpoints::FILES_CHUNKS_MISSING + " again.");
+            return;
+        case ChunkCommitResult::CHECKSUM_MISMATCH:
+            sendErrorResponse(response, HTTPResponse::HTTP_UNPROCESSABLE_ENTITY, "Chunks do not match 'checksum'.");
+            return;
+        case ChunkCommitResult::IO_ERROR:
+            break;
+    }
+    sendErrorResponse(response, HTTPResponse::HTTP_INTERNAL_SERVER_ERROR, "File commit failed on the server.");
+}
+
+void APIRouterHandler::handleFileClaim(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session) {
+    json req_payload;
+    try {
+        req_payload = json::parse(request.stream());
+    } catch (const json::exception& e) {
+        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Invalid JSON: " + std::string(e.what()));
+        return;
+    }
+    const std::string relative_path = req_payload.value(JsonKeys::PATH, "");
+    const std::string checksum = req_payload.value(JsonKeys::CHECKSUM, "");
+    if (relative_path.empty() || Poco::Path(relative_path).isAbsolute() || relative_path.find("..") != std::string::npos) {
+        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Invalid or missing 'path' in JSON body.");
+        return;
+    }
+    if (!FastCdc::is_chunk_hash(checksum)) { // Cùng dạng SHA-256 hex
+        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "'checksum' must be a SHA-256 hex string.");
+        return;
+    }
+    fs::path target_abs_fs_path = fs::path(session.home_dir) / relative_path;
+    if (access_control_manager_.get_permission(session.user_id, target_abs_fs_path.parent_path()) < PermissionLevel::READ_WRITE) {
+        sendErrorResponse(response, HTTPResponse::HTTP_FORBIDDEN, "Permission denied to write to the target location.");
+        return;
+    }
+
+    // Chỉ dùng file user đọc được: checksum không được thành cách lấy nội dung của người khác
+    auto can_read = [this, &session](const fs::path& source) {
+        return access_control_manager_.get_permission(session.user_id, source) >= PermissionLevel::READ;
+    };
+    std::uint64_t claimed_bytes = 0;
+    switch (file_manager_.claim_by_checksum(session.home_dir, relative_path, checksum, can_read, session.user_id, &claimed_bytes)) {
+        case ClaimResult::OK:
+            metrics_.claim_hits->inc();
+            metrics_.claim_bytes_avoided->inc(claimed_bytes);
+            sendSuccessResponse(response, "File '" + relative_path + "' created from existing content.", HTTPResponse::HTTP_CREATED);
+            return;
+        case ClaimResult::INVALID_PATH:
+            sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Invalid target path.");
+            return;
+        case ClaimResult::NOT_FOUND:
+            metrics_.claim_misses->inc();
+            sendErrorResponse(response, HTTPResponse::HTTP_NOT_FOUND, "No readable file with that checksum; upload the content.");
+            return;
+        case ClaimResult::IO_ERROR:
+            break;
+    }
+    sendErrorResponse(response, HTTPResponse::HTTP_INTERNAL_SERVER_ERROR, "File claim failed on the server.");
+}
+
+
+
+
+
+
+void APIRouterHandler::handleFileBatch(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session) {
+    json req_payload;
+    try {
+        req_payload = json::parse(request.stream());
+    } catch (const json::exception& e) {
+        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Invalid JSON: " + std::string(e.what()));
+        return;
+    }
+    if (!req_payload.is_object() || !req_payload.contains(JsonKeys::OPERATIONS) || !req_payload[JsonKeys::OPERATIONS].is_array()) {
+        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "'operations' must be an array.");
+        return;
+    }
+    const json& operations = req_payload[JsonKeys::OPERATIONS];
+    if (operations.size() > static_cast<std::size_t>(std::max(0, Config::STORAGE_BATCH_MAX_OPERATIONS))) {
+        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST,
+                          "At most " + std::to_string(Config::STORAGE_BATCH_MAX_OPERATIONS) + " operations per batch.");
+        return;
+    }
+    const bool atomic = req_payload.value(JsonKeys::ATOMIC, false);
+
+    std::vector<MetadataOp> ops;
+    ops.reserve(operations.size());
+    for (std::size_t i = 0; i < operations.size(); ++i) {
+        const json& item = operations[i];
+        const std::string kind = item.is_object() ? item.value(JsonKeys::OP, "") : "";
+        MetadataOp op;
+        if (kind == MetadataBatch::MKDIR || kind == MetadataBatch::DELETE) {
+            op.type = kind == MetadataBatch::MKDIR ? MetadataOpType::MKDIR : MetadataOpType::DELETE;
+            op.path = item.value(JsonKeys::PATH, "");
+        } else if (kind == MetadataBatch::RENAME) {
+            op.type = MetadataOpType::RENAME;
+            op.path = item.value(JsonKeys::OLD_PATH, "");
+            op.new_path = item.value(JsonKeys::NEW_PATH, "");
+        } else {
+            sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Operation " + std::to_string(i) + ": unknown 'op'.");
+            return;
+        }
+        if (op.path.empty() || (op.type == MetadataOpType::RENAME && op.new_path.empty())) {
+            sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Operation " + std::to_string(i) + ": missing path.");
+            return;
+        }
+        ops.push_back(std::move(op));
+    }
+
+    // Cùng quyền như FILES_MKDIR / FILES_DELETE / FILES_RENAME
+    auto can_write = [this, &session](const fs::path& path) {
+        return access_control_manager_.get_permission(session.user_id, path) >= PermissionLevel::READ_WRITE;
+    };
+    const std::vector<MetadataOpResult> results = file_manager_.apply_metadata_batch(session.home_dir, ops, atomic, can_write, session.user_id);
+
+    json results_json = json::array();
+    std::size_t failed = 0;
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        int code = HTTPResponse::HTTP_INTERNAL_SERVER_ERROR;
+        std::string message;
+        switch (results[i]) {
+            case MetadataOpResult::OK:
+                code = ops[i].type == MetadataOpType::MKDIR ? HTTPResponse::HTTP_CREATED : HTTPResponse::HTTP_OK;
+                break;
+            case MetadataOpResult::INVALID_PATH: code = HTTPResponse::HTTP_BAD_REQUEST; message = "Invalid path."; break;
+            case MetadataOpResult::FORBIDDEN:    code = HTTPResponse::HTTP_FORBIDDEN; message = "Permission denied."; break;
+            case MetadataOpResult::NOT_FOUND:    code = HTTPResponse::HTTP_NOT_FOUND; message = "Path does not exist."; break;
+            case MetadataOpResult::CONFLICT:     code = HTTPResponse::HTTP_CONFLICT; message = "Destination already exists."; break;
+            case MetadataOpResult::IO_ERROR:     message = "Operation failed on the server."; break;
+            case MetadataOpResult::NOT_APPLIED:  code = 424; message = "Not applied: another operation of the atomic batch failed."; break;
+        }
+        json entry = {{JsonKeys::CODE, code}};
+        if (!message.empty()) {
+            entry[JsonKeys::MESSAGE] = message;
+            ++failed;
+        }
+        results_json.push_back(std::move(entry));
+    }
+    LOG_DEBUG("[Server Batch] " << ops.size() << " operation(s), " << failed << " failed, user " << session.user_id);
+    sendJsonResponse(response, HTTPResponse::HTTP_OK, {{JsonKeys::STATUS, "success"}, {JsonKeys::RESULTS, results_json}});
+}
 
 void APIRouterHandler::handleFileList(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session) {
     Poco::URI uri(request.getURI());
@@ -639,21 +1524,14 @@ void APIRouterHandler::handleFileList(HTTPServerRequest& request, HTTPServerResp
         return;
     }
 
+    const ManifestFormat format = negotiate_manifest_format(request.get(HttpHeaders::ACCEPT, ""));
     std::vector<FileInfo> items = file_manager_.list_directory(session.home_dir, relative_path, session.user_id);
-    json j_items = json::array();
-    for (const auto& item : items) {
-        j_items.push_back({
-            {JsonKeys::NAME, item.name},
-            {JsonKeys::PATH, item.path}, // Path relative to the sync root/home dir
-            {JsonKeys::IS_DIRECTORY, item.is_directory},
-            {JsonKeys::SIZE, item.size},
-            {JsonKeys::LAST_MODIFIED, static_cast<long long>(item.last_modified)} // Unix timestamp
-        });
-    }
-    json res_payload;
-    res_payload[JsonKeys::STATUS] = "success";
-    res_payload[JsonKeys::LISTING] = j_items;
-    sendJsonResponse(response, HTTPResponse::HTTP_OK, res_payload);
+    streamManifestResponse(response, format, JsonKeys::LISTING, items.size(), [&items, format](ManifestResponseWriter& writer) {
+        for (const auto& item : items) {
+            writer.element(encode_listing_entry(item.name, item.path, item.is_directory, item.size,
+                                                static_cast<std::int64_t>(item.last_modified), format));
+        }
+    });
 }
 
 void APIRouterHandler::handleFileMkdir(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session) {
@@ -819,67 +1697,272 @@ void APIRouterHandler::handleFileRename(HTTPServerRequest& request, HTTPServerRe
 
 // Sync Handler
 void APIRouterHandler::handleSyncManifest(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session) {
-    json req_payload;
+    // Body có thể là JSON hoặc CBOR / MessagePack compact (Content-Type), response theo Accept.
+    const ManifestFormat request_format = manifest_format_from_content_type(request.getContentType());
+    const ManifestFormat response_format = negotiate_manifest_format(request.get(HttpHeaders::ACCEPT, ""));
+
+    // Đọc SAX thẳng từ stream vào manifest phẳng của planner: bộ nhớ đỉnh chỉ là mảng kết quả.
+    SyncPlanManifest client_manifest;
+    std::vector<std::string> scope; // Có sau SYNC_TREE: chỉ so các thư mục có hash khác
+    bool scoped = false;
+    ManifestLimits limits;
+    limits.max_entries = static_cast<std::uint64_t>(std::max(0, Config::SYNC_MANIFEST_MAX_ENTRIES));
+    limits.max_bytes = static_cast<std::uint64_t>(std::max(0, Config::SYNC_MANIFEST_MAX_BYTES));
     try {
-        req_payload = json::parse(request.stream());
-    } catch (const json::parse_error& e) {
-        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Invalid JSON for sync: " + std::string(e.what()) + " at byte " + std::to_string(e.byte));
+        read_manifest_stream(request.stream(), request_format, limits,
+            [&client_manifest](ManifestEntry&& entry) {
+                client_manifest.add(entry.relative_path, entry.last_modified, entry.checksum,
+                                    entry.is_directory, entry.is_deleted, entry.size);
+            },
+            [&client_manifest](std::size_t count) { client_manifest.reserve(count); },
+            [&scope, &scoped](std::string&& dir) {
+                scoped = true;
+                scope.push_back(normalize_sync_path(dir));
+            });
+    } catch (const ManifestTooLarge& e) {
+        sendErrorResponse(response, HTTPResponse::HTTP_REQUEST_ENTITY_TOO_LARGE, e.what());
         return;
+    } catch (const ManifestMalformed& e) {
+        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Invalid manifest for sync: " + std::string(e.what()));
+        return;
+    }
+    LOG_DEBUG("Sync manifest from user " << session.user_id << ": " << client_manifest.size() << " entries"
+              << (scoped ? ", scope of " + std::to_string(scope.size()) + " directories" : std::string()));
+    for (const auto& dir : scope) {
+        if (dir.find("..") != std::string::npos) {
+            sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Invalid directory in manifest scope: " + dir);
+            return;
+        }
     }
 
-    if (!req_payload.contains(JsonKeys::CLIENT_FILES) || !req_payload[JsonKeys::CLIENT_FILES].is_array()) {
-        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Missing or invalid 'client_files' array.");
+    Poco::Path server_sync_root_path(session.home_dir); // KHAI BÁO ĐÚNG
+
+    PermissionLevel perm = access_control_manager_.get_permission(session.user_id, fs::path(session.home_dir));
+    if (perm < PermissionLevel::READ_WRITE) {
+         sendErrorResponse(response, HTTPResponse::HTTP_FORBIDDEN, "Permission denied for sync on home dir.");
         return;
     }
 
-    std::vector<ClientSyncFileInfo> client_files_info_list; // KHAI BÁO ĐÚNG
-    for (const auto& cf_json : req_payload[JsonKeys::CLIENT_FILES]) {
-        ClientSyncFileInfo cfi;
-        cfi.relative_path = cf_json.value(JsonKeys::RELATIVE_PATH, "");
-        cfi.last_modified = Poco::Timestamp::fromEpochTime(cf_json.value(JsonKeys::LAST_MODIFIED, (long long)0));
-        cfi.checksum = cf_json.value(JsonKeys::CHECKSUM, "");
+    // Mã action trên dây = giá trị SyncActionType (xem CompactManifest::SYNC_ACTION_NAMES)
+    static_assert(static_cast<int>(SyncActionType::MOVE_ON_CLIENT) + 1 == CompactManifest::SYNC_ACTION_COUNT,
+                  "CompactManifest::SYNC_ACTION_NAMES must follow SyncActionType");
 
-        cfi.is_directory = cf_json.value(JsonKeys::IS_DIRECTORY, false);
-        cfi.is_deleted = cf_json.value("is_deleted", false); 
-        if (!cfi.relative_path.empty()) {
-            client_files_info_list.push_back(cfi);
+    if (accepts_plan_stream(request.get(HttpHeaders::ACCEPT, ""))) {
+        // PlanStream: mỗi operation một dòng ngay khi planner tính xong, client bắt đầu chạy trước khi plan xong.
+        // Không nén: CompressingBodyStream chỉ gửi khi đóng nên sẽ giữ lại cả plan.
+        response.setStatus(HTTPResponse::HTTP_OK);
+        response.setContentType(ContentTypes::APPLICATION_NDJSON);
+        response.set("Vary", HttpHeaders::ACCEPT + ", " + HttpHeaders::ACCEPT_ENCODING);
+        response.set("Cache-Control", "no-store");
+        response.setChunkedTransferEncoding(true);
+        std::ostream& out = response.send();
+        std::size_t count = 0;
+        try {
+            sync_manager_.stream_sync_actions(session.user_id, server_sync_root_path, client_manifest, access_control_manager_,
+                scoped ? &scope : nullptr, [&out, &count](SyncOperation&& op) {
+                    out << encode_sync_operation(static_cast<int>(op.action), op.relative_path, ManifestFormat::JSON,
+                                                 op.source_path, op.size).dump()
+                        << PlanStream::LINE_SEPARATOR;
+                    if (++count % 64 == 0) out.flush();
+                });
+            out << json{{JsonKeys::STATUS, "success"}, {JsonKeys::COUNT, count}}.dump() << PlanStream::LINE_SEPARATOR;
+        } catch (const std::exception& e) {
+            // Header đã gửi: lỗi chỉ báo được bằng dòng cuối
+            LOG_ERROR("Streaming sync plan for user " << session.user_id << " failed after " << count << " operations: " << e.what());
+            out << json{{JsonKeys::STATUS, "error"}, {JsonKeys::MESSAGE, "Sync planning failed."}}.dump()
+                << PlanStream::LINE_SEPARATOR;
         }
+        out.flush();
+        return;
+    }
+
+    std::vector<SyncOperation> sync_ops_result = sync_manager_.determine_sync_actions(
+        session.user_id, server_sync_root_path, client_manifest, access_control_manager_, scoped ? &scope : nullptr);
+
+    streamManifestResponse(response, response_format, JsonKeys::SYNC_OPERATIONS, sync_ops_result.size(),
+        [&sync_ops_result, response_format](ManifestResponseWriter& writer) {
+            for (const auto& op : sync_ops_result) {
+                writer.element(encode_sync_operation(static_cast<int>(op.action), op.relative_path, response_format, op.source_path,
+                                                     op.size));
+            }
+        });
+}
+
+// Tree sync: so hash thư mục theo từng mức (xem MerkleTree trong protocol.hpp)
+void APIRouterHandler::handleSyncTree(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session) {
+    const ManifestFormat request_format = manifest_format_from_content_type(request.getContentType());
+    const ManifestFormat response_format = negotiate_manifest_format(request.get(HttpHeaders::ACCEPT, ""));
+
+    json req_payload;
+    try {
+        if (request_format == ManifestFormat::CBOR) req_payload = json::from_cbor(request.stream());
+        else if (request_format == ManifestFormat::MSGPACK) req_payload = json::from_msgpack(request.stream());
+        else req_payload = json::parse(request.stream());
+    } catch (const json::exception& e) {
+        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Invalid tree sync body: " + std::string(e.what()));
+        return;
+    }
+    if (!req_payload.is_object() || !req_payload.contains(JsonKeys::DIRECTORIES) || !req_payload[JsonKeys::DIRECTORIES].is_array()) {
+        sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Missing or invalid '" + JsonKeys::DIRECTORIES + "' array.");
+        return;
+    }
+    const json& directories = req_payload[JsonKeys::DIRECTORIES];
+    if (Config::SYNC_MANIFEST_MAX_ENTRIES > 0 && directories.size() > static_cast<std::size_t>(Config::SYNC_MANIFEST_MAX_ENTRIES)) {
+        sendErrorResponse(response, HTTPResponse::HTTP_REQUEST_ENTITY_TOO_LARGE,
+                          "Tree sync request has more than " + std::to_string(Config::SYNC_MANIFEST_MAX_ENTRIES) + " directories.");
+        return;
     }
-    
-    Poco::Path server_sync_root_path(session.home_dir); // KHAI BÁO ĐÚNG
 
     PermissionLevel perm = access_control_manager_.get_permission(session.user_id, fs::path(session.home_dir));
-    if (perm < PermissionLevel::READ_WRITE) {
-         sendErrorResponse(response, HTTPResponse::HTTP_FORBIDDEN, "Permission denied for sync on home dir.");
+    if (perm < PermissionLevel::READ) {
+        sendErrorResponse(response, HTTPResponse::HTTP_FORBIDDEN, "Permission denied for sync on home dir.");
         return;
     }
 
+    const std::string home = canonicalHome(session.home_dir);
 
+    struct Requested {
+        std::string path;        // tương đối, đã chuẩn hoá
+        std::string client_hash;
+    };
+    std::vector<Requested> requested;
+    requested.reserve(directories.size());
+    for (const auto& item : directories) {
+        if (!item.is_object() || !item.contains(JsonKeys::PATH) || !item[JsonKeys::PATH].is_string()) {
+            sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Each directory needs a string '" + JsonKeys::PATH + "'.");
+            return;
+        }
+        Requested r{normalize_sync_path(item[JsonKeys::PATH].get<std::string>()), item.value(JsonKeys::HASH, std::string())};
+        if (r.path.find("..") != std::string::npos) {
+            sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Invalid directory path: " + r.path);
+            return;
+        }
+        requested.push_back(std::move(r));
+    }
 
-    std::vector<SyncOperation> sync_ops_result = sync_manager_.determine_sync_actions(session.user_id, server_sync_root_path, client_files_info_list, access_control_manager_);
+    TreeHashIndex& index = file_manager_.tree_hashes();
+    streamManifestResponse(response, response_format, JsonKeys::DIRECTORIES, requested.size(),
+        [&](ManifestResponseWriter& writer) {
+            for (const auto& r : requested) {
+                const std::string abs = r.path.empty() ? home : home + "/" + r.path;
+                json dir = {{JsonKeys::PATH, r.path}, {JsonKeys::HASH, ""}};
+                std::error_code dir_ec;
+                if (fs::is_directory(abs, dir_ec)) {
+                    const std::string server_hash = index.directory_hash(abs);
+                    dir[JsonKeys::HASH] = server_hash;
+                    if (server_hash != r.client_hash) {
+                        json children = json::array();
+                        for (const auto& child : index.children(abs)) {
+                            children.push_back(json::array({child.name, child.is_directory,
+                                response_format == ManifestFormat::JSON ? json(child.value) : checksum_to_wire(child.value)}));
+                        }
+                        dir[JsonKeys::CHILDREN] = std::move(children);
+                    }
+                }
+                writer.element(dir);
+            }
+        });
+}
 
-    json ops_json_array_resp = json::array();
-    for (const auto& op : sync_ops_result) {
-        json op_json_obj;
-        std::string action_str;
-        switch (op.action) { // Dùng SyncActionType từ sync_manager.hpp
-            case SyncActionType::NO_ACTION: action_str = "NO_ACTION"; break;
-            case SyncActionType::UPLOAD_TO_SERVER: action_str = "UPLOAD_TO_SERVER"; break;
-            case SyncActionType::DOWNLOAD_TO_CLIENT: action_str = "DOWNLOAD_TO_CLIENT"; break;
-            case SyncActionType::CONFLICT_SERVER_WINS: action_str = "CONFLICT_SERVER_WINS"; break;
-            // ... các case khác ...
-            default: action_str = "UNKNOWN_SYNC_ACTION";
+// Trả lời khi tree hash của home khác "hash" client gửi (ngay lập tức nếu đã khác), hoặc
+// "changed": false khi hết timeout. Đăng ký với ChangeNotifier trước rồi mới đọc hash, nên
+// một thay đổi xen giữa hai bước không bị bỏ lỡ.
+void APIRouterHandler::handleSyncWatch(HTTPServerRequest& request, HTTPServerResponse& response, const ActiveSession& session) {
+    Poco::URI uri(request.getURI());
+    std::string client_hash;
+    int timeout_seconds = Config::SYNC_WATCH_TIMEOUT_SECONDS;
+    for (const auto& p : uri.getQueryParameters()) {
+        if (p.first == JsonKeys::HASH) {
+            client_hash = p.second;
+        } else if (p.first == "timeout") {
+            try {
+                timeout_seconds = std::stoi(p.second);
+            } catch (const std::exception&) {
+                sendErrorResponse(response, HTTPResponse::HTTP_BAD_REQUEST, "Invalid 'timeout' query parameter.");
+                return;
+            }
         }
+    }
+    timeout_seconds = std::clamp(timeout_seconds, 0, std::max(0, Config::SYNC_WATCH_TIMEOUT_SECONDS));
 
-        // Tạo JSON object cho mỗi operation
-        op_json_obj[JsonKeys::SYNC_ACTION_TYPE] = action_str;
-        op_json_obj[JsonKeys::RELATIVE_PATH] = op.relative_path;
-        ops_json_array_resp.push_back(op_json_obj);
+    PermissionLevel perm = access_control_manager_.get_permission(session.user_id, fs::path(session.home_dir));
+    if (perm < PermissionLevel::READ) {
+        sendErrorResponse(response, HTTPResponse::HTTP_FORBIDDEN, "Permission denied for sync on home dir.");
+        return;
     }
-    json res_payload;
-    res_payload[JsonKeys::STATUS] = "success";
-    res_payload[JsonKeys::SYNC_OPERATIONS] = ops_json_array_resp;
-    sendJsonResponse(response, HTTPResponse::HTTP_OK, res_payload);
+
+    const std::string home = canonicalHome(session.home_dir);
+    TreeHashIndex* index = &file_manager_.tree_hashes(); // FileManager sống lâu hơn mọi request
+    ChangeNotifier& changes = file_manager_.changes();
+
+    // Client chưa có hash (lần đầu) hoặc không muốn chờ: trả lời ngay
+    if (client_hash.empty() || timeout_seconds == 0) {
+        const std::string current = index->directory_hash(home);
+        sendWatchResponse(response, current != client_hash, current);
+        return;
+    }
+    if (Config::SYNC_WATCH_MAX_WAITERS > 0 && changes.waiting() >= static_cast<std::size_t>(Config::SYNC_WATCH_MAX_WAITERS)) {
+        sendRetryLaterResponse(response, pools_.retry_after_seconds, "Too many watchers, retry later.");
+        return;
+    }
+
+    const std::chrono::seconds timeout(timeout_seconds);
+    if (auto* deferrable = dynamic_cast<DeferrableResponse*>(&response)) {
+        // Epoll: handler thread được trả lại ngay, kết nối nằm chờ trên I/O thread
+        auto send = std::make_shared<std::function<void(const DeferrableResponse::Writer&)>>(deferrable->defer());
+        const ChangeNotifier::Id id = changes.subscribe(home, timeout, [send, index, home, client_hash](bool) {
+            // Thay đổi rồi đổi ngược lại thì hash như cũ: báo không đổi
+            const std::string current = index->directory_hash(home);
+            (*send)([&](HTTPServerResponse& later) { sendWatchResponse(later, current != client_hash, current); });
+        });
+        const std::string current = index->directory_hash(home);
+        if (current != client_hash && changes.unsubscribe(id)) {
+            (*send)([&](HTTPServerResponse& later) { sendWatchResponse(later, true, current); });
+        }
+        return;
+    }
+
+    // Engine Poco: không có cách trả thread lại, chờ ngay trên thread kết nối. Chỉ một phần tư
+    // server.max_threads được dùng để chờ, phần còn lại phục vụ upload / login; quá mức đó trả lời
+    // ngay kèm Retry-After để client hỏi lại sau thay vì giữ thread.
+    const int poco_limit = std::max(1, Config::HTTP_MAX_THREADS / 4);
+    if (poco_parked_watchers.fetch_add(1) >= poco_limit) {
+        poco_parked_watchers.fetch_sub(1);
+        const std::string current = index->directory_hash(home);
+        if (current == client_hash) response.set("Retry-After", std::to_string(timeout_seconds));
+        sendWatchResponse(response, current != client_hash, current);
+        return;
+    }
+    struct ParkedSlot {
+        ~ParkedSlot() { poco_parked_watchers.fetch_sub(1); }
+    } parked_slot;
+
+    struct Waiter {
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool fired = false;
+    };
+    auto waiter = std::make_shared<Waiter>();
+    const ChangeNotifier::Id id = changes.subscribe(home, timeout, [waiter](bool) {
+        {
+            std::lock_guard<std::mutex> lock(waiter->mutex);
+            waiter->fired = true;
+        }
+        waiter->cv.notify_all();
+    });
+    std::string current = index->directory_hash(home);
+    if (current != client_hash && changes.unsubscribe(id)) {
+        sendWatchResponse(response, true, current);
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(waiter->mutex);
+        // Sweeper fire theo timeout; chờ thêm một chút phòng khi sweeper không chạy
+        waiter->cv.wait_for(lock, timeout + std::chrono::seconds(2), [&waiter]() { return waiter->fired; });
+    }
+    changes.unsubscribe(id); // Không làm gì nếu đã fire
+    current = index->directory_hash(home);
+    sendWatchResponse(response, current != client_hash, current);
 }
 
 // Sharing Handlers
@@ -0,0 +1,218 @@
+#include "session_persistence.hpp"
+#include "async_logger.hpp"
+#include "token_codec.hpp"
+
+#include <iostream>
+#include <vector>
+
+namespace {
+    std::int64_t unix_now() {
+        return std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    std::string column_text(sqlite3_stmt* stmt, int col) {
+        const unsigned char* text = sqlite3_column_text(stmt, col);
+        return text ? reinterpret_cast<const char*>(text) : "";
+    }
+}
+
+SessionPersistence::SessionPersistence(const std::string& db_path, SessionStore& store, TokenRevocationList& revocations,
+                                       std::chrono::seconds flush_interval)
+    : db_(db_path), store_(store), revocations_(revocations), flush_interval_(flush_interval) {
+    if (db_.get_db_handle()) {
+        // Handler threads write to the same file through the main connection.
+        sqlite3_busy_timeout(db_.get_db_handle(), 5000);
+    }
+}
+
+SessionPersistence::~SessionPersistence() {
+    stop();
+}
+
+std::optional<std::string> SessionPersistence::load_or_create_signing_key(const std::string& key_id) {
+    sqlite3* h = db_.get_db_handle();
+    if (!h) return std::nullopt;
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(h, "SELECT secret FROM token_signing_keys WHERE key_id = ?;", -1, &stmt, nullptr) != SQLITE_OK) {
+        LOG_ERROR("[SessionPersistence] Failed to prepare key lookup: " << sqlite3_errmsg(h));
+        return std::nullopt;
+    }
+    sqlite3_bind_text(stmt, 1, key_id.c_str(), -1, SQLITE_TRANSIENT);
+    std::optional<std::string> secret;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        secret = column_text(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    if (secret) return secret;
+
+    std::string fresh = TokenCodec::generate_secret();
+    if (sqlite3_prepare_v2(h, "INSERT INTO token_signing_keys (key_id, secret, created_at) VALUES (?, ?, ?);", -1, &stmt, nullptr) != SQLITE_OK) {
+        LOG_ERROR("[SessionPersistence] Failed to prepare key insert: " << sqlite3_errmsg(h));
+        return std::nullopt;
+    }
+    sqlite3_bind_text(stmt, 1, key_id.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, fresh.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 3, unix_now());
+    bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+    if (!ok) {
+        LOG_ERROR("[SessionPersistence] Failed to store signing key: " << sqlite3_errmsg(h));
+    }
+    sqlite3_finalize(stmt);
+    if (!ok) return std::nullopt;
+    return fresh;
+}
+
+std::size_t SessionPersistence::load() {
+    if (!db_.get_db_handle()) return 0;
+    std::int64_t now = unix_now();
+
+    // Bỏ các dòng đã hết hạn trước khi nạp.
+    db_.execute("DELETE FROM sessions WHERE expires_at <= " + std::to_string(now) + ";");
+    db_.execute("DELETE FROM revoked_tokens WHERE expires_at <= " + std::to_string(now) + ";");
+
+    db_.execute_query("SELECT token_id, expires_at FROM revoked_tokens;", [this](sqlite3_stmt* stmt) {
+        revocations_.revoke(column_text(stmt, 0), sqlite3_column_int64(stmt, 1));
+    });
+
+    std::size_t restored = 0;
+    std::vector<std::string> stale;
+    db_.execute_query("SELECT token_id, user_id, username, home_dir, expires_at, last_activity FROM sessions;",
+        [&](sqlite3_stmt* stmt) {
+            PersistedSession s{column_text(stmt, 0), sqlite3_column_int(stmt, 1), column_text(stmt, 2),
+                               column_text(stmt, 3), sqlite3_column_int64(stmt, 4), sqlite3_column_int64(stmt, 5)};
+            if (revocations_.is_revoked(s.token_id) || !store_.restore(s)) {
+                stale.push_back(s.token_id);
+            } else {
+                ++restored;
+            }
+        });
+
+    // Sessions idle past the TTL while we were down: drop them now.
+    for (const auto& token_id : stale) {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db_.get_db_handle(), "DELETE FROM sessions WHERE token_id = ?;", -1, &stmt, nullptr) == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, token_id.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_step(stmt);
+            sqlite3_finalize(stmt);
+        }
+    }
+    // restore() does not mark entries dirty; discard any removals queued during load.
+    std::vector<PersistedSession> ignored_upserts;
+    std::vector<std::string> ignored_deletes;
+    store_.drain_changes(ignored_upserts, ignored_deletes);
+
+    LOG_INFO("[SessionPersistence] Restored " << restored << " session(s), "
+              << revocations_.size() << " revoked token(s).");
+    return restored;
+}
+
+bool SessionPersistence::flush() {
+    std::lock_guard<std::mutex> guard(flush_mutex_);
+    sqlite3* h = db_.get_db_handle();
+    if (!h) return false;
+
+    // Batch lỗi lần trước được ghi lại trước, thay đổi mới nối phía sau.
+    std::vector<PersistedSession> upserts;
+    std::vector<std::string> deletes;
+    upserts.swap(retry_upserts_);
+    deletes.swap(retry_deletes_);
+    store_.drain_changes(upserts, deletes);
+    auto revoked = revocations_.snapshot();
+    std::int64_t now = unix_now();
+
+    if (!db_.execute("BEGIN IMMEDIATE;")) return false;
+    bool ok = true;
+
+    sqlite3_stmt* upsert_stmt = nullptr;
+    const char* upsert_sql =
+        "INSERT INTO sessions (token_id, user_id, username, home_dir, expires_at, last_activity) VALUES (?, ?, ?, ?, ?, ?) "
+        "ON CONFLICT(token_id) DO UPDATE SET last_activity = excluded.last_activity;";
+    if (!upserts.empty()) {
+        ok = sqlite3_prepare_v2(h, upsert_sql, -1, &upsert_stmt, nullptr) == SQLITE_OK;
+        for (std::size_t i = 0; ok && i < upserts.size(); ++i) {
+            const auto& s = upserts[i];
+            sqlite3_bind_text(upsert_stmt, 1, s.token_id.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_int(upsert_stmt, 2, s.user_id);
+            sqlite3_bind_text(upsert_stmt, 3, s.username.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(upsert_stmt, 4, s.home_dir.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_int64(upsert_stmt, 5, s.token_expires_at);
+            sqlite3_bind_int64(upsert_stmt, 6, s.last_activity);
+            // Lỗi FK (user đã bị xoá) không nên chặn cả batch.
+            int rc = sqlite3_step(upsert_stmt);
+            if (rc != SQLITE_DONE && rc != SQLITE_CONSTRAINT) ok = false;
+            sqlite3_reset(upsert_stmt);
+        }
+        sqlite3_finalize(upsert_stmt);
+    }
+
+    if (ok && !deletes.empty()) {
+        sqlite3_stmt* del_stmt = nullptr;
+        ok = sqlite3_prepare_v2(h, "DELETE FROM sessions WHERE token_id = ?;", -1, &del_stmt, nullptr) == SQLITE_OK;
+        for (std::size_t i = 0; ok && i < deletes.size(); ++i) {
+            sqlite3_bind_text(del_stmt, 1, deletes[i].c_str(), -1, SQLITE_STATIC);
+            ok = sqlite3_step(del_stmt) == SQLITE_DONE;
+            sqlite3_reset(del_stmt);
+        }
+        sqlite3_finalize(del_stmt);
+    }
+
+    if (ok) {
+        ok = db_.execute("DELETE FROM revoked_tokens WHERE expires_at <= " + std::to_string(now) + ";");
+    }
+    if (ok && !revoked.empty()) {
+        sqlite3_stmt* rev_stmt = nullptr;
+        ok = sqlite3_prepare_v2(h, "INSERT OR IGNORE INTO revoked_tokens (token_id, expires_at) VALUES (?, ?);", -1, &rev_stmt, nullptr) == SQLITE_OK;
+        for (std::size_t i = 0; ok && i < revoked.size(); ++i) {
+            sqlite3_bind_text(rev_stmt, 1, revoked[i].first.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_int64(rev_stmt, 2, revoked[i].second);
+            ok = sqlite3_step(rev_stmt) == SQLITE_DONE;
+            sqlite3_reset(rev_stmt);
+        }
+        sqlite3_finalize(rev_stmt);
+    }
+
+    if (!ok) {
+        LOG_ERROR("[SessionPersistence] Flush failed: " << sqlite3_errmsg(h));
+        db_.execute("ROLLBACK;");
+        retry_upserts_.swap(upserts);
+        retry_deletes_.swap(deletes);
+        return false;
+    }
+    if (!db_.execute("COMMIT;")) {
+        db_.execute("ROLLBACK;");
+        retry_upserts_.swap(upserts);
+        retry_deletes_.swap(deletes);
+        return false;
+    }
+    return true;
+}
+
+void SessionPersistence::start() {
+    std::lock_guard<std::mutex> lock(flusher_mutex_);
+    if (flusher_.joinable()) return;
+    stop_requested_ = false;
+    flusher_ = std::thread([this]() {
+        std::unique_lock<std::mutex> lk(flusher_mutex_);
+        while (!stop_requested_) {
+            flusher_cv_.wait_for(lk, flush_interval_, [this]() { return stop_requested_; });
+            if (stop_requested_) break;
+            lk.unlock();
+            flush();
+            lk.lock();
+        }
+    });
+}
+
+void SessionPersistence::stop() {
+    {
+        std::lock_guard<std::mutex> lock(flusher_mutex_);
+        stop_requested_ = true;
+    }
+    flusher_cv_.notify_all();
+    if (flusher_.joinable()) {
+        flusher_.join();
+        flush(); // Ghi nốt batch cuối trước khi tắt
+    }
+}
@@ -0,0 +1,245 @@
+#include "session_store.hpp"
+#include "async_logger.hpp"
+
+#include <iostream>
+
+SessionStore::SessionStore(std::chrono::seconds idle_ttl)
+    : idle_ttl_(idle_ttl),
+      epoch_(std::chrono::steady_clock::now()),
+      epoch_unix_ms_(std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::system_clock::now().time_since_epoch()).count()),
+      wheel_(0) {}
+
+SessionStore::~SessionStore() {
+    stop_sweeper();
+}
+
+void SessionStore::start_sweeper() {
+    std::lock_guard<std::mutex> lock(sweeper_mutex_);
+    if (sweeper_.joinable()) return;
+    stop_requested_ = false;
+    sweeper_ = std::thread([this]() {
+        std::unique_lock<std::mutex> lk(sweeper_mutex_);
+        while (!stop_requested_) {
+            sweeper_cv_.wait_for(lk, std::chrono::seconds(1), [this]() { return stop_requested_; });
+            if (stop_requested_) break;
+            lk.unlock();
+            std::size_t n = sweep();
+            if (n > 0) {
+                LOG_INFO("[SessionStore] Expired " << n << " idle session(s).");
+            }
+            lk.lock();
+        }
+    });
+}
+
+void SessionStore::stop_sweeper() {
+    {
+        std::lock_guard<std::mutex> lock(sweeper_mutex_);
+        stop_requested_ = true;
+    }
+    sweeper_cv_.notify_all();
+    if (sweeper_.joinable()) sweeper_.join();
+}
+
+SessionStore::Shard& SessionStore::shard_for(const std::string& token) {
+    return shards_[std::hash<std::string>{}(token) % SHARD_COUNT];
+}
+
+std::int64_t SessionStore::now_ms() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - epoch_).count();
+}
+
+std::int64_t SessionStore::to_unix_seconds(std::int64_t store_ms) const {
+    return (epoch_unix_ms_ + store_ms) / 1000;
+}
+
+void SessionStore::note_removed(const std::string& token_id) {
+    std::lock_guard<std::mutex> lock(removed_mutex_);
+    removed_since_drain_.push_back(token_id);
+}
+
+TimingWheel::Tick SessionStore::tick_for_ms(std::int64_t ms) const {
+    return ms <= 0 ? 0 : static_cast<TimingWheel::Tick>((ms + 999) / 1000);
+}
+
+void SessionStore::insert(const std::string& token, int user_id, const std::string& username, const std::string& home_dir,
+                          std::int64_t token_expires_at) {
+    auto entry = std::make_shared<Entry>();
+    entry->user_id = user_id;
+    entry->username = username;
+    entry->home_dir = home_dir;
+    entry->token_expires_at = token_expires_at;
+    std::int64_t now = now_ms();
+    entry->last_activity_ms.store(now, std::memory_order_relaxed);
+
+    bool is_new = false;
+    {
+        Shard& shard = shard_for(token);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        is_new = shard.map.insert_or_assign(token, std::move(entry)).second;
+    }
+    if (is_new) active_.fetch_add(1, std::memory_order_relaxed);
+    created_.fetch_add(1, std::memory_order_relaxed);
+
+    // Khoá shard đã được nhả trước khi lấy wheel_mutex_ (sweep() lấy theo thứ tự ngược lại).
+    std::lock_guard<std::mutex> lock(wheel_mutex_);
+    wheel_.schedule(token, tick_for_ms(now + idle_ttl_.count() * 1000));
+}
+
+std::optional<SessionInfo> SessionStore::touch(const std::string& token) {
+    Shard& shard = shard_for(token);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.map.find(token);
+    if (it == shard.map.end()) {
+        return std::nullopt;
+    }
+    Entry& entry = *it->second;
+    std::int64_t now = now_ms();
+    std::int64_t last = entry.last_activity_ms.load(std::memory_order_relaxed);
+    if (now - last > idle_ttl_.count() * 1000) {
+        return std::nullopt; // Hết hạn nhưng sweeper chưa kịp dọn
+    }
+    entry.last_activity_ms.store(now, std::memory_order_relaxed);
+    if (!entry.dirty.load(std::memory_order_relaxed)) entry.dirty.store(true, std::memory_order_relaxed);
+    return SessionInfo{entry.user_id, entry.username, entry.home_dir, Poco::Timestamp()};
+}
+
+bool SessionStore::touch_or_adopt(const std::string& token, int user_id, const std::string& username, const std::string& home_dir,
+                                  std::int64_t token_expires_at) {
+    {
+        Shard& shard = shard_for(token);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.map.find(token);
+        if (it != shard.map.end()) {
+            Entry& entry = *it->second;
+            std::int64_t now = now_ms();
+            if (now - entry.last_activity_ms.load(std::memory_order_relaxed) > idle_ttl_.count() * 1000) {
+                return false;
+            }
+            entry.last_activity_ms.store(now, std::memory_order_relaxed);
+            if (!entry.dirty.load(std::memory_order_relaxed)) entry.dirty.store(true, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    // Token hợp lệ nhưng process này chưa thấy (server khác cấp, hoặc trước khi restart).
+    insert(token, user_id, username, home_dir, token_expires_at);
+    return true;
+}
+
+bool SessionStore::erase(const std::string& token) {
+    Shard& shard = shard_for(token);
+    {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        if (shard.map.erase(token) == 0) {
+            return false;
+        }
+    }
+    active_.fetch_sub(1, std::memory_order_relaxed);
+    removed_.fetch_add(1, std::memory_order_relaxed);
+    note_removed(token);
+    // Slot tương ứng trong wheel sẽ tự bỏ qua token này khi tới hạn.
+    return true;
+}
+
+bool SessionStore::restore(const PersistedSession& session) {
+    std::int64_t last_ms = session.last_activity * 1000 - epoch_unix_ms_;
+    std::int64_t deadline_ms = last_ms + idle_ttl_.count() * 1000;
+    if (deadline_ms <= now_ms()) {
+        return false; // Đã idle quá TTL trong lúc server tắt
+    }
+
+    auto entry = std::make_shared<Entry>();
+    entry->user_id = session.user_id;
+    entry->username = session.username;
+    entry->home_dir = session.home_dir;
+    entry->token_expires_at = session.token_expires_at;
+    entry->last_activity_ms.store(last_ms, std::memory_order_relaxed);
+    entry->dirty.store(false, std::memory_order_relaxed);
+
+    bool is_new = false;
+    {
+        Shard& shard = shard_for(session.token_id);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        is_new = shard.map.emplace(session.token_id, std::move(entry)).second;
+    }
+    if (!is_new) return false;
+    active_.fetch_add(1, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(wheel_mutex_);
+    wheel_.schedule(session.token_id, tick_for_ms(deadline_ms));
+    return true;
+}
+
+void SessionStore::drain_changes(std::vector<PersistedSession>& upserts, std::vector<std::string>& deletes) {
+    for (Shard& shard : shards_) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        for (const auto& kv : shard.map) {
+            Entry& entry = *kv.second;
+            if (!entry.dirty.exchange(false, std::memory_order_relaxed)) continue;
+            upserts.push_back(PersistedSession{
+                kv.first, entry.user_id, entry.username, entry.home_dir, entry.token_expires_at,
+                to_unix_seconds(entry.last_activity_ms.load(std::memory_order_relaxed))});
+        }
+    }
+    std::lock_guard<std::mutex> lock(removed_mutex_);
+    deletes.insert(deletes.end(), removed_since_drain_.begin(), removed_since_drain_.end());
+    removed_since_drain_.clear();
+}
+
+void SessionStore::on_wheel_expire(const std::string& token, std::vector<std::pair<std::string, std::int64_t>>& expired) {
+    Shard& shard = shard_for(token);
+    std::int64_t now = now_ms();
+    std::int64_t ttl_ms = idle_ttl_.count() * 1000;
+    std::int64_t deadline = 0;
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.map.find(token);
+        if (it == shard.map.end()) return; // Đã logout
+        deadline = it->second->last_activity_ms.load(std::memory_order_relaxed) + ttl_ms;
+    }
+    if (deadline > now) {
+        // Session vẫn được dùng từ lúc schedule: re-arm theo last_activity thật.
+        wheel_.schedule(token, tick_for_ms(deadline));
+        return;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.map.find(token);
+    if (it == shard.map.end()) return;
+    deadline = it->second->last_activity_ms.load(std::memory_order_relaxed) + ttl_ms;
+    if (deadline > now) {
+        lock.unlock();
+        wheel_.schedule(token, tick_for_ms(deadline));
+        return;
+    }
+    expired.emplace_back(token, it->second->token_expires_at);
+    shard.map.erase(it);
+    lock.unlock();
+    active_.fetch_sub(1, std::memory_order_relaxed);
+    expired_.fetch_add(1, std::memory_order_relaxed);
+    note_removed(token);
+}
+
+std::size_t SessionStore::sweep() {
+    std::vector<std::pair<std::string, std::int64_t>> expired;
+    {
+        std::lock_guard<std::mutex> lock(wheel_mutex_);
+        wheel_.advance(static_cast<TimingWheel::Tick>(now_ms() / 1000),
+                       [this, &expired](const std::string& token) { on_wheel_expire(token, expired); });
+    }
+    // Gọi listener ngoài mọi khoá để nó có thể thu hồi token / ghi DB tuỳ ý.
+    if (expiry_listener_) {
+        for (const auto& e : expired) expiry_listener_(e.first, e.second);
+    }
+    return expired.size();
+}
+
+SessionStore::Stats SessionStore::stats() const {
+    return Stats{
+        active_.load(std::memory_order_relaxed),
+        created_.load(std::memory_order_relaxed),
+        expired_.load(std::memory_order_relaxed),
+        removed_.load(std::memory_order_relaxed)
+    };
+}
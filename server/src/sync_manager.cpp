@@ -1,4 +1,5 @@
 // #include "sync_manager.hpp"
+#include "async_logger.hpp"
 // #include "config.hpp" // If needed for paths, but server_sync_root_path should be absolute
 // #include <sqlite3.h>
 // #include <iostream>     // For debugging
@@ -220,156 +221,196 @@
 #include "sync_manager.hpp"
 #include "config.hpp"
 #include <sqlite3.h>
-#include <iostream>
+#include <algorithm>
+#include <unordered_set>
 #include <Poco/File.h>
 #include <Poco/DateTimeFormat.h>
 
 SyncManager::SyncManager(Database& db, FileManager& file_manager)
     : db_(db), file_manager_(file_manager) {}
 
-// CHỈ GIỮ LẠI PHIÊN BẢN HÀM NÀY
 // Nó nhận AccessControlManager để thực hiện lọc quyền bên trong.
-std::map<std::string, ServerSyncFileInfo> SyncManager::get_server_file_states(
+SyncPlanManifest SyncManager::get_server_file_states(
     int user_id,
     const Poco::Path& server_sync_root_path,
     AccessControlManager& acm)
 {
-    std::map<std::string, ServerSyncFileInfo> server_states;
+    SyncPlanManifest server_states;
     std::string root_path_str = server_sync_root_path.toString();
     if (root_path_str.empty() || root_path_str.back() != Poco::Path::separator()) {
         root_path_str += Poco::Path::separator();
     }
+    // Mọi path dưới root nằm trong [root, root_end): root kết thúc bằng '/', root_end thay nó bằng '0'
+    // (ký tự kế tiếp). Khác LIKE, so sánh khoảng dùng được index trên file_path và trả về đúng
+    // thứ tự ORDER BY mà merge-join cần, nên không phải sort lại phía server.
+    std::string root_end_str = root_path_str;
+    root_end_str.back() = static_cast<char>(root_end_str.back() + 1);
 
     // Truy vấn tất cả các mục chưa bị xóa trong đường dẫn gốc
     char* sql_query = sqlite3_mprintf(
-        "SELECT file_path, checksum, last_modified, version, owner_user_id, is_directory FROM file_metadata "
-        "WHERE file_path LIKE %Q || '%%' AND is_deleted = 0;",
-        root_path_str.c_str()
+        "SELECT file_path, checksum, last_modified, is_directory FROM file_metadata "
+        "WHERE file_path >= %Q AND file_path < %Q AND is_deleted = 0 ORDER BY file_path;",
+        root_path_str.c_str(), root_end_str.c_str()
     );
 
     if (!sql_query) {
-        std::cerr << "Failed to allocate memory for SQL query in get_server_file_states." << std::endl;
+        LOG_ERROR("Failed to allocate memory for SQL query in get_server_file_states.");
         return server_states;
     }
 
     db_.execute_query(sql_query, [&](sqlite3_stmt* stmt) {
-        std::string full_path_str(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+        const char* full_path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        const std::string_view full_path_view(full_path, static_cast<std::size_t>(sqlite3_column_bytes(stmt, 0)));
 
         // LỌC QUYỀN NGAY TẠI ĐÂY
-        if (acm.get_permission(user_id, fs::path(full_path_str)) < PermissionLevel::READ) {
+        if (acm.get_permission(user_id, fs::path(full_path_view)) < PermissionLevel::READ) {
             return; // Bỏ qua file này nếu không có quyền đọc
         }
 
-        Poco::Path full_server_path(full_path_str);
-        std::string relative_path_str;
-        if (full_server_path.toString().rfind(server_sync_root_path.toString(), 0) == 0) {
-            relative_path_str = full_server_path.toString().substr(server_sync_root_path.toString().length());
-        } else {
-            std::cerr << "Warning: Mismatch between LIKE query and path prefix for " << full_path_str
-                      << " and root " << server_sync_root_path.toString() << std::endl;
-            return;
-        }
-        
-        Poco::Path temp_relative_path(relative_path_str);
-        relative_path_str = temp_relative_path.toString(Poco::Path::PATH_UNIX);
-
-        ServerSyncFileInfo sfi;
-        sfi.full_path_on_server = full_path_str;
-        sfi.relative_path = relative_path_str;
-        sfi.checksum = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        sfi.last_modified = Poco::Timestamp::fromEpochTime(static_cast<std::time_t>(sqlite3_column_int64(stmt, 2)));
-        sfi.version = sqlite3_column_int(stmt, 3);
-        sfi.owner_user_id = sqlite3_column_int(stmt, 4);
-        sfi.is_directory = (sqlite3_column_int(stmt, 5) == 1); // Lấy thông tin thư mục
-
-        server_states[sfi.relative_path] = sfi;
+        const char* checksum = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        server_states.add(full_path_view.substr(root_path_str.size()),
+                          sqlite3_column_int64(stmt, 2),
+                          checksum ? std::string_view(checksum, static_cast<std::size_t>(sqlite3_column_bytes(stmt, 1)))
+                                   : std::string_view(),
+                          sqlite3_column_int(stmt, 3) == 1,
+                          false);
     });
 
     sqlite3_free(sql_query);
+    // Thường là no-op; chỉ sắp lại khi chuẩn hoá path làm đổi thứ tự (VD "a//b")
+    server_states.sort_by_path();
     return server_states;
 }
 
-
-// VIẾT LẠI HOÀN TOÀN HÀM NÀY
-std::vector<SyncOperation> SyncManager::determine_sync_actions(
+SyncPlanManifest SyncManager::get_scoped_server_file_states(
     int user_id,
     const Poco::Path& server_sync_root_path,
-    const std::vector<ClientSyncFileInfo>& client_files,
+    const std::vector<std::string>& scope,
     AccessControlManager& acm)
 {
-    std::vector<SyncOperation> operations;
-    
-    // Bước 1: Lấy danh sách các file/thư mục trên server mà user có quyền truy cập
-    std::map<std::string, ServerSyncFileInfo> server_file_states = get_server_file_states(user_id, server_sync_root_path, acm);
-    
-    std::map<std::string, bool> client_files_processed;
-
-    // Bước 2: Duyệt qua manifest của client để so sánh
-    for (const auto& client_file : client_files) {
-        std::string client_relative_path = Poco::Path(client_file.relative_path).toString(Poco::Path::PATH_UNIX);
-        client_files_processed[client_relative_path] = true;
-        auto it = server_file_states.find(client_relative_path);
-
-        // Ưu tiên 1: Xử lý các mục đã bị xóa ở client (Tombstone)
-        if (client_file.is_deleted) {
-            if (it != server_file_states.end()) {
-                // Client đã xóa, server vẫn còn -> Yêu cầu server xóa
-                operations.emplace_back(SyncActionType::DELETE_ON_SERVER, client_relative_path);
-            } else {
-                // Cả hai đều đã xóa (hoặc server chưa từng có) -> Không làm gì
-                operations.emplace_back(SyncActionType::NO_ACTION, client_relative_path);
-            }
-            continue; // Đã xử lý xong, chuyển sang mục tiếp theo
+    SyncPlanManifest server_states;
+    std::string root_path_str = server_sync_root_path.toString();
+    while (root_path_str.size() > 1 && root_path_str.back() == Poco::Path::separator()) {
+        root_path_str.pop_back();
+    }
+
+    for (const std::string& dir : scope) {
+        // parent_path lưu path tuyệt đối của thư mục cha, không có '/' ở cuối
+        const std::string parent = dir.empty() ? root_path_str : root_path_str + "/" + dir;
+        char* sql_query = sqlite3_mprintf(
+            "SELECT file_path, checksum, last_modified, is_directory FROM file_metadata "
+            "WHERE parent_path = %Q AND is_deleted = 0;",
+            parent.c_str()
+        );
+        if (!sql_query) {
+            LOG_ERROR("Failed to allocate memory for SQL query in get_scoped_server_file_states.");
+            continue;
         }
 
-        // Ưu tiên 2: Xử lý các thư mục (chưa bị xóa)
-        if (client_file.is_directory) {
-            if (it == server_file_states.end()) {
-                // Thư mục chỉ có ở client -> Yêu cầu server tạo
-                operations.emplace_back(SyncActionType::UPLOAD_TO_SERVER, client_relative_path);
-            } else {
-                // Cả hai đều có thư mục -> Không làm gì
-                operations.emplace_back(SyncActionType::NO_ACTION, client_relative_path);
+        db_.execute_query(sql_query, [&](sqlite3_stmt* stmt) {
+            const char* full_path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            const std::string_view full_path_view(full_path, static_cast<std::size_t>(sqlite3_column_bytes(stmt, 0)));
+            if (full_path_view.size() <= root_path_str.size() + 1) return;
+            if (acm.get_permission(user_id, fs::path(full_path_view)) < PermissionLevel::READ) {
+                return;
             }
-            continue; // Đã xử lý xong, chuyển sang mục tiếp theo
-        }
 
-        // Ưu tiên 3: Xử lý các file (chưa bị xóa)
-        if (it != server_file_states.end()) {
-            // File tồn tại ở cả hai nơi
-            const ServerSyncFileInfo& server_file = it->second;
+            const char* checksum = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            server_states.add(full_path_view.substr(root_path_str.size() + 1),
+                              sqlite3_column_int64(stmt, 2),
+                              checksum ? std::string_view(checksum, static_cast<std::size_t>(sqlite3_column_bytes(stmt, 1)))
+                                       : std::string_view(),
+                              sqlite3_column_int(stmt, 3) == 1,
+                              false);
+        });
+        sqlite3_free(sql_query);
+    }
 
-            Poco::Timestamp client_ts_sec(Poco::Timestamp::fromEpochTime(client_file.last_modified.epochTime()));
-            Poco::Timestamp server_ts_sec(Poco::Timestamp::fromEpochTime(server_file.last_modified.epochTime()));
+    // Mỗi thư mục trả về theo thứ tự riêng nên phải sắp lại
+    server_states.sort_by_path();
+    return server_states;
+}
 
-            bool checksums_match = (client_file.checksum == server_file.checksum);
-            
-            if (checksums_match) {
-                operations.emplace_back(SyncActionType::NO_ACTION, client_relative_path);
-            } else {
-                if (client_ts_sec == server_ts_sec) {
-                    operations.emplace_back(SyncActionType::CONFLICT_SERVER_WINS, client_relative_path);
-                } else if (client_ts_sec > server_ts_sec) {
-                    operations.emplace_back(SyncActionType::UPLOAD_TO_SERVER, client_relative_path);
-                } else {
-                    operations.emplace_back(SyncActionType::DOWNLOAD_TO_CLIENT, client_relative_path);
-                }
-            }
-        } else {
-            // File chỉ có ở client (và chưa bị xóa) -> UPLOAD
-            operations.emplace_back(SyncActionType::UPLOAD_TO_SERVER, client_relative_path);
-        }
-    }
 
-    // Bước 3: Duyệt qua các file trên server để tìm những file client không có
-    for (const auto& pair : server_file_states) {
-        const std::string& server_relative_path = pair.first;
-        if (client_files_processed.find(server_relative_path) == client_files_processed.end()) {
-            // File/thư mục chỉ có trên server -> Yêu cầu client tải về/tạo
-            operations.emplace_back(SyncActionType::DOWNLOAD_TO_CLIENT, server_relative_path);
+SyncPlanOptions SyncManager::prepare_plan(
+    int user_id,
+    const Poco::Path& server_sync_root_path,
+    SyncPlanManifest& client_files,
+    AccessControlManager& acm,
+    const std::vector<std::string>* scope,
+    SyncPlanManifest& server_file_states)
+{
+    // Bước 1: Lấy danh sách các file/thư mục trên server mà user có quyền truy cập (đã sắp theo path)
+    server_file_states = scope
+        ? get_scoped_server_file_states(user_id, server_sync_root_path, *scope, acm)
+        : get_server_file_states(user_id, server_sync_root_path, acm);
+
+    // Bước 2: Sắp manifest của client rồi merge-join hai phía theo path
+    client_files.sort_by_path();
+    if (scope) {
+        // Entry của client nằm ngoài scope (thư mục cha có hash khớp) không được so với server
+        const std::unordered_set<std::string> scope_dirs(scope->begin(), scope->end());
+        SyncPlanManifest in_scope;
+        in_scope.reserve(client_files.size());
+        for (std::size_t i = 0; i < client_files.size(); ++i) {
+            const std::string_view path = client_files.path(i);
+            const std::size_t slash = path.find_last_of('/');
+            const std::string parent(slash == std::string_view::npos ? std::string_view() : path.substr(0, slash));
+            if (scope_dirs.count(parent) == 0) continue;
+            in_scope.add(path, client_files.last_modified(i), client_files.checksum(i),
+                         client_files.is_directory(i), client_files.is_deleted(i), client_files.file_size(i));
         }
+        client_files = std::move(in_scope);
+    }
+    SyncPlanOptions options;
+    options.threads = static_cast<unsigned>(std::max(1, Config::SYNC_PLANNER_THREADS));
+    options.min_partition_entries = static_cast<std::size_t>(std::max(1, Config::SYNC_PLANNER_MIN_PARTITION));
+    options.detect_moves = Config::SYNC_DETECT_MOVES;
+    options.stream_slice_entries = static_cast<std::size_t>(std::max(1, Config::SYNC_STREAM_SLICE_ENTRIES));
+    options.large_file_bytes = static_cast<std::uint64_t>(std::max(0, Config::SYNC_STREAM_LARGE_FILE_BYTES));
+    std::string root_path_str = server_sync_root_path.toString();
+    while (root_path_str.size() > 1 && root_path_str.back() == Poco::Path::separator()) root_path_str.pop_back();
+    // Placeholder của file chunked có cùng kích thước (sparse) nên stat vẫn đúng
+    options.server_file_size = [root_path_str](std::string_view relative_path) -> std::uint64_t {
+        std::error_code ec;
+        const std::uintmax_t size = fs::file_size(fs::path(root_path_str) / std::string(relative_path), ec);
+        return ec ? 0 : static_cast<std::uint64_t>(size);
+    };
+    if (options.detect_moves) {
+        // file_metadata giữ dòng is_deleted = 1 của path đã xoá / đổi tên trên server
+        options.deleted_on_server = [this, root_path_str](std::string_view relative_path) {
+            const std::string full_path = root_path_str + "/" + std::string(relative_path);
+            char* sql = sqlite3_mprintf("SELECT 1 FROM file_metadata WHERE file_path = %Q AND is_deleted = 1;", full_path.c_str());
+            if (!sql) return false;
+            const bool deleted = db_.execute_scalar(sql).has_value();
+            sqlite3_free(sql);
+            return deleted;
+        };
     }
+    return options;
+}
 
-    return operations;
+std::vector<SyncOperation> SyncManager::determine_sync_actions(
+    int user_id,
+    const Poco::Path& server_sync_root_path,
+    SyncPlanManifest& client_files,
+    AccessControlManager& acm,
+    const std::vector<std::string>* scope)
+{
+    SyncPlanManifest server_file_states;
+    const SyncPlanOptions options = prepare_plan(user_id, server_sync_root_path, client_files, acm, scope, server_file_states);
+    return plan_sync_operations(client_files, server_file_states, options);
 }
 
+void SyncManager::stream_sync_actions(
+    int user_id,
+    const Poco::Path& server_sync_root_path,
+    SyncPlanManifest& client_files,
+    AccessControlManager& acm,
+    const std::vector<std::string>* scope,
+    const std::function<void(SyncOperation&&)>& emit)
+{
+    SyncPlanManifest server_file_states;
+    const SyncPlanOptions options = prepare_plan(user_id, server_sync_root_path, client_files, acm, scope, server_file_states);
+    stream_sync_operations(client_files, server_file_states, options, emit);
+}
@@ -0,0 +1,403 @@
+#include "sync_planner.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+    // Chép từng segment vào out, bỏ segment rỗng ("a//b", "/a", "a/") và "."
+    void append_normalized(std::string& out, std::string_view relative_path) {
+        const std::size_t start = out.size();
+        std::size_t pos = 0;
+        while (pos < relative_path.size()) {
+            std::size_t end = relative_path.find('/', pos);
+            if (end == std::string_view::npos) end = relative_path.size();
+            const std::string_view segment = relative_path.substr(pos, end - pos);
+            if (!segment.empty() && segment != ".") {
+                if (out.size() != start) out += '/';
+                out.append(segment.data(), segment.size());
+            }
+            pos = end + 1;
+        }
+    }
+}
+
+std::string normalize_sync_path(std::string_view relative_path) {
+    std::string out;
+    out.reserve(relative_path.size());
+    append_normalized(out, relative_path);
+    return out;
+}
+
+void SyncPlanManifest::reserve(std::size_t entries, std::size_t text_bytes) {
+    entries_.reserve(entries);
+    if (text_bytes > 0) text_.reserve(text_bytes);
+}
+
+void SyncPlanManifest::add(std::string_view relative_path, std::int64_t last_modified, std::string_view checksum,
+                           bool is_directory, bool is_deleted, std::uint64_t file_size) {
+    Entry entry;
+    entry.path_offset = text_.size();
+    append_normalized(text_, relative_path);
+    entry.path_size = static_cast<std::uint32_t>(text_.size() - entry.path_offset);
+    text_.append(checksum.data(), checksum.size());
+    entry.checksum_size = static_cast<std::uint32_t>(checksum.size());
+    entry.last_modified = last_modified;
+    entry.file_size = file_size;
+    entry.flags = (is_directory ? FLAG_DIRECTORY : 0) | (is_deleted ? FLAG_DELETED : 0);
+    entries_.push_back(entry);
+
+    const std::size_t n = entries_.size();
+    if (sorted_ && n > 1 && !(path(n - 2) < path(n - 1))) sorted_ = false;
+}
+
+void SyncPlanManifest::sort_by_path() {
+    if (sorted_) return;
+    auto path_of = [this](const Entry& e) { return std::string_view(text_.data() + e.path_offset, e.path_size); };
+    std::stable_sort(entries_.begin(), entries_.end(),
+                     [&path_of](const Entry& a, const Entry& b) { return path_of(a) < path_of(b); });
+
+    // Path trùng nằm liền nhau theo thứ tự add: giữ cái cuối. Text của entry bị bỏ vẫn nằm lại trong text_.
+    auto out = entries_.begin();
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        auto next = std::next(it);
+        if (next != entries_.end() && path_of(*next) == path_of(*it)) continue;
+        *out++ = *it;
+    }
+    entries_.erase(out, entries_.end());
+    sorted_ = true;
+}
+
+namespace {
+    // Cả hai phía cùng có path này.
+    SyncActionType decide_both(const SyncPlanManifest& client, std::size_t ci,
+                               const SyncPlanManifest& server, std::size_t si) {
+        if (client.is_deleted(ci)) return SyncActionType::DELETE_ON_SERVER;
+        if (client.is_directory(ci)) return SyncActionType::NO_ACTION;
+        if (client.checksum(ci) == server.checksum(si)) return SyncActionType::NO_ACTION;
+        // Checksum khác: timestamp bằng nhau là conflict (server thắng), còn lại bên mới hơn thắng
+        if (client.last_modified(ci) == server.last_modified(si)) return SyncActionType::CONFLICT_SERVER_WINS;
+        return client.last_modified(ci) > server.last_modified(si) ? SyncActionType::UPLOAD_TO_SERVER
+                                                                   : SyncActionType::DOWNLOAD_TO_CLIENT;
+    }
+
+    void plan_range(const SyncPlanManifest& client, std::size_t ci, std::size_t client_end,
+                    const SyncPlanManifest& server, std::size_t si, std::size_t server_end,
+                    std::vector<SyncOperation>& out, const SyncPlanOptions& options) {
+        auto server_size = [&](std::size_t i) -> std::uint64_t {
+            return options.server_file_size && !server.is_directory(i) ? options.server_file_size(server.path(i)) : 0;
+        };
+        out.reserve(out.size() + std::max(client_end - ci, server_end - si));
+        while (ci < client_end || si < server_end) {
+            const int cmp = ci == client_end ? 1 : si == server_end ? -1 : client.path(ci).compare(server.path(si));
+            if (cmp < 0) {
+                // Chỉ có ở client: tombstone thì bỏ qua, còn lại (file hoặc thư mục) upload
+                SyncOperation& op = out.emplace_back(client.is_deleted(ci) ? SyncActionType::NO_ACTION : SyncActionType::UPLOAD_TO_SERVER,
+                                                     std::string(client.path(ci)));
+                op.is_directory = client.is_directory(ci);
+                if (op.action == SyncActionType::UPLOAD_TO_SERVER) op.size = client.file_size(ci);
+                ++ci;
+            } else if (cmp > 0) {
+                // Chỉ có trên server: client tải về / tạo
+                SyncOperation& op = out.emplace_back(SyncActionType::DOWNLOAD_TO_CLIENT, std::string(server.path(si)));
+                op.is_directory = server.is_directory(si);
+                op.size = server_size(si);
+                ++si;
+            } else {
+                SyncOperation& op = out.emplace_back(decide_both(client, ci, server, si), std::string(client.path(ci)));
+                op.is_directory = client.is_directory(ci) || server.is_directory(si);
+                if (op.action == SyncActionType::UPLOAD_TO_SERVER) op.size = client.file_size(ci);
+                else if (op.action == SyncActionType::DOWNLOAD_TO_CLIENT || op.action == SyncActionType::CONFLICT_SERVER_WINS) op.size = server_size(si);
+                ++ci;
+                ++si;
+            }
+        }
+    }
+
+    std::size_t lower_bound_path(const SyncPlanManifest& side, std::string_view key) {
+        std::size_t lo = 0, hi = side.size();
+        while (lo < hi) {
+            const std::size_t mid = lo + (hi - lo) / 2;
+            if (side.path(mid) < key) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    // Index của path trong side, hoặc side.size() nếu không có
+    std::size_t find_path(const SyncPlanManifest& side, std::string_view path) {
+        const std::size_t i = lower_bound_path(side, path);
+        return i < side.size() && side.path(i) == path ? i : side.size();
+    }
+
+    bool is_plain_file(const SyncPlanManifest& side, std::size_t i) {
+        return i < side.size() && !side.is_directory(i) && !side.is_deleted(i) && !side.checksum(i).empty();
+    }
+
+    // Gộp (nguồn, đích) cùng checksum thành MOVE đặt ở vị trí op đích; op nguồn bị đánh dấu bỏ.
+    // Nguồn được lấy theo thứ tự path nên kết quả không phụ thuộc số partition. confirm chỉ được
+    // gọi cho nguồn đã có đích cùng checksum.
+    template <typename SourceChecksum, typename TargetChecksum, typename Confirm>
+    void pair_by_checksum(std::vector<SyncOperation>& ops, std::vector<bool>& dropped, SyncActionType move,
+                          SourceChecksum source_checksum, TargetChecksum target_checksum, Confirm confirm) {
+        std::unordered_map<std::string_view, std::vector<std::size_t>> targets;
+        for (std::size_t i = 0; i < ops.size(); ++i) {
+            if (dropped[i]) continue;
+            const std::string_view sum = target_checksum(ops[i]);
+            if (!sum.empty()) targets[sum].push_back(i);
+        }
+        if (targets.empty()) return;
+        std::unordered_map<std::string_view, std::size_t> next_target;
+        for (std::size_t i = 0; i < ops.size(); ++i) {
+            if (dropped[i]) continue;
+            const std::string_view sum = source_checksum(ops[i]);
+            if (sum.empty()) continue;
+            auto it = targets.find(sum);
+            if (it == targets.end()) continue;
+            std::size_t& next = next_target[sum];
+            if (next == it->second.size() || !confirm(ops[i])) continue;
+            SyncOperation& target = ops[it->second[next++]];
+            target.action = move;
+            target.source_path = std::move(ops[i].relative_path);
+            target.size = 0; // Đổi tên, không truyền nội dung
+            dropped[i] = true;
+        }
+    }
+
+    void pair_moves(const SyncPlanManifest& client, const SyncPlanManifest& server, const SyncPlanOptions& options,
+                    std::vector<SyncOperation>& ops) {
+        std::vector<bool> dropped(ops.size(), false);
+        // Upload của file chỉ có ở client: đích của MOVE_ON_SERVER, nguồn của MOVE_ON_CLIENT
+        auto client_only_file = [&](const SyncOperation& op) -> std::string_view {
+            if (op.action != SyncActionType::UPLOAD_TO_SERVER) return {};
+            const std::size_t ci = find_path(client, op.relative_path);
+            if (!is_plain_file(client, ci) || find_path(server, op.relative_path) != server.size()) return {};
+            return client.checksum(ci);
+        };
+
+        pair_by_checksum(ops, dropped, SyncActionType::MOVE_ON_SERVER,
+            [&](const SyncOperation& op) -> std::string_view {
+                if (op.action != SyncActionType::DELETE_ON_SERVER) return {};
+                const std::size_t si = find_path(server, op.relative_path);
+                return is_plain_file(server, si) ? server.checksum(si) : std::string_view();
+            },
+            client_only_file,
+            [](const SyncOperation&) { return true; }); // Tombstone của client là đủ bằng chứng
+
+        if (options.deleted_on_server) {
+            pair_by_checksum(ops, dropped, SyncActionType::MOVE_ON_CLIENT,
+                client_only_file,
+                [&](const SyncOperation& op) -> std::string_view {
+                    if (op.action != SyncActionType::DOWNLOAD_TO_CLIENT || op.relative_path.empty()) return {};
+                    const std::size_t si = find_path(server, op.relative_path);
+                    if (!is_plain_file(server, si) || find_path(client, op.relative_path) != client.size()) return {};
+                    return server.checksum(si);
+                },
+                // Không có dấu vết trên server thì A có thể là file mới của client: giữ upload
+                [&](const SyncOperation& op) { return options.deleted_on_server(op.relative_path); });
+        }
+
+        std::size_t out = 0;
+        for (std::size_t i = 0; i < ops.size(); ++i) {
+            if (dropped[i]) continue;
+            if (out != i) ops[out] = std::move(ops[i]);
+            ++out;
+        }
+        ops.erase(ops.begin() + static_cast<std::ptrdiff_t>(out), ops.end());
+    }
+
+    // Checksum của các file có thể thành một đầu của cặp move (xem pair_moves). Operation không dùng
+    // checksum nào trong đây chắc chắn không bị ghép nên được stream ngay, không phải chờ hết manifest.
+    struct MoveCandidates {
+        std::unordered_set<std::string_view> client_only; // File chỉ có ở client
+        std::unordered_set<std::string_view> server_only; // File chỉ có trên server (chỉ khi có deleted_on_server)
+        std::unordered_set<std::string_view> tombstoned;  // Bản trên server của path client đã xoá
+    };
+
+    MoveCandidates find_move_candidates(const SyncPlanManifest& client, const SyncPlanManifest& server,
+                                        const SyncPlanOptions& options) {
+        MoveCandidates candidates;
+        for (std::size_t i = 0; i < client.size(); ++i) {
+            const std::size_t si = find_path(server, client.path(i));
+            if (client.is_deleted(i)) {
+                if (is_plain_file(server, si)) candidates.tombstoned.insert(server.checksum(si));
+            } else if (is_plain_file(client, i) && si == server.size()) {
+                candidates.client_only.insert(client.checksum(i));
+            }
+        }
+        if (options.deleted_on_server) {
+            for (std::size_t i = 0; i < server.size(); ++i) {
+                if (is_plain_file(server, i) && find_path(client, server.path(i)) == client.size()) {
+                    candidates.server_only.insert(server.checksum(i));
+                }
+            }
+        }
+        return candidates;
+    }
+
+    // Cùng điều kiện nguồn / đích như pair_moves, cộng với việc phía bên kia có checksum trùng
+    bool is_move_candidate(const SyncOperation& op, const SyncPlanManifest& client, const SyncPlanManifest& server,
+                           const MoveCandidates& candidates) {
+        switch (op.action) {
+            case SyncActionType::UPLOAD_TO_SERVER: {
+                const std::size_t ci = find_path(client, op.relative_path);
+                if (!is_plain_file(client, ci) || find_path(server, op.relative_path) != server.size()) return false;
+                const std::string_view sum = client.checksum(ci);
+                return candidates.tombstoned.count(sum) > 0 || candidates.server_only.count(sum) > 0;
+            }
+            case SyncActionType::DOWNLOAD_TO_CLIENT: {
+                if (candidates.server_only.empty() || op.relative_path.empty()) return false;
+                const std::size_t si = find_path(server, op.relative_path);
+                if (!is_plain_file(server, si) || find_path(client, op.relative_path) != client.size()) return false;
+                return candidates.client_only.count(server.checksum(si)) > 0;
+            }
+            case SyncActionType::DELETE_ON_SERVER: {
+                const std::size_t si = find_path(server, op.relative_path);
+                return is_plain_file(server, si) && candidates.client_only.count(server.checksum(si)) > 0;
+            }
+            default:
+                return false;
+        }
+    }
+
+    bool creates_directory(const SyncOperation& op) {
+        return op.is_directory && (op.action == SyncActionType::UPLOAD_TO_SERVER || op.action == SyncActionType::DOWNLOAD_TO_CLIENT);
+    }
+
+    bool is_delete(const SyncOperation& op) {
+        return op.action == SyncActionType::DELETE_ON_CLIENT || op.action == SyncActionType::DELETE_ON_SERVER;
+    }
+
+    bool is_large_transfer(const SyncOperation& op, std::uint64_t large_file_bytes) {
+        switch (op.action) {
+            case SyncActionType::UPLOAD_TO_SERVER:
+            case SyncActionType::DOWNLOAD_TO_CLIENT:
+            case SyncActionType::CONFLICT_SERVER_WINS:
+            case SyncActionType::CONFLICT_CLIENT_WINS:
+            case SyncActionType::CREATE_CONFLICT_COPY_ON_SERVER:
+                return large_file_bytes > 0 && !op.is_directory && op.size >= large_file_bytes;
+            default:
+                return false;
+        }
+    }
+}
+
+std::vector<SyncOperation> plan_sync_operations(const SyncPlanManifest& client, const SyncPlanManifest& server,
+                                                const SyncPlanOptions& options) {
+    if (!client.sorted() || !server.sorted()) {
+        throw std::invalid_argument("plan_sync_operations: manifests must be sorted by path");
+    }
+
+    std::size_t parts = 1;
+    if (options.threads > 1 && options.min_partition_entries > 0) {
+        parts = std::min<std::size_t>(options.threads, (client.size() + server.size()) / options.min_partition_entries);
+        parts = std::max<std::size_t>(parts, 1);
+    }
+
+    // Điểm cắt lấy đều trên phía lớn hơn; cùng một path cắt cả hai phía nên path khớp luôn cùng partition.
+    const SyncPlanManifest& larger = client.size() >= server.size() ? client : server;
+    std::vector<std::size_t> client_cut(parts + 1, 0), server_cut(parts + 1, 0);
+    client_cut[parts] = client.size();
+    server_cut[parts] = server.size();
+    for (std::size_t k = 1; k < parts; ++k) {
+        const std::string_view key = larger.path(k * larger.size() / parts);
+        client_cut[k] = lower_bound_path(client, key);
+        server_cut[k] = lower_bound_path(server, key);
+    }
+
+    std::vector<std::vector<SyncOperation>> results(parts);
+    std::vector<std::exception_ptr> errors(parts);
+    auto run = [&](std::size_t k) {
+        try {
+            plan_range(client, client_cut[k], client_cut[k + 1], server, server_cut[k], server_cut[k + 1], results[k], options);
+        } catch (...) {
+            errors[k] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(parts > 0 ? parts - 1 : 0);
+    for (std::size_t k = 1; k < parts; ++k) {
+        try {
+            workers.emplace_back(run, k);
+        } catch (const std::system_error&) {
+            run(k); // Không tạo được thread: chạy luôn trên thread hiện tại
+        }
+    }
+    run(0);
+    for (auto& worker : workers) worker.join();
+    for (const auto& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+
+    std::vector<SyncOperation> operations;
+    if (parts == 1) {
+        operations = std::move(results[0]);
+    } else {
+        std::size_t total = 0;
+        for (const auto& part : results) total += part.size();
+        operations.reserve(total);
+        for (auto& part : results) {
+            operations.insert(operations.end(), std::make_move_iterator(part.begin()), std::make_move_iterator(part.end()));
+        }
+    }
+    // Cặp move có thể nằm ở hai partition khác nhau nên ghép sau khi nối kết quả
+    if (options.detect_moves) pair_moves(client, server, options, operations);
+    return operations;
+}
+
+void stream_sync_operations(const SyncPlanManifest& client, const SyncPlanManifest& server, const SyncPlanOptions& options,
+                            const std::function<void(SyncOperation&&)>& emit) {
+    if (!client.sorted() || !server.sorted()) {
+        throw std::invalid_argument("stream_sync_operations: manifests must be sorted by path");
+    }
+    MoveCandidates candidates;
+    if (options.detect_moves) candidates = find_move_candidates(client, server, options);
+
+    const std::size_t slice = std::max<std::size_t>(1, options.stream_slice_entries);
+    std::vector<SyncOperation> ops, held, large, deletes;
+    std::size_t ci = 0, si = 0;
+    while (ci < client.size() || si < server.size()) {
+        // Đoạn kế tiếp: slice entry của phía còn nhiều hơn, cắt tại cùng một path ở cả hai phía
+        std::size_t client_end = client.size(), server_end = server.size();
+        const bool client_larger = client.size() - ci >= server.size() - si;
+        const SyncPlanManifest& larger = client_larger ? client : server;
+        const std::size_t start = client_larger ? ci : si;
+        if (larger.size() - start > slice) {
+            const std::string_view key = larger.path(start + slice);
+            client_end = lower_bound_path(client, key);
+            server_end = lower_bound_path(server, key);
+        }
+        ops.clear();
+        plan_range(client, ci, client_end, server, si, server_end, ops, options);
+        ci = client_end;
+        si = server_end;
+
+        const auto rest = std::stable_partition(ops.begin(), ops.end(), creates_directory);
+        for (auto it = ops.begin(); it != rest; ++it) emit(std::move(*it));
+        for (auto it = rest; it != ops.end(); ++it) {
+            if (options.detect_moves && is_move_candidate(*it, client, server, candidates)) held.push_back(std::move(*it));
+            else if (options.detect_moves && is_delete(*it)) deletes.push_back(std::move(*it));
+            else if (is_large_transfer(*it, options.large_file_bytes)) large.push_back(std::move(*it));
+            else emit(std::move(*it));
+        }
+    }
+
+    if (options.detect_moves) {
+        // held chứa mọi operation có thể ghép, theo thứ tự path: kết quả như pair_moves trên cả plan
+        pair_moves(client, server, options, held);
+        for (auto& op : held) {
+            if (is_delete(op)) deletes.push_back(std::move(op));
+            else if (is_large_transfer(op, options.large_file_bytes)) large.push_back(std::move(op));
+            else emit(std::move(op));
+        }
+    }
+    std::stable_sort(large.begin(), large.end(), [](const SyncOperation& a, const SyncOperation& b) { return a.size < b.size; });
+    for (auto& op : large) emit(std::move(op));
+    for (auto& op : deletes) emit(std::move(op));
+}
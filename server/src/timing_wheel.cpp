@@ -0,0 +1,65 @@
+#include "timing_wheel.hpp"
+
+#include <utility>
+
+TimingWheel::TimingWheel(Tick start_tick) : current_(start_tick) {}
+
+void TimingWheel::schedule(const std::string& key, Tick deadline) {
+    place(Entry{key, deadline}, current_ + 1); // tick hiện tại đã xử lý xong
+    ++size_;
+}
+
+// Chọn level dựa trên nhóm 6 bit cao nhất khác nhau giữa deadline và tick hiện tại.
+// Nhờ vậy slot được chọn luôn nằm "phía trước" con trỏ của level đó.
+void TimingWheel::place(Entry&& entry, Tick earliest) {
+    Tick effective = entry.deadline > earliest ? entry.deadline : earliest;
+    Tick diff = effective ^ current_;
+
+    int level = 0;
+    while (level < LEVELS && (diff >> (SLOT_BITS * (level + 1))) != 0) {
+        ++level;
+    }
+    if (level >= LEVELS) {
+        overflow_.push_back(std::move(entry));
+        return;
+    }
+    std::size_t slot = static_cast<std::size_t>((effective >> (SLOT_BITS * level)) & (SLOTS - 1));
+    wheels_[level][slot].push_back(std::move(entry));
+}
+
+void TimingWheel::cascade(int level) {
+    std::size_t slot = static_cast<std::size_t>((current_ >> (SLOT_BITS * level)) & (SLOTS - 1));
+    Slot pending;
+    pending.swap(wheels_[level][slot]);
+    for (auto& e : pending) {
+        place(std::move(e), current_); // có thể rơi đúng vào slot level 0 sắp fire
+    }
+}
+
+std::size_t TimingWheel::advance(Tick now, const std::function<void(const std::string&)>& on_expire) {
+    std::size_t fired = 0;
+    while (current_ < now) {
+        ++current_;
+
+        // Khi con trỏ level thấp quay hết một vòng, hạ các entry của level trên xuống.
+        if ((current_ & ((Tick(1) << (SLOT_BITS * LEVELS)) - 1)) == 0 && !overflow_.empty()) {
+            std::vector<Entry> pending;
+            pending.swap(overflow_);
+            for (auto& e : pending) place(std::move(e), current_);
+        }
+        for (int level = LEVELS - 1; level >= 1; --level) {
+            if ((current_ & ((Tick(1) << (SLOT_BITS * level)) - 1)) == 0) {
+                cascade(level);
+            }
+        }
+
+        Slot due;
+        due.swap(wheels_[0][current_ & (SLOTS - 1)]);
+        for (const auto& e : due) {
+            --size_;
+            ++fired;
+            on_expire(e.key); // callback có thể schedule lại (re-arm) mà không ảnh hưởng `due`
+        }
+    }
+    return fired;
+}
@@ -0,0 +1,210 @@
+#include "token_codec.hpp"
+#include "async_logger.hpp"
+
+#include <nlohmann/json.hpp>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+using json = nlohmann::json;
+
+namespace {
+    const char* const TOKEN_VERSION = "v1";
+
+    const char B64URL_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+    int b64url_value(char c) {
+        if (c >= 'A' && c <= 'Z') return c - 'A';
+        if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+        if (c >= '0' && c <= '9') return c - '0' + 52;
+        if (c == '-') return 62;
+        if (c == '_') return 63;
+        return -1;
+    }
+
+    std::string hmac_sha256(const std::string& secret, const std::string& message) {
+        unsigned char mac[EVP_MAX_MD_SIZE];
+        unsigned int mac_len = 0;
+        HMAC(EVP_sha256(), secret.data(), static_cast<int>(secret.size()),
+             reinterpret_cast<const unsigned char*>(message.data()), message.size(), mac, &mac_len);
+        return std::string(reinterpret_cast<const char*>(mac), mac_len);
+    }
+
+    std::string random_hex(std::size_t bytes) {
+        std::string raw(bytes, '\0');
+        if (RAND_bytes(reinterpret_cast<unsigned char*>(&raw[0]), static_cast<int>(bytes)) != 1) {
+            throw std::runtime_error("RAND_bytes failed");
+        }
+        std::ostringstream ss;
+        for (unsigned char c : raw) ss << std::hex << std::setw(2) << std::setfill('0') << (int)c;
+        return ss.str();
+    }
+
+    bool valid_key_id(const std::string& key_id) {
+        if (key_id.empty()) return false;
+        for (char c : key_id) {
+            if (c == '.' || c == ':' || c == ',' || c == ' ') return false;
+        }
+        return true;
+    }
+}
+
+std::string base64url_encode(const std::string& data) {
+    std::string out;
+    out.reserve((data.size() * 4 + 2) / 3);
+    std::size_t i = 0;
+    for (; i + 2 < data.size(); i += 3) {
+        unsigned v = (unsigned char)data[i] << 16 | (unsigned char)data[i + 1] << 8 | (unsigned char)data[i + 2];
+        out += B64URL_ALPHABET[(v >> 18) & 63];
+        out += B64URL_ALPHABET[(v >> 12) & 63];
+        out += B64URL_ALPHABET[(v >> 6) & 63];
+        out += B64URL_ALPHABET[v & 63];
+    }
+    if (i + 1 == data.size()) {
+        unsigned v = (unsigned char)data[i] << 16;
+        out += B64URL_ALPHABET[(v >> 18) & 63];
+        out += B64URL_ALPHABET[(v >> 12) & 63];
+    } else if (i + 2 == data.size()) {
+        unsigned v = (unsigned char)data[i] << 16 | (unsigned char)data[i + 1] << 8;
+        out += B64URL_ALPHABET[(v >> 18) & 63];
+        out += B64URL_ALPHABET[(v >> 12) & 63];
+        out += B64URL_ALPHABET[(v >> 6) & 63];
+    }
+    return out;
+}
+
+std::optional<std::string> base64url_decode(const std::string& text) {
+    if (text.size() % 4 == 1) return std::nullopt;
+    std::string out;
+    out.reserve(text.size() * 3 / 4);
+    unsigned buffer = 0;
+    int bits = 0;
+    for (char c : text) {
+        int v = b64url_value(c);
+        if (v < 0) return std::nullopt;
+        buffer = (buffer << 6) | static_cast<unsigned>(v);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out += static_cast<char>((buffer >> bits) & 0xFF);
+        }
+    }
+    return out;
+}
+
+bool TokenCodec::add_key(const std::string& key_id, const std::string& secret) {
+    if (!valid_key_id(key_id) || secret.size() < 16) {
+        LOG_WARN("[TokenCodec] Rejected signing key '" << key_id << "' (invalid id or secret shorter than 16 bytes).");
+        return false;
+    }
+    keys_[key_id] = secret;
+    return true;
+}
+
+bool TokenCodec::set_active_key(const std::string& key_id) {
+    if (keys_.find(key_id) == keys_.end()) {
+        LOG_ERROR("[TokenCodec] Active key '" << key_id << "' is not in the key ring.");
+        return false;
+    }
+    active_key_id_ = key_id;
+    return true;
+}
+
+bool TokenCodec::load_key_list(const std::string& key_list) {
+    bool all_ok = true;
+    std::stringstream ss(key_list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        // trim
+        item.erase(0, item.find_first_not_of(" \t"));
+        item.erase(item.find_last_not_of(" \t") + 1);
+        if (item.empty()) continue;
+        std::size_t colon = item.find(':');
+        if (colon == std::string::npos) {
+            LOG_WARN("[TokenCodec] Ignoring malformed key entry (expected kid:secret).");
+            all_ok = false;
+            continue;
+        }
+        all_ok = add_key(item.substr(0, colon), item.substr(colon + 1)) && all_ok;
+    }
+    return all_ok;
+}
+
+std::string TokenCodec::generate_secret(std::size_t bytes) {
+    return random_hex(bytes);
+}
+
+std::string TokenCodec::issue(int user_id, const std::string& username, const std::string& home_root, std::chrono::seconds ttl,
+                              TokenClaims* out_claims) const {
+    auto it = keys_.find(active_key_id_);
+    if (it == keys_.end()) {
+        throw std::logic_error("TokenCodec has no active signing key");
+    }
+    std::int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    json claims;
+    claims["uid"] = user_id;
+    claims["usr"] = username;
+    claims["home"] = home_root;
+    claims["iat"] = now;
+    claims["exp"] = now + ttl.count();
+    claims["jti"] = random_hex(16);
+
+    if (out_claims) {
+        *out_claims = TokenClaims{user_id, username, home_root, now, now + ttl.count(), active_key_id_, claims["jti"].get<std::string>()};
+    }
+
+    std::string signing_input = std::string(TOKEN_VERSION) + "." + active_key_id_ + "." + base64url_encode(claims.dump());
+    return signing_input + "." + base64url_encode(hmac_sha256(it->second, signing_input));
+}
+
+std::optional<TokenClaims> TokenCodec::verify(const std::string& token) const {
+    // v1.<kid>.<payload>.<sig>
+    std::size_t p1 = token.find('.');
+    if (p1 == std::string::npos || token.compare(0, p1, TOKEN_VERSION) != 0) return std::nullopt;
+    std::size_t p2 = token.find('.', p1 + 1);
+    if (p2 == std::string::npos) return std::nullopt;
+    std::size_t p3 = token.find('.', p2 + 1);
+    if (p3 == std::string::npos || token.find('.', p3 + 1) != std::string::npos) return std::nullopt;
+
+    std::string key_id = token.substr(p1 + 1, p2 - p1 - 1);
+    auto key_it = keys_.find(key_id);
+    if (key_it == keys_.end()) return std::nullopt; // Unknown or retired key
+
+    std::string expected = hmac_sha256(key_it->second, token.substr(0, p3));
+    auto given = base64url_decode(token.substr(p3 + 1));
+    if (!given || given->size() != expected.size() ||
+        CRYPTO_memcmp(given->data(), expected.data(), expected.size()) != 0) {
+        return std::nullopt;
+    }
+
+    auto payload = base64url_decode(token.substr(p2 + 1, p3 - p2 - 1));
+    if (!payload) return std::nullopt;
+    json claims = json::parse(*payload, nullptr, false);
+    if (claims.is_discarded() || !claims.is_object()) return std::nullopt;
+
+    TokenClaims out;
+    try {
+        out.user_id = claims.at("uid").get<int>();
+        out.username = claims.at("usr").get<std::string>();
+        out.home_root = claims.at("home").get<std::string>();
+        out.issued_at = claims.at("iat").get<std::int64_t>();
+        out.expires_at = claims.at("exp").get<std::int64_t>();
+        out.token_id = claims.at("jti").get<std::string>();
+    } catch (const json::exception&) {
+        return std::nullopt;
+    }
+    out.key_id = key_id;
+
+    std::int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    if (out.expires_at <= now) return std::nullopt;
+    return out;
+}
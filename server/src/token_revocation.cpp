@@ -0,0 +1,46 @@
+#include "token_revocation.hpp"
+
+#include <chrono>
+#include <iterator>
+#include <mutex>
+
+void TokenRevocationList::revoke(const std::string& token_id, std::int64_t expires_at) {
+    std::int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    // Revoke hiếm khi xảy ra (logout / idle), tiện dọn luôn các token đã tự hết hạn.
+    for (auto it = revoked_.begin(); it != revoked_.end();) {
+        it = (it->second <= now) ? revoked_.erase(it) : std::next(it);
+    }
+    revoked_[token_id] = expires_at;
+    count_.store(revoked_.size(), std::memory_order_release);
+}
+
+bool TokenRevocationList::is_revoked(const std::string& token_id) const {
+    if (count_.load(std::memory_order_acquire) == 0) {
+        return false; // Fast path: không có token nào bị thu hồi
+    }
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return revoked_.find(token_id) != revoked_.end();
+}
+
+std::size_t TokenRevocationList::purge_expired(std::int64_t now) {
+    if (count_.load(std::memory_order_acquire) == 0) return 0;
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    std::size_t removed = 0;
+    for (auto it = revoked_.begin(); it != revoked_.end();) {
+        if (it->second <= now) {
+            it = revoked_.erase(it);
+            ++removed;
+        } else {
+            ++it;
+        }
+    }
+    count_.store(revoked_.size(), std::memory_order_release);
+    return removed;
+}
+
+std::vector<std::pair<std::string, std::int64_t>> TokenRevocationList::snapshot() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return std::vector<std::pair<std::string, std::int64_t>>(revoked_.begin(), revoked_.end());
+}
@@ -0,0 +1,170 @@
+#include "tree_hash.hpp"
+#include "async_logger.hpp"
+#include "config.hpp"
+#include "protocol.hpp"
+
+#include <openssl/evp.h>
+#include <sqlite3.h>
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace {
+    std::string parent_of(const std::string& path) {
+        std::size_t slash = path.find_last_of('/');
+        if (slash == std::string::npos) return std::string();
+        return slash == 0 ? std::string("/") : path.substr(0, slash);
+    }
+
+    // [prefix/, prefix0): mọi path nằm dưới prefix ('0' là ký tự ngay sau '/')
+    std::string subtree_condition(const char* column, const std::string& dir_path) {
+        std::string lower = dir_path + "/";
+        std::string upper = dir_path + "0";
+        char* sql = sqlite3_mprintf("(%s = %Q OR (%s >= %Q AND %s < %Q))", column, dir_path.c_str(),
+                                    column, lower.c_str(), column, upper.c_str());
+        std::string condition = sql ? sql : "0";
+        sqlite3_free(sql);
+        return condition;
+    }
+}
+
+std::string compute_tree_hash(std::vector<TreeHashChild>& children) {
+    std::sort(children.begin(), children.end(),
+              [](const TreeHashChild& a, const TreeHashChild& b) { return a.name < b.name; });
+
+    std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx(EVP_MD_CTX_new(), EVP_MD_CTX_free);
+    EVP_DigestInit_ex(ctx.get(), EVP_sha256(), nullptr);
+    static const char zero = '\0';
+    for (const auto& child : children) {
+        const char kind = child.is_directory ? MerkleTree::KIND_DIRECTORY : MerkleTree::KIND_FILE;
+        EVP_DigestUpdate(ctx.get(), &kind, 1);
+        EVP_DigestUpdate(ctx.get(), child.name.data(), child.name.size());
+        EVP_DigestUpdate(ctx.get(), &zero, 1);
+        EVP_DigestUpdate(ctx.get(), child.value.data(), child.value.size());
+        EVP_DigestUpdate(ctx.get(), &zero, 1);
+    }
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    EVP_DigestFinal_ex(ctx.get(), digest, &length);
+
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(2 * length, '0');
+    for (unsigned int i = 0; i < length; ++i) {
+        hex[2 * i] = digits[digest[i] >> 4];
+        hex[2 * i + 1] = digits[digest[i] & 0x0f];
+    }
+    return hex;
+}
+
+TreeHashIndex::TreeHashIndex(Database& db) : db_(db) {
+    for (const std::string& root : {Config::USER_DATA_ROOT, Config::SHARED_DATA_ROOT}) {
+        if (root.empty()) continue;
+        std::error_code ec;
+        fs::path canonical = fs::weakly_canonical(root, ec);
+        if (ec) continue;
+        std::string root_str = canonical.string();
+        while (root_str.size() > 1 && root_str.back() == '/') root_str.pop_back();
+        storage_roots_.push_back(root_str);
+    }
+}
+
+std::string TreeHashIndex::directory_hash(const std::string& dir_path) {
+    std::scoped_lock lock(db_.write_mutex(), mutex_);
+    return hash_locked(dir_path);
+}
+
+std::vector<TreeHashChild> TreeHashIndex::children(const std::string& dir_path) {
+    std::scoped_lock lock(db_.write_mutex(), mutex_);
+    return children_locked(dir_path);
+}
+
+void TreeHashIndex::refresh(const std::string& dir_path) {
+    std::scoped_lock lock(db_.write_mutex(), mutex_);
+    std::string dir = dir_path;
+    while (!dir.empty()) {
+        recompute_locked(dir);
+        if (is_storage_top(dir)) break;
+        dir = parent_of(dir);
+    }
+}
+
+void TreeHashIndex::drop_subtree(const std::string& dir_path) {
+    std::scoped_lock lock(db_.write_mutex(), mutex_);
+    db_.execute("DELETE FROM directory_hashes WHERE " + subtree_condition("dir_path", dir_path) + ";");
+}
+
+void TreeHashIndex::move_subtree(const std::string& old_dir_path, const std::string& new_dir_path) {
+    std::scoped_lock lock(db_.write_mutex(), mutex_);
+    // Hash của một cây con chỉ phụ thuộc tên bên trong nó nên chuyển nguyên được
+    char* sql = sqlite3_mprintf("UPDATE OR REPLACE directory_hashes SET dir_path = %Q || substr(dir_path, %d) WHERE ",
+                                new_dir_path.c_str(), static_cast<int>(old_dir_path.size()) + 1);
+    if (!sql) return;
+    db_.execute(std::string(sql) + subtree_condition("dir_path", old_dir_path) + ";");
+    sqlite3_free(sql);
+}
+
+std::string TreeHashIndex::hash_locked(const std::string& dir_path) {
+    char* sql = sqlite3_mprintf("SELECT tree_hash FROM directory_hashes WHERE dir_path = %Q;", dir_path.c_str());
+    if (!sql) return recompute_locked(dir_path);
+    std::optional<std::string> stored = db_.execute_scalar(sql);
+    sqlite3_free(sql);
+    return stored ? *stored : recompute_locked(dir_path);
+}
+
+std::string TreeHashIndex::recompute_locked(const std::string& dir_path) {
+    std::vector<TreeHashChild> kids = children_locked(dir_path);
+    const std::string hash = compute_tree_hash(kids);
+    char* sql = sqlite3_mprintf(
+        "INSERT INTO directory_hashes (dir_path, tree_hash) VALUES (%Q, %Q) "
+        "ON CONFLICT(dir_path) DO UPDATE SET tree_hash = excluded.tree_hash;",
+        dir_path.c_str(), hash.c_str());
+    if (sql) {
+        db_.execute(sql);
+        sqlite3_free(sql);
+    }
+    return hash;
+}
+
+std::vector<TreeHashChild> TreeHashIndex::children_locked(const std::string& dir_path) {
+    std::vector<TreeHashChild> kids;
+    char* sql = sqlite3_mprintf(
+        "SELECT file_path, is_directory, checksum FROM file_metadata WHERE parent_path = %Q AND is_deleted = 0;",
+        dir_path.c_str());
+    if (!sql) {
+        LOG_ERROR("Failed to allocate memory for SQL query in TreeHashIndex::children.");
+        return kids;
+    }
+    const std::size_t prefix = dir_path == "/" ? 1 : dir_path.size() + 1;
+    db_.execute_query(sql, [&](sqlite3_stmt* stmt) {
+        std::string file_path(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+        if (file_path.size() <= prefix) return;
+        TreeHashChild child;
+        child.name = file_path.substr(prefix);
+        child.is_directory = sqlite3_column_int(stmt, 1) == 1;
+        const unsigned char* checksum = sqlite3_column_text(stmt, 2);
+        if (!child.is_directory && checksum) child.value = reinterpret_cast<const char*>(checksum);
+        else if (child.is_directory) child.value = std::move(file_path); // Thay bằng hash sau khi query xong
+        kids.push_back(std::move(child));
+    });
+    sqlite3_free(sql);
+
+    for (auto& child : kids) {
+        if (child.is_directory) child.value = hash_locked(child.value);
+    }
+    return kids;
+}
+
+bool TreeHashIndex::is_storage_top(const std::string& dir_path) const {
+    const std::string parent = parent_of(dir_path);
+    for (const auto& root : storage_roots_) {
+        if (parent == root || dir_path == root) return true;
+        if (dir_path.size() > root.size() && dir_path.compare(0, root.size(), root) == 0 && dir_path[root.size()] == '/') {
+            return false; // Nằm sâu hơn trong storage: tiếp tục đi lên
+        }
+    }
+    return true; // Ngoài các data root: chỉ tính chính thư mục này
+}
@@ -1,34 +1,135 @@
 #include "user_manager.hpp"
+#include "async_logger.hpp"
 #include "config.hpp"
+#include "bounded_executor.hpp"
 #include <openssl/sha.h> // For SHA256
-#include <openssl/rand.h> // For salt (if using salt with simple SHA256, bcrypt is better)
+#include <openssl/rand.h> // For salt
+#include <openssl/evp.h>  // For PKCS5_PBKDF2_HMAC
+#include <openssl/crypto.h> // For CRYPTO_memcmp
 #include <iomanip>      // For std::hex, std::setw, std::setfill
 #include <sstream>      // For std::ostringstream
 #include <iostream>     // For std::cerr
 #include <filesystem>   // For std::filesystem
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
 namespace fs = std::filesystem;
 
-UserManager::UserManager(Database& db) : db_(db) {}
+namespace {
+    const std::string PBKDF2_PREFIX = "pbkdf2_sha256";
 
-// Basic SHA256 hashing (without salt, for simplicity here. Production should use bcrypt/scrypt/Argon2)
-// Or at least SHA256 with a unique salt per user stored alongside the hash.
-std::string UserManager::hash_password(const std::string& password) {
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-    SHA256_Update(&sha256, password.c_str(), password.length());
-    SHA256_Final(hash, &sha256);
+    std::string to_hex(const unsigned char* data, std::size_t len) {
+        std::ostringstream ss;
+        for (std::size_t i = 0; i < len; i++) {
+            ss << std::hex << std::setw(2) << std::setfill('0') << (int)data[i];
+        }
+        return ss.str();
+    }
+
+    std::optional<std::vector<unsigned char>> from_hex(const std::string& hex) {
+        if (hex.size() % 2 != 0) return std::nullopt;
+        std::vector<unsigned char> out(hex.size() / 2);
+        for (std::size_t i = 0; i < out.size(); ++i) {
+            unsigned int byte;
+            std::istringstream iss(hex.substr(i * 2, 2));
+            if (!(iss >> std::hex >> byte)) return std::nullopt;
+            out[i] = static_cast<unsigned char>(byte);
+        }
+        return out;
+    }
+
+    std::vector<unsigned char> pbkdf2(const std::string& password, const std::vector<unsigned char>& salt, int iterations) {
+        std::vector<unsigned char> out(SHA256_DIGEST_LENGTH);
+        PKCS5_PBKDF2_HMAC(password.data(), static_cast<int>(password.size()), salt.data(), static_cast<int>(salt.size()),
+                          iterations, EVP_sha256(), static_cast<int>(out.size()), out.data());
+        return out;
+    }
+
+    // Hash kiểu cũ: SHA-256 không salt (dữ liệu từ các bản trước).
+    std::string legacy_sha256_hex(const std::string& password) {
+        unsigned char hash[SHA256_DIGEST_LENGTH];
+        SHA256(reinterpret_cast<const unsigned char*>(password.data()), password.size(), hash);
+        return to_hex(hash, SHA256_DIGEST_LENGTH);
+    }
+
+    struct ParsedHash {
+        int iterations;
+        std::vector<unsigned char> salt;
+        std::vector<unsigned char> hash;
+    };
+
+    std::optional<ParsedHash> parse_pbkdf2(const std::string& stored) {
+        // pbkdf2_sha256$<iterations>$<salt hex>$<hash hex>
+        std::vector<std::string> parts;
+        std::stringstream ss(stored);
+        std::string part;
+        while (std::getline(ss, part, '$')) parts.push_back(part);
+        if (parts.size() != 4 || parts[0] != PBKDF2_PREFIX) return std::nullopt;
+        ParsedHash parsed;
+        try {
+            parsed.iterations = std::stoi(parts[1]);
+        } catch (const std::exception&) {
+            return std::nullopt;
+        }
+        auto salt = from_hex(parts[2]);
+        auto hash = from_hex(parts[3]);
+        if (parsed.iterations <= 0 || !salt || !hash || hash->empty()) return std::nullopt;
+        parsed.salt = std::move(*salt);
+        parsed.hash = std::move(*hash);
+        return parsed;
+    }
+}
 
-    std::ostringstream ss;
-    for(int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-        ss << std::hex << std::setw(2) << std::setfill('0') << (int)hash[i];
+UserManager::UserManager(Database& db, BoundedExecutor* hash_executor) : db_(db), hash_executor_(hash_executor) {}
+
+// Hashing chạy trên pool riêng (nếu có) để login dồn dập không chiếm CPU của các thread HTTP.
+template <class F>
+auto UserManager::run_hashing(F&& f) {
+    if (hash_executor_) {
+        return hash_executor_->run(std::forward<F>(f)); // có thể ném ExecutorSaturated
     }
-    return ss.str();
+    return f();
+}
+
+// Salted, iterated PBKDF2-HMAC-SHA256 (Config::PASSWORD_SALT_LENGTH / Config::HASH_ITERATIONS).
+std::string UserManager::hash_password(const std::string& password, int iterations, int salt_length) {
+    std::vector<unsigned char> salt(static_cast<std::size_t>(salt_length > 0 ? salt_length : 16));
+    if (RAND_bytes(salt.data(), static_cast<int>(salt.size())) != 1) {
+        throw std::runtime_error("RAND_bytes failed while generating password salt");
+    }
+    std::vector<unsigned char> hash = pbkdf2(password, salt, iterations);
+    return PBKDF2_PREFIX + "$" + std::to_string(iterations) + "$" + to_hex(salt.data(), salt.size()) + "$" + to_hex(hash.data(), hash.size());
 }
 
 bool UserManager::verify_password(const std::string& password, const std::string& stored_hash) {
-    return hash_password(password) == stored_hash;
+    if (auto parsed = parse_pbkdf2(stored_hash)) {
+        std::vector<unsigned char> computed = pbkdf2(password, parsed->salt, parsed->iterations);
+        return computed.size() == parsed->hash.size() &&
+               CRYPTO_memcmp(computed.data(), parsed->hash.data(), computed.size()) == 0;
+    }
+    std::string legacy = legacy_sha256_hex(password);
+    return legacy.size() == stored_hash.size() && CRYPTO_memcmp(legacy.data(), stored_hash.data(), legacy.size()) == 0;
+}
+
+bool UserManager::needs_rehash(const std::string& stored_hash, int iterations) {
+    auto parsed = parse_pbkdf2(stored_hash);
+    return !parsed || parsed->iterations < iterations;
+}
+
+bool UserManager::update_password_hash(int user_id, const std::string& new_hash) {
+    std::string sql = "UPDATE users SET password_hash = ? WHERE id = ?;";
+    std::lock_guard<std::recursive_mutex> db_lock(db_.write_mutex());
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_.get_db_handle(), sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        LOG_ERROR("Failed to prepare password update: " << sqlite3_errmsg(db_.get_db_handle()));
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, new_hash.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, user_id);
+    bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+    sqlite3_finalize(stmt);
+    return ok;
 }
 
 bool UserManager::create_user_directory(const std::string& username) {
@@ -36,16 +137,16 @@ bool UserManager::create_user_directory(const std::string& username) {
     try {
         if (!fs::exists(user_dir)) {
             if (fs::create_directories(user_dir)) {
-                std::cout << "Created directory for user: " << username << " at " << user_dir << std::endl;
+                LOG_INFO("Created directory for user: " << username << " at " << user_dir);
                 return true;
             } else {
-                std::cerr << "Failed to create directory for user: " << username << std::endl;
+                LOG_ERROR("Failed to create directory for user: " << username);
                 return false;
             }
         }
         return true; // Directory already exists
     } catch (const fs::filesystem_error& e) {
-        std::cerr << "Filesystem error creating directory for " << username << ": " << e.what() << std::endl;
+        LOG_ERROR("Filesystem error creating directory for " << username << ": " << e.what());
         return false;
     }
 }
@@ -56,7 +157,7 @@ std::optional<int> UserManager::register_user(const std::string& username, const
     std::string check_sql = "SELECT id FROM users WHERE username = ?;";
     sqlite3_stmt* stmt_check;
     if (sqlite3_prepare_v2(db_.get_db_handle(), check_sql.c_str(), -1, &stmt_check, nullptr) != SQLITE_OK) {
-        std::cerr << "Failed to prepare check statement: " << sqlite3_errmsg(db_.get_db_handle()) << std::endl;
+        LOG_ERROR("Failed to prepare check statement: " << sqlite3_errmsg(db_.get_db_handle()));
         return std::nullopt;
     }
     sqlite3_bind_text(stmt_check, 1, username.c_str(), -1, SQLITE_STATIC);
@@ -68,23 +169,30 @@ std::optional<int> UserManager::register_user(const std::string& username, const
     sqlite3_finalize(stmt_check);
 
     if (exists) {
-        std::cerr << "Username '" << username << "' already exists." << std::endl;
+        LOG_WARN("Username '" << username << "' already exists.");
         return std::nullopt;
     }
 
+    // Hash trước khi tạo thư mục: nếu pool hash bị đầy (ExecutorSaturated) thì chưa có gì phải dọn.
+    int iterations = Config::HASH_ITERATIONS;
+    int salt_length = Config::PASSWORD_SALT_LENGTH;
+    std::string hashed_password = run_hashing([password, iterations, salt_length]() {
+        return hash_password(password, iterations, salt_length);
+    });
+
     // Create user directory
     if (!create_user_directory(username)) {
         return std::nullopt; // Directory creation failed
     }
 
-    std::string hashed_password = hash_password(password);
     fs::path home_dir_path = fs::path(Config::USER_DATA_ROOT) / username;
     std::string home_dir_str = home_dir_path.string(); // Store as string
 
     std::string insert_sql = "INSERT INTO users (username, password_hash, home_dir) VALUES (?, ?, ?);";
+    std::lock_guard<std::recursive_mutex> db_lock(db_.write_mutex()); // Cả last_insert_rowid bên dưới
     sqlite3_stmt* stmt_insert;
     if (sqlite3_prepare_v2(db_.get_db_handle(), insert_sql.c_str(), -1, &stmt_insert, nullptr) != SQLITE_OK) {
-        std::cerr << "Failed to prepare insert statement: " << sqlite3_errmsg(db_.get_db_handle()) << std::endl;
+        LOG_ERROR("Failed to prepare insert statement: " << sqlite3_errmsg(db_.get_db_handle()));
         return std::nullopt;
     }
 
@@ -93,7 +201,7 @@ std::optional<int> UserManager::register_user(const std::string& username, const
     sqlite3_bind_text(stmt_insert, 3, home_dir_str.c_str(), -1, SQLITE_STATIC);
 
     if (sqlite3_step(stmt_insert) != SQLITE_DONE) {
-        std::cerr << "Failed to execute insert statement: " << sqlite3_errmsg(db_.get_db_handle()) << std::endl;
+        LOG_ERROR("Failed to execute insert statement: " << sqlite3_errmsg(db_.get_db_handle()));
         sqlite3_finalize(stmt_insert);
         // Potentially roll back directory creation or clean up
         return std::nullopt;
@@ -101,7 +209,7 @@ std::optional<int> UserManager::register_user(const std::string& username, const
     sqlite3_finalize(stmt_insert);
     
     int user_id = sqlite3_last_insert_rowid(db_.get_db_handle());
-    std::cout << "User " << username << " registered successfully with ID: " << user_id << std::endl;
+    LOG_INFO("User " << username << " registered successfully with ID: " << user_id);
     return user_id;
 }
 
@@ -112,7 +220,7 @@ std::optional<int> UserManager::login_user(const std::string& username, const st
     std::string sql = "SELECT id, password_hash FROM users WHERE username = ?;";
     sqlite3_stmt* stmt;
     if (sqlite3_prepare_v2(db_.get_db_handle(), sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
-        std::cerr << "Failed to prepare login statement: " << sqlite3_errmsg(db_.get_db_handle()) << std::endl;
+        LOG_ERROR("Failed to prepare login statement: " << sqlite3_errmsg(db_.get_db_handle()));
         return std::nullopt;
     }
     sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
@@ -121,16 +229,28 @@ std::optional<int> UserManager::login_user(const std::string& username, const st
         int user_id = sqlite3_column_int(stmt, 0);
         std::string stored_hash = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
         sqlite3_finalize(stmt);
-        if (verify_password(password, stored_hash)) {
-            std::cout << "User " << username << " logged in successfully." << std::endl;
+
+        int iterations = Config::HASH_ITERATIONS;
+        int salt_length = Config::PASSWORD_SALT_LENGTH;
+        // Verify và (nếu cần) nâng cấp hash cũ trong cùng một task trên pool hashing.
+        auto result = run_hashing([password, stored_hash, iterations, salt_length]() -> std::pair<bool, std::string> {
+            if (!verify_password(password, stored_hash)) return {false, ""};
+            if (needs_rehash(stored_hash, iterations)) return {true, hash_password(password, iterations, salt_length)};
+            return {true, ""};
+        });
+        if (result.first) {
+            if (!result.second.empty() && update_password_hash(user_id, result.second)) {
+                LOG_INFO("Upgraded password hash for user " << username << ".");
+            }
+            LOG_INFO("User " << username << " logged in successfully.");
             return user_id;
         } else {
-            std::cerr << "Incorrect password for user " << username << std::endl;
+            LOG_WARN("Incorrect password for user " << username);
             return std::nullopt;
         }
     } else {
         sqlite3_finalize(stmt);
-        std::cerr << "User " << username << " not found." << std::endl;
+        LOG_WARN("User " << username << " not found.");
         return std::nullopt;
     }
 }
@@ -153,28 +273,30 @@ bool UserManager::delete_user(int user_id) {
 
 
     std::string sql = "DELETE FROM users WHERE id = ?;";
+    std::unique_lock<std::recursive_mutex> db_lock(db_.write_mutex());
     sqlite3_stmt* stmt;
     if (sqlite3_prepare_v2(db_.get_db_handle(), sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
-         std::cerr << "Failed to prepare delete statement: " << sqlite3_errmsg(db_.get_db_handle()) << std::endl;
+         LOG_ERROR("Failed to prepare delete statement: " << sqlite3_errmsg(db_.get_db_handle()));
         return false;
     }
     sqlite3_bind_int(stmt, 1, user_id);
     
     bool success = (sqlite3_step(stmt) == SQLITE_DONE);
     if (!success) {
-        std::cerr << "Failed to delete user: " << sqlite3_errmsg(db_.get_db_handle()) << std::endl;
+        LOG_ERROR("Failed to delete user: " << sqlite3_errmsg(db_.get_db_handle()));
     }
     sqlite3_finalize(stmt);
+    db_lock.unlock();
 
     if (success && !home_dir_to_delete.empty()) {
         try {
             fs::path user_dir(home_dir_to_delete);
             if (fs::exists(user_dir)) {
                 uintmax_t n = fs::remove_all(user_dir); // remove_all deletes directory and its contents
-                std::cout << "Removed user directory " << user_dir << " and " << n << " files/subdirectories." << std::endl;
+                LOG_INFO("Removed user directory " << user_dir << " and " << n << " files/subdirectories.");
             }
         } catch (const fs::filesystem_error& e) {
-            std::cerr << "Filesystem error deleting directory " << home_dir_to_delete << ": " << e.what() << std::endl;
+            LOG_ERROR("Filesystem error deleting directory " << home_dir_to_delete << ": " << e.what());
             // DB entry deleted, but directory remains. This is an inconsistency.
             // Log this error prominently.
         }
@@ -186,7 +308,7 @@ std::optional<std::string> UserManager::get_user_home_dir(int user_id) {
     std::string sql = "SELECT home_dir FROM users WHERE id = ?;";
     sqlite3_stmt* stmt;
     if (sqlite3_prepare_v2(db_.get_db_handle(), sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db_.get_db_handle()) << std::endl;
+        LOG_ERROR("Failed to prepare statement: " << sqlite3_errmsg(db_.get_db_handle()));
         return std::nullopt;
     }
     sqlite3_bind_int(stmt, 1, user_id);
@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+#include "async_logger.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// AsyncLogger is a process-wide singleton, so everything runs in one test.
+TEST(AsyncLoggerTest, WritesAllThreadsThroughBackgroundWriter) {
+    const std::string path = "test_async_logger.log";
+    std::filesystem::remove(path);
+
+    AsyncLogger::instance().start(LogLevel::INFO, path);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([t]() {
+            for (int i = 0; i < 100; ++i) {
+                LOG_INFO("thread " << t << " message " << i);
+                if (i % 10 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+    LOG_DEBUG("compiled out at the default FILESERVER_LOG_MIN_LEVEL");
+    AsyncLogger::instance().set_level(LogLevel::WARN);
+    LOG_INFO("filtered at runtime");
+    LOG_WARN("kept " << std::hex << 255);
+    LOG_ERROR("decimal again " << 255); // format flags do not leak between lines
+    AsyncLogger::instance().stop();
+
+    std::ifstream in(path);
+    std::string line;
+    int info = 0, warn = 0;
+    bool saw_hex = false, saw_dec = false;
+    while (std::getline(in, line)) {
+        if (line.find("filtered at runtime") != std::string::npos) ADD_FAILURE() << line;
+        if (line.find("compiled out") != std::string::npos) ADD_FAILURE() << line;
+        if (line.find(" INFO ") != std::string::npos && line.find("| thread ") != std::string::npos) ++info;
+        if (line.find(" WARN ") != std::string::npos) ++warn;
+        if (line.find("kept ff") != std::string::npos) saw_hex = true;
+        if (line.find("decimal again 255") != std::string::npos) saw_dec = true;
+    }
+    EXPECT_EQ(info + static_cast<int>(AsyncLogger::instance().dropped()), 400);
+    EXPECT_EQ(warn, 1);
+    EXPECT_TRUE(saw_hex);
+    EXPECT_TRUE(saw_dec);
+    std::filesystem::remove(path);
+}
+
+TEST(AsyncLoggerTest, ParsesLevelNames) {
+    LogLevel level;
+    EXPECT_TRUE(AsyncLogger::parse_level("WARNING", level));
+    EXPECT_EQ(level, LogLevel::WARN);
+    EXPECT_TRUE(AsyncLogger::parse_level("debug", level));
+    EXPECT_EQ(level, LogLevel::DBG);
+    EXPECT_FALSE(AsyncLogger::parse_level("verbose", level));
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,205 @@
+#include <gtest/gtest.h>
+#include "block_delta.hpp"
+#include "file_manager.hpp"
+#include "db.hpp"
+#include "config.hpp"
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+    std::string random_bytes(std::size_t size, unsigned seed) {
+        std::mt19937 rng(seed);
+        std::string out(size, '\0');
+        for (auto& c : out) c = static_cast<char>(rng() & 0xff);
+        return out;
+    }
+
+    BlockDelta::Signature signature_of(const std::string& data, std::uint32_t block_size) {
+        std::istringstream in(data);
+        BlockDelta::Signature signature;
+        EXPECT_TRUE(BlockDelta::compute_signature(in, block_size, signature));
+        return signature;
+    }
+
+    std::string make_delta(const std::string& base, const std::string& target, std::uint32_t block_size,
+                           BlockDelta::DeltaStats* stats = nullptr) {
+        std::istringstream in(target);
+        std::ostringstream out;
+        EXPECT_TRUE(BlockDelta::write_delta(signature_of(base, block_size), in, out, stats));
+        return out.str();
+    }
+
+    bool apply(const std::string& base, const std::string& delta, std::string& result) {
+        std::istringstream base_in(base), delta_in(delta);
+        std::ostringstream out;
+        if (!BlockDelta::apply_delta(base_in, delta_in, out)) return false;
+        result = out.str();
+        return true;
+    }
+}
+
+TEST(BlockDeltaTest, RollingChecksumFindsShiftedBlock) {
+    // Block chỉ khớp sau khi checksum trượt đi một byte: checksum trượt phải bằng checksum tính lại
+    const std::string data = random_bytes(2049, 1);
+    BlockDelta::DeltaStats stats;
+    make_delta(data.substr(1), data, 2048, &stats);
+    EXPECT_EQ(stats.copied_bytes, 2048u);
+    EXPECT_EQ(stats.literal_bytes, 1u);
+}
+
+TEST(BlockDeltaTest, SmallEditReusesTheRestOfTheFile) {
+    const std::string base = random_bytes(300 * 1024, 2);
+    std::string target = base;
+    target.replace(100000, 10, "0123456789");   // Sửa tại chỗ
+    target.insert(200000, "inserted bytes");     // Chèn: các block phía sau bị lệch
+    target.erase(250000, 777);                   // Xoá
+
+    BlockDelta::DeltaStats stats;
+    const std::string delta = make_delta(base, target, 2048, &stats);
+    EXPECT_LT(delta.size(), 16u * 1024);
+    EXPECT_GT(stats.copied_bytes, target.size() - 8 * 2048);
+    EXPECT_EQ(stats.copied_bytes + stats.literal_bytes, target.size());
+
+    std::string result;
+    ASSERT_TRUE(apply(base, delta, result));
+    EXPECT_EQ(result, target);
+}
+
+TEST(BlockDeltaTest, EdgeCasesRoundTrip) {
+    const std::string data = random_bytes(10000, 3); // Block cuối ngắn (10000 % 2048)
+    const std::vector<std::pair<std::string, std::string>> cases = {
+        {"", ""}, {"", data}, {data, ""}, {data, data},
+        {data, data.substr(0, 4096)},           // Chỉ còn block đầy đủ
+        {data, data + data.substr(0, 100)},     // Nối thêm sau block cuối ngắn
+        {data, random_bytes(10000, 4)},         // Khác hoàn toàn
+        {std::string(8192, '\0'), std::string(20000, '\0')}, // Block giống nhau lặp lại
+    };
+    for (const auto& c : cases) {
+        BlockDelta::DeltaStats stats;
+        const std::string delta = make_delta(c.first, c.second, 2048, &stats);
+        std::string result;
+        ASSERT_TRUE(apply(c.first, delta, result));
+        EXPECT_EQ(result, c.second);
+    }
+
+    BlockDelta::DeltaStats stats;
+    make_delta(data, data, 2048, &stats);
+    EXPECT_EQ(stats.literal_bytes, 0u); // Cả block cuối ngắn cũng khớp
+    EXPECT_LT(stats.delta_bytes, 64u);  // Một op copy duy nhất
+}
+
+TEST(BlockDeltaTest, SignatureRoundTripAndRejectsMalformedInput) {
+    const std::string data = random_bytes(7000, 5);
+    const BlockDelta::Signature signature = signature_of(data, 2048);
+    ASSERT_EQ(signature.blocks.size(), 4u);
+    EXPECT_EQ(signature.file_size, 7000u);
+
+    std::ostringstream out;
+    ASSERT_TRUE(BlockDelta::write_signature(signature, out));
+    std::istringstream in(out.str());
+    BlockDelta::Signature read;
+    ASSERT_TRUE(BlockDelta::read_signature(in, read));
+    EXPECT_EQ(read.block_size, signature.block_size);
+    ASSERT_EQ(read.blocks.size(), signature.blocks.size());
+    EXPECT_EQ(read.blocks[3].strong, signature.blocks[3].strong);
+
+    std::istringstream truncated(out.str().substr(0, out.str().size() - 1));
+    EXPECT_FALSE(BlockDelta::read_signature(truncated, read));
+    std::istringstream bad_magic("XSIG" + out.str().substr(4));
+    EXPECT_FALSE(BlockDelta::read_signature(bad_magic, read));
+
+    // Delta bị cắt hoặc copy ngoài base thì bị từ chối
+    const std::string delta = make_delta(data, data, 2048);
+    std::string result;
+    EXPECT_FALSE(apply(data, delta.substr(0, delta.size() - 1), result));
+    EXPECT_FALSE(apply(data.substr(0, 2048), delta, result));
+
+    EXPECT_EQ(BlockDelta::block_size_for(0), BlockDelta::MIN_BLOCK_SIZE);
+    EXPECT_EQ(BlockDelta::block_size_for(4ull << 30), 65536u);
+    EXPECT_EQ(BlockDelta::block_size_for(1ull << 50), BlockDelta::MAX_BLOCK_SIZE);
+}
+
+// FileManager::apply_delta: dựng file mới rồi rename, kiểm tra base và checksum.
+class BlockDeltaFileTest : public ::testing::Test {
+protected:
+    std::string test_db_path = "test_block_delta.db";
+    fs::path data_root;
+    fs::path home;
+    std::string saved_user_root;
+    Database* db = nullptr;
+    FileManager* fm = nullptr;
+
+    void SetUp() override {
+        fs::remove(test_db_path);
+        data_root = fs::absolute("test_block_delta_data");
+        fs::remove_all(data_root);
+        home = fs::weakly_canonical(data_root) / "alice";
+        fs::create_directories(home);
+
+        saved_user_root = Config::USER_DATA_ROOT;
+        Config::USER_DATA_ROOT = data_root.string();
+        db = new Database(test_db_path);
+        ASSERT_TRUE(db->initialize_schema());
+        fm = new FileManager(*db);
+    }
+
+    void TearDown() override {
+        delete fm;
+        delete db;
+        Config::USER_DATA_ROOT = saved_user_root;
+        fs::remove(test_db_path);
+        fs::remove_all(data_root);
+    }
+
+    std::string read_file(const fs::path& path) {
+        std::ifstream in(path, std::ios::binary);
+        std::ostringstream out;
+        out << in.rdbuf();
+        return out.str();
+    }
+
+    std::string checksum_of(const std::string& content) {
+        const fs::path scratch = data_root / "scratch";
+        std::ofstream(scratch, std::ios::binary) << content;
+        std::string checksum = fm->calculate_checksum(scratch);
+        fs::remove(scratch);
+        return checksum;
+    }
+};
+
+TEST_F(BlockDeltaFileTest, AppliesDeltaAtomicallyAndChecksBaseAndResult) {
+    const std::string base = random_bytes(64 * 1024, 6);
+    std::string target = base;
+    target.replace(30000, 5, "hello");
+    ASSERT_TRUE(fm->upload_file(home, "img/disk.bin", std::vector<char>(base.begin(), base.end())));
+    const std::string hash_before = fm->tree_hashes().directory_hash(home.string());
+    const std::string delta = make_delta(base, target, 2048);
+
+    // Base đã đổi: không chạm vào file
+    std::istringstream stale(delta);
+    EXPECT_EQ(fm->apply_delta(home, "img/disk.bin", stale, checksum_of("other"), checksum_of(target)), DeltaApplyResult::BASE_CHANGED);
+    // Kết quả không khớp checksum: file cũ còn nguyên, không sót file tạm
+    std::istringstream wrong(delta);
+    EXPECT_EQ(fm->apply_delta(home, "img/disk.bin", wrong, checksum_of(base), checksum_of("nope")), DeltaApplyResult::CHECKSUM_MISMATCH);
+    EXPECT_EQ(read_file(home / "img/disk.bin"), base);
+    EXPECT_EQ(std::distance(fs::directory_iterator(home / "img"), fs::directory_iterator()), 1);
+
+    std::istringstream good(delta);
+    EXPECT_EQ(fm->apply_delta(home, "img/disk.bin", good, checksum_of(base), checksum_of(target)), DeltaApplyResult::OK);
+    EXPECT_EQ(read_file(home / "img/disk.bin"), target);
+    EXPECT_NE(fm->tree_hashes().directory_hash(home.string()), hash_before);
+
+    std::istringstream missing(delta);
+    EXPECT_EQ(fm->apply_delta(home, "img/none.bin", missing, "", ""), DeltaApplyResult::NOT_FOUND);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
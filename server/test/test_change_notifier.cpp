@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include "change_notifier.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+TEST(ChangeNotifierTest, NotifyFiresSubscriptionsOnTheDirectoryAndItsAncestors) {
+    ChangeNotifier notifier;
+    std::vector<std::string> fired;
+    notifier.subscribe("/data/alice", std::chrono::seconds(60), [&](bool changed) { if (changed) fired.push_back("alice"); });
+    notifier.subscribe("/data/alice/docs", std::chrono::seconds(60), [&](bool changed) { if (changed) fired.push_back("docs"); });
+    notifier.subscribe("/data/bob", std::chrono::seconds(60), [&](bool changed) { if (changed) fired.push_back("bob"); });
+    notifier.subscribe("/data/ali", std::chrono::seconds(60), [&](bool changed) { if (changed) fired.push_back("ali"); });
+    EXPECT_EQ(notifier.waiting(), 4u);
+
+    notifier.notify("/data/alice/photos/2024");
+    EXPECT_EQ(fired, (std::vector<std::string>{"alice"}));
+
+    // One-shot: subscription đã fire không fire lại
+    notifier.notify("/data/alice/docs");
+    EXPECT_EQ(fired, (std::vector<std::string>{"alice", "docs"}));
+    EXPECT_EQ(notifier.waiting(), 2u);
+}
+
+TEST(ChangeNotifierTest, UnsubscribeOnlySucceedsBeforeTheCallbackFires) {
+    ChangeNotifier notifier;
+    int calls = 0;
+    auto a = notifier.subscribe("/data/alice", std::chrono::seconds(60), [&](bool) { ++calls; });
+    auto b = notifier.subscribe("/data/alice", std::chrono::seconds(60), [&](bool) { ++calls; });
+    EXPECT_TRUE(notifier.unsubscribe(a));
+    EXPECT_FALSE(notifier.unsubscribe(a));
+
+    notifier.notify("/data/alice");
+    EXPECT_EQ(calls, 1);
+    EXPECT_FALSE(notifier.unsubscribe(b));
+    EXPECT_EQ(notifier.waiting(), 0u);
+}
+
+TEST(ChangeNotifierTest, TimeoutsAndShutdownAnswerUnchanged) {
+    ChangeNotifier notifier;
+    std::atomic<int> timed_out{0}, released{0};
+    notifier.subscribe("/data/alice", std::chrono::seconds(0), [&](bool changed) { if (!changed) ++timed_out; });
+    notifier.subscribe("/data/bob", std::chrono::seconds(3600), [&](bool changed) { if (!changed) ++released; });
+    EXPECT_EQ(notifier.sweep(), 0u); // Không fire sớm hơn timeout
+
+    notifier.start_sweeper();
+    for (int i = 0; i < 50 && timed_out.load() == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    EXPECT_EQ(timed_out.load(), 1);
+    EXPECT_EQ(released.load(), 0);
+    EXPECT_EQ(notifier.waiting(), 1u);
+
+    notifier.stop_sweeper();
+    EXPECT_EQ(released.load(), 1);
+    EXPECT_EQ(notifier.waiting(), 0u);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,284 @@
+#include <gtest/gtest.h>
+#include "fastcdc.hpp"
+#include "chunk_store.hpp"
+#include "file_manager.hpp"
+#include "db.hpp"
+#include "config.hpp"
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+    std::string random_bytes(std::size_t size, unsigned seed) {
+        std::mt19937 rng(seed);
+        std::string out(size, '\0');
+        for (auto& c : out) c = static_cast<char>(rng() & 0xff);
+        return out;
+    }
+
+    std::vector<std::string> chunk_hashes(const std::string& data, std::vector<std::size_t>* sizes = nullptr) {
+        std::istringstream in(data);
+        std::vector<std::string> hashes;
+        EXPECT_TRUE(FastCdc::split(in, [&](const unsigned char* chunk, std::size_t length) {
+            hashes.push_back(FastCdc::chunk_hash(chunk, length));
+            if (sizes) sizes->push_back(length);
+            return true;
+        }));
+        return hashes;
+    }
+
+    const unsigned char* bytes(const std::string& data) {
+        return reinterpret_cast<const unsigned char*>(data.data());
+    }
+
+    std::string read_all(std::istream& in) {
+        std::ostringstream out;
+        out << in.rdbuf();
+        return out.str();
+    }
+}
+
+TEST(FastCdcTest, ChunkSizesStayInBoundsAndCutsSurviveAnInsert) {
+    const std::string data = random_bytes(4 * 1024 * 1024, 1);
+    std::vector<std::size_t> sizes;
+    const auto hashes = chunk_hashes(data, &sizes);
+    ASSERT_GT(hashes.size(), 20u);
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < sizes.size(); ++i) {
+        total += sizes[i];
+        EXPECT_LE(sizes[i], FastCdc::MAX_SIZE);
+        if (i + 1 < sizes.size()) {
+            EXPECT_GE(sizes[i], FastCdc::MIN_SIZE);
+        }
+    }
+    EXPECT_EQ(total, data.size());
+    EXPECT_EQ(chunk_hashes(data), hashes); // Cắt giống hệt ở lần sau
+
+    // Chèn vài byte ở giữa: chỉ một hai chunk quanh chỗ chèn đổi hash
+    std::string edited = data;
+    edited.insert(data.size() / 2, "a few inserted bytes");
+    const auto edited_hashes = chunk_hashes(edited);
+    const std::set<std::string> before(hashes.begin(), hashes.end());
+    std::size_t changed = 0;
+    for (const auto& hash : edited_hashes) changed += before.count(hash) == 0;
+    EXPECT_LE(changed, 3u);
+}
+
+TEST(FastCdcTest, FramesRoundTripAndRejectMalformedInput) {
+    const std::string data = random_bytes(1000, 2);
+    const std::string hash = FastCdc::chunk_hash(bytes(data), data.size());
+    ASSERT_TRUE(FastCdc::is_chunk_hash(hash));
+    EXPECT_FALSE(FastCdc::is_chunk_hash(hash.substr(1)));
+    EXPECT_FALSE(FastCdc::is_chunk_hash(std::string(64, 'G')));
+
+    std::ostringstream out;
+    ASSERT_TRUE(FastCdc::write_frame(out, hash, bytes(data), data.size()));
+    std::istringstream in(out.str());
+    std::string read_hash, read_data;
+    bool eof = false;
+    ASSERT_TRUE(FastCdc::read_frame(in, read_hash, read_data, eof));
+    EXPECT_EQ(read_hash, hash);
+    EXPECT_EQ(read_data, data);
+    EXPECT_FALSE(FastCdc::read_frame(in, read_hash, read_data, eof));
+    EXPECT_TRUE(eof);
+
+    std::istringstream truncated(out.str().substr(0, out.str().size() - 1));
+    EXPECT_FALSE(FastCdc::read_frame(truncated, read_hash, read_data, eof));
+    EXPECT_FALSE(eof);
+}
+
+// ChunkStore / FileManager ở chế độ chunked trên một DB và thư mục tạm.
+class ChunkStoreTest : public ::testing::Test {
+protected:
+    std::string test_db_path = "test_chunk_store.db";
+    fs::path data_root;
+    fs::path home;
+    std::string saved_user_root, saved_mode, saved_chunks_root;
+    Database* db = nullptr;
+    FileManager* fm = nullptr;
+
+    void SetUp() override {
+        fs::remove(test_db_path);
+        data_root = fs::absolute("test_chunk_store_data");
+        fs::remove_all(data_root);
+        home = fs::weakly_canonical(data_root) / "alice";
+        fs::create_directories(home);
+
+        saved_user_root = Config::USER_DATA_ROOT;
+        saved_mode = Config::STORAGE_MODE;
+        saved_chunks_root = Config::STORAGE_CHUNKS_ROOT;
+        Config::USER_DATA_ROOT = data_root.string();
+        Config::STORAGE_MODE = "chunked";
+        Config::STORAGE_CHUNKS_ROOT = (data_root / "chunks").string();
+        db = new Database(test_db_path);
+        ASSERT_TRUE(db->initialize_schema());
+        fm = new FileManager(*db);
+    }
+
+    void TearDown() override {
+        delete fm;
+        delete db;
+        Config::USER_DATA_ROOT = saved_user_root;
+        Config::STORAGE_MODE = saved_mode;
+        Config::STORAGE_CHUNKS_ROOT = saved_chunks_root;
+        fs::remove(test_db_path);
+        fs::remove_all(data_root);
+    }
+
+    std::string checksum_of(const std::string& content) {
+        const fs::path scratch = data_root / "scratch";
+        std::ofstream(scratch, std::ios::binary) << content;
+        std::string checksum = fm->calculate_checksum(scratch);
+        fs::remove(scratch);
+        return checksum;
+    }
+};
+
+TEST_F(ChunkStoreTest, MissingChunksRespectOwnershipAndGcKeepsReferencedChunks) {
+    ChunkStore& store = fm->chunks();
+    const std::string a = random_bytes(5000, 3), b = random_bytes(6000, 4);
+    const std::string hash_a = FastCdc::chunk_hash(bytes(a), a.size());
+    const std::string hash_b = FastCdc::chunk_hash(bytes(b), b.size());
+
+    EXPECT_FALSE(store.put_chunk(hash_b, bytes(a), a.size(), 1)); // Hash không khớp nội dung
+    ASSERT_TRUE(store.put_chunk(hash_a, bytes(a), a.size(), 1));
+    EXPECT_EQ(store.missing_chunks({hash_a, hash_b}, 1), std::vector<std::string>{hash_b});
+    // User khác chưa upload a: vẫn báo thiếu, và không được dùng a trong recipe
+    EXPECT_EQ(store.missing_chunks({hash_a}, 2), std::vector<std::string>{hash_a});
+    ChunkRecipe foreign;
+    foreign.chunks = {{hash_a, 0}};
+    EXPECT_FALSE(store.complete_recipe(foreign, 2));
+    ASSERT_TRUE(store.put_chunk(hash_a, bytes(a), a.size(), 2));
+    EXPECT_TRUE(store.complete_recipe(foreign, 2));
+    EXPECT_EQ(foreign.size, a.size());
+
+    ASSERT_TRUE(store.put_chunk(hash_b, bytes(b), b.size(), 1));
+    ChunkRecipe recipe;
+    recipe.checksum = checksum_of(a + b);
+    recipe.chunks = {{hash_a, 0}, {hash_b, 0}};
+    ASSERT_TRUE(store.complete_recipe(recipe, 1));
+    ASSERT_TRUE(store.put_recipe("/x/file", recipe));
+    EXPECT_EQ(store.collect_garbage(std::chrono::seconds(0)), 0u);
+
+    auto content = store.open(recipe);
+    content->seekg(static_cast<std::streamoff>(a.size() - 10));
+    EXPECT_EQ(read_all(*content), a.substr(a.size() - 10) + b);
+
+    // Bỏ recipe: cả hai chunk hết được dùng và bị dọn khi hết grace
+    store.remove_recipes("/x");
+    EXPECT_FALSE(store.recipe("/x/file"));
+    EXPECT_EQ(store.collect_garbage(std::chrono::seconds(3600)), 0u);
+    EXPECT_EQ(store.collect_garbage(std::chrono::seconds(0)), 2u);
+    EXPECT_FALSE(fs::exists(store.chunk_path(hash_a)));
+    EXPECT_EQ(store.stats().chunks, 0u);
+}
+
+TEST_F(ChunkStoreTest, ChunkedFilesRoundTripAndDeduplicate) {
+    const std::string data = random_bytes(1024 * 1024, 5);
+    ASSERT_TRUE(fm->upload_file(home, "a/one.bin", std::vector<char>(data.begin(), data.end())));
+    ASSERT_TRUE(fm->upload_file(home, "a/two.bin", std::vector<char>(data.begin(), data.end())));
+
+    // Trên đĩa chỉ là placeholder cùng kích thước; nội dung đọc qua FileManager
+    EXPECT_TRUE(fm->is_stored_as_chunks(home / "a/one.bin"));
+    EXPECT_EQ(fs::file_size(home / "a/one.bin"), data.size());
+    auto downloaded = fm->download_file(home, "a/one.bin");
+    ASSERT_TRUE(downloaded);
+    EXPECT_EQ(std::string(downloaded->begin(), downloaded->end()), data);
+    EXPECT_EQ(fm->calculate_checksum(home / "a/one.bin"), checksum_of(data));
+
+    const ChunkStoreStats stats = fm->chunks().stats();
+    EXPECT_EQ(stats.logical_bytes, 2 * data.size());
+    EXPECT_EQ(stats.stored_bytes, data.size()); // File thứ hai không tốn thêm chunk nào
+
+    // Đổi tên thư mục kéo theo recipe
+    ASSERT_TRUE(fs::exists(home / "a"));
+    fs::rename(home / "a", home / "b");
+    ASSERT_TRUE(fm->update_metadata_after_rename(home / "a", home / "b", -1));
+    downloaded = fm->download_file(home, "b/two.bin");
+    ASSERT_TRUE(downloaded);
+    EXPECT_EQ(downloaded->size(), data.size());
+
+    ASSERT_TRUE(fm->delete_file_or_directory(home, "b"));
+    EXPECT_EQ(fm->chunks().stats().logical_bytes, 0u);
+    EXPECT_GT(fm->chunks().collect_garbage(std::chrono::seconds(0)), 0u);
+    EXPECT_EQ(fm->chunks().stats().stored_bytes, 0u);
+}
+
+TEST_F(ChunkStoreTest, CommitChecksChunksAndChecksum) {
+    const std::string data = random_bytes(300 * 1024, 6);
+    std::vector<std::size_t> sizes;
+    const auto hashes = chunk_hashes(data, &sizes);
+    ChunkRecipe recipe;
+    for (const auto& hash : hashes) recipe.chunks.push_back({hash, 0});
+
+    EXPECT_EQ(fm->commit_chunks(home, "big.bin", recipe, checksum_of(data), 1), ChunkCommitResult::MISSING_CHUNKS);
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < hashes.size(); ++i) {
+        ASSERT_TRUE(fm->chunks().put_chunk(hashes[i], bytes(data) + offset, sizes[i], 1));
+        offset += sizes[i];
+    }
+    EXPECT_TRUE(fm->chunks().missing_chunks(hashes, 1).empty());
+
+    ChunkRecipe reordered = recipe;
+    std::swap(reordered.chunks.front(), reordered.chunks.back());
+    EXPECT_EQ(fm->commit_chunks(home, "big.bin", reordered, checksum_of(data), 1), ChunkCommitResult::CHECKSUM_MISMATCH);
+    EXPECT_FALSE(fs::exists(home / "big.bin"));
+    EXPECT_EQ(fm->commit_chunks(home, "../escape.bin", recipe, checksum_of(data), 1), ChunkCommitResult::INVALID_PATH);
+
+    EXPECT_EQ(fm->commit_chunks(home, "big.bin", recipe, checksum_of(data), 1), ChunkCommitResult::OK);
+    EXPECT_TRUE(fm->is_stored_as_chunks(home / "big.bin"));
+    EXPECT_EQ(fm->calculate_checksum(home / "big.bin"), checksum_of(data));
+
+    // Plain: commit ghép ra file thật, không giữ recipe
+    Config::STORAGE_MODE = "plain";
+    EXPECT_EQ(fm->commit_chunks(home, "plain.bin", recipe, checksum_of(data), 1), ChunkCommitResult::OK);
+    EXPECT_FALSE(fm->is_stored_as_chunks(home / "plain.bin"));
+    std::ifstream in(home / "plain.bin", std::ios::binary);
+    EXPECT_EQ(read_all(in), data);
+}
+
+// FILES_CLAIM: file mới từ một file cùng checksum mà user đọc được, không cần nội dung.
+TEST_F(ChunkStoreTest, ClaimByChecksumReusesReadableContent) {
+    const std::string data = random_bytes(200 * 1024, 7);
+    const std::string checksum = checksum_of(data);
+    auto everyone = [](const fs::path&) { return true; };
+    auto nobody = [](const fs::path&) { return false; };
+    ASSERT_TRUE(fm->upload_file(home, "src.bin", std::vector<char>(data.begin(), data.end())));
+
+    EXPECT_EQ(fm->claim_by_checksum(home, "copy.bin", checksum, nobody), ClaimResult::NOT_FOUND);
+    EXPECT_EQ(fm->claim_by_checksum(home, "copy.bin", checksum_of("other"), everyone), ClaimResult::NOT_FOUND);
+    EXPECT_EQ(fm->claim_by_checksum(home, "../copy.bin", checksum, everyone), ClaimResult::INVALID_PATH);
+
+    // Chunked: chỉ thêm recipe, không tốn thêm chunk
+    std::uint64_t claimed = 0;
+    const std::uint64_t stored_before = fm->chunks().stats().stored_bytes;
+    ASSERT_EQ(fm->claim_by_checksum(home, "dir/copy.bin", checksum, everyone, -1, &claimed), ClaimResult::OK);
+    EXPECT_EQ(claimed, data.size());
+    EXPECT_EQ(fm->chunks().stats().stored_bytes, stored_before);
+    EXPECT_EQ(fm->calculate_checksum(home / "dir/copy.bin"), checksum);
+
+    // Plain: copy ra file thật, kể cả khi nguồn là placeholder
+    Config::STORAGE_MODE = "plain";
+    ASSERT_EQ(fm->claim_by_checksum(home, "plain.bin", checksum, everyone), ClaimResult::OK);
+    EXPECT_FALSE(fm->is_stored_as_chunks(home / "plain.bin"));
+    std::ifstream in(home / "plain.bin", std::ios::binary);
+    EXPECT_EQ(read_all(in), data);
+
+    // Dòng metadata cũ (file bị sửa ngoài server) không được dùng làm nguồn
+    ASSERT_TRUE(fm->delete_file_or_directory(home, "src.bin"));
+    ASSERT_TRUE(fm->delete_file_or_directory(home, "dir"));
+    std::ofstream(home / "plain.bin", std::ios::binary | std::ios::trunc) << "changed behind our back";
+    EXPECT_EQ(fm->claim_by_checksum(home, "again.bin", checksum, everyone), ClaimResult::NOT_FOUND);
+    EXPECT_FALSE(fs::exists(home / "again.bin"));
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
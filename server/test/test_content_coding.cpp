@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include "content_coding.hpp"
+#include <nlohmann/json.hpp>
+
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <zlib.h>
+
+namespace {
+    std::string gunzip(const std::string& compressed) {
+        z_stream zs{};
+        if (inflateInit2(&zs, 15 + 16) != Z_OK) throw std::runtime_error("inflateInit2");
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+        zs.avail_in = static_cast<uInt>(compressed.size());
+        std::string out;
+        char buf[4096];
+        int rc;
+        do {
+            zs.next_out = reinterpret_cast<Bytef*>(buf);
+            zs.avail_out = sizeof(buf);
+            rc = inflate(&zs, Z_NO_FLUSH);
+            out.append(buf, sizeof(buf) - zs.avail_out);
+        } while (rc == Z_OK);
+        inflateEnd(&zs);
+        if (rc != Z_STREAM_END) throw std::runtime_error("truncated gzip stream");
+        return out;
+    }
+
+    std::string manifest_like_json(int files) {
+        nlohmann::json listing = nlohmann::json::array();
+        for (int i = 0; i < files; ++i) {
+            listing.push_back({{"path", "projects/report/section_" + std::to_string(i) + ".txt"},
+                               {"checksum", "9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08"},
+                               {"size", 1000 + i}, {"is_directory", false}});
+        }
+        return nlohmann::json{{"status", "success"}, {"listing", listing}}.dump(2);
+    }
+}
+
+TEST(ContentCodingTest, NegotiatesFromAcceptEncoding) {
+    const bool zstd = content_coding_supported(ContentCoding::ZSTD);
+    EXPECT_EQ(negotiate_content_coding(""), ContentCoding::IDENTITY);
+    EXPECT_EQ(negotiate_content_coding("gzip"), ContentCoding::GZIP);
+    EXPECT_EQ(negotiate_content_coding("deflate, br"), ContentCoding::IDENTITY);
+    EXPECT_EQ(negotiate_content_coding("GZip;q=0.5, identity"), ContentCoding::GZIP);
+    EXPECT_EQ(negotiate_content_coding("gzip;q=0"), ContentCoding::IDENTITY);
+    EXPECT_EQ(negotiate_content_coding("*;q=0.1, gzip;q=0"), zstd ? ContentCoding::ZSTD : ContentCoding::IDENTITY);
+    EXPECT_EQ(negotiate_content_coding("zstd, gzip"), zstd ? ContentCoding::ZSTD : ContentCoding::GZIP);
+    EXPECT_EQ(negotiate_content_coding("zstd;q=0.4, gzip;q=0.9"), ContentCoding::GZIP);
+}
+
+TEST(ContentCodingTest, GzipStreamRoundTripsAcrossWrites) {
+    const std::string input = manifest_like_json(2000);
+    std::string compressed;
+    StreamCompressor compressor(ContentCoding::GZIP, 6, [&](const char* d, std::size_t n) { compressed.append(d, n); });
+    for (std::size_t off = 0; off < input.size(); off += 777) {
+        compressor.write(input.data() + off, std::min<std::size_t>(777, input.size() - off));
+    }
+    compressor.finish();
+    EXPECT_EQ(compressor.bytes_in(), input.size());
+    EXPECT_EQ(compressor.bytes_out(), compressed.size());
+    EXPECT_LT(compressed.size() * 10, input.size()); // repetitive JSON compresses well
+    EXPECT_EQ(gunzip(compressed), input);
+}
+
+TEST(ContentCodingTest, BodyStreamSkipsSmallBodiesAndCompressesLargeOnes) {
+    int opens = 0;
+    ContentCoding opened_with = ContentCoding::IDENTITY;
+    std::int64_t opened_length = 0;
+    std::ostringstream wire;
+    auto open = [&](ContentCoding coding, std::int64_t length) -> std::ostream& {
+        ++opens;
+        opened_with = coding;
+        opened_length = length;
+        return wire;
+    };
+
+    {
+        CompressingBodyStream body(ContentCoding::GZIP, 6, 1024, open);
+        body << "{\"status\":\"success\"}";
+        body.finish();
+        EXPECT_EQ(opens, 1);
+        EXPECT_EQ(opened_with, ContentCoding::IDENTITY);
+        EXPECT_EQ(opened_length, 20);
+        EXPECT_EQ(wire.str(), "{\"status\":\"success\"}");
+    }
+
+    opens = 0;
+    wire.str("");
+    nlohmann::json payload = nlohmann::json::parse(manifest_like_json(500));
+    {
+        CompressingBodyStream body(ContentCoding::GZIP, 6, 1024, open);
+        body << std::setw(2) << payload;
+        body.finish();
+        EXPECT_EQ(opens, 1);
+        EXPECT_EQ(opened_with, ContentCoding::GZIP);
+        EXPECT_EQ(opened_length, -1);
+        EXPECT_EQ(body.coding_used(), ContentCoding::GZIP);
+        EXPECT_EQ(body.bytes_out(), wire.str().size());
+    }
+    EXPECT_EQ(gunzip(wire.str()), payload.dump(2));
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
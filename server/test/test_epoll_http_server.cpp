@@ -0,0 +1,309 @@
+#include <gtest/gtest.h>
+#include "epoll_http_server.hpp"
+#include "http_request_parser.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    // Feeds the input one byte at a time; returns the final status.
+    HttpRequestParser::Status parse_bytewise(HttpRequestParser& parser, const std::string& input, std::string& body) {
+        auto sink = [&body](const char* d, std::size_t n) { body.append(d, n); return true; };
+        HttpRequestParser::Status status = HttpRequestParser::Status::NEED_MORE;
+        for (char c : input) {
+            std::size_t consumed = 0;
+            status = parser.parse(&c, 1, consumed, sink);
+            if (status != HttpRequestParser::Status::NEED_MORE) break;
+        }
+        return status;
+    }
+
+    int connect_to(std::uint16_t port) {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) { ::close(fd); return -1; }
+        return fd;
+    }
+
+    void send_all(int fd, const std::string& data) {
+        std::size_t off = 0;
+        while (off < data.size()) {
+            ssize_t n = ::send(fd, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+            ASSERT_GT(n, 0);
+            off += static_cast<std::size_t>(n);
+        }
+    }
+
+    // Reads one response (headers + Content-Length body) from fd; buffer keeps leftovers.
+    std::string read_response(int fd, std::string& buffer) {
+        char chunk[4096];
+        for (;;) {
+            std::size_t end = buffer.find("\r\n\r\n");
+            if (end != std::string::npos) {
+                std::size_t cl = buffer.find("Content-Length: ");
+                std::size_t length = cl < end ? std::stoul(buffer.substr(cl + 16)) : 0;
+                if (buffer.size() >= end + 4 + length) {
+                    std::string response = buffer.substr(0, end + 4 + length);
+                    buffer.erase(0, end + 4 + length);
+                    return response;
+                }
+            }
+            ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) return "";
+            buffer.append(chunk, static_cast<std::size_t>(n));
+        }
+    }
+
+    EpollHttpServer::Options test_options() {
+        EpollHttpServer::Options options;
+        options.bind_address = "127.0.0.1";
+        options.port = 0;
+        options.io_threads = 2;
+        options.handler_threads = 2;
+        return options;
+    }
+
+    // Echoes method, URI, body size and the first bytes of the body.
+    void echo_handler(EpollHttpServer::Request& req, EpollHttpServer::Response& res) {
+        std::string body = req.body;
+        if (!req.body_file.empty()) {
+            std::ifstream in(req.body_file, std::ios::binary);
+            body.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        res.headers.emplace_back("Content-Type", "text/plain");
+        res.body = req.head.method + " " + req.head.uri + " " + std::to_string(body.size()) + " " +
+                   (req.body_file.empty() ? "memory" : "spooled") + " " + body.substr(0, 8);
+    }
+}
+
+TEST(HttpRequestParserTest, ParsesFixedLengthBodySplitAtEveryByte) {
+    HttpRequestParser parser;
+    std::string body;
+    auto status = parse_bytewise(parser,
+        "\r\nPOST /api/v1/files/upload?x=1 HTTP/1.1\r\nHost: a\r\ncontent-length: 5\r\nX-Empty:\r\n\r\nhello", body);
+    ASSERT_EQ(status, HttpRequestParser::Status::COMPLETE);
+    EXPECT_EQ(parser.head().method, "POST");
+    EXPECT_EQ(parser.head().uri, "/api/v1/files/upload?x=1");
+    EXPECT_EQ(parser.head().content_length, 5);
+    EXPECT_TRUE(parser.head().keep_alive);
+    ASSERT_NE(parser.head().find("x-empty"), nullptr);
+    EXPECT_EQ(*parser.head().find("HOST"), "a");
+    EXPECT_EQ(body, "hello");
+}
+
+TEST(HttpRequestParserTest, ParsesChunkedBodyAndStopsBeforePipelinedRequest) {
+    HttpRequestParser parser;
+    std::string body;
+    const std::string first = "POST /a HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                              "4;ext=1\r\nWiki\r\n6\r\npedia \r\n0\r\nX-Trailer: t\r\n\r\n";
+    const std::string second = "GET /b HTTP/1.0\r\n\r\n";
+    std::string input = first + second;
+    std::size_t consumed = 0;
+    auto status = parser.parse(input.data(), input.size(), consumed,
+                               [&body](const char* d, std::size_t n) { body.append(d, n); return true; });
+    ASSERT_EQ(status, HttpRequestParser::Status::COMPLETE);
+    EXPECT_EQ(consumed, first.size());
+    EXPECT_EQ(body, "Wikipedia ");
+
+    parser.reset();
+    status = parser.parse(input.data() + consumed, input.size() - consumed, consumed, nullptr);
+    ASSERT_EQ(status, HttpRequestParser::Status::COMPLETE);
+    EXPECT_EQ(parser.head().uri, "/b");
+    EXPECT_FALSE(parser.head().keep_alive); // HTTP/1.0 without keep-alive
+}
+
+TEST(HttpRequestParserTest, RejectsMalformedAndOversizedRequests) {
+    struct Case { const char* input; int status; };
+    const Case cases[] = {
+        {"GET /\r\n\r\n", 400},
+        {"GET / HTTP/2.0\r\n\r\n", 505},
+        {"GET / HTTP/1.1\r\nBad Header: x\r\n\r\n", 400},
+        {"POST / HTTP/1.1\r\nContent-Length: 3\r\nTransfer-Encoding: chunked\r\n\r\n", 400},
+        {"POST / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n", 400},
+        {"POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n", 501},
+        {"POST / HTTP/1.1\r\nContent-Length: 2048\r\n\r\n", 413},
+        {"POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n", 400},
+    };
+    for (const Case& c : cases) {
+        HttpRequestParser::Limits limits;
+        limits.max_body_bytes = 1024;
+        HttpRequestParser parser(limits);
+        std::string input = c.input;
+        std::size_t consumed = 0;
+        EXPECT_EQ(parser.parse(input.data(), input.size(), consumed, nullptr), HttpRequestParser::Status::ERROR) << c.input;
+        EXPECT_EQ(parser.error_status(), c.status) << c.input;
+    }
+
+    HttpRequestParser::Limits limits;
+    limits.max_header_bytes = 64;
+    HttpRequestParser parser(limits);
+    std::string big = "GET / HTTP/1.1\r\nX-Long: " + std::string(100, 'a');
+    std::size_t consumed = 0;
+    EXPECT_EQ(parser.parse(big.data(), big.size(), consumed, nullptr), HttpRequestParser::Status::ERROR);
+    EXPECT_EQ(parser.error_status(), 431);
+}
+
+TEST(EpollHttpServerTest, ServesKeepAliveAndPipelinedRequests) {
+    EpollHttpServer server(test_options(), echo_handler);
+    server.start();
+    ASSERT_NE(server.port(), 0);
+
+    int fd = connect_to(server.port());
+    ASSERT_GE(fd, 0);
+    std::string buffer;
+    send_all(fd, "GET /one HTTP/1.1\r\nHost: x\r\n\r\n");
+    std::string r1 = read_response(fd, buffer);
+    EXPECT_EQ(r1.rfind("HTTP/1.1 200 OK\r\n", 0), 0u) << r1;
+    EXPECT_NE(r1.find("Connection: keep-alive"), std::string::npos);
+    EXPECT_NE(r1.find("GET /one 0 memory"), std::string::npos);
+
+    // Two requests in one write on the same connection, answered in order.
+    send_all(fd, "POST /two HTTP/1.1\r\nContent-Length: 4\r\n\r\nabcdHEAD /three HTTP/1.1\r\n\r\n");
+    std::string r2 = read_response(fd, buffer);
+    EXPECT_NE(r2.find("POST /two 4 memory abcd"), std::string::npos) << r2;
+    // HEAD: headers only (Content-Length of the GET body), nothing after them.
+    std::size_t header_end = buffer.find("\r\n\r\n");
+    while (header_end == std::string::npos) {
+        char chunk[1024];
+        ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+        ASSERT_GT(n, 0);
+        buffer.append(chunk, static_cast<std::size_t>(n));
+        header_end = buffer.find("\r\n\r\n");
+    }
+    EXPECT_EQ(buffer.rfind("HTTP/1.1 200 OK\r\n", 0), 0u);
+    EXPECT_EQ(buffer.size(), header_end + 4);
+
+    ::close(fd);
+    auto stats = server.stats();
+    EXPECT_EQ(stats.accepted, 1u);
+    EXPECT_EQ(stats.requests, 3u);
+    server.stop();
+}
+
+TEST(EpollHttpServerTest, SpoolsLargeBodiesAndAnswersExpectContinue) {
+    EpollHttpServer::Options options = test_options();
+    options.body_spool_threshold = 1024;
+    EpollHttpServer server(options, echo_handler);
+    server.start();
+
+    int fd = connect_to(server.port());
+    ASSERT_GE(fd, 0);
+    std::string buffer;
+    const std::string body(200000, 'z');
+    send_all(fd, "PUT /big HTTP/1.1\r\nExpect: 100-continue\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n");
+    std::string interim = read_response(fd, buffer);
+    EXPECT_EQ(interim, "HTTP/1.1 100 Continue\r\n\r\n");
+    send_all(fd, body);
+    std::string r = read_response(fd, buffer);
+    EXPECT_NE(r.find("PUT /big 200000 spooled zzzzzzzz"), std::string::npos) << r;
+    ::close(fd);
+    server.stop();
+}
+
+TEST(EpollHttpServerTest, ClosesAfterBadRequestAndConnectionClose) {
+    EpollHttpServer server(test_options(), echo_handler);
+    server.start();
+
+    int fd = connect_to(server.port());
+    ASSERT_GE(fd, 0);
+    std::string buffer;
+    send_all(fd, "GARBAGE\r\n\r\n");
+    std::string r = read_response(fd, buffer);
+    EXPECT_EQ(r.rfind("HTTP/1.1 400 Bad Request\r\n", 0), 0u) << r;
+    EXPECT_NE(r.find("Connection: close"), std::string::npos);
+    char c;
+    EXPECT_EQ(::recv(fd, &c, 1, 0), 0); // server closed
+    ::close(fd);
+
+    fd = connect_to(server.port());
+    ASSERT_GE(fd, 0);
+    buffer.clear();
+    send_all(fd, "GET /bye HTTP/1.1\r\nConnection: close\r\n\r\n");
+    r = read_response(fd, buffer);
+    EXPECT_NE(r.find("Connection: close"), std::string::npos);
+    EXPECT_EQ(::recv(fd, &c, 1, 0), 0);
+    ::close(fd);
+
+    EXPECT_EQ(server.stats().parse_errors, 1u);
+    server.stop();
+}
+
+TEST(EpollHttpServerTest, DeferredResponsesDoNotHoldHandlerThreads) {
+    EpollHttpServer::Options options = test_options();
+    options.handler_threads = 1;
+    std::mutex mutex;
+    std::vector<std::shared_ptr<EpollHttpServer::Responder>> parked;
+    EpollHttpServer server(options, [&](EpollHttpServer::Request& req, EpollHttpServer::Response& res) {
+        if (req.head.uri == "/park") {
+            std::lock_guard<std::mutex> lock(mutex);
+            parked.push_back(req.defer());
+            return;
+        }
+        echo_handler(req, res);
+    });
+    server.start();
+
+    // Ba request nằm chờ, request thứ tư vẫn được trả lời bởi handler thread duy nhất
+    int parked_fds[3];
+    for (int& fd : parked_fds) {
+        fd = connect_to(server.port());
+        ASSERT_GE(fd, 0);
+        send_all(fd, "GET /park HTTP/1.1\r\n\r\n");
+    }
+    int fd = connect_to(server.port());
+    ASSERT_GE(fd, 0);
+    std::string buffer;
+    send_all(fd, "GET /now HTTP/1.1\r\n\r\n");
+    EXPECT_NE(read_response(fd, buffer).find("GET /now 0 memory"), std::string::npos);
+    ::close(fd);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ASSERT_EQ(parked.size(), 3u);
+    }
+
+    // Trả lời từ thread khác; complete lần hai bị bỏ qua; Responder bị bỏ đi mà chưa complete -> 500
+    std::thread([&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (std::size_t i = 0; i < 2; ++i) {
+            EpollHttpServer::Response res;
+            res.body = "late";
+            parked[i]->complete(res);
+            res.body = "again";
+            parked[i]->complete(res);
+        }
+        parked.clear();
+    }).join();
+
+    // Thứ tự parked theo lúc handler chạy, không nhất thiết theo thứ tự kết nối
+    int ok = 0, failed = 0;
+    for (int parked_fd : parked_fds) {
+        std::string b;
+        std::string r = read_response(parked_fd, b);
+        if (r.rfind("HTTP/1.1 200 OK\r\n", 0) == 0 && r.find("late") != std::string::npos) ++ok;
+        if (r.rfind("HTTP/1.1 500", 0) == 0) ++failed;
+        // Kết nối vẫn keep-alive sau response trả chậm
+        send_all(parked_fd, "GET /after HTTP/1.1\r\n\r\n");
+        EXPECT_NE(read_response(parked_fd, b).find("GET /after"), std::string::npos);
+        ::close(parked_fd);
+    }
+    EXPECT_EQ(ok, 2);
+    EXPECT_EQ(failed, 1);
+    server.stop();
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,192 @@
+#include <gtest/gtest.h>
+#include "file_manager.hpp"
+#include "access_control.hpp"
+#include "user_manager.hpp"
+#include "fastcdc.hpp"
+#include "db.hpp"
+#include "config.hpp"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+class FileBatchTest : public ::testing::Test {
+protected:
+    std::string test_db_path = "test_file_batch.db";
+    fs::path data_root;
+    fs::path home;
+    fs::path trash;
+    std::string saved_user_root;
+    std::string saved_trash_dir;
+    Database* db = nullptr;
+    FileManager* fm = nullptr;
+
+    void SetUp() override {
+        fs::remove(test_db_path);
+        data_root = fs::absolute("test_file_batch_data");
+        fs::remove_all(data_root);
+        home = fs::weakly_canonical(data_root) / "alice";
+        fs::create_directories(home);
+
+        trash = fs::absolute("test_file_batch_trash");
+        fs::remove_all(trash);
+
+        saved_user_root = Config::USER_DATA_ROOT;
+        saved_trash_dir = Config::STORAGE_BATCH_TRASH_DIR;
+        Config::USER_DATA_ROOT = data_root.string();
+        Config::STORAGE_BATCH_TRASH_DIR = trash.string();
+        db = new Database(test_db_path);
+        ASSERT_TRUE(db->initialize_schema());
+        fm = new FileManager(*db);
+    }
+
+    void TearDown() override {
+        delete fm;
+        delete db;
+        Config::USER_DATA_ROOT = saved_user_root;
+        Config::STORAGE_BATCH_TRASH_DIR = saved_trash_dir;
+        fs::remove(test_db_path);
+        fs::remove_all(data_root);
+        fs::remove_all(trash);
+    }
+
+    bool upload(const std::string& path, const std::string& content) {
+        return fm->upload_file(home, path, std::vector<char>(content.begin(), content.end()));
+    }
+
+    std::string read(const std::string& path) {
+        std::ifstream in(home / path, std::ios::binary);
+        std::ostringstream out;
+        out << in.rdbuf();
+        return out.str();
+    }
+
+    std::string home_hash() { return fm->tree_hashes().directory_hash(home.string()); }
+
+    std::string recomputed_home_hash() {
+        db->execute("DELETE FROM directory_hashes;");
+        return home_hash();
+    }
+
+    static bool allow_all(const fs::path&) { return true; }
+};
+
+TEST_F(FileBatchTest, NonAtomicBatchSkipsFailedOperations) {
+    ASSERT_TRUE(upload("a/x.txt", "x"));
+    ASSERT_TRUE(upload("old.txt", "o"));
+
+    const std::vector<MetadataOp> ops = {
+        {MetadataOpType::MKDIR, "new/deep", ""},
+        {MetadataOpType::RENAME, "a/x.txt", "new/deep/x.txt"},
+        {MetadataOpType::DELETE, "missing.txt", ""},
+        {MetadataOpType::RENAME, "old.txt", "../escape.txt"},
+        {MetadataOpType::DELETE, "old.txt", ""},
+    };
+    const auto results = fm->apply_metadata_batch(home, ops, false, allow_all);
+    EXPECT_EQ(results, (std::vector<MetadataOpResult>{MetadataOpResult::OK, MetadataOpResult::OK, MetadataOpResult::NOT_FOUND,
+                                                      MetadataOpResult::INVALID_PATH, MetadataOpResult::OK}));
+
+    EXPECT_EQ(read("new/deep/x.txt"), "x");
+    EXPECT_FALSE(fs::exists(home / "a/x.txt"));
+    EXPECT_FALSE(fs::exists(home / "old.txt"));
+    EXPECT_EQ(std::vector<fs::path>(fs::directory_iterator(data_root), fs::directory_iterator()),
+              std::vector<fs::path>{home}); // Không staging gì cạnh các home
+    EXPECT_TRUE(fs::is_directory(trash));
+    EXPECT_TRUE(fs::is_empty(trash));
+    EXPECT_EQ(home_hash(), recomputed_home_hash());
+}
+
+TEST_F(FileBatchTest, AtomicBatchFailureLeavesTreeUnchanged) {
+    ASSERT_TRUE(upload("a/x.txt", "x"));
+    ASSERT_TRUE(upload("keep.txt", "k"));
+    const std::string before = home_hash();
+
+    const std::vector<MetadataOp> ops = {
+        {MetadataOpType::MKDIR, "made", ""},
+        {MetadataOpType::RENAME, "a/x.txt", "made/x.txt"},
+        {MetadataOpType::DELETE, "keep.txt", ""},
+        {MetadataOpType::RENAME, "made", "a"}, // Đích đã tồn tại
+        {MetadataOpType::MKDIR, "later", ""},
+    };
+    const auto results = fm->apply_metadata_batch(home, ops, true, allow_all);
+    EXPECT_EQ(results, (std::vector<MetadataOpResult>{MetadataOpResult::NOT_APPLIED, MetadataOpResult::NOT_APPLIED,
+                                                      MetadataOpResult::NOT_APPLIED, MetadataOpResult::CONFLICT,
+                                                      MetadataOpResult::NOT_APPLIED}));
+
+    EXPECT_EQ(read("a/x.txt"), "x");
+    EXPECT_EQ(read("keep.txt"), "k");
+    EXPECT_FALSE(fs::exists(home / "made"));
+    EXPECT_FALSE(fs::exists(home / "later"));
+    EXPECT_EQ(home_hash(), before);
+    EXPECT_EQ(recomputed_home_hash(), before);
+}
+
+TEST_F(FileBatchTest, AtomicRollbackKeepsWritesCommittedByAnotherThread) {
+    ChunkStore store(*db, data_root / "chunks");
+    UserManager users(*db);
+    AccessControlManager acl(*db, users);
+    ASSERT_TRUE(db->execute("INSERT INTO users (id, username, password_hash, home_dir) VALUES (7, 'bob', 'x', '/bob');"));
+    ASSERT_TRUE(db->execute("INSERT INTO shared_storage (storage_name, storage_path) VALUES ('team', '/shared/team');"));
+    const std::string data = "chunk uploaded by another client";
+    const auto* chunk = reinterpret_cast<const unsigned char*>(data.data());
+    const std::string hash = FastCdc::chunk_hash(chunk, data.size());
+    ASSERT_TRUE(store.put_chunk(hash, chunk, data.size(), 1));
+    ChunkRecipe recipe;
+    recipe.checksum = "other";
+    recipe.chunks = {{hash, 0}};
+    ASSERT_TRUE(store.complete_recipe(recipe, 1));
+
+    // Thread khác commit recipe và quyền trong lúc batch đang mở transaction trên cùng connection
+    std::thread other;
+    auto can_write = [&](const fs::path&) {
+        if (!other.joinable()) {
+            other = std::thread([&]() {
+                EXPECT_TRUE(acl.grant_shared_storage_access(7, "team", PermissionLevel::READ));
+                EXPECT_TRUE(store.put_recipe("/other/file", recipe));
+            });
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+        return true;
+    };
+    const std::vector<MetadataOp> ops = {
+        {MetadataOpType::MKDIR, "made", ""},
+        {MetadataOpType::DELETE, "missing.txt", ""},
+    };
+    const auto results = fm->apply_metadata_batch(home, ops, true, can_write);
+    ASSERT_TRUE(other.joinable());
+    other.join();
+    EXPECT_EQ(results, (std::vector<MetadataOpResult>{MetadataOpResult::NOT_APPLIED, MetadataOpResult::NOT_FOUND}));
+    EXPECT_FALSE(fs::exists(home / "made"));
+
+    // ROLLBACK của batch chỉ huỷ phần của batch
+    auto stored = store.recipe("/other/file");
+    ASSERT_TRUE(stored);
+    EXPECT_EQ(stored->checksum, "other");
+    EXPECT_EQ(db->execute_scalar("SELECT access FROM shared_access WHERE user_id = 7;"), std::optional<std::string>("r"));
+}
+
+TEST_F(FileBatchTest, ForbiddenOperationIsReported) {
+    ASSERT_TRUE(upload("locked/x.txt", "x"));
+    const fs::path locked = home / "locked";
+    auto can_write = [&](const fs::path& path) { return path != locked && path.parent_path() != locked; };
+
+    const std::vector<MetadataOp> ops = {
+        {MetadataOpType::DELETE, "locked/x.txt", ""},
+        {MetadataOpType::MKDIR, "open", ""},
+    };
+    const auto results = fm->apply_metadata_batch(home, ops, false, can_write);
+    EXPECT_EQ(results, (std::vector<MetadataOpResult>{MetadataOpResult::FORBIDDEN, MetadataOpResult::OK}));
+    EXPECT_TRUE(fs::exists(home / "locked/x.txt"));
+    EXPECT_TRUE(fs::is_directory(home / "open"));
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,238 @@
+#include <gtest/gtest.h>
+#include "manifest_codec.hpp"
+#include "protocol.hpp"
+
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace {
+    const std::string kChecksum = "9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08";
+
+    json manifest_of(const std::vector<ManifestEntry>& entries, ManifestFormat format) {
+        json files = json::array();
+        for (const auto& e : entries) files.push_back(encode_manifest_entry(e, format));
+        return {{JsonKeys::CLIENT_FILES, files}};
+    }
+
+    std::vector<ManifestEntry> read_body(const std::string& body, ManifestFormat format, ManifestLimits limits = {}) {
+        std::istringstream in(body);
+        std::vector<ManifestEntry> out;
+        read_manifest_stream(in, format, limits, [&](ManifestEntry&& e) { out.push_back(std::move(e)); });
+        return out;
+    }
+
+    std::vector<ManifestEntry> round_trip(const std::vector<ManifestEntry>& entries, ManifestFormat format) {
+        return read_body(serialize_manifest_body(manifest_of(entries, format), format), format);
+    }
+}
+
+TEST(ManifestCodecTest, NegotiatesFormatFromHeaders) {
+    EXPECT_EQ(manifest_format_from_content_type("application/cbor"), ManifestFormat::CBOR);
+    EXPECT_EQ(manifest_format_from_content_type("Application/MsgPack; foo=bar"), ManifestFormat::MSGPACK);
+    EXPECT_EQ(manifest_format_from_content_type("application/json; charset=utf-8"), ManifestFormat::JSON);
+    EXPECT_EQ(manifest_format_from_content_type(""), ManifestFormat::JSON);
+
+    EXPECT_EQ(negotiate_manifest_format(""), ManifestFormat::JSON);
+    EXPECT_EQ(negotiate_manifest_format("*/*"), ManifestFormat::JSON);
+    EXPECT_EQ(negotiate_manifest_format("application/msgpack, application/json;q=0.5"), ManifestFormat::MSGPACK);
+    EXPECT_EQ(negotiate_manifest_format("application/cbor;q=0.8, application/msgpack;q=0.9"), ManifestFormat::MSGPACK);
+    EXPECT_EQ(negotiate_manifest_format("application/json, application/cbor;q=0.5"), ManifestFormat::JSON);
+    EXPECT_EQ(negotiate_manifest_format("application/cbor;q=0"), ManifestFormat::JSON);
+
+    EXPECT_TRUE(accepts_plan_stream("application/x-ndjson, application/msgpack"));
+    EXPECT_TRUE(accepts_plan_stream("application/json;q=0.5, Application/X-NDJSON;q=0.9"));
+    EXPECT_FALSE(accepts_plan_stream("application/x-ndjson;q=0"));
+    EXPECT_FALSE(accepts_plan_stream("*/*"));
+}
+
+TEST(ManifestCodecTest, CompactFormatsRoundTripEntries) {
+    const std::vector<ManifestEntry> entries = {
+        {"docs/report.txt", 1700000000, kChecksum, false, false, std::uint64_t{5} << 30},
+        {"docs", 1690000000, "", true, false},
+        {"old/removed.bin", 0, "", false, true},
+    };
+    for (ManifestFormat format : {ManifestFormat::JSON, ManifestFormat::CBOR, ManifestFormat::MSGPACK}) {
+        auto decoded = round_trip(entries, format);
+        ASSERT_EQ(decoded.size(), entries.size());
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            EXPECT_EQ(decoded[i].relative_path, entries[i].relative_path);
+            EXPECT_EQ(decoded[i].last_modified, entries[i].last_modified);
+            EXPECT_EQ(decoded[i].checksum, entries[i].checksum);
+            EXPECT_EQ(decoded[i].is_directory, entries[i].is_directory);
+            EXPECT_EQ(decoded[i].is_deleted, entries[i].is_deleted);
+            EXPECT_EQ(decoded[i].size, entries[i].size);
+        }
+    }
+
+    // Checksum đi dưới dạng 32 byte thô, không phải 64 ký tự hex
+    json compact = encode_manifest_entry(entries[0], ManifestFormat::MSGPACK);
+    ASSERT_TRUE(compact[2].is_binary());
+    EXPECT_EQ(compact[2].get_binary().size(), CompactManifest::CHECKSUM_BYTES);
+    EXPECT_LT(serialize_manifest_body(manifest_of(entries, ManifestFormat::MSGPACK), ManifestFormat::MSGPACK).size() * 2,
+              manifest_of(entries, ManifestFormat::JSON).dump().size());
+}
+
+TEST(ManifestCodecTest, RejectsMalformedManifests) {
+    auto decode = [](const json& files) {
+        json payload = {{JsonKeys::CLIENT_FILES, files}};
+        read_body(serialize_manifest_body(payload, ManifestFormat::CBOR), ManifestFormat::CBOR);
+    };
+    EXPECT_THROW(decode(json::array({json::array({"a.txt", 1})})), ManifestMalformed);
+    EXPECT_THROW(decode(json::array({json::array({"a.txt", 1, 42, 0})})), ManifestMalformed);
+    EXPECT_THROW(decode(json::array({json::array({"a.txt", 1, json::binary({1, 2, 3}), 0})})), ManifestMalformed);
+    EXPECT_THROW(decode(json::array({"a.txt"})), ManifestMalformed);
+    EXPECT_THROW(decode(json::array({{{JsonKeys::IS_DIRECTORY, "yes"}}})), ManifestMalformed);
+    EXPECT_THROW(read_body("{}", ManifestFormat::JSON), ManifestMalformed);
+    EXPECT_THROW(read_body("[]", ManifestFormat::JSON), ManifestMalformed);
+    EXPECT_THROW(read_body(R"({"client_files": {}})", ManifestFormat::JSON), ManifestMalformed);
+    EXPECT_THROW(read_body(R"({"client_files": [{"relative_path": "a")", ManifestFormat::JSON), ManifestMalformed);
+    EXPECT_THROW(read_body(std::string("\xff\x00\x01", 3), ManifestFormat::CBOR), ManifestMalformed);
+    EXPECT_THROW(checksum_to_wire("xyz"), std::invalid_argument);
+}
+
+TEST(ManifestCodecTest, StreamReaderSkipsUnknownFieldsAndKeepsJsonSemantics) {
+    const std::string body = R"({"device": {"name": "laptop", "tags": [1, [2]]},
+        "client_files": [
+            {"relative_path": "a.txt", "last_modified": 1700000000, "checksum": "abc", "extra": {"x": [1]}},
+            {"relative_path": "", "is_directory": true},
+            {"relative_path": "gone.txt", "is_deleted": true},
+            ["b.bin", 5, null, 1, "future field"]
+        ],
+        "client_version": 3})";
+    auto entries = read_body(body, ManifestFormat::JSON);
+    ASSERT_EQ(entries.size(), 3u); // entry không có relative_path bị bỏ như trước
+    EXPECT_EQ(entries[0].relative_path, "a.txt");
+    EXPECT_EQ(entries[0].last_modified, 1700000000);
+    EXPECT_EQ(entries[0].checksum, "abc");
+    EXPECT_TRUE(entries[1].is_deleted);
+    EXPECT_EQ(entries[1].last_modified, 0);
+    EXPECT_EQ(entries[2].relative_path, "b.bin");
+    EXPECT_TRUE(entries[2].is_directory);
+    EXPECT_TRUE(entries[2].checksum.empty());
+}
+
+TEST(ManifestCodecTest, StreamReaderEnforcesLimits) {
+    std::vector<ManifestEntry> entries;
+    for (int i = 0; i < 100; ++i) entries.push_back({"dir/file_" + std::to_string(i), 1700000000 + i, kChecksum, false, false});
+
+    for (ManifestFormat format : {ManifestFormat::JSON, ManifestFormat::MSGPACK}) {
+        const std::string body = serialize_manifest_body(manifest_of(entries, format), format);
+        ManifestLimits limits;
+        limits.max_entries = 100;
+        limits.max_bytes = body.size();
+        EXPECT_EQ(read_body(body, format, limits).size(), 100u);
+
+        limits.max_entries = 99;
+        EXPECT_THROW(read_body(body, format, limits), ManifestTooLarge);
+
+        limits.max_entries = 0;
+        limits.max_bytes = body.size() - 1;
+        EXPECT_THROW(read_body(body, format, limits), ManifestTooLarge);
+    }
+
+    // Binary formats know the entry count up front: reserve once, reject before reading entries.
+    const std::string packed = serialize_manifest_body(manifest_of(entries, ManifestFormat::MSGPACK), ManifestFormat::MSGPACK);
+    std::size_t reserved = 0;
+    int visited = 0;
+    std::istringstream in(packed);
+    read_manifest_stream(in, ManifestFormat::MSGPACK, {}, [&](ManifestEntry&&) { ++visited; },
+                         [&](std::size_t n) { reserved = n; });
+    EXPECT_EQ(reserved, 100u);
+    EXPECT_EQ(visited, 100);
+
+    visited = 0;
+    std::istringstream again(packed);
+    ManifestLimits limits;
+    limits.max_entries = 10;
+    EXPECT_THROW(read_manifest_stream(again, ManifestFormat::MSGPACK, limits, [&](ManifestEntry&&) { ++visited; }), ManifestTooLarge);
+    EXPECT_EQ(visited, 0);
+}
+
+TEST(ManifestCodecTest, StreamReaderReportsScopeWhenAsked) {
+    json payload = manifest_of({{"docs/a.txt", 1, kChecksum, false, false}}, ManifestFormat::CBOR);
+    payload[JsonKeys::SCOPE] = json::array({"", "docs"});
+    const std::string body = serialize_manifest_body(payload, ManifestFormat::CBOR);
+
+    std::vector<std::string> scope;
+    int visited = 0;
+    std::istringstream in(body);
+    read_manifest_stream(in, ManifestFormat::CBOR, {}, [&](ManifestEntry&&) { ++visited; }, nullptr,
+                         [&](std::string&& dir) { scope.push_back(std::move(dir)); });
+    EXPECT_EQ(visited, 1);
+    EXPECT_EQ(scope, (std::vector<std::string>{"", "docs"}));
+    EXPECT_EQ(read_body(body, ManifestFormat::CBOR).size(), 1u); // Không hỏi scope: bỏ qua như key lạ
+
+    auto read_scope = [](const std::string& json_body, ManifestLimits limits = {}) {
+        std::istringstream stream(json_body);
+        read_manifest_stream(stream, ManifestFormat::JSON, limits, [](ManifestEntry&&) {}, nullptr, [](std::string&&) {});
+    };
+    EXPECT_THROW(read_scope(R"({"scope": "docs", "client_files": []})"), ManifestMalformed);
+    EXPECT_THROW(read_scope(R"({"scope": [1], "client_files": []})"), ManifestMalformed);
+    EXPECT_THROW(read_scope(R"({"scope": [["a"]], "client_files": []})"), ManifestMalformed);
+    ManifestLimits limits;
+    limits.max_entries = 1;
+    EXPECT_THROW(read_scope(R"({"scope": ["a", "b"], "client_files": []})", limits), ManifestTooLarge);
+}
+
+TEST(ManifestCodecTest, EncodesOperationsAsCodesOrNames) {
+    EXPECT_EQ(encode_sync_operation(2, "a.txt", ManifestFormat::CBOR), json::array({2, "a.txt"}));
+    json op = encode_sync_operation(2, "a.txt", ManifestFormat::JSON);
+    EXPECT_EQ(op[JsonKeys::SYNC_ACTION_TYPE], "DOWNLOAD_TO_CLIENT");
+    EXPECT_EQ(op[JsonKeys::RELATIVE_PATH], "a.txt");
+    EXPECT_EQ(encode_sync_operation(99, "a.txt", ManifestFormat::JSON)[JsonKeys::SYNC_ACTION_TYPE], "UNKNOWN_SYNC_ACTION");
+    EXPECT_FALSE(op.contains(JsonKeys::SIZE));
+    EXPECT_EQ(encode_sync_operation(2, "a.txt", ManifestFormat::JSON, "", 42)[JsonKeys::SIZE], 42);
+
+    json listed = encode_listing_entry("a.txt", "docs/a.txt", false, 12, 1700000000, ManifestFormat::MSGPACK);
+    EXPECT_EQ(listed, json::array({"a.txt", "docs/a.txt", false, 12, 1700000000}));
+}
+
+TEST(ManifestCodecTest, ResponseWriterStreamsEveryFormat) {
+    for (std::size_t count : {std::size_t(0), std::size_t(3), std::size_t(70000)}) {
+        json expected_ops = json::array();
+        for (std::size_t i = 0; i < count; ++i) expected_ops.push_back(json::array({static_cast<int>(i % 8), "p/" + std::to_string(i)}));
+        const json expected = {{JsonKeys::STATUS, "success"}, {JsonKeys::SYNC_OPERATIONS, expected_ops}};
+
+        for (ManifestFormat format : {ManifestFormat::JSON, ManifestFormat::CBOR, ManifestFormat::MSGPACK}) {
+            std::ostringstream out;
+            ManifestResponseWriter writer(out, format, 2);
+            writer.field(JsonKeys::STATUS, "success");
+            writer.begin_array(JsonKeys::SYNC_OPERATIONS, count);
+            for (const auto& op : expected_ops) writer.element(op);
+            writer.end_array();
+            writer.finish();
+
+            const std::string body = out.str();
+            json parsed = format == ManifestFormat::CBOR ? json::from_cbor(body)
+                        : format == ManifestFormat::MSGPACK ? json::from_msgpack(body)
+                        : json::parse(body);
+            EXPECT_EQ(parsed, expected) << manifest_format_content_type(format) << " count=" << count;
+            if (format != ManifestFormat::JSON) {
+                EXPECT_EQ(body, serialize_manifest_body(expected, format));
+            }
+        }
+    }
+}
+
+TEST(ManifestCodecTest, ResponseWriterRejectsWrongCounts) {
+    std::ostringstream out;
+    ManifestResponseWriter writer(out, ManifestFormat::MSGPACK, 1);
+    writer.begin_array(JsonKeys::LISTING, 1);
+    writer.element(json::array({"a"}));
+    EXPECT_THROW(writer.element(json::array({"b"})), std::logic_error);
+    writer.end_array();
+    EXPECT_THROW(writer.field(JsonKeys::STATUS, "extra"), std::logic_error);
+
+    ManifestResponseWriter short_writer(out, ManifestFormat::CBOR, 2);
+    short_writer.begin_array(JsonKeys::LISTING, 2);
+    short_writer.element(1);
+    EXPECT_THROW(short_writer.end_array(), std::logic_error);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
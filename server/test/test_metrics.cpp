@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+#include "metrics.hpp"
+
+TEST(MetricsTest, HistogramBucketsCoverEveryValue) {
+    for (std::uint64_t v : {0ULL, 1ULL, 2ULL, 3ULL, 4ULL, 5ULL, 6ULL, 7ULL, 8ULL, 1000ULL, 123456789ULL}) {
+        std::size_t i = Histogram::bucket_index(v);
+        EXPECT_LE(v, Histogram::bucket_upper_bound(i)) << v;
+        if (i > 0) {
+            EXPECT_GT(v, Histogram::bucket_upper_bound(i - 1)) << v;
+        }
+    }
+    // Bucket bounds are strictly increasing.
+    for (std::size_t i = 1; i < Histogram::kBucketCount; ++i) {
+        EXPECT_GT(Histogram::bucket_upper_bound(i), Histogram::bucket_upper_bound(i - 1));
+    }
+    EXPECT_EQ(Histogram::bucket_index(std::uint64_t(1) << 50), Histogram::kBucketCount - 1);
+}
+
+TEST(MetricsTest, SameNameAndLabelsReturnSameMetric) {
+    MetricsRegistry registry;
+    Counter& a = registry.counter("test_requests_total", "Requests.", {{"route", "login"}});
+    Counter& b = registry.counter("test_requests_total", "Requests.", {{"route", "login"}});
+    Counter& c = registry.counter("test_requests_total", "Requests.", {{"route", "upload"}});
+    EXPECT_EQ(&a, &b);
+    EXPECT_NE(&a, &c);
+    EXPECT_THROW(registry.gauge("test_requests_total", "Wrong type."), std::invalid_argument);
+}
+
+TEST(MetricsTest, RendersPrometheusText) {
+    MetricsRegistry registry;
+    registry.counter("test_requests_total", "Requests.", {{"route", "login"}}).inc(3);
+    Histogram& h = registry.histogram("test_latency_seconds", "Latency.", {{"route", "login"}});
+    h.record(100);   // 100 us
+    h.record(2000);  // 2 ms
+    int sessions = 7;
+    registry.gauge_callback("test_sessions", "Sessions.", {}, [&sessions]() { return sessions; });
+
+    std::string text = registry.render_prometheus();
+    EXPECT_NE(text.find("# TYPE test_requests_total counter\n"), std::string::npos);
+    EXPECT_NE(text.find("test_requests_total{route=\"login\"} 3\n"), std::string::npos);
+    EXPECT_NE(text.find("# TYPE test_latency_seconds histogram\n"), std::string::npos);
+    EXPECT_NE(text.find("test_latency_seconds_bucket{route=\"login\",le=\"+Inf\"} 2\n"), std::string::npos);
+    EXPECT_NE(text.find("test_latency_seconds_count{route=\"login\"} 2\n"), std::string::npos);
+    EXPECT_NE(text.find("test_latency_seconds_sum{route=\"login\"} 0.0021\n"), std::string::npos);
+    EXPECT_NE(text.find("test_sessions 7\n"), std::string::npos);
+
+    sessions = 9;
+    EXPECT_NE(registry.render_prometheus().find("test_sessions 9\n"), std::string::npos);
+    registry.remove_callbacks("test_sessions");
+    EXPECT_EQ(registry.render_prometheus().find("test_sessions"), std::string::npos);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
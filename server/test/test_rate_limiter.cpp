@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+#include "rate_limiter.hpp"
+
+#include <chrono>
+
+using namespace std::chrono_literals;
+
+TEST(RateLimiterTest, BurstThenRefill) {
+    RateLimiter limiter(10, 5); // 10/s, bucket of 5
+    auto t0 = RateLimiter::Clock::now();
+
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_TRUE(limiter.acquire("u1", 1, t0).allowed) << "request " << i;
+    }
+    auto denied = limiter.acquire("u1", 1, t0);
+    EXPECT_FALSE(denied.allowed);
+    EXPECT_GT(denied.retry_after.count(), 0);
+    EXPECT_LE(denied.retry_after, std::chrono::nanoseconds(100ms));
+
+    // Another key has its own bucket.
+    EXPECT_TRUE(limiter.acquire("u2", 1, t0).allowed);
+
+    // One token back after 100 ms.
+    EXPECT_TRUE(limiter.acquire("u1", 1, t0 + 100ms).allowed);
+    EXPECT_FALSE(limiter.acquire("u1", 1, t0 + 100ms).allowed);
+}
+
+TEST(RateLimiterTest, ChargeAfterTheFactCreatesDebt) {
+    RateLimiter limiter(1000, 1000); // 1000 bytes/s, 1000-byte burst
+    auto t0 = RateLimiter::Clock::now();
+
+    EXPECT_TRUE(limiter.check("u1", t0).allowed);
+    limiter.charge("u1", 3000, t0); // a download much larger than the burst
+
+    auto denied = limiter.check("u1", t0);
+    EXPECT_FALSE(denied.allowed);
+    EXPECT_GE(denied.retry_after, std::chrono::nanoseconds(1900ms));
+    EXPECT_TRUE(limiter.check("u1", t0 + 2s).allowed);
+}
+
+TEST(RateLimiterTest, ZeroRateDisables) {
+    RateLimiter limiter(0, 0);
+    EXPECT_FALSE(limiter.enabled());
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_TRUE(limiter.acquire("u1").allowed);
+    }
+    EXPECT_EQ(limiter.tracked_keys(), 0u);
+}
+
+TEST(AdmissionControlTest, CountsRejections) {
+    AdmissionControl admission(AdmissionControl::Limits{1, 2, 0, 0, 1, 1});
+    EXPECT_TRUE(admission.admit_user_request(7).allowed);
+    EXPECT_TRUE(admission.admit_user_request(7).allowed);
+    EXPECT_FALSE(admission.admit_user_request(7).allowed);
+    EXPECT_TRUE(admission.admit_user_transfer(7).allowed); // bytes unlimited
+    EXPECT_TRUE(admission.admit_ip_request("10.0.0.1").allowed);
+    EXPECT_FALSE(admission.admit_ip_request("10.0.0.1").allowed);
+
+    AdmissionControl::Stats st = admission.stats();
+    EXPECT_EQ(st.rejected_user_requests, 1u);
+    EXPECT_EQ(st.rejected_user_bytes, 0u);
+    EXPECT_EQ(st.rejected_ip_requests, 1u);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
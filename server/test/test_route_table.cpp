@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include "route_table.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+    std::vector<RouteSpec> sample_routes() {
+        return {
+            {HttpMethod::POST,   "/api/v1/users/login",    0, "users_login",    false, RouteCost::REQUEST,        1024},
+            {HttpMethod::GET,    "/api/v1/users/me",       1, "users_me",       true,  RouteCost::REQUEST,        1024},
+            {HttpMethod::POST,   "/api/v1/files/upload",   2, "files_upload",   true,  RouteCost::UPLOAD_BYTES,   0},
+            {HttpMethod::GET,    "/api/v1/files/download", 3, "files_download", true,  RouteCost::DOWNLOAD_BYTES, 1024},
+            {HttpMethod::DELETE, "/api/v1/files/delete",   4, "files_delete",   true,  RouteCost::REQUEST,        1024},
+            {HttpMethod::GET,    "/api/v1/files/delete",   5, "files_stat",     true,  RouteCost::REQUEST,        1024},
+        };
+    }
+}
+
+TEST(RouteTableTest, FindsEveryRoute) {
+    RouteTable table(sample_routes());
+    for (const auto& r : sample_routes()) {
+        const RouteSpec* found = table.find(r.method, r.path);
+        ASSERT_NE(found, nullptr) << r.name;
+        EXPECT_EQ(found->id, r.id);
+        EXPECT_EQ(found->name, r.name);
+    }
+    EXPECT_EQ(table.find(HttpMethod::POST, "/api/v1/files/upload")->cost, RouteCost::UPLOAD_BYTES);
+    EXPECT_FALSE(table.find(HttpMethod::POST, "/api/v1/users/login")->requires_auth);
+}
+
+TEST(RouteTableTest, RejectsUnknownMethodOrPath) {
+    RouteTable table(sample_routes());
+    EXPECT_EQ(table.find(HttpMethod::GET, "/api/v1/users/login"), nullptr);
+    EXPECT_EQ(table.find(HttpMethod::POST, "/api/v1/users/logi"), nullptr);
+    EXPECT_EQ(table.find(HttpMethod::POST, "/api/v1/users/login/"), nullptr);
+    EXPECT_EQ(table.find(HttpMethod::UNKNOWN, "/api/v1/users/me"), nullptr);
+    EXPECT_EQ(table.find(HttpMethod::GET, ""), nullptr);
+}
+
+TEST(RouteTableTest, RejectsDuplicatesAndSparseIds) {
+    auto dup = sample_routes();
+    dup.push_back({HttpMethod::GET, "/api/v1/users/me", 6, "again", true, RouteCost::REQUEST, 0});
+    EXPECT_THROW(RouteTable{dup}, std::invalid_argument);
+
+    auto sparse = sample_routes();
+    sparse.back().id = 42;
+    EXPECT_THROW(RouteTable{sparse}, std::invalid_argument);
+}
+
+TEST(RouteTableTest, MethodAndPathParsing) {
+    EXPECT_EQ(parse_http_method("GET"), HttpMethod::GET);
+    EXPECT_EQ(parse_http_method("DELETE"), HttpMethod::DELETE);
+    EXPECT_EQ(parse_http_method("get"), HttpMethod::UNKNOWN);
+    EXPECT_EQ(RouteTable::path_of("/api/v1/files/list?path=a%20b"), "/api/v1/files/list");
+    EXPECT_EQ(RouteTable::path_of("/api/v1/files/list"), "/api/v1/files/list");
+    EXPECT_EQ(RouteTable::path_of("/x#frag"), "/x");
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
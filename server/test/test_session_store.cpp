@@ -0,0 +1,169 @@
+#include <gtest/gtest.h>
+#include "session_store.hpp"
+#include "session_persistence.hpp"
+#include "timing_wheel.hpp"
+#include "db.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+// --- TimingWheel ---
+
+TEST(TimingWheelTest, FiresAtDeadline) {
+    TimingWheel wheel(0);
+    wheel.schedule("a", 5);
+    wheel.schedule("b", 70);      // level 1
+    wheel.schedule("c", 5000);    // level 2
+
+    std::vector<std::string> fired;
+    auto collect = [&](const std::string& k) { fired.push_back(k); };
+
+    EXPECT_EQ(wheel.advance(4, collect), 0u);
+    EXPECT_EQ(wheel.advance(5, collect), 1u);
+    ASSERT_EQ(fired.size(), 1u);
+    EXPECT_EQ(fired[0], "a");
+
+    EXPECT_EQ(wheel.advance(69, collect), 0u);
+    EXPECT_EQ(wheel.advance(70, collect), 1u);
+    EXPECT_EQ(fired.back(), "b");
+
+    EXPECT_EQ(wheel.advance(4999, collect), 0u);
+    EXPECT_EQ(wheel.advance(5000, collect), 1u);
+    EXPECT_EQ(fired.back(), "c");
+    EXPECT_EQ(wheel.size(), 0u);
+}
+
+TEST(TimingWheelTest, PastDeadlineFiresOnNextTick) {
+    TimingWheel wheel(100);
+    wheel.schedule("late", 10);
+    std::vector<std::string> fired;
+    wheel.advance(101, [&](const std::string& k) { fired.push_back(k); });
+    ASSERT_EQ(fired.size(), 1u);
+    EXPECT_EQ(fired[0], "late");
+}
+
+TEST(TimingWheelTest, RearmFromCallback) {
+    TimingWheel wheel(0);
+    wheel.schedule("k", 3);
+    int fired = 0;
+    std::function<void(const std::string&)> cb = [&](const std::string& k) {
+        if (++fired == 1) wheel.schedule(k, 10);
+    };
+    wheel.advance(9, cb);
+    EXPECT_EQ(fired, 1);
+    wheel.advance(10, cb);
+    EXPECT_EQ(fired, 2);
+}
+
+// --- SessionStore ---
+
+TEST(SessionStoreTest, InsertTouchErase) {
+    SessionStore store(std::chrono::seconds(60));
+    store.insert("tok1", 1, "alice", "/data/users/alice");
+
+    auto s = store.touch("tok1");
+    ASSERT_TRUE(s.has_value());
+    EXPECT_EQ(s->user_id, 1);
+    EXPECT_EQ(s->username, "alice");
+    EXPECT_EQ(s->home_dir, "/data/users/alice");
+
+    EXPECT_FALSE(store.touch("unknown").has_value());
+
+    EXPECT_TRUE(store.erase("tok1"));
+    EXPECT_FALSE(store.erase("tok1"));
+    EXPECT_FALSE(store.touch("tok1").has_value());
+
+    SessionStore::Stats st = store.stats();
+    EXPECT_EQ(st.active, 0u);
+    EXPECT_EQ(st.created, 1u);
+    EXPECT_EQ(st.removed, 1u);
+}
+
+TEST(SessionStoreTest, IdleSessionExpires) {
+    SessionStore store(std::chrono::seconds(1));
+    store.insert("idle", 1, "alice", "/h/alice");
+    store.insert("busy", 2, "bob", "/h/bob");
+
+    // Keep "busy" alive while "idle" goes quiet.
+    for (int i = 0; i < 6; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(400));
+        EXPECT_TRUE(store.touch("busy").has_value());
+        store.sweep();
+    }
+    EXPECT_FALSE(store.touch("idle").has_value());
+    EXPECT_TRUE(store.touch("busy").has_value());
+
+    SessionStore::Stats st = store.stats();
+    EXPECT_EQ(st.active, 1u);
+    EXPECT_EQ(st.expired, 1u);
+}
+
+TEST(SessionStoreTest, ConcurrentTouch) {
+    SessionStore store(std::chrono::seconds(60));
+    for (int i = 0; i < 100; ++i) {
+        store.insert("t" + std::to_string(i), i, "u" + std::to_string(i), "/h");
+    }
+    std::vector<std::thread> threads;
+    std::atomic<int> hits{0};
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&]() {
+            for (int n = 0; n < 10000; ++n) {
+                if (store.touch("t" + std::to_string(n % 100))) hits.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+    EXPECT_EQ(hits.load(), 8 * 10000);
+}
+
+// --- SessionPersistence ---
+
+TEST(SessionPersistenceTest, SessionsSurviveRestart) {
+    const std::string db_path = "test_sessions.db";
+    std::filesystem::remove(db_path);
+    {
+        Database db(db_path);
+        ASSERT_TRUE(db.initialize_schema());
+        ASSERT_TRUE(db.execute("INSERT INTO users (id, username, password_hash, home_dir) VALUES (1, 'alice', 'x', 'data/users/alice');"));
+    }
+
+    std::string key;
+    {
+        SessionStore store(std::chrono::seconds(60));
+        TokenRevocationList revocations;
+        SessionPersistence persistence(db_path, store, revocations, std::chrono::seconds(60));
+        auto k = persistence.load_or_create_signing_key("local");
+        ASSERT_TRUE(k.has_value());
+        key = *k;
+
+        store.insert("jti-1", 1, "alice", "data/users/alice", 4102444800);
+        store.insert("jti-2", 1, "alice", "data/users/alice", 4102444800);
+        revocations.revoke("jti-old", 4102444800);
+        EXPECT_TRUE(persistence.flush());
+
+        store.erase("jti-2");
+        EXPECT_TRUE(persistence.flush());
+    }
+    {
+        SessionStore store(std::chrono::seconds(60));
+        TokenRevocationList revocations;
+        SessionPersistence persistence(db_path, store, revocations, std::chrono::seconds(60));
+        EXPECT_EQ(*persistence.load_or_create_signing_key("local"), key);
+        EXPECT_EQ(persistence.load(), 1u);
+
+        auto s = store.touch("jti-1");
+        ASSERT_TRUE(s.has_value());
+        EXPECT_EQ(s->username, "alice");
+        EXPECT_FALSE(store.touch("jti-2").has_value());
+        EXPECT_TRUE(revocations.is_revoked("jti-old"));
+    }
+    std::filesystem::remove(db_path);
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
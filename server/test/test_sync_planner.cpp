@@ -0,0 +1,234 @@
+#include <gtest/gtest.h>
+#include "sync_planner.hpp"
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+    const std::string kSumA(64, 'a');
+    const std::string kSumB(64, 'b');
+
+    std::vector<std::pair<SyncActionType, std::string>> flatten(const std::vector<SyncOperation>& ops) {
+        std::vector<std::pair<SyncActionType, std::string>> out;
+        for (const auto& op : ops) out.emplace_back(op.action, op.relative_path);
+        return out;
+    }
+}
+
+TEST(SyncPlannerTest, KeepsPlanningSemantics) {
+    SyncPlanManifest client;
+    client.add("same.txt", 100, kSumA, false, false);
+    client.add("newer_on_client.txt", 200, kSumA, false, false);
+    client.add("newer_on_server.txt", 100, kSumA, false, false);
+    client.add("conflict.txt", 100, kSumA, false, false);
+    client.add("client_only.txt", 100, kSumA, false, false);
+    client.add("deleted_on_client.txt", 0, "", false, true);
+    client.add("deleted_everywhere.txt", 0, "", false, true);
+    client.add("dir", 0, "", true, false);
+    client.add("client_dir", 0, "", true, false);
+    client.sort_by_path();
+
+    SyncPlanManifest server;
+    server.add("conflict.txt", 100, kSumB, false, false);
+    server.add("deleted_on_client.txt", 50, kSumA, false, false);
+    server.add("dir", 10, "", true, false);
+    server.add("newer_on_client.txt", 100, kSumB, false, false);
+    server.add("newer_on_server.txt", 300, kSumB, false, false);
+    server.add("same.txt", 999, kSumA, false, false);
+    server.add("server_only.txt", 100, kSumA, false, false);
+    ASSERT_TRUE(server.sorted()); // thêm theo thứ tự như ORDER BY: không cần sắp lại
+
+    const std::vector<std::pair<SyncActionType, std::string>> expected = {
+        {SyncActionType::UPLOAD_TO_SERVER, "client_dir"},
+        {SyncActionType::UPLOAD_TO_SERVER, "client_only.txt"},
+        {SyncActionType::CONFLICT_SERVER_WINS, "conflict.txt"},
+        {SyncActionType::NO_ACTION, "deleted_everywhere.txt"},
+        {SyncActionType::DELETE_ON_SERVER, "deleted_on_client.txt"},
+        {SyncActionType::NO_ACTION, "dir"},
+        {SyncActionType::UPLOAD_TO_SERVER, "newer_on_client.txt"},
+        {SyncActionType::DOWNLOAD_TO_CLIENT, "newer_on_server.txt"},
+        {SyncActionType::NO_ACTION, "same.txt"},
+        {SyncActionType::DOWNLOAD_TO_CLIENT, "server_only.txt"},
+    };
+    EXPECT_EQ(flatten(plan_sync_operations(client, server)), expected);
+}
+
+TEST(SyncPlannerTest, NormalizesAndDeduplicatesPaths) {
+    SyncPlanManifest client;
+    client.add("./docs//a.txt", 1, kSumA, false, false);
+    client.add("docs/", 1, "", true, false);
+    client.add("docs/a.txt", 2, kSumB, false, false); // trùng path: entry sau thắng
+    EXPECT_FALSE(client.sorted());
+    client.sort_by_path();
+    ASSERT_EQ(client.size(), 2u);
+    EXPECT_EQ(client.path(0), "docs");
+    EXPECT_EQ(client.path(1), "docs/a.txt");
+    EXPECT_EQ(client.checksum(1), kSumB);
+    EXPECT_EQ(client.last_modified(1), 2);
+    EXPECT_TRUE(client.is_directory(0));
+
+    SyncPlanManifest unsorted;
+    unsorted.add("b", 0, "", false, false);
+    unsorted.add("a", 0, "", false, false);
+    EXPECT_THROW(plan_sync_operations(unsorted, SyncPlanManifest()), std::invalid_argument);
+}
+
+TEST(SyncPlannerTest, PartitionedPlanMatchesSingleThread) {
+    std::mt19937 rng(7);
+    std::vector<std::string> paths;
+    for (int i = 0; i < 20000; ++i) paths.push_back("d" + std::to_string(i % 37) + "/f" + std::to_string(i));
+    std::shuffle(paths.begin(), paths.end(), rng);
+
+    SyncPlanManifest client, server;
+    for (const auto& p : paths) {
+        const unsigned r = rng() % 10;
+        if (r < 7) client.add(p, 100 + rng() % 3, r < 4 ? kSumA : kSumB, false, r == 6);
+        if (r >= 3) server.add(p, 100 + rng() % 3, kSumA, false, false);
+    }
+    client.sort_by_path();
+    server.sort_by_path();
+
+    const auto single = flatten(plan_sync_operations(client, server));
+    EXPECT_EQ(single.size(), paths.size());
+    EXPECT_TRUE(std::is_sorted(single.begin(), single.end(),
+                               [](const auto& a, const auto& b) { return a.second < b.second; }));
+
+    SyncPlanOptions options;
+    options.min_partition_entries = 1000;
+    for (unsigned threads : {2u, 3u, 8u, 64u}) {
+        options.threads = threads;
+        EXPECT_EQ(flatten(plan_sync_operations(client, server, options)), single) << threads << " threads";
+    }
+    options.threads = 4;
+    EXPECT_EQ(plan_sync_operations(SyncPlanManifest(), server, options).size(), server.size());
+    EXPECT_EQ(plan_sync_operations(client, SyncPlanManifest(), options).size(), client.size());
+}
+
+TEST(SyncPlannerTest, PairsDeletesAndCreatesWithSameChecksumAsMoves) {
+    const std::string kSumC(64, 'c');
+    SyncPlanManifest client;
+    client.add("old/report.pdf", 0, "", false, true);          // Client đổi tên report.pdf ...
+    client.add("new/report.pdf", 100, kSumA, false, false);    // ... thành new/report.pdf
+    client.add("gone.txt", 0, "", false, true);                // Xoá thật: không có file mới cùng checksum
+    client.add("photo.jpg", 100, kSumB, false, false);         // Server đã đổi tên thành photos/photo.jpg
+    client.add("fresh.txt", 100, kSumC, false, false);         // File mới của client, server có bản trùng nội dung
+    client.add("new", 0, "", true, false);
+    client.sort_by_path();
+
+    SyncPlanManifest server;
+    server.add("copy_of_fresh.txt", 100, kSumC, false, false);
+    server.add("gone.txt", 100, kSumB + "x", false, false);
+    server.add("old/report.pdf", 100, kSumA, false, false);
+    server.add("photos/photo.jpg", 100, kSumB, false, false);
+
+    SyncPlanOptions options;
+    options.detect_moves = true;
+    std::vector<std::string> asked;
+    options.deleted_on_server = [&asked](std::string_view path) {
+        asked.emplace_back(path);
+        return path == "photo.jpg";
+    };
+
+    const auto ops = plan_sync_operations(client, server, options);
+    const std::vector<std::pair<SyncActionType, std::string>> expected = {
+        {SyncActionType::DOWNLOAD_TO_CLIENT, "copy_of_fresh.txt"},
+        {SyncActionType::UPLOAD_TO_SERVER, "fresh.txt"},
+        {SyncActionType::DELETE_ON_SERVER, "gone.txt"},
+        {SyncActionType::UPLOAD_TO_SERVER, "new"},
+        {SyncActionType::MOVE_ON_SERVER, "new/report.pdf"},
+        {SyncActionType::MOVE_ON_CLIENT, "photos/photo.jpg"},
+    };
+    EXPECT_EQ(flatten(ops), expected);
+    EXPECT_EQ(ops[4].source_path, "old/report.pdf");
+    EXPECT_EQ(ops[5].source_path, "photo.jpg");
+    // Chỉ hỏi server cho các path có ứng viên cùng checksum
+    EXPECT_EQ(asked, (std::vector<std::string>{"fresh.txt", "photo.jpg"}));
+
+    // Mặc định: không ghép, giữ xoá + upload / download
+    EXPECT_EQ(plan_sync_operations(client, server).size(), 8u);
+}
+
+TEST(SyncPlannerTest, StreamEmitsSamePlanInPriorityOrder) {
+    std::mt19937 rng(11);
+    SyncPlanManifest client, server;
+    for (int d = 0; d < 40; ++d) {
+        const std::string dir = "d" + std::to_string(d);
+        if (d % 2 == 0) client.add(dir, 0, "", true, false); // Thư mục chỉ có ở client
+        else server.add(dir, 10, "", true, false);
+        for (int i = 0; i < 50; ++i) {
+            const std::string path = dir + "/f" + std::to_string(i);
+            const unsigned r = rng() % 10;
+            if (r < 6) client.add(path, 100 + rng() % 3, r < 3 ? kSumA : kSumB, false, false, (rng() % 8) << 20);
+            if (r >= 4) server.add(path, 100 + rng() % 3, kSumA, false, false);
+        }
+    }
+    client.sort_by_path();
+    server.sort_by_path();
+
+    SyncPlanOptions options;
+    options.stream_slice_entries = 100;
+    options.server_file_size = [](std::string_view path) { return static_cast<std::uint64_t>(path.size()); };
+    std::vector<SyncOperation> streamed;
+    stream_sync_operations(client, server, options, [&streamed](SyncOperation&& op) { streamed.push_back(std::move(op)); });
+
+    auto sorted = [](std::vector<std::pair<SyncActionType, std::string>> ops) {
+        std::sort(ops.begin(), ops.end(), [](const auto& a, const auto& b) { return a.second < b.second; });
+        return ops;
+    };
+    EXPECT_EQ(sorted(flatten(streamed)), flatten(plan_sync_operations(client, server, options)));
+
+    std::map<std::string, std::size_t> position;
+    for (std::size_t i = 0; i < streamed.size(); ++i) position[streamed[i].relative_path] = i;
+    std::size_t first_large = streamed.size();
+    for (std::size_t i = 0; i < streamed.size(); ++i) {
+        const auto& op = streamed[i];
+        const auto slash = op.relative_path.find('/');
+        if (slash != std::string::npos) {
+            EXPECT_LT(position.at(op.relative_path.substr(0, slash)), i) << op.relative_path; // Thư mục trước nội dung
+        }
+        const bool large = !op.is_directory && op.size >= options.large_file_bytes;
+        if (large && first_large == streamed.size()) first_large = i;
+        if (i > first_large) {
+            EXPECT_TRUE(large) << op.relative_path;                 // File lớn sau cùng ...
+            EXPECT_LE(streamed[i - 1].size, op.size);               // ... nhỏ trước
+        }
+    }
+    EXPECT_LT(first_large, streamed.size());
+}
+
+TEST(SyncPlannerTest, StreamPairsMovesAndSendsDeletesLast) {
+    SyncPlanManifest client;
+    client.add("a/old.bin", 0, "", false, true);
+    client.add("gone.txt", 0, "", false, true);
+    client.add("keep.txt", 100, kSumB, false, false, 10);
+    client.add("z/new.bin", 100, kSumA, false, false, 10);
+    client.sort_by_path();
+    SyncPlanManifest server;
+    server.add("a/old.bin", 100, kSumA, false, false);
+    server.add("gone.txt", 100, std::string(64, 'c'), false, false);
+    server.add("keep.txt", 100, kSumB, false, false);
+    server.sort_by_path();
+
+    SyncPlanOptions options;
+    options.detect_moves = true;
+    options.stream_slice_entries = 1;
+    std::vector<SyncOperation> streamed;
+    stream_sync_operations(client, server, options, [&streamed](SyncOperation&& op) { streamed.push_back(std::move(op)); });
+
+    const std::vector<std::pair<SyncActionType, std::string>> expected = {
+        {SyncActionType::NO_ACTION, "keep.txt"},
+        {SyncActionType::MOVE_ON_SERVER, "z/new.bin"},
+        {SyncActionType::DELETE_ON_SERVER, "gone.txt"},
+    };
+    EXPECT_EQ(flatten(streamed), expected);
+    EXPECT_EQ(streamed[1].source_path, "a/old.bin");
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+#include "token_codec.hpp"
+#include "token_revocation.hpp"
+
+#include <chrono>
+#include <vector>
+
+namespace {
+    const std::string SECRET_A = "0123456789abcdef0123456789abcdef";
+    const std::string SECRET_B = "fedcba9876543210fedcba9876543210";
+}
+
+TEST(Base64UrlTest, RoundTrip) {
+    std::vector<std::string> samples = {"", "f", "fo", "foo", "foob", "fooba", "foobar", std::string("\0\xff\x10", 3)};
+    for (const std::string& s : samples) {
+        auto decoded = base64url_decode(base64url_encode(s));
+        ASSERT_TRUE(decoded.has_value());
+        EXPECT_EQ(*decoded, s);
+    }
+    EXPECT_EQ(base64url_encode("foobar"), "Zm9vYmFy");
+    EXPECT_FALSE(base64url_decode("Zm9v+").has_value());
+}
+
+TEST(TokenCodecTest, IssueAndVerify) {
+    TokenCodec codec;
+    ASSERT_TRUE(codec.add_key("k1", SECRET_A));
+    ASSERT_TRUE(codec.set_active_key("k1"));
+
+    TokenClaims issued;
+    std::string token = codec.issue(42, "alice", "alice", std::chrono::seconds(60), &issued);
+    auto claims = codec.verify(token);
+    ASSERT_TRUE(claims.has_value());
+    EXPECT_EQ(claims->user_id, 42);
+    EXPECT_EQ(claims->username, "alice");
+    EXPECT_EQ(claims->home_root, "alice");
+    EXPECT_EQ(claims->key_id, "k1");
+    EXPECT_EQ(claims->token_id, issued.token_id);
+    EXPECT_EQ(claims->expires_at, issued.expires_at);
+}
+
+TEST(TokenCodecTest, RejectsTamperedToken) {
+    TokenCodec codec;
+    codec.add_key("k1", SECRET_A);
+    codec.set_active_key("k1");
+    std::string token = codec.issue(1, "alice", "alice", std::chrono::seconds(60));
+
+    std::string tampered = token;
+    tampered[tampered.size() / 2] = (tampered[tampered.size() / 2] == 'A') ? 'B' : 'A';
+    EXPECT_FALSE(codec.verify(tampered).has_value());
+    EXPECT_FALSE(codec.verify("token_UID1_USERalice_UUIDx").has_value());
+    EXPECT_FALSE(codec.verify("").has_value());
+}
+
+TEST(TokenCodecTest, RejectsExpiredToken) {
+    TokenCodec codec;
+    codec.add_key("k1", SECRET_A);
+    codec.set_active_key("k1");
+    std::string token = codec.issue(1, "alice", "alice", std::chrono::seconds(-1));
+    EXPECT_FALSE(codec.verify(token).has_value());
+}
+
+TEST(TokenCodecTest, KeyRotation) {
+    TokenCodec old_codec;
+    old_codec.load_key_list("k1:" + SECRET_A);
+    old_codec.set_active_key("k1");
+    std::string old_token = old_codec.issue(1, "alice", "alice", std::chrono::seconds(60));
+
+    // New process: both keys present, k2 active. Old tokens still verify.
+    TokenCodec codec;
+    ASSERT_TRUE(codec.load_key_list("k1:" + SECRET_A + ", k2:" + SECRET_B));
+    ASSERT_TRUE(codec.set_active_key("k2"));
+    EXPECT_TRUE(codec.verify(old_token).has_value());
+    auto fresh = codec.verify(codec.issue(2, "bob", "bob", std::chrono::seconds(60)));
+    ASSERT_TRUE(fresh.has_value());
+    EXPECT_EQ(fresh->key_id, "k2");
+
+    // k1 retired: old tokens are rejected.
+    TokenCodec retired;
+    retired.load_key_list("k2:" + SECRET_B);
+    retired.set_active_key("k2");
+    EXPECT_FALSE(retired.verify(old_token).has_value());
+}
+
+TEST(TokenCodecTest, RejectsBadKeys) {
+    TokenCodec codec;
+    EXPECT_FALSE(codec.add_key("k.1", SECRET_A));
+    EXPECT_FALSE(codec.add_key("k1", "short"));
+    EXPECT_FALSE(codec.set_active_key("missing"));
+    EXPECT_FALSE(codec.load_key_list("no-colon"));
+}
+
+TEST(TokenRevocationListTest, RevokeAndPurge) {
+    TokenRevocationList list;
+    EXPECT_FALSE(list.is_revoked("a"));
+
+    std::int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    list.revoke("a", now + 100);
+    list.revoke("b", now + 200);
+    EXPECT_TRUE(list.is_revoked("a"));
+    EXPECT_FALSE(list.is_revoked("c"));
+    EXPECT_EQ(list.size(), 2u);
+
+    EXPECT_EQ(list.purge_expired(now + 150), 1u);
+    EXPECT_FALSE(list.is_revoked("a"));
+    EXPECT_TRUE(list.is_revoked("b"));
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+#include "tree_hash.hpp"
+#include "file_manager.hpp"
+#include "db.hpp"
+#include "config.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+TEST(TreeHashTest, EmptyDirectoryIsHashOfNothing) {
+    std::vector<TreeHashChild> none;
+    EXPECT_EQ(compute_tree_hash(none), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+}
+
+TEST(TreeHashTest, IndependentOfChildOrderButNotOfKindOrValue) {
+    std::vector<TreeHashChild> a = {{"b.txt", false, "11"}, {"a", true, "22"}};
+    std::vector<TreeHashChild> b = {{"a", true, "22"}, {"b.txt", false, "11"}};
+    EXPECT_EQ(compute_tree_hash(a), compute_tree_hash(b));
+
+    std::vector<TreeHashChild> as_file = {{"a", false, "22"}, {"b.txt", false, "11"}};
+    std::vector<TreeHashChild> changed = {{"a", true, "23"}, {"b.txt", false, "11"}};
+    EXPECT_NE(compute_tree_hash(as_file), compute_tree_hash(b));
+    EXPECT_NE(compute_tree_hash(changed), compute_tree_hash(b));
+}
+
+// Hash duy trì tăng dần qua FileManager phải bằng hash tính lại từ đầu.
+class TreeHashIndexTest : public ::testing::Test {
+protected:
+    std::string test_db_path = "test_tree_hash.db";
+    fs::path data_root;
+    fs::path home;
+    std::string saved_user_root;
+    Database* db = nullptr;
+    FileManager* fm = nullptr;
+
+    void SetUp() override {
+        fs::remove(test_db_path);
+        data_root = fs::absolute("test_tree_hash_data");
+        fs::remove_all(data_root);
+        home = fs::weakly_canonical(data_root) / "alice";
+        fs::create_directories(home);
+
+        saved_user_root = Config::USER_DATA_ROOT;
+        Config::USER_DATA_ROOT = data_root.string();
+        db = new Database(test_db_path);
+        ASSERT_TRUE(db->initialize_schema());
+        fm = new FileManager(*db);
+    }
+
+    void TearDown() override {
+        delete fm;
+        delete db;
+        Config::USER_DATA_ROOT = saved_user_root;
+        fs::remove(test_db_path);
+        fs::remove_all(data_root);
+    }
+
+    bool upload(const std::string& path, const std::string& content) {
+        return fm->upload_file(home, path, std::vector<char>(content.begin(), content.end()));
+    }
+
+    std::string home_hash() { return fm->tree_hashes().directory_hash(home.string()); }
+
+    std::string recomputed_home_hash() {
+        db->execute("DELETE FROM directory_hashes;");
+        return home_hash();
+    }
+};
+
+TEST_F(TreeHashIndexTest, MaintainedHashMatchesRecompute) {
+    const std::string empty = home_hash();
+    ASSERT_TRUE(upload("docs/report.txt", "v1"));
+    ASSERT_TRUE(upload("docs/old/notes.txt", "n"));
+    ASSERT_TRUE(upload("top.txt", "t"));
+    ASSERT_TRUE(fm->create_directory(home, "empty"));
+
+    const std::string after_upload = home_hash();
+    EXPECT_NE(after_upload, empty);
+    EXPECT_EQ(after_upload, recomputed_home_hash());
+
+    // Sửa một file sâu bên trong: hash đổi từ thư mục chứa nó tới gốc, thư mục anh em thì không
+    const std::string old_hash = fm->tree_hashes().directory_hash((home / "docs/old").string());
+    ASSERT_TRUE(upload("docs/report.txt", "v2"));
+    EXPECT_NE(home_hash(), after_upload);
+    EXPECT_EQ(fm->tree_hashes().directory_hash((home / "docs/old").string()), old_hash);
+    EXPECT_EQ(home_hash(), recomputed_home_hash());
+
+    // Nội dung trở lại như cũ thì hash cũng trở lại
+    ASSERT_TRUE(upload("docs/report.txt", "v1"));
+    EXPECT_EQ(home_hash(), after_upload);
+}
+
+TEST_F(TreeHashIndexTest, RenameAndDeleteKeepHashesConsistent) {
+    ASSERT_TRUE(upload("a/b/x.txt", "x"));
+    ASSERT_TRUE(upload("a/y.txt", "y"));
+    ASSERT_TRUE(upload("keep.txt", "k"));
+
+    fs::rename(home / "a", home / "c");
+    ASSERT_TRUE(fm->update_metadata_after_rename(home / "a", home / "c", -1));
+    const std::string after_rename = home_hash();
+    EXPECT_EQ(after_rename, recomputed_home_hash());
+
+    auto children = fm->tree_hashes().children(home.string());
+    std::vector<std::string> names;
+    for (const auto& child : children) names.push_back(child.name);
+    std::sort(names.begin(), names.end());
+    EXPECT_EQ(names, (std::vector<std::string>{"c", "keep.txt"}));
+
+    ASSERT_TRUE(fm->delete_file_or_directory(home, "c/b"));
+    EXPECT_NE(home_hash(), after_rename);
+    EXPECT_EQ(home_hash(), recomputed_home_hash());
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -2,7 +2,10 @@
 #include "user_manager.hpp"
 #include "db.hpp"
 #include "config.hpp" // For DATABASE_PATH
+#include "bounded_executor.hpp"
 #include <filesystem>
+#include <future>
+#include <thread>
 
 namespace fs = std::filesystem;
 
@@ -131,6 +134,87 @@ TEST_F(UserManagerTest, GetHomeDir) {
     ASSERT_EQ(fs::weakly_canonical(fs::path(*home_dir_opt)), fs::weakly_canonical(expected_home_dir));
 }
 
+TEST_F(UserManagerTest, StoresSaltedPbkdf2Hash) {
+    std::string h1 = UserManager::hash_password("password", 1000, 16);
+    std::string h2 = UserManager::hash_password("password", 1000, 16);
+    EXPECT_EQ(h1.rfind("pbkdf2_sha256$1000$", 0), 0u);
+    EXPECT_NE(h1, h2); // salt khác nhau
+    EXPECT_TRUE(UserManager::verify_password("password", h1));
+    EXPECT_FALSE(UserManager::verify_password("wrong", h1));
+    EXPECT_FALSE(UserManager::needs_rehash(h1, 1000));
+    EXPECT_TRUE(UserManager::needs_rehash(h1, 2000));
+}
+
+TEST_F(UserManagerTest, LegacyHashIsUpgradedOnLogin) {
+    auto user_id_opt = userManager->register_user("testuser_legacy", "password");
+    ASSERT_TRUE(user_id_opt.has_value());
+    // SHA-256("password") như các bản trước lưu.
+    ASSERT_TRUE(db->execute("UPDATE users SET password_hash = "
+        "'5e884898da28047151d0e56f8dc6292773603d0d6aabbdd62a11ef721d1542d8' WHERE username = 'testuser_legacy';"));
+
+    EXPECT_FALSE(userManager->login_user("testuser_legacy", "wrong").has_value());
+    EXPECT_TRUE(userManager->login_user("testuser_legacy", "password").has_value());
+
+    std::string stored;
+    db->execute_query("SELECT password_hash FROM users WHERE username = 'testuser_legacy';", [&](sqlite3_stmt* stmt) {
+        stored = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+    });
+    EXPECT_EQ(stored.rfind("pbkdf2_sha256$", 0), 0u);
+    EXPECT_TRUE(userManager->login_user("testuser_legacy", "password").has_value());
+}
+
+TEST(BoundedExecutorTest, RejectsWhenQueueIsFull) {
+    BoundedExecutor executor("test", 1, 1);
+    std::promise<void> release;
+    std::shared_future<void> gate = release.get_future().share();
+
+    auto running = executor.submit([gate]() { gate.wait(); return 1; });
+    // Chờ worker nhận task đầu tiên để hàng đợi trống.
+    while (executor.stats().active == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    auto queued = executor.submit([]() { return 2; });
+    EXPECT_THROW(executor.submit([]() { return 3; }), ExecutorSaturated);
+
+    release.set_value();
+    EXPECT_EQ(running.get(), 1);
+    EXPECT_EQ(queued.get(), 2);
+    BoundedExecutor::Stats st = executor.stats();
+    EXPECT_EQ(st.rejected, 1u);
+    EXPECT_EQ(st.submitted, 2u);
+}
+
+TEST(BoundedExecutorTest, ZeroQueueLimitRunsOnIdleWorkers) {
+    BoundedExecutor executor("test", 2, 0);
+    std::promise<void> release;
+    std::shared_future<void> gate = release.get_future().share();
+
+    // Không có chỗ chờ, nhưng worker rảnh vẫn nhận việc
+    auto first = executor.submit([gate]() { gate.wait(); return 1; });
+    auto second = executor.submit([gate]() { gate.wait(); return 2; });
+    EXPECT_THROW(executor.submit([]() { return 3; }), ExecutorSaturated);
+
+    release.set_value();
+    EXPECT_EQ(first.get(), 1);
+    EXPECT_EQ(second.get(), 2);
+    // Worker lại rảnh khi quay về chờ job kế tiếp
+    int third = 0;
+    for (int i = 0; i < 1000 && third == 0; ++i) {
+        try {
+            third = executor.run([]() { return 3; });
+        } catch (const ExecutorSaturated&) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    EXPECT_EQ(third, 3);
+    EXPECT_EQ(executor.stats().submitted, 3u);
+}
+
+TEST_F(UserManagerTest, LoginUsesHashExecutor) {
+    BoundedExecutor executor("password_hashing", 2, 4);
+    UserManager pooled(*db, &executor);
+    ASSERT_TRUE(pooled.register_user("testuser_pooled", "password").has_value());
+    EXPECT_TRUE(pooled.login_user("testuser_pooled", "password").has_value());
+    EXPECT_EQ(executor.stats().submitted, 2u);
+}
 
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);